@@ -124,6 +124,52 @@ FaceRecognition112V1S8 recognizer;
 #endif
 #endif
 
+// Streaming does not wait for detection: stream_handler hands a copy of a frame to
+// face_detect_task on the other core whenever it is idle, and overlays every streamed
+// frame with the latest results, so stream FPS does not depend on inference time.
+#define FACE_MAX_RESULTS       8
+#define FACE_DETECT_WIDTH      240      // wider frames are halved before detection
+#define FACE_RESULT_MAX_AGE_US 1000000  // older results are no longer overlaid
+#define FACE_DETECT_STACK      (8 * 1024)
+#define FACE_DETECT_PRIO       2
+#define FACE_DETECT_CORE       1
+
+typedef struct {
+  int box[4];
+  int keypoint[10];
+} face_box_t;
+
+typedef struct {
+  face_box_t faces[FACE_MAX_RESULTS];
+  int count;
+  int face_id;
+  int width;  // size of the image detection ran on, boxes are scaled from this
+  int height;
+  int64_t timestamp;
+#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
+  char label[32];
+  uint32_t label_color;
+#endif
+} face_results_t;
+
+typedef struct {
+  uint8_t *buf;  // copy of the camera frame to detect on
+  size_t len;
+  size_t size;
+  int width;
+  int height;
+  pixformat_t format;
+} face_job_t;
+
+static face_job_t face_job;
+static face_results_t face_results;
+static SemaphoreHandle_t face_mutex = NULL;
+static TaskHandle_t face_task = NULL;
+static volatile bool face_busy = false;
+static volatile uint32_t face_detect_us = 0;  // duration of the last detection
+static uint8_t *face_rgb = NULL;              // decoded image for detection
+static size_t face_rgb_size = 0;
+
 #endif
 
 typedef struct {
@@ -172,56 +218,52 @@ static void rgb_print(fb_data_t *fb, uint32_t color, const char *str) {
   fb_gfx_print(fb, (fb->width - (strlen(str) * 14)) / 2, 10, color, str);
 }
 
-static int rgb_printf(fb_data_t *fb, uint32_t color, const char *format, ...) {
-  char loc_buf[64];
-  char *temp = loc_buf;
-  int len;
-  va_list arg;
-  va_list copy;
-  va_start(arg, format);
-  va_copy(copy, arg);
-  len = vsnprintf(loc_buf, sizeof(loc_buf), format, arg);
-  va_end(copy);
-  if (len >= sizeof(loc_buf)) {
-    temp = (char *)malloc(len + 1);
-    if (temp == NULL) {
-      return 0;
+#endif
+
+static void store_face_results(std::list<dl::detect::result_t> *results, int width, int height, face_results_t *out) {
+  int i = 0;
+  for (std::list<dl::detect::result_t>::iterator prediction = results->begin(); prediction != results->end() && i < FACE_MAX_RESULTS; prediction++, i++) {
+    for (int j = 0; j < 4; j++) {
+      out->faces[i].box[j] = (int)prediction->box[j];
+    }
+    for (int j = 0; j < 10; j++) {
+      out->faces[i].keypoint[j] = j < (int)prediction->keypoint.size() ? prediction->keypoint[j] : 0;
     }
   }
-  vsnprintf(temp, len + 1, format, arg);
-  va_end(arg);
-  rgb_print(fb, color, temp);
-  if (len > 64) {
-    free(temp);
-  }
-  return len;
+  out->count = i;
+  out->width = width;
+  out->height = height;
+  out->timestamp = esp_timer_get_time();
 }
-#endif
-static void draw_face_boxes(fb_data_t *fb, std::list<dl::detect::result_t> *results, int face_id) {
+
+static void draw_face_boxes(fb_data_t *fb, const face_results_t *results) {
   int x, y, w, h;
   uint32_t color = FACE_COLOR_YELLOW;
-  if (face_id < 0) {
+  if (results->face_id < 0) {
     color = FACE_COLOR_RED;
-  } else if (face_id > 0) {
+  } else if (results->face_id > 0) {
     color = FACE_COLOR_GREEN;
   }
   if (fb->bytes_per_pixel == 2) {
     //color = ((color >> 8) & 0xF800) | ((color >> 3) & 0x07E0) | (color & 0x001F);
     color = ((color >> 16) & 0x001F) | ((color >> 3) & 0x07E0) | ((color << 8) & 0xF800);
   }
-  int i = 0;
-  for (std::list<dl::detect::result_t>::iterator prediction = results->begin(); prediction != results->end(); prediction++, i++) {
-    // rectangle box
-    x = (int)prediction->box[0];
-    y = (int)prediction->box[1];
-    w = (int)prediction->box[2] - x + 1;
-    h = (int)prediction->box[3] - y + 1;
+  for (int i = 0; i < results->count; i++) {
+    const face_box_t *face = &results->faces[i];
+    // rectangle box, scaled from the detection image to this frame
+    x = max(face->box[0] * fb->width / results->width, 0);
+    y = max(face->box[1] * fb->height / results->height, 0);
+    w = (face->box[2] + 1) * fb->width / results->width - x;
+    h = (face->box[3] + 1) * fb->height / results->height - y;
     if ((x + w) > fb->width) {
       w = fb->width - x;
     }
     if ((y + h) > fb->height) {
       h = fb->height - y;
     }
+    if (w <= 0 || h <= 0) {
+      continue;
+    }
     fb_gfx_drawFastHLine(fb, x, y, w, color);
     fb_gfx_drawFastHLine(fb, x, y + h - 1, w, color);
     fb_gfx_drawFastVLine(fb, x, y, h, color);
@@ -230,16 +272,21 @@ static void draw_face_boxes(fb_data_t *fb, std::list<dl::detect::result_t> *resu
     // landmarks (left eye, mouth left, nose, right eye, mouth right)
     int x0, y0, j;
     for (j = 0; j < 10; j += 2) {
-      x0 = (int)prediction->keypoint[j];
-      y0 = (int)prediction->keypoint[j + 1];
+      x0 = face->keypoint[j] * fb->width / results->width;
+      y0 = face->keypoint[j + 1] * fb->height / results->height;
       fb_gfx_fillRect(fb, x0, y0, 3, 3, color);
     }
 #endif
   }
+#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
+  if (results->label[0]) {
+    rgb_print(fb, results->label_color, results->label);
+  }
+#endif
 }
 
 #if CONFIG_ESP_FACE_RECOGNITION_ENABLED
-static int run_face_recognition(fb_data_t *fb, std::list<dl::detect::result_t> *results) {
+static int run_face_recognition(fb_data_t *fb, std::list<dl::detect::result_t> *results, face_results_t *out) {
   std::vector<int> landmarks = results->front().keypoint;
   int id = -1;
 
@@ -251,18 +298,157 @@ static int run_face_recognition(fb_data_t *fb, std::list<dl::detect::result_t> *
   if (enrolled_count < FACE_ID_SAVE_NUMBER && is_enrolling) {
     id = recognizer.enroll_id(tensor, landmarks, "", true);
     log_i("Enrolled ID: %d", id);
-    rgb_printf(fb, FACE_COLOR_CYAN, "ID[%u]", id);
+    snprintf(out->label, sizeof(out->label), "ID[%u]", id);
+    out->label_color = FACE_COLOR_CYAN;
   }
 
+  // label is drawn with the boxes, so it appears on every frame the results are overlaid on
   face_info_t recognize = recognizer.recognize(tensor, landmarks);
   if (recognize.id >= 0) {
-    rgb_printf(fb, FACE_COLOR_GREEN, "ID[%u]: %.2f", recognize.id, recognize.similarity);
+    snprintf(out->label, sizeof(out->label), "ID[%u]: %.2f", recognize.id, recognize.similarity);
+    out->label_color = FACE_COLOR_GREEN;
   } else {
-    rgb_print(fb, FACE_COLOR_RED, "Intruder Alert!");
+    snprintf(out->label, sizeof(out->label), "Intruder Alert!");
+    out->label_color = FACE_COLOR_RED;
   }
   return recognize.id;
 }
 #endif
+
+static bool face_decode(face_job_t *job, fb_data_t *rfb) {
+  // decode the frame copy for detection, halved when wider than FACE_DETECT_WIDTH,
+  // except for recognition which needs the full size RGB888 image
+  bool halve = job->width > FACE_DETECT_WIDTH;
+#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
+  if (recognition_enabled) {
+    halve = false;
+  }
+#endif
+  rfb->width = halve ? job->width / 2 : job->width;
+  rfb->height = halve ? job->height / 2 : job->height;
+  size_t needed = job->width * job->height * 3;
+  if (face_rgb_size < needed) {
+    free(face_rgb);
+    face_rgb = (uint8_t *)malloc(needed);
+    face_rgb_size = face_rgb ? needed : 0;
+    if (!face_rgb) {
+      log_e("face_rgb malloc failed");
+      return false;
+    }
+  }
+  rfb->data = face_rgb;
+#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
+  bool rgb565 = !recognition_enabled;
+#else
+  bool rgb565 = true;
+#endif
+  if (rgb565 && job->format == PIXFORMAT_JPEG) {
+    rfb->bytes_per_pixel = 2;
+    rfb->format = FB_RGB565;
+    return jpg2rgb565(job->buf, job->len, face_rgb, halve ? JPG_SCALE_2X : JPG_SCALE_NONE);
+  }
+  if (rgb565 && job->format == PIXFORMAT_RGB565) {
+    rfb->bytes_per_pixel = 2;
+    rfb->format = FB_RGB565;
+    uint16_t *src = (uint16_t *)job->buf;
+    uint16_t *dst = (uint16_t *)face_rgb;
+    int step = halve ? 2 : 1;
+    for (int y = 0; y < rfb->height; y++) {
+      for (int x = 0; x < rfb->width; x++) {
+        *dst++ = src[(y * step) * job->width + x * step];
+      }
+    }
+    return true;
+  }
+  rfb->width = job->width;
+  rfb->height = job->height;
+  rfb->bytes_per_pixel = 3;
+  rfb->format = FB_BGR888;
+  return fmt2rgb888(job->buf, job->len, job->format, face_rgb);
+}
+
+static void face_detect_task(void *arg) {
+#if TWO_STAGE
+  HumanFaceDetectMSR01 s1(0.1F, 0.5F, 10, 0.2F);
+  HumanFaceDetectMNP01 s2(0.5F, 0.3F, 5);
+#else
+  HumanFaceDetectMSR01 s1(0.3F, 0.5F, 10, 0.2F);
+#endif
+  face_results_t latest;
+  fb_data_t rfb;
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    int64_t fr_start = esp_timer_get_time();
+    memset(&latest, 0, sizeof(latest));
+    if (!face_decode(&face_job, &rfb)) {
+      log_e("Face detect decode failed");
+      face_busy = false;
+      continue;
+    }
+    std::list<dl::detect::result_t> *results;
+    if (rfb.bytes_per_pixel == 2) {
+#if TWO_STAGE
+      std::list<dl::detect::result_t> &candidates = s1.infer((uint16_t *)rfb.data, {rfb.height, rfb.width, 3});
+      results = &s2.infer((uint16_t *)rfb.data, {rfb.height, rfb.width, 3}, candidates);
+#else
+      results = &s1.infer((uint16_t *)rfb.data, {rfb.height, rfb.width, 3});
+#endif
+    } else {
+#if TWO_STAGE
+      std::list<dl::detect::result_t> &candidates = s1.infer((uint8_t *)rfb.data, {rfb.height, rfb.width, 3});
+      results = &s2.infer((uint8_t *)rfb.data, {rfb.height, rfb.width, 3}, candidates);
+#else
+      results = &s1.infer((uint8_t *)rfb.data, {rfb.height, rfb.width, 3});
+#endif
+    }
+#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
+    if (results->size() > 0 && recognition_enabled && rfb.bytes_per_pixel == 3) {
+      latest.face_id = run_face_recognition(&rfb, results, &latest);
+    }
+#endif
+    store_face_results(results, rfb.width, rfb.height, &latest);
+    face_detect_us = esp_timer_get_time() - fr_start;
+    xSemaphoreTake(face_mutex, portMAX_DELAY);
+    face_results = latest;
+    xSemaphoreGive(face_mutex);
+    face_busy = false;
+  }
+}
+
+static void face_submit(camera_fb_t *fb) {
+  // pass a copy of the frame to face_detect_task if it is ready for another
+  if (face_busy || face_task == NULL) {
+    return;
+  }
+  size_t needed = max(fb->len, fb->width * fb->height * 2);  // stays big enough for any jpeg at this size
+  if (face_job.size < needed) {
+    free(face_job.buf);
+    face_job.buf = (uint8_t *)malloc(needed);
+    face_job.size = face_job.buf ? needed : 0;
+    if (!face_job.buf) {
+      log_e("face_job malloc failed");
+      return;
+    }
+  }
+  memcpy(face_job.buf, fb->buf, fb->len);
+  face_job.len = fb->len;
+  face_job.width = fb->width;
+  face_job.height = fb->height;
+  face_job.format = fb->format;
+  face_busy = true;
+  xTaskNotifyGive(face_task);
+}
+
+static bool face_overlay(face_results_t *overlay) {
+  // latest detection results, unless too old to still match the picture
+  xSemaphoreTake(face_mutex, portMAX_DELAY);
+  bool current = face_results.count > 0 && esp_timer_get_time() - face_results.timestamp < FACE_RESULT_MAX_AGE_US;
+  if (current) {
+    *overlay = face_results;
+  }
+  xSemaphoreGive(face_mutex);
+  return current;
+}
 #endif
 
 #if CONFIG_LED_ILLUMINATOR_ENABLED
@@ -367,6 +553,8 @@ static esp_err_t capture_handler(httpd_req_t *req) {
   bool detected = false;
 #endif
   int face_id = 0;
+  face_results_t found;
+  memset(&found, 0, sizeof(found));
   if (!detection_enabled || fb->width > 400) {
 #endif
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
@@ -420,7 +608,8 @@ static esp_err_t capture_handler(httpd_req_t *req) {
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
       detected = true;
 #endif
-      draw_face_boxes(&rfb, &results, face_id);
+      store_face_results(&results, fb->width, fb->height, &found);
+      draw_face_boxes(&rfb, &found);
     }
     s = fmt2jpg_cb(fb->buf, fb->len, fb->width, fb->height, PIXFORMAT_RGB565, 90, jpg_encode_stream, &jchunk);
     esp_camera_fb_return(fb);
@@ -466,10 +655,12 @@ static esp_err_t capture_handler(httpd_req_t *req) {
 #endif
 #if CONFIG_ESP_FACE_RECOGNITION_ENABLED
       if (recognition_enabled) {
-        face_id = run_face_recognition(&rfb, &results);
+        face_id = run_face_recognition(&rfb, &results, &found);
+        found.face_id = face_id;
       }
 #endif
-      draw_face_boxes(&rfb, &results, face_id);
+      store_face_results(&results, out_width, out_height, &found);
+      draw_face_boxes(&rfb, &found);
     }
 
     s = fmt2jpg_cb(out_buf, out_len, out_width, out_height, PIXFORMAT_RGB888, 90, jpg_encode_stream, &jchunk);
@@ -500,21 +691,15 @@ static esp_err_t stream_handler(httpd_req_t *req) {
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
   bool detected = false;
   int64_t fr_ready = 0;
-  int64_t fr_recognize = 0;
   int64_t fr_encode = 0;
-  int64_t fr_face = 0;
   int64_t fr_start = 0;
 #endif
   int face_id = 0;
-  size_t out_len = 0, out_width = 0, out_height = 0;
+  size_t out_len = 0;
   uint8_t *out_buf = NULL;
   bool s = false;
-#if TWO_STAGE
-  HumanFaceDetectMSR01 s1(0.1F, 0.5F, 10, 0.2F);
-  HumanFaceDetectMNP01 s2(0.5F, 0.3F, 5);
-#else
-  HumanFaceDetectMSR01 s1(0.3F, 0.5F, 10, 0.2F);
-#endif
+  bool annotate = false;
+  face_results_t overlay;
 #endif
 
   static int64_t last_frame = 0;
@@ -541,6 +726,7 @@ static esp_err_t stream_handler(httpd_req_t *req) {
     detected = false;
 #endif
     face_id = 0;
+    annotate = false;
 #endif
 
     fb = esp_camera_fb_get();
@@ -555,10 +741,12 @@ static esp_err_t stream_handler(httpd_req_t *req) {
       fr_start = esp_timer_get_time();
       fr_ready = fr_start;
       fr_encode = fr_start;
-      fr_recognize = fr_start;
-      fr_face = fr_start;
 #endif
-      if (!detection_enabled || fb->width > 400) {
+      if (detection_enabled && fb->width <= 400) {
+        face_submit(fb);
+        annotate = face_overlay(&overlay);
+      }
+      if (!annotate) {
 #endif
         if (fb->format != PIXFORMAT_JPEG) {
           bool jpeg_converted = frame2jpg(fb, 80, &_jpg_buf, &_jpg_buf_len);
@@ -574,36 +762,22 @@ static esp_err_t stream_handler(httpd_req_t *req) {
         }
 #if CONFIG_ESP_FACE_DETECT_ENABLED
       } else {
-        if (fb->format == PIXFORMAT_RGB565
-#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
-            && !recognition_enabled
-#endif
-        ) {
+        // draw the latest detection results, frames without faces go out unchanged
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-          fr_ready = esp_timer_get_time();
-#endif
-#if TWO_STAGE
-          std::list<dl::detect::result_t> &candidates = s1.infer((uint16_t *)fb->buf, {(int)fb->height, (int)fb->width, 3});
-          std::list<dl::detect::result_t> &results = s2.infer((uint16_t *)fb->buf, {(int)fb->height, (int)fb->width, 3}, candidates);
-#else
-          std::list<dl::detect::result_t> &results = s1.infer((uint16_t *)fb->buf, {(int)fb->height, (int)fb->width, 3});
-#endif
-#if CONFIG_ESP_FACE_DETECT_ENABLED && ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-          fr_face = esp_timer_get_time();
-          fr_recognize = fr_face;
-#endif
-          if (results.size() > 0) {
-            fb_data_t rfb;
-            rfb.width = fb->width;
-            rfb.height = fb->height;
-            rfb.data = fb->buf;
-            rfb.bytes_per_pixel = 2;
-            rfb.format = FB_RGB565;
+        detected = true;
+#endif
+        face_id = overlay.face_id;
+        fb_data_t rfb;
+        rfb.width = fb->width;
+        rfb.height = fb->height;
+        if (fb->format == PIXFORMAT_RGB565) {
+          rfb.data = fb->buf;
+          rfb.bytes_per_pixel = 2;
+          rfb.format = FB_RGB565;
+          draw_face_boxes(&rfb, &overlay);
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-            detected = true;
+          fr_ready = esp_timer_get_time();
 #endif
-            draw_face_boxes(&rfb, &results, face_id);
-          }
           s = fmt2jpg(fb->buf, fb->len, fb->width, fb->height, PIXFORMAT_RGB565, 80, &_jpg_buf, &_jpg_buf_len);
           esp_camera_fb_return(fb);
           fb = NULL;
@@ -611,13 +785,8 @@ static esp_err_t stream_handler(httpd_req_t *req) {
             log_e("fmt2jpg failed");
             res = ESP_FAIL;
           }
-#if CONFIG_ESP_FACE_DETECT_ENABLED && ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-          fr_encode = esp_timer_get_time();
-#endif
         } else {
           out_len = fb->width * fb->height * 3;
-          out_width = fb->width;
-          out_height = fb->height;
           out_buf = (uint8_t *)malloc(out_len);
           if (!out_buf) {
             log_e("out_buf malloc failed");
@@ -631,55 +800,25 @@ static esp_err_t stream_handler(httpd_req_t *req) {
               log_e("To rgb888 failed");
               res = ESP_FAIL;
             } else {
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-              fr_ready = esp_timer_get_time();
-#endif
-
-              fb_data_t rfb;
-              rfb.width = out_width;
-              rfb.height = out_height;
               rfb.data = out_buf;
               rfb.bytes_per_pixel = 3;
               rfb.format = FB_BGR888;
-
-#if TWO_STAGE
-              std::list<dl::detect::result_t> &candidates = s1.infer((uint8_t *)out_buf, {(int)out_height, (int)out_width, 3});
-              std::list<dl::detect::result_t> &results = s2.infer((uint8_t *)out_buf, {(int)out_height, (int)out_width, 3}, candidates);
-#else
-              std::list<dl::detect::result_t> &results = s1.infer((uint8_t *)out_buf, {(int)out_height, (int)out_width, 3});
-#endif
-
-#if CONFIG_ESP_FACE_DETECT_ENABLED && ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-              fr_face = esp_timer_get_time();
-              fr_recognize = fr_face;
-#endif
-
-              if (results.size() > 0) {
+              draw_face_boxes(&rfb, &overlay);
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-                detected = true;
-#endif
-#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
-                if (recognition_enabled) {
-                  face_id = run_face_recognition(&rfb, &results);
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-                  fr_recognize = esp_timer_get_time();
-#endif
-                }
+              fr_ready = esp_timer_get_time();
 #endif
-                draw_face_boxes(&rfb, &results, face_id);
-              }
-              s = fmt2jpg(out_buf, out_len, out_width, out_height, PIXFORMAT_RGB888, 90, &_jpg_buf, &_jpg_buf_len);
+              s = fmt2jpg(out_buf, out_len, rfb.width, rfb.height, PIXFORMAT_RGB888, 90, &_jpg_buf, &_jpg_buf_len);
               free(out_buf);
               if (!s) {
                 log_e("fmt2jpg failed");
                 res = ESP_FAIL;
               }
-#if CONFIG_ESP_FACE_DETECT_ENABLED && ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-              fr_encode = esp_timer_get_time();
-#endif
             }
           }
         }
+#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
+        fr_encode = esp_timer_get_time();
+#endif
       }
 #endif
     }
@@ -709,10 +848,9 @@ static esp_err_t stream_handler(httpd_req_t *req) {
 
 #if CONFIG_ESP_FACE_DETECT_ENABLED && ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
     int64_t ready_time = (fr_ready - fr_start) / 1000;
-    int64_t face_time = (fr_face - fr_ready) / 1000;
-    int64_t recognize_time = (fr_recognize - fr_face) / 1000;
-    int64_t encode_time = (fr_encode - fr_recognize) / 1000;
+    int64_t encode_time = (fr_encode - fr_ready) / 1000;
     int64_t process_time = (fr_encode - fr_start) / 1000;
+    uint32_t detect_time = detection_enabled ? face_detect_us / 1000 : 0;
 #endif
 
     int64_t frame_time = fr_end - last_frame;
@@ -723,13 +861,13 @@ static esp_err_t stream_handler(httpd_req_t *req) {
     log_i(
       "MJPG: %uB %ums (%.1ffps), AVG: %ums (%.1ffps)"
 #if CONFIG_ESP_FACE_DETECT_ENABLED
-      ", %u+%u+%u+%u=%u %s%d"
+      ", %u+%u=%u, detect %ums %s%d"
 #endif
       ,
       (uint32_t)(_jpg_buf_len), (uint32_t)frame_time, 1000.0 / (uint32_t)frame_time, avg_frame_time, 1000.0 / avg_frame_time
 #if CONFIG_ESP_FACE_DETECT_ENABLED
       ,
-      (uint32_t)ready_time, (uint32_t)face_time, (uint32_t)recognize_time, (uint32_t)encode_time, (uint32_t)process_time, (detected) ? "DETECTED " : "", face_id
+      (uint32_t)ready_time, (uint32_t)encode_time, (uint32_t)process_time, detect_time, (detected) ? "DETECTED " : "", face_id
 #endif
     );
   }
@@ -1289,6 +1427,14 @@ void startCameraServer() {
 
   ra_filter_init(&ra_filter, 20);
 
+#if CONFIG_ESP_FACE_DETECT_ENABLED
+  face_mutex = xSemaphoreCreateMutex();
+  if (xTaskCreatePinnedToCore(face_detect_task, "face_detect", FACE_DETECT_STACK, NULL, FACE_DETECT_PRIO, &face_task, FACE_DETECT_CORE) != pdPASS) {
+    log_e("Failed to start face detection task");
+    face_task = NULL;
+  }
+#endif
+
 #if CONFIG_ESP_FACE_RECOGNITION_ENABLED
   recognizer.set_partition(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "fr");
 
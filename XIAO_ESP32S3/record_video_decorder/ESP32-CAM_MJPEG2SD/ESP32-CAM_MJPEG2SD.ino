@@ -53,6 +53,7 @@ void setup() {
     prepTelegram();
 #endif
     prepRecording(); 
+    startIdleMon();
     checkMemory();
   } 
 }
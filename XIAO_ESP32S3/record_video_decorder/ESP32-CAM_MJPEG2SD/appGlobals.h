@@ -102,6 +102,9 @@ CAMERA_MODEL_ESP32S3_CAM_LCD
 #define RGB888_BYTES 3 // number of bytes per pixel
 #define GRAYSCALE_BYTES 1 // number of bytes per pixel 
 #define MAX_ALERT MAX_JPEG
+#define ALERT_WIDTH 480 // max motion alert image width, selects jpeg decode scale
+#define ALERT_QUALITY 60
+#define ALERT_COALESCE_SECS 30 // motion alerts this close to the last are sent together
 
 #ifdef SIDE_ALARM
 #define STORAGE LittleFS
@@ -109,8 +112,19 @@ CAMERA_MODEL_ESP32S3_CAM_LCD
 #define STORAGE SD_MMC
 #endif
 #define GITHUB_PATH "/s60sc/ESP32-CAM_MJPEG2SD/master"
-#define RAMSIZE (1024 * 8) // set this to multiple of SD card sector size (512 or 1024 bytes)
+#ifndef RAMSIZE
+#define RAMSIZE (1024 * 8) // SD write coalescing size, set this to multiple of SD card cluster size (or at least sector size 512 bytes)
+#endif
 #define CHUNKSIZE (1024 * 4)
+#define MAX_READ_AHEAD 16 // max RAMSIZE blocks buffered ahead of playback
+#define READ_AHEAD_MS 500 // playback time to hold in read ahead blocks
+#define DOWNLOAD_READ_AHEAD 4 // CHUNKSIZE blocks buffered ahead of file download
+#define THUMB_INTERVAL 2000 // ms of clip time between sidecar thumbnails
+#define MAX_THUMBS 8 // thumbnails per clip sidecar
+#define THUMB_WIDTH 200 // max thumbnail width, selects jpeg decode scale
+#define THUMB_QUALITY 60
+#define THUMB_STORE_SIZE (96 * 1024) // PSRAM holding thumbnails of current clip
+#define THUMB_HDR_LEN 1024 // max sidecar json line
 #define ISCAM // cam specific code in generics
 
 #define IS_IO_EXTENDER false // must be false except for IO_Extender
@@ -122,13 +136,16 @@ CAMERA_MODEL_ESP32S3_CAM_LCD
 #define AVI_EXT "avi"
 #define CSV_EXT "csv"
 #define SRT_EXT "srt"
+#define TLM_EXT "tlm"
+#define THM_EXT "thm"
 #define AVI_HEADER_LEN 310 // AVI header length
 #define CHUNK_HDR 8 // bytes per jpeg hdr in AVI 
+#define ADPCM_BLOCK_LEN 256 // bytes per IMA-ADPCM audio block
+#define ADPCM_BLOCK_SAMPLES ((ADPCM_BLOCK_LEN - 4) * 2 + 1) // samples per block, first held in block header
 #define WAVTEMP "/current.wav"
 #define AVITEMP "/current.avi"
 #define TLTEMP "/current.tl"
-#define TELETEMP "/current.csv"
-#define SRTTEMP "/current.srt"
+#define TELETEMP "/current.tlm"
 
 // non default pins configured for SD card on given camera board
 #if defined(CAMERA_MODEL_ESP32S3_EYE) || defined(CAMERA_MODEL_FREENOVE_ESP32S3_CAM)
@@ -157,13 +174,17 @@ CAMERA_MODEL_ESP32S3_CAM_LCD
 #define BATT_STACK_SIZE (1024 * 2)
 #define CAPTURE_STACK_SIZE (1024 * 4)
 #define EMAIL_STACK_SIZE (1024 * 6)
+#define ALERT_STACK_SIZE (1024 * 4)
 #define FS_STACK_SIZE (1024 * 4)
 #define LOG_STACK_SIZE (1024 * 3)
+#define LOGFLUSH_STACK_SIZE (1024 * 4)
 #define MIC_STACK_SIZE (1024 * 4)
 #define MQTT_STACK_SIZE (1024 * 4)
 #define PING_STACK_SIZE (1024 * 5)
 #define PLAYBACK_STACK_SIZE (1024 * 2)
+#define DOWNLOAD_STACK_SIZE (1024 * 2)
 #define SERVO_STACK_SIZE (1024)
+#define STORAGE_STACK_SIZE (1024 * 4)
 #define SUSTAIN_STACK_SIZE (1024 * 4)
 #define TGRAM_STACK_SIZE (1024 * 6)
 #define TELEM_STACK_SIZE (1024 * 4)
@@ -174,11 +195,14 @@ CAMERA_MODEL_ESP32S3_CAM_LCD
 #define SUSTAIN_PRI 5
 #define STICK_PRI 5
 #define PLAY_PRI 4
+#define DOWNLOAD_PRI 4
 #define TELEM_PRI 3
 #define MIC_PRI 2
 #define TGRAM_PRI 1
 #define EMAIL_PRI 1
+#define ALERT_PRI 1
 #define FTP_PRI 1
+#define STORAGE_PRI 1
 #define LOG_PRI 1
 #define MQTT_PRI 1
 #define LED_PRI 1
@@ -210,26 +234,37 @@ struct fnameStruct {
 
 // global app specific functions
 
-size_t getAudioBuffer(bool endStream);
+uint8_t* getAdpcmAudio(size_t* audLen);
+int16_t* getAudioBlock(uint32_t* seq, size_t* blockLen);
 void buildAviHdr(uint8_t FPS, uint8_t frameType, uint16_t frameCnt, bool isTL = false);
 void buildAviIdx(size_t dataSize, bool isVid = true, bool isTL = false);
 size_t buildSubtitle(int srtSeqNo, uint32_t sampleInterval);
 bool checkMotion(camera_fb_t* fb, bool motionStatus);
 bool checkSDFiles();
+void closeAudioStream();
 void currentStackUsage();
 void doIOExtPing();
+bool expandTelemetry(const char* fileName);
 void finalizeAviIndex(uint16_t frameCnt, bool isTL = false);
 void finishAudio(bool isValid);
 mjpegStruct getNextFrame(bool firstCall = false);
 bool getPIRval();
 bool haveWavFile(bool isTL = false);
 bool isNight(uint8_t nightSwitch);
+size_t motionArenaHighWater();
 void keepFrame(camera_fb_t* fb);
+bool holdAlertFrame(uint8_t** jpgBuf, size_t* jpgLen);
+void raiseAlert();
+void releaseAlertFrame();
 void motorSpeed(int speedVal);
+const uint8_t* openAudioStream(uint32_t* seq);
 void openSDfile(const char* streamFile);
 void prepAviIndex(bool isTL = false);
 bool prepCam();
 bool prepRecording();
+void publishStreamFrame(camera_fb_t* fb);
+void releaseAdpcmAudio(size_t audLen);
+esp_err_t sendThumb(httpd_req_t* req, const char* aviName, bool infoOnly);
 void prepTelemetry();
 void prepMic();
 void setCamPan(int panVal);
@@ -264,6 +299,7 @@ extern int detectNumBands;
 extern int detectStartBand;
 extern int detectEndBand; // inclusive
 extern int detectChangeThreshold; // min difference in pixel comparison to indicate a change
+extern bool motionDC; // grayscale motion from JPEG DC coefficients instead of full decode
 extern bool mlUse; // whether to use ML for motion detection, requires INCLUDE_TINYML to be true
 extern float mlProbability; // minimum probability (0.0 - 1.0) for positive classification
 
@@ -283,11 +319,15 @@ extern bool forcePlayback; // playback enabled by user
 extern uint8_t FPS;
 extern uint8_t fsizePtr; // index to frameData[] for record
 extern bool isCapturing;
+extern uint32_t framesCaptured; // since boot
 extern uint8_t lightLevel;  
 extern uint8_t lampLevel;  
 extern int micGain;
+extern bool adpcmCapture; // current recording is interleaving ADPCM audio
 extern uint8_t minSeconds; // default min video length (includes moveStopSecs time)
 extern float motionVal;  // motion sensitivity setting - min percentage of changed pixels that constitute a movement
+extern uint32_t motionChanges; // changed pixels at last motion check
+extern uint32_t motionThreshold; // changed pixels needed for movement at last motion check
 extern uint8_t nightSwitch; // initial white level % for night/day switching
 extern bool nightTime; 
 extern bool stopPlayback;
@@ -311,11 +351,8 @@ extern uint8_t aviHeader[];
 extern const uint8_t dcBuf[]; // 00dc
 extern const uint8_t wbBuf[]; // 01wb
 extern byte* uartData;
-extern size_t streamBufferSize[];
-extern byte* streamBuffer[]; // buffer for stream frame
 extern size_t motionJpegLen;
 extern uint8_t* motionJpeg;
-extern uint8_t* audioBuffer;
 extern char srtBuffer[];
 extern size_t srtBytes;
 
@@ -336,6 +373,7 @@ extern bool servoUse; // true to use pan / tilt servo control
 extern bool voltUse; // true to report on ADC pin eg for for battery
 // microphone cannot be used on IO Extender
 extern bool micUse; // true to use external I2S microphone 
+extern bool micADPCM; // true to interleave IMA-ADPCM audio in AVI
 extern bool wakeUse;
 
 // sensors 
@@ -396,6 +434,7 @@ extern int stickXpin;
 extern int stickYpin; 
 
 // task handling
+extern TaskHandle_t alertHandle;
 extern TaskHandle_t battHandle;
 extern TaskHandle_t captureHandle;
 extern TaskHandle_t DS18B20handle;
@@ -408,6 +447,7 @@ extern TaskHandle_t playbackHandle;
 extern esp_ping_handle_t pingHandle;
 extern TaskHandle_t servoHandle;
 extern TaskHandle_t stickHandle;
+extern TaskHandle_t storageHandle;
 extern TaskHandle_t sustainHandle[];
 extern TaskHandle_t telegramHandle;
 extern TaskHandle_t telemetryHandle;
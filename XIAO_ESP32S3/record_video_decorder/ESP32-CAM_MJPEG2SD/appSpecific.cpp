@@ -39,6 +39,7 @@ bool updateAppStatus(const char* variable, const char* value) {
   else if (!strcmp(variable, "detectStartBand")) detectStartBand = intVal;
   else if (!strcmp(variable, "detectEndBand")) detectEndBand = intVal;
   else if (!strcmp(variable, "detectChangeThreshold")) detectChangeThreshold = intVal;
+  else if (!strcmp(variable, "motionDC")) motionDC = (bool)intVal;
   else if (!strcmp(variable, "mlUse")) mlUse = (bool)intVal;
   else if (!strcmp(variable, "mlProbability")) mlProbability = fltVal < 0 ? 0.0 : (fltVal > 1.0 ? 1.0 : fltVal);
   else if (!strcmp(variable, "depthColor")) {
@@ -104,6 +105,7 @@ bool updateAppStatus(const char* variable, const char* value) {
 #if INCLUDE_MIC
   else if (!strcmp(variable, "micUse")) micUse = (bool)intVal;
   else if (!strcmp(variable, "micGain")) micGain = intVal;
+  else if (!strcmp(variable, "micADPCM")) micADPCM = (bool)intVal;
   else if (!strcmp(variable, "micSckPin")) micSckPin = intVal;
   else if (!strcmp(variable, "micSWsPin")) micSWsPin = intVal;
   else if (!strcmp(variable, "micSdPin")) micSdPin = intVal;
@@ -214,6 +216,8 @@ esp_err_t appSpecificWebHandler(httpd_req_t *req, const char* variable, const ch
     httpd_resp_set_type(req, "application/json");
     httpd_resp_sendstr(req, jsonBuff);
   } 
+  else if (!strcmp(variable, "thumb")) sendThumb(req, value, false); // preview jpeg from clip sidecar
+  else if (!strcmp(variable, "thumbInfo")) sendThumb(req, value, true); // clip stats and keyframe offsets
   else if (!strcmp(variable, "updateFPS")) {
     // requires response with updated default fps
     sprintf(jsonBuff, "{\"fps\":\"%u\"}", setFPSlookup(fsizePtr));
@@ -325,6 +329,7 @@ void buildAppJsonString(bool filter) {
     p += sprintf(p, "\"total_bytes\":\"%s\",", fmtSize(SD_MMC.totalBytes()));
   }
   p += sprintf(p, "\"free_psram\":\"%s\",", fmtSize(ESP.getFreePsram()));     
+  p += sprintf(p, "\"motion_arena\":\"%s\",", fmtSize(motionArenaHighWater()));
 #if INCLUDE_FTP_HFS
   p += sprintf(p, "\"progressBar\":%d,", percentLoaded);  
   if (percentLoaded == 100) percentLoaded = 0;
@@ -333,6 +338,25 @@ void buildAppJsonString(bool filter) {
   *p = 0;
 }
 
+size_t buildMqttMetrics(char* metricsMsg, size_t msgLen) {
+  // periodic metrics for mqttTask, short keys as sent by every camera each interval
+  // fields only, caller appends its own fields and the closing brace
+  static uint32_t lastFrames = 0;
+  static uint32_t lastTime = 0;
+  uint32_t elapsed = millis() - lastTime;
+  float metricsFPS = elapsed ? (1000.0f * (framesCaptured - lastFrames)) / elapsed : 0;
+  lastFrames = framesCaptured;
+  lastTime = millis();
+  bool uploading = false;
+#if INCLUDE_FTP_HFS
+  uploading = uploadActive();
+#endif
+  int len = snprintf(metricsMsg, msgLen, "{\"fps\":%0.1f,\"rec\":%u,\"free\":%u,\"up\":%u,\"light\":%u", 
+    metricsFPS, (uint8_t)((isCapturing && doRecording) || forceRecord), 
+    (uint32_t)((STORAGE.totalBytes() - STORAGE.usedBytes()) / ONEMEG), uploading, lightLevel);
+  return len < 0 ? 0 : std::min((size_t)len, msgLen - 1);
+}
+
 /******************************************************************/
 
 void externalAlert(const char* subject, const char* message) {
@@ -367,6 +391,8 @@ void currentStackUsage() {
   checkStackUse(uartClientHandle, 13);
   // 14: http webserver
   for (int i=0; i < numStreams; i++) checkStackUse(sustainHandle[i], 15 + i);
+  checkStackUse(alertHandle, 19);
+  checkStackUse(storageHandle, 20);
 }
 
 void doAppPing() {
@@ -515,6 +541,7 @@ agc~1~98~~na
 agc_gain~0~98~~na
 autoUpload~0~98~~na
 deleteAfter~0~98~~na
+ftpParallel~0~98~~na
 awb~1~98~~na
 awb_gain~1~98~~na
 bpc~1~98~~na
@@ -576,6 +603,7 @@ detectNumBands~10~1~N~Total num of detection bands
 detectStartBand~3~1~N~Top band where motion is checked
 detectEndBand~8~1~N~Bottom band where motion is checked
 detectChangeThreshold~15~1~N~Pixel difference to indicate change
+motionDC~1~1~C~Fast grayscale motion from JPEG DC values
 mlUse~0~1~C~Use Machine Learning
 mlProbability~0.8~1~N~ML minimum positive probability 0.0 - 1.0
 depthColor~0~1~C~Color depth for motion detection: Gray <> RGB
@@ -593,6 +621,7 @@ lampUse~0~3~C~Use lamp
 lampType~0~3~S:Manual:PIR~How lamp activated
 servoUse~0~3~C~Use servos
 micUse~0~3~C~Use microphone
+micADPCM~1~3~C~Compress audio as ADPCM in AVI
 pirPin~~3~N~Pin used for PIR
 lampPin~4~3~N~Pin used for Lamp
 servoPanPin~~3~N~Pin used for Pan Servo
@@ -94,24 +94,26 @@ static const frameSizeStruct frameSizeData[] = {
 static size_t idxPtr[2];
 static size_t idxOffset[2];
 static size_t moviSize[2];
-static size_t audSize;
+static size_t audSize; // total audio bytes, from interleaved chunks or appended wav
+static uint16_t audCnt[2]; // number of audio chunks
 static size_t indexLen[2];
 static File wavFile;
-bool haveSoundFile = false;
 
 
 void prepAviIndex(bool isTL) {
   // prep buffer to store index data, gets appended to end of file
-  if (idxBuf[isTL] == NULL) idxBuf[isTL] = (uint8_t*)ps_malloc((maxFrames+1)*IDX_ENTRY); // include some space for audio index
+  // include space for an interleaved audio index entry per frame
+  if (idxBuf[isTL] == NULL) idxBuf[isTL] = (uint8_t*)ps_malloc((maxFrames*(INCLUDE_MIC ? 2 : 1)+1)*IDX_ENTRY);
   memcpy(idxBuf[isTL], idx1Buf, 4); // index header
   idxPtr[isTL] = CHUNK_HDR;  // leave 4 bytes for index size
-  moviSize[isTL] = indexLen[isTL] = 0;
+  moviSize[isTL] = indexLen[isTL] = audCnt[isTL] = 0;
+  if (!isTL) audSize = 0;
   idxOffset[isTL] = 4; // 4 byte offset
 }
 
 void buildAviHdr(uint8_t FPS, uint8_t frameType, uint16_t frameCnt, bool isTL) {
   // update AVI header template with file specific details
-  size_t aviSize = moviSize[isTL] + AVI_HEADER_LEN + ((CHUNK_HDR+IDX_ENTRY) * (frameCnt+(haveSoundFile?1:0))); // AVI content size 
+  size_t aviSize = moviSize[isTL] + AVI_HEADER_LEN + ((CHUNK_HDR+IDX_ENTRY) * (frameCnt+audCnt[isTL])); // AVI content size 
   // update aviHeader with relevant stats
   memcpy(aviHeader+4, &aviSize, 4);
   uint32_t usecs = (uint32_t)round(1000000.0f / FPS); // usecs_per_frame 
@@ -119,7 +121,7 @@ void buildAviHdr(uint8_t FPS, uint8_t frameType, uint16_t frameCnt, bool isTL) {
   memcpy(aviHeader+0x30, &frameCnt, 2);
   memcpy(aviHeader+0x8C, &frameCnt, 2);
   memcpy(aviHeader+0x84, &FPS, 1);
-  uint32_t dataSize = moviSize[isTL] + ((frameCnt+(haveSoundFile?1:0)) * CHUNK_HDR) + 4; 
+  uint32_t dataSize = moviSize[isTL] + ((frameCnt+audCnt[isTL]) * CHUNK_HDR) + 4; 
   memcpy(aviHeader+0x12E, &dataSize, 4); // data size 
 
   // apply video framesize to avi header
@@ -132,15 +134,37 @@ void buildAviHdr(uint8_t FPS, uint8_t frameType, uint16_t frameCnt, bool isTL) {
   uint8_t withAudio = 2; // increase number of streams for audio
   if (isTL) memcpy(aviHeader+0x100, zeroBuf, 4); // no audio for timelapse
   else {
-    if (haveSoundFile) memcpy(aviHeader+0x38, &withAudio, 1); 
-    memcpy(aviHeader+0x100, &audSize, 4); // audio data size
+    if (audCnt[isTL]) memcpy(aviHeader+0x38, &withAudio, 1); 
   }
   // apply audio details to avi header
-  memcpy(aviHeader+0xF8, &SAMPLE_RATE, 4);
+  uint32_t audScale = 1;
+  uint32_t audLength = audSize;
   uint32_t bytesPerSec = SAMPLE_RATE * 2;
+  uint32_t sampleSize = 2;
+  uint16_t formatTag = 1; // PCM
+  uint16_t blockAlign = 2;
+  uint16_t bitsPerSample = 16;
+  if (adpcmCapture) {
+    // IMA-ADPCM, rate / scale is blocks per sec so length is in blocks.
+    // No room in the fixed size header for the wSamplesPerBlock extension,
+    // players derive it from the block align
+    audScale = ADPCM_BLOCK_SAMPLES;
+    audLength = audSize / ADPCM_BLOCK_LEN;
+    bytesPerSec = SAMPLE_RATE * ADPCM_BLOCK_LEN / ADPCM_BLOCK_SAMPLES;
+    sampleSize = blockAlign = ADPCM_BLOCK_LEN;
+    formatTag = 0x11; // IMA ADPCM
+    bitsPerSample = 4;
+  }
+  if (!isTL) memcpy(aviHeader+0x100, &audLength, 4); // audio data length
+  memcpy(aviHeader+0xF4, &audScale, 4);
+  memcpy(aviHeader+0xF8, &SAMPLE_RATE, 4);
   memcpy(aviHeader+0x104, &bytesPerSec, 4); // suggested buffer size
+  memcpy(aviHeader+0x10C, &sampleSize, 4);
+  memcpy(aviHeader+0x118, &formatTag, 2);
   memcpy(aviHeader+0x11C, &SAMPLE_RATE, 4);
   memcpy(aviHeader+0x120, &bytesPerSec, 4); // bytes per sec
+  memcpy(aviHeader+0x124, &blockAlign, 2);
+  memcpy(aviHeader+0x126, &bitsPerSample, 2);
 #else
   memcpy(aviHeader+0x100, zeroBuf, 4);
 #endif
@@ -154,6 +178,10 @@ void buildAviIdx(size_t dataSize, bool isVid, bool isTL) {
   // build AVI video index into buffer - 16 bytes per frame
   // called from saveFrame() for each frame
   moviSize[isTL] += dataSize;
+  if (!isVid) {
+    audSize += dataSize;
+    audCnt[isTL]++;
+  }
   if (isVid) memcpy(idxBuf[isTL]+idxPtr[isTL], dcBuf, 4);
   else memcpy(idxBuf[isTL]+idxPtr[isTL], wbBuf, 4);
   memcpy(idxBuf[isTL]+idxPtr[isTL]+4, zeroBuf, 4);
@@ -184,15 +212,14 @@ size_t writeAviIndex(byte* clientBuf, size_t buffSize, bool isTL) {
   
 void finalizeAviIndex(uint16_t frameCnt, bool isTL) {
   // update index with size
-  uint32_t sizeOfIndex = (frameCnt+(haveSoundFile?1:0))*IDX_ENTRY;
+  uint32_t sizeOfIndex = (frameCnt+audCnt[isTL])*IDX_ENTRY;
   memcpy(idxBuf[isTL]+4, &sizeOfIndex, 4); // size of index 
   indexLen[isTL] = sizeOfIndex + CHUNK_HDR;
   idxPtr[isTL] = 0; // pointer to index buffer
 }
 
 bool haveWavFile(bool isTL) {
-  haveSoundFile = false;
-  audSize = 0;
+  bool haveSoundFile = false;
 #if INCLUDE_MIC
   if (isTL) return false;
   // check if wave file exists
@@ -201,8 +228,7 @@ bool haveWavFile(bool isTL) {
   wavFile = STORAGE.open(WAVTEMP, FILE_READ);
   if (wavFile) {
     // add sound file index
-    audSize = wavFile.size() - WAV_HEADER_LEN;
-    buildAviIdx(audSize, false); 
+    buildAviIdx(wavFile.size() - WAV_HEADER_LEN, false); 
     // add sound file header    
     wavFile.seek(WAV_HEADER_LEN, SeekSet); // skip over header
     haveSoundFile = true;
@@ -1,4 +1,7 @@
 // Upload SD card or SPIFFS content to a remote server using FTP or HTTPS
+// File content is read ahead in UPLOAD_BLOCK blocks so SD reads overlap socket writes.
+// A folder is uploaded over the one control connection, optionally with a second
+// FTP session so that 2 data transfers run in parallel
 // 
 // s60sc 2022, 2023
 
@@ -24,6 +27,50 @@ static byte* fsChunk;
 bool deleteAfter = false; // auto delete after upload
 bool autoUpload = false;  // Automatically upload every created file to remote file server
 bool fsUse = false; // FTP if false, HTTPS if true
+bool ftpParallel = false; // use 2 parallel FTP transfers for folder upload
+
+#define UPLOAD_BLOCK (1024 * 16) // SD read and socket write size
+#define UPLOAD_READ_AHEAD 3 // blocks read ahead of socket writes
+#define MAX_TRANSFERS 2
+static readAhead_t uploadRA[MAX_TRANSFERS]; // SD blocks read ahead of each transfer
+static File uploadRoot; // folder being uploaded
+static SemaphoreHandle_t uploadMutex = NULL; // serialises folder iteration across transfers
+static uint32_t uploadFiles; // stats for current run
+static uint64_t uploadBytes;
+
+static bool uploadable(const char* fileName) {
+  // only upload valid file types
+#ifdef ISCAM
+  return strstr(fileName, AVI_EXT) || strstr(fileName, CSV_EXT) || strstr(fileName, SRT_EXT);
+#else
+  return strstr(fileName, FILE_EXT);
+#endif
+}
+
+static bool sendFileData(uint8_t transfer, File& fh, Client& client, uint8_t& progress) {
+  // stream file content to client, reading next blocks from SD while current one is sent
+  size_t fileSize = fh.size();
+  size_t totalSent = 0;
+  size_t blockLen;
+  uint8_t* block;
+  bool res = true;
+  readAheadStart(&uploadRA[transfer], &fh, UPLOAD_READ_AHEAD);
+  while (res && (blockLen = readAheadNext(&uploadRA[transfer], &block))) {
+    size_t writeLen = client.write((const uint8_t*)block, blockLen);
+    if (writeLen != blockLen) res = false;
+    totalSent += writeLen;
+    if (calcProgress(totalSent, fileSize, 5, progress)) LOG_INF("Uploaded %u%% of %s", progress, fh.name()); 
+  }
+  readAheadRelease(&uploadRA[transfer]);
+  readAheadStop(&uploadRA[transfer]);
+  if (res) {
+    xSemaphoreTake(uploadMutex, portMAX_DELAY);
+    uploadFiles++;
+    uploadBytes += totalSent;
+    xSemaphoreGive(uploadMutex);
+  }
+  return res;
+}
 
 
 /******************** HTTPS ********************/
@@ -96,26 +143,18 @@ static void postHeader(const char* tmethod, const char* contentType, bool isFile
 static bool hfsStoreFile(File &fh) {
   // Upload individual file to HTTPS server
   // reject if folder or not valid file type
-#ifdef ISCAM
-  if (!strstr(fh.name(), AVI_EXT) && !strstr(fh.name(), CSV_EXT) && !strstr(fh.name(), SRT_EXT)) return false; 
-#else
-  if (!strstr(fh.name(), FILE_EXT)) return false; 
-#endif
+  if (!uploadable(fh.name())) return false; 
   LOG_INF("Upload file: %s, size: %s", fh.name(), fmtSize(fh.size()));    
 
   // prep POST header and send file to HTTPS server
   postHeader("upload", BIN_TYPE, true, fh.size(), fh.name());
-  // upload file content in chunks
-  uint8_t percentLoaded = 0;
-  size_t chunksize = 0, totalSent = 0;
-  while ((chunksize = fh.read((uint8_t*)fsChunk, CHUNKSIZE))) {
-    hclient.write((uint8_t*)fsChunk, chunksize);
-    totalSent += chunksize;
-    if (calcProgress(totalSent, fh.size(), 5, percentLoaded)) LOG_INF("Uploaded %u%%", percentLoaded); 
-  }
+  // upload file content
+  percentLoaded = 0;
+  bool res = sendFileData(0, fh, hclient, percentLoaded);
+  if (!res) LOG_ERR("Upload file to https failed");
   percentLoaded = 100;
   hclient.println(END_BOUNDARY);
-  return true;
+  return res;
 }
 
 /******************** FTP ********************/
@@ -123,98 +162,102 @@ static bool hfsStoreFile(File &fh) {
 // FTP control
 bool useFtps = false;
 char ftpUser[MAX_HOST_LEN];
-static char rspBuf[256]; // Ftp response buffer
-static char respCodeRx[4]; // ftp response code
 static fs::FS fp = STORAGE;
 #define NO_CHECK "999"
 
-// WiFi Clients
-WiFiClient rclient;
-WiFiClient dclient;
-
-static bool sendFtpCommand(const char* cmd, const char* param, const char* respCode, const char* respCode2 = NO_CHECK) {
+// each FTP session has its own control and data connection
+struct ftpSession_t {
+  WiFiClient rclient; // control
+  WiFiClient dclient; // data
+  char rspBuf[256]; // Ftp response buffer
+  char respCodeRx[4]; // ftp response code
+  uint8_t id; // also index to uploadRA
+};
+static ftpSession_t ftpSession[MAX_TRANSFERS];
+
+static bool sendFtpCommand(ftpSession_t& fs, const char* cmd, const char* param, const char* respCode, const char* respCode2 = NO_CHECK) {
   // build and send ftp command
   if (strlen(cmd)) {
-    rclient.print(cmd);
-    rclient.println(param);
+    fs.rclient.print(cmd);
+    fs.rclient.println(param);
   }
   LOG_DBG("Sent cmd: %s%s", cmd, param);
   
   // wait for ftp server response
   uint32_t start = millis();
-  while (!rclient.available() && millis() < start + (responseTimeoutSecs * 1000)) delay(1);
-  if (!rclient.available()) {
+  while (!fs.rclient.available() && millis() < start + (responseTimeoutSecs * 1000)) delay(1);
+  if (!fs.rclient.available()) {
     LOG_ERR("FTP server response timeout");
     return false;
   }
   // read in response code and message
-  rclient.read((uint8_t*)respCodeRx, 3); 
-  respCodeRx[3] = 0; // terminator
-  int readLen = rclient.read((uint8_t*)rspBuf, 255);
-  rspBuf[readLen] = 0;
-  while (rclient.available()) rclient.read(); // bin the rest of response
+  fs.rclient.read((uint8_t*)fs.respCodeRx, 3); 
+  fs.respCodeRx[3] = 0; // terminator
+  int readLen = fs.rclient.read((uint8_t*)fs.rspBuf, 255);
+  fs.rspBuf[readLen] = 0;
+  while (fs.rclient.available()) fs.rclient.read(); // bin the rest of response
 
   // check response code with expected
-  LOG_DBG("Rx code: %s, resp: %s", respCodeRx, rspBuf);
+  LOG_DBG("Rx code: %s, resp: %s", fs.respCodeRx, fs.rspBuf);
   if (strcmp(respCode, NO_CHECK) == 0) return true; // response code not checked
-  if (strcmp(respCodeRx, respCode) != 0) {
-    if (strcmp(respCodeRx, respCode2) != 0) {
+  if (strcmp(fs.respCodeRx, respCode) != 0) {
+    if (strcmp(fs.respCodeRx, respCode2) != 0) {
       // incorrect response code
-      LOG_ERR("Command %s got wrong response: %s %s", cmd, respCodeRx, rspBuf);
+      LOG_ERR("Command %s got wrong response: %s %s", cmd, fs.respCodeRx, fs.rspBuf);
       return false;
     }
   }
   return true;
 }
 
-static bool ftpConnect() {
+static bool ftpConnect(ftpSession_t& fs) {
   // Connect to ftp or ftps
-  if (rclient.connect(fsServer, fsPort)) {LOG_DBG("FTP connected at %s:%u", fsServer, fsPort);}
+  if (fs.rclient.connect(fsServer, fsPort)) {LOG_DBG("FTP connected at %s:%u", fsServer, fsPort);}
   else {
     LOG_ERR("Error opening ftp connection to %s:%u", fsServer, fsPort);
     return false;
   }
-  if (!sendFtpCommand("", "", "220")) return false;
+  if (!sendFtpCommand(fs, "", "", "220")) return false;
   if (useFtps) {
-    if (sendFtpCommand("AUTH ", "TLS", "234")) {
+    if (sendFtpCommand(fs, "AUTH ", "TLS", "234")) {
       /* NOT IMPLEMENTED */
     } else LOG_WRN("FTPS not available");
   }
-  if (!sendFtpCommand("USER ", ftpUser, "331")) return false;
-  if (!sendFtpCommand("PASS ", FS_Pass, "230")) return false;
+  if (!sendFtpCommand(fs, "USER ", ftpUser, "331")) return false;
+  if (!sendFtpCommand(fs, "PASS ", FS_Pass, "230")) return false;
   // change to supplied folder
-  if (!sendFtpCommand("CWD ", fsWd, "250")) return false;
-  if (!sendFtpCommand("Type I", "", "200")) return false;
+  if (!sendFtpCommand(fs, "CWD ", fsWd, "250")) return false;
+  if (!sendFtpCommand(fs, "Type I", "", "200")) return false;
   return true;
 }
 
-static void ftpDisconnect() {
+static void ftpDisconnect(ftpSession_t& fs) {
   // Disconnect from ftp server
-  rclient.println("QUIT");
-  dclient.stop();
-  rclient.stop();
+  fs.rclient.println("QUIT");
+  fs.dclient.stop();
+  fs.rclient.stop();
 }
 
-static bool ftpCreateFolder(const char* folderName) {
+static bool ftpCreateFolder(ftpSession_t& fs, const char* folderName) {
   // create folder if non existent then change to it
   LOG_DBG("Check for folder %s", folderName);
-  sendFtpCommand("CWD ", folderName, NO_CHECK); 
-  if (strcmp(respCodeRx, "550") == 0) {
+  sendFtpCommand(fs, "CWD ", folderName, NO_CHECK); 
+  if (strcmp(fs.respCodeRx, "550") == 0) {
     // non existent folder, create it
-    if (!sendFtpCommand("MKD ", folderName, "257")) return false;
-    //sendFtpCommand("SITE CHMOD 755 ", folderName, "200", "550"); // unix only
-    if (!sendFtpCommand("CWD ", folderName, "250")) return false;         
+    if (!sendFtpCommand(fs, "MKD ", folderName, "257")) return false;
+    //sendFtpCommand(fs, "SITE CHMOD 755 ", folderName, "200", "550"); // unix only
+    if (!sendFtpCommand(fs, "CWD ", folderName, "250")) return false;         
   }
   return true;
 }
 
-static bool openDataPort() {
+static bool openDataPort(ftpSession_t& fs) {
   // set up port for data transfer
-  if (!sendFtpCommand("PASV", "", "227")) return false;
+  if (!sendFtpCommand(fs, "PASV", "", "227")) return false;
   // derive data port number
-  char* p = strchr(rspBuf, '('); // skip over initial text
+  char* p = strchr(fs.rspBuf, '('); // skip over initial text
   int p1, p2;   
-  int items = sscanf(p, "(%*d,%*d,%*d,%*d,%d,%d)", &p1, &p2);
+  int items = p ? sscanf(p, "(%*d,%*d,%*d,%*d,%d,%d)", &p1, &p2) : 0;
   if (items != 2) {
     LOG_ERR("Failed to parse data port");
     return false;
@@ -223,51 +266,39 @@ static bool openDataPort() {
   
   // Connect to data port
   LOG_DBG("Data port: %i", dataPort);
-  if (!dclient.connect(fsServer, dataPort)) {
+  if (!fs.dclient.connect(fsServer, dataPort)) {
     LOG_ERR("Data connection failed");   
     return false;
   }
   return true;
 }
 
-static bool ftpStoreFile(File &fh) {
+static bool ftpStoreFile(ftpSession_t& fs, File &fh) {
   // Upload individual file to current folder, overwrite any existing file 
   // reject if folder, or not valid file type    
-#ifdef ISCAM
-  if (!strstr(fh.name(), AVI_EXT) && !strstr(fh.name(), CSV_EXT) && !strstr(fh.name(), SRT_EXT)) return false; 
-#else
-  if (!strstr(fh.name(), FILE_EXT)) return false; 
-#endif
+  if (!uploadable(fh.name())) return false; 
   char ftpSaveName[FILE_NAME_LEN];
   strcpy(ftpSaveName, fh.name());
   size_t fileSize = fh.size();
   LOG_INF("Upload file: %s, size: %s", ftpSaveName, fmtSize(fileSize));    
 
   // open data connection
-  openDataPort();
-  uint32_t writeBytes = 0; 
+  if (!openDataPort(fs)) return false;
   uint32_t uploadStart = millis();
-  size_t readLen, writeLen;
-  if (!sendFtpCommand("STOR ", ftpSaveName, "150", "125")) return false;
-  do {
-    // upload file in chunks
-    readLen = fh.read(fsChunk, CHUNKSIZE);  
-    if (readLen) {
-      writeLen = dclient.write((const uint8_t*)fsChunk, readLen);
-      writeBytes += writeLen;
-      if (writeLen == 0) {
-        LOG_ERR("Upload file to ftp failed");
-        return false;
-      }
-      if (calcProgress(writeBytes, fileSize, 5, percentLoaded)) LOG_INF("Uploaded %u%%", percentLoaded); 
-    }
-  } while (readLen > 0);
-  dclient.stop();
-  percentLoaded = 100;
-  bool res = sendFtpCommand("", "", "226");
+  if (!sendFtpCommand(fs, "STOR ", ftpSaveName, "150", "125")) return false;
+  // only first session reports progress to web page
+  uint8_t progress = 0;
+  bool res = sendFileData(fs.id, fh, fs.dclient, fs.id ? progress : percentLoaded);
+  fs.dclient.stop();
+  if (!res) {
+    LOG_ERR("Upload file to ftp failed");
+    return false;
+  }
+  if (!fs.id) percentLoaded = 100;
+  res = sendFtpCommand(fs, "", "", "226");
   if (res) {
-    LOG_ALT("Uploaded %s in %u sec", fmtSize(writeBytes), (millis() - uploadStart) / 1000);
-    //sendFtpCommand("SITE CHMOD 644 ", ftpSaveName, "200", "550"); // unix only
+    LOG_ALT("Uploaded %s in %u sec", fmtSize(fileSize), (millis() - uploadStart) / 1000);
+    //sendFtpCommand(fs, "SITE CHMOD 644 ", ftpSaveName, "200", "550"); // unix only
   } else LOG_ERR("File transfer not successful");
   return res;
 }
@@ -283,22 +314,74 @@ static bool getFolderName(const char* folderName) {
   bool res = true;
   for (char* p = strchr(folderPath, '/'); (p = strchr(++p, '/')) != NULL; pos = p + 1 - folderPath) {
     *p = 0; // terminator
-    if (!fsUse) res = ftpCreateFolder(folderPath + pos);
+    if (!fsUse) res = ftpCreateFolder(ftpSession[0], folderPath + pos);
   }
   return res;
 }
 
+static bool storeFile(File& fh) {
+  return fsUse ? hfsStoreFile(fh) : ftpStoreFile(ftpSession[0], fh);
+}
+
+static File nextUploadFile() {
+  // next file in folder being uploaded, skipping those not uploaded
+  // shared by parallel transfers
+  xSemaphoreTake(uploadMutex, portMAX_DELAY);
+  File fh = uploadRoot.openNextFile();
+  while (fh && !uploadable(fh.name())) {
+    fh.close();
+    fh = uploadRoot.openNextFile();
+  }
+  xSemaphoreGive(uploadMutex);
+  return fh;
+}
+
+static bool uploadFolderFiles(ftpSession_t* fs) {
+  // upload files from folder until none left, fs is NULL for HTTPS
+  bool res = true;
+  File fh = nextUploadFile();
+  while (fh) {
+    res = fs == NULL ? hfsStoreFile(fh) : ftpStoreFile(*fs, fh);
+    fh.close();
+    if (!res) break; // abandon rest of files
+    fh = nextUploadFile();
+  }
+  return res;
+}
+
+static volatile bool parallelRunning = false;
+static volatile bool parallelRes = true;
+
+static void parallelUploadTask(void* parameter) {
+  // second FTP session, takes alternate files from folder
+  ftpSession_t& fs = ftpSession[1];
+  if (ftpConnect(fs) && ftpCreateFolder(fs, uploadRoot.name())) parallelRes = uploadFolderFiles(&fs);
+  else LOG_WRN("Second FTP session unavailable, continuing with one");
+  ftpDisconnect(fs);
+  parallelRunning = false;
+  vTaskDelete(NULL);
+}
+
 static bool uploadFolderOrFileFs(const char* fileOrFolder) {
   // Upload a single file or whole folder using FTP or HTTPS server
-  // folder is uploaded file by file
+  // folder is uploaded file by file over the same control connection
   fsBuff = (char*)fsChunk;
-  bool res = fsUse ? remoteServerConnect(hclient, fsServer, fsPort, hfs_rootCACertificate) : ftpConnect();
+  if (uploadMutex == NULL) uploadMutex = xSemaphoreCreateMutex();
+  for (int i = 0; i < MAX_TRANSFERS; i++) {
+    ftpSession[i].id = i;
+    if (i && !ftpParallel) break;
+    if (uploadRA[i].taskHandle == NULL) readAheadInit(&uploadRA[i], "uploadRA", UPLOAD_BLOCK, UPLOAD_READ_AHEAD, DOWNLOAD_STACK_SIZE, FTP_PRI);
+  }
+  if (uploadRA[0].taskHandle == NULL) return false;
+  bool res = fsUse ? remoteServerConnect(hclient, fsServer, fsPort, hfs_rootCACertificate) : ftpConnect(ftpSession[0]);
 
   if (!res) {
     LOG_ERR("Unable to connect to %s server", fsUse ? "HTTPS" : "FTP");
     return false;
   }
   res = false;
+  uploadFiles = uploadBytes = 0;
+  uint32_t runStart = millis();
   const int saveRefreshVal = refreshVal;
   refreshVal = 1;
   File root = fp.open(fileOrFolder);
@@ -306,20 +389,23 @@ static bool uploadFolderOrFileFs(const char* fileOrFolder) {
     // Upload a single file 
     char fsSaveName[FILE_NAME_LEN];
     strcpy(fsSaveName, root.path());
-    if (getFolderName(root.path())) res = fsUse ? hfsStoreFile(root) : ftpStoreFile(root); 
+    if (getFolderName(root.path())) res = storeFile(root); 
 #ifdef ISCAM
     // upload corresponding csv and srt files if exist
     if (res) {
+#if INCLUDE_TELEM
+      expandTelemetry(fsSaveName); // binary telemetry to csv and srt
+#endif
       changeExtension(fsSaveName, CSV_EXT);
       if (fp.exists(fsSaveName)) {
         File csv = fp.open(fsSaveName);
-        res = fsUse ? hfsStoreFile(csv) : ftpStoreFile(csv);
+        res = storeFile(csv);
         csv.close();
       }
       changeExtension(fsSaveName, SRT_EXT);
       if (fp.exists(fsSaveName)) {
         File srt = fp.open(fsSaveName);
-        res = fsUse ? hfsStoreFile(srt) : ftpStoreFile(srt);
+        res = storeFile(srt);
         srt.close();
       }
     }
@@ -327,25 +413,42 @@ static bool uploadFolderOrFileFs(const char* fileOrFolder) {
 #endif
   } else {  
     // Upload a whole folder, file by file
-    LOG_INF("Uploading folder: ", root.name()); 
+    LOG_INF("Uploading folder: %s", root.name()); 
     strncpy(folderPath, root.name(), FILE_NAME_LEN - 1);
-    res = fsUse ? true : ftpCreateFolder(root.name());
+    res = fsUse ? true : ftpCreateFolder(ftpSession[0], root.name());
     if (!res) {
       refreshVal = saveRefreshVal;
+      root.close();
+      fsUse ? remoteServerClose(hclient) : ftpDisconnect(ftpSession[0]); 
       return false;
     }
-    File fh = root.openNextFile();
-    while (fh) {
-      res = fsUse ? hfsStoreFile(fh) : ftpStoreFile(fh);
-      if (!res) break; // abandon rest of files
-      fh.close();
-      fh = root.openNextFile();
+#if defined(ISCAM) && INCLUDE_TELEM
+    // expand any binary telemetry first, so csv and srt files are included in folder
+    File tf = root.openNextFile();
+    while (tf) {
+      if (strstr(tf.name(), TLM_EXT)) expandTelemetry(tf.path());
+      tf.close();
+      tf = root.openNextFile();
     }
-    if (fh) fh.close();
+    root.rewindDirectory();
+#endif
+    uploadRoot = root;
+    // second FTP session, HTTPS needs too much heap for a second TLS connection
+    parallelRunning = !fsUse && ftpParallel && uploadRA[1].taskHandle != NULL;
+    parallelRes = true;
+    if (parallelRunning && xTaskCreate(&parallelUploadTask, "parallelUpload", FS_STACK_SIZE, NULL, FTP_PRI, NULL) != pdPASS) 
+      parallelRunning = false;
+    res = uploadFolderFiles(fsUse ? NULL : &ftpSession[0]);
+    while (parallelRunning) delay(100);
+    res = res && parallelRes;
+    uploadRoot = File();
   }
   refreshVal = saveRefreshVal;
   root.close();
-  fsUse ? remoteServerClose(hclient) : ftpDisconnect(); 
+  fsUse ? remoteServerClose(hclient) : ftpDisconnect(ftpSession[0]); 
+  uint32_t runTime = millis() - runStart;
+  LOG_ALT("Upload run: %u files, %s in %0.1f secs at %0.2f MB/s", uploadFiles, fmtSize(uploadBytes), 
+    runTime / 1000.0, runTime ? ((float)uploadBytes / (1024 * 1024)) / (runTime / 1000.0) : 0);
   return res;
 }
 
@@ -380,6 +483,10 @@ bool fsFileOrFolder(const char* fileFolder) {
   return false;
 }
 
+bool uploadActive() {
+  return uploadInProgress;
+}
+
 void prepUpload() {
   LOG_INF("File uploads will use %s server", fsUse ? "HTTPS" : "FTP");
 }
@@ -70,6 +70,24 @@
 #define MIN_STACK_FREE 512
 #define STARTUP_FAIL "Startup Failure: "
 
+// SD read ahead state, see readAheadInit() in utilsFS.cpp
+struct readAhead_t {
+  uint8_t* buff; // maxDepth blocks in psram
+  size_t* blockLen; // bytes read into each block
+  size_t blockSize;
+  uint8_t maxDepth;
+  uint8_t depth; // blocks in use for current file
+  File* file;
+  QueueHandle_t filled; // indexes of blocks ready for consumer, in file order
+  SemaphoreHandle_t freeBlocks; // blocks reader may fill
+  TaskHandle_t taskHandle;
+  volatile bool run;
+  volatile bool busy;
+  bool holding; // consumer has a block
+  uint32_t readTime; // ms spent in SD reads for current file
+  uint32_t readBytes;
+};
+
 // global mandatory app specific functions, in appSpecific.cpp 
 bool appDataFiles();
 esp_err_t appSpecificHeaderHandler(httpd_req_t *req);
@@ -78,15 +96,18 @@ esp_err_t appSpecificSustainHandler(httpd_req_t* req);
 esp_err_t appSpecificWebHandler(httpd_req_t *req, const char* variable, const char* value);
 void appSpecificWsHandler(const char* wsMsg);
 void buildAppJsonString(bool filter);
+size_t buildMqttMetrics(char* metricsMsg, size_t msgLen);
 bool updateAppStatus(const char* variable, const char* value);
 
 // global general utility functions in utils.cpp / utilsFS.cpp / peripherals.cpp    
 void buildJsonString(uint8_t filter);
+size_t buildTaskStatsJson(char* p);
 bool calcProgress(int progressVal, int totalVal, int percentReport, uint8_t &pcProgress);
 bool changeExtension(char* fileName, const char* newExt);
 bool checkAlarm();
 bool checkDataFiles();
 bool checkFreeStorage();
+void addToFolderIndex(const char* filePath, size_t fileSize);
 void checkMemory(const char* source = "");
 uint32_t checkStackUse(TaskHandle_t thisTask, int taskIdx);
 void debugMemory(const char* caller);
@@ -97,6 +118,7 @@ void doAppPing();
 void doRestart(const char* restartStr);
 esp_err_t downloadFile(File& df, httpd_req_t* req);
 void emailAlert(const char* _subject, const char* _message);
+void emailIdle();
 const char* encode64(const char* inp);
 const uint8_t* encode64chunk(const uint8_t* inp, int rem);
 const char* espErrMsg(esp_err_t errCode);
@@ -111,6 +133,7 @@ void forceCrash();
 void formatElapsedTime(char* timeStr, uint32_t timeVal, bool noDays = false);
 void formatHex(const char* inData, size_t inLen);
 bool fsFileOrFolder(const char* fileFolder);
+bool uploadActive();
 const char* getEncType(int ssidIndex);
 void getExtIP();
 time_t getEpoch();
@@ -134,6 +157,12 @@ bool prepTelegram();
 void prepTemperature();
 void prepUart();
 void prepUpload();
+size_t readAheadNext(readAhead_t* ra, uint8_t** data);
+uint8_t readAheadDepth(readAhead_t* ra, uint32_t bytesPerSec, uint32_t aheadMs);
+bool readAheadInit(readAhead_t* ra, const char* taskName, size_t blockSize, uint8_t maxDepth, uint32_t stackSize, UBaseType_t priority);
+void readAheadRelease(readAhead_t* ra);
+void readAheadStart(readAhead_t* ra, File* file, uint8_t depth);
+void readAheadStop(readAhead_t* ra);
 void reloadConfigs();
 float readTemperature(bool isCelsius);
 float readVoltage();
@@ -145,13 +174,14 @@ void replaceChar(char* s, char c, char r);
 void reset_log();
 void resetWatchDog();
 bool retrieveConfigVal(const char* variable, char* value);
-esp_err_t sendChunks(File df, httpd_req_t *req, bool endChunking = true);
+esp_err_t sendChunks(File df, httpd_req_t *req, bool endChunking = true, size_t sendLen = SIZE_MAX);
 void setFolderName(const char* fname, char* fileName);
 void setPeripheralResponse(const byte pinNum, const uint32_t responseData);
 void setupADC();
 void showProgress(const char* marker = ".");
 uint16_t smoothAnalog(int analogPin, int samples = ADC_SAMPLES);
 float smoothSensor(float latestVal, float smoothedVal, float alpha);
+void startIdleMon();
 void startOTAtask();
 void startSecTimer(bool startTimer);
 bool startStorage();
@@ -169,6 +199,7 @@ void wsAsyncSend(const char* wsData);
 void startMqttClient();  
 void stopMqttClient();  
 void mqttPublish(const char* payload);
+void mqttEvent(const char* event, bool on);
 // telegram.cpp
 bool getTgramUpdate(char* response);
 bool sendTgramMessage(const char* info, const char* item, const char* parseMode);
@@ -190,6 +221,7 @@ extern char ST_Pass[]; //Router passd
 extern bool useHttps;
 extern bool useSecure;
 extern bool useFtps;
+extern bool ftpParallel;
 
 extern char ST_ip[]; //Leave blank for dhcp
 extern char ST_sn[];
@@ -1,7 +1,11 @@
 
 // Creates 16 bit single channel PCM WAV file from microphone input.
 // Default sample rate is 16kHz
+// If micADPCM is set, audio is instead IMA-ADPCM encoded (4:1) on the mic task
+// and interleaved into the AVI as a 01wb chunk after each video frame
 // Audio is not replayed on streaming, only via AVI file
+// Each I2S DMA buffer is read once into a ring of blocks, which the recording
+// and any NVR audio streams then use in place rather than copying
 
 // The following devices have been tested with this application:
 // - I2S microphone: INMP441
@@ -16,6 +20,7 @@
 #include "appGlobals.h"
 
 bool micUse = true; // true to use external I2S microphone 
+bool micADPCM = true; // true to interleave IMA-ADPCM audio in AVI, false for PCM WAV appended at close
 
 // INMP441 I2S microphone pinout, connect L/R to GND for left channel
 // MP34DT01 PDM microphone pinout, connect SEL to GND for left channel
@@ -47,19 +52,46 @@ static const uint8_t sampleWidth = sizeof(int16_t);
 static const size_t sampleBytes = DMA_BUFF_LEN * sampleWidth;
 static File wavFile;
 static int totalSamples = 0;
-static size_t bytesRead = 0;
-static size_t audBytes = 0;
 TaskHandle_t micHandle = NULL;
-static bool doMicCapture = false;
-static bool captureRunning = false;
-static bool doStreamCapture = false;
-static bool captureStream = false;
-static uint8_t* sampleBuffer = NULL;
-uint8_t* audioBuffer = NULL;
+static volatile bool doMicCapture = false;
+static volatile bool captureRunning = false;
 static QueueHandle_t i2s_queue = NULL;
+
+// ring of DMA sized blocks, filled by micTask, read by reference by audio streams
+#define MIC_BLOCKS 8 // about 0.5 sec of audio for stream readers to fall behind by
+#define MIC_WAIT_MS 500 // max wait for next block before stream reader gives up
+static uint8_t* micRing = NULL;
+static size_t micBlockLen[MIC_BLOCKS];
+static volatile uint32_t micSeq = 0; // blocks read from I2S, block micSeq % MIC_BLOCKS is being filled
+static volatile uint8_t micStreams = 0; // active stream readers
+static portMUX_TYPE micMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t i2sOverruns = 0; // DMA buffers lost before micTask read them
+static uint32_t streamOverruns = 0; // blocks skipped as a stream reader fell a ring behind
 static i2s_event_t event;
 static i2s_pin_config_t i2s_mic_pins;
 
+// IMA-ADPCM encoded blocks waiting to be interleaved by saveFrame()
+#define ADPCM_RING_LEN (ADPCM_BLOCK_LEN * 128) // about 4 secs of audio, covers slow SD writes
+bool adpcmCapture = false; // current recording is interleaving ADPCM chunks
+static uint8_t* adpcmRing = NULL;
+static size_t adpcmHead = 0; // bytes encoded, only advanced by micTask
+static size_t adpcmTail = 0; // bytes interleaved, only advanced by releaseAdpcmAudio()
+static portMUX_TYPE adpcmMux = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t adpcmBlock[ADPCM_BLOCK_LEN];
+static int blockSamples = 0; // samples in block being encoded
+static int adpcmPredictor = 0;
+static int adpcmIndex = 0;
+static uint32_t adpcmDropped = 0;
+
+static const int8_t adpcmIndexTable[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+static const int16_t adpcmStepTable[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+  337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+  2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+  15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
 const uint32_t WAV_HEADER_LEN = 44; // WAV header length
 static uint8_t wavHeader[WAV_HEADER_LEN] = { // WAV header template
   0x52, 0x49, 0x46, 0x46, 0x00, 0x00, 0x00, 0x00, 0x57, 0x41, 0x56, 0x45, 0x66, 0x6D, 0x74, 0x20,
@@ -84,13 +116,6 @@ static i2s_config_t i2s_mic_config = {
   .fixed_mclk = 0
 };
 
-static inline void IRAM_ATTR wakeTask(TaskHandle_t thisTask) {
-  // utility function to resume task from interrupt
-  BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-  vTaskNotifyGiveFromISR(thisTask, &xHigherPriorityTaskWoken);
-  if (xHigherPriorityTaskWoken) portYIELD_FROM_ISR();
-}
-
 static void startMic() {
   // install & start up the I2S peripheral as microphone when activated
   int queueSize = 4;
@@ -115,43 +140,138 @@ static void stopMic() {
   LOG_DBG("Stopped I2S port %d", I2S_CHAN);
 }
 
-static void getMicData() {
-  // get mic I2S data
-  bytesRead = 0;
+static int16_t* getMicData(size_t* bytesRead) {
+  // read next I2S DMA buffer straight into the next ring block
+  // only published to stream readers once complete
+  *bytesRead = 0;
+  uint8_t slot = micSeq % MIC_BLOCKS;
+  uint8_t* block = micRing + slot * sampleBytes;
   // wait for i2s buffer to be ready
   if (xQueueReceive(i2s_queue, &event, pdMS_TO_TICKS(2 * SAMPLE_RATE)) == pdPASS) {
-    if (event.type == I2S_EVENT_RX_DONE) {
-      i2s_read(I2S_CHAN, sampleBuffer, sampleBytes, &bytesRead, portMAX_DELAY);
-      int samplesRead = bytesRead / sampleWidth;
+    if (event.type == I2S_EVENT_RX_Q_OVF) i2sOverruns++;
+    else if (event.type == I2S_EVENT_RX_DONE) {
+      i2s_read(I2S_CHAN, block, sampleBytes, bytesRead, portMAX_DELAY);
+      int samplesRead = *bytesRead / sampleWidth;
       // process each sample as amplified 16 bit 
-      int16_t* ampBuffer = (int16_t*)sampleBuffer;
+      int16_t* ampBuffer = (int16_t*)block;
       for (int i = 0; i < samplesRead; i++) 
         ampBuffer[i] = constrain(ampBuffer[i] * micGain, SHRT_MIN, SHRT_MAX);
-      if (doStreamCapture) {
-        if (!audBytes) {
-          memcpy(audioBuffer, sampleBuffer, bytesRead);
-          audBytes = bytesRead;
-        }
-      }
+      micBlockLen[slot] = *bytesRead;
+      micSeq++;
     } 
   }  
+  return (int16_t*)block;
+}
+
+static uint8_t adpcmEncode(int16_t sample) {
+  // encode one sample as 4 bit difference from predicted value
+  int step = adpcmStepTable[adpcmIndex];
+  int diff = sample - adpcmPredictor;
+  uint8_t nibble = 0;
+  if (diff < 0) {
+    nibble = 8;
+    diff = -diff;
+  }
+  int delta = step >> 3;
+  if (diff >= step) {
+    nibble |= 4;
+    diff -= step;
+    delta += step;
+  }
+  step >>= 1;
+  if (diff >= step) {
+    nibble |= 2;
+    diff -= step;
+    delta += step;
+  }
+  step >>= 1;
+  if (diff >= step) {
+    nibble |= 1;
+    delta += step;
+  }
+  adpcmPredictor = constrain(adpcmPredictor + ((nibble & 8) ? -delta : delta), SHRT_MIN, SHRT_MAX);
+  adpcmIndex = constrain(adpcmIndex + adpcmIndexTable[nibble & 7], 0, 88);
+  return nibble;
+}
+
+static void pushAdpcmBlock() {
+  // add completed block to ring, dropped if interleaving has fallen too far behind
+  portENTER_CRITICAL(&adpcmMux);
+  size_t used = adpcmHead - adpcmTail;
+  portEXIT_CRITICAL(&adpcmMux);
+  if (used + ADPCM_BLOCK_LEN > ADPCM_RING_LEN) {
+    adpcmDropped++;
+    return;
+  }
+  memcpy(adpcmRing + adpcmHead % ADPCM_RING_LEN, adpcmBlock, ADPCM_BLOCK_LEN);
+  portENTER_CRITICAL(&adpcmMux);
+  adpcmHead += ADPCM_BLOCK_LEN;
+  portEXIT_CRITICAL(&adpcmMux);
+}
+
+static void encodeAdpcm(const int16_t* samples, int numSamples) {
+  // build mono IMA-ADPCM blocks: 4 byte header holding first sample and step index,
+  // then remaining samples packed 2 per byte, low nibble first
+  for (int i = 0; i < numSamples; i++) {
+    if (!blockSamples) {
+      adpcmPredictor = samples[i];
+      memcpy(adpcmBlock, &samples[i], sizeof(int16_t));
+      adpcmBlock[2] = adpcmIndex;
+      adpcmBlock[3] = 0;
+      blockSamples = 1;
+    } else {
+      uint8_t nibble = adpcmEncode(samples[i]);
+      size_t pos = 4 + (blockSamples - 1) / 2;
+      if (blockSamples & 1) adpcmBlock[pos] = nibble;
+      else adpcmBlock[pos] |= nibble << 4;
+      if (++blockSamples == ADPCM_BLOCK_SAMPLES) {
+        pushAdpcmBlock();
+        blockSamples = 0;
+      }
+    }
+  }
+}
+
+uint8_t* getAdpcmAudio(size_t* audLen) {
+  // called from saveFrame() to get whole blocks encoded since previous frame
+  // returns contiguous part of ring, remainder after ring wrap is picked up on next call
+  portENTER_CRITICAL(&adpcmMux);
+  size_t avail = adpcmHead - adpcmTail;
+  portEXIT_CRITICAL(&adpcmMux);
+  size_t offset = adpcmTail % ADPCM_RING_LEN;
+  *audLen = min(avail, ADPCM_RING_LEN - offset);
+  return adpcmRing + offset;
+}
+
+void releaseAdpcmAudio(size_t audLen) {
+  // blocks from getAdpcmAudio() have been copied out, micTask can reuse the space
+  portENTER_CRITICAL(&adpcmMux);
+  adpcmTail += audLen;
+  portEXIT_CRITICAL(&adpcmMux);
 }
 
 static void micTask(void* parameter) {
   startMic();
   while (true) {
-    // wait for recording request
+    // wait for recording or stream request
     ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-    totalSamples = 0;
-    captureRunning = true;
-    while (captureStream) delay(10); // wait for stream to read mic buffer
-    doMicCapture = true;   
-    while (doMicCapture) {
-      getMicData();
-      wavFile.write(sampleBuffer, bytesRead);
-      totalSamples += bytesRead / sampleWidth;
+    // discard DMA buffers that filled while idle
+    xQueueReset(i2s_queue);
+    i2s_zero_dma_buffer(I2S_CHAN);
+    while (doMicCapture || micStreams) {
+      // claim block before checking, so finishAudio() waits for it to be saved
+      captureRunning = true;
+      bool recording = doMicCapture;
+      if (!recording) captureRunning = false;
+      size_t bytesRead;
+      int16_t* block = getMicData(&bytesRead);
+      if (recording && bytesRead) {
+        if (adpcmCapture) encodeAdpcm(block, bytesRead / sampleWidth);
+        else wavFile.write((uint8_t*)block, bytesRead);
+        totalSamples += bytesRead / sampleWidth;
+      }
+      captureRunning = false;
     }
-    captureRunning = false;
   }
   stopMic();
   vTaskDelete(NULL);
@@ -161,10 +281,20 @@ void startAudio() {
   // start audio recording and write recorded audio to SD card as WAV file 
   // combined into AVI file as PCM channel on FTP upload or browser download
   // so can be read by media players
-  if (micUse && micGain) {
-    wavFile = STORAGE.open(WAVTEMP, FILE_WRITE);
-    wavFile.write(wavHeader, WAV_HEADER_LEN); 
-    wakeTask(micHandle);
+  adpcmCapture = false;
+  if (micUse && micGain && micRing != NULL) {
+    totalSamples = 0;
+    if (micADPCM && adpcmRing != NULL) {
+      // no WAV file, saveFrame() interleaves the encoded audio
+      adpcmHead = adpcmTail = adpcmDropped = 0;
+      blockSamples = adpcmIndex = 0;
+      adpcmCapture = true;
+    } else {
+      wavFile = STORAGE.open(WAVTEMP, FILE_WRITE);
+      wavFile.write(wavHeader, WAV_HEADER_LEN); 
+    }
+    doMicCapture = true;
+    xTaskNotifyGive(micHandle);
   } 
 }
 
@@ -185,7 +315,12 @@ void finishAudio(bool isValid) {
     // finish a recording and save if valid
     doMicCapture = false; 
     while (captureRunning) delay(100); // wait for getRecording() to complete
-    if (isValid) {
+    if (adpcmCapture) {
+      // a final part block (under 32ms) is not worth padding out
+      LOG_INF("Captured %d audio samples with gain factor %i as %s ADPCM", totalSamples, micGain, 
+        fmtSize(adpcmHead));
+      if (adpcmDropped) LOG_WRN("Dropped %u ADPCM blocks as SD writes fell behind", adpcmDropped);
+    } else if (isValid) {
       uint32_t dataBytes = updateWavHeader();
       wavFile.seek(0, SeekSet); // start of file
       wavFile.write(wavHeader, WAV_HEADER_LEN); // overwrite default header
@@ -196,33 +331,49 @@ void finishAudio(bool isValid) {
   }
 }
 
-size_t getAudioBuffer(bool endStream) {
-  // called from audioStream();
-  size_t haveBytes = 0;
-  static bool startStream = true;
-  captureStream = false;
-  if (micUse) {
-    if (endStream) {
-      doStreamCapture = false;
-      startStream = true;
-      return 0; // reset for end of stream
-    }
-    audBytes = 0;
-    if (startStream) {
-      updateWavHeader();
-      memcpy(audioBuffer, wavHeader, WAV_HEADER_LEN);
-      haveBytes = WAV_HEADER_LEN;
-      doStreamCapture = true;
-      startStream = false;
-    } else {
-      if (!captureRunning) {
-        captureStream = true;
-        getMicData(); 
-      } // otherwise already loaded by micTask()
-      haveBytes = audBytes;
-    }
+const uint8_t* openAudioStream(uint32_t* seq) {
+  // called from audioStream() to register as a reader of the mic ring
+  // returns WAV header to send first, with max sizes as stream length unknown
+  static uint8_t streamHeader[WAV_HEADER_LEN];
+  memcpy(streamHeader, wavHeader, WAV_HEADER_LEN);
+  uint32_t maxSize = UINT32_MAX;
+  memcpy(streamHeader+4, &maxSize, 4);
+  memcpy(streamHeader+24, &SAMPLE_RATE, 4);
+  uint32_t byteRate = SAMPLE_RATE * sampleWidth;
+  memcpy(streamHeader+28, &byteRate, 4); 
+  memcpy(streamHeader+WAV_HEADER_LEN-4, &maxSize, 4);
+  portENTER_CRITICAL(&micMux);
+  micStreams++;
+  portEXIT_CRITICAL(&micMux);
+  *seq = micSeq; // start from block being filled
+  if (micHandle != NULL) xTaskNotifyGive(micHandle);
+  return streamHeader;
+}
+
+int16_t* getAudioBlock(uint32_t* seq, size_t* blockLen) {
+  // wait for next block after seq and pass it back in place, no copy made
+  // micTask overwrites a block MIC_BLOCKS-1 blocks after it is published, 
+  // a reader further behind than that skips to the oldest intact block
+  for (int waited = 0; *seq == micSeq; waited += 10) {
+    if (waited >= MIC_WAIT_MS) return NULL;
+    delay(10);
+  }
+  uint32_t head = micSeq;
+  if (head - *seq > MIC_BLOCKS - 1) {
+    streamOverruns += head - *seq - (MIC_BLOCKS - 1);
+    *seq = head - (MIC_BLOCKS - 1);
   }
-  return haveBytes;
+  uint8_t slot = *seq % MIC_BLOCKS;
+  *blockLen = micBlockLen[slot];
+  (*seq)++;
+  return (int16_t*)(micRing + slot * sampleBytes);
+}
+
+void closeAudioStream() {
+  portENTER_CRITICAL(&micMux);
+  if (micStreams) micStreams--;
+  portEXIT_CRITICAL(&micMux);
+  LOG_INF("Mic overruns: %u I2S DMA, %u stream blocks", i2sOverruns, streamOverruns);
 }
 
 void prepMic() {
@@ -240,8 +391,9 @@ void prepMic() {
     updateStatus("micSckPin", "41");
 #endif
     if (micSckPin && micSWsPin && micSdPin) {
-      if (sampleBuffer == NULL) sampleBuffer = (uint8_t*)malloc(sampleBytes);
-      if (audioBuffer == NULL) audioBuffer = (uint8_t*)ps_malloc(sampleBytes);
+      if (micRing == NULL) micRing = (uint8_t*)ps_malloc(MIC_BLOCKS * sampleBytes);
+      if (micADPCM && adpcmRing == NULL) adpcmRing = (uint8_t*)ps_malloc(ADPCM_RING_LEN);
+      if (micADPCM && adpcmRing == NULL) LOG_WRN("No memory for ADPCM, audio saved as PCM WAV");
       micType = micSckPin == -1 ? PDM_MIC : I2S_MIC;
       LOG_INF("Sound recording is available using %s mic on I2S%i", micType ? "PDM" : "I2S", I2S_CHAN);
       xTaskCreate(micTask, "micTask", MIC_STACK_SIZE, NULL, MIC_PRI, &micHandle);
@@ -31,6 +31,7 @@ uint8_t minSeconds = 5; // default min video length (includes POST_MOTION_TIME)
 bool doRecording = true; // whether to capture to SD or not 
 uint8_t xclkMhz = 20; // camera clock rate MHz
 bool doKeepFrame = false;
+uint32_t framesCaptured = 0;
 static bool haveSrt = false;
 char camModel[10];
 
@@ -45,6 +46,12 @@ static uint32_t oTime; // file opening time
 static uint32_t cTime; // file closing time
 static uint32_t sTime; // file streaming time
 
+// SD write latency histogram, bucket upper limits in usecs (same layout as edge_monitor SDWriteBuffer)
+static const uint32_t wHistLimits[] = {1000, 2000, 5000, 10000, 20000, 50000, 100000, UINT32_MAX};
+#define WRITE_HIST_BUCKETS (sizeof(wHistLimits) / sizeof(wHistLimits[0]))
+static uint32_t wHist[WRITE_HIST_BUCKETS];
+static uint32_t wMaxUs; // slowest single SD write
+
 uint8_t frameDataRows = 14; // number of frame sizes
 static uint16_t frameInterval; // units of 0.1ms between frames
 
@@ -57,7 +64,6 @@ static char aviFileName[FILE_NAME_LEN];
 // SD playback
 static File playbackFile;
 static char partName[FILE_NAME_LEN];
-static size_t readLen;
 static uint8_t recFPS;
 static uint32_t recDuration;
 static uint8_t saveFPS = 99;
@@ -66,7 +72,7 @@ bool doPlayback = false; // controls playback
 // task control
 TaskHandle_t captureHandle = NULL;
 TaskHandle_t playbackHandle = NULL;
-static SemaphoreHandle_t readSemaphore;
+static readAhead_t playbackRA; // SD blocks read ahead of playback
 static SemaphoreHandle_t playbackSemaphore;
 SemaphoreHandle_t frameSemaphore[MAX_STREAMS] = {NULL};
 SemaphoreHandle_t motionSemaphore = NULL;
@@ -106,6 +112,149 @@ void controlFrameTimer(bool restartTimer) {
   }
 }
 
+/**************** clip sidecar  ************************/
+
+// "<clip>.thm" next to each avi: one json line with clip stats and per thumbnail
+// its frame number, avi offset of the frame and position after the json line,
+// followed by the downscaled thumbnail jpegs
+
+typedef struct {
+  uint16_t frame;
+  uint32_t clipMs;
+  uint32_t aviOffset; // frame 00dc chunk in avi
+  uint32_t offset; // thumbnail jpeg, counted from end of json line
+  uint32_t len;
+} thumbEntry_t;
+
+static thumbEntry_t thumbs[MAX_THUMBS];
+static uint8_t thumbCnt;
+static uint8_t* thumbStore = NULL; // PSRAM, thumbnail jpegs of current clip
+static size_t thumbStoreLen;
+static size_t thumbJpegLen;
+static uint8_t* thumbBitmap = NULL;
+static size_t thumbBitmapSize = 0;
+static uint32_t nextThumbMs;
+static uint32_t clipMotionPeak;
+
+static size_t thumbJpegOut(void* arg, size_t index, const void* data, size_t len) {
+  // jpg_out_cb for thumbnail, appended after those already in store
+  if (thumbStoreLen + index + len > THUMB_STORE_SIZE) return 0;
+  memcpy(thumbStore + thumbStoreLen + index, data, len);
+  thumbJpegLen = index + len;
+  return len;
+}
+
+static void takeThumb(camera_fb_t* fb, uint32_t aviOffset) {
+  // keep downscaled copy of frame at fixed clip time intervals
+  uint32_t clipMs = millis() - startTime;
+  if (useMotion && motionChanges > clipMotionPeak) clipMotionPeak = motionChanges;
+  if (thumbCnt >= MAX_THUMBS || clipMs < nextThumbMs) return;
+  nextThumbMs = (clipMs / THUMB_INTERVAL + 1) * THUMB_INTERVAL;
+  if (thumbStore == NULL && psramFound()) thumbStore = (uint8_t*)ps_malloc(THUMB_STORE_SIZE);
+  if (thumbStore == NULL) return;
+
+  uint32_t tTime = millis();
+  // smallest decode scale that fits thumbnail width
+  int scale = 1;
+  while (scale < 3 && (fb->width >> scale) > THUMB_WIDTH) scale++;
+  uint16_t thumbW = fb->width >> scale;
+  uint16_t thumbH = fb->height >> scale;
+  size_t bitmapSize = thumbW * thumbH * 2; // RGB565
+  if (bitmapSize > thumbBitmapSize) {
+    if (thumbBitmap != NULL) free(thumbBitmap);
+    thumbBitmap = (uint8_t*)ps_malloc(bitmapSize);
+    thumbBitmapSize = thumbBitmap == NULL ? 0 : bitmapSize;
+  }
+  if (thumbBitmap == NULL) return;
+  if (!jpg2rgb565(fb->buf, fb->len, thumbBitmap, (jpg_scale_t)scale)) {
+    LOG_WRN("Thumbnail decode failed for frame %u", frameCnt);
+    return;
+  }
+  thumbJpegLen = 0;
+  if (!fmt2jpg_cb(thumbBitmap, bitmapSize, thumbW, thumbH, PIXFORMAT_RGB565, THUMB_QUALITY, thumbJpegOut, NULL)) {
+    LOG_WRN("Thumbnail store full after %u thumbnails", thumbCnt);
+    nextThumbMs = UINT32_MAX; // no more for this clip
+    return;
+  }
+  thumbs[thumbCnt].frame = frameCnt;
+  thumbs[thumbCnt].clipMs = clipMs;
+  thumbs[thumbCnt].aviOffset = aviOffset;
+  thumbs[thumbCnt].offset = thumbStoreLen;
+  thumbs[thumbCnt].len = thumbJpegLen;
+  thumbStoreLen += thumbJpegLen;
+  thumbCnt++;
+  LOG_DBG("Thumbnail %u of %ux%u, %u bytes in %ums", thumbCnt, thumbW, thumbH, thumbJpegLen, millis() - tTime);
+}
+
+static void saveThumbs(float actualFPS, uint32_t vidDuration) {
+  // write sidecar for closed avi, json line built in SD buffer as no longer needed
+  char thmName[FILE_NAME_LEN];
+  strcpy(thmName, aviFileName);
+  changeExtension(thmName, THM_EXT);
+  char* p = (char*)iSDbuffer;
+  p += sprintf(p, "{\"v\":1,\"frames\":%u,\"fps\":%0.2f,\"duration_ms\":%u,\"width\":%u,\"height\":%u,",
+    frameCnt, actualFPS, vidDuration, frameData[fsizePtr].frameWidth, frameData[fsizePtr].frameHeight);
+  if (useMotion) p += sprintf(p, "\"motion_peak\":%u,\"motion_threshold\":%u,", clipMotionPeak, motionThreshold);
+  else p += sprintf(p, "\"motion_peak\":-1,\"motion_threshold\":0,");
+  p += sprintf(p, "\"thumbs\":[");
+  for (int i = 0; i < thumbCnt; i++) 
+    p += sprintf(p, "%s{\"frame\":%u,\"ms\":%u,\"avi_offset\":%u,\"offset\":%u,\"len\":%u}", i ? "," : "", 
+      thumbs[i].frame, thumbs[i].clipMs, thumbs[i].aviOffset, thumbs[i].offset, thumbs[i].len);
+  p += sprintf(p, "]}\n");
+  size_t hdrLen = p - (char*)iSDbuffer;
+
+  File thmFile = STORAGE.open(thmName, FILE_WRITE);
+  if (!thmFile) {
+    LOG_WRN("Failed to open sidecar %s", thmName);
+    return;
+  }
+  bool res = thmFile.write(iSDbuffer, hdrLen) == hdrLen;
+  if (res && thumbStoreLen) res = thmFile.write(thumbStore, thumbStoreLen) == thumbStoreLen;
+  thmFile.close();
+  if (res) LOG_INF("Sidecar %s: %u thumbnails, %s", thmName, thumbCnt, fmtSize(hdrLen + thumbStoreLen));
+  else {
+    LOG_WRN("Failed to write sidecar %s", thmName);
+    STORAGE.remove(thmName);
+  }
+}
+
+esp_err_t sendThumb(httpd_req_t* req, const char* aviName, bool infoOnly) {
+  // send first thumbnail from clip sidecar, or its json line
+  char thmName[FILE_NAME_LEN];
+  strncpy(thmName, aviName, FILE_NAME_LEN - 1);
+  thmName[FILE_NAME_LEN - 1] = 0;
+  changeExtension(thmName, THM_EXT);
+  File thmFile = STORAGE.open(thmName, FILE_READ);
+  if (!thmFile) {
+    httpd_resp_send_404(req);
+    return ESP_FAIL;
+  }
+  char line[THUMB_HDR_LEN];
+  size_t readLen = thmFile.readBytesUntil('\n', line, THUMB_HDR_LEN - 1);
+  esp_err_t res = ESP_FAIL;
+  if (readLen) {
+    line[readLen] = 0;
+    if (infoOnly) {
+      httpd_resp_set_type(req, "application/json");
+      res = httpd_resp_send(req, line, readLen);
+    } else {
+      // first thumbnail starts straight after json line
+      char* lenPtr = strstr(line, "\"len\":");
+      size_t thumbLen = lenPtr == NULL ? 0 : atoi(lenPtr + 6);
+      uint8_t* thumb = thumbLen ? (uint8_t*)ps_malloc(thumbLen) : NULL;
+      if (thumb != NULL && thmFile.seek(readLen + 1) && thmFile.read(thumb, thumbLen) == thumbLen) {
+        httpd_resp_set_type(req, "image/jpeg");
+        httpd_resp_set_hdr(req, "Cache-Control", "max-age=86400");
+        res = httpd_resp_send(req, (const char*)thumb, thumbLen);
+      }
+      free(thumb);
+    }
+  }
+  thmFile.close();
+  if (res != ESP_OK) httpd_resp_send_404(req);
+  return res;
+}
+
 /**************** capture AVI  ************************/
 
 static void openAvi() {
@@ -128,8 +277,11 @@ static void openAvi() {
   // initialisation of counters
   startTime = millis();
   frameCnt = fTimeTot = wTimeTot = dTimeTot = vidSize = 0;
+  memset(wHist, 0, sizeof(wHist));
+  wMaxUs = 0;
   highPoint = AVI_HEADER_LEN; // allot space for AVI header
   prepAviIndex();
+  thumbCnt = thumbStoreLen = nextThumbMs = clipMotionPeak = 0;
 }
 
 static inline bool doMonitor(bool capturing) {
@@ -216,50 +368,210 @@ static void timeLapse(camera_fb_t* fb) {
 }
 
 void keepFrame(camera_fb_t* fb) {
-  // keep required frame for external server alert
+  // keep required frame for still / telegram snap request
   if (fb->len < MAX_JPEG && alertBuffer != NULL) {
     memcpy(alertBuffer, fb->buf, fb->len);
     alertBufferSize = fb->len;
   }
 }
 
-static void saveFrame(camera_fb_t* fb) {
-  // save frame on SD card
-  uint32_t fTime = millis();
-  // align end of jpeg on 4 byte boundary for AVI
-  uint16_t filler = (4 - (fb->len & 0x00000003)) & 0x00000003; 
-  size_t jpegSize = fb->len + filler;
-  // add avi frame header
-  memcpy(iSDbuffer+highPoint, dcBuf, 4); 
-  memcpy(iSDbuffer+highPoint+4, &jpegSize, 4);
+/******************** motion alert pipeline *******************/
+
+// checkMotion() only raises the alert. alertTask, at low priority, takes a
+// reference to the next shared stream frame, re-encodes it at messaging size
+// into alertBuffer and hands it to email / telegram, so neither the frame copy
+// nor any TLS work lands on processFrame(). Alerts raised within
+// ALERT_COALESCE_SECS of the last one are folded into it. The email session
+// stays open between alerts, see emailIdle().
+TaskHandle_t alertHandle = NULL;
+static uint16_t alertEvents = 0;
+static uint32_t lastAlertMs = 0;
+static uint8_t* alertBitmap = NULL;
+static size_t alertBitmapSize = 0;
+static portMUX_TYPE alertMux = portMUX_INITIALIZER_UNLOCKED;
+
+void raiseAlert() {
+  // called from checkMotion() on motion start, never waits
+  if (alertHandle == NULL) return;
+  portENTER_CRITICAL(&alertMux);
+  alertEvents++;
+  portEXIT_CRITICAL(&alertMux);
+  xTaskNotifyGive(alertHandle);
+}
+
+static size_t alertJpegOut(void* arg, size_t index, const void* data, size_t len) {
+  // jpg_out_cb for alert image
+  if (index + len > MAX_ALERT) return 0;
+  memcpy(alertBuffer + index, data, len);
+  alertBufferSize = index + len;
+  return len;
+}
+
+static bool prepAlertImage() {
+  // downscale referenced frame into alertBuffer
+  uint8_t* jpgBuf;
+  size_t jpgLen;
+  alertBufferSize = 0;
+  if (alertBuffer == NULL || !holdAlertFrame(&jpgBuf, &jpgLen)) return false;
+  uint16_t frameW = frameData[fsizePtr].frameWidth;
+  uint16_t frameH = frameData[fsizePtr].frameHeight;
+  // smallest decode scale that fits alert width
+  int scale = 0;
+  while (scale < 3 && (frameW >> scale) > ALERT_WIDTH) scale++;
+  uint16_t alertW = frameW >> scale;
+  uint16_t alertH = frameH >> scale;
+  size_t bitmapSize = alertW * alertH * 2; // RGB565
+  if (scale && bitmapSize > alertBitmapSize) {
+    if (alertBitmap != NULL) free(alertBitmap);
+    alertBitmap = (uint8_t*)ps_malloc(bitmapSize);
+    alertBitmapSize = alertBitmap == NULL ? 0 : bitmapSize;
+  }
+  bool decoded = scale && alertBitmap != NULL && jpg2rgb565(jpgBuf, jpgLen, alertBitmap, (jpg_scale_t)scale);
+  if (!decoded && jpgLen <= MAX_ALERT) {
+    // already small enough, or can't be scaled, so send as is
+    memcpy(alertBuffer, jpgBuf, jpgLen);
+    alertBufferSize = jpgLen;
+  }
+  releaseAlertFrame(); // frame free for viewers once decoded
+  if (decoded && !fmt2jpg_cb(alertBitmap, bitmapSize, alertW, alertH, PIXFORMAT_RGB565, ALERT_QUALITY, alertJpegOut, NULL)) {
+    LOG_WRN("Alert image encode failed");
+    alertBufferSize = 0;
+  }
+  return (bool)alertBufferSize;
+}
+
+static void alertTask(void* parameter) {
+  while (true) {
+    if (!ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ALERT_COALESCE_SECS * 1000))) {
+#if INCLUDE_SMTP
+      emailIdle(); // no alert, so check whether to close email session
+#endif
+      continue;
+    }
+    uint32_t aTime = millis();
+#if INCLUDE_SMTP
+    while (emailHandle != NULL) delay(100); // previous email still sending from alertBuffer
+#endif
+    if (prepAlertImage()) LOG_DBG("Alert image %s in %ums", fmtSize(alertBufferSize), millis() - aTime);
+    else LOG_WRN("No frame available for motion alert");
+    // hold the alert until the coalescing window after the last one has passed
+    uint32_t sinceLast = millis() - lastAlertMs;
+    if (lastAlertMs && sinceLast < ALERT_COALESCE_SECS * 1000) delay(ALERT_COALESCE_SECS * 1000 - sinceLast);
+    ulTaskNotifyTake(pdTRUE, 0); // raised while waiting, so already counted in alertEvents
+    portENTER_CRITICAL(&alertMux);
+    uint16_t events = alertEvents;
+    alertEvents = 0;
+    portEXIT_CRITICAL(&alertMux);
+    lastAlertMs = millis();
+#if INCLUDE_SMTP
+    if (smtpUse) {
+      char alertMsg[50];
+      if (events > 1) snprintf(alertMsg, sizeof(alertMsg) - 1, "from %s, %u motion events", hostName, events);
+      else snprintf(alertMsg, sizeof(alertMsg) - 1, "from %s", hostName);
+      emailAlert("Motion Alert", alertMsg);
+    }
+#endif
+    // telegram sends alertBuffer once the clip filename is available, see tgramAlert()
+    LOG_INF("Motion alert for %u event%s", events, events > 1 ? "s" : "");
+  }
+}
+
+static void prepAlerts() {
+#if INCLUDE_SMTP || INCLUDE_TGRAM
+  bool alertUse = false;
+#if INCLUDE_SMTP
+  alertUse |= smtpUse;
+#endif
+#if INCLUDE_TGRAM
+  alertUse |= tgramUse;
+#endif
+  if (alertUse && alertHandle == NULL) 
+    xTaskCreate(&alertTask, "alertTask", ALERT_STACK_SIZE, NULL, ALERT_PRI, &alertHandle);
+#endif
+}
+
+static size_t timedWrite(const uint8_t* buf, size_t len) {
+  // write block to SD, recording its latency in the histogram
+  uint32_t wStart = micros();
+  size_t written = aviFile.write(buf, len);
+  uint32_t wUs = micros() - wStart;
+  int i = 0;
+  while (i < WRITE_HIST_BUCKETS - 1 && wUs >= wHistLimits[i]) i++;
+  wHist[i]++;
+  if (wUs > wMaxUs) wMaxUs = wUs;
+  return written;
+}
+
+static void logWriteHist() {
+  char histStr[100];
+  int pos = 0;
+  for (int i = 0; i < WRITE_HIST_BUCKETS - 1; i++) 
+    pos += snprintf(histStr + pos, sizeof(histStr) - pos, "<%ums:%u ", wHistLimits[i] / 1000, wHist[i]);
+  snprintf(histStr + pos, sizeof(histStr) - pos, ">=%ums:%u", wHistLimits[WRITE_HIST_BUCKETS - 2] / 1000, wHist[WRITE_HIST_BUCKETS - 1]);
+  LOG_INF("SD write latency (%u byte blocks): %s", RAMSIZE, histStr);
+  LOG_INF("Slowest SD write: %u ms", wMaxUs / 1000);
+}
+
+static uint32_t bufferChunk(const uint8_t* chunkId, const uint8_t* chunkData, size_t chunkSize) {
+  // add avi chunk to SD buffer, writing out each RAMSIZE block as it fills
+  // returns time spent writing to SD
+  memcpy(iSDbuffer+highPoint, chunkId, 4); 
+  memcpy(iSDbuffer+highPoint+4, &chunkSize, 4);
   highPoint += CHUNK_HDR;
   if (highPoint >= RAMSIZE) {
     // marker overflows buffer
     highPoint -= RAMSIZE;
-    aviFile.write(iSDbuffer, RAMSIZE);
+    timedWrite(iSDbuffer, RAMSIZE);
     // push overflow to buffer start
     memcpy(iSDbuffer, iSDbuffer+RAMSIZE, highPoint);
   }
-  // add frame content
-  size_t jpegRemain = jpegSize;
+  // add chunk content
+  size_t chunkRemain = chunkSize;
   uint32_t wTime = millis();
-  while (jpegRemain >= RAMSIZE - highPoint) {
+  while (chunkRemain >= RAMSIZE - highPoint) {
     // write to SD when RAMSIZE is filled in buffer
-    memcpy(iSDbuffer+highPoint, fb->buf + jpegSize - jpegRemain, RAMSIZE - highPoint);
-    aviFile.write(iSDbuffer, RAMSIZE);
-    jpegRemain -= RAMSIZE - highPoint;
+    memcpy(iSDbuffer+highPoint, chunkData + chunkSize - chunkRemain, RAMSIZE - highPoint);
+    timedWrite(iSDbuffer, RAMSIZE);
+    chunkRemain -= RAMSIZE - highPoint;
     highPoint = 0;
   } 
   wTime = millis() - wTime;
-  wTimeTot += wTime;
-  LOG_DBG("SD storage time %u ms", wTime); 
-  // whats left or small frame
-  memcpy(iSDbuffer+highPoint, fb->buf + jpegSize - jpegRemain, jpegRemain);
-  highPoint += jpegRemain;
-  
+  // whats left or small chunk
+  memcpy(iSDbuffer+highPoint, chunkData + chunkSize - chunkRemain, chunkRemain);
+  highPoint += chunkRemain;
+  vidSize += chunkSize + CHUNK_HDR;
+  return wTime;
+}
+
+#if INCLUDE_MIC
+static size_t saveAudio() {
+  // interleave ADPCM audio encoded since previous frame, so no wav file to append on close
+  size_t audLen;
+  uint8_t* audData = getAdpcmAudio(&audLen);
+  if (audLen) {
+    wTimeTot += bufferChunk(wbBuf, audData, audLen);
+    releaseAdpcmAudio(audLen);
+    buildAviIdx(audLen, false); // save avi index for audio
+  }
+  return audLen;
+}
+#endif
+
+static void saveFrame(camera_fb_t* fb) {
+  // save frame on SD card
+  uint32_t fTime = millis();
+  takeThumb(fb, AVI_HEADER_LEN + vidSize);
+  // align end of jpeg on 4 byte boundary for AVI
+  uint16_t filler = (4 - (fb->len & 0x00000003)) & 0x00000003; 
+  size_t jpegSize = fb->len + filler;
+  uint32_t wTime = bufferChunk(dcBuf, fb->buf, jpegSize);
   buildAviIdx(jpegSize); // save avi index for frame
-  vidSize += jpegSize + CHUNK_HDR;
   frameCnt++; 
+  wTimeTot += wTime;
+  LOG_DBG("SD storage time %u ms", wTime); 
+#if INCLUDE_MIC
+  if (adpcmCapture) saveAudio();
+#endif
   fTime = millis() - fTime - wTime;
   fTimeTot += fTime;
   LOG_DBG("Frame processing time %u ms", fTime);
@@ -274,14 +586,21 @@ static bool closeAvi() {
   LOG_DBG("Capture time %u, min seconds: %u ", vidDurationSecs, minSeconds);
 
   cTime = millis();
-  // write remaining frame content to SD
-  aviFile.write(iSDbuffer, highPoint); 
   size_t readLen = 0;
   bool haveWav = false;
 #if INCLUDE_MIC
-  // add wav file if exists
   finishAudio(true);
-  haveWav = haveWavFile();
+  if (adpcmCapture) {
+    // interleave remaining audio, may be split by ring wrap
+    while (saveAudio()) {}
+    haveWav = true;
+  }
+#endif
+  // write remaining frame content to SD
+  timedWrite(iSDbuffer, highPoint); 
+#if INCLUDE_MIC
+  // add wav file if exists
+  if (!adpcmCapture) haveWav = haveWavFile();
   if (haveWav) {
     do {
       readLen = writeWavFile(iSDbuffer, RAMSIZE);
@@ -313,6 +632,8 @@ static bool closeAvi() {
       haveWav ? "_S" : "", haveSrt ? "_M" : "", AVI_EXT); 
     if (alen > FILE_NAME_LEN - 1) LOG_WRN("file name truncated");
     STORAGE.rename(AVITEMP, aviFileName);
+    addToFolderIndex(aviFileName, vidSize + AVI_HEADER_LEN);
+    saveThumbs(actualFPS, vidDuration);
     LOG_DBG("AVI close time %lu ms", millis() - hTime); 
     cTime = millis() - cTime;
 #if INCLUDE_TELEM
@@ -333,15 +654,13 @@ static bool closeAvi() {
       LOG_INF("Average frame storage time: %u ms", wTimeTot / frameCnt);
     }
     LOG_INF("Average SD write speed: %u kB/s", ((vidSize / wTimeTot) * 1000) / 1024);
+    logWriteHist();
     LOG_INF("File open / completion times: %u ms / %u ms", oTime, cTime);
     LOG_INF("Busy: %u%%", std::min(100 * (wTimeTot + fTimeTot + dTimeTot + oTime + cTime) / vidDuration, (uint32_t)100));
     checkMemory();
     LOG_INF("*************************************");
 #if INCLUDE_MQTT
-    if (mqtt_active) {
-      sprintf(jsonBuff, "{\"RECORD\":\"OFF\", \"TIME\":\"%s\"}", esp_log_system_timestamp());
-      mqttPublish(jsonBuff);
-    }
+    if (mqtt_active) mqttEvent("RECORD", false);
 #endif
 #if INCLUDE_FTP_HFS
     if (autoUpload) fsFileOrFolder(aviFileName); // Upload it to remote ftp server if requested
@@ -349,7 +668,7 @@ static bool closeAvi() {
 #if INCLUDE_TGRAM
     if (tgramUse) tgramAlert(aviFileName, "");
 #endif
-    if (!checkFreeStorage()) doRecording = false; 
+    if (!checkFreeStorage()) doRecording = false; // O(1), deletion is done by storageTask
     return true; 
   } else {
     // delete too small files if exist
@@ -370,14 +689,9 @@ static boolean processFrame() {
 
   camera_fb_t* fb = esp_camera_fb_get();
   if (fb == NULL || !fb->len || fb->len > MAX_JPEG) return false;
+  framesCaptured++;
   timeLapse(fb);
-  for (int i = 0; i < vidStreams; i++) {
-    if (!streamBufferSize[i] && streamBuffer[i] != NULL) {
-      memcpy(streamBuffer[i], fb->buf, fb->len);
-      streamBufferSize[i] = fb->len;   
-      xSemaphoreGive(frameSemaphore[i]); // signal frame ready for stream
-    }
-  }
+  publishStreamFrame(fb); // single copy shared by all stream clients
   if (doKeepFrame) {
     keepFrame(fb);
     doKeepFrame = false;
@@ -405,10 +719,7 @@ static boolean processFrame() {
       stopPlayback = true; // stop any subsequent playback
       LOG_ALT("Capture started by %s%s%s", captureMotion ? "Motion " : "", pirVal ? "PIR" : "",forceRecord ? "Button" : "");
 #if INCLUDE_MQTT
-      if (mqtt_active) {
-        sprintf(jsonBuff, "{\"RECORD\":\"ON\", \"TIME\":\"%s\"}", esp_log_system_timestamp());
-        mqttPublish(jsonBuff);
-      }
+      if (mqtt_active) mqttEvent("RECORD", true);
 #endif
       openAvi();
       wasCapturing = true;
@@ -495,24 +806,10 @@ static void playbackFPS(const char* fname) {
   controlFrameTimer(true); // set frametimer
 }
 
-static void readSD() {
-  // read next cluster from SD for playback
-  uint32_t rTime = millis();
-  // read to interim dram before copying to psram
-  readLen = 0;
-  if (!stopPlayback) {
-    readLen = playbackFile.read(iSDbuffer+RAMSIZE+CHUNK_HDR, RAMSIZE);
-    LOG_DBG("SD read time %lu ms", millis() - rTime);
-  }
-  wTimeTot += millis() - rTime;
-  xSemaphoreGive(readSemaphore); // signal that ready     
-  delay(10);
-}
-
-
 void openSDfile(const char* streamFile) {
   // open selected file on SD for streaming
   if (stopPlayback) LOG_WRN("Playback refused - capture in progress");
+  else if (playbackRA.taskHandle == NULL) LOG_ERR("Playback unavailable - no read ahead buffers");
   else {
     stopPlaying(); // in case already running
     strcpy(aviFileName, streamFile);
@@ -520,9 +817,13 @@ void openSDfile(const char* streamFile) {
     playbackFile = STORAGE.open(aviFileName, FILE_READ);
     playbackFile.seek(AVI_HEADER_LEN, SeekSet); // skip over header
     playbackFPS(aviFileName);
+    // read ahead enough SD blocks to cover file data rate
+    uint32_t bytesPerSec = playbackFile.size() / (recDuration ? recDuration : 1);
+    uint8_t depth = readAheadDepth(&playbackRA, bytesPerSec, READ_AHEAD_MS);
+    LOG_INF("Read ahead %u blocks for %s/s", depth, fmtSize(bytesPerSec));
     isPlaying = true; //playback status
     doPlayback = true; // control playback
-    readSD(); // prime playback task
+    readAheadStart(&playbackRA, &playbackFile, depth); // prime playback task
   }
 }
 
@@ -536,13 +837,15 @@ mjpegStruct getNextFrame(bool firstCall) {
   static uint32_t tTimeTot;
   static uint32_t hTime;
   static size_t remainingFrame;
+  static size_t remainingAudio;
   static size_t buffLen;
   const uint32_t dcVal = 0x63643030; // value of 00dc marker
+  const uint32_t wbVal = 0x62773130; // value of 01wb marker
   if (firstCall) {
     sTime = millis();
     hTime = millis();  
     remainingBuff = completedPlayback = false;
-    frameCnt = remainingFrame = vidSize = buffOffset = 0;
+    frameCnt = remainingFrame = remainingAudio = vidSize = buffOffset = 0;
     wTimeTot = fTimeTot = hTimeTot = tTimeTot = 1; // avoid divide by 0
   }  
   LOG_DBG("http send time %lu ms", millis() - hTime);
@@ -555,26 +858,33 @@ mjpegStruct getNextFrame(bool firstCall) {
       mTime = millis();
       // move final bytes to buffer start in case jpeg marker at end of buffer
       memcpy(iSDbuffer, iSDbuffer+RAMSIZE, CHUNK_HDR);
-      xSemaphoreTake(readSemaphore, portMAX_DELAY); // wait for read from SD card completed
-      buffLen = readLen;
+      uint8_t* blockData;
+      buffLen = readAheadNext(&playbackRA, &blockData); // wait for next read ahead block
       LOG_DBG("SD wait time %lu ms", millis()-mTime);
       wTimeTot += millis()-mTime;
       mTime = millis();  
       // overlap buffer by CHUNK_HDR to prevent jpeg marker being split between buffers
-      memcpy(iSDbuffer+CHUNK_HDR, iSDbuffer+RAMSIZE+CHUNK_HDR, buffLen); // load new cluster from double buffer
+      if (buffLen) memcpy(iSDbuffer+CHUNK_HDR, blockData, buffLen); // load new cluster from read ahead block
+      readAheadRelease(&playbackRA); // reader can refill block
       LOG_DBG("memcpy took %lu ms for %u bytes", millis()-mTime, buffLen);
       fTimeTot += millis() - mTime;
       remainingBuff = true;
       if (buffOffset > RAMSIZE) buffOffset = 4; // special case, marker overlaps end of buffer 
       else buffOffset = frameCnt ? 0 : CHUNK_HDR; // only before 1st frame
-      xTaskNotifyGive(playbackHandle); // wake up task to get next cluster - sets readLen
     }
     mTime = millis();
-    if (!remainingFrame) {
+    if (!remainingFrame && !remainingAudio) {
       // at start of jpeg frame marker
       uint32_t inVal;
       memcpy(&inVal, iSDbuffer + buffOffset, 4);
-      if (inVal != dcVal) {
+      if (inVal == wbVal) {
+        // interleaved audio chunk, not part of mjpeg stream so skip over it
+        uint32_t audLen;
+        memcpy(&audLen, iSDbuffer + buffOffset + 4, 4);
+        remainingAudio = audLen;
+        buffOffset += CHUNK_HDR;
+        mjpegData.jpegSize = 0;
+      } else if (inVal != dcVal) {
         // reached end of frames to stream
         mjpegData.buffLen = buffOffset; // remainder of final jpeg
         mjpegData.buffOffset = 0; // from start of buff
@@ -598,19 +908,30 @@ mjpegStruct getNextFrame(bool firstCall) {
         showProgress();
       }
     } else mjpegData.jpegSize = 0; // within frame,    
-    // determine amount of data to send to webServer
-    if (buffOffset > RAMSIZE) mjpegData.buffLen = 0; // special case 
-    else mjpegData.buffLen = (remainingFrame > buffLen - buffOffset) ? buffLen - buffOffset : remainingFrame;
-    mjpegData.buffOffset = buffOffset; // from here    
-    remainingFrame -= mjpegData.buffLen;
-    buffOffset += mjpegData.buffLen;
+    if (remainingAudio) {
+      // nothing to send until past audio, which may span several SD blocks
+      size_t skipLen = (buffOffset > RAMSIZE) ? 0 : min(remainingAudio, buffLen - buffOffset);
+      remainingAudio -= skipLen;
+      buffOffset += skipLen;
+      mjpegData.buffLen = 0;
+      mjpegData.buffOffset = buffOffset; // non zero so not end of playback
+    } else {
+      // determine amount of data to send to webServer
+      if (buffOffset > RAMSIZE) mjpegData.buffLen = 0; // special case 
+      else mjpegData.buffLen = (remainingFrame > buffLen - buffOffset) ? buffLen - buffOffset : remainingFrame;
+      mjpegData.buffOffset = buffOffset; // from here    
+      remainingFrame -= mjpegData.buffLen;
+      buffOffset += mjpegData.buffLen;
+    }
     if (buffOffset >= buffLen) remainingBuff = false;
   } else {
     // finished, close SD file used for streaming
+    readAheadStop(&playbackRA);
     playbackFile.close();
     logLine();
     if (!completedPlayback) LOG_INF("Force close playback");
     uint32_t playDuration = (millis() - sTime) / 1000;
+    uint32_t readTime = playbackRA.readTime ? playbackRA.readTime : 1;
     uint32_t totBusy = wTimeTot + fTimeTot + hTimeTot;
     LOG_INF("******** AVI playback stats ********");
     LOG_INF("Playback %s", aviFileName);
@@ -618,8 +939,9 @@ mjpegStruct getNextFrame(bool firstCall) {
     LOG_INF("Playback FPS %0.1f, duration %u secs", (float)frameCnt / playDuration, playDuration);
     LOG_INF("Number of frames: %u", frameCnt);
     if (frameCnt) {
-      LOG_INF("Average SD read speed: %u kB/s", ((vidSize / wTimeTot) * 1000) / 1024);
-      LOG_INF("Average frame SD read time: %u ms", wTimeTot / frameCnt);
+      LOG_INF("Average SD read speed: %u kB/s", ((playbackRA.readBytes / readTime) * 1000) / 1024);
+      LOG_INF("Average frame SD read time: %u ms", readTime / frameCnt);
+      LOG_INF("Average frame SD wait time: %u ms (%u blocks read ahead)", wTimeTot / frameCnt, playbackRA.depth);
       LOG_INF("Average frame processing time: %u ms", fTimeTot / frameCnt);
       LOG_INF("Average frame delay time: %u ms", tTimeTot / frameCnt);
       LOG_INF("Average http send time: %u ms", hTimeTot / frameCnt);
@@ -650,7 +972,7 @@ void stopPlaying() {
       doPlayback = false; // stop webserver playback
       setFPS(saveFPS);
       xSemaphoreGive(playbackSemaphore);
-      xSemaphoreGive(readSemaphore);
+      readAheadStop(&playbackRA);
       delay(200);
     } 
     stopPlayback = false;
@@ -658,20 +980,13 @@ void stopPlaying() {
   }
 }
 
-static void playbackTask(void* parameter) {
-  while (true) {
-    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-    readSD();
-  }
-  vTaskDelete(NULL);
-}
-
 /******************* Startup ********************/
 
 static void startSDtasks() {
   // tasks to manage SD card operation
   xTaskCreate(&captureTask, "captureTask", CAPTURE_STACK_SIZE, NULL, CAPTURE_PRI, &captureHandle);
-  xTaskCreate(&playbackTask, "playbackTask", PLAYBACK_STACK_SIZE, NULL, PLAY_PRI, &playbackHandle);
+  if (readAheadInit(&playbackRA, "playbackTask", RAMSIZE, MAX_READ_AHEAD, PLAYBACK_STACK_SIZE, PLAY_PRI)) 
+    playbackHandle = playbackRA.taskHandle;
   // set initial camera framesize and FPS from configs
   sensor_t * s = esp_camera_sensor_get();
   s->set_framesize(s, (framesize_t)fsizePtr);
@@ -681,7 +996,6 @@ static void startSDtasks() {
 
 bool prepRecording() {
   // initialisation & prep for AVI capture
-  readSemaphore = xSemaphoreCreateBinary();
   playbackSemaphore = xSemaphoreCreateBinary();
   aviMutex = xSemaphoreCreateMutex();
   motionSemaphore = xSemaphoreCreateBinary();
@@ -694,6 +1008,7 @@ bool prepRecording() {
   }
   reloadConfigs(); // apply camera config
   startSDtasks();
+  prepAlerts();
 #if INCLUDE_TINYML
   LOG_INF("%sUsing TinyML", mlUse ? "" : "Not ");
 #endif
@@ -35,6 +35,8 @@ using namespace std;
 #define RESIZE_DIM_SQ (RESIZE_DIM * RESIZE_DIM) // pixels in bitmap
 #define INACTIVE_COLOR 96 // color for inactive motion pixel
 #define JPEG_QUAL 80 // % quality for generated motion detect jpeg
+#define MAX_RESCALE_DIM 256 // max output dimension for rescaleImage()
+#define MOTION_JPEG_SIZE (32 * 1024) // max size of debug changeMap jpeg
   
 // motion recording parameters
 int detectMotionFrames = 5; // min sequence of changed frames to confirm motion 
@@ -47,19 +49,41 @@ int detectEndBand = 8; // inclusive
 int detectChangeThreshold = 15; // min difference in pixel comparison to indicate a change
 uint8_t colorDepth = RGB888_BYTES; // GRAYSCALE_BYTES or RGB888_BYTES
 static size_t stride;
+bool motionDC = true; // grayscale motion from JPEG DC coefficients instead of full decode
 bool mlUse = false; // whether to use ML for motion detection, requires INCLUDE_TINYML to be true
 float mlProbability = 0.8; // minimum probability (0.0 - 1.0) for positive classification
 
 uint8_t lightLevel; // Current ambient light level 
 uint8_t nightSwitch = 20; // initial white level % for night/day switching
 float motionVal = 8.0; // initial motion sensitivity setting
+uint32_t motionChanges = 0;
+uint32_t motionThreshold = 0;
 uint8_t* motionJpeg = NULL;
 size_t motionJpegLen = 0;
 static uint8_t* currBuff = NULL;
 
+// scratch buffers for checkMotion(), carved from one PSRAM block that is only
+// reallocated when frame size or color depth changes, so no per frame heap churn
+typedef struct {
+  uint8_t* base;
+  size_t size;
+  uint8_t* decode; // jpeg decode or DC thumbnail output
+  size_t decodeSize;
+  uint8_t* currGray;
+  uint8_t* prevGray;
+  uint8_t* changeMap;
+  uint8_t* mlBuff;
+  uint8_t fsize; // configuration arena is laid out for
+  uint8_t depth;
+  size_t highWater; // most bytes used by a single check
+  uint16_t resizes;
+} motionArena_t;
+static motionArena_t arena = {};
+
 /**********************************************************************************/
 
-static bool jpg2rgb(const uint8_t *src, size_t src_len, uint8_t ** out, jpg_scale_t scale);
+static bool jpg2rgb(const uint8_t *src, size_t src_len, uint8_t* out, size_t outSize, jpg_scale_t scale);
+static bool jpgDCluma(const uint8_t* src, size_t srcLen, uint8_t* out, size_t outSize, int* outWidth, int* outHeight);
 
 bool isNight(uint8_t nightSwitch) {
   // check if night time for suspending recording
@@ -90,33 +114,136 @@ bool isNight(uint8_t nightSwitch) {
   return nightTime;
 }
 
+static uint8_t* arenaAlloc(size_t& offset, size_t len) {
+  // carve 4 byte aligned block from arena, or just size it if no base yet
+  uint8_t* ptr = arena.base == NULL ? NULL : arena.base + offset;
+  offset += (len + 3) & ~3;
+  return ptr;
+}
+
+static size_t layoutArena() {
+  // assign arena blocks for current config, returns bytes required
+  size_t offset = 0;
+  uint16_t frameWidth = frameData[fsizePtr].frameWidth;
+  uint16_t frameHeight = frameData[fsizePtr].frameHeight;
+  uint8_t scaling = frameData[fsizePtr].scaleFactor;
+  size_t fullDecode = (frameWidth >> scaling) * (frameHeight >> scaling) * colorDepth;
+  size_t dcDecode = ((frameWidth + 7) / 8) * ((frameHeight + 7) / 8);
+  arena.decodeSize = max(fullDecode, dcDecode);
+  arena.decode = arenaAlloc(offset, arena.decodeSize);
+  currBuff = arenaAlloc(offset, RESIZE_DIM_SQ * colorDepth);
+  arena.currGray = arenaAlloc(offset, RESIZE_DIM_SQ);
+  arena.prevGray = arenaAlloc(offset, RESIZE_DIM_SQ);
+  arena.changeMap = arenaAlloc(offset, RESIZE_DIM_SQ * RGB888_BYTES);
+#if INCLUDE_TINYML
+  arena.mlBuff = arenaAlloc(offset, EI_CLASSIFIER_INPUT_WIDTH * EI_CLASSIFIER_INPUT_HEIGHT * colorDepth);
+#else
+  arena.mlBuff = NULL;
+#endif
+  return offset;
+}
+
+static bool prepMotionArena() {
+  // (re)size arena when frame size or color depth changes, else reuse as is
+  if (motionJpeg == NULL) motionJpeg = (uint8_t*)ps_malloc(MOTION_JPEG_SIZE);
+  if (arena.base != NULL && arena.fsize == fsizePtr && arena.depth == colorDepth) return true;
+  free(arena.base);
+  arena.base = NULL;
+  size_t needed = layoutArena();
+  arena.base = (uint8_t*)ps_malloc(needed);
+  if (arena.base == NULL) {
+    arena.size = 0;
+    LOG_ERR("motionDetect: failed to allocate %s arena", fmtSize(needed));
+    return false;
+  }
+  arena.size = layoutArena();
+  arena.fsize = fsizePtr;
+  arena.depth = colorDepth;
+  arena.highWater = 0;
+  arena.resizes++;
+  memset(arena.prevGray, 0, RESIZE_DIM_SQ);
+  LOG_INF("Motion detect arena %s for %s %s", fmtSize(arena.size), frameData[fsizePtr].frameSizeStr, colorDepth == RGB888_BYTES ? "color" : "grayscale");
+  return true;
+}
+
+size_t motionArenaHighWater() {
+  return arena.highWater;
+}
+
+/************* motion kernels *****************/
+
+// Integer only, branch free inner loops so they pipeline on the Xtensa core
+// without per pixel float, floor / ceil or division calls.
+// Vector (PIE) versions can be dropped in behind the same signatures.
+
 static void rescaleImage(const uint8_t* input, int inputWidth, int inputHeight, uint8_t* output, int outputWidth, int outputHeight) {
-  // use bilinear interpolation to resize image
-  float xRatio = (float)inputWidth / (float)outputWidth;
-  float yRatio = (float)inputHeight / (float)outputHeight;
-
-  for (int i = 0; i < outputHeight; ++i) {
-    for (int j = 0; j < outputWidth; ++j) {
-      int xL = (int)floor(xRatio * j);
-      int yL = (int)floor(yRatio * i);
-      int xH = (int)ceil(xRatio * j);
-      int yH = (int)ceil(yRatio * i);
-      float xWeight = xRatio * j - xL;
-      float yWeight = yRatio * i - yL;
-      for (int channel = 0; channel < colorDepth; ++channel) {
-        uint8_t a = input[(yL * inputWidth + xL) * colorDepth + channel];
-        uint8_t b = input[(yL * inputWidth + xH) * colorDepth + channel];
-        uint8_t c = input[(yH * inputWidth + xL) * colorDepth + channel];
-        uint8_t d = input[(yH * inputWidth + xH) * colorDepth + channel];
-
-        float pixel = a * (1 - xWeight) * (1 - yWeight) + b * xWeight * (1 - yWeight)
-                    + c * yWeight * (1 - xWeight) + d * xWeight * yWeight;
-        output[(i * outputWidth + j) * colorDepth + channel] = (uint8_t)pixel;
+  // use bilinear interpolation to resize image, in 8 bit fixed point
+  // source offsets and weights are computed once per column and per row
+  static uint16_t xLo[MAX_RESCALE_DIM], xHi[MAX_RESCALE_DIM], xW[MAX_RESCALE_DIM];
+  if (outputWidth > MAX_RESCALE_DIM || outputHeight > MAX_RESCALE_DIM) {
+    LOG_ERR("rescaleImage: output %ux%u exceeds %u", outputWidth, outputHeight, MAX_RESCALE_DIM);
+    return;
+  }
+  for (int j = 0; j < outputWidth; j++) {
+    uint32_t pos = (uint32_t)j * inputWidth * 256 / outputWidth;
+    uint16_t xL = pos >> 8;
+    xW[j] = pos & 0xFF;
+    xLo[j] = xL * colorDepth;
+    xHi[j] = (xW[j] && xL + 1 < inputWidth ? xL + 1 : xL) * colorDepth;
+  }
+  size_t rowLen = inputWidth * colorDepth;
+  for (int i = 0; i < outputHeight; i++) {
+    uint32_t pos = (uint32_t)i * inputHeight * 256 / outputHeight;
+    uint16_t yL = pos >> 8;
+    uint32_t yW = pos & 0xFF;
+    uint16_t yH = (yW && yL + 1 < inputHeight) ? yL + 1 : yL;
+    const uint8_t* rowL = input + yL * rowLen;
+    const uint8_t* rowH = input + yH * rowLen;
+    uint8_t* out = output + i * outputWidth * colorDepth;
+    for (int j = 0; j < outputWidth; j++) {
+      uint32_t wx = xW[j];
+      uint32_t wa = (256 - wx) * (256 - yW), wb = wx * (256 - yW);
+      uint32_t wc = (256 - wx) * yW, wd = wx * yW;
+      for (int channel = 0; channel < colorDepth; channel++) {
+        *out++ = (rowL[xLo[j] + channel] * wa + rowL[xHi[j] + channel] * wb
+                + rowH[xLo[j] + channel] * wc + rowH[xHi[j] + channel] * wd) >> 16;
       }
     }
   }
 }
 
+static void grayKernel(const uint8_t* input, uint8_t* gray, int pixels) {
+  // average of RGB channels, x/3 as multiply and shift
+  for (int i = 0; i < pixels; i++, input += RGB888_BYTES) 
+    gray[i] = ((uint32_t)(input[0] + input[1] + input[2]) * 0x5556) >> 16;
+}
+
+static uint32_t sumKernel(const uint8_t* gray, int pixels) {
+  // total brightness, 4 pixels per 32 bit load (buffers are 4 byte aligned)
+  uint32_t sum = 0;
+  const uint32_t* words = (const uint32_t*)gray;
+  int i = 0;
+  for (; i + 4 <= pixels; i += 4) {
+    uint32_t w = *words++;
+    uint32_t pairs = (w & 0x00FF00FF) + ((w >> 8) & 0x00FF00FF);
+    sum += (pairs & 0xFFFF) + (pairs >> 16);
+  }
+  for (; i < pixels; i++) sum += gray[i];
+  return sum;
+}
+
+static int changeKernel(const uint8_t* curr, const uint8_t* prev, int start, int end, int threshold) {
+  // count pixels whose absolute difference exceeds threshold, unrolled x4
+  int count = 0;
+  int i = start;
+  for (; i + 4 <= end; i += 4) {
+    count += (abs(curr[i] - prev[i]) > threshold) + (abs(curr[i + 1] - prev[i + 1]) > threshold)
+           + (abs(curr[i + 2] - prev[i + 2]) > threshold) + (abs(curr[i + 3] - prev[i + 3]) > threshold);
+  }
+  for (; i < end; i++) count += abs(curr[i] - prev[i]) > threshold;
+  return count;
+}
+
 #if INCLUDE_TINYML
 
 static int getImageData(size_t offset, size_t length, float *out_ptr) {
@@ -138,10 +265,8 @@ static bool tinyMLclassify() {
   uint32_t dTime = millis(); 
   // reduce size of bitmap to that required by classifier and copy to features as grayscale or RGB
   if (RESIZE_DIM != EI_CLASSIFIER_INPUT_WIDTH) {
-    uint8_t* tempBuff = (uint8_t*)ps_malloc(EI_CLASSIFIER_INPUT_WIDTH * EI_CLASSIFIER_INPUT_HEIGHT * colorDepth);
-    rescaleImage(currBuff, RESIZE_DIM, RESIZE_DIM, tempBuff, EI_CLASSIFIER_INPUT_WIDTH, EI_CLASSIFIER_INPUT_HEIGHT);
-    memcpy(currBuff, tempBuff, EI_CLASSIFIER_INPUT_WIDTH * EI_CLASSIFIER_INPUT_HEIGHT * colorDepth);
-    free(tempBuff);
+    rescaleImage(currBuff, RESIZE_DIM, RESIZE_DIM, arena.mlBuff, EI_CLASSIFIER_INPUT_WIDTH, EI_CLASSIFIER_INPUT_HEIGHT);
+    memcpy(currBuff, arena.mlBuff, EI_CLASSIFIER_INPUT_WIDTH * EI_CLASSIFIER_INPUT_HEIGHT * colorDepth);
   }
   signal_t features_signal;
   features_signal.total_length = EI_CLASSIFIER_INPUT_WIDTH * EI_CLASSIFIER_INPUT_HEIGHT;
@@ -167,14 +292,21 @@ static bool tinyMLclassify() {
 }
 #endif
 
+static size_t motionJpegOut(void* arg, size_t index, const void* data, size_t len) {
+  // jpg_out_cb for changeMap jpeg, bounded by motionJpeg size
+  if (index + len > MOTION_JPEG_SIZE) return 0;
+  memcpy(motionJpeg + index, data, len);
+  *(size_t*)arg = index + len;
+  return len;
+}
+
 bool checkMotion(camera_fb_t* fb, bool motionStatus) {
   // check difference between current and previous image (subtract background)
   // convert image from JPEG to downscaled RGB888 or 8 bit grayscale bitmap
   uint32_t dTime = millis();
   uint32_t lux = 0;
   static uint32_t motionCnt = 0;
-  uint8_t* rgb_buf = NULL;
-  uint8_t* jpg_buf = NULL;
+  if (!prepMotionArena()) return motionStatus;
 
   // calculate parameters for sample size
   uint8_t scaling = frameData[fsizePtr].scaleFactor; 
@@ -183,59 +315,66 @@ bool checkMotion(camera_fb_t* fb, bool motionStatus) {
   int sampleWidth = frameData[fsizePtr].frameWidth / downsize;
   int sampleHeight = frameData[fsizePtr].frameHeight / downsize;
   stride = colorDepth == RGB888_BYTES ? 1 : RGB888_BYTES;
-  if (!jpg2rgb((uint8_t*)fb->buf, fb->len, &rgb_buf, (jpg_scale_t)scaling)) {
-    LOG_ERR("motionDetect: jpg2rgb() failed");
-    free(rgb_buf);
-    rgb_buf = NULL;
-    return motionStatus;
+  int decodeWidth = 0, decodeHeight = 0;
+  bool useDC = motionDC && colorDepth == GRAYSCALE_BYTES;
+  if (useDC) {
+    // fast path: 1/8 scale luma thumbnail from the DC coefficients, no IDCT or color conversion
+    if (!jpgDCluma(fb->buf, fb->len, arena.decode, arena.decodeSize, &sampleWidth, &sampleHeight)) {
+      LOG_WRN("motionDetect: DC parse failed, using full decode");
+      useDC = false;
+    } else {
+      decodeWidth = sampleWidth;
+      decodeHeight = sampleHeight;
+    }
   }
-  LOG_DBG("JPEG to rescaled %s bitmap conversion %u bytes in %lums", colorDepth == RGB888_BYTES ? "color" : "grayscale", sampleWidth * sampleHeight * colorDepth, millis() - dTime);
+  if (!useDC) {
+    if (!jpg2rgb((uint8_t*)fb->buf, fb->len, arena.decode, arena.decodeSize, (jpg_scale_t)scaling)) {
+      LOG_ERR("motionDetect: jpg2rgb() failed");
+      return motionStatus;
+    }
+    decodeWidth = fb->width >> scaling;
+    decodeHeight = fb->height >> scaling;
+  }
+  size_t arenaUsed = arena.size - arena.decodeSize + decodeWidth * decodeHeight * (useDC ? 1 : colorDepth);
+  if (arenaUsed > arena.highWater) arena.highWater = arenaUsed;
+  LOG_DBG("JPEG to %s %s bitmap conversion %u bytes in %lums", useDC ? "DC" : "rescaled", colorDepth == RGB888_BYTES ? "color" : "grayscale", sampleWidth * sampleHeight * colorDepth, millis() - dTime);
   
-  // allocate buffer space on heap
   size_t resizeDimLen = RESIZE_DIM_SQ * colorDepth; // byte size of bitmap
-  if (motionJpeg == NULL) motionJpeg = (uint8_t*)ps_malloc(32 * 1024);
-  if (currBuff == NULL) currBuff = (uint8_t*)ps_malloc(resizeDimLen);
-  static uint8_t* prevBuff = (uint8_t*)ps_malloc(resizeDimLen);
-  static uint8_t* changeMap = (uint8_t*)ps_malloc(RESIZE_DIM_SQ * RGB888_BYTES);
+  uint8_t* currGray = arena.currGray;
+  uint8_t* prevGray = arena.prevGray;
+  uint8_t* changeMap = arena.changeMap;
 
   dTime = millis();
-  rescaleImage(rgb_buf, sampleWidth, sampleHeight, currBuff, RESIZE_DIM, RESIZE_DIM);
-  free(rgb_buf); 
-  rgb_buf = NULL;
+  rescaleImage(arena.decode, sampleWidth, sampleHeight, currBuff, RESIZE_DIM, RESIZE_DIM);
   LOG_DBG("Bitmap rescale to %u bytes in %lums", resizeDimLen, millis() - dTime);
  
   // compare each pixel in current frame with previous frame 
   dTime = millis();
-  int changeCount = 0;
   // set horizontal region of interest in image 
-  uint16_t startPixel = resizeDimLen*(detectStartBand-1)/detectNumBands;
-  uint16_t endPixel = resizeDimLen*(detectEndBand)/detectNumBands;
-  int moveThreshold = ((endPixel-startPixel)/colorDepth) * (11-motionVal)/100; // number of changed pixels that constitute a movement
-  for (int i = 0; i < resizeDimLen; i += colorDepth) {
-    uint16_t currPix = 0, prevPix = 0;
-    for (int j = 0; j < colorDepth; j++) {
-      currPix += currBuff[i + j];
-      prevPix += prevBuff[i + j];
-    }
-    currPix /= colorDepth;
-    prevPix /= colorDepth;
-    lux += currPix; // for calculating light level
-    uint8_t pixVal = 255; // show active changed pixel as bright red color in changeMap image
+  int startPixel = RESIZE_DIM_SQ*(detectStartBand-1)/detectNumBands;
+  int endPixel = RESIZE_DIM_SQ*(detectEndBand)/detectNumBands;
+  int moveThreshold = (endPixel-startPixel) * (11-motionVal)/100; // number of changed pixels that constitute a movement
+  if (colorDepth == RGB888_BYTES) grayKernel(currBuff, currGray, RESIZE_DIM_SQ);
+  else memcpy(currGray, currBuff, RESIZE_DIM_SQ);
+  lux = sumKernel(currGray, RESIZE_DIM_SQ); // for calculating light level
+  int changeCount = changeKernel(currGray, prevGray, startPixel, endPixel, detectChangeThreshold);
+  motionChanges = changeCount; // motion score for clip sidecar
+  motionThreshold = moveThreshold;
+  if (dbgMotion) {
     // set up display image for motion tracking debug
-    if (dbgMotion) for (int j = 0; j < RGB888_BYTES; j++) changeMap[(i * stride) + j] = currPix; // grayscale
-    // determine pixel change status
-    if (abs((int)currPix - (int)prevPix) > detectChangeThreshold) {
-      if (i > startPixel && i < endPixel) changeCount++; // number of changed pixels
-      else pixVal = 80; // show inactive changed pixel as dark red color in changeMap image
-      if (dbgMotion) {
-        changeMap[(i * stride) + 2] = pixVal;
-        for (int j = 0; j < RGB888_BYTES - 1; j++) changeMap[(i * stride) + j] = 0;
+    for (int i = 0; i < RESIZE_DIM_SQ; i++) {
+      uint8_t* pix = changeMap + i * RGB888_BYTES;
+      pix[0] = pix[1] = pix[2] = currGray[i]; // grayscale
+      if (abs(currGray[i] - prevGray[i]) > detectChangeThreshold) {
+        // show active changed pixel as bright red, inactive as dark red
+        pix[0] = pix[1] = 0;
+        pix[2] = (i >= startPixel && i < endPixel) ? 255 : 80;
       }
     }
   }
   lightLevel = (lux*100)/(RESIZE_DIM_SQ*255); // light value as a %
   nightTime = isNight(nightSwitch);
-  memcpy(prevBuff, currBuff, resizeDimLen); // save image for next comparison 
+  swap(arena.currGray, arena.prevGray); // save image for next comparison 
   LOG_DBG("Detected %u changes, threshold %u, light level %u, in %lums", changeCount, moveThreshold, lightLevel, millis() - dTime);
 
   dTime = millis();
@@ -250,26 +389,13 @@ bool checkMotion(camera_fb_t* fb, bool motionStatus) {
       // pass image to TinyML for classification
       if (!dbgMotion && mlUse) if (!tinyMLclassify()) motionCnt = 0; // not classified, so cancel motion
 #endif
-      if (motionCnt) {
-#if INCLUDE_SMTP
-        if (smtpUse) {
-          // send email with movement image
-          keepFrame(fb);
-          char subjectMsg[50];
-          snprintf(subjectMsg, sizeof(subjectMsg) - 1, "from %s", hostName);
-          emailAlert("Motion Alert", subjectMsg);
-        } 
+#if INCLUDE_SMTP || INCLUDE_TGRAM
+      // email / telegram image is prepared and sent by alertTask
+      if (motionCnt) raiseAlert();
 #endif
-#if INCLUDE_TGRAM
-        if (tgramUse) keepFrame(fb); // for telegram, wait till filename available
-#endif
-      }
       dTime = millis();
 #if INCLUDE_MQTT
-      if (mqtt_active && motionCnt) {
-        sprintf(jsonBuff, "{\"MOTION\":\"ON\",\"TIME\":\"%s\"}",esp_log_system_timestamp());
-        mqttPublish(jsonBuff);
-      }
+      if (mqtt_active && motionCnt) mqttEvent("MOTION", true);
 #endif
     } 
   } else motionCnt = 0;
@@ -279,10 +405,7 @@ bool checkMotion(camera_fb_t* fb, bool motionStatus) {
     LOG_DBG("***** Motion - STOP");
     motionStatus = false; // motion stopped
 #if INCLUDE_MQTT
-    if (mqtt_active) {
-      sprintf(jsonBuff, "{\"MOTION\":\"OFF\",\"TIME\":\"%s\"}", esp_log_system_timestamp());
-      mqttPublish(jsonBuff);
-    }
+    if (mqtt_active) mqttEvent("MOTION", false);
 #endif
   } 
   if (motionStatus) LOG_DBG("*** Motion - ongoing %u frames", motionCnt);
@@ -291,11 +414,11 @@ bool checkMotion(camera_fb_t* fb, bool motionStatus) {
     // ready to setup next movement map for streaming
     dTime = millis();
     // build jpeg of changeMap for debug streaming
-    if (!fmt2jpg(changeMap, resizeDimLen, RESIZE_DIM, RESIZE_DIM, PIXFORMAT_RGB888, JPEG_QUAL, &jpg_buf, &motionJpegLen))
-      LOG_ERR("motionDetect: fmt2jpg() failed");
-    memcpy(motionJpeg, jpg_buf, motionJpegLen); 
-    free(jpg_buf);
-    jpg_buf = NULL;
+    // encoded straight into motionJpeg rather than a malloc'd buffer
+    size_t jpegLen = 0;
+    if (motionJpeg == NULL || !fmt2jpg_cb(changeMap, RESIZE_DIM_SQ * RGB888_BYTES, RESIZE_DIM, RESIZE_DIM, PIXFORMAT_RGB888, JPEG_QUAL, motionJpegOut, &jpegLen))
+      LOG_ERR("motionDetect: fmt2jpg_cb() failed");
+    motionJpegLen = jpegLen;
     xSemaphoreGive(motionSemaphore);
     LOG_DBG("Created changeMap JPEG %d bytes in %lums", motionJpegLen, millis() - dTime);
   }
@@ -314,6 +437,7 @@ typedef struct {
   uint16_t data_offset;
   const uint8_t *input;
   uint8_t *output;
+  size_t outSize;
 } rgb_jpg_decoder;
 
 static bool _rgb_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data) {
@@ -324,11 +448,8 @@ static bool _rgb_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16_t
       // write start
       jpeg->width = w;
       jpeg->height = h;
-      // if output is null, this is BMP
-      if (!jpeg->output) {
-        jpeg->output = (uint8_t*)ps_malloc((w*h*colorDepth)+jpeg->data_offset);
-        if (!jpeg->output) return false;
-      }
+      // mpjpeg2sd: output to caller's buffer instead of allocating per frame
+      if ((size_t)(w*h*colorDepth)+jpeg->data_offset > jpeg->outSize) return false;
     } 
     return true;
   }
@@ -365,14 +486,255 @@ static uint32_t _jpg_read(void * arg, size_t index, uint8_t *buf, size_t len) {
   return len;
 }
 
-static bool jpg2rgb(const uint8_t *src, size_t src_len, uint8_t **out, jpg_scale_t scale) {
+static bool jpg2rgb(const uint8_t *src, size_t src_len, uint8_t* out, size_t outSize, jpg_scale_t scale) {
   rgb_jpg_decoder jpeg;
   jpeg.width = 0;
   jpeg.height = 0;
   jpeg.input = src;
-  jpeg.output = NULL; 
+  jpeg.output = out; 
+  jpeg.outSize = outSize;
   jpeg.data_offset = 0;
   esp_err_t res = esp_jpg_decode(src_len, scale, _jpg_read, _rgb_write, (void*)&jpeg);
-  *out = jpeg.output;
   return (res == ESP_OK) ? true : false;
 }
+
+/************* fast luma thumbnail from baseline JPEG DC coefficients *****************/
+
+// Each 8x8 block's DC coefficient is 8x its mean value, so Huffman parsing the
+// entropy data and keeping only the Y DC terms gives a 1/8 scale grayscale image.
+// AC coefficients are decoded only to skip over them: no dequantize, IDCT or color conversion.
+
+#define DC_LUT_BITS 9 // code lengths resolved by single table lookup
+
+typedef struct {
+  uint16_t lut[1 << DC_LUT_BITS]; // (code length << 8) | symbol, 0 if longer code
+  int32_t maxCode[17]; // largest code of each length, -1 if none
+  int32_t valOffset[17]; // symbol index minus first code of each length
+  uint8_t vals[256];
+  bool defined;
+} dcHuffTable;
+
+typedef struct {
+  const uint8_t* ptr;
+  const uint8_t* end;
+  uint32_t bits; // left aligned
+  int bitCnt;
+  bool atMarker;
+} dcBitReader;
+
+static void dcBuildTable(dcHuffTable* ht, const uint8_t* counts, const uint8_t* symbols, int numSymbols) {
+  memset(ht->lut, 0, sizeof(ht->lut));
+  memcpy(ht->vals, symbols, numSymbols);
+  int code = 0, k = 0;
+  for (int len = 1; len <= 16; len++) {
+    ht->valOffset[len] = k - code;
+    ht->maxCode[len] = counts[len - 1] ? code + counts[len - 1] - 1 : -1;
+    for (int i = 0; i < counts[len - 1]; i++, k++, code++) {
+      if (len <= DC_LUT_BITS) {
+        int fill = 1 << (DC_LUT_BITS - len);
+        for (int j = 0; j < fill; j++) ht->lut[(code << (DC_LUT_BITS - len)) + j] = (len << 8) | symbols[k];
+      }
+    }
+    code <<= 1;
+  }
+  ht->defined = true;
+}
+
+static inline void dcFillBits(dcBitReader* br) {
+  // keep at least 25 bits available, unstuffing 0xFF00 and stopping at markers
+  while (br->bitCnt <= 24) {
+    uint32_t c = 0;
+    if (!br->atMarker && br->ptr < br->end) {
+      c = *br->ptr;
+      if (c == 0xFF) {
+        if (br->ptr + 1 < br->end && br->ptr[1] == 0x00) br->ptr += 2;
+        else {
+          br->atMarker = true; // leave marker unread, feed zeros
+          c = 0;
+        }
+      } else br->ptr++;
+    }
+    br->bits |= c << (24 - br->bitCnt);
+    br->bitCnt += 8;
+  }
+}
+
+static inline int dcGetBits(dcBitReader* br, int n) {
+  dcFillBits(br);
+  int val = br->bits >> (32 - n);
+  br->bits <<= n;
+  br->bitCnt -= n;
+  return val;
+}
+
+static inline int dcDecode(dcBitReader* br, const dcHuffTable* ht) {
+  dcFillBits(br);
+  uint16_t entry = ht->lut[br->bits >> (32 - DC_LUT_BITS)];
+  if (entry) {
+    br->bits <<= entry >> 8;
+    br->bitCnt -= entry >> 8;
+    return entry & 0xFF;
+  }
+  for (int len = DC_LUT_BITS + 1; len <= 16; len++) {
+    int32_t code = br->bits >> (32 - len);
+    if (code <= ht->maxCode[len]) {
+      br->bits <<= len;
+      br->bitCnt -= len;
+      return ht->vals[code + ht->valOffset[len]];
+    }
+  }
+  return -1; // corrupt data
+}
+
+static bool dcRestart(dcBitReader* br) {
+  // skip to after next RSTn marker
+  const uint8_t* p = br->ptr;
+  while (p + 1 < br->end && !(p[0] == 0xFF && p[1] >= 0xD0 && p[1] <= 0xD7)) p++;
+  if (p + 1 >= br->end) return false;
+  br->ptr = p + 2;
+  br->bits = 0;
+  br->bitCnt = 0;
+  br->atMarker = false;
+  return true;
+}
+
+static bool jpgDCluma(const uint8_t* src, size_t srcLen, uint8_t* out, size_t outSize, int* outWidth, int* outHeight) {
+  // parse baseline JPEG headers then entropy data, writing mean luma of each Y block to out
+  static dcHuffTable dcTables[2], acTables[2]; // static as ~4kB, tables rebuilt per frame
+  uint16_t dcQuant[4] = {0};
+  uint8_t compId[3], compH[3], compV[3], compQ[3], compDC[3], compAC[3];
+  int numComps = 0, width = 0, height = 0, restartInterval = 0;
+  const uint8_t* p = src;
+  const uint8_t* end = src + srcLen;
+  for (int i = 0; i < 2; i++) dcTables[i].defined = acTables[i].defined = false;
+
+  if (srcLen < 4 || p[0] != 0xFF || p[1] != 0xD8) return false;
+  p += 2;
+  while (true) {
+    // read each marker segment up to start of scan
+    while (p < end && *p != 0xFF) p++;
+    while (p < end && *p == 0xFF) p++;
+    if (p + 3 > end) return false;
+    uint8_t marker = *p++;
+    if (marker == 0xD8 || (marker >= 0xD0 && marker <= 0xD7)) continue;
+    if (marker == 0xD9) return false; // EOI before scan
+    uint16_t segLen = (p[0] << 8) | p[1];
+    const uint8_t* seg = p + 2;
+    const uint8_t* segEnd = p + segLen;
+    if (segLen < 2 || segEnd > end) return false;
+
+    if (marker == 0xDB) {
+      // DQT - only the DC quantizer of each table is needed
+      while (seg < segEnd) {
+        uint8_t pq = seg[0] >> 4, tq = seg[0] & 0x03;
+        dcQuant[tq] = pq ? (seg[1] << 8) | seg[2] : seg[1];
+        seg += 1 + (pq ? 128 : 64);
+      }
+    } else if (marker == 0xC0 || marker == 0xC1) {
+      // SOF0 / SOF1 baseline frame
+      height = (seg[1] << 8) | seg[2];
+      width = (seg[3] << 8) | seg[4];
+      numComps = seg[5];
+      if (numComps != 1 && numComps != 3) return false;
+      for (int i = 0; i < numComps; i++) {
+        compId[i] = seg[6 + i * 3];
+        compH[i] = seg[7 + i * 3] >> 4;
+        compV[i] = seg[7 + i * 3] & 0x0F;
+        compQ[i] = seg[8 + i * 3] & 0x03;
+        if (!compH[i] || !compV[i]) return false;
+      }
+    } else if (marker == 0xC2 || marker == 0xC3 || (marker >= 0xC5 && marker <= 0xCF && marker != 0xC8 && marker != 0xCC)) {
+      return false; // progressive, lossless or arithmetic coded
+    } else if (marker == 0xC4) {
+      // DHT
+      while (seg + 17 <= segEnd) {
+        uint8_t tc = seg[0] >> 4, th = seg[0] & 0x01;
+        int numSymbols = 0;
+        for (int i = 0; i < 16; i++) numSymbols += seg[1 + i];
+        if (numSymbols > 256 || seg + 17 + numSymbols > segEnd) return false;
+        dcBuildTable(tc ? &acTables[th] : &dcTables[th], seg + 1, seg + 17, numSymbols);
+        seg += 17 + numSymbols;
+      }
+    } else if (marker == 0xDD) {
+      restartInterval = (seg[0] << 8) | seg[1];
+    } else if (marker == 0xDA) {
+      // SOS - map scan components to their tables, entropy data follows segment
+      if (!numComps || seg[0] != numComps) return false; // non interleaved scans not supported
+      for (int i = 0; i < numComps; i++) {
+        uint8_t id = seg[1 + i * 2];
+        if (id != compId[i]) return false;
+        compDC[i] = seg[2 + i * 2] >> 4 & 0x01;
+        compAC[i] = seg[2 + i * 2] & 0x01;
+        if (!dcTables[compDC[i]].defined || !acTables[compAC[i]].defined) return false;
+      }
+      p = segEnd;
+      break;
+    }
+    p = segEnd;
+  }
+
+  // block grid of the Y component
+  int maxH = 1, maxV = 1;
+  for (int i = 0; i < numComps; i++) {
+    if (compH[i] > maxH) maxH = compH[i];
+    if (compV[i] > maxV) maxV = compV[i];
+  }
+  if (numComps == 1) maxH = maxV = compH[0] = compV[0] = 1; // single component scan is not MCU interleaved
+  int mcusX = (width + 8 * maxH - 1) / (8 * maxH);
+  int mcusY = (height + 8 * maxV - 1) / (8 * maxV);
+  int thumbW = (width * compH[0] / maxH + 7) / 8;
+  int thumbH = (height * compV[0] / maxV + 7) / 8;
+  if (!width || !height || (size_t)(thumbW * thumbH) > outSize) return false;
+
+  dcBitReader br = {p, end, 0, 0, false};
+  int pred[3] = {0};
+  int q0 = dcQuant[compQ[0]] ? dcQuant[compQ[0]] : 1;
+  int mcuCount = 0;
+  for (int my = 0; my < mcusY; my++) {
+    for (int mx = 0; mx < mcusX; mx++) {
+      if (restartInterval && mcuCount && !(mcuCount % restartInterval)) {
+        if (!dcRestart(&br)) return false;
+        pred[0] = pred[1] = pred[2] = 0;
+      }
+      mcuCount++;
+      for (int c = 0; c < numComps; c++) {
+        const dcHuffTable* dcT = &dcTables[compDC[c]];
+        const dcHuffTable* acT = &acTables[compAC[c]];
+        for (int by = 0; by < compV[c]; by++) {
+          for (int bx = 0; bx < compH[c]; bx++) {
+            // DC difference
+            int sz = dcDecode(&br, dcT);
+            if (sz < 0 || sz > 11) return false;
+            if (sz) {
+              int diff = dcGetBits(&br, sz);
+              if (diff < (1 << (sz - 1))) diff -= (1 << sz) - 1;
+              pred[c] += diff;
+            }
+            // skip AC coefficients
+            for (int k = 1; k < 64; k++) {
+              int rs = dcDecode(&br, acT);
+              if (rs < 0) return false;
+              int run = rs >> 4, acSize = rs & 0x0F;
+              if (acSize) {
+                k += run;
+                dcGetBits(&br, acSize);
+              } else if (run == 15) k += 15;
+              else break; // end of block
+            }
+            if (c == 0) {
+              int x = mx * compH[0] + bx;
+              int y = my * compV[0] + by;
+              if (x < thumbW && y < thumbH) {
+                int pix = pred[0] * q0 / 8 + 128;
+                out[y * thumbW + x] = pix < 0 ? 0 : (pix > 255 ? 255 : pix);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  *outWidth = thumbW;
+  *outHeight = thumbH;
+  return true;
+}
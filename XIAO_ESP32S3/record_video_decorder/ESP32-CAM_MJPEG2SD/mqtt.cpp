@@ -16,6 +16,8 @@ char mqtt_topic_prefix[FILE_NAME_LEN / 2] = "";  //Mqtt server topic to publish
 #define MQTT_LWT_RETAIN 1
 #define MQTT_RETAIN 0
 #define MQTT_QOS 1
+#define MQTT_QUEUE_LEN 16 // events held while publishing or disconnected
+#define MQTT_METRICS_SECS 60 // interval between metrics messages
 
 bool mqtt_active = false;         //Is enabled
 bool mqttRunning = false;         //Is mqtt task running
@@ -27,6 +29,16 @@ static char lwt_topic[FILE_NAME_LEN / 2];
 static char cmd_topic[FILE_NAME_LEN / 2];
 static int mqttTaskDelay = 0;
 static char mqttPublishTopic[FILE_NAME_LEN] = "";
+static char mqttMetricsTopic[FILE_NAME_LEN] = "";
+
+// events from capture path are queued as fixed size records and published by mqttTask
+struct mqttEvent_t {
+  const char* event; // string literal, eg "MOTION"
+  bool on;
+  struct timeval tv; // time of event, not of publish
+};
+static QueueHandle_t mqttQueue = NULL;
+static uint32_t mqttDropped = 0; // events lost to a full queue
 
 void mqtt_client_publish(const char* topic, const char* payload){
   if (!mqtt_client || !mqttConnected) return;
@@ -41,6 +53,38 @@ void mqttPublish(const char* payload) {
   mqtt_client_publish(mqttPublishTopic, payload);
 }
 
+void mqttEvent(const char* event, bool on) {
+  // queue event for mqttTask, never waits so safe to call from capture
+  if (mqttQueue == NULL) return;
+  mqttEvent_t mqttEv = {event, on};
+  gettimeofday(&mqttEv.tv, NULL);
+  if (xQueueSend(mqttQueue, &mqttEv, 0) != pdTRUE) mqttDropped++;
+  else if (mqttTaskHandle != NULL) xTaskNotifyGive(mqttTaskHandle);
+}
+
+static void publishEvents() {
+  // publish queued events in order, as {"MOTION":"ON","TIME":"10:07:47.560"}
+  mqttEvent_t mqttEv;
+  char eventMsg[64];
+  while (mqttConnected && xQueueReceive(mqttQueue, &mqttEv, 0) == pdTRUE) {
+    struct tm lt;
+    localtime_r(&mqttEv.tv.tv_sec, &lt);
+    snprintf(eventMsg, sizeof(eventMsg), "{\"%s\":\"%s\",\"TIME\":\"%02d:%02d:%02d.%03ld\"}", mqttEv.event, 
+      mqttEv.on ? "ON" : "OFF", lt.tm_hour, lt.tm_min, lt.tm_sec, mqttEv.tv.tv_usec / 1000);
+    mqttPublish(eventMsg);
+  }
+}
+
+static void publishMetrics() {
+  // one compact message per interval for all periodic metrics
+  if (!strlen(mqtt_topic_prefix)) return;
+  if (!strlen(mqttMetricsTopic)) snprintf(mqttMetricsTopic, FILE_NAME_LEN, "%s%s/metrics", mqtt_topic_prefix, hostName);
+  char metricsMsg[160];
+  size_t msgLen = buildMqttMetrics(metricsMsg, sizeof(metricsMsg) - 24);
+  snprintf(metricsMsg + msgLen, sizeof(metricsMsg) - msgLen, ",\"drop\":%u}", mqttDropped);
+  mqtt_client_publish(mqttMetricsTopic, metricsMsg);
+}
+
 static void mqtt_connected_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data) {
   LOG_INF("Mqtt connected");
   esp_mqtt_client_publish(mqtt_client, lwt_topic, "online", 0, MQTT_LWT_QOS, MQTT_LWT_RETAIN);
@@ -115,22 +159,33 @@ void checkForRemoteQuerry() {
 }
 
 static void mqttTask(void* parameter) { 
+  // woken by remote command or queued event, else by metrics interval
   LOG_DBG("Mqtt task start"); 
+  uint32_t metricsTime = millis();
+  bool wasConnected = true;
   while (mqtt_active) {
-    //LOG_DBG("Waiting for signal..");
-    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-    //LOG_DBG("Wake..");
+    uint32_t sinceMetrics = millis() - metricsTime;
+    uint32_t metricsWait = sinceMetrics < MQTT_METRICS_SECS * 1000 ? MQTT_METRICS_SECS * 1000 - sinceMetrics : 0;
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(metricsWait));
+    if (!mqtt_active) break;
     if (mqttConnected) {
       //Check if server sends a remote command
       checkForRemoteQuerry();
+      publishEvents();
+      if (millis() - metricsTime >= MQTT_METRICS_SECS * 1000) {
+        publishMetrics();
+        metricsTime = millis();
+      }
       if (mqttTaskDelay > 0 ) vTaskDelay(mqttTaskDelay / portTICK_RATE_MS);
-    } else { //Disconnected      
-      LOG_ERR("Disconnected wait..");
+      wasConnected = true;
+    } else { //Disconnected, events stay queued till reconnect 
+      if (wasConnected) LOG_ERR("Disconnected wait..");
+      wasConnected = false;
       vTaskDelay(2000 / portTICK_RATE_MS);
     }        
-    //xTaskNotifyGive(mqttTaskHandle);    
   }
   mqttRunning = false;
+  mqttTaskHandle = NULL;
   LOG_DBG("Mqtt Task exiting..");  
   vTaskDelete(NULL);
 }
@@ -207,6 +262,7 @@ void startMqttClient(void){
         return;
       } 
       else LOG_DBG("Mqtt subscribed: %s", cmd_topic );
+      if (mqttQueue == NULL) mqttQueue = xQueueCreate(MQTT_QUEUE_LEN, sizeof(mqttEvent_t));
       // Create a mqtt task
       BaseType_t xReturned = xTaskCreate(&mqttTask, "mqttTask", MQTT_STACK_SIZE, NULL, MQTT_PRI, &mqttTaskHandle);
       LOG_INF("Created mqtt task: %u", xReturned );
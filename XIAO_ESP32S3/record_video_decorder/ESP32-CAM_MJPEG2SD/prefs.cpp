@@ -9,6 +9,8 @@
                                                    retrieveConfigVal (as required)
   statusHandler:
     vector -> buildJsonString+buildAppJsonString -> browser 
+  keys are located via keyIndex, a hash table of vector rows rebuilt whenever
+  the vector is loaded or reordered, so lookups don't search or allocate
   controlHandler: 
     browser -> updateStatus+updateAppStatus -> updateConfigVect -> vector -> saveConfigVect -> file 
                                             -> vars
@@ -36,6 +38,11 @@ static char variable[FILE_NAME_LEN] = {0,};
 static char value[FILE_NAME_LEN] = {0,};
 time_t currEpoch = 0;
 
+#define KEY_INDEX_LEN 512 // power of 2, at least twice MAX_CONFIGS to keep probe chains short
+static_assert(KEY_INDEX_LEN >= MAX_CONFIGS * 2 && !(KEY_INDEX_LEN & (KEY_INDEX_LEN - 1)), "KEY_INDEX_LEN too small");
+static int16_t keyIndex[KEY_INDEX_LEN]; // configs row for key hash slot, -1 if empty
+static bool jsonTruncated = false;
+
 /********************* generic Config functions ****************************/
 
 static bool getNextKeyVal(char* keyName, char* keyVal) {
@@ -55,27 +62,41 @@ void reloadConfigs() {
   while (getNextKeyVal(variable, value)) updateStatus(variable, value);
 }
 
-static int getKeyPos(std::string thisKey) {
+static constexpr uint32_t keyHash(const char* key, uint32_t hash = 2166136261u) {
+  // FNV-1a hash of config key
+  return *key ? keyHash(key + 1, (hash ^ (uint8_t)*key) * 16777619u) : hash;
+}
+
+static void indexConfigs() {
+  // rebuild key index after configs vector loaded or reordered, first row wins for duplicate keys
+  memset(keyIndex, 0xFF, sizeof(keyIndex));
+  int rows = std::min((int)configs.size(), KEY_INDEX_LEN - 1); // always leave an empty slot to end probes
+  for (int row = 0; row < rows; row++) {
+    const char* key = configs[row][0].c_str();
+    uint32_t slot = keyHash(key) & (KEY_INDEX_LEN - 1);
+    while (keyIndex[slot] >= 0 && strcmp(configs[keyIndex[slot]][0].c_str(), key)) slot = (slot + 1) & (KEY_INDEX_LEN - 1);
+    if (keyIndex[slot] < 0) keyIndex[slot] = row;
+  }
+}
+
+static int getKeyPos(const char* thisKey) {
   // get location of given key to retrieve other elements
   if (configs.empty()) return -1;
-  auto lower = std::lower_bound(configs.begin(), configs.end(), thisKey, [](
-    const std::vector<std::string> &a, const std::string &b) { 
-    return a[0] < b;}
-  );
-  int keyPos = std::distance(configs.begin(), lower); 
-  if (keyPos < configs.size() && thisKey == configs[keyPos][0]) return keyPos;
-//  else LOG_DBG("Key %s not found", thisKey.c_str()); 
+  uint32_t slot = keyHash(thisKey) & (KEY_INDEX_LEN - 1);
+  while (keyIndex[slot] >= 0) {
+    if (!strcmp(configs[keyIndex[slot]][0].c_str(), thisKey)) return keyIndex[slot];
+    slot = (slot + 1) & (KEY_INDEX_LEN - 1);
+  }
+//  LOG_DBG("Key %s not found", thisKey); 
   return -1; // not found
 }
 
 bool updateConfigVect(const char* variable, const char* value) {
-  std::string thisKey(variable);
-  std::string thisVal(value);
-  int keyPos = getKeyPos(thisKey);
+  int keyPos = getKeyPos(variable);
   if (keyPos >= 0) {
-    // update value
+    // update value, only allocates if longer than capacity reserved on load
     if (psramFound()) heap_caps_malloc_extmem_enable(MIN_RAM); 
-    configs[keyPos][1] = thisVal;
+    configs[keyPos][1] = value;
     if (psramFound()) heap_caps_malloc_extmem_enable(MAX_RAM);
     return true;    
   }
@@ -83,8 +104,7 @@ bool updateConfigVect(const char* variable, const char* value) {
 }
 
 bool retrieveConfigVal(const char* variable, char* value) {
-  std::string thisKey(variable);
-  int keyPos = getKeyPos(thisKey);
+  int keyPos = getKeyPos(variable);
   if (keyPos >= 0) {
     strcpy(value, configs[keyPos][1].c_str()); 
     return true;  
@@ -109,6 +129,7 @@ static void loadVectItem(const std::string keyValGrpLabel) {
       if (!ALLOW_SPACES) token[1].erase(std::remove(token[1].begin(), token[1].end(), ' '), token[1].end());
       if (token[tokens-1][token[tokens-1].size() - 1] == '\r') token[tokens-1].erase(token[tokens-1].size() - 1);
       configs.push_back({token[0], token[1], token[2], token[3], token[4]});
+      configs.back()[1].reserve(FILE_NAME_LEN - 1); // value updates then reuse the same storage
     }
   }
   if (configs.size() > MAX_CONFIGS) LOG_ERR("Config file entries: %u exceed max: %u", configs.size(), MAX_CONFIGS);
@@ -121,6 +142,7 @@ static void saveConfigVect() {
   else {
     sort(configs.begin(), configs.end());
     configs.erase(unique(configs.begin(), configs.end()), configs.end()); // remove any dups
+    indexConfigs();
     for (const auto& row: configs) {
       // recreate config file with updated content
       if (!strcmp(row[0].c_str() + strlen(row[0].c_str()) - 5, "_Pass")) 
@@ -149,6 +171,7 @@ static bool loadConfigVect() {
     const std::vector<std::string> &a, const std::vector<std::string> &b) {
     return a[0] < b[0];}
   );
+  indexConfigs();
   // return malloc to default 
   if (psramFound()) heap_caps_malloc_extmem_enable(MAX_RAM);
   file.close();
@@ -272,6 +295,7 @@ void updateStatus(const char* variable, const char* _value) {
   else if(!strcmp(variable, "autoUpload")) autoUpload = (bool)intVal;
   else if(!strcmp(variable, "deleteAfter")) deleteAfter = (bool)intVal;
   else if(!strcmp(variable, "useFtps")) useFtps = (bool)intVal;
+  else if(!strcmp(variable, "ftpParallel")) ftpParallel = (bool)intVal;
 #endif
 #if INCLUDE_SMTP
   else if (!strcmp(variable, "smtpUse")) {
@@ -354,10 +378,38 @@ void updateStatus(const char* variable, const char* _value) {
   if (res) updateConfigVect(variable, value);  
 }
 
+static char* addJsonPair(char* p, const char* key, const char* val, int valLen = -1) {
+  // append "key":"val", to jsonBuff without format parsing, dropped if no room
+  size_t keyLen = strlen(key);
+  if (valLen < 0) valLen = strlen(val);
+  if (p + keyLen + valLen + 7 > jsonBuff + JSON_BUFF_LEN) {
+    jsonTruncated = true;
+    return p;
+  }
+  *p++ = '"';
+  memcpy(p, key, keyLen);
+  p += keyLen;
+  memcpy(p, "\":\"", 3);
+  p += 3;
+  memcpy(p, val, valLen);
+  p += valLen;
+  *p++ = '"';
+  *p++ = ',';
+  return p;
+}
+
+static char* addJsonLabel(char* p, const char* prefix, const char* key, const char* val) {
+  // append "<prefix><key>":"val",
+  char prefixed[FILE_NAME_LEN];
+  snprintf(prefixed, sizeof(prefixed), "%s%s", prefix, key);
+  return addJsonPair(p, prefixed, val);
+}
+
 void buildJsonString(uint8_t filter) {
   // called from statusHandler() to build json string with current status to return to browser 
   char* p = jsonBuff;
   *p++ = '{';
+  jsonTruncated = false;
   if (filter < 2) {
     // build json string for main page refresh
     buildAppJsonString((bool)filter);
@@ -374,26 +426,27 @@ void buildJsonString(uint8_t filter) {
     formatElapsedTime(timeBuff, millis());
     p += sprintf(p, "\"up_time\":\"%s\",", timeBuff);   
     p += sprintf(p, "\"free_heap\":\"%s\",", fmtSize(ESP.getFreeHeap()));    
+    p += buildTaskStatsJson(p);
     p += sprintf(p, "\"wifi_rssi\":\"%i dBm\",", WiFi.RSSI() );  
     p += sprintf(p, "\"fw_version\":\"%s\",", APP_VER); 
     p += sprintf(p, "\"extIP\":\"%s\",", extIP); 
     if (!filter) {
       // populate first part of json string from config vect
       for (const auto& row : configs) 
-        p += sprintf(p, "\"%s\":\"%s\",", row[0].c_str(), row[1].c_str());
+        p = addJsonPair(p, row[0].c_str(), row[1].c_str(), row[1].length());
       p += sprintf(p, "\"logType\":\"%d\",", logType);
       // passwords stored in prefs on NVS 
-      p += sprintf(p, "\"ST_Pass\":\"%.*s\",", strlen(ST_Pass), FILLSTAR);
-      p += sprintf(p, "\"AP_Pass\":\"%.*s\",", strlen(AP_Pass), FILLSTAR);
-      p += sprintf(p, "\"Auth_Pass\":\"%.*s\",", strlen(Auth_Pass), FILLSTAR);
+      p = addJsonPair(p, "ST_Pass", FILLSTAR, strlen(ST_Pass));
+      p = addJsonPair(p, "AP_Pass", FILLSTAR, strlen(AP_Pass));
+      p = addJsonPair(p, "Auth_Pass", FILLSTAR, strlen(Auth_Pass));
 #if INCLUDE_FTP_HFS
-      p += sprintf(p, "\"FS_Pass\":\"%.*s\",", strlen(FS_Pass), FILLSTAR);
+      p = addJsonPair(p, "FS_Pass", FILLSTAR, strlen(FS_Pass));
 #endif
 #if INCLUDE_SMTP
-      p += sprintf(p, "\"SMTP_Pass\":\"%.*s\",", strlen(SMTP_Pass), FILLSTAR);
+      p = addJsonPair(p, "SMTP_Pass", FILLSTAR, strlen(SMTP_Pass));
 #endif
 #if INCLUDE_MQTT
-      p += sprintf(p, "\"mqtt_user_Pass\":\"%.*s\",", strlen(mqtt_user_Pass), FILLSTAR);
+      p = addJsonPair(p, "mqtt_user_Pass", FILLSTAR, strlen(mqtt_user_Pass));
 #endif
     }
   } else {
@@ -401,23 +454,22 @@ void buildJsonString(uint8_t filter) {
     updateAppStatus("custom", "");
     uint8_t cfgGroup = filter - 10; // filter number is length of url query string, config group number is length of string - 10
     p += sprintf(p, "\"cfgGroup\":\"%u\",", cfgGroup);
-    char pwdHide[MAX_PWD_LEN] = {0, };  // used to replace password value with asterisks
     for (const auto& row : configs) {
       if (atoi(row[2].c_str()) == cfgGroup) {
-        int valSize = strlen(row[1].c_str());
-        if (valSize < sizeof(pwdHide)) {
-          strncpy(pwdHide, FILLSTAR, valSize); 
-          pwdHide[valSize] = 0;
-        }
         // for each config item, list - key:value, key:label text, key:type identifier
-        p += sprintf(p, "\"%s\":\"%s\",\"lab%s\":\"%s\",\"typ%s\":\"%s\",", row[0].c_str(),
-          strstr(row[0].c_str(), "_Pass") == NULL ? row[1].c_str() : pwdHide, row[0].c_str(), row[4].c_str(), row[0].c_str(), row[3].c_str()); 
+        // password values replaced with asterisks
+        const char* key = row[0].c_str();
+        if (strstr(key, "_Pass") == NULL) p = addJsonPair(p, key, row[1].c_str(), row[1].length());
+        else p = addJsonPair(p, key, FILLSTAR, std::min((int)row[1].length(), MAX_PWD_LEN - 1));
+        p = addJsonLabel(p, "lab", key, row[4].c_str());
+        p = addJsonLabel(p, "typ", key, row[3].c_str());
       }
     }
   }
   *p = 0;
   *(--p) = '}'; // overwrite final comma
-  if (p - jsonBuff >= JSON_BUFF_LEN) LOG_ERR("jsonBuff overrun by: %u bytes", (p - jsonBuff) - JSON_BUFF_LEN);
+  if (jsonTruncated) LOG_ERR("jsonBuff full, config entries dropped");
+  else if (p - jsonBuff >= JSON_BUFF_LEN) LOG_ERR("jsonBuff overrun by: %u bytes", (p - jsonBuff) - JSON_BUFF_LEN);
 }
 
 void initStatus(int cfgGroup, int delayVal) {
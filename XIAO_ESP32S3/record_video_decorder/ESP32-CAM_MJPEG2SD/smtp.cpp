@@ -25,10 +25,14 @@ uint16_t smtp_port; // gmail SSL port 465;
 
 #define MIME_TYPE "image/jpg"
 #define ATTACH_NAME "frame.jpg"
+#define SMTP_IDLE_SECS 120 // keep logged in session this long after an email for the next one
 
 // SMTP control
 // Calling function has to populate SMTPbuffer and set smtpBufferSize for attachment data
 TaskHandle_t emailHandle = NULL; 
+WiFiClientSecure sclient; // kept open between emails, so TLS handshake and login only done once
+static bool smtpLoggedIn = false;
+static uint32_t smtpLastUse = 0;
 static char rspBuf[256]; // smtp response buffer
 static char respCodeRx[4]; // smtp response code 
 static char subject[50];
@@ -67,24 +71,36 @@ static bool sendSmtpCommand(WiFiClientSecure& client, const char* cmd, const cha
 	return true;
 }
 
+static bool smtpSession(WiFiClientSecure& client) {
+  // reuse logged in session from previous email if server still has it open
+  if (smtpLoggedIn && client.connected()) {
+    if (sendSmtpCommand(client, "RSET", "250")) return true;
+    LOG_DBG("SMTP session expired, reconnecting");
+  }
+  smtpLoggedIn = false;
+  remoteServerClose(client);
+  if (!remoteServerConnect(client, smtp_server, smtp_port, smtp_rootCACertificate)) return false;
+
+  char content[100];
+  if (!sendSmtpCommand(client, "", "220")) return false;
+  sprintf(content, "HELO %s: ", APP_NAME);
+  if (!sendSmtpCommand(client, content, "250")) return false;
+  if (!sendSmtpCommand(client, "AUTH LOGIN", "334")) return false; 
+  if (!sendSmtpCommand(client, encode64(smtp_login), "334")) return false;
+  if (!sendSmtpCommand(client, encode64(SMTP_Pass), "235")) return false;
+  smtpLoggedIn = true;
+  return true;
+}
+
 static bool emailSend(const char* mimeType = MIME_TYPE, const char* fileName = ATTACH_NAME) {
 
   // send email to defined smtp server
   char content[100];
-  
-  WiFiClientSecure client;
-  bool res = remoteServerConnect(client, smtp_server, smtp_port, smtp_rootCACertificate); 
-  if (!res) return false;
+  WiFiClientSecure& client = sclient;
+  bool res = false;
   
   while (true) { // fake non loop to enable breaks
-    if (!sendSmtpCommand(client, "", "220")) break;
-  
-    sprintf(content, "HELO %s: ", APP_NAME);
-    if (!sendSmtpCommand(client, content, "250")) break;
-    
-    if (!sendSmtpCommand(client, "AUTH LOGIN", "334")) break; 
-    if (!sendSmtpCommand(client, encode64(smtp_login), "334")) break;
-    if (!sendSmtpCommand(client, encode64(SMTP_Pass), "235")) break;
+    if (!smtpSession(client)) break;
   
     // send email header
     sprintf(content, "MAIL FROM: <%s>", APP_NAME);
@@ -129,18 +145,31 @@ static bool emailSend(const char* mimeType = MIME_TYPE, const char* fileName = A
     } 
     client.println("\n"); // two lines to finish header
         
-    // close message data and quit
+    // close message data, session left open for next email
     if (!sendSmtpCommand(client, ".", "250")) break;
-    if (!sendSmtpCommand(client, "QUIT", "221")) break;
     res = true;
     break;
   }
-  // cleanly terminate connection
-  remoteServerClose(client);
+  if (!res) {
+    // cleanly terminate broken session
+    smtpLoggedIn = false;
+    remoteServerClose(client);
+  }
+  smtpLastUse = millis();
   alertBufferSize = 0;
   return res;
 }
 
+void emailIdle() {
+  // called by alertTask when no alert pending, quit session held open too long
+  if (emailHandle != NULL || !sclient.connected()) return;
+  if (millis() - smtpLastUse < SMTP_IDLE_SECS * 1000) return;
+  if (smtpLoggedIn) sendSmtpCommand(sclient, "QUIT", "221");
+  smtpLoggedIn = false;
+  remoteServerClose(sclient);
+  LOG_DBG("SMTP session closed after %us idle", SMTP_IDLE_SECS);
+}
+
 static void emailTask(void* parameter) {
   //  send email
   if (emailCount < alertMax) { 
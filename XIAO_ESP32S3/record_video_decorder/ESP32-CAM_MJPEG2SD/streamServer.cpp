@@ -24,8 +24,6 @@ bool streamNvr = false;
 bool streamSnd = false;
 bool streamSrt = false;
 static bool isStreaming[MAX_STREAMS] = {false};
-size_t streamBufferSize[MAX_STREAMS] = {0};
-byte* streamBuffer[MAX_STREAMS] = {NULL}; // buffer for stream frame
 static char variable[FILE_NAME_LEN]; 
 static char value[FILE_NAME_LEN];
 uint32_t sustainId = 0;
@@ -34,6 +32,23 @@ uint8_t vidStreams = 1;
 int srtInterval = 1; // subtitle interval in secs
 
 
+// live stream frames shared by all video stream clients
+// each camera frame is copied once, whatever the number of viewers, and the
+// buffer is reused once every client it was handed to has sent it
+struct streamFrame_t {
+  byte* buf = NULL;
+  size_t len = 0;
+  uint8_t refs = 0; // clients yet to send this frame
+};
+// the motion alert pipeline is one more client, taking frames by reference too
+#define ALERT_CLIENT MAX_STREAMS
+static streamFrame_t streamFrame[MAX_STREAMS + 1];
+static int8_t streamSlot[MAX_STREAMS + 1] = {-1, -1, -1, -1, -1}; // frame held by each client, alert last
+static uint8_t streamSlots = 0;
+static portMUX_TYPE streamMux = portMUX_INITIALIZER_UNLOCKED;
+static bool alertWaiting = false;
+static SemaphoreHandle_t alertFrameSemaphore = NULL;
+
 TaskHandle_t sustainHandle[MAX_STREAMS]; 
 struct httpd_sustain_req_t {
   httpd_req_t* req = NULL;
@@ -97,6 +112,82 @@ static void showPlayback(httpd_req_t* req) {
   }
 }
 
+static void releaseStreamFrame(uint8_t taskNum) {
+  // drop client reference to its shared frame
+  portENTER_CRITICAL(&streamMux);
+  int8_t slot = streamSlot[taskNum];
+  if (slot >= 0 && streamFrame[slot].refs) streamFrame[slot].refs--;
+  streamSlot[taskNum] = -1;
+  portEXIT_CRITICAL(&streamMux);
+}
+
+void publishStreamFrame(camera_fb_t* fb) {
+  // called by processFrame() to offer latest frame to idle stream clients
+  // only the capture task publishes, so an unreferenced slot can be filled outside the lock
+  int8_t slot = -1;
+  bool waiting = false;
+  portENTER_CRITICAL(&streamMux);
+  for (int i = 0; i < vidStreams; i++) if (isStreaming[i] && streamSlot[i] < 0) waiting = true;
+  if (alertWaiting && streamSlot[ALERT_CLIENT] < 0) waiting = true;
+  if (waiting) {
+    for (int s = 0; s < streamSlots; s++) {
+      if (!streamFrame[s].refs && streamFrame[s].buf != NULL) {
+        slot = s;
+        break;
+      }
+    }
+  }
+  portEXIT_CRITICAL(&streamMux);
+  if (slot < 0) return; // no viewer waiting, or all frames still being sent
+
+  memcpy(streamFrame[slot].buf, fb->buf, fb->len);
+  bool notify[MAX_STREAMS] = {false};
+  bool notifyAlert = false;
+  portENTER_CRITICAL(&streamMux);
+  streamFrame[slot].len = fb->len;
+  for (int i = 0; i < vidStreams; i++) {
+    if (isStreaming[i] && streamSlot[i] < 0) {
+      streamSlot[i] = slot;
+      streamFrame[slot].refs++;
+      notify[i] = true;
+    }
+  }
+  if (alertWaiting && streamSlot[ALERT_CLIENT] < 0) {
+    streamSlot[ALERT_CLIENT] = slot;
+    streamFrame[slot].refs++;
+    alertWaiting = false;
+    notifyAlert = true;
+  }
+  portEXIT_CRITICAL(&streamMux);
+  for (int i = 0; i < vidStreams; i++) 
+    if (notify[i]) xSemaphoreGive(frameSemaphore[i]); // signal frame ready for stream
+  if (notifyAlert) xSemaphoreGive(alertFrameSemaphore);
+}
+
+bool holdAlertFrame(uint8_t** jpgBuf, size_t* jpgLen) {
+  // alert pipeline: reference the next frame published by processFrame(), no copy
+  // frame stays unchanged until releaseAlertFrame()
+  if (alertFrameSemaphore == NULL) return false;
+  xSemaphoreTake(alertFrameSemaphore, 0); // clear any stale signal
+  portENTER_CRITICAL(&streamMux);
+  alertWaiting = true;
+  portEXIT_CRITICAL(&streamMux);
+  bool gotFrame = xSemaphoreTake(alertFrameSemaphore, pdMS_TO_TICKS(MAX_FRAME_WAIT)) == pdTRUE;
+  portENTER_CRITICAL(&streamMux);
+  alertWaiting = false;
+  int8_t slot = streamSlot[ALERT_CLIENT]; // may have been handed over just after timeout
+  portEXIT_CRITICAL(&streamMux);
+  if (slot < 0) return false;
+  if (!gotFrame) xSemaphoreTake(alertFrameSemaphore, 0);
+  *jpgBuf = streamFrame[slot].buf;
+  *jpgLen = streamFrame[slot].len;
+  return true;
+}
+
+void releaseAlertFrame() {
+  releaseStreamFrame(ALERT_CLIENT);
+}
+
 static void showStream(httpd_req_t* req, uint8_t taskNum) {
   // start live streaming to browser
   esp_err_t res = ESP_OK; 
@@ -105,8 +196,8 @@ static void showStream(httpd_req_t* req, uint8_t taskNum) {
   uint32_t startTime = millis();
   uint32_t frameCnt = 0;
   uint32_t mjpegLen = 0;
+  releaseStreamFrame(taskNum); // in case frame handed over after previous stream ended
   isStreaming[taskNum] = true;
-  streamBufferSize[taskNum] = 0;
   if (!taskNum) motionJpegLen = 0;
   // output header for streaming request
   httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
@@ -116,11 +207,11 @@ static void showStream(httpd_req_t* req, uint8_t taskNum) {
     // stream from camera at current frame rate
     if (xSemaphoreTake(frameSemaphore[taskNum], pdMS_TO_TICKS(MAX_FRAME_WAIT)) == pdFAIL) {
       // failed to take semaphore, allow retry
-      streamBufferSize[taskNum] = 0;
       continue;
     }
     if (dbgMotion && !taskNum) {
       // motion tracking stream on task 0 only, wait for new move mapping image
+      releaseStreamFrame(taskNum); // live frame not needed
       if (xSemaphoreTake(motionSemaphore, pdMS_TO_TICKS(MAX_FRAME_WAIT)) == pdFAIL) continue;
       // use image created by checkMotion()
       jpgLen = motionJpegLen;
@@ -128,10 +219,11 @@ static void showStream(httpd_req_t* req, uint8_t taskNum) {
       jpgBuf = motionJpeg;
     } else {
       // live stream 
-      if (!streamBufferSize[taskNum]) continue;
-      jpgLen = streamBufferSize[taskNum];
-      // use frame stored by processFrame()
-      jpgBuf = streamBuffer[taskNum];
+      int8_t slot = streamSlot[taskNum];
+      if (slot < 0) continue;
+      // use shared frame published by processFrame()
+      jpgLen = streamFrame[slot].len;
+      jpgBuf = streamFrame[slot].buf;
     }
     if (res == ESP_OK) {
       // send next frame in stream
@@ -142,7 +234,8 @@ static void showStream(httpd_req_t* req, uint8_t taskNum) {
       frameCnt++;
     } 
     mjpegLen += jpgLen;
-    jpgLen = streamBufferSize[taskNum] = 0;
+    jpgLen = 0;
+    releaseStreamFrame(taskNum); // frame can be reused once all clients have sent it
     if (dbgMotion && !taskNum) motionJpegLen = 0;
     if (res != ESP_OK) {
       // get send error when browser closes stream 
@@ -150,6 +243,7 @@ static void showStream(httpd_req_t* req, uint8_t taskNum) {
       isStreaming[taskNum] = false;
     }     
   }
+  releaseStreamFrame(taskNum);
   if (res == ESP_OK) httpd_resp_sendstr_chunk(req, NULL);
   uint32_t mjpegTime = millis() - startTime;
   float mjpegTimeF = float(mjpegTime) / 1000; // secs
@@ -164,14 +258,19 @@ static void audioStream(httpd_req_t* req, uint8_t taskNum) {
   httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
   isStreaming[taskNum] = true;
   uint32_t totalSamples = 0;
-  while (isStreaming[taskNum]) {
-    size_t buffSize = getAudioBuffer(false);
-    if (buffSize) res = httpd_resp_send_chunk(req, (const char*)audioBuffer, buffSize); 
+  uint32_t seq;
+  const uint8_t* wavHdr = openAudioStream(&seq);
+  res = httpd_resp_send_chunk(req, (const char*)wavHdr, WAV_HEADER_LEN);
+  while (isStreaming[taskNum] && res == ESP_OK) {
+    // send each mic block straight from the mic ring
+    size_t buffSize = 0;
+    int16_t* block = getAudioBlock(&seq, &buffSize);
+    if (buffSize) res = httpd_resp_send_chunk(req, (const char*)block, buffSize); 
     if (res != ESP_OK) isStreaming[taskNum] = false; // client connection closed
     else totalSamples += buffSize / 2; // 16 bit samples
   }
   if (res == ESP_OK) httpd_resp_sendstr_chunk(req, NULL);
-  getAudioBuffer(true); // reset for next stream
+  closeAudioStream(); // stop mic task reading for this stream
   LOG_INF("WAV: sent %lu samples", totalSamples);
 #else 
   httpd_resp_sendstr(req, NULL);
@@ -256,8 +355,16 @@ void startSustainTasks() {
     LOG_WRN("numStreams %d exceeds MAX_STREAMS %d", numStreams, MAX_STREAMS);
     numStreams = MAX_STREAMS;
   }
-  for (int i = 0; i < vidStreams; i++)
-    if (streamBuffer[i] == NULL) streamBuffer[i] = (byte*)ps_malloc(MAX_JPEG); 
+  // one shared frame per video stream, so a slow client doesn't stall the other
+  // plus one for the alert pipeline, so a frame it holds never stalls a viewer
+  uint8_t frameBufs = vidStreams;
+#if INCLUDE_SMTP || INCLUDE_TGRAM
+  frameBufs++;
+  if (alertFrameSemaphore == NULL) alertFrameSemaphore = xSemaphoreCreateBinary();
+#endif
+  for (int i = 0; i < frameBufs; i++)
+    if (streamFrame[i].buf == NULL) streamFrame[i].buf = (byte*)ps_malloc(MAX_JPEG); 
+  streamSlots = frameBufs;
 
   for (int i = 0; i < numStreams; i++) {
     sustainReq[i].taskNum = i; // so task knows its number
@@ -1,7 +1,8 @@
 //
 // Telemetry data recorded to storage during camera recording
-// Formatted as CSV file for presentation in spreadsheet
-// and as a SRT file to provide video subtitles when used with a media player
+// Stored as fixed size binary records, batched in RAM and written in RAMSIZE blocks,
+// then expanded on download or upload into a CSV file for presentation in spreadsheet
+// and a SRT file to provide video subtitles when used with a media player
 // Sensor data obtained from user supplied libraries and code
 // Need to check 'Use telemetry recording' under Peripherals button on Edit Config web page
 // and have downloaded relevant device libraries.
@@ -12,14 +13,14 @@
 #include "appGlobals.h"
 #include <Wire.h>
 
-#define NUM_BUFF 2 
 #define MAX_SRT_LEN 128 // store each srt entry, for subtitle streaming
+#define TLM_MAGIC "TLM1"
 
 TaskHandle_t telemetryHandle = NULL;
 bool teleUse = false;
 static int teleInterval = 1;
-static char* teleBuf[NUM_BUFF]; // csv and srt telemetry data buffers
-size_t highPoint[NUM_BUFF]; // indexes to buffers
+static uint8_t* teleBuf; // binary record buffer
+static size_t teleLen; // index to buffer
 static bool capturing = false;
 static char teleFileName[FILE_NAME_LEN];
 char srtBuffer[MAX_SRT_LEN];
@@ -35,7 +36,10 @@ static bool checkI2C(byte addr);
 
 // user defined header row, first field is always Time, row must end with \n
 #define TELEHEADER "Time,Temperature (C),Pressure (mb),Altitude (m),Heading,Pitch,Roll\n"
-#define BUF_OVERFLOW 100 // set to be max size of formatted telemetry row
+// number of sensor values per record, one per TELEHEADER column after Time
+#define TELE_VALUES 6
+// units appended to each value in subtitles
+static const char* teleUnits[TELE_VALUES] = {"C", "mb", "m", "", "", ""};
 
 // if require I2C, define which pins to use for I2C bus
 // if pins not correctly defined for board, spurious results will occur
@@ -98,109 +102,198 @@ static bool setupSensors() {
   return res; 
 }
 
-static void getSensorData() {
-  // get sensor data and format as csv row & srt entry in buffers
+static void getSensorData(float* values) {
+  // get sensor data into values, in TELEHEADER column order
+  // values left as NAN are shown as - 
 #ifdef USE_GY91
   bmp280.measure();
   if (bmp280.hasValue()) {
     float bmpPressure = bmp280.getPressure() * 0.01;  // pascals to mb/hPa
-    float bmpAltitude = 44330.0 * (1.0 - pow(bmpPressure / STD_PRESSURE, 1.0 / 5.255)); // altitude in meters
-    highPoint[0] += sprintf(teleBuf[0] + highPoint[0], "%0.1f,%0.1f,%0.1f,", bmp280.getTemperature(), bmpPressure, bmpAltitude);
-    highPoint[1] += sprintf(teleBuf[1] + highPoint[1], "  %0.1fC  %0.1fmb  %0.1fm", bmp280.getTemperature(), bmpPressure, bmpAltitude);
-  } else for (int i=0; i< 2; i++) highPoint[i] += sprintf(teleBuf[i] + highPoint[i], "-,-,-,");
+    values[0] = bmp280.getTemperature();
+    values[1] = bmpPressure;
+    values[2] = 44330.0 * (1.0 - pow(bmpPressure / STD_PRESSURE, 1.0 / 5.255)); // altitude in meters
+  }
   
   if (mpu9250.update()) {
-    highPoint[0] += sprintf(teleBuf[0] + highPoint[0], "%0.1f,%0.1f,%0.1f,", mpu9250.getYaw(), mpu9250.getPitch(), mpu9250.getRoll()); 
-    highPoint[1] += sprintf(teleBuf[1] + highPoint[1], "  %0.1f  %0.1f  %0.1f", mpu9250.getYaw(), mpu9250.getPitch(), mpu9250.getRoll()); 
+    values[3] = mpu9250.getYaw();
+    values[4] = mpu9250.getPitch();
+    values[5] = mpu9250.getRoll();
   }
 #endif
 }
 
 /*************** LEAVE CODE BELOW AS IS ******************/
 
+struct teleRecord {
+  uint32_t epoch; // sample time
+  float values[TELE_VALUES];
+};
+
+struct teleFileHeader {
+  char magic[4];
+  uint16_t recordLen;
+  uint16_t numValues;
+  uint32_t sampleInterval; // ms between records
+  uint16_t headerLen; // length of TELEHEADER text that follows
+};
+
+static size_t formatSrtData(char* buf, size_t bufLen, const float* values) {
+  // format sensor values as subtitle text
+  size_t len = 0;
+  for (int i = 0; i < TELE_VALUES && len < bufLen; i++) {
+    if (isnan(values[i])) len += snprintf(buf + len, bufLen - len, "  -");
+    else len += snprintf(buf + len, bufLen - len, "  %0.1f%s", values[i], teleUnits[i]);
+  }
+  return min(len, bufLen);
+}
+
+static void readSensors(teleRecord* rec) {
+  rec->epoch = (uint32_t)getEpoch();
+  for (int i = 0; i < TELE_VALUES; i++) rec->values[i] = NAN;
+  getSensorData(rec->values);
+}
+
 void storeSensorData(bool fromStream) {
   // can be called from telemetry task or streaming task
-  if (fromStream) {
-    // called fron streaming task
-    if (capturing) return; // as being stored by telemetry task
-    else highPoint[0] = highPoint[1] = 0;
-  }
-  size_t startData = highPoint[1];
-  getSensorData();
-  if (!srtBytes) { 
-    srtBytes = min(highPoint[1] - startData, (size_t)MAX_SRT_LEN);
-    memcpy(srtBuffer, teleBuf[1] + startData, srtBytes);
-  }
+  if (fromStream && capturing) return; // as being stored by telemetry task
+  teleRecord rec;
+  readSensors(&rec);
+  if (!srtBytes) srtBytes = formatSrtData(srtBuffer, MAX_SRT_LEN, rec.values);
 }
 
 static void telemetryTask(void* pvParameters) {
   while (true) {
     ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
     capturing = true;
-    int srtSeqNo = 1;
-    uint32_t srtTime = 0;
-    char timeStr[10];
+    int recordCnt = 0;
     uint32_t sampleInterval = 1000 * (teleInterval < 1 ? 1 : teleInterval);
     // open storage file
     if (STORAGE.exists(TELETEMP)) STORAGE.remove(TELETEMP);
-    if (STORAGE.exists(SRTTEMP)) STORAGE.remove(SRTTEMP);
     File teleFile = STORAGE.open(TELETEMP, FILE_WRITE);
-    File srtFile = STORAGE.open(SRTTEMP, FILE_WRITE);
-    // write CSV header row to buffer
-    highPoint[0] = sprintf(teleBuf[0], "%s", TELEHEADER); 
-    highPoint[1] = 0;
+    // file header describes record layout and columns for expandTelemetry()
+    teleFileHeader hdr = {{'T', 'L', 'M', '1'}, sizeof(teleRecord), TELE_VALUES, sampleInterval, (uint16_t)strlen(TELEHEADER)};
+    memcpy(teleBuf, &hdr, sizeof(hdr));
+    memcpy(teleBuf + sizeof(hdr), TELEHEADER, hdr.headerLen);
+    teleLen = sizeof(hdr) + hdr.headerLen;
     
     // loop while camera recording
     while (capturing) {
       uint32_t startTime = millis();
-      // write header for this subtitle
-      formatElapsedTime(timeStr, srtTime, true);
-      highPoint[1] += sprintf(teleBuf[1] + highPoint[1], "%d\n%s --> ", srtSeqNo++, timeStr);
-      srtTime += sampleInterval;
-      formatElapsedTime(timeStr, srtTime, true);
-      highPoint[1] += sprintf(teleBuf[1] + highPoint[1], "%s\n", timeStr);
-      // write current time for csv row and srt entry
-      time_t currEpoch = getEpoch();
-      for (int i = 0; i < NUM_BUFF; i++) highPoint[i] += strftime(teleBuf[i] + highPoint[i], 10, "%H:%M:%S,", localtime(&currEpoch));
-      // get and store data from sensors 
-      storeSensorData(false);
-      // add newline to finish row
-      highPoint[0] += sprintf(teleBuf[0] + highPoint[0], "\n"); 
-      highPoint[1] += sprintf(teleBuf[1] + highPoint[1], "\n\n");
+      teleRecord* rec = (teleRecord*)(teleBuf + teleLen);
+      readSensors(rec);
+      teleLen += sizeof(teleRecord);
+      recordCnt++;
+      // only format for subtitle stream once it has taken the previous entry
+      if (!srtBytes) srtBytes = formatSrtData(srtBuffer, MAX_SRT_LEN, rec->values);
       
-      // if marker overflows buffer, write to storage
-      for (int i = 0; i < NUM_BUFF; i++) {
-        if (highPoint[i] >= RAMSIZE) {
-          highPoint[i] -= RAMSIZE;
-          if (i) srtFile.write((uint8_t*)teleBuf[i], RAMSIZE);
-          else teleFile.write((uint8_t*)teleBuf[i], RAMSIZE);
-          // push overflow to buffer start
-          memcpy(teleBuf[i], teleBuf[i]+RAMSIZE, highPoint[i]);
-        }
+      // if record overflows buffer, write block to storage
+      if (teleLen >= RAMSIZE) {
+        teleLen -= RAMSIZE;
+        teleFile.write(teleBuf, RAMSIZE);
+        // push overflow to buffer start
+        memcpy(teleBuf, teleBuf + RAMSIZE, teleLen);
       }
       // wait for next collection interval
       while (millis() - sampleInterval < startTime) delay(10);
     }
     
     // capture finished, write remaining buff to storage 
-    if (highPoint[0]) teleFile.write((uint8_t*)teleBuf[0], highPoint[0]);
-    if (highPoint[1]) srtFile.write((uint8_t*)teleBuf[1], highPoint[1]);
+    if (teleLen) teleFile.write(teleBuf, teleLen);
     teleFile.close();
-    srtFile.close();
-    // rename temp files to specific file names using avi file name with relevant extension
-    changeExtension(teleFileName, CSV_EXT);
+    // rename temp file to specific file name using avi file name with relevant extension
+    changeExtension(teleFileName, TLM_EXT);
     STORAGE.rename(TELETEMP, teleFileName);
-    changeExtension(teleFileName, SRT_EXT);
-    STORAGE.rename(SRTTEMP, teleFileName);
-    LOG_INF("Saved %d entries in telemetry files", srtSeqNo);
+    LOG_INF("Saved %d entries in telemetry file", recordCnt);
+  }
+}
+
+static void flushText(File& outFile, char* buf, size_t* len, bool final) {
+  // write text buffer in RAMSIZE blocks
+  if (*len >= RAMSIZE) {
+    outFile.write((uint8_t*)buf, RAMSIZE);
+    *len -= RAMSIZE;
+    memcpy(buf, buf + RAMSIZE, *len);
+  }
+  if (final && *len) outFile.write((uint8_t*)buf, *len);
+}
+
+bool expandTelemetry(const char* fileName) {
+  // create csv & srt files from binary telemetry file for fileName, if not already done
+  // called before download or upload, returns true if csv file is available
+  char tlmName[FILE_NAME_LEN];
+  char csvName[FILE_NAME_LEN];
+  char srtName[FILE_NAME_LEN];
+  strcpy(tlmName, fileName);
+  changeExtension(tlmName, TLM_EXT);
+  strcpy(csvName, fileName);
+  changeExtension(csvName, CSV_EXT);
+  strcpy(srtName, fileName);
+  changeExtension(srtName, SRT_EXT);
+  if (STORAGE.exists(csvName)) return true;
+  if (!STORAGE.exists(tlmName)) return false;
+
+  File tlmFile = STORAGE.open(tlmName, FILE_READ);
+  teleFileHeader hdr;
+  if (tlmFile.read((uint8_t*)&hdr, sizeof(hdr)) != sizeof(hdr) || memcmp(hdr.magic, TLM_MAGIC, 4) 
+      || hdr.recordLen != sizeof(teleRecord) || hdr.numValues != TELE_VALUES) {
+    LOG_WRN("Telemetry file %s has unknown format", tlmName);
+    tlmFile.close();
+    return false;
+  }
+  uint32_t eTime = millis();
+  // each text buffer has room for a block plus a formatted row
+  const size_t bufLen = RAMSIZE + 512;
+  char* csvBuf = psramFound() ? (char*)ps_malloc(bufLen) : (char*)malloc(bufLen);
+  char* srtBuf = psramFound() ? (char*)ps_malloc(bufLen) : (char*)malloc(bufLen);
+  File csvFile = STORAGE.open(csvName, FILE_WRITE);
+  File srtFile = STORAGE.open(srtName, FILE_WRITE);
+  // CSV header row is stored in file
+  size_t csvLen = tlmFile.read((uint8_t*)csvBuf, min((size_t)hdr.headerLen, bufLen));
+  size_t srtLen = 0;
+  int srtSeqNo = 1;
+  uint32_t srtTime = 0;
+  char timeStr[10];
+  teleRecord rec;
+  while (tlmFile.read((uint8_t*)&rec, sizeof(rec)) == sizeof(rec)) {
+    time_t recEpoch = rec.epoch;
+    char clockStr[10];
+    strftime(clockStr, sizeof(clockStr), "%H:%M:%S", localtime(&recEpoch));
+    // csv row
+    csvLen += sprintf(csvBuf + csvLen, "%s,", clockStr);
+    for (int i = 0; i < TELE_VALUES; i++) {
+      if (isnan(rec.values[i])) csvLen += sprintf(csvBuf + csvLen, "-,");
+      else csvLen += sprintf(csvBuf + csvLen, "%0.1f,", rec.values[i]);
+    }
+    csvLen += sprintf(csvBuf + csvLen, "\n");
+    // srt entry
+    formatElapsedTime(timeStr, srtTime, true);
+    srtLen += sprintf(srtBuf + srtLen, "%d\n%s --> ", srtSeqNo++, timeStr);
+    srtTime += hdr.sampleInterval;
+    formatElapsedTime(timeStr, srtTime, true);
+    srtLen += sprintf(srtBuf + srtLen, "%s\n%s,", timeStr, clockStr);
+    srtLen += formatSrtData(srtBuf + srtLen, MAX_SRT_LEN, rec.values);
+    srtLen += sprintf(srtBuf + srtLen, "\n\n");
+    flushText(csvFile, csvBuf, &csvLen, false);
+    flushText(srtFile, srtBuf, &srtLen, false);
   }
+  flushText(csvFile, csvBuf, &csvLen, true);
+  flushText(srtFile, srtBuf, &srtLen, true);
+  csvFile.close();
+  srtFile.close();
+  tlmFile.close();
+  free(csvBuf);
+  free(srtBuf);
+  LOG_INF("Expanded %d telemetry entries from %s in %lu ms", srtSeqNo - 1, tlmName, millis() - eTime);
+  return true;
 }
 
 void prepTelemetry() {
   // called by app initialisation
   if (teleUse) {
     teleInterval = srtInterval;
-    for (int i=0; i < NUM_BUFF; i++) teleBuf[i] = psramFound() ? (char*)ps_malloc(RAMSIZE + BUF_OVERFLOW) : (char*)malloc(RAMSIZE + BUF_OVERFLOW);
+    // room for a block plus the file header or an overflowing record
+    const size_t bufLen = RAMSIZE + sizeof(teleFileHeader) + strlen(TELEHEADER) + sizeof(teleRecord);
+    teleBuf = psramFound() ? (uint8_t*)ps_malloc(bufLen) : (uint8_t*)malloc(bufLen);
     if (setupSensors()) xTaskCreate(&telemetryTask, "telemetryTask", TELEM_STACK_SIZE, NULL, TELEM_PRI, &telemetryHandle);
     else teleUse = false;
     LOG_INF("Telemetry recording %s available", teleUse ? "is" : "NOT");
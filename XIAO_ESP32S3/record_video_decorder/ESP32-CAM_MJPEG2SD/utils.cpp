@@ -581,7 +581,7 @@ void checkMemory(const char* source ) {
 
 uint32_t checkStackUse(TaskHandle_t thisTask, int taskIdx) {
   // get minimum free stack size for task since started
-  static uint32_t minStack[20]; 
+  static uint32_t minStack[21]; 
   uint32_t freeStack = 0;
   if (thisTask != NULL) {
     freeStack = (uint32_t)uxTaskGetStackHighWaterMark(thisTask);
@@ -637,6 +637,12 @@ float smoothSensor(float latestVal, float smoothedVal, float alpha) {
  * true  : also saves log on SD card. To download the log generated, either:
  *  - To view the log, press Show Log button on the browser
  * - To clear the log file contents, on log web page press Clear Log link
+ *
+ * logPrint() only waits for logTask to format the message, which is then
+ * stored in the RAM log and queued in logRing. logFlushTask outputs queued
+ * messages to serial, SD and web socket, batching SD writes into sectors,
+ * so callers on the capture path are not held up by slow output.
+ * If the queue is full the message is dropped rather than block the caller.
  */
  
 #define MAX_OUT 200
@@ -651,11 +657,27 @@ static int logWait = 100; // ms
 bool useLogColors = false;  // true to colorise log messages (eg if using idf.py, but not arduino)
 bool wsLog = false;
 
-#define WRITE_CACHE_CYCLE 5
+#define LOG_SLOTS 32 // formatted messages queued for output
+#define SD_SECTOR 512
+#define LOG_SYNC_MS 2000 // max time SD log data held before being synced to card
 bool sdLog = false; // log to SD
 int logType = 0; // which log contents to display (0 : ram, 1 : sd, 2 : ws)
 static FILE* log_remote_fp = NULL;
-static uint32_t counter_write = 0;
+
+struct logSlot_t {
+  uint16_t len;
+  char text[MAX_OUT];
+};
+static logSlot_t* logRing = NULL;
+static volatile uint32_t logHead = 0; // next slot filled by logPrint
+static volatile uint32_t logTail = 0; // next slot output by logFlushTask
+static volatile uint32_t logDropped = 0;
+static volatile uint8_t flushReq = 0; // 1 : sync SD log, 2 : sync and close
+static TaskHandle_t logFlushHandle = NULL;
+static char sdLogBuf[SD_SECTOR];
+static size_t sdLogLen = 0;
+static bool sdUnsynced = false;
+static uint32_t lastSyncMs = 0;
 
 // RAM memory based logging in RTC slow memory
 RTC_NOINIT_ATTR bool ramLog; // log to RAM
@@ -680,15 +702,90 @@ static void ramLogStore(size_t msgLen) {
   mlogEnd += msgLen;
 }
 
-void flush_log(bool andClose) {
-  if (log_remote_fp != NULL) {
-    fsync(fileno(log_remote_fp));  
+static void sdLogWrite(bool sync) {
+  // write out batched SD log data, and sync to card if requested
+  if (log_remote_fp == NULL) {
+    sdLogLen = 0;
+    return;
+  }
+  if (sdLogLen) {
+    fwrite(sdLogBuf, sizeof(char), sdLogLen, log_remote_fp); // log.txt
+    sdLogLen = 0;
+    sdUnsynced = true;
+  }
+  if (sync && sdUnsynced) {
     fflush(log_remote_fp);
-    if (andClose) {
-      LOG_INF("Closed SD file for logging");
+    fsync(fileno(log_remote_fp));
+    sdUnsynced = false;
+  }
+  if (sync) lastSyncMs = millis();
+}
+
+static void logOutput(char* msg, size_t msgLen) {
+  // output formatted message to monitor, SD and web socket as required
+  if (monitorOpen) Serial.write(msg, msgLen); 
+  if (sdLog && log_remote_fp != NULL) {
+    // accumulate into sector sized writes
+    size_t copied = 0;
+    while (copied < msgLen) {
+      size_t chunk = min(msgLen - copied, SD_SECTOR - sdLogLen);
+      memcpy(sdLogBuf + sdLogLen, msg + copied, chunk);
+      sdLogLen += chunk;
+      copied += chunk;
+      if (sdLogLen == SD_SECTOR) sdLogWrite(false);
+    }
+  }
+  // output to web socket if open
+  if (msgLen > 1) {
+    msg[msgLen - 1] = 0; // lose final '/n'
+    if (wsLog) wsAsyncSend(msg);
+  }
+}
+
+static void logFlushTask(void* arg) {
+  // output queued log messages outside of caller context
+  char msg[MAX_OUT];
+  uint32_t reportedDrops = 0;
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOG_SYNC_MS));
+    while (logTail != logHead) {
+      __sync_synchronize(); // slot content visible before use
+      logSlot_t* slot = logRing + (logTail % LOG_SLOTS);
+      size_t msgLen = slot->len;
+      memcpy(msg, slot->text, msgLen + 1);
+      logTail++; // release slot for reuse
+      logOutput(msg, msgLen);
+    }
+    if (logDropped != reportedDrops) {
+      int dropLen = snprintf(msg, MAX_OUT, "[%u log messages dropped]\n", logDropped - reportedDrops);
+      reportedDrops = logDropped;
+      logOutput(msg, dropLen);
+    }
+    // queue empty, write out partial sector when requested or periodically
+    if (flushReq || millis() - lastSyncMs >= LOG_SYNC_MS) sdLogWrite(true);
+    if (flushReq == 2 && log_remote_fp != NULL) {
       fclose(log_remote_fp);
       log_remote_fp = NULL;
-    } else delay(1000);
+    }
+    flushReq = 0;
+  }
+}
+
+void flush_log(bool andClose) {
+  if (log_remote_fp != NULL) {
+    if (andClose) LOG_INF("Closed SD file for logging");
+    if (logFlushHandle == NULL) {
+      sdLogWrite(true);
+      if (andClose) {
+        fclose(log_remote_fp);
+        log_remote_fp = NULL;
+      }
+    } else {
+      // have logFlushTask output queued messages then write out to SD
+      flushReq = andClose ? 2 : 1;
+      xTaskNotifyGive(logFlushHandle);
+      for (int i = 0; flushReq && i < 100; i++) delay(10);
+    }
   }  
 }
 
@@ -735,7 +832,7 @@ static void logTask(void *arg) {
 }
 
 void logPrint(const char *format, ...) {
-  // feeds logTask to format message, then outputs as required
+  // feeds logTask to format message, then queues it for output
   if (xSemaphoreTake(logMutex, pdMS_TO_TICKS(logWait)) == pdTRUE) {
     strncpy(fmtBuf, format, MAX_OUT);
     va_start(arglist, format); 
@@ -753,20 +850,15 @@ void logPrint(const char *format, ...) {
       alertMsg[msgLen - 2] = 0;
     }
     if (ramLog) ramLogStore(msgLen); // store in rtc ram 
-    if (monitorOpen) Serial.print(outBuf); 
-    else delay(10); // allow time for other tasks
-    if (sdLog) {
-      if (log_remote_fp != NULL) {
-        // output to SD if file opened
-        fwrite(outBuf, sizeof(char), msgLen, log_remote_fp); // log.txt
-        // periodic sync to SD
-        if (counter_write++ % WRITE_CACHE_CYCLE == 0) fsync(fileno(log_remote_fp));
-      } 
-    }
-    // output to web socket if open
-    if (msgLen > 1) {
-      outBuf[msgLen - 1] = 0; // lose final '/n'
-      if (wsLog) wsAsyncSend(outBuf);
+    if (logRing == NULL) logOutput(outBuf, msgLen); // no queue, output directly
+    else if (logHead - logTail >= LOG_SLOTS) logDropped++; // queue full, don't hold up caller
+    else {
+      logSlot_t* slot = logRing + (logHead % LOG_SLOTS);
+      memcpy(slot->text, outBuf, msgLen + 1);
+      slot->len = msgLen;
+      __sync_synchronize(); // slot content visible before published
+      logHead++;
+      xTaskNotifyGive(logFlushHandle);
     }
     xSemaphoreGive(logMutex);
   } 
@@ -788,6 +880,11 @@ void logSetup() {
   xSemaphoreGive(logSemaphore);
   xSemaphoreGive(logMutex);
   xTaskCreate(logTask, "logTask", LOG_STACK_SIZE, NULL, LOG_PRI, &logHandle);
+  logRing = psramFound() ? (logSlot_t*)ps_malloc(LOG_SLOTS * sizeof(logSlot_t)) : (logSlot_t*)malloc(LOG_SLOTS * sizeof(logSlot_t));
+  if (logRing != NULL && xTaskCreate(logFlushTask, "logFlushTask", LOGFLUSH_STACK_SIZE, NULL, LOG_PRI, &logFlushHandle) != pdPASS) {
+    free(logRing);
+    logRing = NULL;
+  }
   if (mlogEnd >= RAM_LOG_LEN) ramLogClear(); // init
   LOG_INF("Setup RAM based log, size %u, starting from %u\n\n", RAM_LOG_LEN, mlogEnd);
   LOG_INF("=============== %s %s ===============", APP_NAME, APP_VER);
@@ -877,12 +974,105 @@ uint32_t* reportIdle() {
   return idlePercent;
 }
 
+/************** per task cpu & stack usage *************/
+
+// sampled by idleMonTask, needs FreeRTOS trace facility & run time stats
+#define MAX_TASK_STATS 40
+#define STATS_INTERVALS 10 // idlemon intervals per task stats sample
+
+typedef struct {
+  TaskHandle_t handle;
+  char name[configMAX_TASK_NAME_LEN];
+  uint32_t runTime; // cumulative run time counter at last sample
+  uint8_t cpuPercent; // of one core over last sample
+  int8_t core; // pinned core, -1 if either
+  uint8_t priority;
+  uint32_t stackFree; // stack high water mark in bytes
+} taskStat_t;
+
+static taskStat_t taskStats[MAX_TASK_STATS];
+static int numTaskStats = 0;
+static SemaphoreHandle_t taskStatsMutex = NULL;
+
+#if configUSE_TRACE_FACILITY
+static TaskStatus_t sysState[MAX_TASK_STATS];
+static taskStat_t newStats[MAX_TASK_STATS];
+static uint32_t prevTotalRunTime = 0;
+
+static void sampleTaskStats() {
+  // snapshot all tasks and derive cpu usage since previous snapshot
+  uint32_t totalRunTime = 0;
+  int numTasks = uxTaskGetSystemState(sysState, MAX_TASK_STATS, &totalRunTime);
+  if (!numTasks) return; // more tasks than MAX_TASK_STATS
+  uint32_t elapsed = totalRunTime - prevTotalRunTime; // same for each core
+  bool havePrev = prevTotalRunTime > 0;
+  prevTotalRunTime = totalRunTime;
+  for (int i = 0; i < numTasks; i++) {
+    taskStat_t* ts = &newStats[i];
+    ts->handle = sysState[i].xHandle;
+    strncpy(ts->name, sysState[i].pcTaskName, configMAX_TASK_NAME_LEN - 1);
+    ts->name[configMAX_TASK_NAME_LEN - 1] = 0;
+#if configGENERATE_RUN_TIME_STATS
+    ts->runTime = sysState[i].ulRunTimeCounter;
+#else
+    ts->runTime = 0;
+#endif
+    ts->cpuPercent = 0;
+    if (havePrev && elapsed) {
+      // match with previous sample, new tasks get measured next time
+      for (int j = 0; j < numTaskStats; j++) {
+        if (taskStats[j].handle == ts->handle) {
+          ts->cpuPercent = min((uint64_t)100, (100ULL * (ts->runTime - taskStats[j].runTime)) / elapsed);
+          break;
+        }
+      }
+    }
+#if configTASKLIST_INCLUDE_COREID
+    ts->core = sysState[i].xCoreID == tskNO_AFFINITY ? -1 : sysState[i].xCoreID;
+#else
+    ts->core = -1;
+#endif
+    ts->priority = sysState[i].uxCurrentPriority;
+    ts->stackFree = sysState[i].usStackHighWaterMark; // bytes on ESP-IDF
+  }
+  if (xSemaphoreTake(taskStatsMutex, pdMS_TO_TICKS(10)) == pdTRUE) {
+    memcpy(taskStats, newStats, numTasks * sizeof(taskStat_t));
+    numTaskStats = numTasks;
+    xSemaphoreGive(taskStatsMutex);
+  }
+}
+#endif
+
+size_t buildTaskStatsJson(char* p) {
+  // add task stats array to status json, empty if not sampled
+  char* start = p;
+  if (taskStatsMutex == NULL || !numTaskStats) return 0;
+  if (xSemaphoreTake(taskStatsMutex, pdMS_TO_TICKS(10)) != pdTRUE) return 0;
+  p += sprintf(p, "\"taskStats\":[");
+  for (int i = 0; i < numTaskStats; i++) {
+    taskStat_t* ts = &taskStats[i];
+    p += sprintf(p, "{\"name\":\"%s\",\"core\":%d,\"pri\":%u,\"cpu\":%u,\"stack\":%u},", 
+      ts->name, ts->core, ts->priority, ts->cpuPercent, ts->stackFree);
+  }
+  xSemaphoreGive(taskStatsMutex);
+  p[-1] = ']'; // lose trailing comma
+  p += sprintf(p, ",");
+  return p - start;
+}
+
 static void idleMonTask(void* p) {
+  uint32_t intervals = 0;
   while (true) {
     for (int i = 0; i < portNUM_PROCESSORS; i++) {
       idleCnt[i] = idleCalls[i];
       idleCalls[i] = 0;
     }
+#if configUSE_TRACE_FACILITY
+    if (++intervals >= STATS_INTERVALS) {
+      intervals = 0;
+      sampleTaskStats();
+    }
+#endif
     vTaskDelay(TICKS_PER_INTERVAL);
   }
   vTaskDelete(NULL);
@@ -894,7 +1084,11 @@ void startIdleMon() {
   LOG_INF("Start core idle time monitoring @ interval %ums", INTERVAL_TIME);
   for (int i = 0; i < portNUM_PROCESSORS; i++) 
     esp_register_freertos_idle_hook_for_cpu(hookCallback, i);
-  xTaskCreatePinnedToCore(idleMonTask, "idlemon", 1024, NULL, IDLEMON_PRI, NULL, 0);
+  taskStatsMutex = xSemaphoreCreateMutex();
+#if !configUSE_TRACE_FACILITY || !configGENERATE_RUN_TIME_STATS
+  LOG_WRN("Task cpu usage not available, needs FreeRTOS run time stats");
+#endif
+  xTaskCreatePinnedToCore(idleMonTask, "idlemon", 2048, NULL, IDLEMON_PRI, NULL, 0);
 }
 
 
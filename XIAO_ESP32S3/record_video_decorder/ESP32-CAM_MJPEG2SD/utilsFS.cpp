@@ -3,6 +3,8 @@
 // s60sc 2021, 2022 
 
 #include "appGlobals.h"
+#include <algorithm>
+#include <deque>
 
 // Storage settings
 int sdMinCardFreeSpace = 100; // Minimum amount of card free Megabytes before sdFreeSpaceMode action is enabled
@@ -87,7 +89,10 @@ bool startStorage() {
   if ((fs::SDMMCFS*)&STORAGE == &SD_MMC) {
     strcpy(fsType, "SD_MMC");
     res = prepSD_MMC();
-    if (res) listFolder(DATA_DIR);
+    if (res) {
+      listFolder(DATA_DIR);
+      startStorageTask();
+    }
     else snprintf(startupFailure, SF_LEN, STARTUP_FAIL "Check SD card inserted");
     debugMemory("startStorage");
     return res; 
@@ -122,50 +127,276 @@ bool startStorage() {
   return res;
 }
 
-static void getOldestDir(char* oldestDir) {
-  // get oldest folder by its date name
+void inline getFileDate(File file, char* fileDate) {
+  // get creation date of file as string
+  time_t writeTime = file.getLastWrite();
+  struct tm lt;
+  localtime_r(&writeTime, &lt);
+  strftime(fileDate, sizeof(fileDate), "%Y-%m-%d %H:%M:%S", &lt);
+}
+
+/************** day folder index & background free space **************/
+
+// Day folders oldest first with size and file count, saved in DATA_DIR so boot only
+// walks new folders. With cached free space, checkFreeStorage() is O(1) and storageTask
+// deletes from the oldest folder in small steps while below the watermark.
+
+#define FOLDER_INDEX_PATH DATA_DIR "/folders.idx"
+#define STORAGE_HEADROOM_MB 100 // deletion runs till this much above sdMinCardFreeSpace
+#define STORAGE_REFRESH_SECS 60 // re-read free space from card
+#define DELETE_BATCH 4 // files deleted per step
+#define DELETE_PAUSE 20 // ms between steps, longer while capturing
+
+struct dayFolder_t {
+  char name[16]; // eg /20241014
+  uint64_t bytes;
+  uint32_t files;
+};
+static std::deque<dayFolder_t> folderIndex;
+static SemaphoreHandle_t indexMutex = NULL;
+static bool indexReady = false;
+static bool indexDirty = false;
+static volatile int64_t cardFreeBytes = -1; // unknown till first refresh
+TaskHandle_t storageHandle = NULL;
+
+static bool isDayFolder(File& file) {
+  // root folders taken for recordings, as getOldestDir() used to select
+  return file.isDirectory() && strstr(file.name(), "System") == NULL // ignore Sys Vol Info
+    && strstr(DATA_DIR, file.name()) == NULL // ignore data folder
+    && strlen(file.path()) < sizeof(dayFolder_t::name);
+}
+
+static void walkFolder(dayFolder_t& folder) {
+  // size up folder contents, only done for folders the saved index doesn't hold
+  folder.bytes = folder.files = 0;
+  File root = fp.open(folder.name);
+  File file = root.openNextFile();
+  while (file) {
+    if (!file.isDirectory()) {
+      folder.bytes += file.size();
+      folder.files++;
+    }
+    file = root.openNextFile();
+  }
+}
+
+static void saveFolderIndex() {
+  // persist so next boot only needs to walk folders changed since
+  xSemaphoreTake(indexMutex, portMAX_DELAY);
+  File idxFile = fp.open(FOLDER_INDEX_PATH, FILE_WRITE);
+  if (idxFile) {
+    for (auto& folder : folderIndex) idxFile.write((uint8_t*)&folder, sizeof(dayFolder_t));
+    idxFile.close();
+    indexDirty = false;
+  } else LOG_WRN("Failed to save %s", FOLDER_INDEX_PATH);
+  xSemaphoreGive(indexMutex);
+}
+
+static void buildFolderIndex() {
+  // load saved index, keeping entries for folders still present, walk the rest
+  uint32_t iTime = millis();
+  std::vector<dayFolder_t> saved;
+  File idxFile = fp.open(FOLDER_INDEX_PATH, FILE_READ);
+  if (idxFile) {
+    dayFolder_t folder;
+    while (idxFile.read((uint8_t*)&folder, sizeof(dayFolder_t)) == sizeof(dayFolder_t)) saved.push_back(folder);
+    idxFile.close();
+  }
+  std::vector<dayFolder_t> found;
   File root = fp.open("/");
   File file = root.openNextFile();
-  if (file) strcpy(oldestDir, file.path()); // initialise oldestDir
   while (file) {
-    if (file.isDirectory() && strstr(file.name(), "System") == NULL // ignore Sys Vol Info
-        && strstr(DATA_DIR, file.name()) == NULL) { // ignore data folder
-      if (strcmp(oldestDir, file.path()) > 0) strcpy(oldestDir, file.path()); 
+    if (isDayFolder(file)) {
+      dayFolder_t folder = {};
+      strncpy(folder.name, file.path(), sizeof(folder.name) - 1);
+      found.push_back(folder);
     }
     file = root.openNextFile();
   }
+  std::sort(found.begin(), found.end(), [](const dayFolder_t& a, const dayFolder_t& b) { return strcmp(a.name, b.name) < 0; });
+  int walked = 0;
+  for (size_t i = 0; i < found.size(); i++) {
+    // newest folder may have had clips added after index was last saved
+    bool known = false;
+    if (i < found.size() - 1) {
+      for (auto& folder : saved) {
+        if (!strcmp(folder.name, found[i].name)) {
+          found[i] = folder;
+          known = true;
+          break;
+        }
+      }
+    }
+    if (!known) {
+      walkFolder(found[i]);
+      walked++;
+    }
+  }
+  xSemaphoreTake(indexMutex, portMAX_DELAY);
+  folderIndex.assign(found.begin(), found.end());
+  indexReady = true;
+  indexDirty = true;
+  xSemaphoreGive(indexMutex);
+  saveFolderIndex();
+  LOG_INF("Folder index: %u day folders, %u walked, in %ums", found.size(), walked, millis() - iTime);
 }
 
-void inline getFileDate(File file, char* fileDate) {
-  // get creation date of file as string
-  time_t writeTime = file.getLastWrite();
-  struct tm lt;
-  localtime_r(&writeTime, &lt);
-  strftime(fileDate, sizeof(fileDate), "%Y-%m-%d %H:%M:%S", &lt);
+void addToFolderIndex(const char* filePath, size_t fileSize) {
+  // called on closing a recording, O(1) as file is always in newest folder
+  if (indexMutex == NULL) return;
+  const char* sep = strchr(filePath + 1, '/');
+  if (sep == NULL || sep - filePath >= (int)sizeof(dayFolder_t::name)) return;
+  xSemaphoreTake(indexMutex, portMAX_DELAY);
+  if (indexReady) {
+    if (folderIndex.empty() || strncmp(folderIndex.back().name, filePath, sep - filePath)
+        || folderIndex.back().name[sep - filePath] != 0) {
+      dayFolder_t folder = {};
+      strncpy(folder.name, filePath, sep - filePath);
+      folderIndex.push_back(folder);
+    }
+    folderIndex.back().bytes += fileSize;
+    folderIndex.back().files++;
+    indexDirty = true;
+  }
+  if (cardFreeBytes >= 0) cardFreeBytes -= fileSize;
+  xSemaphoreGive(indexMutex);
 }
 
-bool checkFreeStorage() { 
-  // Check for sufficient space on storage
-  bool res = false;
-  size_t freeSize = (size_t)((STORAGE.totalBytes() - STORAGE.usedBytes()) / ONEMEG);
-  if (!sdFreeSpaceMode && freeSize < sdMinCardFreeSpace) 
-    LOG_ERR("Space left %uMB is less than minimum %uMB", freeSize, sdMinCardFreeSpace);
-  else {
-    // delete to make space
-    while (freeSize < sdMinCardFreeSpace) {
-      char oldestDir[FILE_NAME_LEN];
-      getOldestDir(oldestDir);
-      LOG_WRN("Deleting oldest folder: %s %s", oldestDir, sdFreeSpaceMode == 2 ? "after uploading" : "");
+static void removeFromFolderIndex(const char* path, uint64_t bytes, uint32_t files, bool isFolder) {
+  // account for deleted folder, or file within a day folder
+  if (indexMutex == NULL) return;
+  xSemaphoreTake(indexMutex, portMAX_DELAY);
+  for (auto it = folderIndex.begin(); it != folderIndex.end(); ++it) {
+    size_t nameLen = strlen(it->name);
+    if (strncmp(it->name, path, nameLen) || (path[nameLen] != 0 && path[nameLen] != '/')) continue;
+    if (isFolder && path[nameLen] == 0) folderIndex.erase(it);
+    else if (!isFolder) {
+      it->bytes = it->bytes > bytes ? it->bytes - bytes : 0;
+      if (it->files) it->files -= files;
+    }
+    indexDirty = true;
+    break;
+  }
+  if (cardFreeBytes >= 0) cardFreeBytes += bytes;
+  xSemaphoreGive(indexMutex);
+}
+
+static int64_t freeSpaceWatermark() {
+  return (int64_t)(sdMinCardFreeSpace + STORAGE_HEADROOM_MB) * ONEMEG;
+}
+
+static bool deleteOldestStep() {
+  // delete a few files from oldest day folder, then folder when empty
+  // returns false when there is nothing that can be deleted
+  dayFolder_t oldest;
+  xSemaphoreTake(indexMutex, portMAX_DELAY);
+  bool haveFolder = !folderIndex.empty();
+  if (haveFolder) oldest = folderIndex.front();
+  xSemaphoreGive(indexMutex);
+  char currentFolder[FILE_NAME_LEN];
+  dateFormat(currentFolder, sizeof(currentFolder), true);
+  if (!haveFolder || !strcmp(oldest.name, currentFolder)) {
+    LOG_WRN("No day folder older than current one to delete");
+    return false;
+  }
 #if INCLUDE_FTP_HFS
-      if (sdFreeSpaceMode == 2) fsFileOrFolder(oldestDir); // Upload and then delete oldest folder
+  static char uploadedFolder[sizeof(dayFolder_t::name)] = "";
+  if (sdFreeSpaceMode == 2 && strcmp(uploadedFolder, oldest.name)) {
+    // upload whole folder before deleting any of it
+    LOG_WRN("Uploading oldest folder %s before deletion", oldest.name);
+    while (uploadActive()) delay(1000); // wait for any other upload to finish
+    fsFileOrFolder(oldest.name);
+    delay(100);
+    while (uploadActive()) delay(1000);
+    strcpy(uploadedFolder, oldest.name);
+  }
 #endif
-      deleteFolderOrFile(oldestDir);
-      freeSize = (size_t)((STORAGE.totalBytes() - STORAGE.usedBytes()) / ONEMEG);
+  File df = fp.open(oldest.name);
+  if (!df || !df.isDirectory()) {
+    // gone already, eg deleted from web page
+    removeFromFolderIndex(oldest.name, 0, 0, true);
+    return true;
+  }
+  uint64_t freed = 0;
+  int deleted = 0;
+  File file = df.openNextFile();
+  while (file && deleted < DELETE_BATCH) {
+    char filepath[FILE_NAME_LEN];
+    strcpy(filepath, file.path());
+    bool isDir = file.isDirectory();
+    size_t fSize = file.size();
+    file.close();
+    if (!isDir && STORAGE.remove(filepath)) {
+      freed += fSize;
+      deleted++;
+      LOG_DBG("  FILE : %s Size : %s deleted", filepath, fmtSize(fSize));
     }
-    LOG_INF("Storage free space: %s", fmtSize(STORAGE.totalBytes() - STORAGE.usedBytes()));
-    res = true;
+    file = df.openNextFile();
   }
-  return res;
+  df.close();
+  if (deleted) removeFromFolderIndex(oldest.name, freed, deleted, false);
+  else {
+    // empty, so remove folder
+    bool res = STORAGE.rmdir(oldest.name);
+    LOG_ALT("Folder %s %sdeleted to free space", oldest.name, res ? "" : "not ");
+    removeFromFolderIndex(oldest.name, 0, 0, true);
+    if (!res) return false;
+  }
+  return true;
+}
+
+static void storageTask(void* parameter) {
+  // maintains folder index and free space off the recording path
+  buildFolderIndex();
+  uint32_t refreshTime = 0;
+  while (true) {
+    if (!refreshTime || millis() - refreshTime > STORAGE_REFRESH_SECS * 1000) {
+      cardFreeBytes = (int64_t)(STORAGE.totalBytes() - STORAGE.usedBytes());
+      refreshTime = millis();
+      if (indexDirty) saveFolderIndex();
+    }
+    if (sdFreeSpaceMode && cardFreeBytes < freeSpaceWatermark()) {
+      LOG_WRN("Free space %s below %uMB, deleting oldest folder", fmtSize(cardFreeBytes), sdMinCardFreeSpace + STORAGE_HEADROOM_MB);
+      uint32_t dTime = millis();
+      while (cardFreeBytes < freeSpaceWatermark() && deleteOldestStep()) {
+#ifdef ISCAM
+        delay(isCapturing ? DELETE_PAUSE * 5 : DELETE_PAUSE); // recording gets the card first
+#else
+        delay(DELETE_PAUSE);
+#endif
+      }
+      cardFreeBytes = (int64_t)(STORAGE.totalBytes() - STORAGE.usedBytes());
+      refreshTime = millis();
+      saveFolderIndex();
+      LOG_INF("Storage free space: %s, after %ums deleting", fmtSize(cardFreeBytes), millis() - dTime);
+    }
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STORAGE_REFRESH_SECS * 1000));
+  }
+}
+
+static void startStorageTask() {
+  if (storageHandle != NULL) return;
+  indexMutex = xSemaphoreCreateMutex();
+  xTaskCreate(&storageTask, "storageTask", STORAGE_STACK_SIZE, NULL, STORAGE_PRI, &storageHandle);
+}
+
+bool checkFreeStorage() { 
+  // Check for sufficient space on storage, O(1) from cached free space
+  // called when a recording is closed, any deletion is left to storageTask
+  int64_t freeBytes = cardFreeBytes;
+  if (freeBytes < 0) {
+    // not yet known, storageTask will check
+    if (storageHandle != NULL) xTaskNotifyGive(storageHandle);
+    return true;
+  }
+  size_t freeSize = (size_t)(freeBytes / ONEMEG);
+  if (!sdFreeSpaceMode && freeSize < sdMinCardFreeSpace) {
+    LOG_ERR("Space left %uMB is less than minimum %uMB", freeSize, sdMinCardFreeSpace);
+    return false;
+  }
+  if (sdFreeSpaceMode && freeBytes < freeSpaceWatermark() && storageHandle != NULL) xTaskNotifyGive(storageHandle);
+  LOG_INF("Storage free space: %s", fmtSize(freeBytes));
+  return true;
 } 
 
 void setFolderName(const char* fname, char* fileName) {
@@ -276,6 +507,7 @@ void deleteFolderOrFile(const char* deleteThis) {
   // Empty named folder first
   if (df.isDirectory() || ((!strcmp(fsType, "SPIFFS")) && strstr("/", fileName) != NULL)) {
     LOG_INF("Folder %s contents", fileName);
+    uint64_t freed = 0;
     File file = df.openNextFile();
     while (file) {
       char filepath[FILE_NAME_LEN];
@@ -284,25 +516,38 @@ void deleteFolderOrFile(const char* deleteThis) {
       else {
         size_t fSize = file.size();
         file.close();
-        LOG_INF("  FILE : %s Size : %s %sdeleted", filepath, fmtSize(fSize), STORAGE.remove(filepath) ? "" : "not ");
+        bool removed = STORAGE.remove(filepath);
+        if (removed) freed += fSize;
+        LOG_INF("  FILE : %s Size : %s %sdeleted", filepath, fmtSize(fSize), removed ? "" : "not ");
       }
       file = df.openNextFile();
     }
     // Remove the folder
-    if (df.isDirectory()) LOG_ALT("Folder %s %sdeleted", fileName, STORAGE.rmdir(fileName) ? "" : "not ");
+    if (df.isDirectory()) {
+      bool removed = STORAGE.rmdir(fileName);
+      LOG_ALT("Folder %s %sdeleted", fileName, removed ? "" : "not ");
+      removeFromFolderIndex(fileName, freed, 0, removed);
+    }
     else df.close();
   } else {
     // delete individual file
+    size_t fSize = df.size();
     df.close();
-    LOG_ALT("File %s %sdeleted", deleteThis, STORAGE.remove(deleteThis) ? "" : "not ");  //Remove the file
+    bool removed = STORAGE.remove(deleteThis);
+    LOG_ALT("File %s %sdeleted", deleteThis, removed ? "" : "not ");  //Remove the file
+    if (removed) removeFromFolderIndex(deleteThis, fSize, 1, false);
 #ifdef ISCAM
-    // delete corresponding csv and srt files if exist
+    // delete corresponding csv, srt and thumbnail sidecar files if exist
     char otherDeleteName[FILE_NAME_LEN];
     strcpy(otherDeleteName, deleteThis);
     changeExtension(otherDeleteName, CSV_EXT);
     if (STORAGE.remove(otherDeleteName)) LOG_INF("File %s deleted", otherDeleteName);
     changeExtension(otherDeleteName, SRT_EXT);
     if (STORAGE.remove(otherDeleteName)) LOG_INF("File %s deleted", otherDeleteName);
+    changeExtension(otherDeleteName, TLM_EXT);
+    if (STORAGE.remove(otherDeleteName)) LOG_INF("File %s deleted", otherDeleteName);
+    changeExtension(otherDeleteName, THM_EXT);
+    if (STORAGE.remove(otherDeleteName)) LOG_INF("File %s deleted", otherDeleteName);
 #endif  
   }
 }
@@ -329,6 +574,41 @@ static esp_err_t writeHeader(File& inFile, httpd_req_t* req) {
   return httpd_resp_send_chunk(req, tarHeader, BLOCKSIZE);
 }
 
+static int parseRange(httpd_req_t* req, size_t fileSize, size_t& rangeStart, size_t& rangeLen) {
+  // single byte range from Range header: 'bytes=first-last', 'bytes=first-' or 'bytes=-suffix'
+  // returns 1 if valid, -1 if not satisfiable, 0 if absent or not usable so whole file sent
+  char rangeHdr[64];
+  size_t hdrLen = httpd_req_get_hdr_value_len(req, "Range");
+  if (!hdrLen || hdrLen >= sizeof(rangeHdr)) return 0;
+  if (httpd_req_get_hdr_value_str(req, "Range", rangeHdr, sizeof(rangeHdr)) != ESP_OK) return 0;
+  // multiple ranges not supported
+  if (strncmp(rangeHdr, "bytes=", 6) || strchr(rangeHdr, ',') != NULL) return 0; 
+  char* first = rangeHdr + 6;
+  char* last = strchr(first, '-');
+  if (last == NULL) return 0;
+  *last++ = 0;
+  char* endPtr;
+  if (!strlen(first)) {
+    // suffix range, final bytes of file
+    size_t suffixLen = strtoul(last, &endPtr, 10);
+    if (endPtr == last || *endPtr) return 0;
+    if (!suffixLen || !fileSize) return -1;
+    rangeLen = std::min(suffixLen, fileSize);
+    rangeStart = fileSize - rangeLen;
+    return 1;
+  }
+  rangeStart = strtoul(first, &endPtr, 10);
+  if (*endPtr) return 0;
+  size_t rangeEnd = fileSize - 1;
+  if (strlen(last)) {
+    rangeEnd = strtoul(last, &endPtr, 10);
+    if (*endPtr || rangeEnd < rangeStart) return 0;
+  }
+  if (rangeStart >= fileSize) return -1;
+  rangeLen = std::min(rangeEnd, fileSize - 1) - rangeStart + 1;
+  return 1;
+}
+
 esp_err_t downloadFile(File& df, httpd_req_t* req) {
   // download file as attachment, required file name in inFileName
   // setup download header, create zip file if required, and download file
@@ -340,6 +620,9 @@ esp_err_t downloadFile(File& df, httpd_req_t* req) {
   char fsSavePath[FILE_NAME_LEN];
   strcpy(fsSavePath, inFileName);
 #ifdef ISCAM
+#if INCLUDE_TELEM
+  expandTelemetry(fsSavePath); // binary telemetry to csv and srt
+#endif
   changeExtension(fsSavePath, CSV_EXT);
   
   // check if ancillary files present
@@ -370,8 +653,30 @@ esp_err_t downloadFile(File& df, httpd_req_t* req) {
   char contentDisp[IN_FILE_NAME_LEN + 50];
   snprintf(contentDisp, sizeof(contentDisp) - 1, "attachment; filename=%s", downloadName);
   httpd_resp_set_hdr(req, "Content-Disposition", contentDisp);
+  // byte range of single file for seeking or resumed download
+  size_t rangeStart = 0;
+  size_t rangeLen = downloadSize;
+  int hasRange = needZip ? 0 : parseRange(req, downloadSize, rangeStart, rangeLen);
+  char contentRange[40];
+  if (hasRange < 0) {
+    LOG_WRN("Requested range not satisfiable for %s", downloadName);
+    snprintf(contentRange, sizeof(contentRange) - 1, "bytes */%u", downloadSize);
+    httpd_resp_set_status(req, "416 Range Not Satisfiable");
+    httpd_resp_set_hdr(req, "Content-Range", contentRange);
+    httpd_resp_send(req, NULL, 0);
+    df.close();
+    return ESP_OK;
+  }
+  if (!needZip) httpd_resp_set_hdr(req, "Accept-Ranges", "bytes");
+  if (hasRange) {
+    LOG_INF("Download range %u-%u of %s", rangeStart, rangeStart + rangeLen - 1, downloadName);
+    snprintf(contentRange, sizeof(contentRange) - 1, "bytes %u-%u/%u", rangeStart, rangeStart + rangeLen - 1, downloadSize);
+    httpd_resp_set_status(req, "206 Partial Content");
+    httpd_resp_set_hdr(req, "Content-Range", contentRange);
+    df.seek(rangeStart, SeekSet);
+  }
   char contentLength[10];
-  snprintf(contentLength, sizeof(contentLength) - 1, "%i", downloadSize);
+  snprintf(contentLength, sizeof(contentLength) - 1, "%i", rangeLen);
   httpd_resp_set_hdr(req, "Content-Length", contentLength);
 
   if (needZip) {
@@ -401,6 +706,112 @@ esp_err_t downloadFile(File& df, httpd_req_t* req) {
     res = httpd_resp_send_chunk(req, zeroBlock, BLOCKSIZE);
     res = httpd_resp_sendstr_chunk(req, NULL);
 #endif
-  } else res = sendChunks(df, req); // send AVI
+  } else res = sendChunks(df, req, true, rangeLen); // send AVI or requested range of it
   return res;
 }
+
+/************** SD read ahead **************/
+
+// A reader task keeps up to depth blocks of a file in psram ahead of its consumer,
+// so the SD read of the following blocks overlaps with sending the current one
+
+#define READ_AHEAD_STOP 0xFF // queued to release a waiting consumer
+
+static void readAheadTask(void* p) {
+  readAhead_t* ra = (readAhead_t*)p;
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY); // wait for readAheadStart()
+    uint8_t head = 0;
+    size_t blockLen = 1;
+    while (ra->run && blockLen) {
+      // wait for consumer to free a block, recheck run periodically
+      if (xSemaphoreTake(ra->freeBlocks, pdMS_TO_TICKS(100)) != pdTRUE) continue;
+      uint32_t rTime = millis();
+      blockLen = ra->run ? ra->file->read(ra->buff + head * ra->blockSize, ra->blockSize) : 0;
+      ra->readTime += millis() - rTime;
+      ra->readBytes += blockLen;
+      ra->blockLen[head] = blockLen;
+      xQueueSend(ra->filled, &head, portMAX_DELAY); // zero length block flags end of file
+      if (++head >= ra->depth) head = 0;
+    }
+    ra->busy = false;
+  }
+  vTaskDelete(NULL);
+}
+
+bool readAheadInit(readAhead_t* ra, const char* taskName, size_t blockSize, uint8_t maxDepth, uint32_t stackSize, UBaseType_t priority) {
+  // allocate blocks in psram and start reader task
+  ra->blockSize = blockSize;
+  ra->maxDepth = ra->depth = maxDepth;
+  ra->buff = psramFound() ? (uint8_t*)ps_malloc(blockSize * maxDepth) : (uint8_t*)malloc(blockSize * maxDepth);
+  ra->blockLen = (size_t*)malloc(sizeof(size_t) * maxDepth);
+  ra->filled = xQueueCreate(maxDepth + 1, sizeof(uint8_t)); // room for stop marker
+  ra->freeBlocks = xSemaphoreCreateCounting(maxDepth, 0);
+  ra->run = ra->busy = ra->holding = false;
+  ra->file = NULL;
+  ra->readTime = ra->readBytes = 0;
+  ra->taskHandle = NULL;
+  if (ra->buff == NULL || ra->blockLen == NULL || ra->filled == NULL || ra->freeBlocks == NULL) {
+    LOG_ERR("Insufficient memory for %s read ahead of %u x %u bytes", taskName, maxDepth, blockSize);
+    return false;
+  }
+  xTaskCreate(readAheadTask, taskName, stackSize, ra, priority, &ra->taskHandle);
+  return true;
+}
+
+uint8_t readAheadDepth(readAhead_t* ra, uint32_t bytesPerSec, uint32_t aheadMs) {
+  // number of blocks to hold given duration of content at given data rate, plus current block
+  uint32_t blocks = ((uint64_t)bytesPerSec * aheadMs / 1000 + ra->blockSize - 1) / ra->blockSize + 1;
+  return (uint8_t)constrain(blocks, 2, ra->maxDepth);
+}
+
+static void waitReader(readAhead_t* ra) {
+  ra->run = false;
+  uint32_t timeOut = millis();
+  while (ra->busy && millis() - timeOut < MAX_FRAME_WAIT) delay(5);
+  if (ra->busy) LOG_WRN("Read ahead task did not stop");
+}
+
+void readAheadStart(readAhead_t* ra, File* file, uint8_t depth) {
+  // (re)start reading file from its current position
+  waitReader(ra);
+  xQueueReset(ra->filled);
+  while (xSemaphoreTake(ra->freeBlocks, 0) == pdTRUE) {}
+  ra->depth = constrain(depth, 1, ra->maxDepth);
+  for (int i = 0; i < ra->depth; i++) xSemaphoreGive(ra->freeBlocks);
+  ra->file = file;
+  ra->holding = false;
+  ra->readTime = ra->readBytes = 0;
+  ra->busy = ra->run = true;
+  xTaskNotifyGive(ra->taskHandle);
+}
+
+size_t readAheadNext(readAhead_t* ra, uint8_t** data) {
+  // wait for next block in file order, returns 0 at end of file or when stopped
+  // caller must readAheadRelease() the block once finished with it
+  uint8_t blk;
+  readAheadRelease(ra);
+  xQueueReceive(ra->filled, &blk, portMAX_DELAY);
+  if (blk == READ_AHEAD_STOP) {
+    *data = NULL;
+    return 0;
+  }
+  ra->holding = true;
+  *data = ra->buff + blk * ra->blockSize;
+  return ra->blockLen[blk];
+}
+
+void readAheadRelease(readAhead_t* ra) {
+  // block can be refilled
+  if (ra->holding) {
+    ra->holding = false;
+    xSemaphoreGive(ra->freeBlocks);
+  }
+}
+
+void readAheadStop(readAhead_t* ra) {
+  // stop reader before file is closed, and release any waiting consumer
+  waitReader(ra);
+  uint8_t stop = READ_AHEAD_STOP;
+  xQueueSend(ra->filled, &stop, 0);
+}
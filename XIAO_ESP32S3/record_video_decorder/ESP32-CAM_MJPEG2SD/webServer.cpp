@@ -20,14 +20,35 @@ bool useSecure = false;
 
 static fs::FS fp = STORAGE;
 static byte* chunk;
+static readAhead_t downloadRA; // SD chunks read ahead of file download
+static SemaphoreHandle_t downloadMutex = NULL;
 
-esp_err_t sendChunks(File df, httpd_req_t *req, bool endChunking) {   
-  // use chunked encoding to send large content to browser
+esp_err_t sendChunks(File df, httpd_req_t *req, bool endChunking, size_t sendLen) {   
+  // use chunked encoding to send large content to browser, up to sendLen bytes from current file position
   size_t chunksize = 0;
-  while ((chunksize = df.read(chunk, CHUNKSIZE))) {
-    if (httpd_resp_send_chunk(req, (char*)chunk, chunksize) != ESP_OK) break;
-    // httpd_sess_update_lru_counter(req->handle, httpd_req_to_sockfd(req));
-  } 
+  size_t remaining = sendLen;
+  if (downloadRA.taskHandle != NULL && xSemaphoreTake(downloadMutex, 0) == pdTRUE) {
+    // SD reads of following chunks overlap with sending current chunk
+    uint8_t* data;
+    readAheadStart(&downloadRA, &df, DOWNLOAD_READ_AHEAD);
+    while (remaining && (chunksize = readAheadNext(&downloadRA, &data))) {
+      chunksize = std::min(chunksize, remaining);
+      if (httpd_resp_send_chunk(req, (char*)data, chunksize) != ESP_OK) break;
+      remaining -= chunksize;
+      chunksize = 0;
+    }
+    readAheadRelease(&downloadRA);
+    readAheadStop(&downloadRA);
+    xSemaphoreGive(downloadMutex);
+  } else {
+    // read ahead in use by another download
+    while (remaining && (chunksize = df.read(chunk, std::min((size_t)CHUNKSIZE, remaining)))) {
+      if (httpd_resp_send_chunk(req, (char*)chunk, chunksize) != ESP_OK) break;
+      // httpd_sess_update_lru_counter(req->handle, httpd_req_to_sockfd(req));
+      remaining -= chunksize;
+      chunksize = 0;
+    } 
+  }
   if (endChunking) {
     df.close();
     httpd_resp_sendstr_chunk(req, NULL);
@@ -420,6 +441,8 @@ static void https_server_user_callback(esp_https_server_user_cb_arg_t *user_cb)
 void startWebServer() {
   esp_err_t res = ESP_FAIL;
   chunk = psramFound() ? (byte*)ps_malloc(CHUNKSIZE) : (byte*)malloc(CHUNKSIZE); 
+  downloadMutex = xSemaphoreCreateMutex();
+  readAheadInit(&downloadRA, "downloadTask", CHUNKSIZE, DOWNLOAD_READ_AHEAD, DOWNLOAD_STACK_SIZE, DOWNLOAD_PRI);
 #if INCLUDE_CERTS
   size_t prvtkey_len = strlen(prvtkey_pem);
   size_t cacert_len = strlen(cacert_pem);
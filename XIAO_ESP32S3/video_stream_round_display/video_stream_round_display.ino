@@ -1,5 +1,6 @@
 #include <Arduino.h>
 #include <TFT_eSPI.h>
+#include <TJpg_Decoder.h>
 #include <SPI.h>
 #include "esp_camera.h"
 
@@ -11,7 +12,34 @@
 const int camera_width = 240;
 const int camera_height = 240;
 
+// Frames are captured as JPEG and decoded one MCU row at a time into two
+// DMA-capable band buffers: the SPI DMA of one band to the GC9A01 runs while
+// the next band decodes, and with two frame buffers the camera captures the
+// next frame meanwhile.
+const int band_lines = 16; // tallest MCU row (4:2:0 sampling)
+
 TFT_eSPI tft = TFT_eSPI();
+uint16_t* band_buf[2] = {NULL, NULL};
+int band_sel = 0;
+uint32_t frame_count = 0;
+unsigned long fps_start = 0;
+
+// TJpg_Decoder output: collect the MCU blocks of a row, then send the row by DMA
+bool band_output(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t* bitmap) {
+  if (y >= camera_height) return false;
+  if (x + w > camera_width) w = camera_width - x;
+  if (h > band_lines) h = band_lines;
+  uint16_t* band = band_buf[band_sel];
+  for (int row = 0; row < h; row++) {
+    memcpy(band + row * camera_width + x, bitmap + row * w, w * sizeof(uint16_t));
+  }
+  if (x + w >= camera_width) {
+    // pushImageDMA waits for the previous band, so the other buffer is free to fill next
+    tft.pushImageDMA(0, y, camera_width, h, band);
+    band_sel ^= 1;
+  }
+  return true;
+}
 
 void setup() {
   // put your setup code here, to run once:
@@ -41,8 +69,8 @@ void setup() {
   config.xclk_freq_hz = 20000000;
 //  config.frame_size = FRAMESIZE_UXGA;
   config.frame_size = FRAMESIZE_240X240;
-//  config.pixel_format = PIXFORMAT_JPEG; // for streaming
-  config.pixel_format = PIXFORMAT_RGB565;
+  config.pixel_format = PIXFORMAT_JPEG; // decoded to the display by TJpg_Decoder
+//  config.pixel_format = PIXFORMAT_RGB565;
   config.grab_mode = CAMERA_GRAB_WHEN_EMPTY;
   config.fb_location = CAMERA_FB_IN_PSRAM;
   config.jpeg_quality = 12;
@@ -80,7 +108,20 @@ void setup() {
   tft.init();
   tft.setRotation(1);
   tft.fillScreen(TFT_WHITE);
+  tft.initDMA();
 
+  // Band buffers must be in internal DMA-capable memory
+  for (int i = 0; i < 2; i++) {
+    band_buf[i] = (uint16_t*)heap_caps_malloc(camera_width * band_lines * sizeof(uint16_t), MALLOC_CAP_DMA);
+    if (!band_buf[i]) {
+      Serial.println("Display band buffer allocation failed");
+      return;
+    }
+  }
+  TJpgDec.setJpgScale(1);
+  TJpgDec.setSwapBytes(true); // GC9A01 takes RGB565 most significant byte first
+  TJpgDec.setCallback(band_output);
+  fps_start = millis();
 }
 
 void loop() {
@@ -92,16 +133,26 @@ void loop() {
     return;
   }
 
-  // Decode JPEG images
-  uint8_t* buf = fb->buf;
-  uint32_t len = fb->len;
+  if (!band_buf[1]) {
+    esp_camera_fb_return(fb);
+    delay(10000);
+    return;
+  }
+
+  // Decode JPEG images, startWrite keeps the display selected across the DMA transfers
   tft.startWrite();
-  tft.setAddrWindow(0, 0, camera_width, camera_height);
-  tft.pushColors(buf, len);
+  if (TJpgDec.drawJpg(0, 0, fb->buf, fb->len) != JDR_OK) {
+    Serial.println("JPEG decode failed");
+  }
+  tft.dmaWait(); // last band finished before the display is deselected
   tft.endWrite();
 
-  // Release image memory
+  // Release image memory, the driver captures into it while this frame was decoding
   esp_camera_fb_return(fb);
 
-  delay(10);
+  if (++frame_count == 100) {
+    Serial.printf("Display: %.1f fps\n", frame_count * 1000.0 / (millis() - fps_start));
+    frame_count = 0;
+    fps_start = millis();
+  }
 }
@@ -0,0 +1,209 @@
+#include "AviWriter.h"
+#include "HeapAccounting.h"
+
+// avi header data
+static const uint8_t dcBuf[4] = {0x30, 0x30, 0x64, 0x63};   // 00dc
+static const uint8_t idx1Buf[4] = {0x69, 0x64, 0x78, 0x31}; // idx1
+static const uint8_t ftimBuf[4] = {0x66, 0x74, 0x69, 0x6D}; // ftim
+static const uint8_t zeroBuf[4] = {0x00, 0x00, 0x00, 0x00}; // 0000
+
+static const uint8_t aviHeaderTemplate[AVI_HEADER_LEN] = { // AVI header template
+  0x52, 0x49, 0x46, 0x46, 0x00, 0x00, 0x00, 0x00, 0x41, 0x56, 0x49, 0x20, 0x4C, 0x49, 0x53, 0x54,
+  0x16, 0x01, 0x00, 0x00, 0x68, 0x64, 0x72, 0x6C, 0x61, 0x76, 0x69, 0x68, 0x38, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0xe0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x4C, 0x49, 0x53, 0x54, 0x6C, 0x00, 0x00, 0x00,
+  0x73, 0x74, 0x72, 0x6C, 0x73, 0x74, 0x72, 0x68, 0x30, 0x00, 0x00, 0x00, 0x76, 0x69, 0x64, 0x73,
+  0x4D, 0x4A, 0x50, 0x47, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0A, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x73, 0x74, 0x72, 0x66,
+  0x28, 0x00, 0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x01, 0x00, 0x18, 0x00, 0x4D, 0x4A, 0x50, 0x47, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x4C, 0x49, 0x53, 0x54, 0x56, 0x00, 0x00, 0x00,
+  0x73, 0x74, 0x72, 0x6C, 0x73, 0x74, 0x72, 0x68, 0x30, 0x00, 0x00, 0x00, 0x61, 0x75, 0x64, 0x73,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x01, 0x00, 0x00, 0x00, 0x11, 0x2B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x11, 0x2B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x73, 0x74, 0x72, 0x66,
+  0x12, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x11, 0x2B, 0x00, 0x00, 0x11, 0x2B, 0x00, 0x00,
+  0x02, 0x00, 0x10, 0x00, 0x00, 0x00,
+  0x4C, 0x49, 0x53, 0x54, 0x00, 0x00, 0x00, 0x00, 0x6D, 0x6F, 0x76, 0x69,
+};
+
+AviWriter::AviWriter(uint32_t maxFrames) {
+    this->idxBuf = NULL;
+    this->timeBuf = NULL;
+    this->firstFrameMs = 0;
+    this->maxFrames = maxFrames;
+    this->idxPtr = 0;
+    this->idxOffset = 4;
+    this->moviSize = 0;
+    this->indexLen = 0;
+    this->frameCnt = 0;
+    memcpy(aviHeader, aviHeaderTemplate, AVI_HEADER_LEN);
+}
+
+AviWriter::~AviWriter() {
+    heapRecorder.release(idxBuf);
+    heapRecorder.release(timeBuf);
+}
+
+bool AviWriter::begin() {
+    if (idxBuf == NULL) {
+        size_t idxSize = (maxFrames + 1) * IDX_ENTRY;
+        idxBuf = (uint8_t*)heapRecorder.allocPreferPsram(idxSize);
+        if (idxBuf == NULL) {
+            Serial.println("ERROR: AviWriter index allocation failed!");
+            return false;
+        }
+    }
+    if (timeBuf == NULL) {
+        size_t timeSize = maxFrames * TIME_ENTRY;
+        timeBuf = (uint32_t*)heapRecorder.allocPreferPsram(timeSize);
+        if (timeBuf == NULL) {
+            Serial.println("ERROR: AviWriter time index allocation failed!");
+            return false;
+        }
+    }
+    return true;
+}
+
+void AviWriter::prepAviIndex() {
+    // prep buffer to store index data, gets appended to end of file
+    memcpy(idxBuf, idx1Buf, 4); // index header
+    idxPtr = CHUNK_HDR;  // leave 4 bytes for index size
+    moviSize = indexLen = 0;
+    idxOffset = 4; // 4 byte offset
+    frameCnt = 0;
+}
+
+void AviWriter::buildAviHdr(uint8_t FPS, uint16_t frameWidth, uint16_t frameHeight, uint32_t frameCnt, uint32_t usecsPerFrame) {
+    // update AVI header template with file specific details
+    uint32_t aviSize = moviSize + AVI_HEADER_LEN + ((CHUNK_HDR + IDX_ENTRY) * frameCnt) // AVI content size
+                     + CHUNK_HDR + TIME_ENTRY * frameCnt;                                 // plus ftim chunk
+    if (FPS == 0) FPS = 1;
+    memcpy(aviHeader + 4, &aviSize, 4);
+    // usecs_per_frame, from the measured frame spacing when known
+    uint32_t usecs = usecsPerFrame ? usecsPerFrame : (uint32_t)round(1000000.0f / FPS);
+    memcpy(aviHeader + 0x20, &usecs, 4);
+    memcpy(aviHeader + 0x30, &frameCnt, 4);
+    memcpy(aviHeader + 0x8C, &frameCnt, 4);
+    memcpy(aviHeader + 0x84, &FPS, 1);
+    uint32_t dataSize = moviSize + (frameCnt * CHUNK_HDR) + 4;
+    memcpy(aviHeader + 0x12E, &dataSize, 4); // data size
+
+    // apply video framesize to avi header (taken from the frames, not a framesize table)
+    memcpy(aviHeader + 0x40, &frameWidth, 2);
+    memcpy(aviHeader + 0xA8, &frameWidth, 2);
+    memcpy(aviHeader + 0x44, &frameHeight, 2);
+    memcpy(aviHeader + 0xAC, &frameHeight, 2);
+
+    // no audio stream
+    memcpy(aviHeader + 0x100, zeroBuf, 4);
+}
+
+bool AviWriter::buildAviIdx(size_t dataSize, uint32_t timestampMs) {
+    // build AVI video index into buffer - 16 bytes per frame, plus its capture time
+    if (frameCnt >= maxFrames) {
+        return false;
+    }
+    if (frameCnt == 0) firstFrameMs = timestampMs;
+    timeBuf[frameCnt] = timestampMs - firstFrameMs;
+    moviSize += dataSize;
+    memcpy(idxBuf + idxPtr, dcBuf, 4);
+    memcpy(idxBuf + idxPtr + 4, zeroBuf, 4);
+    memcpy(idxBuf + idxPtr + 8, &idxOffset, 4);
+    memcpy(idxBuf + idxPtr + 12, &dataSize, 4);
+    idxOffset += dataSize + CHUNK_HDR;
+    idxPtr += IDX_ENTRY;
+    frameCnt++;
+    return true;
+}
+
+void AviWriter::finalizeAviIndex(uint32_t frameCnt) {
+    // update index with size
+    uint32_t sizeOfIndex = frameCnt * IDX_ENTRY;
+    memcpy(idxBuf + 4, &sizeOfIndex, 4); // size of index
+    indexLen = sizeOfIndex + CHUNK_HDR;
+    idxPtr = 0; // pointer to index buffer
+}
+
+size_t AviWriter::writeAviIndex(uint8_t* clientBuf, size_t buffSize) {
+    // copy out completed index, called repeatedly until it returns 0
+    if (idxPtr < indexLen) {
+        size_t chunk = min(indexLen - idxPtr, buffSize);
+        memcpy(clientBuf, idxBuf + idxPtr, chunk);
+        idxPtr += chunk;
+        return chunk;
+    }
+    return idxPtr = 0;
+}
+
+bool AviWriter::openAvi(SDWriteBuffer& out) {
+    if (!begin()) {
+        return false;
+    }
+    prepAviIndex();
+    // allot space for AVI header, rewritten at close
+    memcpy(aviHeader, aviHeaderTemplate, AVI_HEADER_LEN);
+    return out.write(aviHeader, AVI_HEADER_LEN) == AVI_HEADER_LEN;
+}
+
+size_t AviWriter::writeFrame(SDWriteBuffer& out, const uint8_t* jpeg, size_t len, uint32_t timestampMs) {
+    // align end of jpeg on 4 byte boundary for AVI
+    uint16_t filler = (4 - (len & 0x00000003)) & 0x00000003;
+    uint32_t jpegSize = len + filler;
+    if (!buildAviIdx(jpegSize, timestampMs)) {
+        return 0; // index full - caller should close the clip
+    }
+
+    uint8_t hdrBuff[CHUNK_HDR];
+    memcpy(hdrBuff, dcBuf, 4);
+    memcpy(hdrBuff + 4, &jpegSize, 4);
+    size_t written = out.write(hdrBuff, CHUNK_HDR);
+    written += out.write(jpeg, len);
+    if (filler) written += out.write(zeroBuf, filler);
+    return written;
+}
+
+bool AviWriter::closeAvi(SDWriteBuffer& out, File& file, float actualFPS, uint16_t frameWidth, uint16_t frameHeight) {
+    // append index, drain the write buffer, then rewrite header at start of file
+    uint32_t frames = frameCnt;
+    finalizeAviIndex(frames);
+    uint8_t idxChunk[512];
+    size_t idxLen = 0;
+    do {
+        idxLen = writeAviIndex(idxChunk, sizeof(idxChunk));
+        if (idxLen && out.write(idxChunk, idxLen) != idxLen) {
+            Serial.println("ERROR: Failed writing AVI index");
+            return false;
+        }
+    } while (idxLen > 0);
+
+    // capture times follow the index, in the same frame order
+    uint32_t timeSize = frames * TIME_ENTRY;
+    uint8_t timeHdr[CHUNK_HDR];
+    memcpy(timeHdr, ftimBuf, 4);
+    memcpy(timeHdr + 4, &timeSize, 4);
+    if (out.write(timeHdr, CHUNK_HDR) != CHUNK_HDR || out.write((const uint8_t*)timeBuf, timeSize) != timeSize) {
+        Serial.println("ERROR: Failed writing AVI capture times");
+        return false;
+    }
+    if (!out.flush()) {
+        return false;
+    }
+
+    // frame duration from the real spacing of first to last frame, not the rounded FPS
+    uint32_t usecs = 0;
+    if (frames > 1 && timeBuf[frames - 1] > 0) {
+        usecs = (uint32_t)((uint64_t)timeBuf[frames - 1] * 1000 / (frames - 1));
+    }
+    uint8_t fpsInt = (uint8_t)constrain(lround(actualFPS), 1, 255);
+    buildAviHdr(fpsInt, frameWidth, frameHeight, frames, usecs);
+    file.seek(0, SeekSet); // start of file
+    bool ok = file.write(aviHeader, AVI_HEADER_LEN) == AVI_HEADER_LEN;
+    Serial.printf("AVI finalized: %u frames, %dx%d @ %u FPS, index %u bytes\n",
+                  (unsigned)frames, frameWidth, frameHeight, fpsInt, (unsigned)(frames * IDX_ENTRY + CHUNK_HDR));
+    return ok;
+}
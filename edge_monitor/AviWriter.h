@@ -0,0 +1,85 @@
+#ifndef AVIWRITER_H
+#define AVIWRITER_H
+
+#include "FS.h"
+#include "SDWriteBuffer.h"
+
+/* AVI file format (ported from MJPEG2SD avi.cpp):
+header:
+ 310 bytes
+per jpeg:
+ 4 byte 00dc marker
+ 4 byte jpeg size
+ jpeg frame content
+ 0-3 bytes filler to align on DWORD boundary
+footer:
+ 4 byte idx1 marker
+ 4 byte index size
+ per jpeg:
+  4 byte 00dc marker
+  4 byte 0000
+  4 byte jpeg location
+  4 byte jpeg size
+ 4 byte ftim marker (capture times, skipped by players as an unknown chunk)
+ 4 byte chunk size
+ per jpeg:
+  4 byte ms since the first frame
+*/
+
+#define AVI_HEADER_LEN 310 // AVI header length
+#define CHUNK_HDR 8        // bytes per jpeg hdr in AVI
+#define IDX_ENTRY 16       // bytes per index entry
+#define TIME_ENTRY 4       // bytes per capture time entry
+
+/**
+ * AviWriter - MJPEG AVI container with an idx1 index
+ *
+ * The index is kept in PSRAM while recording and appended at close,
+ * so players (and the ingest server) can seek to frame N directly.
+ * Capture times are kept alongside and written as an ftim chunk after
+ * idx1, so real frame spacing can be checked after the fact.
+ */
+class AviWriter {
+private:
+    uint8_t aviHeader[AVI_HEADER_LEN];
+    uint8_t* idxBuf;
+    uint32_t* timeBuf;
+    uint32_t firstFrameMs;
+    uint32_t maxFrames;
+
+    size_t idxPtr;
+    size_t idxOffset;
+    size_t moviSize;
+    size_t indexLen;
+    uint32_t frameCnt;
+
+public:
+    // Constructor - maxFrames bounds the in-memory index (16 bytes per frame)
+    AviWriter(uint32_t maxFrames = 6000);
+    ~AviWriter();
+
+    // Allocate index buffer
+    bool begin();
+
+    // Low level index / header builders (same roles as in MJPEG2SD avi.cpp)
+    void prepAviIndex();
+    void buildAviHdr(uint8_t FPS, uint16_t frameWidth, uint16_t frameHeight, uint32_t frameCnt, uint32_t usecsPerFrame = 0);
+    bool buildAviIdx(size_t dataSize, uint32_t timestampMs = 0);
+    void finalizeAviIndex(uint32_t frameCnt);
+    size_t writeAviIndex(uint8_t* clientBuf, size_t buffSize);
+
+    // File level helpers used by the recorder, clip data goes through the write buffer
+    bool openAvi(SDWriteBuffer& out);
+    size_t writeFrame(SDWriteBuffer& out, const uint8_t* jpeg, size_t len, uint32_t timestampMs);
+    bool closeAvi(SDWriteBuffer& out, File& file, float actualFPS, uint16_t frameWidth, uint16_t frameHeight);
+
+    // Status
+    uint32_t getFrameCount() const { return frameCnt; }
+    uint32_t getMaxFrames() const { return maxFrames; }
+    bool isIndexFull() const { return frameCnt >= maxFrames; }
+    // File offset the next frame's 00dc chunk will be written at
+    size_t getNextFrameOffset() const { return AVI_HEADER_LEN + moviSize + frameCnt * CHUNK_HDR; }
+    const uint8_t* getHeader() const { return aviHeader; }
+};
+
+#endif // AVIWRITER_H
@@ -0,0 +1,93 @@
+#include "BootSequencer.h"
+
+struct PhaseTaskArg {
+    BootSequencer* sequencer;
+    int id;
+};
+
+BootSequencer::BootSequencer() {
+    this->numPhases = 0;
+    this->allBits = 0;
+    this->done = xEventGroupCreate();
+    this->bootStartMs = 0;
+    this->completeMs = 0;
+}
+
+int BootSequencer::addPhase(const char* name, PhaseFn fn, uint32_t dependsOn, uint32_t stackBytes) {
+    if (numPhases >= MAX_PHASES) {
+        Serial.printf("ERROR: Too many boot phases, %s not added\n", name);
+        return -1;
+    }
+    Phase& p = phases[numPhases];
+    p.name = name;
+    p.fn = fn;
+    p.dependsOn = dependsOn;
+    p.stackBytes = stackBytes;
+    p.state = PHASE_WAITING;
+    p.startMs = 0;
+    p.endMs = 0;
+    allBits |= bit(numPhases);
+    return numPhases++;
+}
+
+const char* BootSequencer::stateName(PhaseState state) {
+    switch (state) {
+        case PHASE_WAITING: return "waiting";
+        case PHASE_RUNNING: return "running";
+        case PHASE_OK: return "ok";
+        default: return "failed";
+    }
+}
+
+bool BootSequencer::start() {
+    bootStartMs = millis();
+    bool ok = true;
+    for (int i = 0; i < numPhases; i++) {
+        PhaseTaskArg* arg = new PhaseTaskArg{this, i};
+        char taskName[16];
+        snprintf(taskName, sizeof(taskName), "boot_%s", phases[i].name);
+        if (xTaskCreatePinnedToCore(phaseTaskEntry, taskName, phases[i].stackBytes, arg,
+                                    PHASE_PRIORITY, NULL, tskNO_AFFINITY) != pdPASS) {
+            // Count it as finished so nothing waits on it forever
+            Serial.printf("ERROR: Failed to create boot task for %s!\n", phases[i].name);
+            delete arg;
+            phases[i].state = PHASE_FAILED;
+            xEventGroupSetBits(done, bit(i));
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void BootSequencer::phaseTaskEntry(void* param) {
+    PhaseTaskArg* arg = (PhaseTaskArg*)param;
+    arg->sequencer->runPhase(arg->id);
+    delete arg;
+    vTaskDelete(NULL);
+}
+
+void BootSequencer::runPhase(int id) {
+    Phase& p = phases[id];
+    if (p.dependsOn) {
+        xEventGroupWaitBits(done, p.dependsOn, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+    p.startMs = millis() - bootStartMs;
+    p.state = PHASE_RUNNING;
+    Serial.printf("BOOT: %s started at %lu ms\n", p.name, p.startMs);
+    bool ok = p.fn();
+    p.endMs = millis() - bootStartMs;
+    p.state = ok ? PHASE_OK : PHASE_FAILED;
+    Serial.printf("BOOT: %s %s after %lu ms\n", p.name, ok ? "ready" : "FAILED", p.endMs - p.startMs);
+
+    EventBits_t bits = xEventGroupSetBits(done, bit(id));
+    if ((bits & allBits) == allBits && completeMs == 0) {
+        completeMs = max(p.endMs, 1UL);
+        Serial.printf("BOOT: all phases finished in %lu ms\n", completeMs);
+    }
+}
+
+bool BootSequencer::waitFor(uint32_t mask, unsigned long timeoutMs) {
+    TickType_t ticks = timeoutMs == 0xFFFFFFFF ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+    EventBits_t bits = xEventGroupWaitBits(done, mask, pdFALSE, pdTRUE, ticks);
+    return (bits & mask) == mask;
+}
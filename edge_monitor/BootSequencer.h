@@ -0,0 +1,73 @@
+#ifndef BOOTSEQUENCER_H
+#define BOOTSEQUENCER_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+
+/**
+ * BootSequencer - runs setup()'s independent stages side by side
+ *
+ * Each phase is a plain bool() function run in its own short-lived task
+ * once every phase it depends on has finished (failed or not - a phase
+ * that needs another one's result checks it itself, e.g. NTP returns
+ * false without WiFi). Completion is an event group bit per phase, so
+ * setup() can wait for just the ones it needs (the camera) and let the
+ * rest - SD indexing, WiFi, NTP - finish behind loop(). Start and end
+ * times of each phase are kept for /status.
+ */
+class BootSequencer {
+public:
+    typedef bool (*PhaseFn)();
+
+    enum PhaseState : uint8_t { PHASE_WAITING, PHASE_RUNNING, PHASE_OK, PHASE_FAILED };
+
+    struct Phase {
+        const char* name;
+        PhaseFn fn;
+        uint32_t dependsOn;         // mask of phase bits
+        uint32_t stackBytes;
+        volatile PhaseState state;
+        unsigned long startMs;      // since boot start
+        unsigned long endMs;
+    };
+
+    static const int MAX_PHASES = 8;
+
+private:
+    static const UBaseType_t PHASE_PRIORITY = 2;
+
+    Phase phases[MAX_PHASES];
+    int numPhases;
+    uint32_t allBits;
+    EventGroupHandle_t done;
+    unsigned long bootStartMs;
+    volatile unsigned long completeMs;
+
+    static void phaseTaskEntry(void* param);
+    void runPhase(int id);
+
+public:
+    BootSequencer();
+
+    // Register a phase before start(); returns its id, bit(id) is its dependency mask
+    int addPhase(const char* name, PhaseFn fn, uint32_t dependsOn = 0, uint32_t stackBytes = 4096);
+    static uint32_t bit(int id) { return 1u << id; }
+
+    // Launch every phase (each waits for its dependencies); false if a task couldn't be created
+    bool start();
+    // Block until all phases in mask have finished; false on timeout
+    bool waitFor(uint32_t mask, unsigned long timeoutMs = 0xFFFFFFFF);
+
+    // Status
+    bool isDone(int id) const { return phases[id].state == PHASE_OK || phases[id].state == PHASE_FAILED; }
+    bool succeeded(int id) const { return phases[id].state == PHASE_OK; }
+    bool isComplete() const { return completeMs != 0; }
+    unsigned long getCompleteMs() const { return completeMs; }
+    int getPhaseCount() const { return numPhases; }
+    const Phase& getPhase(int id) const { return phases[id]; }
+    static const char* stateName(PhaseState state);
+};
+
+#endif // BOOTSEQUENCER_H
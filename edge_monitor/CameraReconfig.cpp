@@ -0,0 +1,127 @@
+#include "CameraReconfig.h"
+
+CameraReconfig::CameraReconfig(int maxFramesize) {
+    this->recorder = NULL;
+    this->maxFramesize = maxFramesize;
+    this->activeProfile = -1;
+    for (int i = 0; i < PROFILE_COUNT; i++) {
+        profiles[i].framesize = maxFramesize;
+        profiles[i].quality = -1;
+    }
+}
+
+void CameraReconfig::setMaxFramesize(int framesize) {
+    maxFramesize = framesize;
+    for (int i = 0; i < PROFILE_COUNT; i++) {
+        profiles[i].framesize = min(profiles[i].framesize, maxFramesize);
+    }
+}
+
+void CameraReconfig::setProfile(ProfileId id, int framesize, int quality) {
+    profiles[id].framesize = min(framesize, maxFramesize);
+    profiles[id].quality = quality;
+}
+
+const char* CameraReconfig::profileName(int id) {
+    switch (id) {
+        case PROFILE_PREVIEW: return "preview";
+        case PROFILE_RECORDING: return "recording";
+        default: return "custom";
+    }
+}
+
+int CameraReconfig::profileFromName(const String& name) {
+    for (int i = 0; i < PROFILE_COUNT; i++) {
+        if (name == profileName(i)) return i;
+    }
+    return -1;
+}
+
+bool CameraReconfig::flushStaleFrames(int framesize) {
+    // Frames already in the driver's buffers were exposed at the old size
+    stats.lastStaleFrames = 0;
+    stats.lastFrameBytes = 0;
+    for (int i = 0; i < MAX_FLUSH_FRAMES; i++) {
+        camera_fb_t* fb = esp_camera_fb_get();
+        if (!fb) {
+            return false;
+        }
+        bool current = fb->width == resolution[framesize].width && fb->height == resolution[framesize].height;
+        size_t len = fb->len;
+        esp_camera_fb_return(fb);
+        if (current) {
+            stats.lastFrameBytes = len;
+            return true;
+        }
+        stats.lastStaleFrames++;
+    }
+    return false;
+}
+
+bool CameraReconfig::apply(int framesize, int quality, String& error) {
+    if (!allows(framesize)) {
+        stats.rejected++;
+        error = "Frame size " + String(framesize) + " is above the allocated maximum " + String(maxFramesize);
+        return false;
+    }
+    sensor_t* s = esp_camera_sensor_get();
+    if (s == NULL || s->pixformat != PIXFORMAT_JPEG) {
+        stats.failures++;
+        error = "Camera not ready";
+        return false;
+    }
+
+    unsigned long startMs = millis();
+    bool resize = s->status.framesize != framesize;
+    if (resize && recorder && !recorder->pauseCapture(PAUSE_TIMEOUT_MS)) {
+        stats.rejected++;
+        error = "Recording in progress, try again between clips";
+        return false;
+    }
+
+    bool ok = true;
+    if (quality >= 0 && s->set_quality(s, quality) != 0) {
+        ok = false;
+        error = "Sensor refused quality " + String(quality);
+    }
+    if (ok && resize) {
+        if (s->set_framesize(s, (framesize_t)framesize) != 0) {
+            ok = false;
+            error = "Sensor refused frame size " + String(framesize);
+        } else if (!flushStaleFrames(framesize)) {
+            ok = false;
+            error = "No frame at the new size";
+        }
+    }
+    if (resize && recorder) {
+        recorder->resumeCapture();
+    }
+
+    uint32_t elapsedMs = millis() - startMs;
+    if (!ok) {
+        stats.failures++;
+        Serial.printf("ERROR: Camera reconfiguration failed: %s\n", error.c_str());
+        return false;
+    }
+    activeProfile = -1;
+    if (resize) {
+        stats.switches++;
+        stats.lastSwitchMs = elapsedMs;
+        if (elapsedMs > stats.maxSwitchMs) stats.maxSwitchMs = elapsedMs;
+        Serial.printf("Camera reconfigured to frame size %d in %u ms (%d stale frames flushed)\n",
+                      framesize, (unsigned)elapsedMs, stats.lastStaleFrames);
+    }
+    return true;
+}
+
+bool CameraReconfig::applyProfile(ProfileId id, String& error) {
+    if (id >= PROFILE_COUNT) {
+        error = "Unknown profile";
+        return false;
+    }
+    if (!apply(profiles[id].framesize, profiles[id].quality, error)) {
+        return false;
+    }
+    activeProfile = id;
+    return true;
+}
@@ -0,0 +1,77 @@
+#ifndef CAMERARECONFIG_H
+#define CAMERARECONFIG_H
+
+#include <Arduino.h>
+#include "esp_camera.h"
+#include "VideoRecorder.h"
+
+/**
+ * CameraReconfig - frame size / quality changes without a camera re-init
+ *
+ * setup() allocates the driver's frame buffers once for maxFramesize,
+ * so any smaller size fits the buffers already there and a change is
+ * sensor only: the capture task is parked between clips, set_framesize
+ * reprograms the sensor, frames still in the buffers from the old size
+ * are thrown away and the task picks up again. No deinit, no PSRAM
+ * churn and no reboot - a switch takes a few hundred ms at most.
+ *
+ * Two profiles let the device swap between a small preview setting and
+ * the full recording setting in one call. Sizes above maxFramesize are
+ * refused, since they'd overrun the buffers.
+ */
+class CameraReconfig {
+public:
+    enum ProfileId : uint8_t { PROFILE_PREVIEW, PROFILE_RECORDING, PROFILE_COUNT };
+
+    struct Profile {
+        int framesize;
+        int quality;
+    };
+
+    struct Stats {
+        uint32_t switches = 0;
+        uint32_t rejected = 0;        // above the allocated maximum, or busy recording
+        uint32_t failures = 0;        // sensor refused, or no frame at the new size
+        uint32_t lastSwitchMs = 0;
+        uint32_t maxSwitchMs = 0;
+        int lastStaleFrames = 0;      // old-size frames flushed after the last switch
+        size_t lastFrameBytes = 0;    // first frame at the new size
+    };
+
+private:
+    static const unsigned long PAUSE_TIMEOUT_MS = 500;
+    static const int MAX_FLUSH_FRAMES = 4;  // driver buffers plus the DMA frame in flight
+
+    VideoRecorder* recorder;
+    int maxFramesize;
+    Profile profiles[PROFILE_COUNT];
+    int activeProfile;              // -1 after a plain frame size change
+    Stats stats;
+
+    bool flushStaleFrames(int framesize);
+
+public:
+    // Constructor - maxFramesize is what setup() sized the frame buffers for
+    CameraReconfig(int maxFramesize);
+
+    void setRecorder(VideoRecorder* recorder) { this->recorder = recorder; }
+    // Buffers ended up smaller than planned (no PSRAM) - profiles are capped to match
+    void setMaxFramesize(int framesize);
+    void setProfile(ProfileId id, int framesize, int quality);
+
+    // Change the frame size with the buffers already allocated; quality < 0 leaves it alone
+    bool apply(int framesize, int quality, String& error);
+    bool applyProfile(ProfileId id, String& error);
+
+    static const char* profileName(int id);
+    static int profileFromName(const String& name);
+
+    // Status
+    int getMaxFramesize() const { return maxFramesize; }
+    bool allows(int framesize) const { return framesize >= 0 && framesize <= maxFramesize; }
+    const Profile& getProfile(ProfileId id) const { return profiles[id]; }
+    int getActiveProfile() const { return activeProfile; }
+    const Stats& getStats() const { return stats; }
+};
+
+#endif // CAMERARECONFIG_H
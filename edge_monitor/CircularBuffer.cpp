@@ -1,9 +1,23 @@
 #include "CircularBuffer.h"
+#include "ClipSidecar.h"
+#include "ClipPreview.h"
+#include <algorithm>
+
+static const unsigned long MAINTAIN_INTERVAL_MS = 200;     // between eviction steps
+static const unsigned long FREE_REFRESH_MS = 10000;        // SD free space query while idle
 
 CircularBuffer::CircularBuffer(long maxStorageMB, long minFreeSpaceMB, bool enableCircularBuffer) {
     this->maxStorageMB = maxStorageMB;
     this->minFreeSpaceMB = minFreeSpaceMB;
     this->enableCircularBuffer = enableCircularBuffer;
+    this->indexedBytes = 0;
+    this->indexBuilt = false;
+    this->indexLock = xSemaphoreCreateMutex();
+    this->headroomMB = 0;
+    this->cachedFreeBytes = 0;
+    this->freeKnown = false;
+    this->freeCheckedMs = 0;
+    this->nextMaintainMs = 0;
 }
 
 void CircularBuffer::printStorageInfo() {
@@ -12,147 +26,285 @@ void CircularBuffer::printStorageInfo() {
     uint64_t usedBytes = SD.usedBytes() / (1024 * 1024);
     uint64_t freeBytes = (SD.totalBytes() - SD.usedBytes()) / (1024 * 1024);
     
-    Serial.printf("SD Card Size: %lluMB\n", cardSize);
-    Serial.printf("Total Space: %lluMB\n", totalBytes);
-    Serial.printf("Used Space: %lluMB\n", usedBytes);
-    Serial.printf("Free Space: %lluMB\n", freeBytes);
+    Serial.printf("SD Card Size: %" PRIu64 "MB\n", cardSize);
+    Serial.printf("Total Space: %" PRIu64 "MB\n", totalBytes);
+    Serial.printf("Used Space: %" PRIu64 "MB\n", usedBytes);
+    Serial.printf("Free Space: %" PRIu64 "MB\n", freeBytes);
     Serial.printf("Reserved for Videos: %ldMB\n", maxStorageMB);
     Serial.printf("Min Free Space: %ldMB\n", minFreeSpaceMB);
 }
 
-String CircularBuffer::getOldestVideoFile() {
-    File root = SD.open("/");
-    File file = root.openNextFile();
-    String oldestFile = "";
-    time_t oldestTime = 0;
-    bool foundFirst = false;
+void CircularBuffer::ensureIndex() {
+    if (!indexBuilt) {
+        rebuildIndex();
+    }
+}
+
+void CircularBuffer::rebuildIndex() {
+    unsigned long startMs = millis();
+    std::deque<VideoFileEntry> entries;
+    uint64_t totalSize = 0;
     
-    while (file) {
-        String fileName = file.name();
-        // Check for both old format (video*.avi) and new timestamp format (*.avi)
-        if (fileName.endsWith(".avi")) {
-            time_t fileTime = file.getLastWrite();
-            if (!foundFirst || fileTime < oldestTime) {
-                oldestTime = fileTime;
-                oldestFile = "/" + fileName;
-                foundFirst = true;
+    File root = SD.open("/");
+    if (root) {
+        File file = root.openNextFile();
+        while (file) {
+            String fileName = file.name();
+            // Index both old format (video*.avi) and new timestamp format (*.avi)
+            if (!file.isDirectory() && fileName.endsWith(".avi")) {
+                VideoFileEntry entry;
+                entry.path = "/" + fileName;
+                entry.size = file.size();
+                entry.mtime = file.getLastWrite();
+                entries.push_back(entry);
+                totalSize += entry.size;
             }
+            file.close();
+            file = root.openNextFile();
         }
-        file = root.openNextFile();
+        root.close();
     }
-    root.close();
-    return oldestFile;
+    
+    // Oldest first; stable so files with equal (unset clock) times keep directory order
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const VideoFileEntry& a, const VideoFileEntry& b) { return a.mtime < b.mtime; });
+    
+    xSemaphoreTake(indexLock, portMAX_DELAY);
+    videoIndex.swap(entries);
+    indexedBytes = totalSize;
+    indexBuilt = true;
+    xSemaphoreGive(indexLock);
+    
+    Serial.printf("Storage index built: %zu videos, %.2fMB (%lu ms)\n",
+                  videoIndex.size(), totalSize / (1024.0 * 1024.0), millis() - startMs);
 }
 
-int CircularBuffer::countVideoFiles() {
-    File root = SD.open("/");
-    File file = root.openNextFile();
-    int count = 0;
-    
-    while (file) {
-        String fileName = file.name();
-        // Count all .avi files regardless of naming format
-        if (fileName.endsWith(".avi")) {
-            count++;
+void CircularBuffer::addVideoFile(const String& path, size_t size, time_t mtime) {
+    if (!path.endsWith(".avi")) {
+        return;
+    }
+    ensureIndex();
+    xSemaphoreTake(indexLock, portMAX_DELAY);
+    // Replace an existing entry for the same file
+    for (auto it = videoIndex.begin(); it != videoIndex.end(); ++it) {
+        if (it->path == path) {
+            indexedBytes -= it->size;
+            videoIndex.erase(it);
+            break;
         }
-        file = root.openNextFile();
     }
-    root.close();
-    return count;
+    VideoFileEntry entry;
+    entry.path = path;
+    entry.size = size;
+    entry.mtime = mtime;
+    // Pooled clips were already counted when the pool grew - the next refresh corrects it
+    cachedFreeBytes = cachedFreeBytes > size ? cachedFreeBytes - size : 0;
+    // New recordings are normally the newest, so this is usually an append
+    auto pos = videoIndex.end();
+    while (pos != videoIndex.begin() && (pos - 1)->mtime > mtime) {
+        --pos;
+    }
+    videoIndex.insert(pos, entry);
+    indexedBytes += size;
+    xSemaphoreGive(indexLock);
 }
 
-uint64_t CircularBuffer::getVideoStorageUsed() {
-    File root = SD.open("/");
-    File file = root.openNextFile();
-    uint64_t totalSize = 0;
-    
-    while (file) {
-        String fileName = file.name();
-        // Count all .avi files regardless of naming format
-        if (fileName.endsWith(".avi")) {
-            totalSize += file.size();
+void CircularBuffer::removeVideoFile(const String& path) {
+    if (!indexBuilt) {
+        return; // Nothing indexed yet, the first rebuild will see the current card
+    }
+    xSemaphoreTake(indexLock, portMAX_DELAY);
+    // Deletions are normally the oldest (eviction) or just-uploaded files, search from the front
+    for (auto it = videoIndex.begin(); it != videoIndex.end(); ++it) {
+        if (it->path == path) {
+            indexedBytes -= it->size;
+            videoIndex.erase(it);
+            break;
         }
-        file = root.openNextFile();
     }
-    root.close();
-    return totalSize;
+    xSemaphoreGive(indexLock);
+}
+
+String CircularBuffer::getOldestVideoFile(const String& exclude) {
+    ensureIndex();
+    xSemaphoreTake(indexLock, portMAX_DELAY);
+    String oldestFile = "";
+    for (const VideoFileEntry& entry : videoIndex) {
+        if (entry.path != exclude) {
+            oldestFile = entry.path;
+            break;
+        }
+    }
+    xSemaphoreGive(indexLock);
+    return oldestFile;
+}
+
+bool CircularBuffer::getVideoFilesPage(const VideoFileEntry* cursor, size_t maxCount, std::vector<VideoFileEntry>& page) {
+    ensureIndex();
+    page.clear();
+    page.reserve(maxCount);
+    xSemaphoreTake(indexLock, portMAX_DELAY);
+    // Index is oldest first, so walk back from the newest - or from the cursor entry
+    auto it = videoIndex.end();
+    if (cursor != NULL) {
+        it = std::lower_bound(videoIndex.begin(), videoIndex.end(), cursor->mtime,
+                              [](const VideoFileEntry& e, time_t t) { return e.mtime < t; });
+        // Equal times keep directory order; if the cursor file was evicted, restart below its time
+        for (auto tie = it; tie != videoIndex.end() && tie->mtime == cursor->mtime; ++tie) {
+            if (tie->path == cursor->path) {
+                it = tie;
+                break;
+            }
+        }
+    }
+    while (it != videoIndex.begin() && page.size() < maxCount) {
+        --it;
+        page.push_back(*it);
+    }
+    bool more = it != videoIndex.begin();
+    xSemaphoreGive(indexLock);
+    return more;
+}
+
+bool CircularBuffer::getVideoFilesInRange(time_t from, time_t to, size_t maxCount, std::vector<VideoFileEntry>& range) {
+    ensureIndex();
+    range.clear();
+    xSemaphoreTake(indexLock, portMAX_DELAY);
+    // Clips don't overlap, so only the first one closed after 'to' can still start before it
+    auto it = std::lower_bound(videoIndex.begin(), videoIndex.end(), from,
+                               [](const VideoFileEntry& e, time_t t) { return e.mtime < t; });
+    bool pastEnd = false;
+    while (it != videoIndex.end() && !pastEnd && range.size() < maxCount) {
+        pastEnd = to > 0 && it->mtime > to;
+        range.push_back(*it);
+        ++it;
+    }
+    bool more = !pastEnd && it != videoIndex.end();
+    xSemaphoreGive(indexLock);
+    return more;
+}
+
+int CircularBuffer::countVideoFiles() {
+    ensureIndex();
+    return videoIndex.size();
+}
+
+uint64_t CircularBuffer::getVideoStorageUsed() {
+    ensureIndex();
+    return indexedBytes;
 }
 
 bool CircularBuffer::checkAndManageStorage() {
-    std::vector<String> emptyQueue;
-    return checkAndManageStorage(emptyQueue);
+    return checkAndManageStorage(NULL);
 }
 
-bool CircularBuffer::checkAndManageStorage(std::vector<String>& uploadQueue) {
-    if (!enableCircularBuffer) {
-        return true; // Skip storage management if disabled
+uint64_t CircularBuffer::getFreeBytes(bool refresh) {
+    if (refresh || !freeKnown) {
+        uint64_t freeBytes = SD.totalBytes() - SD.usedBytes();
+        xSemaphoreTake(indexLock, portMAX_DELAY);
+        cachedFreeBytes = freeBytes;
+        xSemaphoreGive(indexLock);
+        freeKnown = true;
+        freeCheckedMs = millis();
+    }
+    return cachedFreeBytes;
+}
+
+bool CircularBuffer::needsEviction(long extraMB) {
+    uint64_t freeMB = getFreeBytes(false) / (1024 * 1024);
+    uint64_t videoMB = getVideoStorageUsed() / (1024 * 1024);
+    return freeMB < (uint64_t)(minFreeSpaceMB + extraMB) || (long)videoMB + extraMB > maxStorageMB;
+}
+
+bool CircularBuffer::evictOldest(UploadJournal* uploadJournal, const String& inUseFile) {
+    uint32_t startMs = millis();
+    // Oldest entry is at the front (or just behind the in-use file) - no search
+    VideoFileEntry oldest;
+    bool found = false;
+    xSemaphoreTake(indexLock, portMAX_DELAY);
+    for (const VideoFileEntry& entry : videoIndex) {
+        if (entry.path != inUseFile) {
+            oldest = entry;
+            found = true;
+            break;
+        }
+    }
+    xSemaphoreGive(indexLock);
+    if (!found) {
+        Serial.println("No video files found to delete!");
+        return false;
     }
     
-    uint64_t freeSpaceMB = (SD.totalBytes() - SD.usedBytes()) / (1024 * 1024);
-    uint64_t videoStorageMB = getVideoStorageUsed() / (1024 * 1024);
-    
-    Serial.printf("Current free space: %lluMB\n", freeSpaceMB);
-    Serial.printf("Video storage used: %lluMB\n", videoStorageMB);
-    
-    // Check if we need to free up space
-    bool needCleanup = false;
+    // Remove from upload queue if present
+    if (uploadJournal && uploadJournal->drop(oldest.path)) {
+        Serial.printf("Removed from upload queue: %s\n", oldest.path.c_str());
+    }
+    if (uploadJournal) uploadJournal->drop(ClipPreview::pathFor(oldest.path));
     
-    // Check 1: Free space is below minimum
-    if (freeSpaceMB < minFreeSpaceMB) {
-        Serial.println("Free space below minimum threshold!");
-        needCleanup = true;
+    size_t freed = oldest.size;
+    if (SD.remove(oldest.path.c_str())) {
+        Serial.printf("Deleted oldest video: %s (%.2fMB)\n", oldest.path.c_str(), freed / (1024.0 * 1024.0));
+    } else if (!SD.exists(oldest.path.c_str())) {
+        // Stale index entry (file removed behind our back) - drop it and carry on
+        Serial.printf("Index entry already gone from card: %s\n", oldest.path.c_str());
+        freed = 0;
+    } else {
+        Serial.printf("Failed to delete: %s\n", oldest.path.c_str());
+        return false;
     }
+    removeVideoFile(oldest.path);
+    ClipSidecar::remove(oldest.path);
+    ClipPreview::remove(oldest.path);
     
-    // Check 2: Video storage exceeds maximum allocation
-    if (videoStorageMB > maxStorageMB) {
-        Serial.println("Video storage exceeds maximum allocation!");
-        needCleanup = true;
+    // Free space follows from the freed size instead of asking the card again
+    xSemaphoreTake(indexLock, portMAX_DELAY);
+    cachedFreeBytes += freed;
+    xSemaphoreGive(indexLock);
+    stats.evicted++;
+    stats.evictedBytes += freed;
+    stats.lastEvictMs = millis() - startMs;
+    if (stats.lastEvictMs > stats.maxEvictMs) stats.maxEvictMs = stats.lastEvictMs;
+    return true;
+}
+
+bool CircularBuffer::maintain(UploadJournal* uploadJournal, const String& inUseFile) {
+    unsigned long now = millis();
+    if (!enableCircularBuffer || !indexBuilt || (long)(now - nextMaintainMs) < 0) {
+        return false;
+    }
+    nextMaintainMs = now + MAINTAIN_INTERVAL_MS;
+    getFreeBytes(!freeKnown || now - freeCheckedMs >= FREE_REFRESH_MS);
+    if (!needsEviction(headroomMB) || countVideoFiles() <= 1) { // Keep at least 1 video file
+        return false;
+    }
+    return evictOldest(uploadJournal, inUseFile);
+}
+
+bool CircularBuffer::checkAndManageStorage(UploadJournal* uploadJournal, const String& inUseFile) {
+    if (!enableCircularBuffer) {
+        return true; // Skip storage management if disabled
     }
+    uint32_t startMs = millis();
+    ensureIndex();
     
-    // Perform cleanup if needed
+    // Cached numbers - maintain() has normally made room and refreshed them already
+    getFreeBytes(millis() - freeCheckedMs >= FREE_REFRESH_MS);
+    bool needCleanup = needsEviction(0);
+    if (needCleanup) {
+        Serial.printf("Storage limits reached at recording start (free %" PRIu64 "MB, video %" PRIu64 "MB), evicting now\n",
+                      getFreeBytes(false) / (1024 * 1024), getVideoStorageUsed() / (1024 * 1024));
+    }
     while (needCleanup && countVideoFiles() > 1) { // Keep at least 1 video file
-        String oldestFile = getOldestVideoFile();
-        if (oldestFile.length() == 0) {
-            Serial.println("No video files found to delete!");
-            break;
-        }
-        
-        // Remove from upload queue if present
-        for (auto it = uploadQueue.begin(); it != uploadQueue.end(); ++it) {
-            if (*it == oldestFile) {
-                uploadQueue.erase(it);
-                Serial.printf("Removed from upload queue: %s\n", oldestFile.c_str());
-                break;
-            }
-        }
-        
-        // Get file size before deletion for reporting
-        File file = SD.open(oldestFile.c_str());
-        size_t fileSize = 0;
-        if (file) {
-            fileSize = file.size();
-            file.close();
-        }
-        
-        // Delete the oldest video file
-        if (SD.remove(oldestFile.c_str())) {
-            Serial.printf("Deleted oldest video: %s (%.2fMB)\n", oldestFile.c_str(), fileSize / (1024.0 * 1024.0));
-        } else {
-            Serial.printf("Failed to delete: %s\n", oldestFile.c_str());
+        if (!evictOldest(uploadJournal, inUseFile)) {
             break; // Exit if we can't delete files
         }
-        
-        // Recalculate storage usage
-        freeSpaceMB = (SD.totalBytes() - SD.usedBytes()) / (1024 * 1024);
-        videoStorageMB = getVideoStorageUsed() / (1024 * 1024);
-        
-        // Check if cleanup is still needed
-        needCleanup = (freeSpaceMB < minFreeSpaceMB) || (videoStorageMB > maxStorageMB);
+        stats.syncEvictions++;
+        needCleanup = needsEviction(0);
     }
     
-    Serial.printf("After cleanup - Free space: %lluMB, Video storage: %lluMB\n", 
-                  freeSpaceMB, videoStorageMB);
+    stats.lastCheckMs = millis() - startMs;
+    if (stats.lastCheckMs > stats.maxCheckMs) stats.maxCheckMs = stats.lastCheckMs;
     
     // Return false if we still don't have enough space
-    return (freeSpaceMB >= minFreeSpaceMB);
-} 
\ No newline at end of file
+    return getFreeBytes(false) / (1024 * 1024) >= (uint64_t)minFreeSpaceMB;
+}
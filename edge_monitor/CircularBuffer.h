@@ -4,36 +4,111 @@
 #include "FS.h"
 #include "SD.h"
 #include <vector>
+#include <deque>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "UploadJournal.h"
 
+// One recorded clip in the storage index
+struct VideoFileEntry {
+    String path;
+    size_t size;
+    time_t mtime;
+};
+
+/**
+ * CircularBuffer - keeps video storage within limits by evicting the oldest clips
+ *
+ * A RAM index of the .avi files (sorted oldest first) is built with one
+ * directory walk at boot and then kept current via addVideoFile() and
+ * removeVideoFile(), so storage checks never have to rescan the card.
+ *
+ * Eviction normally happens in maintain(), one clip per call from loop()
+ * while the card is idle, until free space is headroomMB above the floor
+ * and video storage headroomMB below its cap. checkAndManageStorage() at
+ * recording start then only compares cached numbers, and only evicts
+ * itself (counted as syncEvictions) if maintain() fell behind.
+ */
 class CircularBuffer {
+public:
+    struct Stats {
+        uint32_t evicted = 0;
+        uint64_t evictedBytes = 0;
+        uint32_t syncEvictions = 0;     // done at recording start because maintain() fell behind
+        uint32_t lastEvictMs = 0;       // one clip + sidecar + preview removed
+        uint32_t maxEvictMs = 0;
+        uint32_t lastCheckMs = 0;       // checkAndManageStorage() at recording start
+        uint32_t maxCheckMs = 0;
+    };
+
 private:
     long maxStorageMB;
     long minFreeSpaceMB;
     bool enableCircularBuffer;
     
+    // Storage index
+    std::deque<VideoFileEntry> videoIndex;
+    uint64_t indexedBytes;
+    bool indexBuilt;
+    SemaphoreHandle_t indexLock;
+    
+    // Background eviction
+    long headroomMB;
+    uint64_t cachedFreeBytes;       // card free space, refreshed by maintain() and adjusted in between
+    bool freeKnown;
+    unsigned long freeCheckedMs;
+    unsigned long nextMaintainMs;
+    Stats stats;
+    
+    void ensureIndex();
+    uint64_t getFreeBytes(bool refresh);
+    bool needsEviction(long extraMB);
+    // Delete the oldest clip (never inUseFile) with its sidecar and preview; false if none could go
+    bool evictOldest(UploadJournal* uploadJournal, const String& inUseFile);
+    
 public:
     // Constructor
     CircularBuffer(long maxStorageMB = 24, long minFreeSpaceMB = 1, bool enableCircularBuffer = true);
     
+    // Storage index maintenance
+    void rebuildIndex();                     // Full directory walk - call once after SD init
+    void addVideoFile(const String& path, size_t size, time_t mtime);
+    void removeVideoFile(const String& path);
+    
     // Storage information methods
     void printStorageInfo();
     uint64_t getVideoStorageUsed();
     int countVideoFiles();
-    String getOldestVideoFile();
+    String getOldestVideoFile(const String& exclude = "");
+    // Newest first page of up to maxCount clips older than the cursor entry (NULL = from the newest);
+    // returns true if older clips remain
+    bool getVideoFilesPage(const VideoFileEntry* cursor, size_t maxCount, std::vector<VideoFileEntry>& page);
+    // Oldest first, up to maxCount clips that may hold frames between from and to (unix seconds, 0 = open):
+    // every clip closed at or after from, through the first one closed after to; returns true if more remain
+    bool getVideoFilesInRange(time_t from, time_t to, size_t maxCount, std::vector<VideoFileEntry>& range);
     
     // Storage management methods
     bool checkAndManageStorage();
-    bool checkAndManageStorage(std::vector<String>& uploadQueue); // Version that can modify upload queue
+    // Version that drops evicted clips from the upload journal; inUseFile (e.g. the file being uploaded) is never evicted
+    bool checkAndManageStorage(UploadJournal* uploadJournal, const String& inUseFile = "");
+    // One background eviction step - call from loop() while the card is idle; true if a clip went
+    bool maintain(UploadJournal* uploadJournal, const String& inUseFile = "");
     
     // Configuration methods
     void setMaxStorageMB(long maxMB) { maxStorageMB = maxMB; }
     void setMinFreeSpaceMB(long minMB) { minFreeSpaceMB = minMB; }
+    // Space maintain() keeps beyond both limits, about one clip
+    void setHeadroomMB(long mb) { headroomMB = max(mb, 0L); }
     void setCircularBufferEnabled(bool enabled) { enableCircularBuffer = enabled; }
     
     // Getters
     long getMaxStorageMB() const { return maxStorageMB; }
     long getMinFreeSpaceMB() const { return minFreeSpaceMB; }
     bool isCircularBufferEnabled() const { return enableCircularBuffer; }
+    long getHeadroomMB() const { return headroomMB; }
+    // Last known card free space, without touching the card
+    uint64_t getCachedFreeBytes() const { return cachedFreeBytes; }
+    const Stats& getStats() const { return stats; }
 };
 
 #endif // CIRCULARBUFFER_H 
\ No newline at end of file
@@ -0,0 +1,244 @@
+#include "ClipCatchup.h"
+#include "HeapAccounting.h"
+
+static const uint8_t idx1Tag[4] = {0x69, 0x64, 0x78, 0x31}; // idx1
+static const uint8_t ftimTag[4] = {0x66, 0x74, 0x69, 0x6D}; // ftim
+static const size_t MOVI_START = AVI_HEADER_LEN - 4;        // idx1 offsets count from the movi tag
+static const uint32_t CLIP_FIXED_LEN = 20;                  // CLIP payload before the name
+static const uint32_t FRAME_FIXED_LEN = 8;                  // FRAM payload before the jpeg
+
+ClipCatchup::ClipCatchup(size_t bufferSize) {
+    this->bufferSize = max(bufferSize, (size_t)1024);
+    this->buf = NULL;
+    this->bufLen = 0;
+    this->sink = NULL;
+    this->sinkCtx = NULL;
+    this->sinkOk = false;
+    this->lock = xSemaphoreCreateMutex();
+    this->sessionStartMs = 0;
+    this->sessionBytes = 0;
+    this->sessionMediaMs = 0;
+    this->sessionClips = 0;
+    this->sessionFrames = 0;
+}
+
+ClipCatchup::~ClipCatchup() {
+    heapUpload.release(buf);
+    if (lock) vSemaphoreDelete(lock);
+}
+
+bool ClipCatchup::begin() {
+    if (buf == NULL) {
+        buf = (uint8_t*)heapUpload.allocPreferPsram(bufferSize);
+        if (buf == NULL) {
+            Serial.println("ERROR: Failed to allocate catch-up buffer");
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ClipCatchup::flush() {
+    if (bufLen > 0 && sinkOk) {
+        sinkOk = sink(sinkCtx, buf, bufLen);
+        sessionBytes += bufLen;
+    }
+    bufLen = 0;
+    return sinkOk;
+}
+
+bool ClipCatchup::put(const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    while (len > 0 && sinkOk) {
+        if (bufLen == bufferSize && !flush()) {
+            break;
+        }
+        size_t n = min(len, bufferSize - bufLen);
+        memcpy(buf + bufLen, p, n);
+        bufLen += n;
+        p += n;
+        len -= n;
+    }
+    return sinkOk;
+}
+
+bool ClipCatchup::putRecordHeader(const char* tag, uint32_t payloadLen) {
+    uint8_t hdr[CATCHUP_RECORD_HDR];
+    memcpy(hdr, tag, 4);
+    memcpy(hdr + 4, &payloadLen, 4);
+    return put(hdr, CATCHUP_RECORD_HDR);
+}
+
+bool ClipCatchup::putFromFile(File& file, size_t len) {
+    // Card straight into the send buffer, no per-frame copy
+    while (len > 0 && sinkOk) {
+        if (bufLen == bufferSize && !flush()) {
+            break;
+        }
+        size_t n = file.read(buf + bufLen, min(len, bufferSize - bufLen));
+        if (n == 0) {
+            return false;
+        }
+        bufLen += n;
+        len -= n;
+    }
+    return sinkOk;
+}
+
+bool ClipCatchup::startSession(CatchupSink sink, void* ctx) {
+    if (buf == NULL || lock == NULL || xSemaphoreTake(lock, 0) != pdTRUE) {
+        stats.busy++;
+        return false;
+    }
+    this->sink = sink;
+    this->sinkCtx = ctx;
+    this->sinkOk = true;
+    bufLen = 0;
+    sessionStartMs = millis();
+    sessionBytes = 0;
+    sessionMediaMs = 0;
+    sessionClips = 0;
+    sessionFrames = 0;
+    stats.sessions++;
+    return true;
+}
+
+bool ClipCatchup::sendClip(const String& path, time_t mtime, uint32_t firstFrame, int64_t fromMs, int64_t toMs) {
+    File clip = SD.open(path.c_str(), FILE_READ);
+    File index = SD.open(path.c_str(), FILE_READ);
+    if (!clip || !index) {
+        if (clip) clip.close();
+        if (index) index.close();
+        Serial.printf("WARNING: Catch-up can't open %s\n", path.c_str());
+        stats.failures++;
+        return sinkOk;
+    }
+
+    uint8_t hdr[AVI_HEADER_LEN];
+    uint32_t usecs = 0, frames = 0, dataSize = 0;
+    uint16_t width = 0, height = 0;
+    if (clip.read(hdr, AVI_HEADER_LEN) == AVI_HEADER_LEN) {
+        memcpy(&usecs, hdr + 0x20, 4);
+        memcpy(&frames, hdr + 0x30, 4);
+        memcpy(&width, hdr + 0x40, 2);
+        memcpy(&height, hdr + 0x44, 2);
+        memcpy(&dataSize, hdr + 0x12E, 4);
+    }
+    uint8_t tag[CHUNK_HDR];
+    size_t idxPos = MOVI_START + dataSize;
+    if (frames == 0 || !index.seek(idxPos, SeekSet) || index.read(tag, CHUNK_HDR) != CHUNK_HDR ||
+        memcmp(tag, idx1Tag, 4) != 0) {
+        // Still recording, or cut short by a power loss
+        Serial.printf("WARNING: Catch-up skipped %s, no idx1 index\n", path.c_str());
+        clip.close();
+        index.close();
+        stats.failures++;
+        return sinkOk;
+    }
+    size_t timePos = idxPos + CHUNK_HDR + (size_t)frames * IDX_ENTRY;
+    bool haveTimes = index.seek(timePos, SeekSet) && index.read(tag, CHUNK_HDR) == CHUNK_HDR &&
+                     memcmp(tag, ftimTag, 4) == 0;
+
+    // The file time is when the clip closed, i.e. its last frame
+    uint32_t lastMs = (uint32_t)((uint64_t)(frames - 1) * usecs / 1000);
+    if (haveTimes && index.seek(timePos + CHUNK_HDR + (size_t)(frames - 1) * TIME_ENTRY, SeekSet)) {
+        index.read((uint8_t*)&lastMs, TIME_ENTRY);
+    }
+    int64_t startMs = (int64_t)mtime * 1000 - lastMs;
+
+    const char* name = path.c_str() + (path.startsWith("/") ? 1 : 0);
+    uint32_t nameLen = strlen(name);
+    bool announced = false;
+    bool ok = true;
+    uint32_t sent = 0;
+    uint32_t firstSentMs = 0, lastSentMs = 0;
+    uint8_t entries[INDEX_BATCH * IDX_ENTRY];
+    uint32_t times[INDEX_BATCH];
+    for (uint32_t batch = firstFrame; batch < frames && ok && sinkOk; batch += INDEX_BATCH) {
+        int count = min((uint32_t)INDEX_BATCH, frames - batch);
+        if (!index.seek(idxPos + CHUNK_HDR + (size_t)batch * IDX_ENTRY, SeekSet) ||
+            index.read(entries, count * IDX_ENTRY) != (size_t)count * IDX_ENTRY) {
+            ok = false;
+            break;
+        }
+        if (!haveTimes || !index.seek(timePos + CHUNK_HDR + (size_t)batch * TIME_ENTRY, SeekSet) ||
+            index.read((uint8_t*)times, count * TIME_ENTRY) != (size_t)count * TIME_ENTRY) {
+            for (int i = 0; i < count; i++) {
+                times[i] = (uint32_t)((uint64_t)(batch + i) * usecs / 1000);
+            }
+        }
+        for (int i = 0; i < count && sinkOk; i++) {
+            int64_t wallMs = startMs + times[i];
+            if ((fromMs > 0 && wallMs < fromMs) || (toMs > 0 && wallMs >= toMs)) {
+                continue;
+            }
+            uint32_t offset, len;
+            memcpy(&offset, entries + i * IDX_ENTRY + 8, 4);
+            memcpy(&len, entries + i * IDX_ENTRY + 12, 4);
+            if (!announced) {
+                putRecordHeader("CLIP", CLIP_FIXED_LEN + nameLen);
+                uint8_t info[CLIP_FIXED_LEN];
+                memcpy(info, &frames, 4);
+                memcpy(info + 4, &width, 2);
+                memcpy(info + 6, &height, 2);
+                memcpy(info + 8, &usecs, 4);
+                memcpy(info + 12, &startMs, 8);
+                put(info, CLIP_FIXED_LEN);
+                put(name, nameLen);
+                announced = true;
+                firstSentMs = times[i];
+            }
+            uint32_t frameNo = batch + i;
+            putRecordHeader("FRAM", FRAME_FIXED_LEN + len);
+            put(&frameNo, 4);
+            put(&times[i], 4);
+            if (!clip.seek(MOVI_START + offset + CHUNK_HDR, SeekSet) || !putFromFile(clip, len)) {
+                ok = false;
+                break;
+            }
+            lastSentMs = times[i];
+            sent++;
+        }
+        vTaskDelay(1); // Let the other core 0 tasks in between batches
+    }
+    clip.close();
+    index.close();
+
+    if (!ok && sinkOk) {
+        // Mid-frame with the record length already sent - the stream can't continue
+        Serial.printf("ERROR: Catch-up read failed in %s\n", path.c_str());
+        sinkOk = false;
+    }
+    if (!sinkOk) {
+        stats.failures++;
+        return false;
+    }
+    if (announced) {
+        sessionClips++;
+        sessionFrames += sent;
+        sessionMediaMs += lastSentMs - firstSentMs + usecs / 1000;
+        stats.clips++;
+        stats.frames += sent;
+    }
+    return true;
+}
+
+bool ClipCatchup::finishSession(bool more) {
+    if (sinkOk) {
+        uint32_t done[3] = {sessionClips, sessionFrames, more ? 1u : 0u};
+        putRecordHeader("DONE", sizeof(done));
+        put(done, sizeof(done));
+        flush();
+    }
+    bool ok = sinkOk;
+    stats.bytes += sessionBytes;
+    stats.lastSessionMs = millis() - sessionStartMs;
+    uint32_t elapsed = max(stats.lastSessionMs, (uint32_t)1);
+    stats.lastKBps = (uint32_t)(sessionBytes / elapsed); // bytes per ms ~ KB/s
+    stats.lastRealtimeFactor = (float)sessionMediaMs / elapsed;
+    sink = NULL;
+    sinkCtx = NULL;
+    sinkOk = false;
+    xSemaphoreGive(lock);
+    return ok;
+}
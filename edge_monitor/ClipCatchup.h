@@ -0,0 +1,110 @@
+#ifndef CLIPCATCHUP_H
+#define CLIPCATCHUP_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "SD.h"
+#include "AviWriter.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+/* Catch-up stream format (little endian, RIFF style records):
+per clip (only clips with at least one frame in range):
+ 4 byte CLIP marker
+ 4 byte payload size
+  4 byte frames in the clip
+  2 byte width, 2 byte height
+  4 byte usecs per frame (AVI header)
+  8 byte unix ms of the clip's first frame (from the file time, to the second)
+  clip file name, no terminator
+per frame:
+ 4 byte FRAM marker
+ 4 byte payload size
+  4 byte frame number in the clip (idx1 position)
+  4 byte ms since the clip's first frame (ftim)
+  jpeg frame content
+end of stream:
+ 4 byte DONE marker
+ 4 byte payload size (12)
+  4 byte clips sent, 4 byte frames sent
+  4 byte 1 when the clip limit cut the range short
+*/
+
+#define CATCHUP_RECORD_HDR 8
+
+// Output callback for a catch-up session, returns false to stop
+typedef bool (*CatchupSink)(void* ctx, const uint8_t* data, size_t len);
+
+/**
+ * ClipCatchup - streams recorded frames as fast as the card and link allow
+ *
+ * Paced playback spends a clip's real duration on it; the server syncing a
+ * backlog only needs the frames. A session walks each clip's idx1 (and the
+ * ftim capture times) from a second file handle, so both handles only ever
+ * read forward, and copies the JPEGs straight from the card into one
+ * coalescing buffer that is handed to the sink whenever it fills.
+ *
+ * Frames can be selected by frame number (resume a clip part way) and by
+ * wall clock time, which lets a range of recordings go out as one stream.
+ * One session at a time, since the buffer is shared.
+ */
+class ClipCatchup {
+public:
+    struct Stats {
+        uint32_t sessions = 0;
+        uint32_t busy = 0;            // refused, another session was running
+        uint32_t clips = 0;
+        uint32_t frames = 0;
+        uint32_t failures = 0;        // clips without a readable index, or a sink that gave up
+        uint64_t bytes = 0;
+        uint32_t lastSessionMs = 0;
+        uint32_t lastKBps = 0;
+        float lastRealtimeFactor = 0; // recorded duration sent / time taken
+    };
+
+private:
+    static const int INDEX_BATCH = 32;
+
+    size_t bufferSize;
+    uint8_t* buf;
+    size_t bufLen;
+    CatchupSink sink;
+    void* sinkCtx;
+    bool sinkOk;
+    SemaphoreHandle_t lock;
+
+    // Current session
+    unsigned long sessionStartMs;
+    uint64_t sessionBytes;
+    uint64_t sessionMediaMs;
+    uint32_t sessionClips;
+    uint32_t sessionFrames;
+    Stats stats;
+
+    bool put(const void* data, size_t len);
+    bool putRecordHeader(const char* tag, uint32_t payloadLen);
+    bool putFromFile(File& file, size_t len);
+    bool flush();
+
+public:
+    // Constructor - bufferSize is the sink's chunk size
+    ClipCatchup(size_t bufferSize = 32 * 1024);
+    ~ClipCatchup();
+
+    // Allocate the send buffer
+    bool begin();
+
+    // Session - false when another one is running (or begin() failed)
+    bool startSession(CatchupSink sink, void* ctx);
+    // Frames firstFrame.. of the clip at path whose wall clock time falls in [fromMs, toMs) (0 = open);
+    // mtime is the clip's file time. False when the sink failed - end the session
+    bool sendClip(const String& path, time_t mtime, uint32_t firstFrame = 0, int64_t fromMs = 0, int64_t toMs = 0);
+    // Writes DONE and releases the session
+    bool finishSession(bool more);
+
+    bool isActive() const { return sink != NULL; }
+    uint32_t getSessionFrames() const { return sessionFrames; }
+    const Stats& getStats() const { return stats; }
+};
+
+#endif // CLIPCATCHUP_H
@@ -0,0 +1,181 @@
+#include "ClipPool.h"
+#include <unistd.h>
+
+const char* ClipPool::POOL_DIR = "/pool";
+
+static const char* SD_MOUNT_POINT = "/sd";              // SD.begin() default, truncate() needs the VFS path
+static const unsigned long MAINTAIN_INTERVAL_MS = 500;  // between allocation steps
+static const unsigned long RETRY_AFTER_FAIL_MS = 60000;
+
+ClipPool::ClipPool(size_t fileMB, int targetFiles, size_t stepMB, long minFreeMB) {
+    this->fileBytes = fileMB * 1024 * 1024;
+    this->targetFiles = targetFiles;
+    this->stepBytes = stepMB * 1024 * 1024;
+    this->minFreeBytes = (uint64_t)minFreeMB * 1024 * 1024;
+    this->enabled = true;
+    this->growingFile = "";
+    this->growingSize = 0;
+    this->nextId = 0;
+    this->scanned = false;
+    this->nextMaintainMs = 0;
+    this->lock = xSemaphoreCreateMutex();
+}
+
+ClipPool::~ClipPool() {
+    if (lock) vSemaphoreDelete(lock);
+}
+
+bool ClipPool::begin() {
+    if (!SD.exists(POOL_DIR) && !SD.mkdir(POOL_DIR)) {
+        Serial.printf("ERROR: Failed to create clip pool folder %s\n", POOL_DIR);
+        return false;
+    }
+    scan();
+    return true;
+}
+
+void ClipPool::scan() {
+    std::vector<String> ready;
+    growingFile = "";
+    growingSize = 0;
+    File dir = SD.open(POOL_DIR);
+    if (dir) {
+        File file = dir.openNextFile();
+        while (file) {
+            String name = file.name();
+            bool isPoolFile = !file.isDirectory() && name.endsWith(".clp");
+            size_t size = file.size();
+            file.close();
+            if (isPoolFile) {
+                String path = String(POOL_DIR) + "/" + name;
+                nextId = max(nextId, (uint32_t)name.toInt() + 1);
+                if (size >= fileBytes) {
+                    ready.push_back(path);
+                } else if (growingFile.length() == 0) {
+                    // Left half allocated by a reboot - carry on extending it
+                    growingFile = path;
+                    growingSize = size;
+                } else {
+                    SD.remove(path.c_str());
+                }
+            }
+            file = dir.openNextFile();
+        }
+        dir.close();
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    readyFiles.swap(ready);
+    xSemaphoreGive(lock);
+    scanned = true;
+    Serial.printf("Clip pool: %d of %d files ready (%u MB each)\n",
+                  (int)readyFiles.size(), targetFiles, (unsigned)(fileBytes / (1024 * 1024)));
+}
+
+String ClipPool::newFileName() {
+    return String(POOL_DIR) + "/" + String(nextId++) + ".clp";
+}
+
+int ClipPool::getReadyFiles() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int count = readyFiles.size();
+    xSemaphoreGive(lock);
+    return count;
+}
+
+void ClipPool::maintain() {
+    unsigned long now = millis();
+    if (!enabled || !scanned || (long)(now - nextMaintainMs) < 0) {
+        return;
+    }
+    nextMaintainMs = now + MAINTAIN_INTERVAL_MS;
+    if (getReadyFiles() >= targetFiles) {
+        return;
+    }
+    // Clips come first - leave the pool short rather than push the card below its free space floor
+    uint64_t freeBytes = SD.totalBytes() - SD.usedBytes();
+    if (freeBytes < stepBytes + minFreeBytes) {
+        return;
+    }
+
+    if (growingFile.length() == 0) {
+        growingFile = newFileName();
+        growingSize = 0;
+        File created = SD.open(growingFile, FILE_WRITE);
+        if (!created) {
+            Serial.printf("ERROR: Failed to create pool file %s\n", growingFile.c_str());
+            growingFile = "";
+            nextMaintainMs = now + RETRY_AFTER_FAIL_MS;
+            return;
+        }
+        created.close();
+    }
+
+    // Seeking past the end of a file open for writing makes FAT allocate the clusters up to there
+    uint32_t startMs = millis();
+    size_t target = min(fileBytes, growingSize + stepBytes);
+    File file = SD.open(growingFile, "r+");
+    bool ok = file && file.seek(target - 1) && file.write((uint8_t)0) == 1;
+    if (file) file.close();
+    stats.lastStepMs = millis() - startMs;
+    if (stats.lastStepMs > stats.maxStepMs) stats.maxStepMs = stats.lastStepMs;
+    if (!ok) {
+        Serial.printf("ERROR: Failed to extend pool file %s to %u bytes\n", growingFile.c_str(), (unsigned)target);
+        SD.remove(growingFile.c_str());
+        growingFile = "";
+        growingSize = 0;
+        nextMaintainMs = now + RETRY_AFTER_FAIL_MS;
+        return;
+    }
+    growingSize = target;
+
+    if (growingSize >= fileBytes) {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        readyFiles.push_back(growingFile);
+        int count = readyFiles.size();
+        xSemaphoreGive(lock);
+        stats.filesPrepared++;
+        Serial.printf("Clip pool: %s ready (%d of %d)\n", growingFile.c_str(), count, targetFiles);
+        growingFile = "";
+        growingSize = 0;
+    }
+}
+
+bool ClipPool::take(const String& clipPath) {
+    if (!enabled) {
+        return false;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (readyFiles.empty()) {
+        xSemaphoreGive(lock);
+        return false;
+    }
+    String poolFile = readyFiles.back();
+    readyFiles.pop_back();
+    xSemaphoreGive(lock);
+
+    if (!SD.rename(poolFile.c_str(), clipPath.c_str())) {
+        Serial.printf("ERROR: Failed to rename pool file %s to %s\n", poolFile.c_str(), clipPath.c_str());
+        SD.remove(poolFile.c_str());
+        return false;
+    }
+    return true;
+}
+
+void ClipPool::finishClip(const String& clipPath, bool pooled, size_t clipBytes, const WriteLatencyStats& writes) {
+    if (!pooled) {
+        stats.unpooledClips++;
+        stats.unpooledWrites.merge(writes);
+        return;
+    }
+    stats.pooledClips++;
+    stats.pooledWrites.merge(writes);
+    if (clipBytes > fileBytes) {
+        stats.overflowClips++; // Grew past the allocation, already exactly its own length
+        return;
+    }
+    String vfsPath = String(SD_MOUNT_POINT) + clipPath;
+    if (truncate(vfsPath.c_str(), clipBytes) != 0) {
+        stats.truncateFailures++;
+        Serial.printf("ERROR: Failed to trim pooled clip %s to %u bytes\n", clipPath.c_str(), (unsigned)clipBytes);
+    }
+}
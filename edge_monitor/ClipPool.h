@@ -0,0 +1,95 @@
+#ifndef CLIPPOOL_H
+#define CLIPPOOL_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "SD.h"
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "SDWriteBuffer.h"
+
+/**
+ * ClipPool - pre-allocated clip files
+ *
+ * A growing file makes FAT allocate a cluster and update both FAT
+ * copies every time it crosses a cluster boundary; those updates are
+ * the long tail in the SD write latency histogram. While the card is
+ * idle the pool extends spare files under /pool to a fixed size, a few
+ * MB per maintain() call so loop() never blocks for long. FAT hands out
+ * the next free clusters, so on a card with free space in one run the
+ * files are contiguous.
+ *
+ * A recording takes a ready file, renames it to the clip name and the
+ * recorder overwrites it in place ("r+"), so frames land in clusters
+ * that are already allocated. At close the file is truncated to the
+ * real clip length. Clips longer than a pool file simply grow as before.
+ *
+ * Write latency is kept separately for pooled and unpooled clips, so
+ * the effect can be read from /status on the same card.
+ */
+class ClipPool {
+public:
+    struct Stats {
+        uint32_t pooledClips = 0;
+        uint32_t unpooledClips = 0;     // no ready file (or pool disabled)
+        uint32_t overflowClips = 0;     // pooled but longer than a pool file
+        uint32_t filesPrepared = 0;
+        uint32_t truncateFailures = 0;
+        uint32_t lastStepMs = 0;        // last maintain() extend step
+        uint32_t maxStepMs = 0;
+        WriteLatencyStats pooledWrites;
+        WriteLatencyStats unpooledWrites;
+    };
+
+private:
+    size_t fileBytes;
+    int targetFiles;
+    size_t stepBytes;
+    uint64_t minFreeBytes;
+    volatile bool enabled;
+
+    // Ready files are "/pool/<id>.clp" at full size, at most one more is growing
+    std::vector<String> readyFiles;
+    String growingFile;
+    size_t growingSize;
+    uint32_t nextId;
+    bool scanned;
+    unsigned long nextMaintainMs;
+    SemaphoreHandle_t lock;
+
+    Stats stats;
+
+    String newFileName();
+    void scan();
+
+public:
+    static const char* POOL_DIR;
+
+    // Constructor - minFreeMB is kept free on the card on top of the pool
+    ClipPool(size_t fileMB = 16, int targetFiles = 2, size_t stepMB = 2, long minFreeMB = 1);
+    ~ClipPool();
+
+    // Find pool files left from the last boot (SD must be mounted)
+    bool begin();
+
+    // One allocation step - call from loop() while the card is idle
+    void maintain();
+
+    // Rename a ready pool file to clipPath; false = record into a fresh file instead
+    bool take(const String& clipPath);
+
+    // Closed clip: trim a pooled file to its length and account its writes
+    void finishClip(const String& clipPath, bool pooled, size_t clipBytes, const WriteLatencyStats& writes);
+
+    // Status and control
+    void setEnabled(bool on) { enabled = on; }
+    bool isEnabled() const { return enabled; }
+    int getReadyFiles();
+    size_t getFileBytes() const { return fileBytes; }
+    int getTargetFiles() const { return targetFiles; }
+    size_t getGrowingBytes() const { return growingSize; }
+    const Stats& getStats() const { return stats; }
+};
+
+#endif // CLIPPOOL_H
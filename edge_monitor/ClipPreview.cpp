@@ -0,0 +1,338 @@
+#include "ClipPreview.h"
+#include "HeapAccounting.h"
+#include "img_converters.h"
+
+static const uint8_t idx1Tag[4] = {0x69, 0x64, 0x78, 0x31}; // idx1
+static const uint8_t ftimTag[4] = {0x66, 0x74, 0x69, 0x6D}; // ftim
+static const size_t MOVI_START = AVI_HEADER_LEN - 4;        // idx1 offsets count from the movi tag
+
+ClipPreview::ClipPreview(int frameStep, int scale, uint8_t quality, PreviewFormat format, uint32_t maxFrames)
+    : avi(maxFrames), out(16 * 1024, 4096) {
+    this->frameStep = max(frameStep, 1);
+    this->scale = constrain(scale, 0, 3);
+    this->quality = quality;
+    this->format = format;
+    this->srcBuf = NULL;
+    this->srcSize = 0;
+    this->rgbBuf = NULL;
+    this->rgbSize = 0;
+    this->encBuf = NULL;
+    this->encSize = 0;
+    this->encodeLen = 0;
+#ifdef HAVE_H264_ENCODER
+    this->encoder = NULL;
+    this->yuvBuf = NULL;
+    this->yuvSize = 0;
+    this->nalBuf = NULL;
+    this->nalSize = 0;
+#endif
+}
+
+ClipPreview::~ClipPreview() {
+    heapClips.release(srcBuf);
+    heapClips.release(rgbBuf);
+    heapClips.release(encBuf);
+#ifdef HAVE_H264_ENCODER
+    closeEncoder();
+    if (yuvBuf) heap_caps_free(yuvBuf);
+    if (nalBuf) heap_caps_free(nalBuf);
+#endif
+}
+
+bool ClipPreview::begin() {
+    if (!avi.begin() || !out.begin()) {
+        Serial.println("ERROR: Failed to allocate clip preview buffers");
+        return false;
+    }
+#ifndef HAVE_H264_ENCODER
+    if (format == PREVIEW_FORMAT_H264) {
+        Serial.println("WARNING: Built without the esp_h264 component, previews stay MJPEG");
+        format = PREVIEW_FORMAT_MJPEG;
+    }
+#endif
+    return true;
+}
+
+bool ClipPreview::grow(uint8_t*& buf, size_t& size, size_t need) {
+    // Only grows when a larger frame turns up
+    if (need <= size) {
+        return true;
+    }
+    heapClips.release(buf);
+    buf = (uint8_t*)heapClips.allocPreferPsram(need);
+    size = buf ? need : 0;
+    if (buf == NULL) {
+        Serial.printf("ERROR: Failed to allocate %u bytes for clip preview\n", (unsigned)need);
+        return false;
+    }
+    return true;
+}
+
+size_t ClipPreview::encodeOut(void* arg, size_t index, const void* data, size_t len) {
+    ClipPreview* self = (ClipPreview*)arg;
+    if (index + len > self->encSize) return 0;
+    memcpy(self->encBuf + index, data, len);
+    self->encodeLen = index + len;
+    return len;
+}
+
+bool ClipPreview::copyFrames(File& clip, File& preview, uint32_t& framesOut) {
+    uint8_t hdr[AVI_HEADER_LEN];
+    if (clip.read(hdr, AVI_HEADER_LEN) != AVI_HEADER_LEN) {
+        return false;
+    }
+    uint32_t usecs, frames, dataSize;
+    uint16_t width, height;
+    memcpy(&usecs, hdr + 0x20, 4);
+    memcpy(&frames, hdr + 0x30, 4);
+    memcpy(&width, hdr + 0x40, 2);
+    memcpy(&height, hdr + 0x44, 2);
+    memcpy(&dataSize, hdr + 0x12E, 4);
+    if (frames == 0 || width == 0) {
+        Serial.println("ERROR: Clip has no finalized AVI header");
+        return false;
+    }
+
+    uint8_t tag[CHUNK_HDR];
+    size_t idxPos = MOVI_START + dataSize;
+    if (!clip.seek(idxPos, SeekSet) || clip.read(tag, CHUNK_HDR) != CHUNK_HDR || memcmp(tag, idx1Tag, 4) != 0) {
+        Serial.println("ERROR: Clip has no idx1 index");
+        return false;
+    }
+    // Clips from before the ftim chunk get times from the header frame rate
+    size_t timePos = idxPos + CHUNK_HDR + (size_t)frames * IDX_ENTRY;
+    bool haveTimes = clip.seek(timePos, SeekSet) && clip.read(tag, CHUNK_HDR) == CHUNK_HDR &&
+                     memcmp(tag, ftimTag, 4) == 0;
+
+    uint16_t outWidth = width >> scale;
+    uint16_t outHeight = height >> scale;
+    size_t rgbNeed = (size_t)outWidth * outHeight * 2;
+    bool h264 = format == PREVIEW_FORMAT_H264;
+    bool decode = h264 || scale > 0;
+    if (decode && (!grow(rgbBuf, rgbSize, rgbNeed) || (!h264 && !grow(encBuf, encSize, rgbNeed)))) {
+        return false;
+    }
+    float fps = usecs ? 1000000.0f / usecs / frameStep : 1;
+
+    out.attach(preview);
+#ifdef HAVE_H264_ENCODER
+    // The encoder takes whole macroblocks - crop the right and bottom edge
+    uint16_t codedWidth = outWidth & ~15;
+    uint16_t codedHeight = outHeight & ~15;
+    if (h264 && !openEncoder(codedWidth, codedHeight, fps)) {
+        return false;
+    }
+#endif
+    if (!h264 && !avi.openAvi(out)) {
+        return false;
+    }
+    bool ok = true;
+    for (uint32_t i = 0; i < frames && (h264 || !avi.isIndexFull()); i += frameStep) {
+        uint8_t entry[IDX_ENTRY];
+        uint32_t offset, len;
+        if (!clip.seek(idxPos + CHUNK_HDR + (size_t)i * IDX_ENTRY, SeekSet) || clip.read(entry, IDX_ENTRY) != IDX_ENTRY) {
+            ok = false;
+            break;
+        }
+        memcpy(&offset, entry + 8, 4);
+        memcpy(&len, entry + 12, 4);
+        uint32_t ms = (uint32_t)((uint64_t)i * usecs / 1000);
+        if (haveTimes && clip.seek(timePos + CHUNK_HDR + (size_t)i * TIME_ENTRY, SeekSet)) {
+            clip.read((uint8_t*)&ms, TIME_ENTRY);
+        }
+        if (!grow(srcBuf, srcSize, len) || !clip.seek(MOVI_START + offset + CHUNK_HDR, SeekSet) ||
+            clip.read(srcBuf, len) != len) {
+            ok = false;
+            break;
+        }
+        if (decode && !jpg2rgb565(srcBuf, len, rgbBuf, (jpg_scale_t)scale)) {
+            Serial.printf("WARNING: Preview decode failed at frame %u\n", (unsigned)i);
+            continue;
+        }
+
+#ifdef HAVE_H264_ENCODER
+        if (h264) {
+            rgb565ToI420(rgbBuf, outWidth, yuvBuf, codedWidth, codedHeight);
+            if (!encodeFrame(codedWidth, codedHeight, ms)) {
+                ok = false;
+                break;
+            }
+        }
+#endif
+        if (!h264) {
+            const uint8_t* jpeg = srcBuf;
+            size_t jpegLen = len;
+            if (scale > 0) {
+                encodeLen = 0;
+                if (!fmt2jpg_cb(rgbBuf, rgbNeed, outWidth, outHeight, PIXFORMAT_RGB565, quality, encodeOut, this)) {
+                    Serial.printf("WARNING: Preview re-encode failed at frame %u\n", (unsigned)i);
+                    continue;
+                }
+                jpeg = encBuf;
+                jpegLen = encodeLen;
+            }
+            avi.writeFrame(out, jpeg, jpegLen, ms);
+        }
+        if (out.hasError()) {
+            ok = false;
+            break;
+        }
+        framesOut++;
+        vTaskDelay(1); // Let the other core 0 tasks in between frames
+    }
+#ifdef HAVE_H264_ENCODER
+    if (h264) {
+        closeEncoder();
+        return ok && framesOut > 0 && out.flush();
+    }
+#endif
+    return ok && framesOut > 0 && avi.closeAvi(out, preview, fps, outWidth, outHeight) && !out.hasError();
+}
+
+void ClipPreview::rgb565ToI420(const uint8_t* rgb, uint16_t srcWidth, uint8_t* yuv, uint16_t width, uint16_t height) {
+    // jpg2rgb565 writes big endian pixels; BT.601 limited range, chroma from the top left pixel of each 2x2
+    uint8_t* yPlane = yuv;
+    uint8_t* uPlane = yuv + (size_t)width * height;
+    uint8_t* vPlane = uPlane + (size_t)width * height / 4;
+    for (uint16_t y = 0; y < height; y++) {
+        const uint8_t* row = rgb + (size_t)y * srcWidth * 2;
+        for (uint16_t x = 0; x < width; x++) {
+            uint8_t hi = row[x * 2];
+            uint8_t lo = row[x * 2 + 1];
+            int r = hi & 0xF8;
+            int g = ((hi & 0x07) << 5) | ((lo & 0xE0) >> 3);
+            int b = (lo & 0x1F) << 3;
+            *yPlane++ = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+            if (((x | y) & 1) == 0) {
+                *uPlane++ = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+                *vPlane++ = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+            }
+        }
+    }
+}
+
+#ifdef HAVE_H264_ENCODER
+static const uint32_t H264_BITS_PER_PIXEL_X100 = 10; // ~0.1 bit per pixel, fine for a preview
+static const uint8_t H264_QP_MIN = 20;
+static const uint8_t H264_QP_MAX = 42;
+
+bool ClipPreview::openEncoder(uint16_t width, uint16_t height, float fps) {
+    size_t yuvNeed = (size_t)width * height * 3 / 2;
+    // The encoder wants 16 byte aligned frames; a coded frame is always smaller than the raw one
+    if (yuvNeed > yuvSize) {
+        if (yuvBuf) heap_caps_free(yuvBuf);
+        if (nalBuf) heap_caps_free(nalBuf);
+        yuvBuf = (uint8_t*)heap_caps_aligned_alloc(16, yuvNeed, MALLOC_CAP_SPIRAM);
+        nalBuf = (uint8_t*)heap_caps_aligned_alloc(16, yuvNeed, MALLOC_CAP_SPIRAM);
+        yuvSize = (yuvBuf && nalBuf) ? yuvNeed : 0;
+        nalSize = yuvSize;
+        if (yuvSize == 0) {
+            Serial.println("ERROR: Failed to allocate H.264 frame buffers");
+            return false;
+        }
+    }
+    uint8_t rate = (uint8_t)constrain(lround(fps), 1, 60);
+    esp_h264_enc_cfg_sw_t cfg = {};
+    cfg.pic_type = ESP_H264_RAW_FMT_I420;
+    cfg.gop = rate * 2;
+    cfg.fps = rate;
+    cfg.res.width = width;
+    cfg.res.height = height;
+    cfg.rc.bitrate = (uint32_t)width * height * rate * H264_BITS_PER_PIXEL_X100 / 100;
+    cfg.rc.qp_min = H264_QP_MIN;
+    cfg.rc.qp_max = H264_QP_MAX;
+    if (esp_h264_enc_sw_new(&cfg, &encoder) != ESP_H264_ERR_OK || esp_h264_enc_open(encoder) != ESP_H264_ERR_OK) {
+        Serial.printf("ERROR: Failed to start H.264 encoder at %ux%u\n", width, height);
+        closeEncoder();
+        return false;
+    }
+    return true;
+}
+
+void ClipPreview::closeEncoder() {
+    if (encoder) {
+        esp_h264_enc_close(encoder);
+        esp_h264_enc_del(encoder);
+        encoder = NULL;
+    }
+}
+
+bool ClipPreview::encodeFrame(uint16_t width, uint16_t height, uint32_t ms) {
+    esp_h264_enc_in_frame_t inFrame = {};
+    inFrame.raw_data.buffer = yuvBuf;
+    inFrame.raw_data.len = (uint32_t)width * height * 3 / 2;
+    inFrame.pts = ms;
+    esp_h264_enc_out_frame_t outFrame = {};
+    outFrame.raw_data.buffer = nalBuf;
+    outFrame.raw_data.len = nalSize;
+    if (esp_h264_enc_process(encoder, &inFrame, &outFrame) != ESP_H264_ERR_OK) {
+        Serial.println("ERROR: H.264 encode failed");
+        return false;
+    }
+    // Annex-B NAL units with start codes, appended as they come
+    return out.write(nalBuf, outFrame.length) == outFrame.length;
+}
+#endif
+
+bool ClipPreview::build(const String& clipPath, const String& previewPath) {
+    uint32_t startMs = millis();
+    File clip = SD.open(clipPath, FILE_READ);
+    if (!clip) {
+        Serial.printf("ERROR: Failed to open clip for preview: %s\n", clipPath.c_str());
+        stats.failures++;
+        return false;
+    }
+    File preview = SD.open(previewPath, FILE_WRITE);
+    if (!preview) {
+        Serial.printf("ERROR: Failed to create preview: %s\n", previewPath.c_str());
+        clip.close();
+        stats.failures++;
+        return false;
+    }
+
+    uint32_t frames = 0;
+    bool ok = copyFrames(clip, preview, frames);
+    size_t sourceBytes = clip.size();
+    size_t bytes = out.position();
+    out.detach();
+    preview.close();
+    clip.close();
+    if (!ok) {
+        Serial.printf("ERROR: Failed building preview %s\n", previewPath.c_str());
+        SD.remove(previewPath.c_str());
+        stats.failures++;
+        return false;
+    }
+
+    stats.built++;
+    stats.lastBuildMs = millis() - startMs;
+    stats.lastFrames = frames;
+    stats.lastBytes = bytes;
+    stats.lastSourceBytes = sourceBytes;
+    Serial.printf("Preview built: %s (%u frames, %u of %u bytes, %u ms)\n", previewPath.c_str(), (unsigned)frames,
+                  (unsigned)bytes, (unsigned)sourceBytes, (unsigned)stats.lastBuildMs);
+    return true;
+}
+
+String ClipPreview::pathFor(const String& clipPath) {
+    if (clipPath.endsWith(".avi")) {
+        return clipPath.substring(0, clipPath.length() - 4) + PREVIEW_EXT;
+    }
+    return clipPath + PREVIEW_EXT;
+}
+
+String ClipPreview::clipFor(const String& previewPath) {
+    return previewPath.substring(0, previewPath.length() - strlen(PREVIEW_EXT)) + ".avi";
+}
+
+String ClipPreview::uploadName(const String& previewPath) const {
+    // The server sees an ordinary video file next to the full clip's name
+    String name = previewPath.substring(previewPath.lastIndexOf('/') + 1);
+    return name.substring(0, name.length() - strlen(PREVIEW_EXT)) +
+           (format == PREVIEW_FORMAT_H264 ? "_preview.h264" : "_preview.avi");
+}
+
+bool ClipPreview::remove(const String& clipPath) {
+    String path = pathFor(clipPath);
+    return SD.exists(path.c_str()) && SD.remove(path.c_str());
+}
@@ -0,0 +1,112 @@
+#ifndef CLIPPREVIEW_H
+#define CLIPPREVIEW_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "SD.h"
+#include "AviWriter.h"
+#include "SDWriteBuffer.h"
+
+#define PREVIEW_EXT ".pvw"
+
+// Espressif's software H.264 encoder (esp_h264 component) - only on builds that have it
+#if __has_include("esp_h264_enc_single_sw.h")
+#define HAVE_H264_ENCODER 1
+#include "esp_h264_enc_single_sw.h"
+#endif
+
+enum PreviewFormat : uint8_t {
+    PREVIEW_FORMAT_MJPEG = 0,   // MJPEG AVI, plays anywhere
+    PREVIEW_FORMAT_H264 = 1,    // H.264 annex-B stream, several times smaller
+};
+
+/**
+ * ClipPreview - reduced copy of a recorded clip for tiered uploads
+ *
+ * Builds "<clip>.pvw", an MJPEG AVI holding every frameStep-th frame of
+ * the clip, located through its idx1 index. With scale 1..3 each kept
+ * frame is decoded at 1/2 to 1/8 size and re-encoded, otherwise the
+ * JPEGs are copied as they are. Capture times come from the clip's ftim
+ * chunk, so the preview plays back in real time at the lower rate.
+ *
+ * In H.264 format the decoded frames go through the esp_h264 software
+ * encoder instead (I420, cropped to a multiple of 16) and the preview is
+ * a raw annex-B stream with an IDR every two seconds. The encoder only
+ * keeps up at small sizes, so use scale 2..3 for HD clips.
+ *
+ * The uploader sends the preview ahead of the full clip, which then
+ * follows at backfill priority (or only on request), so on a slow link
+ * the server sees every event within seconds. Previews are built just
+ * before they are sent and deleted once uploaded.
+ */
+class ClipPreview {
+public:
+    struct Stats {
+        uint32_t built = 0;
+        uint32_t failures = 0;
+        uint32_t lastBuildMs = 0;
+        uint32_t lastFrames = 0;
+        size_t lastBytes = 0;
+        size_t lastSourceBytes = 0;
+    };
+
+private:
+    int frameStep;
+    int scale;
+    uint8_t quality;
+    PreviewFormat format;
+    AviWriter avi;
+    SDWriteBuffer out;
+    uint8_t* srcBuf;
+    size_t srcSize;
+    uint8_t* rgbBuf;
+    size_t rgbSize;
+    uint8_t* encBuf;
+    size_t encSize;
+    size_t encodeLen;
+    Stats stats;
+#ifdef HAVE_H264_ENCODER
+    esp_h264_enc_handle_t encoder;
+    uint8_t* yuvBuf;
+    size_t yuvSize;
+    uint8_t* nalBuf;
+    size_t nalSize;
+
+    bool openEncoder(uint16_t width, uint16_t height, float fps);
+    void closeEncoder();
+    bool encodeFrame(uint16_t width, uint16_t height, uint32_t ms);
+#endif
+
+    static size_t encodeOut(void* arg, size_t index, const void* data, size_t len);
+    static bool grow(uint8_t*& buf, size_t& size, size_t need);
+    bool copyFrames(File& clip, File& preview, uint32_t& framesOut);
+    static void rgb565ToI420(const uint8_t* rgb, uint16_t srcWidth, uint8_t* yuv, uint16_t width, uint16_t height);
+
+public:
+    // Constructor - scale 0 keeps the original JPEGs, quality only applies when re-encoding to JPEG
+    ClipPreview(int frameStep = 5, int scale = 1, uint8_t quality = 50,
+                PreviewFormat format = PREVIEW_FORMAT_MJPEG, uint32_t maxFrames = 1200);
+    ~ClipPreview();
+
+    // Allocate the AVI index and write buffer; H.264 without the encoder falls back to MJPEG
+    bool begin();
+
+    // Write previewPath from the closed clip at clipPath
+    bool build(const String& clipPath, const String& previewPath);
+
+    // Configuration and status
+    int getFrameStep() const { return frameStep; }
+    int getScale() const { return scale; }
+    PreviewFormat getFormat() const { return format; }
+    // File name the server gets for a preview
+    String uploadName(const String& previewPath) const;
+    const Stats& getStats() const { return stats; }
+
+    // Preview files on the card
+    static bool isPreview(const String& path) { return path.endsWith(PREVIEW_EXT); }
+    static String pathFor(const String& clipPath);
+    static String clipFor(const String& previewPath);
+    static bool remove(const String& clipPath);
+};
+
+#endif // CLIPPREVIEW_H
@@ -0,0 +1,195 @@
+#include "ClipSidecar.h"
+#include "JsonAllocator.h"
+#include "img_converters.h"
+#include "ArduinoJson.h"
+
+ClipSidecar::ClipSidecar(uint32_t intervalMs, uint16_t maxWidth, uint8_t quality, size_t storeBytes) {
+    this->intervalMs = intervalMs;
+    this->maxWidth = maxWidth;
+    this->quality = quality;
+    this->storeSize = storeBytes;
+    this->store = NULL;
+    this->storeLen = 0;
+    this->encodeLen = 0;
+    this->rgbBuf = NULL;
+    this->rgbSize = 0;
+    this->thumbCount = 0;
+    this->firstFrameMs = 0;
+    this->nextThumbMs = 0;
+    this->lastEncodeUs = 0;
+}
+
+ClipSidecar::~ClipSidecar() {
+    heapClips.release(store);
+    heapClips.release(rgbBuf);
+}
+
+bool ClipSidecar::begin() {
+    if (store != NULL) {
+        return true; // Already initialized
+    }
+    store = psramFound() ? (uint8_t*)heapClips.alloc(storeSize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) : NULL;
+    if (store == NULL) {
+        Serial.println("WARNING: No PSRAM for clip thumbnails, sidecars will carry stats only");
+        return false;
+    }
+    return true;
+}
+
+void ClipSidecar::reset() {
+    storeLen = 0;
+    thumbCount = 0;
+    nextThumbMs = 0;
+}
+
+size_t ClipSidecar::storeOut(void* arg, size_t index, const void* data, size_t len) {
+    // jpg_out_cb for a thumbnail, appended after the ones already taken
+    ClipSidecar* self = (ClipSidecar*)arg;
+    if (self->storeLen + index + len > self->storeSize) return 0;
+    memcpy(self->store + self->storeLen + index, data, len);
+    self->encodeLen = index + len;
+    return len;
+}
+
+bool ClipSidecar::offer(const uint8_t* jpeg, size_t len, uint16_t width, uint16_t height,
+                        uint32_t frameIndex, uint32_t timestampMs, uint32_t aviOffset) {
+    if (frameIndex == 0) firstFrameMs = timestampMs;
+    uint32_t clipMs = timestampMs - firstFrameMs;
+    if (store == NULL || thumbCount >= MAX_THUMBS || clipMs < nextThumbMs || width == 0) {
+        return false;
+    }
+    uint32_t startUs = micros();
+
+    // Smallest decoder scale that brings the width under maxWidth (1/8 at most)
+    int scale = 1;
+    while (scale < 3 && (width >> scale) > maxWidth) scale++;
+    uint16_t w = width >> scale;
+    uint16_t h = height >> scale;
+    size_t need = (size_t)w * h * 2;
+    if (need > rgbSize) {
+        // Only grows when a larger frame size turns up
+        heapClips.release(rgbBuf);
+        rgbBuf = (uint8_t*)heapClips.alloc(need, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        rgbSize = rgbBuf ? need : 0;
+        if (rgbBuf == NULL) {
+            Serial.println("ERROR: Failed to allocate thumbnail bitmap");
+            return false;
+        }
+    }
+
+    nextThumbMs = (clipMs / intervalMs + 1) * intervalMs;
+    if (!jpg2rgb565(jpeg, len, rgbBuf, (jpg_scale_t)scale)) {
+        Serial.printf("WARNING: Thumbnail decode failed at frame %u\n", (unsigned)frameIndex);
+        return false;
+    }
+    encodeLen = 0;
+    if (!fmt2jpg_cb(rgbBuf, need, w, h, PIXFORMAT_RGB565, quality, storeOut, this)) {
+        // Store is full - no room for more thumbnails in this clip
+        Serial.printf("WARNING: Thumbnail store full after %d thumbnails\n", thumbCount);
+        nextThumbMs = UINT32_MAX;
+        return false;
+    }
+
+    Thumb& t = thumbs[thumbCount++];
+    t.frame = frameIndex;
+    t.clipMs = clipMs;
+    t.aviOffset = aviOffset;
+    t.offset = storeLen;
+    t.len = encodeLen;
+    storeLen += encodeLen;
+    lastEncodeUs = micros() - startUs;
+    return true;
+}
+
+bool ClipSidecar::write(const String& aviPath, const ClipStats& stats) {
+    if (stats.frameCount == 0) {
+        return false;
+    }
+    int count = thumbCount;
+    char header[MAX_HEADER];
+    size_t n = snprintf(header, sizeof(header),
+                        "{\"v\":1,\"frames\":%u,\"fps\":%.2f,\"duration_ms\":%lu,\"width\":%u,\"height\":%u,"
+                        "\"motion_peak\":%d,\"motion_threshold\":%d,\"thumbs\":[",
+                        (unsigned)stats.frameCount, stats.fps, stats.durationMs, stats.width, stats.height,
+                        stats.motionPeak, stats.motionThreshold);
+    for (int i = 0; i < count && n < sizeof(header); i++) {
+        const Thumb& t = thumbs[i];
+        n += snprintf(header + n, sizeof(header) - n,
+                      "%s{\"frame\":%u,\"ms\":%u,\"avi_offset\":%u,\"offset\":%u,\"len\":%u}",
+                      i ? "," : "", (unsigned)t.frame, (unsigned)t.clipMs, (unsigned)t.aviOffset,
+                      (unsigned)t.offset, (unsigned)t.len);
+    }
+    if (n < sizeof(header)) n += snprintf(header + n, sizeof(header) - n, "]}\n");
+    if (n >= sizeof(header)) {
+        Serial.println("ERROR: Sidecar header too long");
+        return false;
+    }
+
+    String path = pathFor(aviPath);
+    File file = SD.open(path, FILE_WRITE);
+    if (!file) {
+        Serial.printf("ERROR: Failed to open sidecar: %s\n", path.c_str());
+        return false;
+    }
+    bool ok = file.write((const uint8_t*)header, n) == n;
+    if (ok && storeLen) ok = file.write(store, storeLen) == storeLen;
+    file.close();
+    if (!ok) {
+        Serial.printf("ERROR: Failed writing sidecar: %s\n", path.c_str());
+        SD.remove(path.c_str());
+        return false;
+    }
+    Serial.printf("Sidecar written: %s (%d thumbnails, %u bytes)\n", path.c_str(), count, (unsigned)(n + storeLen));
+    return true;
+}
+
+String ClipSidecar::pathFor(const String& aviPath) {
+    if (aviPath.endsWith(".avi")) {
+        return aviPath.substring(0, aviPath.length() - 4) + THUMB_EXT;
+    }
+    return aviPath + THUMB_EXT;
+}
+
+bool ClipSidecar::remove(const String& aviPath) {
+    // Clips recorded before sidecars existed have none, don't log that as a failure
+    String path = pathFor(aviPath);
+    return SD.exists(path.c_str()) && SD.remove(path.c_str());
+}
+
+bool ClipSidecar::readInfo(const String& aviPath, String& info) {
+    File file = SD.open(pathFor(aviPath), FILE_READ);
+    if (!file) {
+        return false;
+    }
+    char line[MAX_HEADER];
+    size_t got = file.read((uint8_t*)line, sizeof(line));
+    file.close();
+    char* end = (char*)memchr(line, '\n', got);
+    if (end == NULL) {
+        return false;
+    }
+    *end = '\0';
+    info = line;
+    return true;
+}
+
+bool ClipSidecar::openThumb(const String& aviPath, int index, File& file, size_t& len) {
+    String info;
+    if (index < 0 || !readInfo(aviPath, info)) {
+        return false;
+    }
+    JsonDocument doc(&jsonAllocator);
+    if (deserializeJson(doc, info)) {
+        return false;
+    }
+    JsonArray list = doc["thumbs"];
+    if (index >= (int)list.size()) {
+        return false;
+    }
+    file = SD.open(pathFor(aviPath), FILE_READ);
+    if (!file) {
+        return false;
+    }
+    len = list[index]["len"].as<size_t>();
+    return file.seek(info.length() + 1 + list[index]["offset"].as<size_t>(), SeekSet);
+}
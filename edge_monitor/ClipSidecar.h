@@ -0,0 +1,95 @@
+#ifndef CLIPSIDECAR_H
+#define CLIPSIDECAR_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "SD.h"
+
+#define THUMB_EXT ".thm"
+
+// Per-clip figures written into the sidecar header
+struct ClipStats {
+    uint32_t frameCount = 0;
+    float fps = 0;
+    unsigned long durationMs = 0;
+    uint16_t width = 0;
+    uint16_t height = 0;
+    int motionPeak = -1;        // most changed pixels in one check, -1 = not a motion clip
+    int motionThreshold = 0;
+};
+
+/**
+ * ClipSidecar - thumbnails and keyframe offsets for a recorded clip
+ *
+ * While a clip is written, one frame every intervalMs of clip time is
+ * decoded at 1/2 to 1/8 scale and re-encoded as a small JPEG kept in
+ * PSRAM. At close it all goes into "<clip>.thm" next to the AVI: one
+ * JSON line with the clip stats and, per thumbnail, the frame number,
+ * that frame's byte offset in the AVI and where its JPEG sits after the
+ * line, followed by the thumbnail JPEGs back to back. File lists and
+ * previews then cost a few KB read instead of opening the clip.
+ */
+class ClipSidecar {
+public:
+    static const int MAX_THUMBS = 8;
+    static const size_t MAX_HEADER = 1024;
+
+private:
+    struct Thumb {
+        uint32_t frame;
+        uint32_t clipMs;
+        uint32_t aviOffset;     // 00dc chunk of the frame in the AVI
+        uint32_t offset;        // JPEG start, counted from the end of the header line
+        uint32_t len;
+    };
+
+    uint32_t intervalMs;
+    uint16_t maxWidth;
+    uint8_t quality;
+    size_t storeSize;
+    uint8_t* store;
+    size_t storeLen;
+    size_t encodeLen;
+    uint8_t* rgbBuf;
+    size_t rgbSize;
+
+    Thumb thumbs[MAX_THUMBS];
+    int thumbCount;
+    uint32_t firstFrameMs;
+    uint32_t nextThumbMs;
+    uint32_t lastEncodeUs;
+
+    static size_t storeOut(void* arg, size_t index, const void* data, size_t len);
+
+public:
+    // Constructor - maxWidth picks the decode scale, storeBytes bounds all thumbnails of a clip
+    ClipSidecar(uint32_t intervalMs = 2000, uint16_t maxWidth = 200, uint8_t quality = 60,
+                size_t storeBytes = 96 * 1024);
+    ~ClipSidecar();
+
+    // Allocate the thumbnail store
+    bool begin();
+
+    // Start of a new clip
+    void reset();
+
+    // Called for every frame written; takes a thumbnail when the next interval is due
+    bool offer(const uint8_t* jpeg, size_t len, uint16_t width, uint16_t height,
+               uint32_t frameIndex, uint32_t timestampMs, uint32_t aviOffset);
+
+    // Write "<clip>.thm" for the clip just closed
+    bool write(const String& aviPath, const ClipStats& stats);
+
+    // Status
+    int getThumbCount() const { return thumbCount; }
+    uint32_t getLastEncodeUs() const { return lastEncodeUs; }
+
+    // Sidecar files on the card
+    static String pathFor(const String& aviPath);
+    static bool remove(const String& aviPath);
+    static bool readInfo(const String& aviPath, String& info);
+    // Opens the sidecar positioned at thumbnail index, len is its JPEG size
+    static bool openThumb(const String& aviPath, int index, File& file, size_t& len);
+};
+
+#endif // CLIPSIDECAR_H
@@ -0,0 +1,323 @@
+#include "ConnectionManager.h"
+#include "HeapAccounting.h"
+
+static const size_t MAX_REQUEST_HEAD = 512;     // Request line and headers of request()
+static const size_t MAX_HEADER_LINE = 128;      // Longer response header lines are cut (none we read are)
+
+ConnectionManager::ConnectionManager(unsigned long idleTimeoutMs) {
+    this->idleTimeoutMs = idleTimeoutMs;
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        connections[i].host[0] = '\0';
+        connections[i].port = 0;
+        connections[i].secure = false;
+        connections[i].client = NULL;
+        connections[i].inUse = false;
+        connections[i].lastUsed = 0;
+        connections[i].requests = 0;
+        connections[i].tlsInternal = 0;
+        connections[i].tlsPsram = 0;
+    }
+    this->lock = xSemaphoreCreateMutex();
+    this->opened = 0;
+    this->reused = 0;
+}
+
+ConnectionManager::~ConnectionManager() {
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        closeSlot(connections[i]);
+    }
+    if (lock) vSemaphoreDelete(lock);
+}
+
+void ConnectionManager::closeSlot(Connection& conn) {
+    if (conn.client) {
+        conn.client->stop();
+        delete conn.client;
+        conn.client = NULL;
+    }
+    if (conn.tlsInternal || conn.tlsPsram) {
+        heapTls.add(-conn.tlsInternal, false);
+        heapTls.add(-conn.tlsPsram, true);
+        conn.tlsInternal = 0;
+        conn.tlsPsram = 0;
+    }
+    conn.host[0] = '\0';
+    conn.inUse = false;
+    conn.requests = 0;
+}
+
+WiFiClient* ConnectionManager::acquire(const char* host, int port, bool secure, bool* wasReused) {
+    if (wasReused) *wasReused = false;
+    if (WiFi.status() != WL_CONNECTED) {
+        return NULL;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    unsigned long now = millis();
+    Connection* slot = NULL;
+
+    // Prefer a warm idle connection to the same backend
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        Connection& conn = connections[i];
+        if (conn.inUse || conn.client == NULL) continue;
+        if (strcmp(conn.host, host) == 0 && conn.port == port && conn.secure == secure) {
+            if (conn.client->connected() && now - conn.lastUsed < idleTimeoutMs) {
+                slot = &conn;
+                break;
+            }
+            closeSlot(conn); // Server closed it or it sat idle too long
+        }
+    }
+    if (slot) {
+        slot->inUse = true;
+        reused++;
+        xSemaphoreGive(lock);
+        if (wasReused) *wasReused = true;
+        return slot->client;
+    }
+
+    // Otherwise an empty slot, or evict the least recently used idle one
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        Connection& conn = connections[i];
+        if (conn.inUse) continue;
+        if (conn.client == NULL) {
+            slot = &conn;
+            break;
+        }
+        if (slot == NULL || conn.lastUsed < slot->lastUsed) {
+            slot = &conn;
+        }
+    }
+    if (slot == NULL) {
+        xSemaphoreGive(lock);
+        Serial.println("ERROR: No free HTTP connection slot");
+        return NULL;
+    }
+    closeSlot(*slot);
+    slot->inUse = true; // Reserve before connecting outside the lock
+    xSemaphoreGive(lock);
+
+    // The TLS session (mbedTLS context and record buffers) is measured as the
+    // free-heap drop across the handshake, other tasks' allocations included
+    uint32_t internalBefore = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    uint32_t psramBefore = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    WiFiClient* client;
+    if (secure) {
+        WiFiClientSecure* tls = new WiFiClientSecure();
+        tls->setInsecure(); // For testing - use proper certificates in production
+        client = tls;
+    } else {
+        client = new WiFiClient();
+    }
+
+    unsigned long connectStart = millis();
+    if (!client->connect(host, port)) {
+        Serial.printf("Connection failed to %s:%d\n", host, port);
+        delete client;
+        xSemaphoreTake(lock, portMAX_DELAY);
+        slot->inUse = false;
+        xSemaphoreGive(lock);
+        return NULL;
+    }
+    client->setNoDelay(true);
+    Serial.printf("Opened %s connection to %s:%d (%lu ms)\n", secure ? "TLS" : "TCP",
+                  host, port, millis() - connectStart);
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    snprintf(slot->host, sizeof(slot->host), "%s", host);
+    slot->port = port;
+    slot->secure = secure;
+    slot->client = client;
+    slot->requests = 0;
+    if (secure) {
+        slot->tlsInternal = max((int32_t)0, (int32_t)(internalBefore - heap_caps_get_free_size(MALLOC_CAP_INTERNAL)));
+        slot->tlsPsram = max((int32_t)0, (int32_t)(psramBefore - heap_caps_get_free_size(MALLOC_CAP_SPIRAM)));
+        heapTls.add(slot->tlsInternal, false);
+        heapTls.add(slot->tlsPsram, true);
+    }
+    opened++;
+    xSemaphoreGive(lock);
+    return client;
+}
+
+void ConnectionManager::release(WiFiClient* client, bool keepAlive) {
+    if (client == NULL) {
+        return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        Connection& conn = connections[i];
+        if (conn.client == client) {
+            if (keepAlive && client->connected()) {
+                conn.inUse = false;
+                conn.lastUsed = millis();
+                conn.requests++;
+            } else {
+                closeSlot(conn);
+            }
+            break;
+        }
+    }
+    xSemaphoreGive(lock);
+}
+
+void ConnectionManager::closeIdle() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        if (!connections[i].inUse) {
+            closeSlot(connections[i]);
+        }
+    }
+    xSemaphoreGive(lock);
+}
+
+bool ConnectionManager::readLine(WiFiClient* client, char* line, size_t size, unsigned long deadline) {
+    size_t len = 0;
+    line[0] = '\0';
+    while ((long)(deadline - millis()) > 0) {
+        if (client->available()) {
+            int c = client->read();
+            if (c == '\n') {
+                while (len > 0 && isspace((unsigned char)line[len - 1])) len--;
+                line[len] = '\0';
+                return true;
+            }
+            if (c >= 0 && len + 1 < size) {
+                if (len == 0 && (c == ' ' || c == '\t')) continue;
+                line[len++] = (char)c;
+                line[len] = '\0';
+            }
+        } else if (!client->connected()) {
+            return false;
+        } else {
+            delay(1);
+        }
+    }
+    return false;
+}
+
+int ConnectionManager::readResponse(WiFiClient* client, char* body, size_t bodySize, unsigned long timeoutMs,
+                                    bool& keepAlive) {
+    unsigned long deadline = millis() + timeoutMs;
+    size_t bodyLen = 0;
+    if (body == NULL) bodySize = 0;
+    if (bodySize > 0) body[0] = '\0';
+    keepAlive = false;
+
+    // Status line
+    char line[MAX_HEADER_LINE];
+    if (!readLine(client, line, sizeof(line), deadline)) {
+        return 0;
+    }
+    int httpResponseCode = 0;
+    if (strncmp(line, "HTTP/1.", 7) == 0 && strlen(line) >= 12) {
+        httpResponseCode = atoi(line + 9);
+        keepAlive = line[7] == '1';
+    }
+
+    // Headers
+    long contentLength = -1;
+    bool chunked = false;
+    while (readLine(client, line, sizeof(line), deadline)) {
+        if (line[0] == '\0') break; // End of headers
+        for (char* p = line; *p; p++) *p = tolower((unsigned char)*p);
+        if (strncmp(line, "content-length:", 15) == 0) {
+            contentLength = atol(line + 15);
+        } else if (strncmp(line, "transfer-encoding:", 18) == 0 && strstr(line, "chunked") != NULL) {
+            chunked = true;
+        } else if (strncmp(line, "connection:", 11) == 0) {
+            keepAlive = strstr(line, "close") == NULL;
+        }
+    }
+
+    // Body - pieces that don't fit the caller's buffer are drained but not kept
+    uint8_t buf[256];
+    auto keep = [&](size_t got) {
+        if (bodyLen + got < bodySize) {
+            memcpy(body + bodyLen, buf, got);
+            bodyLen += got;
+        }
+    };
+    if (chunked) {
+        while (readLine(client, line, sizeof(line), deadline)) {
+            long chunkLen = strtol(line, NULL, 16);
+            if (chunkLen <= 0) {
+                readLine(client, line, sizeof(line), deadline); // Trailing CRLF
+                break;
+            }
+            while (chunkLen > 0 && (long)(deadline - millis()) > 0) {
+                size_t got = client->readBytes(buf, min((size_t)chunkLen, sizeof(buf)));
+                if (got == 0 && !client->connected()) break;
+                keep(got);
+                chunkLen -= got;
+            }
+            readLine(client, line, sizeof(line), deadline); // CRLF after chunk data
+        }
+    } else if (contentLength >= 0) {
+        long remaining = contentLength;
+        while (remaining > 0 && (long)(deadline - millis()) > 0) {
+            size_t got = client->readBytes(buf, min((size_t)remaining, sizeof(buf)));
+            if (got == 0 && !client->connected()) break;
+            keep(got);
+            remaining -= got;
+        }
+        if (remaining > 0) keepAlive = false;
+    } else {
+        // No length - body runs to connection close
+        while ((client->connected() || client->available()) && (long)(deadline - millis()) > 0) {
+            size_t got = client->readBytes(buf, sizeof(buf));
+            keep(got);
+        }
+        keepAlive = false;
+    }
+    if (bodySize > 0) {
+        while (bodyLen > 0 && isspace((unsigned char)body[bodyLen - 1])) bodyLen--;
+        body[bodyLen] = '\0';
+    }
+    return httpResponseCode;
+}
+
+int ConnectionManager::request(const char* host, int port, bool secure, const char* method, const char* path,
+                               const char* contentType, const uint8_t* body, size_t bodyLen,
+                               char* response, size_t responseSize, unsigned long timeoutMs,
+                               const char* extraHeaders) {
+    // Request line and headers go out in one write from a fixed buffer
+    char head[MAX_REQUEST_HEAD];
+    int headLen = snprintf(head, sizeof(head),
+                           "%s %s HTTP/1.1\r\n"
+                           "Host: %s:%d\r\n"
+                           "%s%s%s"
+                           "Content-Length: %u\r\n"
+                           "%s"
+                           "Connection: keep-alive\r\n\r\n",
+                           method, path, host, port,
+                           contentType ? "Content-Type: " : "", contentType ? contentType : "", contentType ? "\r\n" : "",
+                           (unsigned)bodyLen, extraHeaders ? extraHeaders : "");
+    if (headLen < 0 || (size_t)headLen >= sizeof(head)) {
+        Serial.printf("ERROR: Request headers for %s too long\n", path);
+        return 0;
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool wasReused = false;
+        WiFiClient* client = acquire(host, port, secure, &wasReused);
+        if (client == NULL) {
+            return 0;
+        }
+
+        bool sent = client->write((const uint8_t*)head, headLen) == (size_t)headLen;
+        if (sent && bodyLen > 0) {
+            sent = client->write(body, bodyLen) == bodyLen;
+        }
+
+        bool keepAlive = false;
+        int code = sent ? readResponse(client, response, responseSize, timeoutMs, keepAlive) : 0;
+        release(client, keepAlive);
+        if (code > 0 || !wasReused) {
+            return code;
+        }
+        // The reused socket had gone stale server-side - try once more on a new one
+        Serial.println("Keep-alive connection was stale, reconnecting");
+    }
+    return 0;
+}
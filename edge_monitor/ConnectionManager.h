@@ -0,0 +1,78 @@
+#ifndef CONNECTIONMANAGER_H
+#define CONNECTIONMANAGER_H
+
+#include "WiFi.h"
+#include "WiFiClientSecure.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "HttpEndpoint.h"
+
+/**
+ * ConnectionManager - small pool of persistent HTTP/1.1 connections
+ *
+ * Keeps one warm keep-alive connection per backend host (plus a spare
+ * for concurrent users), shared by video uploads and image streaming,
+ * so each request no longer pays TCP (and TLS) connection setup.
+ * A connection is used by one caller at a time: acquire() it, write the
+ * request, readResponse(), then release() it.
+ *
+ * Requests are formatted and responses parsed in fixed buffers, and the
+ * caller owns the response body buffer, so a request on a warm
+ * connection allocates nothing.
+ */
+class ConnectionManager {
+private:
+    struct Connection {
+        char host[HttpEndpoint::MAX_HOST];
+        int port;
+        bool secure;
+        WiFiClient* client;
+        bool inUse;
+        unsigned long lastUsed;
+        uint32_t requests;
+        int32_t tlsInternal;  // Heap the TLS session took, charged to heapTls until closed
+        int32_t tlsPsram;
+    };
+
+    static const int MAX_CONNECTIONS = 3;
+    Connection connections[MAX_CONNECTIONS];
+    unsigned long idleTimeoutMs;
+    SemaphoreHandle_t lock;
+
+    // Statistics
+    uint32_t opened;
+    uint32_t reused;
+
+    void closeSlot(Connection& conn);
+    // One header line into line (truncated to size), CR/LF and surrounding spaces stripped
+    bool readLine(WiFiClient* client, char* line, size_t size, unsigned long deadline);
+
+public:
+    // Constructor - idle connections older than idleTimeoutMs are reopened rather than reused
+    ConnectionManager(unsigned long idleTimeoutMs = 60000);
+    ~ConnectionManager();
+
+    // Exclusive use of a connected client for host:port (NULL if it can't connect)
+    WiFiClient* acquire(const char* host, int port, bool secure, bool* wasReused = NULL);
+    // Hand the client back; keepAlive=false closes it (errors, Connection: close)
+    void release(WiFiClient* client, bool keepAlive);
+    // Close every idle connection (e.g. after WiFi reconnect)
+    void closeIdle();
+
+    // Read one response on a keep-alive connection, honouring Content-Length / chunked.
+    // The body goes to body (NUL terminated, cut at bodySize - 1; NULL drains it).
+    // Returns the status code (0 on timeout); keepAlive reports whether the server keeps the socket.
+    int readResponse(WiFiClient* client, char* body, size_t bodySize, unsigned long timeoutMs, bool& keepAlive);
+
+    // One-shot request with a small in-memory body, with a retry on a fresh socket if a reused one was stale.
+    // extraHeaders are complete "Name: value\r\n" lines.
+    int request(const char* host, int port, bool secure, const char* method, const char* path,
+                const char* contentType, const uint8_t* body, size_t bodyLen,
+                char* response, size_t responseSize, unsigned long timeoutMs, const char* extraHeaders = "");
+
+    // Statistics
+    uint32_t getOpenedCount() const { return opened; }
+    uint32_t getReusedCount() const { return reused; }
+};
+
+#endif // CONNECTIONMANAGER_H
@@ -0,0 +1,233 @@
+#include "FrameRing.h"
+#include "HeapAccounting.h"
+#include "Metrics.h"
+
+// Keep every frame start DWORD aligned in the arena
+static inline size_t alignUp4(size_t len) {
+    return (len + 3) & ~((size_t)3);
+}
+
+FrameRing::FrameRing(size_t arenaBytes, int maxFrames) {
+    this->arena = NULL;
+    this->arenaSize = alignUp4(arenaBytes);
+    this->slots = NULL;
+    this->maxSlots = maxFrames;
+
+    this->readIdx = 0;
+    this->writeIdx = 0;
+    this->frameCount = 0;
+    this->head = 0;
+    this->bytesInUse = 0;
+    this->nextSeq = 0;
+    this->preRollFrames = 0;
+
+    this->droppedFrames = 0;
+    this->highWaterFrames = 0;
+    this->highWaterBytes = 0;
+
+    this->lock = NULL;
+    this->framesReady = NULL;
+}
+
+FrameRing::~FrameRing() {
+    heapFrameRing.release(arena);
+    heapFrameRing.release(slots);
+    if (lock) vSemaphoreDelete(lock);
+    if (framesReady) vSemaphoreDelete(framesReady);
+}
+
+bool FrameRing::begin() {
+    if (arena != NULL) {
+        return true; // Already initialized
+    }
+
+    // Never take more than half of the free PSRAM, the camera and uploads need the rest
+    size_t freePsram = ESP.getFreePsram();
+    if (freePsram > 0) {
+        if (arenaSize > freePsram / 2) {
+            Serial.printf("FrameRing: reducing arena from %u KB to %u KB (free PSRAM %u KB)\n",
+                          arenaSize / 1024, (freePsram / 2) / 1024, freePsram / 1024);
+            arenaSize = alignUp4(freePsram / 2);
+        }
+        arena = (uint8_t*)heapFrameRing.alloc(arenaSize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    if (arena == NULL) {
+        // No PSRAM - fall back to a small DRAM arena (QQVGA frames are only a few KB)
+        arenaSize = 64 * 1024;
+        arena = (uint8_t*)heapFrameRing.alloc(arenaSize, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    slots = (Slot*)heapFrameRing.alloc(sizeof(Slot) * maxSlots, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+
+    lock = xSemaphoreCreateMutex();
+    framesReady = xSemaphoreCreateCounting(maxSlots, 0);
+
+    if (arena == NULL || slots == NULL || lock == NULL || framesReady == NULL) {
+        Serial.println("ERROR: FrameRing allocation failed!");
+        return false;
+    }
+
+    Serial.printf("FrameRing ready: %u KB arena, %d frame slots (%s)\n",
+                  arenaSize / 1024, maxSlots, freePsram > 0 ? "PSRAM" : "DRAM");
+    return true;
+}
+
+bool FrameRing::reserve(size_t need, size_t& offset) {
+    // Called with lock held. Frames are stored contiguously, so if the tail
+    // end of the arena is too small the frame wraps to the start instead.
+    if (frameCount == 0) {
+        head = 0; // Empty ring - reset for the largest contiguous space
+        offset = 0;
+        return need <= arenaSize;
+    }
+
+    size_t tail = slots[readIdx].offset;
+    if (head > tail) {
+        // Free space is [head, arenaSize) and [0, tail)
+        if (arenaSize - head >= need) {
+            offset = head;
+            return true;
+        }
+        if (tail >= need) {
+            offset = 0;
+            return true;
+        }
+        return false;
+    }
+    if (head < tail) {
+        // Free space is [head, tail)
+        if (tail - head >= need) {
+            offset = head;
+            return true;
+        }
+        return false;
+    }
+    return false; // head == tail with frames queued: arena is full
+}
+
+void FrameRing::evictOldest() {
+    // Called with lock held, only while no consumer is reading
+    xSemaphoreTake(framesReady, 0);
+    bytesInUse -= alignUp4(slots[readIdx].len);
+    readIdx = (readIdx + 1) % maxSlots;
+    frameCount--;
+}
+
+bool FrameRing::push(const uint8_t* data, size_t len, uint32_t timestampMs) {
+    if (arena == NULL || data == NULL || len == 0) {
+        return false;
+    }
+
+    size_t need = alignUp4(len);
+    size_t offset = 0;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (preRollFrames > 0) {
+        // Pre-roll: forget the oldest frames rather than drop this one
+        while (frameCount > 0 && (frameCount >= preRollFrames || frameCount >= maxSlots || !reserve(need, offset))) {
+            evictOldest();
+        }
+    }
+    bool ok = (frameCount < maxSlots) && reserve(need, offset);
+    if (!ok) {
+        droppedFrames++;
+        metricFramesDropped.inc();
+        xSemaphoreGive(lock);
+        return false;
+    }
+    // Claim the space now; the consumer can't see the slot until it is committed below
+    head = offset + need;
+    if (head >= arenaSize) head = 0;
+    bytesInUse += need;
+    xSemaphoreGive(lock);
+
+    // Copy outside the lock so the writer task is never held up by a large memcpy
+    memcpy(arena + offset, data, len);
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    Slot& slot = slots[writeIdx];
+    slot.offset = offset;
+    slot.len = len;
+    slot.timestampMs = timestampMs;
+    slot.seq = nextSeq++;
+    writeIdx = (writeIdx + 1) % maxSlots;
+    frameCount++;
+    if (frameCount > highWaterFrames) highWaterFrames = frameCount;
+    if (bytesInUse > highWaterBytes) highWaterBytes = bytesInUse;
+    xSemaphoreGive(lock);
+
+    xSemaphoreGive(framesReady);
+    return true;
+}
+
+bool FrameRing::peek(Frame& frame, uint32_t waitMs) {
+    if (arena == NULL) {
+        return false;
+    }
+    if (xSemaphoreTake(framesReady, pdMS_TO_TICKS(waitMs)) != pdTRUE) {
+        return false;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    const Slot& slot = slots[readIdx];
+    frame.buf = arena + slot.offset;
+    frame.len = slot.len;
+    frame.timestampMs = slot.timestampMs;
+    frame.seq = slot.seq;
+    xSemaphoreGive(lock);
+    return true;
+}
+
+bool FrameRing::peekNewest(Frame& frame) {
+    if (arena == NULL) {
+        return false;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool ok = frameCount > 0;
+    if (ok) {
+        const Slot& slot = slots[(writeIdx + maxSlots - 1) % maxSlots];
+        frame.buf = arena + slot.offset;
+        frame.len = slot.len;
+        frame.timestampMs = slot.timestampMs;
+        frame.seq = slot.seq;
+    }
+    xSemaphoreGive(lock);
+    return ok;
+}
+
+void FrameRing::setPreRoll(int frames) {
+    if (lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    preRollFrames = frames;
+    xSemaphoreGive(lock);
+}
+
+void FrameRing::release() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (frameCount > 0) {
+        bytesInUse -= alignUp4(slots[readIdx].len);
+        readIdx = (readIdx + 1) % maxSlots;
+        frameCount--;
+    }
+    xSemaphoreGive(lock);
+}
+
+void FrameRing::clear() {
+    if (arena == NULL) {
+        return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    while (xSemaphoreTake(framesReady, 0) == pdTRUE) {
+        // Drain pending frame signals
+    }
+    readIdx = writeIdx = frameCount = 0;
+    head = bytesInUse = 0;
+    xSemaphoreGive(lock);
+}
+
+void FrameRing::resetStats() {
+    droppedFrames = 0;
+    highWaterFrames = frameCount;
+    highWaterBytes = bytesInUse;
+}
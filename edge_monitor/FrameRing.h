@@ -0,0 +1,99 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+/**
+ * FrameRing - PSRAM ring of compressed camera frames
+ *
+ * Single producer (capture task) / single consumer (SD writer task).
+ * JPEG data is copied into one contiguous PSRAM arena so the camera
+ * frame buffer can be returned to the driver immediately, and a fixed
+ * table of descriptors tracks where each frame lives in the arena.
+ *
+ * A frame that does not fit (arena or descriptor table full) is dropped
+ * and counted, so a slow SD card never stalls the capture side.
+ * Before a motion triggered clip the ring runs as a pre-roll buffer
+ * instead: push() evicts the oldest frames to keep the newest ones.
+ */
+class FrameRing {
+public:
+    struct Frame {
+        const uint8_t* buf;
+        size_t len;
+        uint32_t timestampMs;
+        uint32_t seq;
+    };
+
+private:
+    struct Slot {
+        size_t offset;
+        size_t len;
+        uint32_t timestampMs;
+        uint32_t seq;
+    };
+
+    uint8_t* arena;
+    size_t arenaSize;
+    Slot* slots;
+    int maxSlots;
+
+    // Ring state, guarded by lock
+    int readIdx;
+    int writeIdx;
+    int frameCount;
+    size_t head;        // next free byte in the arena
+    size_t bytesInUse;
+    uint32_t nextSeq;
+    int preRollFrames;  // > 0 while no consumer runs: keep only the newest frames
+
+    // Statistics
+    uint32_t droppedFrames;
+    int highWaterFrames;
+    size_t highWaterBytes;
+
+    SemaphoreHandle_t lock;
+    SemaphoreHandle_t framesReady;
+
+    bool reserve(size_t need, size_t& offset);
+    void evictOldest();
+
+public:
+    FrameRing(size_t arenaBytes = 2 * 1024 * 1024, int maxFrames = 48);
+    ~FrameRing();
+
+    // Allocate arena and descriptors; returns false if memory is unavailable
+    bool begin();
+
+    // Producer side: copy a frame into the ring, false if it was dropped
+    bool push(const uint8_t* data, size_t len, uint32_t timestampMs);
+
+    // Producer side: the frame pushed last, valid until the producer pushes again
+    bool peekNewest(Frame& frame);
+
+    // Keep at most this many frames, evicting the oldest; 0 = normal queue.
+    // Only enable while no consumer is reading, disabling is always safe.
+    void setPreRoll(int frames);
+
+    // Consumer side: wait for the oldest frame, then release it once written
+    bool peek(Frame& frame, uint32_t waitMs);
+    void release();
+
+    // Drop everything queued (only call when no consumer holds a frame)
+    void clear();
+    void resetStats();
+
+    // Status
+    int count() const { return frameCount; }
+    bool isEmpty() const { return frameCount == 0; }
+    size_t getBytesUsed() const { return bytesInUse; }
+    size_t getCapacityBytes() const { return arenaSize; }
+    int getMaxFrames() const { return maxSlots; }
+    uint32_t getDroppedFrames() const { return droppedFrames; }
+    int getHighWaterFrames() const { return highWaterFrames; }
+    size_t getHighWaterBytes() const { return highWaterBytes; }
+};
+
+#endif // FRAMERING_H
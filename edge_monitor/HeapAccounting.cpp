@@ -0,0 +1,169 @@
+#include "HeapAccounting.h"
+#include "esp_memory_utils.h"
+
+HeapTag* HeapAccounting::head = NULL;
+HeapTag* HeapAccounting::tail = NULL;
+std::atomic<uint32_t> HeapAccounting::failedAllocs(0);
+std::atomic<uint32_t> HeapAccounting::lastFailedSize(0);
+std::atomic<uint32_t> HeapAccounting::lastFailedCaps(0);
+
+HeapTag heapFrameRing("frame_ring");
+HeapTag heapRecorder("recorder");
+HeapTag heapMotion("motion");
+HeapTag heapStream("stream");
+HeapTag heapClips("clips");
+HeapTag heapUpload("upload");
+HeapTag heapStatus("status");
+HeapTag heapJson("json");
+HeapTag heapTls("tls");
+HeapTag heapCamera("camera");
+
+static const struct {
+    const char* name;
+    uint32_t caps;
+} HEAP_CAPS[HeapAccounting::NUM_CAPS] = {
+    {"internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT},
+    {"psram", MALLOC_CAP_SPIRAM},
+    {"dma", MALLOC_CAP_DMA},
+};
+
+HeapTag::HeapTag(const char* name) {
+    this->name = name;
+    this->next = NULL;
+    internalBytes.store(0, std::memory_order_relaxed);
+    psramBytes.store(0, std::memory_order_relaxed);
+    peakBytes.store(0, std::memory_order_relaxed);
+    allocs.store(0, std::memory_order_relaxed);
+    failures.store(0, std::memory_order_relaxed);
+    // Static construction happens before any task starts, no lock needed
+    if (HeapAccounting::tail) {
+        HeapAccounting::tail->next = this;
+    } else {
+        HeapAccounting::head = this;
+    }
+    HeapAccounting::tail = this;
+}
+
+void HeapTag::updatePeak() {
+    int32_t live = getLiveBytes();
+    int32_t peak = peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+void HeapTag::account(void* ptr, int sign) {
+    int32_t bytes = sign * (int32_t)heap_caps_get_allocated_size(ptr);
+    if (esp_ptr_external_ram(ptr)) {
+        psramBytes.fetch_add(bytes, std::memory_order_relaxed);
+    } else {
+        internalBytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    if (sign > 0) {
+        updatePeak();
+    }
+}
+
+void* HeapTag::alloc(size_t size, uint32_t caps) {
+    void* ptr = heap_caps_malloc(size, caps);
+    if (ptr == NULL) {
+        failures.fetch_add(1, std::memory_order_relaxed);
+        return NULL;
+    }
+    allocs.fetch_add(1, std::memory_order_relaxed);
+    account(ptr, 1);
+    return ptr;
+}
+
+void* HeapTag::allocPreferPsram(size_t size) {
+    if (ESP.getFreePsram() > 0) {
+        return alloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    return alloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+}
+
+void* HeapTag::realloc(void* ptr, size_t size, uint32_t caps) {
+    if (ptr == NULL) {
+        return alloc(size, caps);
+    }
+    account(ptr, -1);
+    void* grown = heap_caps_realloc(ptr, size, caps);
+    if (grown == NULL) {
+        // The original block is still ours
+        account(ptr, 1);
+        failures.fetch_add(1, std::memory_order_relaxed);
+        return NULL;
+    }
+    account(grown, 1);
+    return grown;
+}
+
+void HeapTag::release(void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    account(ptr, -1);
+    heap_caps_free(ptr);
+}
+
+void HeapTag::add(int32_t bytes, bool psram) {
+    if (psram) {
+        psramBytes.fetch_add(bytes, std::memory_order_relaxed);
+    } else {
+        internalBytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    if (bytes > 0) {
+        updatePeak();
+    }
+}
+
+void HeapAccounting::onAllocFailed(size_t size, uint32_t caps, const char* functionName) {
+    // Runs inside the failing allocator - record only, no logging (that would allocate)
+    failedAllocs.fetch_add(1, std::memory_order_relaxed);
+    lastFailedSize.store((uint32_t)size, std::memory_order_relaxed);
+    lastFailedCaps.store(caps, std::memory_order_relaxed);
+}
+
+void HeapAccounting::begin() {
+    if (heap_caps_register_failed_alloc_callback(onAllocFailed) != ESP_OK) {
+        Serial.println("WARNING: Failed to hook heap allocation failures");
+    }
+}
+
+bool HeapAccounting::getCapInfo(int index, HeapCapInfo& info) {
+    if (index < 0 || index >= NUM_CAPS) {
+        return false;
+    }
+    uint32_t caps = HEAP_CAPS[index].caps;
+    info.name = HEAP_CAPS[index].name;
+    info.totalBytes = heap_caps_get_total_size(caps);
+    if (info.totalBytes == 0) {
+        return false;
+    }
+    info.freeBytes = heap_caps_get_free_size(caps);
+    info.largestBlock = heap_caps_get_largest_free_block(caps);
+    info.minFree = heap_caps_get_minimum_free_size(caps);
+    info.fragmentation = info.freeBytes > 0 ? 100.0f * (1.0f - (float)info.largestBlock / info.freeBytes) : 0.0f;
+    return true;
+}
+
+void HeapAccounting::print(const char* caller) {
+    Serial.printf("=== Heap (%s) ===\n", caller);
+    for (int i = 0; i < NUM_CAPS; i++) {
+        HeapCapInfo info;
+        if (!getCapInfo(i, info)) {
+            continue;
+        }
+        Serial.printf("  %-8s free %6u KB, largest block %6u KB, min free %6u KB, fragmentation %.1f%%\n",
+                      info.name, info.freeBytes / 1024, info.largestBlock / 1024, info.minFree / 1024,
+                      info.fragmentation);
+    }
+    for (HeapTag* tag = head; tag; tag = tag->next) {
+        Serial.printf("  %-10s internal %7d B, psram %8d B, peak %8d B, allocs %u, failures %u\n",
+                      tag->name, tag->getInternalBytes(), tag->getPsramBytes(), tag->getPeakBytes(),
+                      tag->getAllocs(), tag->getFailures());
+    }
+    if (getFailedAllocs() > 0) {
+        Serial.printf("  Failed allocations: %u (last %u bytes, caps 0x%x)\n",
+                      getFailedAllocs(), getLastFailedSize(), getLastFailedCaps());
+    }
+}
@@ -0,0 +1,118 @@
+#ifndef HEAP_ACCOUNTING_H
+#define HEAP_ACCOUNTING_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "esp_heap_caps.h"
+
+/**
+ * HeapAccounting - live bytes and peak per subsystem, plus heap fragmentation
+ *
+ * Each HeapTag is a static object that links itself into a registry at
+ * construction (like Metric), so tags cost no allocation and updates are
+ * relaxed atomic adds from any task. Subsystems allocate their long-lived
+ * buffers through their tag; the size charged is the block the heap actually
+ * handed out (heap_caps_get_allocated_size), split by internal RAM and PSRAM.
+ *
+ * Memory that is not allocated through a tag (the camera driver's frame
+ * buffers, the TLS stack behind WiFiClientSecure) is charged with add() from
+ * a free-heap delta measured by the caller. That delta also catches other
+ * tasks allocating at the same moment, so treat those tags as estimates.
+ *
+ * Per heap capability the report gives free bytes, the largest free block
+ * and the low-water mark; a large free total with a small largest block is
+ * fragmentation, which is what makes a big malloc fail with memory "free".
+ */
+
+class HeapTag {
+    friend class HeapAccounting;
+private:
+    const char* name;
+    HeapTag* next;
+    std::atomic<int32_t> internalBytes;
+    std::atomic<int32_t> psramBytes;
+    std::atomic<int32_t> peakBytes;
+    std::atomic<uint32_t> allocs;
+    std::atomic<uint32_t> failures;
+
+    // Charge (sign 1) or credit (sign -1) the block behind ptr
+    void account(void* ptr, int sign);
+    void updatePeak();
+
+public:
+    HeapTag(const char* name);
+
+    // heap_caps_malloc() charged to this tag, NULL on failure
+    void* alloc(size_t size, uint32_t caps);
+    // PSRAM when the board has any, internal RAM otherwise - the ps_malloc/malloc split the modules used
+    void* allocPreferPsram(size_t size);
+    // Resize an allocation made through this tag, same caps as the original
+    void* realloc(void* ptr, size_t size, uint32_t caps);
+    // Free an allocation made through this tag (NULL is fine)
+    void release(void* ptr);
+    // Memory held outside the tag's allocators, measured by the caller (negative to give back)
+    void add(int32_t bytes, bool psram);
+
+    const char* getName() const { return name; }
+    int32_t getInternalBytes() const { return internalBytes.load(std::memory_order_relaxed); }
+    int32_t getPsramBytes() const { return psramBytes.load(std::memory_order_relaxed); }
+    int32_t getLiveBytes() const { return getInternalBytes() + getPsramBytes(); }
+    int32_t getPeakBytes() const { return peakBytes.load(std::memory_order_relaxed); }
+    uint32_t getAllocs() const { return allocs.load(std::memory_order_relaxed); }
+    uint32_t getFailures() const { return failures.load(std::memory_order_relaxed); }
+};
+
+struct HeapCapInfo {
+    const char* name;
+    uint32_t freeBytes;
+    uint32_t largestBlock;
+    uint32_t minFree;        // Low-water mark since boot
+    uint32_t totalBytes;
+    float fragmentation;     // 0-100, share of free memory not usable as one block
+};
+
+class HeapAccounting {
+private:
+    static HeapTag* head;
+    static HeapTag* tail;
+    friend class HeapTag;
+
+    // Allocation failures anywhere in the firmware, from the heap's failed-alloc hook
+    static std::atomic<uint32_t> failedAllocs;
+    static std::atomic<uint32_t> lastFailedSize;
+    static std::atomic<uint32_t> lastFailedCaps;
+    static void onAllocFailed(size_t size, uint32_t caps, const char* functionName);
+
+public:
+    static const int NUM_CAPS = 3;
+
+    // Hooks allocation failures; tags work without it
+    static void begin();
+
+    static HeapTag* first() { return head; }
+    static HeapTag* nextTag(const HeapTag* tag) { return tag->next; }
+
+    // index 0..NUM_CAPS-1: internal, psram, dma. False when the board has none of that memory
+    static bool getCapInfo(int index, HeapCapInfo& info);
+
+    static uint32_t getFailedAllocs() { return failedAllocs.load(std::memory_order_relaxed); }
+    static uint32_t getLastFailedSize() { return lastFailedSize.load(std::memory_order_relaxed); }
+    static uint32_t getLastFailedCaps() { return lastFailedCaps.load(std::memory_order_relaxed); }
+
+    // Per-tag and per-cap table on Serial
+    static void print(const char* caller);
+};
+
+// Subsystem tags (defined in HeapAccounting.cpp)
+extern HeapTag heapFrameRing;
+extern HeapTag heapRecorder;
+extern HeapTag heapMotion;
+extern HeapTag heapStream;
+extern HeapTag heapClips;
+extern HeapTag heapUpload;
+extern HeapTag heapStatus;
+extern HeapTag heapJson;
+extern HeapTag heapTls;
+extern HeapTag heapCamera;
+
+#endif // HEAP_ACCOUNTING_H
@@ -0,0 +1,48 @@
+#include "HttpEndpoint.h"
+
+HttpEndpoint::HttpEndpoint() {
+    this->host[0] = '\0';
+    this->path[0] = '\0';
+    this->port = 80;
+    this->secure = false;
+}
+
+bool HttpEndpoint::parse(const char* url, const char* defaultPath) {
+    host[0] = '\0';
+    path[0] = '\0';
+    secure = false;
+    port = 80;
+
+    if (strncmp(url, "https://", 8) == 0) {
+        secure = true;
+        port = 443;
+        url += 8;
+    } else if (strncmp(url, "http://", 7) == 0) {
+        url += 7;
+    }
+
+    const char* slash = strchr(url, '/');
+    const char* hostEnd = slash ? slash : url + strlen(url);
+    const char* colon = (const char*)memchr(url, ':', hostEnd - url);
+    const char* nameEnd = colon ? colon : hostEnd;
+    size_t hostLen = nameEnd - url;
+    const char* pathPart = slash ? slash : defaultPath;
+    if (hostLen == 0 || hostLen >= sizeof(host) || strlen(pathPart) >= sizeof(path)) {
+        Serial.printf("ERROR: Cannot use URL %s (host or path too long)\n", url);
+        return false;
+    }
+    memcpy(host, url, hostLen);
+    host[hostLen] = '\0';
+    if (colon) {
+        port = atoi(colon + 1);
+    }
+    strcpy(path, pathPart);
+    return true;
+}
+
+void HttpEndpoint::set(const char* host, int port, const char* path, bool secure) {
+    snprintf(this->host, sizeof(this->host), "%s", host);
+    snprintf(this->path, sizeof(this->path), "%s", path);
+    this->port = port;
+    this->secure = secure;
+}
@@ -0,0 +1,31 @@
+#ifndef HTTPENDPOINT_H
+#define HTTPENDPOINT_H
+
+#include <Arduino.h>
+
+/**
+ * HttpEndpoint - a backend URL parsed once into fixed fields
+ *
+ * "http(s)://host[:port][/path]" is split at setup into host, port,
+ * scheme and path, so the upload and snapshot paths format requests
+ * from these fields instead of re-parsing a URL String per request.
+ */
+struct HttpEndpoint {
+    static const size_t MAX_HOST = 64;
+    static const size_t MAX_PATH = 96;
+
+    char host[MAX_HOST];
+    char path[MAX_PATH];
+    int port;
+    bool secure;
+
+    HttpEndpoint();
+
+    // Parse url; a missing path becomes defaultPath. False (and invalid) if a part doesn't fit
+    bool parse(const char* url, const char* defaultPath = "/");
+    // From parts already split (e.g. the configured server IP and port)
+    void set(const char* host, int port, const char* path, bool secure = false);
+    bool isValid() const { return host[0] != '\0'; }
+};
+
+#endif // HTTPENDPOINT_H
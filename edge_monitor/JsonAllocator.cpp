@@ -0,0 +1,3 @@
+#include "JsonAllocator.h"
+
+JsonAllocator jsonAllocator(heapJson);
@@ -0,0 +1,30 @@
+#ifndef JSON_ALLOCATOR_H
+#define JSON_ALLOCATOR_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "HeapAccounting.h"
+
+/**
+ * JsonAllocator - ArduinoJson allocator that charges a HeapTag
+ *
+ * Memory lands where ArduinoJson's default malloc would put it; the only
+ * difference is that request and response documents built with
+ * JsonDocument doc(&jsonAllocator) show up under "json" in the heap report.
+ */
+class JsonAllocator : public ArduinoJson::Allocator {
+private:
+    HeapTag& tag;
+
+public:
+    explicit JsonAllocator(HeapTag& tag) : tag(tag) {}
+
+    void* allocate(size_t size) override { return tag.alloc(size, MALLOC_CAP_DEFAULT); }
+    void deallocate(void* ptr) override { tag.release(ptr); }
+    void* reallocate(void* ptr, size_t newSize) override { return tag.realloc(ptr, newSize, MALLOC_CAP_DEFAULT); }
+};
+
+// Shared by the HTTP handlers and the upload path (defined in JsonAllocator.cpp)
+extern JsonAllocator jsonAllocator;
+
+#endif // JSON_ALLOCATOR_H
@@ -0,0 +1,183 @@
+#include "LiveStream.h"
+#include "HeapAccounting.h"
+
+#define PART_BOUNDARY "123456789000000000000987654321"
+static const char* STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=" PART_BOUNDARY;
+static const char* STREAM_BOUNDARY = "\r\n--" PART_BOUNDARY "\r\n";
+static const char* STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp: %lu\r\n\r\n";
+static const TickType_t FRAME_WAIT_MS = 1000;
+
+LiveStream::LiveStream(size_t maxFrameBytes, unsigned long idleFrameIntervalMs) {
+    this->maxFrameBytes = maxFrameBytes;
+    this->idleFrameIntervalMs = idleFrameIntervalMs;
+    for (int i = 0; i < 2; i++) {
+        frames[i] = NULL;
+        frameLen[i] = 0;
+        frameTimestamp[i] = 0;
+    }
+    this->latest = -1;
+    this->reading = -1;
+    this->lock = xSemaphoreCreateMutex();
+    this->frameReady = xSemaphoreCreateBinary();
+    this->httpd = NULL;
+    this->port = 0;
+    this->viewerActive = false;
+    this->framesPublished = 0;
+    this->framesSent = 0;
+    this->oversizeFrames = 0;
+    this->sessions = 0;
+}
+
+LiveStream::~LiveStream() {
+    stopServer();
+    for (int i = 0; i < 2; i++) {
+        heapStream.release(frames[i]);
+    }
+    if (lock) vSemaphoreDelete(lock);
+    if (frameReady) vSemaphoreDelete(frameReady);
+}
+
+bool LiveStream::begin() {
+    if (frames[0] != NULL) {
+        return true; // Already initialized
+    }
+    for (int i = 0; i < 2; i++) {
+        frames[i] = (uint8_t*)heapStream.alloc(maxFrameBytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (frames[i] == NULL) {
+            Serial.println("ERROR: LiveStream frame buffer allocation failed!");
+            return false;
+        }
+    }
+    Serial.printf("LiveStream ready: 2 x %u KB frame buffers\n", maxFrameBytes / 1024);
+    return true;
+}
+
+bool LiveStream::startServer(uint16_t port) {
+    stopServer();
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = port;
+    config.ctrl_port += 1;           // Must differ from the control server's
+    config.max_uri_handlers = 1;
+    config.max_open_sockets = 2;     // One viewer plus a waiting reconnect
+    config.stack_size = 4096;
+    config.core_id = 0;
+    config.task_priority = 3;        // Below the SD writer, above uploads
+
+    httpd_uri_t stream_uri = {
+        .uri       = "/stream",
+        .method    = HTTP_GET,
+        .handler   = streamHandler,
+        .user_ctx  = this
+    };
+
+    if (httpd_start(&httpd, &config) != ESP_OK) {
+        httpd = NULL;
+        Serial.println("Failed to start live stream server");
+        return false;
+    }
+    httpd_register_uri_handler(httpd, &stream_uri);
+    this->port = port;
+    Serial.printf("Live stream server started on port %d (/stream)\n", port);
+    return true;
+}
+
+void LiveStream::stopServer() {
+    if (httpd != NULL) {
+        httpd_stop(httpd);
+        httpd = NULL;
+    }
+    viewerActive = false;
+}
+
+void LiveStream::publish(const uint8_t* jpeg, size_t len, uint32_t timestampMs) {
+    if (!viewerActive || frames[0] == NULL) {
+        return;
+    }
+    if (len > maxFrameBytes) {
+        oversizeFrames++;
+        return;
+    }
+
+    // Fill the buffer that isn't being sent; if the stream is still on the older
+    // one, overwrite the unsent latest frame instead
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int slot = (latest == 0) ? 1 : 0;
+    if (slot == reading) {
+        slot = 1 - reading;
+        latest = -1;
+    }
+    xSemaphoreGive(lock);
+
+    memcpy(frames[slot], jpeg, len);
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    frameLen[slot] = len;
+    frameTimestamp[slot] = timestampMs;
+    latest = slot;
+    framesPublished++;
+    xSemaphoreGive(lock);
+    xSemaphoreGive(frameReady);
+}
+
+esp_err_t LiveStream::streamHandler(httpd_req_t* req) {
+    return ((LiveStream*)req->user_ctx)->serve(req);
+}
+
+esp_err_t LiveStream::serve(httpd_req_t* req) {
+    if (frames[0] == NULL) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    esp_err_t res = httpd_resp_set_type(req, STREAM_CONTENT_TYPE);
+    if (res != ESP_OK) {
+        return res;
+    }
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    latest = -1; // Don't replay a frame from a previous session
+    xSemaphoreGive(lock);
+    xSemaphoreTake(frameReady, 0);
+    viewerActive = true;
+    sessions++;
+    Serial.println("Live stream viewer connected");
+
+    char partBuf[128];
+    uint32_t sent = 0;
+    unsigned long startMs = millis();
+    while (res == ESP_OK) {
+        if (xSemaphoreTake(frameReady, pdMS_TO_TICKS(FRAME_WAIT_MS)) != pdTRUE) {
+            continue; // Camera busy or reconfiguring
+        }
+        xSemaphoreTake(lock, portMAX_DELAY);
+        int slot = latest;
+        reading = slot;
+        xSemaphoreGive(lock);
+        if (slot < 0) {
+            continue;
+        }
+
+        size_t hlen = snprintf(partBuf, sizeof(partBuf), STREAM_PART,
+                               (unsigned)frameLen[slot], (unsigned long)frameTimestamp[slot]);
+        res = httpd_resp_send_chunk(req, STREAM_BOUNDARY, strlen(STREAM_BOUNDARY));
+        if (res == ESP_OK) res = httpd_resp_send_chunk(req, partBuf, hlen);
+        if (res == ESP_OK) res = httpd_resp_send_chunk(req, (const char*)frames[slot], frameLen[slot]);
+
+        xSemaphoreTake(lock, portMAX_DELAY);
+        reading = -1;
+        xSemaphoreGive(lock);
+        if (res == ESP_OK) {
+            sent++;
+            framesSent++;
+        }
+    }
+
+    // Send error means the browser closed the stream
+    viewerActive = false;
+    float secs = (millis() - startMs) / 1000.0f;
+    Serial.printf("Live stream viewer left: %lu frames in %.1fs (%.1f fps)\n",
+                  (unsigned long)sent, secs, secs > 0 ? sent / secs : 0);
+    return ESP_OK;
+}
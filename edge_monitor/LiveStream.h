@@ -0,0 +1,73 @@
+#ifndef LIVESTREAM_H
+#define LIVESTREAM_H
+
+#include <Arduino.h>
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+/**
+ * LiveStream - MJPEG live view on its own HTTP server
+ *
+ * Serves multipart/x-mixed-replace on /stream from a separate httpd
+ * instance (own port and task), so a long-lived stream never blocks
+ * the control API. Frames are not grabbed here: the recorder's capture
+ * task publish()es a copy of each frame it already holds, and between
+ * recordings grabs preview frames only while a viewer is connected.
+ *
+ * Two PSRAM frame buffers: the capture task fills one while the stream
+ * sends the other, and a slow viewer just skips to the latest frame.
+ */
+class LiveStream {
+private:
+    uint8_t* frames[2];
+    size_t frameLen[2];
+    uint32_t frameTimestamp[2];
+    size_t maxFrameBytes;
+    unsigned long idleFrameIntervalMs;
+
+    // Buffer state, guarded by lock
+    int latest;     // newest complete frame, -1 if none
+    int reading;    // frame being sent, -1 if none
+    SemaphoreHandle_t lock;
+    SemaphoreHandle_t frameReady;
+
+    httpd_handle_t httpd;
+    uint16_t port;
+    volatile bool viewerActive;
+
+    // Statistics
+    uint32_t framesPublished;
+    uint32_t framesSent;
+    uint32_t oversizeFrames;
+    uint32_t sessions;
+
+    static esp_err_t streamHandler(httpd_req_t* req);
+    esp_err_t serve(httpd_req_t* req);
+
+public:
+    // Constructor - idleFrameIntervalMs paces preview frames while not recording
+    LiveStream(size_t maxFrameBytes = 256 * 1024, unsigned long idleFrameIntervalMs = 100);
+    ~LiveStream();
+
+    // Allocate the frame buffers
+    bool begin();
+
+    // Start / stop the stream httpd (restarted with the control server on WiFi reconnect)
+    bool startServer(uint16_t port);
+    void stopServer();
+
+    // Capture task side - copies the frame only when someone is watching
+    void publish(const uint8_t* jpeg, size_t len, uint32_t timestampMs);
+    bool hasViewer() const { return viewerActive; }
+    unsigned long getIdleFrameIntervalMs() const { return idleFrameIntervalMs; }
+
+    // Status and information
+    uint16_t getPort() const { return port; }
+    uint32_t getFramesPublished() const { return framesPublished; }
+    uint32_t getFramesSent() const { return framesSent; }
+    uint32_t getOversizeFrames() const { return oversizeFrames; }
+    uint32_t getSessions() const { return sessions; }
+};
+
+#endif // LIVESTREAM_H
@@ -0,0 +1,112 @@
+#include "Metrics.h"
+
+Metric* Metrics::head = NULL;
+Metric* Metrics::tail = NULL;
+
+// Prometheus buckets are cumulative; stored per bucket and summed on export
+const uint32_t LatencyHistogram::bucketLimitUs[NUM_BUCKETS] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, UINT32_MAX
+};
+
+MetricCounter metricFramesCaptured("edge_frames_captured_total", "Frames taken from the camera driver while recording");
+MetricCounter metricCaptureFailures("edge_capture_failures_total", "esp_camera_fb_get() calls that returned no frame");
+MetricCounter metricFramesDropped("edge_frames_dropped_total", "Frames dropped because the frame ring was full");
+MetricCounter metricJpegBytes("edge_jpeg_bytes_total", "Compressed bytes delivered by the sensor's JPEG encoder");
+LatencyHistogram metricCaptureLatency("edge_capture_seconds", "Time spent in esp_camera_fb_get()");
+LatencyHistogram metricSdWriteLatency("edge_sd_write_seconds", "SD card block write latency");
+LatencyHistogram metricFrameWriteLatency("edge_frame_write_seconds", "Time to append one frame to the AVI");
+LatencyHistogram metricMotionLatency("edge_motion_check_seconds", "Motion detection time per checked frame");
+MetricCounter metricMotionTriggers("edge_motion_triggers_total", "Motion detections that started a clip");
+LatencyHistogram metricUploadLatency("edge_upload_seconds", "Time to upload one video file");
+MetricCounter metricUploadBytes("edge_upload_bytes_total", "File bytes sent to the upload server");
+MetricCounter metricUploadFailures("edge_upload_failures_total", "Uploads that did not complete");
+LatencyHistogram metricSnapshotLatency("edge_snapshot_seconds", "Time from taking a snapshot to the server accepting it");
+MetricCounter metricSnapshotsDropped("edge_snapshots_dropped_total", "Queued snapshots replaced by a newer one before they were sent");
+LatencyHistogram metricHttpLatency("edge_http_request_seconds", "Control API request handling time");
+MetricCounter metricHttpRequests("edge_http_requests_total", "Control API requests handled");
+
+Metric::Metric(const char* name, const char* help) {
+    this->name = name;
+    this->help = help;
+    this->next = NULL;
+    // Static construction happens before any task starts, no lock needed
+    if (Metrics::tail) {
+        Metrics::tail->next = this;
+    } else {
+        Metrics::head = this;
+    }
+    Metrics::tail = this;
+}
+
+bool MetricCounter::write(MetricsSink sink, void* ctx, char* buf, size_t bufSize) const {
+    int len = snprintf(buf, bufSize, "# HELP %s %s\n# TYPE %s counter\n%s %lu\n",
+                       name, help, name, name, (unsigned long)get());
+    return sink(ctx, buf, min((size_t)len, bufSize - 1));
+}
+
+LatencyHistogram::LatencyHistogram(const char* name, const char* help) : Metric(name, help) {
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+    sumUs.store(0, std::memory_order_relaxed);
+    maxUs.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::record(uint32_t us) {
+    int i = 0;
+    while (us > bucketLimitUs[i] && i < NUM_BUCKETS - 1) i++;
+    buckets[i].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sumUs.fetch_add(us, std::memory_order_relaxed);
+    uint32_t prev = maxUs.load(std::memory_order_relaxed);
+    while (us > prev && !maxUs.compare_exchange_weak(prev, us, std::memory_order_relaxed)) {
+        // prev reloaded by the failed exchange
+    }
+}
+
+bool LatencyHistogram::write(MetricsSink sink, void* ctx, char* buf, size_t bufSize) const {
+    int len = snprintf(buf, bufSize, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    if (!sink(ctx, buf, min((size_t)len, bufSize - 1))) {
+        return false;
+    }
+    uint32_t cumulative = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        cumulative += buckets[i].load(std::memory_order_relaxed);
+        if (i < NUM_BUCKETS - 1) {
+            len = snprintf(buf, bufSize, "%s_bucket{le=\"%g\"} %lu\n",
+                           name, bucketLimitUs[i] / 1e6, (unsigned long)cumulative);
+        } else {
+            len = snprintf(buf, bufSize, "%s_bucket{le=\"+Inf\"} %lu\n", name, (unsigned long)cumulative);
+        }
+        if (!sink(ctx, buf, min((size_t)len, bufSize - 1))) {
+            return false;
+        }
+    }
+    // Count from the buckets so the +Inf bucket and _count always agree in one scrape
+    len = snprintf(buf, bufSize, "%s_sum %.6f\n%s_count %lu\n",
+                   name, sumUs.load(std::memory_order_relaxed) / 1e6, name, (unsigned long)cumulative);
+    if (!sink(ctx, buf, min((size_t)len, bufSize - 1))) {
+        return false;
+    }
+    // Worst case since boot, as its own gauge family
+    len = snprintf(buf, bufSize, "# TYPE %s_max gauge\n%s_max %.6f\n",
+                   name, name, maxUs.load(std::memory_order_relaxed) / 1e6);
+    return sink(ctx, buf, min((size_t)len, bufSize - 1));
+}
+
+bool Metrics::writePrometheus(MetricsSink sink, void* ctx) {
+    char buf[256];
+    for (const Metric* m = head; m != NULL; m = m->next) {
+        if (!m->write(sink, ctx, buf, sizeof(buf))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Metrics::writeGauge(MetricsSink sink, void* ctx, const char* name, const char* help, double value) {
+    char buf[256];
+    int len = snprintf(buf, sizeof(buf), "# HELP %s %s\n# TYPE %s gauge\n%s %g\n", name, help, name, name, value);
+    return sink(ctx, buf, min((size_t)len, sizeof(buf) - 1));
+}
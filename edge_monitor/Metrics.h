@@ -0,0 +1,103 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "esp_timer.h"
+
+/**
+ * Metrics - fixed-size counters and latency histograms for hot paths
+ *
+ * Each metric is a static object that links itself into a registry at
+ * construction, so there is no allocation and no lock: updates are
+ * single relaxed atomic adds and safe from any task on either core.
+ * Timing uses esp_timer_get_time(). writePrometheus() renders every
+ * registered metric in Prometheus text format for the /metrics route.
+ *
+ * Values are 32 bit and wrap like any counter; a histogram _sum in
+ * microseconds wraps after ~71 minutes of observed time, which
+ * Prometheus' rate() treats as a counter reset.
+ */
+
+// Output callback for writePrometheus(), returns false to stop
+typedef bool (*MetricsSink)(void* ctx, const char* text, size_t len);
+
+class Metric {
+    friend class Metrics;
+protected:
+    const char* name;
+    const char* help;
+    Metric* next;
+
+    Metric(const char* name, const char* help);
+    virtual ~Metric() {}
+    virtual bool write(MetricsSink sink, void* ctx, char* buf, size_t bufSize) const = 0;
+};
+
+class MetricCounter : public Metric {
+private:
+    std::atomic<uint32_t> value;
+    bool write(MetricsSink sink, void* ctx, char* buf, size_t bufSize) const override;
+
+public:
+    MetricCounter(const char* name, const char* help) : Metric(name, help), value(0) {}
+    void inc(uint32_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    uint32_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+class LatencyHistogram : public Metric {
+public:
+    static const int NUM_BUCKETS = 14;
+    static const uint32_t bucketLimitUs[NUM_BUCKETS]; // upper bound of each bucket, last is +Inf
+
+private:
+    std::atomic<uint32_t> buckets[NUM_BUCKETS];
+    std::atomic<uint32_t> count;
+    std::atomic<uint32_t> sumUs;
+    std::atomic<uint32_t> maxUs;
+    bool write(MetricsSink sink, void* ctx, char* buf, size_t bufSize) const override;
+
+public:
+    LatencyHistogram(const char* name, const char* help);
+    void record(uint32_t us);
+    // Time since a Metrics::now() stamp
+    void recordSince(int64_t startUs) { record((uint32_t)(esp_timer_get_time() - startUs)); }
+    uint32_t getCount() const { return count.load(std::memory_order_relaxed); }
+    uint32_t getMaxUs() const { return maxUs.load(std::memory_order_relaxed); }
+};
+
+class Metrics {
+private:
+    static Metric* head;
+    static Metric* tail;
+    friend class Metric;
+
+public:
+    static int64_t now() { return esp_timer_get_time(); }
+
+    // Render all registered metrics, in registration order
+    static bool writePrometheus(MetricsSink sink, void* ctx);
+
+    // Helpers for values owned elsewhere (heap, queue depths), rendered by the caller
+    static bool writeGauge(MetricsSink sink, void* ctx, const char* name, const char* help, double value);
+};
+
+// Hot path metrics shared across modules (defined in Metrics.cpp)
+extern MetricCounter metricFramesCaptured;
+extern MetricCounter metricCaptureFailures;
+extern MetricCounter metricFramesDropped;
+extern MetricCounter metricJpegBytes;
+extern LatencyHistogram metricCaptureLatency;
+extern LatencyHistogram metricSdWriteLatency;
+extern LatencyHistogram metricFrameWriteLatency;
+extern LatencyHistogram metricMotionLatency;
+extern MetricCounter metricMotionTriggers;
+extern LatencyHistogram metricUploadLatency;
+extern MetricCounter metricUploadBytes;
+extern MetricCounter metricUploadFailures;
+extern LatencyHistogram metricSnapshotLatency;
+extern MetricCounter metricSnapshotsDropped;
+extern LatencyHistogram metricHttpLatency;
+extern MetricCounter metricHttpRequests;
+
+#endif // METRICS_H
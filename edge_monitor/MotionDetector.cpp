@@ -0,0 +1,415 @@
+#include "MotionDetector.h"
+#include "HeapAccounting.h"
+#include "Metrics.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Baseline JPEG DC coefficient parser, shared design with ESP32-CAM_MJPEG2SD motionDetect.cpp.
+// Each 8x8 block's DC coefficient is 8x its mean value, so Huffman parsing the entropy
+// data and keeping only the Y DC terms gives a 1/8 scale grayscale image.
+
+#define DC_LUT_BITS 9 // code lengths resolved by single table lookup
+
+typedef struct {
+    uint16_t lut[1 << DC_LUT_BITS]; // (code length << 8) | symbol, 0 if longer code
+    int32_t maxCode[17]; // largest code of each length, -1 if none
+    int32_t valOffset[17]; // symbol index minus first code of each length
+    uint8_t vals[256];
+    bool defined;
+} dcHuffTable;
+
+typedef struct {
+    const uint8_t* ptr;
+    const uint8_t* end;
+    uint32_t bits; // left aligned
+    int bitCnt;
+    bool atMarker;
+} dcBitReader;
+
+static void dcBuildTable(dcHuffTable* ht, const uint8_t* counts, const uint8_t* symbols, int numSymbols) {
+    memset(ht->lut, 0, sizeof(ht->lut));
+    memcpy(ht->vals, symbols, numSymbols);
+    int code = 0, k = 0;
+    for (int len = 1; len <= 16; len++) {
+        ht->valOffset[len] = k - code;
+        ht->maxCode[len] = counts[len - 1] ? code + counts[len - 1] - 1 : -1;
+        for (int i = 0; i < counts[len - 1]; i++, k++, code++) {
+            if (len <= DC_LUT_BITS) {
+                int fill = 1 << (DC_LUT_BITS - len);
+                for (int j = 0; j < fill; j++) ht->lut[(code << (DC_LUT_BITS - len)) + j] = (len << 8) | symbols[k];
+            }
+        }
+        code <<= 1;
+    }
+    ht->defined = true;
+}
+
+static inline void dcFillBits(dcBitReader* br) {
+    // keep at least 25 bits available, unstuffing 0xFF00 and stopping at markers
+    while (br->bitCnt <= 24) {
+        uint32_t c = 0;
+        if (!br->atMarker && br->ptr < br->end) {
+            c = *br->ptr;
+            if (c == 0xFF) {
+                if (br->ptr + 1 < br->end && br->ptr[1] == 0x00) br->ptr += 2;
+                else {
+                    br->atMarker = true; // leave marker unread, feed zeros
+                    c = 0;
+                }
+            } else br->ptr++;
+        }
+        br->bits |= c << (24 - br->bitCnt);
+        br->bitCnt += 8;
+    }
+}
+
+static inline int dcGetBits(dcBitReader* br, int n) {
+    dcFillBits(br);
+    int val = br->bits >> (32 - n);
+    br->bits <<= n;
+    br->bitCnt -= n;
+    return val;
+}
+
+static inline int dcDecode(dcBitReader* br, const dcHuffTable* ht) {
+    dcFillBits(br);
+    uint16_t entry = ht->lut[br->bits >> (32 - DC_LUT_BITS)];
+    if (entry) {
+        br->bits <<= entry >> 8;
+        br->bitCnt -= entry >> 8;
+        return entry & 0xFF;
+    }
+    for (int len = DC_LUT_BITS + 1; len <= 16; len++) {
+        int32_t code = br->bits >> (32 - len);
+        if (code <= ht->maxCode[len]) {
+            br->bits <<= len;
+            br->bitCnt -= len;
+            return ht->vals[code + ht->valOffset[len]];
+        }
+    }
+    return -1; // corrupt data
+}
+
+static bool dcRestart(dcBitReader* br) {
+    // skip to after next RSTn marker
+    const uint8_t* p = br->ptr;
+    while (p + 1 < br->end && !(p[0] == 0xFF && p[1] >= 0xD0 && p[1] <= 0xD7)) p++;
+    if (p + 1 >= br->end) return false;
+    br->ptr = p + 2;
+    br->bits = 0;
+    br->bitCnt = 0;
+    br->atMarker = false;
+    return true;
+}
+
+static bool jpgDCluma(const uint8_t* src, size_t srcLen, uint8_t* out, size_t outSize, int* outWidth, int* outHeight) {
+    // parse baseline JPEG headers then entropy data, writing mean luma of each Y block to out
+    static dcHuffTable dcTables[2], acTables[2]; // static as ~4kB, tables rebuilt per frame
+    uint16_t dcQuant[4] = {0};
+    uint8_t compId[3], compH[3], compV[3], compQ[3], compDC[3], compAC[3];
+    int numComps = 0, width = 0, height = 0, restartInterval = 0;
+    const uint8_t* p = src;
+    const uint8_t* end = src + srcLen;
+    for (int i = 0; i < 2; i++) dcTables[i].defined = acTables[i].defined = false;
+
+    if (srcLen < 4 || p[0] != 0xFF || p[1] != 0xD8) return false;
+    p += 2;
+    while (true) {
+        // read each marker segment up to start of scan
+        while (p < end && *p != 0xFF) p++;
+        while (p < end && *p == 0xFF) p++;
+        if (p + 3 > end) return false;
+        uint8_t marker = *p++;
+        if (marker == 0xD8 || (marker >= 0xD0 && marker <= 0xD7)) continue;
+        if (marker == 0xD9) return false; // EOI before scan
+        uint16_t segLen = (p[0] << 8) | p[1];
+        const uint8_t* seg = p + 2;
+        const uint8_t* segEnd = p + segLen;
+        if (segLen < 2 || segEnd > end) return false;
+
+        if (marker == 0xDB) {
+            // DQT - only the DC quantizer of each table is needed
+            while (seg < segEnd) {
+                uint8_t pq = seg[0] >> 4, tq = seg[0] & 0x03;
+                dcQuant[tq] = pq ? (seg[1] << 8) | seg[2] : seg[1];
+                seg += 1 + (pq ? 128 : 64);
+            }
+        } else if (marker == 0xC0 || marker == 0xC1) {
+            // SOF0 / SOF1 baseline frame
+            height = (seg[1] << 8) | seg[2];
+            width = (seg[3] << 8) | seg[4];
+            numComps = seg[5];
+            if (numComps != 1 && numComps != 3) return false;
+            for (int i = 0; i < numComps; i++) {
+                compId[i] = seg[6 + i * 3];
+                compH[i] = seg[7 + i * 3] >> 4;
+                compV[i] = seg[7 + i * 3] & 0x0F;
+                compQ[i] = seg[8 + i * 3] & 0x03;
+                if (!compH[i] || !compV[i]) return false;
+            }
+        } else if (marker == 0xC2 || marker == 0xC3 || (marker >= 0xC5 && marker <= 0xCF && marker != 0xC8 && marker != 0xCC)) {
+            return false; // progressive, lossless or arithmetic coded
+        } else if (marker == 0xC4) {
+            // DHT
+            while (seg + 17 <= segEnd) {
+                uint8_t tc = seg[0] >> 4, th = seg[0] & 0x01;
+                int numSymbols = 0;
+                for (int i = 0; i < 16; i++) numSymbols += seg[1 + i];
+                if (numSymbols > 256 || seg + 17 + numSymbols > segEnd) return false;
+                dcBuildTable(tc ? &acTables[th] : &dcTables[th], seg + 1, seg + 17, numSymbols);
+                seg += 17 + numSymbols;
+            }
+        } else if (marker == 0xDD) {
+            restartInterval = (seg[0] << 8) | seg[1];
+        } else if (marker == 0xDA) {
+            // SOS - map scan components to their tables, entropy data follows segment
+            if (!numComps || seg[0] != numComps) return false; // non interleaved scans not supported
+            for (int i = 0; i < numComps; i++) {
+                uint8_t id = seg[1 + i * 2];
+                if (id != compId[i]) return false;
+                compDC[i] = seg[2 + i * 2] >> 4 & 0x01;
+                compAC[i] = seg[2 + i * 2] & 0x01;
+                if (!dcTables[compDC[i]].defined || !acTables[compAC[i]].defined) return false;
+            }
+            p = segEnd;
+            break;
+        }
+        p = segEnd;
+    }
+
+    // block grid of the Y component
+    int maxH = 1, maxV = 1;
+    for (int i = 0; i < numComps; i++) {
+        if (compH[i] > maxH) maxH = compH[i];
+        if (compV[i] > maxV) maxV = compV[i];
+    }
+    if (numComps == 1) maxH = maxV = compH[0] = compV[0] = 1; // single component scan is not MCU interleaved
+    int mcusX = (width + 8 * maxH - 1) / (8 * maxH);
+    int mcusY = (height + 8 * maxV - 1) / (8 * maxV);
+    int thumbW = (width * compH[0] / maxH + 7) / 8;
+    int thumbH = (height * compV[0] / maxV + 7) / 8;
+    if (!width || !height || (size_t)(thumbW * thumbH) > outSize) return false;
+
+    dcBitReader br = {p, end, 0, 0, false};
+    int pred[3] = {0};
+    int q0 = dcQuant[compQ[0]] ? dcQuant[compQ[0]] : 1;
+    int mcuCount = 0;
+    for (int my = 0; my < mcusY; my++) {
+        for (int mx = 0; mx < mcusX; mx++) {
+            if (restartInterval && mcuCount && !(mcuCount % restartInterval)) {
+                if (!dcRestart(&br)) return false;
+                pred[0] = pred[1] = pred[2] = 0;
+            }
+            mcuCount++;
+            for (int c = 0; c < numComps; c++) {
+                const dcHuffTable* dcT = &dcTables[compDC[c]];
+                const dcHuffTable* acT = &acTables[compAC[c]];
+                for (int by = 0; by < compV[c]; by++) {
+                    for (int bx = 0; bx < compH[c]; bx++) {
+                        // DC difference
+                        int sz = dcDecode(&br, dcT);
+                        if (sz < 0 || sz > 11) return false;
+                        if (sz) {
+                            int diff = dcGetBits(&br, sz);
+                            if (diff < (1 << (sz - 1))) diff -= (1 << sz) - 1;
+                            pred[c] += diff;
+                        }
+                        // skip AC coefficients
+                        for (int k = 1; k < 64; k++) {
+                            int rs = dcDecode(&br, acT);
+                            if (rs < 0) return false;
+                            int run = rs >> 4, acSize = rs & 0x0F;
+                            if (acSize) {
+                                k += run;
+                                dcGetBits(&br, acSize);
+                            } else if (run == 15) k += 15;
+                            else break; // end of block
+                        }
+                        if (c == 0) {
+                            int x = mx * compH[0] + bx;
+                            int y = my * compV[0] + by;
+                            if (x < thumbW && y < thumbH) {
+                                int pix = pred[0] * q0 / 8 + 128;
+                                out[y * thumbW + x] = pix < 0 ? 0 : (pix > 255 ? 255 : pix);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    *outWidth = thumbW;
+    *outHeight = thumbH;
+    return true;
+}
+
+// jpgDCluma keeps its Huffman tables in statics, so the capture task and snapshot checks take turns
+static SemaphoreHandle_t dcLumaLock = xSemaphoreCreateMutex();
+
+bool MotionDetector::decodeDCLuma(const uint8_t* jpeg, size_t len, uint8_t* out, size_t outSize, int* width, int* height) {
+    xSemaphoreTake(dcLumaLock, portMAX_DELAY);
+    bool ok = jpgDCluma(jpeg, len, out, outSize, width, height);
+    xSemaphoreGive(dcLumaLock);
+    return ok;
+}
+
+bool MotionDetector::jpegSize(const uint8_t* jpeg, size_t len, uint16_t* width, uint16_t* height) {
+    if (len < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8) return false;
+    const uint8_t* p = jpeg + 2;
+    const uint8_t* end = jpeg + len;
+    while (p + 4 <= end) {
+        if (p[0] != 0xFF) return false;
+        uint8_t marker = p[1];
+        if (marker == 0xFF) {
+            p++; // fill byte
+            continue;
+        }
+        if (marker >= 0xC0 && marker <= 0xC2) {
+            // SOF0 / SOF1 / SOF2
+            if (p + 9 > end) return false;
+            *height = (p[5] << 8) | p[6];
+            *width = (p[7] << 8) | p[8];
+            return *width > 0 && *height > 0;
+        }
+        if (marker == 0xDA || marker == 0xD9) return false; // scan before any frame header
+        p += 2 + ((p[2] << 8) | p[3]);
+    }
+    return false;
+}
+
+MotionDetector::MotionDetector() {
+    this->thumb = NULL;
+    this->thumbSize = 0;
+    this->curr = NULL;
+    this->prev = NULL;
+    this->havePrev = false;
+    this->changedRun = 0;
+    this->motion = false;
+    this->darkRun = 0;
+    this->night = false;
+    this->changedPixels = 0;
+    this->moveThreshold = 0;
+    this->lightLevel = 0;
+    this->lastCheckUs = 0;
+    this->checks = 0;
+    this->parseFailures = 0;
+
+    this->changeThreshold = 15;
+    this->numBands = 10;
+    this->startBand = 3;
+    this->endBand = 8;
+    this->sensitivity = 8.0;
+    this->confirmFrames = 5;
+    this->nightLevel = 20;
+    this->nightFrames = 10;
+}
+
+MotionDetector::~MotionDetector() {
+    heapMotion.release(thumb);
+}
+
+bool MotionDetector::begin(int maxFrameWidth, int maxFrameHeight) {
+    if (thumb != NULL) {
+        return true; // Already initialized
+    }
+    // One block: DC thumbnail, then current and previous bitmaps
+    thumbSize = ((maxFrameWidth + 7) / 8) * ((maxFrameHeight + 7) / 8);
+    size_t total = ((thumbSize + 3) & ~3) + 2 * RESIZE_PIXELS;
+    thumb = (uint8_t*)heapMotion.allocPreferPsram(total);
+    if (thumb == NULL) {
+        Serial.println("ERROR: MotionDetector allocation failed!");
+        return false;
+    }
+    curr = thumb + ((thumbSize + 3) & ~3);
+    prev = curr + RESIZE_PIXELS;
+    Serial.printf("MotionDetector ready: %zu KB scratch\n", total / 1024);
+    return true;
+}
+
+void MotionDetector::reset() {
+    havePrev = false;
+    changedRun = 0;
+    motion = false;
+}
+
+void MotionDetector::rescale(const uint8_t* input, int inputWidth, int inputHeight) {
+    // Bilinear resize of the thumbnail to RESIZE_DIM square, 8 bit fixed point
+    for (int i = 0; i < RESIZE_DIM; i++) {
+        uint32_t posY = (uint32_t)i * inputHeight * 256 / RESIZE_DIM;
+        int yL = posY >> 8;
+        uint32_t wy = posY & 0xFF;
+        int yH = (wy && yL + 1 < inputHeight) ? yL + 1 : yL;
+        const uint8_t* rowL = input + yL * inputWidth;
+        const uint8_t* rowH = input + yH * inputWidth;
+        uint8_t* out = curr + i * RESIZE_DIM;
+        for (int j = 0; j < RESIZE_DIM; j++) {
+            uint32_t posX = (uint32_t)j * inputWidth * 256 / RESIZE_DIM;
+            int xL = posX >> 8;
+            uint32_t wx = posX & 0xFF;
+            int xH = (wx && xL + 1 < inputWidth) ? xL + 1 : xL;
+            out[j] = (rowL[xL] * (256 - wx) * (256 - wy) + rowL[xH] * wx * (256 - wy)
+                    + rowH[xL] * (256 - wx) * wy + rowH[xH] * wx * wy) >> 16;
+        }
+    }
+}
+
+void MotionDetector::updateNight() {
+    // Hysteresis so a passing shadow doesn't flip day / night
+    if (night) {
+        if (lightLevel > nightLevel && --darkRun <= 0) {
+            night = false;
+            darkRun = 0;
+            Serial.println("MotionDetector: day time");
+        }
+    } else if (lightLevel < nightLevel) {
+        if (++darkRun > nightFrames) {
+            night = true;
+            Serial.println("MotionDetector: night time");
+        }
+    }
+}
+
+bool MotionDetector::check(const uint8_t* jpeg, size_t len) {
+    if (thumb == NULL) {
+        return false;
+    }
+    uint32_t startUs = micros();
+    int width = 0, height = 0;
+    if (!decodeDCLuma(jpeg, len, thumb, thumbSize, &width, &height)) {
+        parseFailures++;
+        return motion;
+    }
+    rescale(thumb, width, height);
+
+    // Compare with the previous bitmap inside the band of interest
+    int startPixel = RESIZE_PIXELS * (startBand - 1) / numBands;
+    int endPixel = RESIZE_PIXELS * endBand / numBands;
+    moveThreshold = (endPixel - startPixel) * (11 - sensitivity) / 100;
+    uint32_t lux = 0;
+    for (int i = 0; i < RESIZE_PIXELS; i++) lux += curr[i];
+    lightLevel = (lux * 100) / (RESIZE_PIXELS * 255);
+    changedPixels = 0;
+    if (havePrev) {
+        for (int i = startPixel; i < endPixel; i++) {
+            changedPixels += abs(curr[i] - prev[i]) > changeThreshold;
+        }
+    }
+    uint8_t* swap = prev;
+    prev = curr;
+    curr = swap;
+    havePrev = true;
+    updateNight();
+
+    // Need a run of changed frames to start motion, one quiet frame ends it
+    if (changedPixels > moveThreshold) {
+        changedRun++;
+        if (!motion && changedRun >= confirmFrames) motion = true;
+    } else {
+        changedRun = 0;
+        motion = false;
+    }
+    checks++;
+    lastCheckUs = micros() - startUs;
+    metricMotionLatency.record(lastCheckUs);
+    return night ? false : motion;
+}
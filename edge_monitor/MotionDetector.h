@@ -0,0 +1,84 @@
+#ifndef MOTIONDETECTOR_H
+#define MOTIONDETECTOR_H
+
+#include <Arduino.h>
+
+/**
+ * MotionDetector - background subtraction on JPEG frames
+ *
+ * Same scheme as checkMotion() in ESP32-CAM_MJPEG2SD: frames are reduced
+ * to a small 96x96 grayscale bitmap, compared pixel by pixel with the
+ * previous one inside a horizontal band of interest, and motion is
+ * confirmed after a run of changed frames. Dark scenes never trigger.
+ *
+ * The bitmap comes from the JPEG DC coefficients (1/8 scale luma) rather
+ * than a full decode, so a check costs a Huffman parse, with no IDCT and
+ * no allocation - buffers are sized once in begin().
+ */
+class MotionDetector {
+public:
+    static const int RESIZE_DIM = 96;
+    static const int RESIZE_PIXELS = RESIZE_DIM * RESIZE_DIM;
+
+private:
+    uint8_t* thumb;         // DC luma thumbnail
+    size_t thumbSize;
+    uint8_t* curr;
+    uint8_t* prev;
+    bool havePrev;
+
+    // Detection state
+    int changedRun;
+    bool motion;
+    int darkRun;
+    bool night;
+
+    // Last check
+    int changedPixels;
+    int moveThreshold;
+    uint8_t lightLevel;
+    uint32_t lastCheckUs;
+    uint32_t checks;
+    uint32_t parseFailures;
+
+    void rescale(const uint8_t* input, int inputWidth, int inputHeight);
+    void updateNight();
+
+public:
+    // Tuning, defaults as MJPEG2SD
+    int changeThreshold;    // min pixel difference to count as changed
+    int numBands;           // image split into horizontal bands
+    int startBand;          // first band checked, 1 = top
+    int endBand;            // last band checked (inclusive)
+    float sensitivity;      // 1 - 10, higher needs fewer changed pixels
+    int confirmFrames;      // consecutive changed checks to start motion
+    uint8_t nightLevel;     // light level % below which it's night
+    int nightFrames;        // consecutive dark checks to switch to night
+
+    MotionDetector();
+    ~MotionDetector();
+
+    // Size the thumbnail for the largest frame that will be checked
+    bool begin(int maxFrameWidth = 1600, int maxFrameHeight = 1200);
+
+    // Check one baseline JPEG frame; returns true while motion is ongoing
+    bool check(const uint8_t* jpeg, size_t len);
+    void reset();
+
+    // 1/8 scale luma from the DC terms of a baseline JPEG (safe from any task)
+    static bool decodeDCLuma(const uint8_t* jpeg, size_t len, uint8_t* out, size_t outSize, int* width, int* height);
+    // Width and height from the frame header alone, no decode
+    static bool jpegSize(const uint8_t* jpeg, size_t len, uint16_t* width, uint16_t* height);
+
+    // Status and information
+    bool isMotion() const { return motion; }
+    bool isNight() const { return night; }
+    uint8_t getLightLevel() const { return lightLevel; }
+    int getChangedPixels() const { return changedPixels; }
+    int getMoveThreshold() const { return moveThreshold; }
+    uint32_t getLastCheckUs() const { return lastCheckUs; }
+    uint32_t getChecks() const { return checks; }
+    uint32_t getParseFailures() const { return parseFailures; }
+};
+
+#endif // MOTIONDETECTOR_H
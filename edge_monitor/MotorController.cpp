@@ -0,0 +1,126 @@
+#include "MotorController.h"
+#include "esp_timer.h"
+
+MotorController::MotorController(Motor* motor, int accelPerSec, unsigned long deadmanMs) {
+    this->motor = motor;
+    this->accelPerSec = max(accelPerSec, 1);
+    this->deadmanMs = deadmanMs;
+    this->commands = NULL;
+    this->taskHandle = NULL;
+    this->target = 0;
+    this->output = 0;
+    this->streaming = false;
+    this->lastStreamMs = 0;
+}
+
+MotorController::~MotorController() {
+    if (taskHandle) vTaskDelete(taskHandle);
+    if (commands) vQueueDelete(commands);
+    motor->stop();
+}
+
+bool MotorController::begin() {
+    if (taskHandle != NULL) {
+        return true; // Already running
+    }
+    commands = xQueueCreate(1, sizeof(Command)); // only the latest command matters
+    if (commands == NULL) {
+        Serial.println("ERROR: Motor command queue allocation failed!");
+        return false;
+    }
+    BaseType_t ok = xTaskCreatePinnedToCore(taskEntry, "motorRamp", TASK_STACK,
+                                            this, TASK_PRIORITY, &taskHandle, TASK_CORE);
+    if (ok != pdPASS) {
+        Serial.println("ERROR: Failed to create motor ramp task!");
+        taskHandle = NULL;
+        return false;
+    }
+    Serial.printf("MotorController ready: %d/s ramp, %lu ms deadman\n", accelPerSec, deadmanMs);
+    return true;
+}
+
+bool MotorController::attach(httpd_handle_t server) {
+    httpd_uri_t wsUri = {};
+    wsUri.uri = "/motor/ws";
+    wsUri.method = HTTP_GET;
+    wsUri.handler = wsHandler;
+    wsUri.user_ctx = this;
+    wsUri.is_websocket = true;
+    if (httpd_register_uri_handler(server, &wsUri) != ESP_OK) {
+        Serial.println("ERROR: Failed to register /motor/ws");
+        return false;
+    }
+    return true;
+}
+
+bool MotorController::command(int speed, bool streamed) {
+    if (commands == NULL) {
+        return false;
+    }
+    Command cmd;
+    cmd.speed = constrain(speed, -MAX_COMMAND, MAX_COMMAND);
+    cmd.streamed = streamed;
+    cmd.receivedUs = esp_timer_get_time();
+    xQueueOverwrite(commands, &cmd); // replaces a command the ramp task hasn't taken yet
+    return true;
+}
+
+esp_err_t MotorController::wsHandler(httpd_req_t* req) {
+    return ((MotorController*)req->user_ctx)->receiveFrame(req);
+}
+
+esp_err_t MotorController::receiveFrame(httpd_req_t* req) {
+    if (req->method == HTTP_GET) {
+        // Handshake - frames follow on this socket
+        stats.wsSessions++;
+        Serial.printf("Motor WebSocket connected on socket %d\n", httpd_req_to_sockfd(req));
+        return ESP_OK;
+    }
+    uint8_t payload[8];
+    httpd_ws_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.payload = payload;
+    esp_err_t ret = httpd_ws_recv_frame(req, &frame, sizeof(payload));
+    if (ret != ESP_OK) {
+        Serial.printf("ERROR: Motor WebSocket receive failed: %s\n", esp_err_to_name(ret));
+        return ret;
+    }
+    if (frame.type != HTTPD_WS_TYPE_BINARY || frame.len != 2) {
+        stats.badFrames++;
+        return ESP_OK;
+    }
+    stats.wsCommands++;
+    command((int16_t)(payload[0] | (payload[1] << 8)), true);
+    return ESP_OK;
+}
+
+void MotorController::taskEntry(void* param) {
+    ((MotorController*)param)->rampLoop();
+}
+
+void MotorController::rampLoop() {
+    const int maxStep = max(1, (int)(accelPerSec * RAMP_PERIOD_MS / 1000));
+    TickType_t lastWake = xTaskGetTickCount();
+    while (true) {
+        Command cmd;
+        if (xQueueReceive(commands, &cmd, 0) == pdTRUE) {
+            target = cmd.speed;
+            streaming = cmd.streamed;
+            lastStreamMs = millis();
+            stats.commands++;
+            stats.lastCommandUs = esp_timer_get_time() - cmd.receivedUs;
+        }
+        if (streaming && target != 0 && millis() - lastStreamMs > deadmanMs) {
+            // Streamed commands stopped coming - client gone or stuck
+            target = 0;
+            stats.deadmanStops++;
+            Serial.printf("WARNING: No motor command for %lu ms, stopping\n", deadmanMs);
+        }
+        int step = constrain(target - output, -maxStep, maxStep);
+        if (step != 0) {
+            output += step;
+            motor->setSpeed(output); // dead zone is handled in Motor
+        }
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(RAMP_PERIOD_MS));
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef MOTORCONTROLLER_H
+#define MOTORCONTROLLER_H
+
+#include <Arduino.h>
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "Motor.h"
+
+/**
+ * MotorController - ramped, fixed-rate drive for a Motor
+ *
+ * Speed commands arrive from POST /motor or the binary WebSocket on
+ * /motor/ws and go through a one-entry command queue (a newer command
+ * replaces one not yet applied). A task wakes every RAMP_PERIOD_MS,
+ * takes the latest command and moves the output towards it by at most
+ * accelPerSec, so a joystick jump from full reverse to full forward is
+ * a short ramp rather than a current spike.
+ *
+ * WebSocket commands are a stream: each frame is a little-endian int16
+ * speed (-100..100) and if none arrives for deadmanMs the target falls
+ * to 0, so a dropped connection or frozen client stops the motor. A
+ * POST command is held until the next one, as before.
+ */
+class MotorController {
+public:
+    struct Stats {
+        uint32_t commands = 0;
+        uint32_t wsCommands = 0;
+        uint32_t badFrames = 0;       // wrong length or type
+        uint32_t deadmanStops = 0;
+        uint32_t wsSessions = 0;
+        uint32_t lastCommandUs = 0;   // frame received to target applied
+    };
+
+private:
+    struct Command {
+        int16_t speed;
+        bool streamed;
+        int64_t receivedUs;
+    };
+
+    static const unsigned long RAMP_PERIOD_MS = 5;
+    static const uint32_t TASK_STACK = 3072;
+    static const UBaseType_t TASK_PRIORITY = 4;
+    static const int TASK_CORE = 1;
+    static const int MAX_COMMAND = 100;
+
+    Motor* motor;
+    int accelPerSec;
+    unsigned long deadmanMs;
+    QueueHandle_t commands;
+    TaskHandle_t taskHandle;
+
+    // Owned by the ramp task
+    volatile int target;
+    volatile int output;
+    bool streaming;
+    unsigned long lastStreamMs;
+    Stats stats;
+
+    static void taskEntry(void* param);
+    void rampLoop();
+    static esp_err_t wsHandler(httpd_req_t* req);
+    esp_err_t receiveFrame(httpd_req_t* req);
+
+public:
+    // Constructor - accelPerSec in speed units per second, deadmanMs for WebSocket commands
+    MotorController(Motor* motor, int accelPerSec = 400, unsigned long deadmanMs = 300);
+    ~MotorController();
+
+    bool begin();
+    // Register /motor/ws on the control server (again after it restarts)
+    bool attach(httpd_handle_t server);
+
+    // Queue a speed (-100..100); streamed commands are subject to the deadman timeout
+    bool command(int speed, bool streamed = false);
+
+    // Status
+    int getTarget() const { return target; }
+    int getOutput() const { return output; }
+    int getAccelPerSec() const { return accelPerSec; }
+    unsigned long getDeadmanMs() const { return deadmanMs; }
+    const Stats& getStats() const { return stats; }
+};
+
+#endif // MOTORCONTROLLER_H
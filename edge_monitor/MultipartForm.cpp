@@ -0,0 +1,26 @@
+#include "MultipartForm.h"
+
+MultipartForm::MultipartForm() {
+    this->boundary[0] = '\0';
+    this->head[0] = '\0';
+    this->headLen = 0;
+    this->tail[0] = '\0';
+    this->tailLen = 0;
+}
+
+bool MultipartForm::begin(const char* fileName, uint32_t boundaryId) {
+    snprintf(boundary, sizeof(boundary), "----ESP32FormBoundary%lu", (unsigned long)boundaryId);
+    int len = snprintf(head, sizeof(head),
+                       "--%s\r\n"
+                       "Content-Disposition: form-data; name=\"file\"; filename=\"%s\"\r\n"
+                       "Content-Type: application/octet-stream\r\n\r\n",
+                       boundary, fileName);
+    if (len < 0 || (size_t)len >= sizeof(head)) {
+        Serial.printf("ERROR: Upload file name too long for the form header: %s\n", fileName);
+        headLen = 0;
+        return false;
+    }
+    headLen = len;
+    tailLen = snprintf(tail, sizeof(tail), "\r\n--%s--\r\n", boundary);
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef MULTIPARTFORM_H
+#define MULTIPARTFORM_H
+
+#include <Arduino.h>
+
+/**
+ * MultipartForm - multipart/form-data framing for a one-file upload
+ *
+ * The part header (boundary, "file" field, file name) and the closing
+ * boundary are formatted once into fixed buffers, and the file body is
+ * streamed between them by the caller, so framing an upload builds no
+ * Strings. Content-Length is the file size plus the two frames.
+ */
+class MultipartForm {
+public:
+    static const size_t MAX_HEAD = 256;
+    static const size_t MAX_TAIL = 48;
+
+private:
+    char boundary[32];
+    char head[MAX_HEAD];
+    size_t headLen;
+    char tail[MAX_TAIL];
+    size_t tailLen;
+
+public:
+    MultipartForm();
+
+    // Frame fileName with a boundary made from boundaryId; false if the name doesn't fit
+    bool begin(const char* fileName, uint32_t boundaryId);
+
+    const char* getBoundary() const { return boundary; }
+    const uint8_t* getHead() const { return (const uint8_t*)head; }
+    size_t getHeadLength() const { return headLen; }
+    const uint8_t* getTail() const { return (const uint8_t*)tail; }
+    size_t getTailLength() const { return tailLen; }
+    size_t contentLength(size_t fileSize) const { return headLen + fileSize + tailLen; }
+};
+
+#endif // MULTIPARTFORM_H
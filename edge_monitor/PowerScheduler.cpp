@@ -0,0 +1,240 @@
+#include "PowerScheduler.h"
+
+static const uint32_t IDLE_CPU_MHZ = 80;      // Lowest clock that keeps APB (camera XCLK, UART) at 80 MHz
+static const int RESUME_MAX_FRAMES = 4;       // Grabs to wait for a frame taken after standby
+
+PowerScheduler::PowerScheduler(unsigned long minSleepMs, unsigned long maxSliceMs, int pwdnPin) {
+    this->mode = MODE_OFF;
+    this->minSleepMs = minSleepMs;
+    this->maxSliceMs = maxSliceMs;
+    this->pwdnPin = pwdnPin;
+    this->activeMa = 180;
+    this->lightSleepMa = 20;
+    this->modemSleepMa = 60;
+    this->supplyVolts = 3.7f;
+    this->connections = NULL;
+    this->warmHost = "";
+    this->warmPort = 0;
+    this->warmSecure = false;
+    this->cpuLock = NULL;
+    this->noSleepLock = NULL;
+    this->activeCpuMhz = 240;
+    this->lock = xSemaphoreCreateMutex();
+    this->wakeSignal = xSemaphoreCreateBinary();
+    this->asleep = false;
+    this->sensorStandby = false;
+    this->activePs = WIFI_PS_MIN_MODEM;
+    this->sleepStartMs = 0;
+    this->awakeStartMs = 0;
+    this->holdUntilMs = 0;
+}
+
+PowerScheduler::~PowerScheduler() {
+    wake();
+    if (cpuLock) {
+        esp_pm_lock_release(cpuLock);
+        esp_pm_lock_delete(cpuLock);
+    }
+    if (noSleepLock) {
+        esp_pm_lock_release(noSleepLock);
+        esp_pm_lock_delete(noSleepLock);
+    }
+    if (lock) vSemaphoreDelete(lock);
+    if (wakeSignal) vSemaphoreDelete(wakeSignal);
+}
+
+bool PowerScheduler::begin(ConnectionManager* connections, const String& host, int port, bool secure) {
+    this->connections = connections;
+    this->warmHost = host;
+    this->warmPort = port;
+    this->warmSecure = secure;
+    if (lock == NULL || wakeSignal == NULL) {
+        Serial.println("ERROR: Failed to create power scheduler semaphores!");
+        return false;
+    }
+    activeCpuMhz = getCpuFrequencyMhz();
+    awakeStartMs = millis();
+
+    // Locks first and held while awake, so configuring power management changes nothing until sleep()
+    if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "powerCpu", &cpuLock) != ESP_OK ||
+        esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "powerAwake", &noSleepLock) != ESP_OK) {
+        if (cpuLock) esp_pm_lock_delete(cpuLock);
+        cpuLock = NULL;
+        noSleepLock = NULL;
+        mode = MODE_MODEM_SLEEP;
+        Serial.printf("WARNING: No power management in this build, idle is modem sleep at %u MHz\n",
+                      (unsigned)IDLE_CPU_MHZ);
+        return true;
+    }
+    esp_pm_lock_acquire(cpuLock);
+    esp_pm_lock_acquire(noSleepLock);
+
+    esp_pm_config_t pm = {};
+    pm.max_freq_mhz = activeCpuMhz;
+    pm.min_freq_mhz = IDLE_CPU_MHZ;
+    pm.light_sleep_enable = true;
+    if (esp_pm_configure(&pm) == ESP_OK) {
+        mode = MODE_LIGHT_SLEEP;
+    } else {
+        // Tickless idle is off - frequency scaling only
+        pm.light_sleep_enable = false;
+        if (esp_pm_configure(&pm) != ESP_OK) {
+            Serial.println("ERROR: esp_pm_configure failed, power scheduler disabled");
+            mode = MODE_OFF;
+            return false;
+        }
+        mode = MODE_MODEM_SLEEP;
+        Serial.println("WARNING: Automatic light sleep not enabled in this build, idle is modem sleep");
+    }
+    Serial.printf("PowerScheduler ready: %s between windows of %lu ms or more\n", modeName(mode), minSleepMs);
+    return true;
+}
+
+void PowerScheduler::setCurrentModel(float activeMa, float lightSleepMa, float modemSleepMa, float supplyVolts) {
+    this->activeMa = activeMa;
+    this->lightSleepMa = lightSleepMa;
+    this->modemSleepMa = modemSleepMa;
+    this->supplyVolts = supplyVolts;
+}
+
+const char* PowerScheduler::modeName(Mode mode) {
+    switch (mode) {
+        case MODE_LIGHT_SLEEP: return "light_sleep";
+        case MODE_MODEM_SLEEP: return "modem_sleep";
+        default: return "off";
+    }
+}
+
+bool PowerScheduler::setSensorStandby(bool standby) {
+    if (pwdnPin >= 0) {
+        // Registers survive PWDN, no reconfiguration on resume
+        digitalWrite(pwdnPin, standby ? HIGH : LOW);
+        return true;
+    }
+    sensor_t* s = esp_camera_sensor_get();
+    if (s == NULL || s->set_reg == NULL) {
+        return false;
+    }
+    switch (s->id.PID) {
+        case OV2640_PID:
+            // COM2 (sensor bank 0x09) bit 4: standby
+            return s->set_reg(s, 0x100 | 0x09, 0x10, standby ? 0x10 : 0x00) == 0;
+        case OV3660_PID:
+        case OV5640_PID:
+            // SYSTEM CTROL0 (0x3008) bit 6: software power down
+            return s->set_reg(s, 0x3008, 0x40, standby ? 0x40 : 0x00) == 0;
+        default:
+            return false;
+    }
+}
+
+void PowerScheduler::enterIdle() {
+    unsigned long now = millis();
+    stats.lastAwakeMs = now - awakeStartMs;
+    stats.awakeMs += stats.lastAwakeMs;
+
+    sensorStandby = setSensorStandby(true);
+    if (!sensorStandby) stats.standbyFailures++;
+    if (esp_wifi_get_ps(&activePs) != ESP_OK) activePs = WIFI_PS_MIN_MODEM;
+    esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
+    if (cpuLock) {
+        esp_pm_lock_release(noSleepLock);
+        esp_pm_lock_release(cpuLock);
+    } else {
+        setCpuFrequencyMhz(IDLE_CPU_MHZ);
+    }
+    sleepStartMs = millis();
+    asleep = true;
+}
+
+uint32_t PowerScheduler::resumeCamera() {
+    if (!sensorStandby) {
+        return 0;
+    }
+    int64_t startUs = esp_timer_get_time();
+    setSensorStandby(false);
+    sensorStandby = false;
+    // Frames queued before standby are stale; one stamped after startUs means the sensor is streaming again
+    for (int i = 0; i < RESUME_MAX_FRAMES; i++) {
+        camera_fb_t* fb = esp_camera_fb_get();
+        if (fb == NULL) break;
+        int64_t stampUs = (int64_t)fb->timestamp.tv_sec * 1000000LL + fb->timestamp.tv_usec;
+        esp_camera_fb_return(fb);
+        if (stampUs >= startUs) break;
+    }
+    return (uint32_t)((esp_timer_get_time() - startUs) / 1000);
+}
+
+uint32_t PowerScheduler::resumeNetwork() {
+    unsigned long start = millis();
+    esp_wifi_set_ps(activePs);
+    // Still associated after modem sleep; a dropped link is left to loop()'s WiFi check
+    if (connections != NULL && warmHost.length() > 0 && WiFi.status() == WL_CONNECTED) {
+        // Reopens the keep-alive connection if it idled out, so the next upload skips the handshake
+        WiFiClient* client = connections->acquire(warmHost.c_str(), warmPort, warmSecure);
+        if (client) connections->release(client, true);
+    }
+    return millis() - start;
+}
+
+void PowerScheduler::closeCycle(unsigned long sleptMs) {
+    stats.cycles++;
+    stats.lastSleepMs = sleptMs;
+    stats.sleepMs += sleptMs;
+    float sleepMa = (mode == MODE_LIGHT_SLEEP) ? lightSleepMa : modemSleepMa;
+    // V x mA x ms = uJ
+    stats.lastCycleMj = supplyVolts * (stats.lastAwakeMs * activeMa + sleptMs * sleepMa) / 1000.0f;
+    stats.totalMj += stats.lastCycleMj;
+}
+
+unsigned long PowerScheduler::sleep(unsigned long durationMs) {
+    unsigned long slice = min(durationMs, maxSliceMs);
+    if (mode == MODE_OFF) {
+        delay(min(slice, 10UL));
+        return 0;
+    }
+    xSemaphoreTake(wakeSignal, 0); // Drop a signal left from an earlier wake()
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (!asleep) {
+        enterIdle();
+    }
+    stats.slices++;
+    xSemaphoreGive(lock);
+
+    unsigned long start = millis();
+    xSemaphoreTake(wakeSignal, pdMS_TO_TICKS(slice));
+    return millis() - start;
+}
+
+void PowerScheduler::wake(unsigned long holdMs) {
+    if (holdMs > 0) {
+        unsigned long until = millis() + holdMs;
+        if ((long)(until - holdUntilMs) > 0) holdUntilMs = until;
+    }
+    if (!asleep) {
+        return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (asleep) {
+        unsigned long start = millis();
+        unsigned long sleptMs = start - sleepStartMs;
+        if (holdMs > 0) stats.earlyWakes++;
+        if (cpuLock) {
+            esp_pm_lock_acquire(cpuLock);
+            esp_pm_lock_acquire(noSleepLock);
+        } else {
+            setCpuFrequencyMhz(activeCpuMhz);
+        }
+        stats.lastCameraResumeMs = resumeCamera();
+        stats.lastNetworkResumeMs = resumeNetwork();
+        stats.maxCameraResumeMs = max(stats.maxCameraResumeMs, stats.lastCameraResumeMs);
+        stats.maxNetworkResumeMs = max(stats.maxNetworkResumeMs, stats.lastNetworkResumeMs);
+        stats.lastWakeMs = millis() - start;
+        stats.maxWakeMs = max(stats.maxWakeMs, stats.lastWakeMs);
+        closeCycle(sleptMs);
+        awakeStartMs = start;
+        asleep = false;
+        xSemaphoreGive(wakeSignal); // Ends the sleep() slice in progress
+    }
+    xSemaphoreGive(lock);
+}
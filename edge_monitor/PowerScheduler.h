@@ -0,0 +1,124 @@
+#ifndef POWERSCHEDULER_H
+#define POWERSCHEDULER_H
+
+#include <Arduino.h>
+#include "esp_camera.h"
+#include "esp_pm.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "ConnectionManager.h"
+
+/**
+ * PowerScheduler - low-power idle between recording windows
+ *
+ * loop() hands over the time until its next window with sleep(); on the
+ * first slice the sensor goes to standby (PWDN pin, or the sensor's own
+ * software standby bit), WiFi moves to maximum modem sleep and the power
+ * management locks held while awake are released, so the chip drops into
+ * automatic light sleep between DTIM beacons while staying associated.
+ * Sockets, the HTTP servers and WebSocket clients survive; they are only
+ * slower to answer.
+ *
+ * Automatic light sleep needs CONFIG_PM_ENABLE and tickless idle in the
+ * core's sdkconfig. Without them the idle state falls back to modem
+ * sleep at the minimum CPU clock (MODE_MODEM_SLEEP), which still saves
+ * most of the radio and core power.
+ *
+ * wake() undoes it in order: CPU and sleep locks, sensor out of standby
+ * until a fresh frame arrives, WiFi power save back to its active mode,
+ * then a warm keep-alive connection to the upload server. Each phase is
+ * timed. Energy per cycle (awake period plus the sleep after it) is an
+ * estimate from time in each state and the configured supply currents -
+ * calibrate them against a meter for a real site.
+ */
+class PowerScheduler {
+public:
+    enum Mode : uint8_t {
+        MODE_OFF,           // begin() failed or not called - sleep() just delays
+        MODE_LIGHT_SLEEP,   // automatic light sleep + modem sleep
+        MODE_MODEM_SLEEP,   // modem sleep at minimum CPU clock
+    };
+
+    struct Stats {
+        uint32_t cycles = 0;
+        uint32_t slices = 0;
+        uint32_t earlyWakes = 0;         // wake() from another task while asleep
+        uint32_t standbyFailures = 0;    // sensor without a known standby control
+        uint64_t sleepMs = 0;
+        uint64_t awakeMs = 0;
+        uint32_t lastSleepMs = 0;
+        uint32_t lastAwakeMs = 0;
+        uint32_t lastCameraResumeMs = 0;
+        uint32_t maxCameraResumeMs = 0;
+        uint32_t lastNetworkResumeMs = 0;
+        uint32_t maxNetworkResumeMs = 0;
+        uint32_t lastWakeMs = 0;         // wake() total, camera + network
+        uint32_t maxWakeMs = 0;
+        float lastCycleMj = 0;
+        double totalMj = 0;
+    };
+
+private:
+    Mode mode;
+    unsigned long minSleepMs;
+    unsigned long maxSliceMs;
+    int pwdnPin;
+
+    // Supply model for the energy estimate
+    float activeMa;
+    float lightSleepMa;
+    float modemSleepMa;
+    float supplyVolts;
+
+    ConnectionManager* connections;
+    String warmHost;
+    int warmPort;
+    bool warmSecure;
+
+    esp_pm_lock_handle_t cpuLock;       // Both held while awake, NULL without power management
+    esp_pm_lock_handle_t noSleepLock;
+    uint32_t activeCpuMhz;
+    SemaphoreHandle_t lock;
+    SemaphoreHandle_t wakeSignal;
+
+    volatile bool asleep;
+    bool sensorStandby;
+    wifi_ps_type_t activePs;
+    unsigned long sleepStartMs;
+    unsigned long awakeStartMs;
+    unsigned long holdUntilMs;
+    Stats stats;
+
+    bool setSensorStandby(bool standby);
+    void enterIdle();
+    void closeCycle(unsigned long sleptMs);
+    uint32_t resumeCamera();
+    uint32_t resumeNetwork();
+
+public:
+    // Constructor - windows shorter than minSleepMs aren't worth a cycle; slices are capped at maxSliceMs
+    PowerScheduler(unsigned long minSleepMs = 2000, unsigned long maxSliceMs = 5000, int pwdnPin = -1);
+    ~PowerScheduler();
+
+    // Set up power management; connections/host/port get a warm connection on every wake
+    bool begin(ConnectionManager* connections, const String& host, int port, bool secure = false);
+    void setCurrentModel(float activeMa, float lightSleepMa, float modemSleepMa, float supplyVolts);
+
+    // loop() only: idle for up to durationMs (capped at maxSliceMs), entering the low-power
+    // state on the first slice. Returns early when another task calls wake(). Returns ms slept.
+    unsigned long sleep(unsigned long durationMs);
+    // Back to full power (no-op when awake); holdMs keeps sleep() from idling again that long.
+    // Any task, call before using the camera.
+    void wake(unsigned long holdMs = 0);
+    bool canSleep() const { return mode != MODE_OFF && (long)(millis() - holdUntilMs) >= 0; }
+
+    // Status
+    Mode getMode() const { return mode; }
+    static const char* modeName(Mode mode);
+    bool isAsleep() const { return asleep; }
+    unsigned long getMinSleepMs() const { return minSleepMs; }
+    const Stats& getStats() const { return stats; }
+};
+
+#endif // POWERSCHEDULER_H
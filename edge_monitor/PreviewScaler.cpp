@@ -0,0 +1,212 @@
+#include "PreviewScaler.h"
+#include "HeapAccounting.h"
+#include "MotionDetector.h"
+#include "img_converters.h"
+
+PreviewScaler::PreviewScaler(uint16_t maxWidth, uint8_t quality, unsigned long intervalMs,
+                             size_t maxFrameBytes, size_t maxPreviewBytes) {
+    this->maxWidth = maxWidth;
+    this->quality = quality;
+    this->intervalMs = intervalMs;
+    this->source = NULL;
+    this->sourceSize = maxFrameBytes;
+    this->sourceLen = 0;
+    this->sourceTimestampMs = 0;
+    this->busy = false;
+    this->lastOfferMs = 0;
+    this->rgbBuf = NULL;
+    this->rgbSize = 0;
+    for (int i = 0; i < 2; i++) {
+        frames[i] = NULL;
+        frameLen[i] = 0;
+        frameTimestamp[i] = 0;
+    }
+    this->frameSize = maxPreviewBytes;
+    this->encodeLen = 0;
+    this->filling = 0;
+    this->latest = -1;
+    this->reading = -1;
+    this->readers = 0;
+    this->lock = xSemaphoreCreateMutex();
+    this->liveStream = NULL;
+    this->demandUntilMs = 0;
+    this->taskHandle = NULL;
+}
+
+PreviewScaler::~PreviewScaler() {
+    if (taskHandle) vTaskDelete(taskHandle);
+    heapStream.release(source);
+    heapStream.release(rgbBuf);
+    for (int i = 0; i < 2; i++) {
+        heapStream.release(frames[i]);
+    }
+    if (lock) vSemaphoreDelete(lock);
+}
+
+bool PreviewScaler::begin() {
+    if (taskHandle != NULL) {
+        return true; // Already running
+    }
+    source = (uint8_t*)heapStream.alloc(sourceSize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    for (int i = 0; i < 2; i++) {
+        frames[i] = (uint8_t*)heapStream.alloc(frameSize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    if (source == NULL || frames[0] == NULL || frames[1] == NULL) {
+        Serial.println("ERROR: Preview scaler allocation failed!");
+        return false;
+    }
+    BaseType_t ok = xTaskCreatePinnedToCore(taskEntry, "previewScale", SCALER_STACK,
+                                            this, SCALER_PRIORITY, &taskHandle, SCALER_CORE);
+    if (ok != pdPASS) {
+        Serial.println("ERROR: Failed to create preview scaler task!");
+        taskHandle = NULL;
+        return false;
+    }
+    Serial.printf("PreviewScaler ready: up to %u px wide every %lu ms\n", maxWidth, intervalMs);
+    return true;
+}
+
+bool PreviewScaler::wanted() const {
+    return (liveStream && liveStream->hasViewer()) || (long)(demandUntilMs - millis()) > 0;
+}
+
+void PreviewScaler::demand(unsigned long holdMs) {
+    unsigned long until = millis() + holdMs;
+    if ((long)(until - demandUntilMs) > 0) demandUntilMs = until;
+}
+
+void PreviewScaler::offer(const uint8_t* jpeg, size_t len, uint32_t timestampMs) {
+    if (taskHandle == NULL || millis() - lastOfferMs < intervalMs || !wanted()) {
+        return;
+    }
+    if (busy) {
+        stats.busy++;
+        return;
+    }
+    if (len > sourceSize) {
+        stats.oversize++;
+        return;
+    }
+    lastOfferMs = millis();
+    memcpy(source, jpeg, len);
+    sourceLen = len;
+    sourceTimestampMs = timestampMs;
+    stats.offered++;
+    busy = true;
+    xTaskNotifyGive(taskHandle);
+}
+
+size_t PreviewScaler::frameOut(void* arg, size_t index, const void* data, size_t len) {
+    PreviewScaler* self = (PreviewScaler*)arg;
+    if (index + len > self->frameSize) return 0;
+    memcpy(self->frames[self->filling] + index, data, len);
+    self->encodeLen = index + len;
+    return len;
+}
+
+bool PreviewScaler::scale() {
+    uint16_t width = 0, height = 0;
+    if (!MotionDetector::jpegSize(source, sourceLen, &width, &height)) {
+        return false;
+    }
+    // Smallest decoder scale that brings the width under maxWidth (1/8 at most)
+    int scale = 0;
+    while (scale < 3 && (width >> scale) > maxWidth) scale++;
+    uint16_t w = width >> scale;
+    uint16_t h = height >> scale;
+    size_t need = (size_t)w * h * 2;
+    if (need > rgbSize) {
+        // Only grows when a larger frame size turns up
+        heapStream.release(rgbBuf);
+        rgbBuf = (uint8_t*)heapStream.alloc(need, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        rgbSize = rgbBuf ? need : 0;
+        if (rgbBuf == NULL) {
+            Serial.println("ERROR: Failed to allocate preview bitmap");
+            return false;
+        }
+    }
+    if (!jpg2rgb565(source, sourceLen, rgbBuf, (jpg_scale_t)scale)) {
+        return false;
+    }
+
+    // Fill the buffer readers aren't holding; if they still hold the older one,
+    // overwrite the latest preview instead
+    xSemaphoreTake(lock, portMAX_DELAY);
+    filling = (latest == 0) ? 1 : 0;
+    if (filling == reading) {
+        filling = 1 - reading;
+        latest = -1;
+    }
+    xSemaphoreGive(lock);
+
+    encodeLen = 0;
+    if (!fmt2jpg_cb(rgbBuf, need, w, h, PIXFORMAT_RGB565, quality, frameOut, this)) {
+        return false; // Also when the preview doesn't fit in frameSize
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    frameLen[filling] = encodeLen;
+    frameTimestamp[filling] = sourceTimestampMs;
+    latest = filling;
+    xSemaphoreGive(lock);
+    stats.width = w;
+    stats.height = h;
+    return true;
+}
+
+void PreviewScaler::taskEntry(void* param) {
+    ((PreviewScaler*)param)->scaleLoop();
+}
+
+void PreviewScaler::scaleLoop() {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint32_t startMs = millis();
+        bool ok = scale();
+        size_t sourceBytes = sourceLen;
+        busy = false; // Source buffer free for the next frame
+        if (!ok) {
+            stats.failures++;
+            continue;
+        }
+        uint32_t scaleMs = millis() - startMs;
+        stats.encoded++;
+        stats.lastScaleMs = scaleMs;
+        if (scaleMs > stats.maxScaleMs) stats.maxScaleMs = scaleMs;
+        stats.lastSourceBytes = sourceBytes;
+        stats.lastBytes = encodeLen;
+        stats.totalSourceBytes += sourceBytes;
+        stats.totalBytes += encodeLen;
+
+        if (liveStream) {
+            Frame frame;
+            if (acquireLatest(frame, UINT32_MAX)) {
+                liveStream->publish(frame.buf, frame.len, frame.timestampMs);
+                releaseLatest();
+            }
+        }
+    }
+}
+
+bool PreviewScaler::acquireLatest(Frame& frame, unsigned long maxAgeMs) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    // A reader already holding an older preview keeps the others on it too
+    int slot = reading >= 0 ? reading : latest;
+    bool ok = slot >= 0 && millis() - frameTimestamp[slot] <= maxAgeMs;
+    if (ok) {
+        reading = slot;
+        readers++;
+        frame.buf = frames[slot];
+        frame.len = frameLen[slot];
+        frame.timestampMs = frameTimestamp[slot];
+    }
+    xSemaphoreGive(lock);
+    return ok;
+}
+
+void PreviewScaler::releaseLatest() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (readers > 0 && --readers == 0) {
+        reading = -1;
+    }
+    xSemaphoreGive(lock);
+}
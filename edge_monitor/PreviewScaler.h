@@ -0,0 +1,119 @@
+#ifndef PREVIEWSCALER_H
+#define PREVIEWSCALER_H
+
+#include <Arduino.h>
+#include "LiveStream.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+/**
+ * PreviewScaler - low resolution preview derived from the recording stream
+ *
+ * The sensor makes one JPEG stream, sized for recording. For live view
+ * and snapshots the capture task offer()s its frames here instead: at
+ * most one per intervalMs and only while someone wants a preview, the
+ * frame is copied into a source buffer (a busy scaler just skips it)
+ * and a task on core 0 - away from capture - decodes it at 1/2..1/8
+ * scale and re-encodes it as a small JPEG. Clips keep the full frames.
+ *
+ * Consumers: the LiveStream gets every preview published to it, other
+ * readers take the latest one with acquireLatest() / releaseLatest().
+ * A reader that wants previews without a live viewer calls demand(),
+ * which keeps them coming for that long.
+ */
+class PreviewScaler {
+public:
+    struct Frame {
+        const uint8_t* buf;
+        size_t len;
+        uint32_t timestampMs;
+    };
+
+    struct Stats {
+        uint32_t offered = 0;          // frames copied in for scaling
+        uint32_t busy = 0;             // frames skipped, scaler still on the last one
+        uint32_t encoded = 0;
+        uint32_t failures = 0;         // decode / encode errors, including previews too large
+        uint32_t oversize = 0;         // source frames above maxFrameBytes
+        uint16_t width = 0;            // of the last preview
+        uint16_t height = 0;
+        uint32_t lastSourceBytes = 0;
+        uint32_t lastBytes = 0;
+        uint32_t lastScaleMs = 0;
+        uint32_t maxScaleMs = 0;
+        uint64_t totalSourceBytes = 0;
+        uint64_t totalBytes = 0;
+    };
+
+private:
+    static const int SCALER_CORE = 0;
+    static const UBaseType_t SCALER_PRIORITY = 1;
+    static const uint32_t SCALER_STACK = 6144;
+
+    uint16_t maxWidth;
+    uint8_t quality;
+    unsigned long intervalMs;
+
+    // Source copy, owned by the scaler task while busy is set
+    uint8_t* source;
+    size_t sourceSize;
+    size_t sourceLen;
+    uint32_t sourceTimestampMs;
+    volatile bool busy;
+    unsigned long lastOfferMs;
+
+    uint8_t* rgbBuf;
+    size_t rgbSize;
+
+    // Two output buffers: the scaler fills one while readers hold the other
+    uint8_t* frames[2];
+    size_t frameSize;
+    size_t frameLen[2];
+    uint32_t frameTimestamp[2];
+    size_t encodeLen;
+    int filling;
+    int latest;                        // newest complete preview, -1 if none
+    int reading;                       // held by readers, -1 if none
+    int readers;
+    SemaphoreHandle_t lock;
+
+    LiveStream* liveStream;
+    volatile unsigned long demandUntilMs;
+    TaskHandle_t taskHandle;
+    Stats stats;
+
+    static size_t frameOut(void* arg, size_t index, const void* data, size_t len);
+    static void taskEntry(void* param);
+    void scaleLoop();
+    bool scale();
+
+public:
+    // Constructor - previews at most maxWidth wide, one per intervalMs; maxFrameBytes bounds
+    // the source frames, maxPreviewBytes the previews (both PSRAM)
+    PreviewScaler(uint16_t maxWidth = 320, uint8_t quality = 50, unsigned long intervalMs = 200,
+                  size_t maxFrameBytes = 256 * 1024, size_t maxPreviewBytes = 48 * 1024);
+    ~PreviewScaler();
+
+    // Allocate the buffers and start the scaler task
+    bool begin();
+    void setLiveStream(LiveStream* stream) { liveStream = stream; }
+
+    // Capture task side: never waits, copies only when a preview is due and wanted
+    void offer(const uint8_t* jpeg, size_t len, uint32_t timestampMs);
+    bool wanted() const;
+    // Keep previews coming for holdMs without a live viewer
+    void demand(unsigned long holdMs);
+
+    // Any task: the newest preview no older than maxAgeMs, valid until releaseLatest()
+    bool acquireLatest(Frame& frame, unsigned long maxAgeMs);
+    void releaseLatest();
+
+    // Status
+    bool isRunning() const { return taskHandle != NULL; }
+    unsigned long getIntervalMs() const { return intervalMs; }
+    uint16_t getMaxWidth() const { return maxWidth; }
+    const Stats& getStats() const { return stats; }
+};
+
+#endif // PREVIEWSCALER_H
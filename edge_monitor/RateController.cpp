@@ -0,0 +1,172 @@
+#include "RateController.h"
+
+static const int PACING_START = 6; // first level that slows the frame rate
+
+RateController::RateController() {
+    this->baseFramesize = FRAMESIZE_HD;
+    this->baseQuality = 20;
+    this->baseDelayMs = 0;
+
+    this->level = 0;
+    this->goodWindows = 0;
+    this->paceBaseMs = 0;
+    this->pacedDelayMs = 0;
+    this->appliedFramesize = FRAMESIZE_HD;
+
+    this->windowStartMs = 0;
+    this->windowFrames = 0;
+    this->windowFailures = 0;
+    this->windowCaptureUs = 0;
+    this->lastRingFill = 0;
+    this->windowWrites = 0;
+    this->windowWriteUs = 0;
+
+    this->measuredFps = 0;
+    this->avgCaptureUs = 0;
+    this->avgWriteUs = 0;
+    this->adjustments = 0;
+}
+
+void RateController::setBaseline(int framesize, int quality) {
+    bool qualityChanged = (quality != baseQuality);
+    baseFramesize = framesize;
+    baseQuality = quality;
+    if (level == 0) {
+        appliedFramesize = framesize;
+    }
+    if (qualityChanged && level > 0) {
+        sensor_t* s = esp_camera_sensor_get();
+        if (s) s->set_quality(s, qualityForLevel(level));
+    }
+}
+
+int RateController::qualityForLevel(int lvl) const {
+    int steps = min(lvl, QUALITY_LEVELS);
+    return min(baseQuality + steps * QUALITY_STEP, max(baseQuality, MAX_QUALITY));
+}
+
+int RateController::framesizeForLevel(int lvl) const {
+    int drops = constrain(lvl - QUALITY_LEVELS, 0, FRAMESIZE_LEVELS);
+    int floor = min(baseFramesize, MIN_FRAMESIZE);
+    return max(baseFramesize - drops, floor);
+}
+
+void RateController::applyFramesize() {
+    int target = framesizeForLevel(level);
+    sensor_t* s = esp_camera_sensor_get();
+    if (s && s->status.framesize != target) {
+        if (s->set_framesize(s, (framesize_t)target) != 0) {
+            Serial.printf("WARNING: RateController could not set framesize %d\n", target);
+            return;
+        }
+    }
+    appliedFramesize = target;
+}
+
+void RateController::applyLevel(int newLevel, const char* reason) {
+    if (newLevel >= PACING_START && level < PACING_START) {
+        // Slow down from what was actually achieved, the configured rate may be unlimited
+        paceBaseMs = baseDelayMs;
+        if (measuredFps > 0) paceBaseMs = max(paceBaseMs, (unsigned long)(1000 / measuredFps));
+        if (paceBaseMs == 0) paceBaseMs = 100;
+    }
+    int oldLevel = level;
+    level = newLevel;
+    pacedDelayMs = paceBaseMs;
+    for (int i = PACING_START; i <= level; i++) {
+        pacedDelayMs = pacedDelayMs * 5 / 4;
+    }
+    adjustments++;
+
+    // Quality takes effect on the next frame, frame size at the next clip boundary
+    sensor_t* s = esp_camera_sensor_get();
+    if (s) s->set_quality(s, qualityForLevel(level));
+
+    Serial.printf("RateController: level %d -> %d (%s): quality %d, framesize %d, frame delay %lu ms\n",
+                  oldLevel, level, reason, qualityForLevel(level), framesizeForLevel(level), getFrameDelayMs());
+}
+
+void RateController::beginSession() {
+    applyFramesize();
+    windowStartMs = millis();
+    windowFrames = 0;
+    windowFailures = 0;
+    windowCaptureUs = 0;
+    lastRingFill = 100; // a motion clip starts with the pre-roll queued
+    windowWrites = 0;
+    windowWriteUs = 0;
+}
+
+void RateController::endSession() {
+    applyFramesize();
+}
+
+void RateController::onCapture(uint32_t captureUs, bool ok) {
+    if (ok) {
+        windowFrames++;
+        windowCaptureUs += captureUs;
+    } else {
+        windowFailures++;
+    }
+}
+
+void RateController::onWrite(uint32_t writeUs) {
+    windowWrites++;
+    windowWriteUs += writeUs;
+}
+
+bool RateController::degrade(const char* reason) {
+    if (level >= MAX_LEVEL) {
+        return false;
+    }
+    goodWindows = 0;
+    applyLevel(level + 1, reason);
+    return true;
+}
+
+void RateController::update(int ringFillPercent) {
+    unsigned long elapsed = millis() - windowStartMs;
+    if (elapsed < WINDOW_MS) {
+        return;
+    }
+    uint32_t writes = windowWrites;
+    uint32_t writeUs = windowWriteUs;
+    measuredFps = windowFrames * 1000.0f / elapsed;
+    avgCaptureUs = windowFrames ? (uint32_t)(windowCaptureUs / windowFrames) : 0;
+    avgWriteUs = writes ? writeUs / writes : 0;
+
+    // Hold the rate currently asked for; with no limit only backlog and failures count
+    unsigned long delayMs = getFrameDelayMs();
+    float targetFps = delayMs > 0 ? 1000.0f / delayMs : 0;
+    uint32_t frameIntervalUs = delayMs > 0 ? delayMs * 1000 : (measuredFps > 0 ? (uint32_t)(1000000 / measuredFps) : 0);
+
+    const char* reason = NULL;
+    if (windowFailures > 0) {
+        reason = "capture failures";
+    } else if (ringFillPercent >= 50 && ringFillPercent >= lastRingFill) {
+        reason = "SD writer behind"; // half full and not draining
+    } else if (targetFps > 0 && measuredFps < targetFps * 0.85f) {
+        reason = "below target FPS";
+    }
+
+    if (reason != NULL) {
+        goodWindows = 0;
+        if (level < MAX_LEVEL) applyLevel(level + 1, reason);
+    } else if (ringFillPercent < 20 && (targetFps == 0 || measuredFps >= targetFps * 0.95f)
+               && (frameIntervalUs == 0 || avgWriteUs < frameIntervalUs / 2)) {
+        if (++goodWindows >= RECOVER_WINDOWS && level > 0) {
+            goodWindows = 0;
+            applyLevel(level - 1, "headroom");
+        }
+    } else {
+        goodWindows = 0;
+    }
+
+    lastRingFill = ringFillPercent;
+    windowStartMs = millis();
+    windowFrames = 0;
+    windowFailures = 0;
+    windowCaptureUs = 0;
+    windowWrites = 0;
+    windowWriteUs = 0;
+}
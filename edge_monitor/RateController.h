@@ -0,0 +1,104 @@
+#ifndef RATECONTROLLER_H
+#define RATECONTROLLER_H
+
+#include <Arduino.h>
+#include "esp_camera.h"
+
+/**
+ * RateController - closed-loop frame rate / quality control for recording
+ *
+ * The capture task reports how long each esp_camera_fb_get() took and
+ * whether it failed, the writer task how long each frame took to reach
+ * the SD card. Once per window the controller compares the measured FPS,
+ * latencies, failures and frame ring fill against the target FPS and
+ * moves one step along a degrade ladder, or back after a run of good
+ * windows:
+ *
+ *   1-3  JPEG quality number +5 per level (smaller frames, same pixels)
+ *   4-5  frame size one step down per level (applied between clips, an
+ *        AVI carries a single frame size)
+ *   6-8  frame interval 25% longer per level
+ *
+ * Capture failures step straight down; only a camera still failing at
+ * the last level aborts the recording.
+ */
+class RateController {
+public:
+    static const int MAX_LEVEL = 8;
+
+private:
+    static const unsigned long WINDOW_MS = 1000;
+    static const int RECOVER_WINDOWS = 5;   // good windows in a row before stepping back up
+    static const int QUALITY_STEP = 5;
+    static const int QUALITY_LEVELS = 3;
+    static const int FRAMESIZE_LEVELS = 2;
+    static const int MAX_QUALITY = 50;      // JPEG quality number, higher = smaller frames
+    static const int MIN_FRAMESIZE = FRAMESIZE_VGA;
+
+    // Configured settings the ladder starts from
+    int baseFramesize;
+    int baseQuality;
+    unsigned long baseDelayMs;
+
+    int level;
+    int goodWindows;
+    unsigned long paceBaseMs;       // frame interval when pacing levels were entered
+    unsigned long pacedDelayMs;     // frame delay in effect at the pacing levels
+    int appliedFramesize;
+
+    // Current window, capture side
+    unsigned long windowStartMs;
+    uint32_t windowFrames;
+    uint32_t windowFailures;
+    uint64_t windowCaptureUs;
+    int lastRingFill;
+    // Current window, writer side (benign race, only averaged)
+    volatile uint32_t windowWrites;
+    volatile uint32_t windowWriteUs;
+
+    // Last completed window
+    float measuredFps;
+    uint32_t avgCaptureUs;
+    uint32_t avgWriteUs;
+    uint32_t adjustments;
+
+    int qualityForLevel(int lvl) const;
+    int framesizeForLevel(int lvl) const;
+    void applyLevel(int newLevel, const char* reason);
+    void applyFramesize();
+
+public:
+    RateController();
+
+    // Settings the user asked for; frameDelayMs 0 = as fast as the sensor delivers
+    void setBaseline(int framesize, int quality);
+    void setFrameDelayMs(unsigned long frameDelayMs) { baseDelayMs = frameDelayMs; }
+
+    // Capture task, at clip boundaries: reset the window, set the frame size for the current level
+    void beginSession();
+    void endSession();
+
+    // Per frame samples
+    void onCapture(uint32_t captureUs, bool ok);
+    void onWrite(uint32_t writeUs);
+
+    // Capture task, every frame: evaluate the window once it is complete
+    void update(int ringFillPercent);
+
+    // Too many consecutive capture failures - false if there is nothing left to degrade
+    bool degrade(const char* reason);
+
+    // Frame delay the capture task should use now
+    unsigned long getFrameDelayMs() const { return level > QUALITY_LEVELS + FRAMESIZE_LEVELS ? pacedDelayMs : baseDelayMs; }
+
+    // Status and information
+    int getLevel() const { return level; }
+    int getQuality() const { return qualityForLevel(level); }
+    int getFramesize() const { return appliedFramesize; }
+    float getMeasuredFps() const { return measuredFps; }
+    uint32_t getAvgCaptureUs() const { return avgCaptureUs; }
+    uint32_t getAvgWriteUs() const { return avgWriteUs; }
+    uint32_t getAdjustments() const { return adjustments; }
+};
+
+#endif // RATECONTROLLER_H
@@ -0,0 +1,133 @@
+#include "SDWriteBuffer.h"
+#include "HeapAccounting.h"
+#include "Metrics.h"
+
+const uint32_t WriteLatencyStats::bucketLimitUs[WriteLatencyStats::NUM_BUCKETS] = {
+    1000, 2000, 5000, 10000, 20000, 50000, 100000, UINT32_MAX
+};
+
+void WriteLatencyStats::reset() {
+    memset(buckets, 0, sizeof(buckets));
+    writes = 0;
+    totalUs = 0;
+    maxUs = 0;
+    bytes = 0;
+}
+
+void WriteLatencyStats::record(uint32_t us, size_t len) {
+    int i = 0;
+    while (i < NUM_BUCKETS - 1 && us >= bucketLimitUs[i]) i++;
+    buckets[i]++;
+    writes++;
+    totalUs += us;
+    bytes += len;
+    if (us > maxUs) maxUs = us;
+}
+
+void WriteLatencyStats::merge(const WriteLatencyStats& other) {
+    for (int i = 0; i < NUM_BUCKETS; i++) buckets[i] += other.buckets[i];
+    writes += other.writes;
+    totalUs += other.totalUs;
+    bytes += other.bytes;
+    if (other.maxUs > maxUs) maxUs = other.maxUs;
+}
+
+SDWriteBuffer::SDWriteBuffer(size_t bufferBytes, size_t alignBytes) {
+    this->alignBytes = (alignBytes >= 512) ? alignBytes : 512;
+    this->bufferSize = (bufferBytes / this->alignBytes) * this->alignBytes;
+    if (this->bufferSize == 0) this->bufferSize = this->alignBytes;
+    this->buffer = NULL;
+    this->fill = 0;
+    this->filePos = 0;
+    this->file = NULL;
+    this->writeError = false;
+}
+
+SDWriteBuffer::~SDWriteBuffer() {
+    heapRecorder.release(buffer);
+}
+
+bool SDWriteBuffer::begin() {
+    if (buffer != NULL) {
+        return true; // Already initialized
+    }
+    if (ESP.getFreePsram() > 0) {
+        buffer = (uint8_t*)heapRecorder.alloc(bufferSize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    if (buffer == NULL) {
+        // No PSRAM - a single cluster in DRAM still avoids partial sector writes
+        bufferSize = alignBytes;
+        buffer = (uint8_t*)heapRecorder.alloc(bufferSize, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (buffer == NULL) {
+        Serial.println("ERROR: SDWriteBuffer allocation failed!");
+        return false;
+    }
+    Serial.printf("SDWriteBuffer ready: %zu KB buffer, %zu byte alignment\n", bufferSize / 1024, alignBytes);
+    return true;
+}
+
+void SDWriteBuffer::attach(File& file) {
+    this->file = &file;
+    this->fill = 0;
+    this->filePos = 0;
+    this->writeError = false;
+    this->fileStats.reset();
+}
+
+bool SDWriteBuffer::writeBlock(const uint8_t* data, size_t len) {
+    uint32_t start = micros();
+    size_t written = file->write(data, len);
+    uint32_t us = micros() - start;
+    stats.record(us, written);
+    fileStats.record(us, written);
+    metricSdWriteLatency.record(us);
+    filePos += written;
+    if (written != len) {
+        Serial.printf("ERROR: SD write failed! Expected %zu bytes, wrote %zu bytes\n", len, written);
+        writeError = true;
+        return false;
+    }
+    return true;
+}
+
+size_t SDWriteBuffer::write(const uint8_t* data, size_t len) {
+    if (buffer == NULL || file == NULL) {
+        return 0;
+    }
+    size_t remain = len;
+    while (remain > 0) {
+        if (fill == 0 && remain >= bufferSize) {
+            // Nothing buffered and file offset is aligned - write whole blocks straight from the source
+            size_t direct = (remain / alignBytes) * alignBytes;
+            if (!writeBlock(data, direct)) {
+                return len - remain;
+            }
+            data += direct;
+            remain -= direct;
+            continue;
+        }
+        size_t chunk = min(remain, bufferSize - fill);
+        memcpy(buffer + fill, data, chunk);
+        fill += chunk;
+        data += chunk;
+        remain -= chunk;
+        if (fill == bufferSize) {
+            fill = 0;
+            if (!writeBlock(buffer, bufferSize)) {
+                return len - remain;
+            }
+        }
+    }
+    return len;
+}
+
+bool SDWriteBuffer::flush() {
+    if (buffer == NULL || file == NULL || fill == 0) {
+        return !writeError;
+    }
+    size_t pending = fill;
+    fill = 0;
+    writeBlock(buffer, pending);
+    return !writeError;
+}
@@ -0,0 +1,75 @@
+#ifndef SDWRITEBUFFER_H
+#define SDWRITEBUFFER_H
+
+#include "FS.h"
+
+// Per-write SD latency histogram (bucket layout mirrors MJPEG2SD mjpeg2sd.cpp)
+struct WriteLatencyStats {
+    static const int NUM_BUCKETS = 8;
+    static const uint32_t bucketLimitUs[NUM_BUCKETS]; // upper bound of each bucket, last is open ended
+
+    uint32_t buckets[NUM_BUCKETS];
+    uint32_t writes;
+    uint64_t totalUs;
+    uint32_t maxUs;
+    uint64_t bytes;
+
+    WriteLatencyStats() { reset(); }
+    void reset();
+    void record(uint32_t us, size_t len);
+    void merge(const WriteLatencyStats& other);
+    uint32_t averageUs() const { return writes ? (uint32_t)(totalUs / writes) : 0; }
+    uint32_t kbPerSec() const { return totalUs ? (uint32_t)((bytes * 1000000ULL / totalUs) / 1024) : 0; }
+};
+
+/**
+ * SDWriteBuffer - coalesces small writes into aligned SD blocks
+ *
+ * Data is copied into a PSRAM buffer and only whole multiples of the
+ * alignment (SD cluster size) are written, always at aligned file
+ * offsets, so the FAT driver never has to read-modify-write a sector.
+ * The remainder is written by flush() when the file is closed.
+ */
+class SDWriteBuffer {
+private:
+    uint8_t* buffer;
+    size_t bufferSize;
+    size_t alignBytes;
+    size_t fill;
+    size_t filePos;
+    File* file;
+    bool writeError;
+
+    WriteLatencyStats stats;
+    WriteLatencyStats fileStats;    // since the last attach()
+
+    bool writeBlock(const uint8_t* data, size_t len);
+
+public:
+    // Constructor - bufferBytes is rounded down to a multiple of alignBytes
+    SDWriteBuffer(size_t bufferBytes = 32 * 1024, size_t alignBytes = 4096);
+    ~SDWriteBuffer();
+
+    // Allocate the buffer (PSRAM if available)
+    bool begin();
+
+    // Attach to a file positioned at offset 0, discarding any buffered data
+    void attach(File& file);
+    void detach() { file = NULL; }
+
+    // Buffered write, returns bytes accepted
+    size_t write(const uint8_t* data, size_t len);
+
+    // Write out whatever is buffered (partial block) - call before seek/close
+    bool flush();
+
+    // Status and information
+    size_t position() const { return filePos + fill; }
+    size_t getBufferSize() const { return bufferSize; }
+    size_t getAlignBytes() const { return alignBytes; }
+    bool hasError() const { return writeError; }
+    WriteLatencyStats& getStats() { return stats; }
+    const WriteLatencyStats& getFileStats() const { return fileStats; }
+};
+
+#endif // SDWRITEBUFFER_H
@@ -0,0 +1,77 @@
+#include "SceneChange.h"
+#include "HeapAccounting.h"
+#include "MotionDetector.h"
+
+SceneChange::SceneChange(int cellThreshold, int minCells) {
+    this->thumb = NULL;
+    this->thumbSize = 0;
+    this->haveCurrent = false;
+    this->haveReference = false;
+    this->cellThreshold = cellThreshold;
+    this->minCells = minCells;
+    this->changedCells = 0;
+    this->lastCheckUs = 0;
+    this->checks = 0;
+}
+
+SceneChange::~SceneChange() {
+    heapMotion.release(thumb);
+}
+
+bool SceneChange::begin(int maxFrameWidth, int maxFrameHeight) {
+    if (thumb != NULL) {
+        return true; // Already initialized
+    }
+    thumbSize = ((maxFrameWidth + 7) / 8) * ((maxFrameHeight + 7) / 8);
+    thumb = (uint8_t*)heapMotion.allocPreferPsram(thumbSize);
+    if (thumb == NULL) {
+        Serial.println("ERROR: SceneChange allocation failed!");
+        return false;
+    }
+    return true;
+}
+
+bool SceneChange::changed(const uint8_t* jpeg, size_t len) {
+    uint32_t startUs = micros();
+    haveCurrent = false;
+    changedCells = GRID_CELLS;
+    int width = 0, height = 0;
+    if (thumb == NULL || !MotionDetector::decodeDCLuma(jpeg, len, thumb, thumbSize, &width, &height) ||
+        width < GRID_W || height < GRID_H) {
+        return true;
+    }
+
+    // Mean of each grid cell over the DC thumbnail
+    for (int gy = 0; gy < GRID_H; gy++) {
+        int y0 = gy * height / GRID_H;
+        int y1 = (gy + 1) * height / GRID_H;
+        for (int gx = 0; gx < GRID_W; gx++) {
+            int x0 = gx * width / GRID_W;
+            int x1 = (gx + 1) * width / GRID_W;
+            uint32_t sum = 0;
+            for (int y = y0; y < y1; y++) {
+                const uint8_t* row = thumb + y * width;
+                for (int x = x0; x < x1; x++) sum += row[x];
+            }
+            current[gy * GRID_W + gx] = sum / ((y1 - y0) * (x1 - x0));
+        }
+    }
+    haveCurrent = true;
+
+    if (haveReference) {
+        changedCells = 0;
+        for (int i = 0; i < GRID_CELLS; i++) {
+            changedCells += abs(current[i] - reference[i]) > cellThreshold;
+        }
+    }
+    checks++;
+    lastCheckUs = micros() - startUs;
+    return !haveReference || changedCells >= minCells;
+}
+
+void SceneChange::accept() {
+    if (haveCurrent) {
+        memcpy(reference, current, GRID_CELLS);
+        haveReference = true;
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef SCENECHANGE_H
+#define SCENECHANGE_H
+
+#include <Arduino.h>
+
+/**
+ * SceneChange - has the picture changed since the last snapshot sent?
+ *
+ * Each candidate JPEG is reduced to a GRID_W x GRID_H grid of mean
+ * luma from its DC terms (no full decode, a few ms per frame) and
+ * compared with the grid of the last frame that was accepted. The
+ * picture counts as changed once minCells cells differ by more than
+ * cellThreshold levels. Comparing against the last accepted frame
+ * rather than the previous one means slow drift still gets through
+ * once it adds up.
+ */
+class SceneChange {
+public:
+    static const int GRID_W = 16;
+    static const int GRID_H = 12;
+    static const int GRID_CELLS = GRID_W * GRID_H;
+
+private:
+    uint8_t* thumb;
+    size_t thumbSize;
+    uint8_t current[GRID_CELLS];
+    uint8_t reference[GRID_CELLS];
+    bool haveCurrent;
+    bool haveReference;
+
+    int cellThreshold;
+    int minCells;
+    int changedCells;
+    uint32_t lastCheckUs;
+    uint32_t checks;
+
+public:
+    // Constructor - cellThreshold in luma levels (0 - 255)
+    SceneChange(int cellThreshold = 8, int minCells = 3);
+    ~SceneChange();
+
+    // Size the DC thumbnail for the largest frame that will be checked
+    bool begin(int maxFrameWidth = 1600, int maxFrameHeight = 1200);
+
+    // Compare a JPEG with the last accepted one; true if changed (or it can't tell)
+    bool changed(const uint8_t* jpeg, size_t len);
+    // The frame just checked was sent - it is the new reference
+    void accept();
+
+    // Status
+    int getChangedCells() const { return changedCells; }
+    int getMinCells() const { return minCells; }
+    uint32_t getLastCheckUs() const { return lastCheckUs; }
+    uint32_t getChecks() const { return checks; }
+};
+
+#endif // SCENECHANGE_H
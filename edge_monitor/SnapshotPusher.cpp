@@ -0,0 +1,198 @@
+#include "SnapshotPusher.h"
+#include "HeapAccounting.h"
+#include "Metrics.h"
+
+SnapshotPusher::SnapshotPusher(int numSlots, size_t maxFrameBytes, unsigned long timeoutMs) {
+    this->numSlots = constrain(numSlots, 1, MAX_SLOTS);
+    this->maxFrameBytes = maxFrameBytes;
+    this->timeoutMs = timeoutMs;
+    this->nextSeq = 0;
+    this->connections = NULL;
+    this->heartbeatBody[0] = '\0';
+    this->heartbeatLen = 0;
+    this->heartbeatPending = false;
+    this->response[0] = '\0';
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        slots[i].data = NULL;
+        slots[i].len = 0;
+        slots[i].queuedMs = 0;
+        slots[i].seq = 0;
+        slots[i].state = SLOT_FREE;
+    }
+    this->lock = xSemaphoreCreateMutex();
+    this->pending = xSemaphoreCreateCounting(MAX_SLOTS + 1, 0); // queued slots plus a heartbeat
+    this->taskHandle = NULL;
+}
+
+SnapshotPusher::~SnapshotPusher() {
+    if (taskHandle) vTaskDelete(taskHandle);
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        heapStream.release(slots[i].data);
+    }
+    if (lock) vSemaphoreDelete(lock);
+    if (pending) vSemaphoreDelete(pending);
+}
+
+bool SnapshotPusher::begin(ConnectionManager* connections, const String& host, int port, const String& path,
+                           const String& heartbeatPath) {
+    this->connections = connections;
+    imageEndpoint.set(host.c_str(), port, path.c_str());
+    if (heartbeatPath.length() > 0) {
+        heartbeatEndpoint.set(host.c_str(), port, heartbeatPath.c_str());
+    }
+    if (taskHandle != NULL) {
+        return true; // Already running
+    }
+    for (int i = 0; i < numSlots; i++) {
+        slots[i].data = (uint8_t*)heapStream.alloc(maxFrameBytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (slots[i].data == NULL) {
+            Serial.println("ERROR: Snapshot slot allocation failed!");
+            return false;
+        }
+    }
+    BaseType_t ok = xTaskCreatePinnedToCore(taskEntry, "snapshotPush", PUSH_STACK,
+                                            this, PUSH_PRIORITY, &taskHandle, PUSH_CORE);
+    if (ok != pdPASS) {
+        Serial.println("ERROR: Failed to create snapshot push task!");
+        taskHandle = NULL;
+        return false;
+    }
+    Serial.printf("SnapshotPusher ready: %d x %u KB slots\n", numSlots, (unsigned)(maxFrameBytes / 1024));
+    return true;
+}
+
+int SnapshotPusher::oldestQueued() {
+    int oldest = -1;
+    for (int i = 0; i < numSlots; i++) {
+        if (slots[i].state == SLOT_QUEUED && (oldest < 0 || (int32_t)(slots[i].seq - slots[oldest].seq) < 0)) {
+            oldest = i;
+        }
+    }
+    return oldest;
+}
+
+bool SnapshotPusher::submit(const uint8_t* jpeg, size_t len) {
+    if (taskHandle == NULL) {
+        return false;
+    }
+    if (len > maxFrameBytes) {
+        stats.oversize++;
+        return false;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int slot = -1;
+    for (int i = 0; i < numSlots && slot < 0; i++) {
+        if (slots[i].state == SLOT_FREE) slot = i;
+    }
+    bool replaced = false;
+    if (slot < 0) {
+        // Everything queued or in flight - the oldest waiting snapshot is the least useful
+        slot = oldestQueued();
+        if (slot < 0) {
+            xSemaphoreGive(lock);
+            stats.dropped++;
+            return false;
+        }
+        replaced = true;
+        stats.dropped++;
+        metricSnapshotsDropped.inc();
+    }
+    memcpy(slots[slot].data, jpeg, len);
+    slots[slot].len = len;
+    slots[slot].queuedMs = millis();
+    slots[slot].seq = nextSeq++;
+    slots[slot].state = SLOT_QUEUED;
+    stats.submitted++;
+    xSemaphoreGive(lock);
+    if (!replaced) {
+        xSemaphoreGive(pending); // A replaced slot was already counted
+    }
+    return true;
+}
+
+bool SnapshotPusher::submitHeartbeat(const char* json, size_t len) {
+    if (taskHandle == NULL || !heartbeatEndpoint.isValid() || len >= sizeof(heartbeatBody)) {
+        return false;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool wasPending = heartbeatPending;
+    memcpy(heartbeatBody, json, len);
+    heartbeatLen = len;
+    heartbeatPending = true;
+    xSemaphoreGive(lock);
+    if (!wasPending) {
+        xSemaphoreGive(pending);
+    }
+    return true;
+}
+
+void SnapshotPusher::sendHeartbeat() {
+    char body[MAX_HEARTBEAT];
+    xSemaphoreTake(lock, portMAX_DELAY);
+    size_t len = heartbeatLen;
+    memcpy(body, heartbeatBody, len);
+    heartbeatPending = false;
+    xSemaphoreGive(lock);
+    int code = connections->request(heartbeatEndpoint.host, heartbeatEndpoint.port, false, "POST",
+                                    heartbeatEndpoint.path, "application/json", (const uint8_t*)body, len,
+                                    response, sizeof(response), timeoutMs);
+    stats.lastHttpCode = code;
+    if (code >= 200 && code < 300) {
+        stats.heartbeats++;
+    } else {
+        stats.failed++;
+        Serial.printf("ERROR: Snapshot heartbeat failed (HTTP %d)\n", code);
+    }
+}
+
+int SnapshotPusher::getQueued() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int count = 0;
+    for (int i = 0; i < numSlots; i++) {
+        if (slots[i].state != SLOT_FREE) count++;
+    }
+    xSemaphoreGive(lock);
+    return count;
+}
+
+void SnapshotPusher::taskEntry(void* param) {
+    ((SnapshotPusher*)param)->pushLoop();
+}
+
+void SnapshotPusher::pushLoop() {
+    while (true) {
+        xSemaphoreTake(pending, portMAX_DELAY);
+        xSemaphoreTake(lock, portMAX_DELAY);
+        int slot = oldestQueued();
+        if (slot >= 0) slots[slot].state = SLOT_SENDING;
+        bool heartbeat = slot < 0 && heartbeatPending;
+        xSemaphoreGive(lock);
+        if (heartbeat) {
+            sendHeartbeat();
+        }
+        if (slot < 0) {
+            continue;
+        }
+
+        Slot& s = slots[slot];
+        int code = connections->request(imageEndpoint.host, imageEndpoint.port, false, "POST",
+                                        imageEndpoint.path, "image/jpeg", s.data, s.len,
+                                        response, sizeof(response), timeoutMs);
+        uint32_t latencyMs = millis() - s.queuedMs;
+        stats.lastHttpCode = code;
+        if (code >= 200 && code < 300) {
+            stats.sent++;
+            stats.lastLatencyMs = latencyMs;
+            stats.totalLatencyMs += latencyMs;
+            if (latencyMs > stats.maxLatencyMs) stats.maxLatencyMs = latencyMs;
+            metricSnapshotLatency.record(latencyMs * 1000);
+        } else {
+            stats.failed++;
+            Serial.printf("ERROR: Snapshot push failed (HTTP %d after %u ms)\n", code, (unsigned)latencyMs);
+        }
+
+        xSemaphoreTake(lock, portMAX_DELAY);
+        s.state = SLOT_FREE;
+        xSemaphoreGive(lock);
+    }
+}
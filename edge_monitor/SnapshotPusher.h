@@ -0,0 +1,105 @@
+#ifndef SNAPSHOTPUSHER_H
+#define SNAPSHOTPUSHER_H
+
+#include <Arduino.h>
+#include "ConnectionManager.h"
+#include "HttpEndpoint.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+/**
+ * SnapshotPusher - background delivery of still images to the server
+ *
+ * loop() copies a JPEG into one of a few PSRAM slots and hands the
+ * camera buffer straight back; a task on core 0 posts the queued
+ * copies (oldest first) over the shared keep-alive connection. With
+ * every slot queued the oldest waiting snapshot is dropped, so a slow
+ * server costs stale images rather than a blocked loop. Latency is
+ * counted from submit() to the server's reply.
+ *
+ * When the scene hasn't changed loop() sends a heartbeat instead: a
+ * small JSON body posted to a separate path, so the server knows the
+ * device is alive and its last image is still current.
+ *
+ * Both endpoints are resolved in begin() and the heartbeat body and
+ * server replies live in fixed buffers, so a push allocates nothing.
+ */
+class SnapshotPusher {
+public:
+    struct Stats {
+        uint32_t submitted = 0;
+        uint32_t sent = 0;
+        uint32_t failed = 0;
+        uint32_t dropped = 0;         // replaced by a newer snapshot before it was sent
+        uint32_t oversize = 0;
+        uint32_t heartbeats = 0;
+        int lastHttpCode = 0;
+        uint32_t lastLatencyMs = 0;
+        uint32_t maxLatencyMs = 0;
+        uint64_t totalLatencyMs = 0;
+    };
+
+private:
+    enum SlotState : uint8_t { SLOT_FREE, SLOT_QUEUED, SLOT_SENDING };
+    struct Slot {
+        uint8_t* data;
+        size_t len;
+        unsigned long queuedMs;
+        uint32_t seq;
+        SlotState state;
+    };
+
+    static const int MAX_SLOTS = 4;
+    static const int PUSH_CORE = 0;
+    static const UBaseType_t PUSH_PRIORITY = 1;
+    static const uint32_t PUSH_STACK = 6144;
+    static const size_t MAX_HEARTBEAT = 192;
+    static const size_t RESPONSE_BYTES = 128;
+
+    Slot slots[MAX_SLOTS];
+    int numSlots;
+    size_t maxFrameBytes;
+    unsigned long timeoutMs;
+    uint32_t nextSeq;
+
+    ConnectionManager* connections;
+    HttpEndpoint imageEndpoint;
+    HttpEndpoint heartbeatEndpoint;     // Invalid when heartbeats are off
+    char heartbeatBody[MAX_HEARTBEAT];
+    size_t heartbeatLen;
+    bool heartbeatPending;
+    char response[RESPONSE_BYTES];      // Push task only
+
+    SemaphoreHandle_t lock;
+    SemaphoreHandle_t pending;
+    TaskHandle_t taskHandle;
+    Stats stats;
+
+    int oldestQueued();
+    static void taskEntry(void* param);
+    void pushLoop();
+    void sendHeartbeat();
+
+public:
+    // Constructor - numSlots buffers of maxFrameBytes each (PSRAM)
+    SnapshotPusher(int numSlots = 3, size_t maxFrameBytes = 256 * 1024, unsigned long timeoutMs = 10000);
+    ~SnapshotPusher();
+
+    // Allocate the slots and start the push task
+    bool begin(ConnectionManager* connections, const String& host, int port, const String& path,
+               const String& heartbeatPath = "");
+
+    // Copy a JPEG for delivery; never waits on the network
+    bool submit(const uint8_t* jpeg, size_t len);
+    // Queue an "unchanged" heartbeat (JSON); a newer one replaces one not yet sent
+    bool submitHeartbeat(const char* json, size_t len);
+
+    // Status
+    int getQueued();
+    int getSlots() const { return numSlots; }
+    uint32_t getAvgLatencyMs() const { return stats.sent ? (uint32_t)(stats.totalLatencyMs / stats.sent) : 0; }
+    const Stats& getStats() const { return stats; }
+};
+
+#endif // SNAPSHOTPUSHER_H
@@ -0,0 +1,228 @@
+#include "StatusEvents.h"
+#include "JsonAllocator.h"
+
+// What dashboards show; everything else stays in /status
+const StatusEvents::Field StatusEvents::FIELDS[] = {
+    {NULL, "wifi_connected"},
+    {NULL, "is_recording"},
+    {NULL, "system_paused"},
+    {NULL, "camera_ready"},
+    {NULL, "sd_ready"},
+    {NULL, "file_count"},
+    {NULL, "storage_used"},
+    {"upload_stats", "queue_size"},
+    {"upload_stats", "queue_alert"},
+    {"upload_stats", "queue_motion"},
+    {"upload_stats", "bytes_uploaded"},
+    {"capture_stats", "total_captures"},
+    {"capture_stats", "failed_captures"},
+    {"capture_stats", "consecutive_failures"},
+    {"capture_stats", "degraded_mode"},
+    {"capture_stats", "ring_dropped"},
+    {"motion", "detected"},
+    {"motion", "triggers"},
+};
+const int StatusEvents::NUM_FIELDS = sizeof(FIELDS) / sizeof(FIELDS[0]);
+
+StatusEvents::StatusEvents(unsigned long heartbeatMs) {
+    this->server = NULL;
+    this->heartbeatMs = heartbeatMs;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        this->clients[i] = -1;
+    }
+    this->lock = xSemaphoreCreateMutex();
+    this->fullPending = false;
+    this->known = false;
+    this->seq = 0;
+    this->lastFrameMs = 0;
+    this->frame[0] = '\0';
+    static_assert(sizeof(FIELDS) / sizeof(FIELDS[0]) <= MAX_FIELDS, "StatusEvents: raise MAX_FIELDS");
+}
+
+StatusEvents::~StatusEvents() {
+    if (lock) vSemaphoreDelete(lock);
+}
+
+bool StatusEvents::attach(httpd_handle_t server) {
+    // Sockets belonged to the old server instance
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        clients[i] = -1;
+    }
+    xSemaphoreGive(lock);
+    this->server = server;
+
+    httpd_uri_t wsUri = {};
+    wsUri.uri = "/events";
+    wsUri.method = HTTP_GET;
+    wsUri.handler = wsHandler;
+    wsUri.user_ctx = this;
+    wsUri.is_websocket = true;
+    if (httpd_register_uri_handler(server, &wsUri) != ESP_OK) {
+        Serial.println("ERROR: Failed to register /events");
+        return false;
+    }
+    return true;
+}
+
+esp_err_t StatusEvents::wsHandler(httpd_req_t* req) {
+    return ((StatusEvents*)req->user_ctx)->handleSocket(req);
+}
+
+esp_err_t StatusEvents::handleSocket(httpd_req_t* req) {
+    int fd = httpd_req_to_sockfd(req);
+    if (req->method == HTTP_GET) {
+        // Handshake done - the next update() sends this client a full frame
+        if (!addClient(fd)) {
+            stats.rejected++;
+            Serial.printf("WARNING: /events already has %d clients, refusing socket %d\n", MAX_CLIENTS, fd);
+            return ESP_FAIL;
+        }
+        stats.sessions++;
+        fullPending = true;
+        return ESP_OK;
+    }
+    uint8_t payload[8];
+    httpd_ws_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.payload = payload;
+    esp_err_t ret = httpd_ws_recv_frame(req, &frame, sizeof(payload));
+    if (ret != ESP_OK) {
+        dropClient(fd);
+        return ret;
+    }
+    if (frame.type == HTTPD_WS_TYPE_TEXT && frame.len == 4 && memcmp(payload, "full", 4) == 0) {
+        fullPending = true;
+    }
+    return ESP_OK;
+}
+
+bool StatusEvents::addClient(int fd) {
+    bool added = false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < MAX_CLIENTS && !added; i++) {
+        if (clients[i] == fd) {
+            added = true; // already known
+        }
+    }
+    for (int i = 0; i < MAX_CLIENTS && !added; i++) {
+        if (clients[i] < 0) {
+            clients[i] = fd;
+            added = true;
+        }
+    }
+    xSemaphoreGive(lock);
+    return added;
+}
+
+void StatusEvents::dropClient(int fd) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i] == fd) {
+            clients[i] = -1;
+        }
+    }
+    xSemaphoreGive(lock);
+}
+
+int StatusEvents::copyClients(int* out) {
+    int n = 0;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i] >= 0) {
+            out[n++] = clients[i];
+        }
+    }
+    xSemaphoreGive(lock);
+    return n;
+}
+
+int StatusEvents::getClientCount() {
+    int fds[MAX_CLIENTS];
+    return copyClients(fds);
+}
+
+int64_t StatusEvents::fieldValue(JsonVariantConst v) {
+    if (v.is<bool>()) {
+        return v.as<bool>() ? 1 : 0;
+    }
+    return v.as<long long>();
+}
+
+void StatusEvents::addField(JsonObject changes, const Field& f, JsonVariantConst v) {
+    char name[48];
+    if (f.section) {
+        snprintf(name, sizeof(name), "%s.%s", f.section, f.key);
+    } else {
+        snprintf(name, sizeof(name), "%s", f.key);
+    }
+    changes[name] = v;
+}
+
+void StatusEvents::update(const JsonDocument& status) {
+    int fds[MAX_CLIENTS];
+    int n = copyClients(fds);
+    if (n == 0 || server == NULL) {
+        known = false; // whoever connects next starts from a full frame
+        return;
+    }
+
+    bool full = fullPending || !known;
+    fullPending = false;
+    JsonDocument msg(&jsonAllocator);
+    msg["seq"] = ++seq;
+    msg["uptime"] = status["uptime"];
+    msg["free_heap"] = status["free_heap"];
+    if (full) {
+        msg["full"] = true;
+    }
+    JsonObject changes = msg["changes"].to<JsonObject>();
+    int changed = 0;
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        const Field& f = FIELDS[i];
+        JsonVariantConst v = f.section ? status[f.section][f.key] : status[f.key];
+        if (v.isNull()) {
+            continue;
+        }
+        int64_t value = fieldValue(v);
+        if (full || value != last[i]) {
+            last[i] = value;
+            addField(changes, f, v);
+            changed++;
+        }
+    }
+    known = true;
+
+    unsigned long now = millis();
+    if (changed == 0 && now - lastFrameMs < heartbeatMs) {
+        seq--; // nothing sent, keep the sequence gapless
+        return;
+    }
+    size_t len = serializeJson(msg, frame, sizeof(frame));
+    if (len == 0 || len >= sizeof(frame) - 1) {
+        Serial.printf("WARNING: Status event needs more than %u bytes, not sent\n", (unsigned)sizeof(frame));
+        return;
+    }
+    lastFrameMs = now;
+    stats.frames++;
+    stats.changedFields += full ? 0 : changed;
+    if (full) stats.fullFrames++;
+
+    for (int i = 0; i < n; i++) {
+        // Same direct send as the MJPEG2SD log socket; a closed socket can't be written
+        httpd_ws_frame_t pkt;
+        memset(&pkt, 0, sizeof(pkt));
+        pkt.payload = (uint8_t*)frame;
+        pkt.len = len;
+        pkt.type = HTTPD_WS_TYPE_TEXT;
+        pkt.final = true;
+        esp_err_t ret = ESP_FAIL;
+        if (httpd_ws_get_fd_info(server, fds[i]) == HTTPD_WS_CLIENT_WEBSOCKET) {
+            ret = httpd_ws_send_frame_async(server, fds[i], &pkt);
+        }
+        if (ret != ESP_OK) {
+            stats.sendFailures++;
+            dropClient(fds[i]);
+        }
+    }
+}
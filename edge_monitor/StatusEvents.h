@@ -0,0 +1,84 @@
+#ifndef STATUSEVENTS_H
+#define STATUSEVENTS_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+/**
+ * StatusEvents - pushes /status changes to dashboards over a WebSocket
+ *
+ * Clients open /events and get one full frame with every watched field,
+ * then compact deltas holding only the fields that changed since the
+ * last frame, e.g. {"seq":7,"uptime":..,"free_heap":..,"changes":
+ * {"is_recording":true,"upload_stats.queue_size":3}}. Fields inside a
+ * /status section are named section.key. loop() feeds it the document
+ * it already builds for StatusSnapshot, so no extra work is done to find
+ * changes. With nothing changing a heartbeat (empty changes) goes out
+ * every heartbeatMs so a client can tell a quiet device from a dead one.
+ * Sending "full" on the socket asks for a fresh full frame.
+ */
+class StatusEvents {
+public:
+    struct Stats {
+        uint32_t sessions = 0;
+        uint32_t rejected = 0;        // over MAX_CLIENTS
+        uint32_t frames = 0;          // sent, counted once per frame not per client
+        uint32_t fullFrames = 0;
+        uint32_t changedFields = 0;
+        uint32_t sendFailures = 0;    // each dropped a client
+    };
+
+    static const int MAX_CLIENTS = 4;
+
+private:
+    struct Field {
+        const char* section;          // NULL for top-level keys
+        const char* key;
+    };
+
+    static const Field FIELDS[];
+    static const int NUM_FIELDS;
+    static const int MAX_FIELDS = 24;
+    static const size_t MAX_FRAME = 768;
+
+    httpd_handle_t server;
+    unsigned long heartbeatMs;
+    int clients[MAX_CLIENTS];
+    SemaphoreHandle_t lock;       // clients[], shared with the server task
+    volatile bool fullPending;
+
+    // Owned by the caller of update()
+    int64_t last[MAX_FIELDS];
+    bool known;
+    uint32_t seq;
+    unsigned long lastFrameMs;
+    char frame[MAX_FRAME];
+    Stats stats;
+
+    static esp_err_t wsHandler(httpd_req_t* req);
+    esp_err_t handleSocket(httpd_req_t* req);
+    bool addClient(int fd);
+    void dropClient(int fd);
+    int copyClients(int* out);
+    static int64_t fieldValue(JsonVariantConst v);
+    static void addField(JsonObject changes, const Field& f, JsonVariantConst v);
+
+public:
+    StatusEvents(unsigned long heartbeatMs = 10000);
+    ~StatusEvents();
+
+    // Register /events on the control server (again after it restarts)
+    bool attach(httpd_handle_t server);
+
+    // Compare a freshly built /status document with the last one sent and push the difference
+    void update(const JsonDocument& status);
+
+    // Status
+    int getClientCount();
+    const Stats& getStats() const { return stats; }
+};
+
+#endif // STATUSEVENTS_H
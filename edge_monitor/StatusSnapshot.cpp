@@ -0,0 +1,110 @@
+#include "StatusSnapshot.h"
+#include "HeapAccounting.h"
+
+StatusSnapshot::StatusSnapshot(size_t bufferSize, unsigned long refreshMs) {
+    this->bufferSize = bufferSize;
+    this->refreshMs = refreshMs;
+    this->buffer = NULL;
+    this->length = 0;
+    this->contentHash = 0;
+    this->etag[0] = '\0';
+    this->builtMs = 0;
+    this->lock = xSemaphoreCreateMutex();
+    this->dirty = true;
+    this->builds = 0;
+    this->changes = 0;
+    this->served = 0;
+    this->notModified = 0;
+    this->oversize = 0;
+}
+
+StatusSnapshot::~StatusSnapshot() {
+    heapStatus.release(buffer);
+    if (lock) vSemaphoreDelete(lock);
+}
+
+bool StatusSnapshot::begin() {
+    if (buffer != NULL) {
+        return true; // Already initialized
+    }
+    buffer = (char*)heapStatus.allocPreferPsram(bufferSize);
+    if (buffer == NULL || lock == NULL) {
+        Serial.println("ERROR: Failed to allocate status snapshot buffer!");
+        return false;
+    }
+    buffer[0] = '\0';
+    return true;
+}
+
+uint32_t StatusSnapshot::hash(const char* data, size_t len) {
+    // FNV-1a, only has to tell two status bodies apart
+    uint32_t h = 2166136261UL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t)data[i];
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+bool StatusSnapshot::needsRefresh(unsigned long nowMs) const {
+    return dirty || length == 0 || nowMs - builtMs >= refreshMs;
+}
+
+bool StatusSnapshot::publish(const JsonDocument& doc) {
+    if (buffer == NULL) {
+        return false;
+    }
+    size_t needed = measureJson(doc);
+    if (needed >= bufferSize) {
+        oversize++;
+        Serial.printf("WARNING: Status is %u bytes, snapshot buffer holds %u\n",
+                      (unsigned)needed, (unsigned)bufferSize);
+        return false;
+    }
+    // Never wait on a slow client - the next loop() tries again
+    if (xSemaphoreTake(lock, 0) != pdTRUE) {
+        return false;
+    }
+    dirty = false;
+    length = serializeJson(doc, buffer, bufferSize);
+    uint32_t h = hash(buffer, length);
+    if (h != contentHash || etag[0] == '\0') {
+        contentHash = h;
+        snprintf(etag, sizeof(etag), "\"%08lx\"", (unsigned long)h);
+        changes++;
+    }
+    builtMs = millis();
+    builds++;
+    xSemaphoreGive(lock);
+    return true;
+}
+
+esp_err_t StatusSnapshot::send(httpd_req_t* req) {
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    if (buffer == NULL || length == 0) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    char clientTag[sizeof(etag)];
+    bool haveClientTag = httpd_req_get_hdr_value_len(req, "If-None-Match") < sizeof(clientTag) &&
+                         httpd_req_get_hdr_value_str(req, "If-None-Match", clientTag, sizeof(clientTag)) == ESP_OK;
+
+    // Headers are only referenced until the send, so the body and tag stay locked until then
+    xSemaphoreTake(lock, portMAX_DELAY);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    esp_err_t res;
+    if (haveClientTag && strcmp(clientTag, etag) == 0) {
+        notModified++;
+        httpd_resp_set_status(req, "304 Not Modified");
+        res = httpd_resp_send(req, NULL, 0);
+    } else {
+        served++;
+        httpd_resp_set_type(req, "application/json");
+        res = httpd_resp_send(req, buffer, length);
+    }
+    xSemaphoreGive(lock);
+    return res;
+}
@@ -0,0 +1,73 @@
+#ifndef STATUSSNAPSHOT_H
+#define STATUSSNAPSHOT_H
+
+#include <Arduino.h>
+#include "esp_http_server.h"
+#include "ArduinoJson.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+/**
+ * StatusSnapshot - pre-serialized /status body served from memory
+ *
+ * loop() rebuilds the status document when something marked it dirty
+ * (an API change, a recording starting or finishing) or after the
+ * refresh period, and publish()es it into a buffer sized once in
+ * begin(). The HTTP handler only copies that buffer to the socket, so
+ * polling never queries the sensor, SD index or WiFi and never waits
+ * on the tasks that own them.
+ *
+ * Each body carries an ETag (hash of its content); a poll with a
+ * matching If-None-Match gets 304 Not Modified and no body.
+ */
+class StatusSnapshot {
+private:
+    size_t bufferSize;
+    unsigned long refreshMs;
+
+    // Published body, guarded by lock
+    char* buffer;
+    size_t length;
+    uint32_t contentHash;
+    char etag[16];
+    unsigned long builtMs;
+    SemaphoreHandle_t lock;
+
+    volatile bool dirty;
+
+    // Statistics
+    uint32_t builds;
+    uint32_t changes;
+    uint32_t served;
+    uint32_t notModified;
+    uint32_t oversize;
+
+    static uint32_t hash(const char* data, size_t len);
+
+public:
+    StatusSnapshot(size_t bufferSize, unsigned long refreshMs);
+    ~StatusSnapshot();
+
+    bool begin();
+
+    // Owning tasks: flag that the status changed, rebuilt on the next loop()
+    void markDirty() { dirty = true; }
+    bool needsRefresh(unsigned long nowMs) const;
+
+    // Serialize doc as the new body; false if it didn't fit or the body is being sent
+    bool publish(const JsonDocument& doc);
+
+    // HTTP handler: 200 with the cached body, or 304 if the client's ETag matches
+    esp_err_t send(httpd_req_t* req);
+
+    // Status and information
+    size_t getLength() const { return length; }
+    size_t getBufferSize() const { return bufferSize; }
+    uint32_t getBuilds() const { return builds; }
+    uint32_t getChanges() const { return changes; }
+    uint32_t getServed() const { return served; }
+    uint32_t getNotModified() const { return notModified; }
+    uint32_t getOversize() const { return oversize; }
+};
+
+#endif // STATUSSNAPSHOT_H
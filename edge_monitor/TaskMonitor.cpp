@@ -0,0 +1,149 @@
+#include "TaskMonitor.h"
+#include "HeapAccounting.h"
+
+TaskMonitor::TaskMonitor(unsigned long samplePeriodMs) {
+    this->samplePeriodMs = samplePeriodMs;
+    this->sysState = NULL;
+    this->working = NULL;
+    this->samples = NULL;
+    this->numSamples = 0;
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        idlePercent[i] = 0;
+    }
+    this->prevTotalRunTime = 0;
+    this->sampleCount = 0;
+    this->lock = xSemaphoreCreateMutex();
+    this->taskHandle = NULL;
+}
+
+TaskMonitor::~TaskMonitor() {
+    if (taskHandle) vTaskDelete(taskHandle);
+    heapStatus.release(sysState);
+    heapStatus.release(working);
+    heapStatus.release(samples);
+    if (lock) vSemaphoreDelete(lock);
+}
+
+bool TaskMonitor::hasRunTimeStats() const {
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool TaskMonitor::begin() {
+    if (taskHandle != NULL) {
+        return true; // Already running
+    }
+#if configUSE_TRACE_FACILITY
+    // Internal RAM, the sample runs with the scheduler briefly suspended
+    sysState = (TaskStatus_t*)heapStatus.alloc(MAX_TASKS * sizeof(TaskStatus_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    working = (TaskSample*)heapStatus.alloc(MAX_TASKS * sizeof(TaskSample), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    samples = (TaskSample*)heapStatus.alloc(MAX_TASKS * sizeof(TaskSample), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (sysState == NULL || working == NULL || samples == NULL || lock == NULL) {
+        Serial.println("ERROR: Failed to allocate task monitor buffers!");
+        return false;
+    }
+    if (!hasRunTimeStats()) {
+        Serial.println("WARNING: FreeRTOS run time stats disabled, task CPU usage not reported");
+    }
+    BaseType_t ok = xTaskCreatePinnedToCore(taskEntry, "taskMonitor", MONITOR_STACK,
+                                            this, MONITOR_PRIORITY, &taskHandle, MONITOR_CORE);
+    if (ok != pdPASS) {
+        Serial.println("ERROR: Failed to create task monitor task!");
+        taskHandle = NULL;
+        return false;
+    }
+    Serial.printf("TaskMonitor ready: sampling every %lu ms\n", samplePeriodMs);
+    return true;
+#else
+    Serial.println("WARNING: FreeRTOS trace facility disabled, task monitor unavailable");
+    return false;
+#endif
+}
+
+void TaskMonitor::taskEntry(void* param) {
+    TaskMonitor* self = (TaskMonitor*)param;
+    TickType_t lastWake = xTaskGetTickCount();
+    while (true) {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(self->samplePeriodMs));
+        self->sample();
+    }
+}
+
+void TaskMonitor::sample() {
+#if configUSE_TRACE_FACILITY
+    uint32_t totalRunTime = 0;
+    int numTasks = uxTaskGetSystemState(sysState, MAX_TASKS, &totalRunTime);
+    if (numTasks == 0) {
+        return; // More tasks than MAX_TASKS
+    }
+    // Run time counter is wall clock, so a task's delta over it is percent of one core
+    uint32_t elapsed = totalRunTime - prevTotalRunTime;
+    bool havePrev = prevTotalRunTime != 0 && elapsed > 0;
+    prevTotalRunTime = totalRunTime;
+
+    for (int i = 0; i < numTasks; i++) {
+        const TaskStatus_t& st = sysState[i];
+        TaskSample& ts = working[i];
+        ts.handle = st.xHandle;
+        strncpy(ts.name, st.pcTaskName, sizeof(ts.name) - 1);
+        ts.name[sizeof(ts.name) - 1] = '\0';
+#if configGENERATE_RUN_TIME_STATS
+        ts.runTime = st.ulRunTimeCounter;
+#else
+        ts.runTime = 0;
+#endif
+        ts.cpuPercent = 0;
+        if (havePrev) {
+            // Tasks created since the last sample are measured from the next one
+            for (int j = 0; j < numSamples; j++) {
+                if (samples[j].handle == ts.handle) {
+                    uint64_t pct = (100ULL * (ts.runTime - samples[j].runTime)) / elapsed;
+                    ts.cpuPercent = pct > 100 ? 100 : (uint8_t)pct;
+                    break;
+                }
+            }
+        }
+#if configTASKLIST_INCLUDE_COREID
+        ts.core = st.xCoreID == tskNO_AFFINITY ? -1 : (int8_t)st.xCoreID;
+#else
+        ts.core = -1;
+#endif
+        ts.priority = (uint8_t)st.uxCurrentPriority;
+        switch (st.eCurrentState) {
+            case eRunning: ts.state = 'R'; break;
+            case eReady: ts.state = 'r'; break;
+            case eBlocked: ts.state = 'B'; break;
+            case eSuspended: ts.state = 'S'; break;
+            default: ts.state = 'D'; break;
+        }
+        ts.stackFree = st.usStackHighWaterMark; // ESP-IDF stacks are sized in bytes
+
+        // IDLE0 / IDLE1 time is what the core had spare
+        if (strncmp(ts.name, "IDLE", 4) == 0 && ts.core >= 0 && ts.core < portNUM_PROCESSORS) {
+            idlePercent[ts.core] = ts.cpuPercent;
+        }
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    TaskSample* done = working;
+    working = samples;
+    samples = done;
+    numSamples = numTasks;
+    sampleCount++;
+    xSemaphoreGive(lock);
+#endif
+}
+
+int TaskMonitor::snapshot(TaskSample* out, int maxTasks) {
+    if (samples == NULL) {
+        return 0;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int n = numSamples < maxTasks ? numSamples : maxTasks;
+    memcpy(out, samples, n * sizeof(TaskSample));
+    xSemaphoreGive(lock);
+    return n;
+}
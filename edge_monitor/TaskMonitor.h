@@ -0,0 +1,73 @@
+#ifndef TASKMONITOR_H
+#define TASKMONITOR_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+// One task as seen at the last sample
+struct TaskSample {
+    TaskHandle_t handle;
+    char name[configMAX_TASK_NAME_LEN];
+    uint32_t runTime;       // run time counter at the sample
+    uint8_t cpuPercent;     // of one core over the last sample period
+    int8_t core;            // pinned core, -1 = either core
+    uint8_t priority;
+    char state;             // R(unning) r(eady) B(locked) S(uspended) D(eleted)
+    uint32_t stackFree;     // stack high water mark in bytes
+};
+
+/**
+ * TaskMonitor - periodic per task CPU and stack usage
+ *
+ * A low priority task snapshots every FreeRTOS task once per period with
+ * uxTaskGetSystemState() and turns the run time counter deltas into CPU
+ * percent of one core, alongside core affinity, priority, state and the
+ * stack high water mark. Per core idle is taken from the IDLE tasks.
+ *
+ * Needs the trace facility and run time stats enabled in the FreeRTOS
+ * config (on in the Arduino-ESP32 builds); without run time stats only
+ * stack, priority and affinity are reported.
+ */
+class TaskMonitor {
+public:
+    static const int MAX_TASKS = 32;
+
+private:
+    static const int MONITOR_CORE = 0;
+    static const UBaseType_t MONITOR_PRIORITY = 1;
+    static const uint32_t MONITOR_STACK = 3072;
+
+    unsigned long samplePeriodMs;
+
+    TaskStatus_t* sysState;         // uxTaskGetSystemState() scratch
+    TaskSample* working;            // sample being built
+    TaskSample* samples;            // last complete sample, guarded by lock
+    int numSamples;
+    uint8_t idlePercent[portNUM_PROCESSORS];
+    uint32_t prevTotalRunTime;
+    uint32_t sampleCount;
+    SemaphoreHandle_t lock;
+    TaskHandle_t taskHandle;
+
+    static void taskEntry(void* param);
+    void sample();
+
+public:
+    TaskMonitor(unsigned long samplePeriodMs = 1000);
+    ~TaskMonitor();
+
+    bool begin();
+
+    // Copy of the last sample, returns number of tasks copied
+    int snapshot(TaskSample* out, int maxTasks);
+
+    // Status and information
+    bool hasRunTimeStats() const;
+    uint8_t getIdlePercent(int core) const { return core >= 0 && core < portNUM_PROCESSORS ? idlePercent[core] : 0; }
+    uint32_t getSampleCount() const { return sampleCount; }
+    unsigned long getSamplePeriodMs() const { return samplePeriodMs; }
+};
+
+#endif // TASKMONITOR_H
@@ -0,0 +1,266 @@
+#include "UploadJournal.h"
+
+bool UploadJournal::OrderKey::operator<(const OrderKey& other) const {
+    // Partly sent files first, then higher priority, then oldest
+    if (partial != other.partial) return partial;
+    if (priority != other.priority) return priority > other.priority;
+    if (seq != other.seq) return seq < other.seq;
+    return path < other.path;
+}
+
+UploadJournal::UploadJournal(const String& path, uint32_t compactLines) {
+    this->journalPath = path;
+    this->tempPath = path + ".tmp";
+    this->compactLines = compactLines;
+    this->nextSeq = 0;
+    this->journalLines = 0;
+    this->loaded = false;
+    this->lock = xSemaphoreCreateMutex();
+}
+
+UploadJournal::~UploadJournal() {
+    if (lock) vSemaphoreDelete(lock);
+}
+
+UploadJournal::OrderKey UploadJournal::keyFor(const String& path, const Entry& entry) {
+    OrderKey key;
+    key.partial = entry.partial;
+    key.priority = entry.priority;
+    key.seq = entry.seq;
+    key.path = path;
+    return key;
+}
+
+void UploadJournal::applyAdd(const String& path, uint8_t priority) {
+    auto it = entries.find(path);
+    if (it == entries.end()) {
+        Entry entry = {priority, nextSeq++, 0, false};
+        entries[path] = entry;
+        order.insert(keyFor(path, entry));
+    } else if (priority > it->second.priority) {
+        order.erase(keyFor(path, it->second));
+        it->second.priority = priority;
+        order.insert(keyFor(path, it->second));
+    }
+}
+
+void UploadJournal::applyPartial(const String& path, size_t offset) {
+    auto it = entries.find(path);
+    if (it == entries.end()) {
+        return;
+    }
+    order.erase(keyFor(path, it->second));
+    it->second.partial = true;
+    it->second.offset = offset;
+    order.insert(keyFor(path, it->second));
+}
+
+bool UploadJournal::applyRemove(const String& path) {
+    auto it = entries.find(path);
+    if (it == entries.end()) {
+        return false;
+    }
+    order.erase(keyFor(path, it->second));
+    entries.erase(it);
+    return true;
+}
+
+void UploadJournal::replayLine(const String& line) {
+    // "A <prio> <path>", "P <offset> <path>", "D <path>", "X <path>"
+    if (line.length() < 3 || line[1] != ' ') {
+        return;
+    }
+    char op = line[0];
+    if (op == 'D' || op == 'X') {
+        applyRemove(line.substring(2));
+        return;
+    }
+    int split = line.indexOf(' ', 2);
+    if (split < 0) {
+        return;
+    }
+    String path = line.substring(split + 1);
+    long value = line.substring(2, split).toInt();
+    if (op == 'A') {
+        applyAdd(path, (uint8_t)value);
+    } else if (op == 'P') {
+        applyPartial(path, (size_t)value);
+    }
+}
+
+bool UploadJournal::load() {
+    uint32_t startMs = millis();
+    xSemaphoreTake(lock, portMAX_DELAY);
+    entries.clear();
+    order.clear();
+    journalLines = 0;
+    loaded = true;
+
+    // A reboot between removing the old journal and renaming the compacted one
+    if (!SD.exists(journalPath.c_str()) && SD.exists(tempPath.c_str())) {
+        SD.rename(tempPath.c_str(), journalPath.c_str());
+    }
+    File file = SD.open(journalPath, FILE_READ);
+    if (!file) {
+        xSemaphoreGive(lock);
+        return false;
+    }
+    while (file.available()) {
+        String line = file.readStringUntil('\n');
+        line.trim();
+        if (line.length() > 0) {
+            replayLine(line);
+            journalLines++;
+        }
+    }
+    file.close();
+    stats.replayedLines = journalLines;
+    compactIfNeeded();
+    stats.loadMs = millis() - startMs;
+    Serial.printf("Upload journal: %d pending from %u lines in %u ms\n",
+                  (int)entries.size(), (unsigned)stats.replayedLines, (unsigned)stats.loadMs);
+    xSemaphoreGive(lock);
+    return true;
+}
+
+bool UploadJournal::append(const String& line) {
+    File file = SD.open(journalPath, FILE_APPEND);
+    bool ok = file && file.print(line) == line.length();
+    if (file) file.close();
+    if (!ok) {
+        stats.appendFailures++;
+        Serial.printf("ERROR: Failed to append to upload journal %s\n", journalPath.c_str());
+        return false;
+    }
+    stats.appends++;
+    journalLines++;
+    return true;
+}
+
+void UploadJournal::compactIfNeeded() {
+    if (journalLines > compactLines && journalLines > 2 * entries.size()) {
+        compact();
+    }
+}
+
+bool UploadJournal::compact() {
+    // Replaying this in order gives back the same queue order
+    File file = SD.open(tempPath, FILE_WRITE);
+    if (!file) {
+        Serial.printf("ERROR: Failed to create %s\n", tempPath.c_str());
+        return false;
+    }
+    uint32_t lines = 0;
+    bool ok = true;
+    for (const OrderKey& key : order) {
+        const Entry& entry = entries[key.path];
+        ok = ok && file.printf("A %u %s\n", (unsigned)entry.priority, key.path.c_str()) > 0;
+        lines++;
+        if (entry.partial) {
+            ok = ok && file.printf("P %u %s\n", (unsigned)entry.offset, key.path.c_str()) > 0;
+            lines++;
+        }
+    }
+    file.close();
+    if (!ok) {
+        Serial.println("ERROR: Failed writing compacted upload journal");
+        SD.remove(tempPath.c_str());
+        return false;
+    }
+    SD.remove(journalPath.c_str());
+    if (!SD.rename(tempPath.c_str(), journalPath.c_str())) {
+        Serial.println("ERROR: Failed to replace upload journal");
+        return false;
+    }
+    journalLines = lines;
+    stats.compactions++;
+    return true;
+}
+
+bool UploadJournal::add(const String& path, uint8_t priority) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    auto it = entries.find(path);
+    bool changed = it == entries.end() || priority > it->second.priority;
+    if (changed) {
+        applyAdd(path, priority);
+        append("A " + String(priority) + " " + path + "\n");
+    }
+    xSemaphoreGive(lock);
+    return changed;
+}
+
+void UploadJournal::markPartial(const String& path, size_t offset) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    auto it = entries.find(path);
+    if (it != entries.end() && !(it->second.partial && it->second.offset == offset)) {
+        applyPartial(path, offset);
+        append("P " + String((unsigned long)offset) + " " + path + "\n");
+    }
+    xSemaphoreGive(lock);
+}
+
+void UploadJournal::markDone(const String& path) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (applyRemove(path)) {
+        append("D " + path + "\n");
+        compactIfNeeded();
+    }
+    xSemaphoreGive(lock);
+}
+
+bool UploadJournal::drop(const String& path) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool removed = applyRemove(path);
+    if (removed) {
+        append("X " + path + "\n");
+        compactIfNeeded();
+    }
+    xSemaphoreGive(lock);
+    return removed;
+}
+
+void UploadJournal::clear() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    entries.clear();
+    order.clear();
+    if (SD.exists(journalPath.c_str())) {
+        SD.remove(journalPath.c_str());
+    }
+    journalLines = 0;
+    xSemaphoreGive(lock);
+}
+
+bool UploadJournal::next(String& path, size_t& offset) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool found = !order.empty();
+    if (found) {
+        path = order.begin()->path;
+        offset = entries[path].offset;
+    }
+    xSemaphoreGive(lock);
+    return found;
+}
+
+bool UploadJournal::contains(const String& path) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool found = entries.count(path) > 0;
+    xSemaphoreGive(lock);
+    return found;
+}
+
+int UploadJournal::pendingCount() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int count = entries.size();
+    xSemaphoreGive(lock);
+    return count;
+}
+
+int UploadJournal::pendingCount(uint8_t priority) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int count = 0;
+    for (const auto& item : entries) {
+        if (item.second.priority == priority) count++;
+    }
+    xSemaphoreGive(lock);
+    return count;
+}
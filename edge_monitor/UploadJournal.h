@@ -0,0 +1,107 @@
+#ifndef UPLOADJOURNAL_H
+#define UPLOADJOURNAL_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "SD.h"
+#include <map>
+#include <set>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Higher goes first; a file queued twice keeps the higher of the two
+enum UploadPriority : uint8_t {
+    UPLOAD_PRIORITY_BACKFILL = 0,   // full clips whose preview went first
+    UPLOAD_PRIORITY_SCHEDULED = 1,  // interval clips, files found by the one-time scan
+    UPLOAD_PRIORITY_MOTION = 2,     // motion triggered clips
+    UPLOAD_PRIORITY_ALERT = 3,      // alerts and operator requests
+};
+
+/**
+ * UploadJournal - persistent, prioritized upload queue
+ *
+ * Every change to the queue is one line appended to a journal file on
+ * the card ("A <prio> <path>" queued, "P <offset> <path>" partly sent,
+ * "D <path>" uploaded, "X <path>" dropped), so the queue and the resume
+ * point of an interrupted upload survive a reboot. In RAM the entries
+ * are kept by path and in upload order: partly sent files first, then
+ * by priority, then oldest first.
+ *
+ * At boot the journal is replayed instead of walking the card; once it
+ * holds more dead lines than live ones it is rewritten with only the
+ * pending entries, so replay stays proportional to what is pending.
+ * Without a journal (first boot) the caller scans the card once.
+ */
+class UploadJournal {
+public:
+    struct Stats {
+        uint32_t appends = 0;
+        uint32_t appendFailures = 0;
+        uint32_t compactions = 0;
+        uint32_t replayedLines = 0;
+        uint32_t loadMs = 0;
+    };
+
+private:
+    struct Entry {
+        uint8_t priority;
+        uint32_t seq;           // queue order within a priority
+        size_t offset;          // bytes already on the server
+        bool partial;
+    };
+    struct OrderKey {
+        bool partial;
+        uint8_t priority;
+        uint32_t seq;
+        String path;
+        bool operator<(const OrderKey& other) const;
+    };
+
+    String journalPath;
+    String tempPath;
+    uint32_t compactLines;
+    std::map<String, Entry> entries;
+    std::set<OrderKey> order;
+    uint32_t nextSeq;
+    uint32_t journalLines;      // lines in the file, live or not
+    bool loaded;
+    SemaphoreHandle_t lock;
+    Stats stats;
+
+    static OrderKey keyFor(const String& path, const Entry& entry);
+    void applyAdd(const String& path, uint8_t priority);
+    void applyPartial(const String& path, size_t offset);
+    bool applyRemove(const String& path);
+    void replayLine(const String& line);
+    bool append(const String& line);
+    void compactIfNeeded();
+    bool compact();
+
+public:
+    // Constructor - compactLines is the journal length that is always left alone
+    UploadJournal(const String& path = "/uploads.jnl", uint32_t compactLines = 64);
+    ~UploadJournal();
+
+    // Replay the journal (SD must be mounted); false = there is none yet
+    bool load();
+    bool isLoaded() const { return loaded; }
+
+    // Queue changes, each persisted before returning
+    bool add(const String& path, uint8_t priority = UPLOAD_PRIORITY_SCHEDULED);
+    void markPartial(const String& path, size_t offset);
+    void markDone(const String& path);
+    bool drop(const String& path);
+    void clear();
+
+    // Next file to upload and its resume offset; false = queue empty
+    bool next(String& path, size_t& offset);
+    bool contains(const String& path);
+
+    // Status
+    int pendingCount();
+    int pendingCount(uint8_t priority);
+    uint32_t getJournalLines() const { return journalLines; }
+    const Stats& getStats() const { return stats; }
+};
+
+#endif // UPLOADJOURNAL_H
@@ -0,0 +1,700 @@
+#include "VideoRecorder.h"
+#include "Metrics.h"
+
+static const uint32_t FRAME_TIMER_HZ = 1000000; // 1 us timer tick
+
+void FrameTimingStats::record(uint32_t intervalUs) {
+    uint32_t reference = nominalUs ? nominalUs : lastIntervalUs;
+    if (intervals > 0 || nominalUs) {
+        uint32_t jitter = intervalUs > reference ? intervalUs - reference : reference - intervalUs;
+        totalJitterUs += jitter;
+        if (jitter > maxJitterUs) maxJitterUs = jitter;
+    }
+    if (intervals == 0 || intervalUs < minIntervalUs) minIntervalUs = intervalUs;
+    if (intervalUs > maxIntervalUs) maxIntervalUs = intervalUs;
+    totalIntervalUs += intervalUs;
+    lastIntervalUs = intervalUs;
+    intervals++;
+}
+
+VideoRecorder::VideoRecorder(size_t ringBytes, int ringFrames, uint32_t maxClipFrames,
+                             size_t sdBufferBytes, size_t sdAlignBytes)
+    : ring(ringBytes, ringFrames), avi(maxClipFrames), sdBuffer(sdBufferBytes, sdAlignBytes) {
+    this->liveStream = NULL;
+    this->preview = NULL;
+    this->motionDetector = NULL;
+    this->clipPool = NULL;
+    this->burstRing = NULL;
+    this->burstArenaBytes = 0;
+    this->burstMaxFrames = 0;
+    this->captureTaskHandle = NULL;
+    this->writerTaskHandle = NULL;
+    this->frameTimer = NULL;
+    this->frameTick = NULL;
+    this->timerDelayMs = 0;
+
+    this->capturing = false;
+    this->writing = false;
+    this->stopRequested = false;
+    this->resultReady = false;
+    this->pauseRequested = false;
+    this->capturePaused = false;
+    this->currentFilename = "";
+    this->durationMs = 0;
+    this->sessionStartMs = 0;
+    this->sessionFailedFrames = 0;
+    this->sessionAborted = false;
+    this->sessionPooled = false;
+    this->sessionBurstFrames = 0;
+    this->frameWidth = 0;
+    this->frameHeight = 0;
+
+    this->preRollFrames = 0;
+    this->postRollMs = 0;
+    this->motionCheckIntervalMs = 0;
+    this->motionArmed = false;
+    this->motionPending = false;
+    this->sessionMotionTriggered = false;
+    this->sessionMotionPeak = -1;
+    this->lastMonitorFrameMs = 0;
+    this->lastMotionCheckMs = 0;
+    this->lastMotionMs = 0;
+    this->motionTriggers = 0;
+}
+
+bool VideoRecorder::begin() {
+    if (captureTaskHandle != NULL) {
+        return true; // Already running
+    }
+    if (!ring.begin() || !avi.begin() || !sdBuffer.begin()) {
+        return false;
+    }
+    sidecar.begin(); // Without PSRAM for thumbnails, sidecars still carry the clip stats
+    if (burstArenaBytes > 0) {
+        burstRing = new FrameRing(burstArenaBytes, burstMaxFrames);
+        if (!burstRing->begin()) {
+            Serial.println("WARNING: No PSRAM for the burst arena, bursts disabled");
+            delete burstRing;
+            burstRing = NULL;
+        } else {
+            Serial.printf("Burst arena: %u KB, up to %d frames\n",
+                          (unsigned)(burstRing->getCapacityBytes() / 1024), burstRing->getMaxFrames());
+        }
+    }
+    frameTick = xSemaphoreCreateBinary();
+    if (frameTick == NULL) {
+        Serial.println("ERROR: Failed to create frame tick semaphore!");
+        return false;
+    }
+
+    // Capture runs next to the camera driver, the writer on the other core with the SD/WiFi work
+    BaseType_t ok1 = xTaskCreatePinnedToCore(captureTaskEntry, "captureTask", CAPTURE_STACK,
+                                             this, CAPTURE_PRIORITY, &captureTaskHandle, CAPTURE_CORE);
+    BaseType_t ok2 = xTaskCreatePinnedToCore(writerTaskEntry, "writerTask", WRITER_STACK,
+                                             this, WRITER_PRIORITY, &writerTaskHandle, WRITER_CORE);
+    if (ok1 != pdPASS || ok2 != pdPASS) {
+        Serial.println("ERROR: Failed to create recorder tasks!");
+        return false;
+    }
+
+    Serial.printf("VideoRecorder ready: capture on core %d, writer on core %d\n", CAPTURE_CORE, WRITER_CORE);
+    return true;
+}
+
+bool VideoRecorder::startRecording(const String& filename, unsigned long durationMs, unsigned long frameDelayMs) {
+    return openSession(filename, durationMs, frameDelayMs, 0);
+}
+
+void VideoRecorder::setBurstArena(size_t arenaBytes, int maxFrames) {
+    this->burstArenaBytes = arenaBytes;
+    this->burstMaxFrames = maxFrames;
+}
+
+bool VideoRecorder::startBurst(const String& filename, int frames, unsigned long maxDurationMs) {
+    if (burstRing == NULL) {
+        Serial.println("ERROR: No burst arena");
+        return false;
+    }
+    frames = constrain(frames, 1, burstRing->getMaxFrames());
+    return openSession(filename, maxDurationMs, 0, frames);
+}
+
+bool VideoRecorder::openSession(const String& filename, unsigned long durationMs, unsigned long frameDelayMs,
+                                int burstFrames) {
+    if (captureTaskHandle == NULL || writerTaskHandle == NULL) {
+        Serial.println("ERROR: VideoRecorder not started");
+        return false;
+    }
+    if (isActive()) {
+        Serial.println("ERROR: Recording already in progress");
+        return false;
+    }
+    if (pauseRequested) {
+        Serial.println("ERROR: Camera is being reconfigured");
+        return false;
+    }
+
+    // A pool file is already allocated - overwrite it in place instead of truncating it
+    bool pooled = clipPool != NULL && clipPool->take(filename);
+    videoFile = SD.open(filename, pooled ? "r+" : FILE_WRITE);
+    if (!videoFile) {
+        Serial.printf("ERROR: Failed to open video file: %s\n", filename.c_str());
+        if (pooled) SD.remove(filename.c_str());
+        return false;
+    }
+    sdBuffer.attach(videoFile);
+    if (!avi.openAvi(sdBuffer)) {
+        Serial.printf("ERROR: Failed to write AVI header: %s\n", filename.c_str());
+        sdBuffer.detach();
+        videoFile.close();
+        if (pooled) SD.remove(filename.c_str()); // Rest of the file is stale pool content
+        return false;
+    }
+
+    this->currentFilename = filename;
+    this->durationMs = durationMs;
+    rate.setFrameDelayMs(frameDelayMs);
+    this->sessionStartMs = millis();
+    this->sessionFailedFrames = 0;
+    this->sessionAborted = false;
+    this->sessionPooled = pooled;
+    this->sessionBurstFrames = burstFrames;
+    this->frameWidth = 0;
+    this->frameHeight = 0;
+    this->stopRequested = false;
+    this->sessionMotionTriggered = motionPending;
+    this->sessionMotionPeak = motionPending ? motionDetector->getChangedPixels() : -1;
+    writing = true;
+    capturing = true;
+    if (burstFrames > 0) {
+        // The writer is woken once the burst is in the arena, the pre-roll ring is left as it is
+        burstRing->clear();
+        burstRing->resetStats();
+        xTaskNotifyGive(captureTaskHandle);
+        return true;
+    }
+    if (motionArmed) {
+        // Frames already in the ring are the pre-roll - stop evicting them and keep them
+        ring.setPreRoll(0);
+    } else {
+        ring.clear();
+    }
+    ring.resetStats();
+
+    xTaskNotifyGive(writerTaskHandle);
+    xTaskNotifyGive(captureTaskHandle);
+    return true;
+}
+
+void VideoRecorder::stopRecording() {
+    if (capturing) {
+        stopRequested = true;
+        Serial.println("VideoRecorder: stop requested");
+    }
+}
+
+void VideoRecorder::setMotionTrigger(MotionDetector* detector, int preRollFrames, unsigned long postRollMs,
+                                     int checksPerSecond) {
+    this->motionDetector = detector;
+    this->preRollFrames = min(preRollFrames, ring.getMaxFrames() - 1);
+    this->postRollMs = postRollMs;
+    this->motionCheckIntervalMs = checksPerSecond > 0 ? 1000 / checksPerSecond : 200;
+}
+
+void VideoRecorder::setMotionArmed(bool armed) {
+    if (motionDetector == NULL || armed == motionArmed) {
+        return;
+    }
+    if (armed) {
+        motionDetector->reset();
+        motionArmed = true;
+        // While a clip is still being written the writer re-enables pre-roll when it finishes
+        if (!isActive()) {
+            ring.clear();
+            ring.setPreRoll(preRollFrames);
+        }
+        Serial.printf("Motion trigger armed: %d frame pre-roll, %lu ms post-roll\n", preRollFrames, postRollMs);
+    } else {
+        motionArmed = false;
+        motionPending = false;
+        ring.setPreRoll(0);
+        Serial.println("Motion trigger disarmed");
+    }
+}
+
+bool VideoRecorder::takeMotionTrigger() {
+    return motionArmed && motionPending && !isActive();
+}
+
+bool VideoRecorder::takeFinishedRecording(RecordingResult& result) {
+    if (!resultReady) {
+        return false;
+    }
+    result = lastResult;
+    resultReady = false;
+    return true;
+}
+
+void VideoRecorder::captureTaskEntry(void* param) {
+    VideoRecorder* recorder = (VideoRecorder*)param;
+    while (true) {
+        if (recorder->pauseRequested) {
+            recorder->parkCapture();
+            continue;
+        }
+        // Between recordings wake at the preview rate so a live viewer still gets frames,
+        // or keep capturing when armed for motion (monitorFrame paces itself)
+        unsigned long waitMs = recorder->liveStream ? recorder->liveStream->getIdleFrameIntervalMs() : 1000;
+        if (recorder->motionArmed) waitMs = 0;
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs)) > 0) {
+            recorder->captureSession();
+        } else if (recorder->motionArmed) {
+            recorder->monitorFrame();
+        } else if (recorder->previewWanted()) {
+            recorder->previewFrame();
+        }
+    }
+}
+
+bool VideoRecorder::pauseCapture(unsigned long timeoutMs) {
+    if (captureTaskHandle == NULL) {
+        return true; // Nothing capturing
+    }
+    pauseRequested = true;
+    unsigned long startMs = millis();
+    while (!capturePaused) {
+        // The task parks at the top of its loop, so never mid-clip
+        if (capturing || millis() - startMs >= timeoutMs) {
+            pauseRequested = false;
+            return false;
+        }
+        vTaskDelay(1);
+    }
+    if (capturing) {
+        // A recording was started just as the task parked
+        pauseRequested = false;
+        return false;
+    }
+    return true;
+}
+
+void VideoRecorder::resumeCapture() {
+    pauseRequested = false;
+}
+
+void VideoRecorder::parkCapture() {
+    capturePaused = true;
+    while (pauseRequested) {
+        vTaskDelay(1);
+    }
+    if (!writing) {
+        // Pre-roll frames are from before the change (the writer still owns them while draining)
+        ring.clear();
+        if (motionDetector) motionDetector->reset();
+    }
+    lastMonitorFrameMs = 0;
+    capturePaused = false;
+}
+
+void IRAM_ATTR VideoRecorder::frameTimerISR(void* param) {
+    // Wake the capture task for the next frame
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(((VideoRecorder*)param)->frameTick, &woken);
+    if (woken) portYIELD_FROM_ISR();
+}
+
+void VideoRecorder::syncFrameTimer(unsigned long delayMs) {
+    // Called from the capture task only, so the timer interrupt lands on the capture core
+    if (delayMs == timerDelayMs) {
+        return;
+    }
+    timerDelayMs = delayMs;
+    if (delayMs == 0) {
+        if (frameTimer) timerStop(frameTimer);
+        return; // Free running: the sensor sets the pace
+    }
+    if (frameTimer == NULL) {
+        frameTimer = timerBegin(FRAME_TIMER_HZ);
+        if (frameTimer == NULL) {
+            Serial.println("WARNING: No hardware timer for frame pacing, using delays");
+            return;
+        }
+        timerAttachInterruptArg(frameTimer, &frameTimerISR, this);
+    }
+    timerAlarm(frameTimer, (uint64_t)delayMs * (FRAME_TIMER_HZ / 1000), true, 0);
+    timerWrite(frameTimer, 0);
+    timerStart(frameTimer);
+    Serial.printf("Frame timer: %lu ms interval\n", delayMs);
+}
+
+void VideoRecorder::waitFrameTick(unsigned long lastFrameMs) {
+    // Frame delay as configured or slowed by the rate controller
+    unsigned long delayMs = rate.getFrameDelayMs();
+    syncFrameTimer(delayMs);
+    if (delayMs == 0) {
+        return;
+    }
+    if (frameTimer != NULL) {
+        // A tick that fired while the last frame was still being handled is taken straight
+        // away, so an overrun costs one interval instead of shifting every later frame
+        xSemaphoreTake(frameTick, pdMS_TO_TICKS(delayMs * 2));
+        return;
+    }
+    unsigned long timeSinceLastFrame = millis() - lastFrameMs;
+    if (timeSinceLastFrame < delayMs) {
+        vTaskDelay(pdMS_TO_TICKS(delayMs - timeSinceLastFrame));
+    }
+}
+
+void VideoRecorder::previewFrame() {
+    camera_fb_t* fb = esp_camera_fb_get();
+    if (fb) {
+        publishFrame(fb->buf, fb->len, millis());
+        esp_camera_fb_return(fb);
+    }
+}
+
+void VideoRecorder::publishFrame(const uint8_t* jpeg, size_t len, uint32_t timestampMs) {
+    // The scaler copies a frame only when one is due and the live stream gets its output
+    if (preview) {
+        preview->offer(jpeg, len, timestampMs);
+    } else if (liveStream) {
+        liveStream->publish(jpeg, len, timestampMs);
+    }
+}
+
+bool VideoRecorder::previewWanted() const {
+    return preview ? preview->wanted() : liveStream && liveStream->hasViewer();
+}
+
+void VideoRecorder::monitorFrame() {
+    if (writing) {
+        // Last clip still draining - don't feed it, just keep live view going
+        if (previewWanted()) previewFrame();
+        vTaskDelay(pdMS_TO_TICKS(liveStream ? liveStream->getIdleFrameIntervalMs() : 100));
+        return;
+    }
+
+    // Same pacing as a recording so the pre-roll plays back at the clip's rate
+    waitFrameTick(lastMonitorFrameMs);
+    lastMonitorFrameMs = millis();
+
+    camera_fb_t* fb = esp_camera_fb_get();
+    if (!fb) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        return;
+    }
+    ring.push(fb->buf, fb->len, lastMonitorFrameMs);
+    publishFrame(fb->buf, fb->len, lastMonitorFrameMs);
+    esp_camera_fb_return(fb);
+
+    if (!motionPending && checkMotion(lastMonitorFrameMs)) {
+        motionTriggers++;
+        metricMotionTriggers.inc();
+        motionPending = true;
+        Serial.printf("*** MOTION DETECTED *** %d changed pixels (threshold %d), %d frames pre-roll\n",
+                      motionDetector->getChangedPixels(), motionDetector->getMoveThreshold(), ring.count());
+    }
+}
+
+bool VideoRecorder::checkMotion(unsigned long nowMs) {
+    // Checks run on the ring's copy, after the fb is back with the driver
+    if (nowMs - lastMotionCheckMs < motionCheckIntervalMs) {
+        return false;
+    }
+    lastMotionCheckMs = nowMs;
+    FrameRing::Frame frame;
+    if (!ring.peekNewest(frame)) {
+        return false;
+    }
+    bool moving = motionDetector->check(frame.buf, frame.len);
+    if (moving) lastMotionMs = nowMs;
+    if (capturing && motionDetector->getChangedPixels() > sessionMotionPeak) {
+        sessionMotionPeak = motionDetector->getChangedPixels();
+    }
+    return moving;
+}
+
+void VideoRecorder::writerTaskEntry(void* param) {
+    VideoRecorder* recorder = (VideoRecorder*)param;
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        recorder->writerSession();
+    }
+}
+
+void VideoRecorder::captureBurst() {
+    // Unpaced: no frame timer, rate controller or live view, just sensor -> arena
+    int captured = 0;
+    uint32_t lastCaptureUs = 0;
+    timing.reset(0);
+    while (!stopRequested && captured < sessionBurstFrames && (millis() - sessionStartMs) < durationMs) {
+        camera_fb_t* fb = esp_camera_fb_get();
+        uint32_t capturedUs = micros();
+        stats.totalCaptures++;
+        if (!fb) {
+            stats.failedCaptures++;
+            sessionFailedFrames++;
+            metricCaptureFailures.inc();
+            if (++stats.consecutiveFailures >= MAX_CONSECUTIVE_FAILURES) {
+                Serial.println("ERROR: Burst aborted after consecutive capture failures");
+                sessionAborted = true;
+                break;
+            }
+            continue;
+        }
+        stats.consecutiveFailures = 0;
+        metricFramesCaptured.inc();
+        metricJpegBytes.inc(fb->len);
+        if (frameWidth == 0) {
+            frameWidth = fb->width;
+            frameHeight = fb->height;
+        }
+        if (lastCaptureUs != 0) timing.record(capturedUs - lastCaptureUs);
+        lastCaptureUs = capturedUs;
+        bool stored = burstRing->push(fb->buf, fb->len, millis());
+        esp_camera_fb_return(fb);
+        if (!stored) {
+            break; // Arena full - the burst is as long as it can be
+        }
+        captured++;
+    }
+    Serial.printf("Burst captured: %d frames in %lu ms, committing to SD\n", captured, millis() - sessionStartMs);
+    motionPending = false;
+    capturing = false;
+    xTaskNotifyGive(writerTaskHandle);
+}
+
+void VideoRecorder::captureSession() {
+    if (sessionBurstFrames > 0) {
+        captureBurst();
+        return;
+    }
+    unsigned long lastFrameTime = millis();
+    uint32_t lastDropReport = 0;
+    lastMotionMs = lastFrameTime;
+    rate.beginSession();
+    timing.reset(rate.getFrameDelayMs() * 1000);
+    uint32_t lastCaptureUs = 0;
+
+    while (!stopRequested && (millis() - sessionStartMs) < durationMs) {
+        waitFrameTick(lastFrameTime);
+        lastFrameTime = millis();
+        if (timing.nominalUs != timerDelayMs * 1000) {
+            timing.nominalUs = timerDelayMs * 1000; // Rate controller changed the pacing
+        }
+
+        uint32_t captureStartUs = micros();
+        camera_fb_t* fb = esp_camera_fb_get();
+        uint32_t capturedUs = micros();
+        stats.totalCaptures++;
+        rate.onCapture(capturedUs - captureStartUs, fb != NULL);
+        metricCaptureLatency.record(capturedUs - captureStartUs);
+        if (fb) {
+            metricFramesCaptured.inc();
+            metricJpegBytes.inc(fb->len);
+        } else {
+            metricCaptureFailures.inc();
+        }
+
+        if (!fb) {
+            // Track capture failure
+            stats.failedCaptures++;
+            stats.consecutiveFailures++;
+            stats.lastFailureTime = millis();
+            sessionFailedFrames++;
+
+            Serial.printf("ERROR: Failed to get framebuffer! (consecutive: %d, total: %lu/%lu)\n",
+                          stats.consecutiveFailures, stats.failedCaptures, stats.totalCaptures);
+            Serial.printf("DEBUG: Free Heap: %d, Free PSRAM: %d\n", ESP.getFreeHeap(), ESP.getFreePsram());
+
+            // Too many consecutive failures: step quality / size / rate down, abort only when out of steps
+            if (stats.consecutiveFailures >= MAX_CONSECUTIVE_FAILURES && rate.degrade("consecutive capture failures")) {
+                stats.consecutiveFailures = 0;
+                stats.degradedMode = true;
+            } else if (stats.consecutiveFailures >= MAX_CONSECUTIVE_FAILURES) {
+                Serial.println("CRITICAL: Too many consecutive capture failures at the lowest settings - aborting recording!");
+                Serial.println("This likely means:");
+                Serial.println("  1. Resolution too high for available memory");
+                Serial.println("  2. PSRAM fragmentation");
+                Serial.println("  3. Insufficient power supply");
+                Serial.println("Consider lowering resolution or JPEG quality.");
+                sessionAborted = true;
+                break;
+            }
+
+            vTaskDelay(pdMS_TO_TICKS(10));  // Brief delay before retry
+            continue;
+        }
+
+        // Successful capture - reset consecutive failure counter
+        stats.consecutiveFailures = 0;
+        if (lastCaptureUs != 0) timing.record(capturedUs - lastCaptureUs);
+        lastCaptureUs = capturedUs;
+        if (frameWidth == 0) {
+            // AVI header needs the real frame size, take it from the first frame
+            frameWidth = fb->width;
+            frameHeight = fb->height;
+        }
+
+        // Copy into the ring (and live view, if watched) and hand the fb straight back to the driver
+        // Frames are stamped when the driver handed them over - these end up in the AVI ftim chunk
+        uint32_t frameMs = millis();
+        bool queued = ring.push(fb->buf, fb->len, frameMs);
+        publishFrame(fb->buf, fb->len, frameMs);
+        esp_camera_fb_return(fb);
+
+        if (!queued && ring.getDroppedFrames() != lastDropReport) {
+            lastDropReport = ring.getDroppedFrames();
+            if (lastDropReport == 1 || lastDropReport % 10 == 0) {
+                Serial.printf("WARNING: Frame ring full, SD writer behind - %lu frames dropped\n",
+                              (unsigned long)lastDropReport);
+            }
+        }
+
+        // Ring fill by bytes or slots, whichever is tighter, tells the controller how far the writer lags
+        int fillPercent = max(ring.count() * 100 / ring.getMaxFrames(),
+                              (int)(ring.getBytesUsed() * 100 / ring.getCapacityBytes()));
+        rate.update(fillPercent);
+        stats.degradedMode = rate.getLevel() > 0;
+
+        // Motion clips end once the scene has been still for the post-roll (durationMs caps the length)
+        if (sessionMotionTriggered && motionArmed) {
+            checkMotion(lastFrameTime);
+            if (millis() - lastMotionMs >= postRollMs) {
+                Serial.printf("Motion ended, closing clip after %lu ms\n", millis() - sessionStartMs);
+                break;
+            }
+        }
+    }
+
+    // Frame size steps only change between clips
+    rate.endSession();
+    motionPending = false;
+    capturing = false;
+}
+
+void VideoRecorder::writerSession() {
+    int frameCount = 0;
+    size_t totalBytesWritten = 0;
+    uint32_t firstFrameMs = 0;
+    uint32_t lastFrameMs = 0;
+    unsigned long lastSyncMs = millis();
+
+    sidecar.reset();
+    // Bursts are committed from their own arena once capture is over
+    FrameRing& src = sessionBurstFrames > 0 ? *burstRing : ring;
+
+    Serial.printf("*** %s *** File: %s%s\n", sessionBurstFrames > 0 ? "BURST COMMIT STARTED" : "RECORDING STARTED",
+                  currentFilename.c_str(), sessionPooled ? " (pooled)" : "");
+
+    while (true) {
+        FrameRing::Frame frame;
+        if (src.peek(frame, 20)) {
+            if (avi.isIndexFull()) {
+                // Clip is at its frame limit - stop capture and drain what is left
+                if (!stopRequested) {
+                    Serial.printf("WARNING: AVI index full (%u frames), ending clip\n", (unsigned)avi.getMaxFrames());
+                    stopRequested = true;
+                }
+                src.release();
+                continue;
+            }
+            size_t expected = CHUNK_HDR + ((frame.len + 3) & ~((size_t)3));
+            size_t aviOffset = avi.getNextFrameOffset();
+            uint32_t writeStartUs = micros();
+            size_t bytesWritten = avi.writeFrame(sdBuffer, frame.buf, frame.len, frame.timestampMs);
+            rate.onWrite(micros() - writeStartUs);
+            metricFrameWriteLatency.record(micros() - writeStartUs);
+            if (bytesWritten != expected) {
+                Serial.printf("ERROR: Write failed! Expected %d bytes, wrote %d bytes\n", expected, bytesWritten);
+            }
+            totalBytesWritten += bytesWritten;
+            if (frameCount == 0) firstFrameMs = frame.timestampMs;
+            lastFrameMs = frame.timestampMs;
+            // Thumbnail from the ring's copy before the slot is handed back
+            if (bytesWritten == expected) {
+                sidecar.offer(frame.buf, frame.len, frameWidth, frameHeight, frameCount, frame.timestampMs, aviOffset);
+            }
+            src.release();
+            frameCount++;
+
+            // Data reaches the card in whole blocks; only sync the FAT now and then
+            if (millis() - lastSyncMs >= SYNC_INTERVAL_MS) {
+                videoFile.flush();
+                lastSyncMs = millis();
+            }
+
+            // Progress indicator every 50 frames with detailed stats
+            if (frameCount % 50 == 0) {
+                int failed = sessionFailedFrames;
+                float failRate = (failed > 0) ? (failed * 100.0 / (frameCount + failed)) : 0;
+                Serial.printf("Recording progress: %d frames (%d failed, %.1f%% fail rate), %lu ms elapsed, %d bytes written\n",
+                              frameCount, failed, failRate, millis() - sessionStartMs, totalBytesWritten);
+                Serial.printf("  Ring: %d frames / %u KB queued, %lu dropped\n",
+                              src.count(), src.getBytesUsed() / 1024, (unsigned long)src.getDroppedFrames());
+            }
+        } else if (!capturing && src.isEmpty()) {
+            break; // Capture finished and everything has been written
+        }
+    }
+
+    // Actual FPS from capture timestamps, not the configured limit
+    float actualFPS = 0;
+    if (frameCount > 1 && lastFrameMs > firstFrameMs) {
+        actualFPS = (frameCount - 1) * 1000.0f / (lastFrameMs - firstFrameMs);
+    } else if (frameCount > 0) {
+        actualFPS = 1;
+    }
+
+    // Append idx1 and rewrite the header, then flush and close the video file
+    if (!avi.closeAvi(sdBuffer, videoFile, actualFPS, frameWidth, frameHeight)) {
+        Serial.printf("ERROR: Failed to finalize AVI: %s\n", currentFilename.c_str());
+    }
+    size_t clipBytes = sdBuffer.position();
+    videoFile.flush();
+    videoFile.close();
+    sdBuffer.detach();
+    if (clipPool) clipPool->finishClip(currentFilename, sessionPooled, clipBytes, sdBuffer.getFileStats());
+
+    // Thumbnails, keyframe offsets and stats next to the clip
+    ClipStats clipStats;
+    clipStats.frameCount = frameCount;
+    clipStats.fps = actualFPS;
+    clipStats.durationMs = lastFrameMs - firstFrameMs;
+    clipStats.width = frameWidth;
+    clipStats.height = frameHeight;
+    clipStats.motionPeak = sessionMotionTriggered ? sessionMotionPeak : -1;
+    clipStats.motionThreshold = motionDetector ? motionDetector->getMoveThreshold() : 0;
+    sidecar.write(currentFilename, clipStats);
+
+    lastResult.filename = currentFilename;
+    lastResult.frameCount = frameCount;
+    lastResult.failedFrames = sessionFailedFrames;
+    lastResult.droppedFrames = src.getDroppedFrames();
+    lastResult.bytesWritten = totalBytesWritten;
+    lastResult.durationMs = millis() - sessionStartMs;
+    lastResult.actualFPS = actualFPS;
+    lastResult.avgJitterUs = timing.avgJitterUs();
+    lastResult.maxJitterUs = timing.maxJitterUs;
+    lastResult.aborted = sessionAborted;
+    lastResult.motionTriggered = sessionMotionTriggered;
+    lastResult.burst = sessionBurstFrames > 0;
+
+    Serial.printf("Writer finished: %d frames, ring high water %d frames, %lu dropped\n",
+                  frameCount, src.getHighWaterFrames(), (unsigned long)src.getDroppedFrames());
+    WriteLatencyStats& ws = sdBuffer.getStats();
+    Serial.printf("SD writes since boot: %lu, avg %lu us, max %lu us, %lu KB/s\n",
+                  (unsigned long)ws.writes, (unsigned long)ws.averageUs(),
+                  (unsigned long)ws.maxUs, (unsigned long)ws.kbPerSec());
+
+    // Ring is empty again - go back to collecting pre-roll before anyone can start a clip
+    if (motionArmed && sessionBurstFrames == 0) {
+        ring.setPreRoll(preRollFrames);
+    } else if (motionArmed) {
+        ring.clear(); // Pre-roll from before the burst would leave a gap in the next clip
+    }
+
+    resultReady = true;
+    writing = false;
+}
@@ -0,0 +1,248 @@
+#ifndef VIDEORECORDER_H
+#define VIDEORECORDER_H
+
+#include "esp_camera.h"
+#include "FS.h"
+#include "SD.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "FrameRing.h"
+#include "AviWriter.h"
+#include "SDWriteBuffer.h"
+#include "LiveStream.h"
+#include "PreviewScaler.h"
+#include "MotionDetector.h"
+#include "RateController.h"
+#include "ClipSidecar.h"
+#include "ClipPool.h"
+
+// Error tracking for capture failures
+struct CaptureStats {
+    unsigned long totalCaptures = 0;
+    unsigned long failedCaptures = 0;
+    unsigned long lastFailureTime = 0;
+    int consecutiveFailures = 0;
+    bool degradedMode = false;  // RateController has stepped quality / size / rate down
+};
+
+// Inter-frame spacing of the current / last recording, jitter against the paced interval
+struct FrameTimingStats {
+    uint32_t nominalUs = 0;         // timer interval, 0 = unpaced (jitter is frame to frame)
+    uint32_t intervals = 0;
+    uint32_t minIntervalUs = 0;
+    uint32_t maxIntervalUs = 0;
+    uint64_t totalIntervalUs = 0;
+    uint32_t lastIntervalUs = 0;
+    uint32_t maxJitterUs = 0;
+    uint64_t totalJitterUs = 0;
+
+    void reset(uint32_t nominal) { *this = FrameTimingStats(); nominalUs = nominal; }
+    void record(uint32_t intervalUs);
+    uint32_t avgIntervalUs() const { return intervals ? (uint32_t)(totalIntervalUs / intervals) : 0; }
+    uint32_t avgJitterUs() const { return intervals ? (uint32_t)(totalJitterUs / intervals) : 0; }
+};
+
+// Summary of one finished recording, handed back to loop()
+struct RecordingResult {
+    String filename;
+    int frameCount = 0;
+    int failedFrames = 0;
+    uint32_t droppedFrames = 0;
+    size_t bytesWritten = 0;
+    unsigned long durationMs = 0;
+    float actualFPS = 0;
+    uint32_t avgJitterUs = 0;
+    uint32_t maxJitterUs = 0;
+    bool aborted = false;
+    bool motionTriggered = false;   // started by the motion detector
+    bool burst = false;             // captured unpaced into the burst arena, written afterwards
+};
+
+/**
+ * VideoRecorder - two-task recording pipeline
+ *
+ * captureTask (pinned to the camera core) pulls frames from the driver,
+ * copies them into a PSRAM FrameRing and returns the fb straight away,
+ * so capture rate is set by the sensor and FPS limit only.
+ * writerTask (other core) drains the ring to the SD card, absorbing
+ * SD latency spikes without slowing capture or blocking loop().
+ * Clips are written as MJPEG AVI with an idx1 index (see AviWriter).
+ * Frame pacing comes from a hardware timer (as MJPEG2SD's frameISR), so
+ * time spent in the capture loop doesn't add up as drift; the spacing
+ * actually achieved is kept as jitter statistics.
+ * The capture task also feeds the LiveStream, so live view never takes
+ * frame buffers away from a recording.
+ *
+ * With a MotionDetector armed, the capture task keeps running between
+ * clips: frames go into the ring as a rolling pre-roll and are checked
+ * for motion a few times a second. A detection is handed to loop() via
+ * takeMotionTrigger(); the clip then starts with the pre-roll frames and
+ * ends once no motion has been seen for the post-roll time.
+ *
+ * The writer also keeps a ClipSidecar: a few thumbnails taken at fixed
+ * clip-time intervals with their AVI offsets, written as "<clip>.thm"
+ * with the clip's stats once the AVI is closed.
+ *
+ * With a ClipPool set, clips are written in place into pre-allocated
+ * files, keeping FAT cluster allocation out of the recording.
+ *
+ * A burst captures a fixed number of frames as fast as the sensor
+ * delivers them into a separate PSRAM arena, with the writer idle so
+ * nothing competes for PSRAM bandwidth or the capture core; the writer
+ * commits the arena to an AVI once the burst is over. Bursts are capped
+ * by the arena, not by SD throughput.
+ */
+class VideoRecorder {
+private:
+    FrameRing ring;
+    AviWriter avi;
+    SDWriteBuffer sdBuffer;
+    RateController rate;
+    ClipSidecar sidecar;
+    LiveStream* liveStream;
+    PreviewScaler* preview;         // When set, live view gets its scaled frames instead of full ones
+    MotionDetector* motionDetector;
+    ClipPool* clipPool;
+    FrameRing* burstRing;           // NULL unless setBurstArena() was called before begin()
+    size_t burstArenaBytes;
+    int burstMaxFrames;
+
+    // Task configuration
+    static const int CAPTURE_CORE = 1;
+    static const int WRITER_CORE = 0;
+    static const UBaseType_t CAPTURE_PRIORITY = 5;
+    static const UBaseType_t WRITER_PRIORITY = 4;
+    static const uint32_t CAPTURE_STACK = 4096;
+    static const uint32_t WRITER_STACK = 8192;  // thumbnail decode keeps the JPEG decoder work area on the stack
+    static const int MAX_CONSECUTIVE_FAILURES = 10;
+    static const unsigned long SYNC_INTERVAL_MS = 5000; // FAT sync while recording, bounds loss on power cut
+
+    TaskHandle_t captureTaskHandle;
+    TaskHandle_t writerTaskHandle;
+
+    // Frame pacing timer, ticks are given to frameTick from the ISR
+    hw_timer_t* frameTimer;
+    SemaphoreHandle_t frameTick;
+    unsigned long timerDelayMs;
+    FrameTimingStats timing;
+
+    // Session state
+    File videoFile;
+    volatile bool capturing;
+    volatile bool writing;
+    volatile bool stopRequested;
+    volatile bool resultReady;
+    volatile bool pauseRequested;
+    volatile bool capturePaused;    // capture task parked for a camera reconfiguration
+    String currentFilename;
+    unsigned long durationMs;
+    unsigned long sessionStartMs;
+    int sessionFailedFrames;
+    bool sessionAborted;
+    bool sessionPooled;             // recording in place into a pre-allocated pool file
+    int sessionBurstFrames;         // > 0: burst session of up to this many frames
+    volatile uint16_t frameWidth;
+    volatile uint16_t frameHeight;
+
+    // Motion trigger state
+    int preRollFrames;
+    unsigned long postRollMs;
+    unsigned long motionCheckIntervalMs;
+    volatile bool motionArmed;
+    volatile bool motionPending;    // detected, waiting for loop() to start the clip
+    bool sessionMotionTriggered;
+    volatile int sessionMotionPeak;  // most changed pixels in one check during the clip
+    unsigned long lastMonitorFrameMs;
+    unsigned long lastMotionCheckMs;
+    unsigned long lastMotionMs;
+    uint32_t motionTriggers;
+
+    CaptureStats stats;
+    RecordingResult lastResult;
+
+    static void captureTaskEntry(void* param);
+    static void writerTaskEntry(void* param);
+    static void IRAM_ATTR frameTimerISR(void* param);
+    void syncFrameTimer(unsigned long delayMs);
+    void waitFrameTick(unsigned long lastFrameMs);
+    void captureSession();
+    void captureBurst();
+    void writerSession();
+    bool openSession(const String& filename, unsigned long durationMs, unsigned long frameDelayMs, int burstFrames);
+    void parkCapture();
+    void previewFrame();
+    void publishFrame(const uint8_t* jpeg, size_t len, uint32_t timestampMs);
+    bool previewWanted() const;
+    void monitorFrame();
+    bool checkMotion(unsigned long nowMs);
+
+public:
+    // Constructor
+    VideoRecorder(size_t ringBytes = 2 * 1024 * 1024, int ringFrames = 48, uint32_t maxClipFrames = 6000,
+                  size_t sdBufferBytes = 32 * 1024, size_t sdAlignBytes = 4096);
+
+    // Allocate the frame ring and start the (idle) capture and writer tasks
+    bool begin();
+
+    // Recording control - startRecording() returns immediately
+    bool startRecording(const String& filename, unsigned long durationMs, unsigned long frameDelayMs);
+    void stopRecording();
+
+    // Burst capture - set the arena size before begin(); startBurst() returns immediately
+    void setBurstArena(size_t arenaBytes, int maxFrames);
+    bool startBurst(const String& filename, int frames, unsigned long maxDurationMs);
+    bool hasBurst() const { return burstRing != NULL; }
+    int getBurstMaxFrames() const { return burstRing ? burstRing->getMaxFrames() : 0; }
+    size_t getBurstArenaBytes() const { return burstRing ? burstRing->getCapacityBytes() : 0; }
+    bool isBurst() const { return sessionBurstFrames > 0 && isActive(); }
+    void setFrameDelayMs(unsigned long delayMs) { rate.setFrameDelayMs(delayMs); }
+    // Configured frame size / quality the rate controller degrades from and recovers to
+    void setCameraBaseline(int framesize, int quality) { rate.setBaseline(framesize, quality); }
+
+    // Frames for live view - every captured frame while recording, paced previews otherwise
+    void setLiveStream(LiveStream* stream) { liveStream = stream; }
+    // Derived low resolution preview - offered the frames live view would have had
+    void setPreview(PreviewScaler* scaler) { preview = scaler; }
+
+    // Pre-allocated clip files - clips take one when ready, otherwise a new file
+    void setClipPool(ClipPool* pool) { clipPool = pool; }
+
+    // Motion triggered recording - preRollFrames must stay below the ring's frame slots
+    void setMotionTrigger(MotionDetector* detector, int preRollFrames, unsigned long postRollMs,
+                          int checksPerSecond);
+    void setMotionArmed(bool armed);
+    bool isMotionArmed() const { return motionArmed; }
+    // Returns true once per detection; startRecording() then keeps the pre-roll
+    bool takeMotionTrigger();
+    void cancelMotionTrigger() { motionPending = false; }
+    uint32_t getMotionTriggers() const { return motionTriggers; }
+
+    // Warm restart around a camera change: park the capture task between clips (false while
+    // recording or if it doesn't park in time), then resume it with the stale pre-roll dropped
+    bool pauseCapture(unsigned long timeoutMs);
+    void resumeCapture();
+    bool isCapturePaused() const { return capturePaused; }
+
+    // True while frames are being captured or still being written to SD
+    bool isActive() const { return capturing || writing; }
+    bool isCapturing() const { return capturing; }
+
+    // Returns true once per finished recording, filling in the result
+    bool takeFinishedRecording(RecordingResult& result);
+
+    // Status and information
+    CaptureStats& getCaptureStats() { return stats; }
+    RateController& getRateController() { return rate; }
+    const FrameTimingStats& getFrameTiming() const { return timing; }
+    int getQueuedFrames() const { return ring.count(); }
+    size_t getQueuedBytes() const { return ring.getBytesUsed(); }
+    uint32_t getDroppedFrames() const { return ring.getDroppedFrames(); }
+    WriteLatencyStats& getWriteStats() { return sdBuffer.getStats(); }
+    size_t getWriteBufferBytes() const { return sdBuffer.getBufferSize(); }
+    int getRingHighWaterFrames() const { return ring.getHighWaterFrames(); }
+    size_t getRingCapacityBytes() const { return ring.getCapacityBytes(); }
+    String getCurrentFilename() const { return currentFilename; }
+    const ClipSidecar& getSidecar() const { return sidecar; }
+};
+
+#endif // VIDEORECORDER_H
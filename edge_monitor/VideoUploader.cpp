@@ -1,4 +1,9 @@
 #include "VideoUploader.h"
+#include "JsonAllocator.h"
+#include "Metrics.h"
+#include "ClipSidecar.h"
+#include "MultipartForm.h"
+#include <algorithm>
 
 VideoUploader::VideoUploader(const String& uploadURL, const String& apiKey, 
                            long chunkSize, long timeoutMs, int maxRetries, 
@@ -19,21 +24,232 @@ VideoUploader::VideoUploader(const String& uploadURL, const String& apiKey,
     this->uploadProgress = 0;
     this->uploadFileSize = 0;
     this->lastUploadAttempt = 0;
+    this->uploadRetries = 0;
+    this->storageIndex = NULL;
+    this->connections = NULL;
+    
+    // Send buffers and reader task are created on first upload
+    for (int i = 0; i < NUM_SEND_BLOCKS; i++) {
+        this->sendBlocks[i].data = NULL;
+        this->sendBlocks[i].len = 0;
+    }
+    this->sendBlockSize = 0;
+    this->emptyBlocks = NULL;
+    this->filledBlocks = NULL;
+    this->readerTaskHandle = NULL;
+    this->readerFile = NULL;
+    this->readerRemaining = 0;
+    this->readerAbort = false;
+    this->readerBusy = false;
+    
+    this->uploadTaskHandle = NULL;
+    this->queueLock = xSemaphoreCreateMutex();
+    this->preview = NULL;
+    this->fullClipOnRequest = false;
+    this->backgroundEnabled = true;
+    this->recorder = NULL;
+    this->recordingRateKBps = 0;
+    this->ringHighWaterPercent = 50;
+    this->deferredReads = 0;
+    this->throttledMs = 0;
+    
+    this->lastThroughputKBps = 0;
+    this->totalBytesUploaded = 0;
+    this->totalUploadMs = 0;
+    
+    // Parsed once here, every request is formatted from the parts
+    this->endpoint.parse(uploadURL.c_str(), "/upload");
+    buildAuthLine();
+    this->responseBody[0] = '\0';
+    this->requestHead[0] = '\0';
 }
 
-void VideoUploader::addToUploadQueue(const String& filename) {
-    // Add to upload queue if not already present
-    for (const String& queued : uploadQueue) {
-        if (queued == filename) {
-            return; // Already in queue
+void VideoUploader::setUploadURL(const String& url) {
+    uploadURL = url;
+    endpoint.parse(uploadURL.c_str(), "/upload");
+}
+
+void VideoUploader::buildAuthLine() {
+    authLine[0] = '\0';
+    if (apiKey.length() == 0) {
+        return;
+    }
+    int len = snprintf(authLine, sizeof(authLine), "Authorization: Bearer %s\r\n", apiKey.c_str());
+    if (len < 0 || (size_t)len >= sizeof(authLine)) {
+        Serial.println("ERROR: Upload API key too long, requests go out without it");
+        authLine[0] = '\0';
+    }
+}
+
+bool VideoUploader::writeRequestHead(WiFiClient* stream, int len) {
+    // len is the snprintf() result for requestHead
+    if (len < 0 || (size_t)len >= sizeof(requestHead)) {
+        Serial.println("ERROR: Upload request headers too long");
+        return false;
+    }
+    return stream->write((const uint8_t*)requestHead, len) == (size_t)len;
+}
+
+bool VideoUploader::ensureSendBuffers() {
+    size_t wanted = (chunkSize >= 1024) ? chunkSize : 1024;
+    if (sendBlockSize != wanted && !readerBusy) {
+        // First use, or chunkSize changed - (re)allocate the blocks
+        for (int i = 0; i < NUM_SEND_BLOCKS; i++) {
+            heapUpload.release(sendBlocks[i].data);
+            sendBlocks[i].data = (uint8_t*)heapUpload.allocPreferPsram(wanted);
+            if (sendBlocks[i].data == NULL) {
+                Serial.printf("ERROR: Failed to allocate %d byte upload buffer\n", wanted);
+                sendBlockSize = 0;
+                return false;
+            }
         }
+        sendBlockSize = wanted;
+        Serial.printf("Upload buffers: %d x %d KB (%s)\n", NUM_SEND_BLOCKS, wanted / 1024,
+                      ESP.getFreePsram() > 0 ? "PSRAM" : "DRAM");
+    }
+    if (emptyBlocks == NULL) {
+        emptyBlocks = xQueueCreate(NUM_SEND_BLOCKS, sizeof(int));
+        filledBlocks = xQueueCreate(NUM_SEND_BLOCKS, sizeof(int));
+    }
+    if (readerTaskHandle == NULL && emptyBlocks != NULL && filledBlocks != NULL) {
+        xTaskCreatePinnedToCore(readerTaskEntry, "uploadReader", READER_STACK,
+                                this, READER_PRIORITY, &readerTaskHandle, READER_CORE);
+    }
+    return sendBlockSize > 0 && readerTaskHandle != NULL;
+}
+
+bool VideoUploader::begin() {
+    if (uploadTaskHandle != NULL) {
+        return true; // Already running
+    }
+    BaseType_t ok = xTaskCreatePinnedToCore(uploadTaskEntry, "uploadTask", UPLOAD_STACK,
+                                            this, UPLOAD_PRIORITY, &uploadTaskHandle, UPLOAD_CORE);
+    if (ok != pdPASS) {
+        Serial.println("ERROR: Failed to create upload task!");
+        return false;
+    }
+    Serial.printf("Upload task ready on core %d\n", UPLOAD_CORE);
+    return true;
+}
+
+void VideoUploader::uploadTaskEntry(void* param) {
+    VideoUploader* uploader = (VideoUploader*)param;
+    while (true) {
+        if (uploader->backgroundEnabled) {
+            uploader->processUploadQueue();
+        }
+        vTaskDelay(pdMS_TO_TICKS(UPLOAD_POLL_MS));
+    }
+}
+
+bool VideoUploader::recorderUnderPressure() const {
+    // Writer ring filling up means the SD card is the bottleneck - leave it to the recorder
+    if (recorder == NULL || !recorder->isActive()) {
+        return false;
+    }
+    size_t capacity = recorder->getRingCapacityBytes();
+    return capacity > 0 && recorder->getQueuedBytes() * 100 >= capacity * ringHighWaterPercent;
+}
+
+void VideoUploader::readerTaskEntry(void* param) {
+    VideoUploader* uploader = (VideoUploader*)param;
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uploader->readerLoop();
+    }
+}
+
+void VideoUploader::readerLoop() {
+    // Read ahead from SD into whichever block the sender has handed back
+    while (readerRemaining > 0 && !readerAbort) {
+        if (recorderUnderPressure()) {
+            deferredReads++;
+            vTaskDelay(pdMS_TO_TICKS(20));
+            continue;
+        }
+        int idx;
+        if (xQueueReceive(emptyBlocks, &idx, pdMS_TO_TICKS(100)) != pdTRUE) {
+            continue; // Sender still busy with both blocks
+        }
+        size_t toRead = min((size_t)readerRemaining, sendBlockSize);
+        size_t bytesRead = readerFile->read(sendBlocks[idx].data, toRead);
+        sendBlocks[idx].len = bytesRead;
+        // A short read of 0 bytes tells the sender the file is unreadable
+        readerRemaining = (bytesRead > 0) ? readerRemaining - bytesRead : 0;
+        xQueueSend(filledBlocks, &idx, portMAX_DELAY);
+    }
+    readerBusy = false;
+}
+
+void VideoUploader::startReader(File& file, size_t length) {
+    xQueueReset(emptyBlocks);
+    xQueueReset(filledBlocks);
+    for (int i = 0; i < NUM_SEND_BLOCKS; i++) {
+        xQueueSend(emptyBlocks, &i, 0);
+    }
+    readerFile = &file;
+    readerRemaining = length;
+    readerAbort = false;
+    readerBusy = true;
+    xTaskNotifyGive(readerTaskHandle);
+}
+
+void VideoUploader::stopReader() {
+    readerAbort = true;
+    while (readerBusy) {
+        // Discard read-ahead blocks until the reader sees the abort
+        int idx;
+        xQueueReceive(filledBlocks, &idx, 0);
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    readerFile = NULL;
+}
+
+void VideoUploader::addToUploadQueue(const String& filename, uint8_t priority) {
+    // Already queued files only move up if the new priority is higher
+    String queued = filename;
+    if (preview && priority < UPLOAD_PRIORITY_ALERT && filename.endsWith(".avi")) {
+        queued = ClipPreview::pathFor(filename);
+        if (!fullClipOnRequest) journal.add(filename, UPLOAD_PRIORITY_BACKFILL);
+    }
+    if (journal.add(queued, priority)) {
+        Serial.printf("Added to upload queue: %s (priority %d, queue size: %d)\n",
+                      queued.c_str(), priority, journal.pendingCount());
+    }
+}
+
+String VideoUploader::getCurrentUploadFile() {
+    xSemaphoreTake(queueLock, portMAX_DELAY);
+    String filename = currentUploadFile;
+    xSemaphoreGive(queueLock);
+    return filename;
+}
+
+void VideoUploader::eraseFromQueue(const String& filename, bool uploaded) {
+    xSemaphoreTake(queueLock, portMAX_DELAY);
+    if (currentUploadFile == filename) {
+        currentUploadFile = "";
+    }
+    xSemaphoreGive(queueLock);
+    if (uploaded) {
+        journal.markDone(filename);
+        // Sent in full ahead of its preview (upload_next) - the preview has nothing left to add
+        if (!ClipPreview::isPreview(filename)) journal.drop(ClipPreview::pathFor(filename));
+    } else {
+        journal.drop(filename);
     }
-    uploadQueue.push_back(filename);
-    Serial.printf("Added to upload queue: %s (Queue size: %d)\n", filename.c_str(), uploadQueue.size());
 }
 
 void VideoUploader::populateUploadQueue() {
-    // Scan SD card for video files and add them to upload queue
+    // The journal is kept current from then on, reconnects don't rescan
+    if (journal.isLoaded()) {
+        return;
+    }
+    if (journal.load()) {
+        return;
+    }
+    
+    // No journal yet - queue the clips already on the card once
     File root = SD.open("/");
     File file = root.openNextFile();
     
@@ -41,20 +257,19 @@ void VideoUploader::populateUploadQueue() {
         String fileName = file.name();
         // Upload all .avi files regardless of naming format
         if (fileName.endsWith(".avi")) {
-            String fullPath = "/" + fileName;
-            addToUploadQueue(fullPath);
+            addToUploadQueue("/" + fileName, UPLOAD_PRIORITY_SCHEDULED);
         }
         file = root.openNextFile();
     }
     root.close();
     
-    if (uploadQueue.size() > 0) {
-        Serial.printf("Found %d videos to upload\n", uploadQueue.size());
+    if (journal.pendingCount() > 0) {
+        Serial.printf("Found %d videos to upload\n", journal.pendingCount());
     }
 }
 
 void VideoUploader::clearUploadQueue() {
-    uploadQueue.clear();
+    journal.clear();
     Serial.println("Upload queue cleared");
 }
 
@@ -127,34 +342,22 @@ void VideoUploader::resetStuckUploadState() {
     }
 }
 
-bool VideoUploader::uploadFileInChunks(String filename) {
+bool VideoUploader::uploadFileInChunks(const String& queuedName) {
     if (WiFi.status() != WL_CONNECTED || uploadPaused) {
         return false;
     }
     
-    // Normalize filename - ensure it has a leading slash
-    String normalizedFilename = filename;
-    if (!normalizedFilename.startsWith("/")) {
-        normalizedFilename = "/" + normalizedFilename;
-    }
-    
-    Serial.printf("DEBUG: Attempting to open file: '%s' (original: '%s')\n", 
-                  normalizedFilename.c_str(), filename.c_str());
-    
-    // Try to open the file - first with normalized path
-    File file = SD.open(normalizedFilename.c_str(), FILE_READ);
-    
-    // If that fails and the original was different, try original path
-    if (!file && normalizedFilename != filename) {
-        Serial.printf("DEBUG: Trying original path: '%s'\n", filename.c_str());
-        file = SD.open(filename.c_str(), FILE_READ);
+    // Journal paths already have the leading slash; only a bare name needs a normalized copy
+    if (!queuedName.startsWith("/")) {
+        return uploadFileInChunks("/" + queuedName);
     }
+    const String& filename = queuedName;
     
-    // If still no file, try without leading slash
-    if (!file && normalizedFilename.startsWith("/")) {
-        String withoutSlash = normalizedFilename.substring(1);
-        Serial.printf("DEBUG: Trying without leading slash: '%s'\n", withoutSlash.c_str());
-        file = SD.open(withoutSlash.c_str(), FILE_READ);
+    // Try to open the file - first with the full path, then without the leading slash
+    File file = SD.open(filename.c_str(), FILE_READ);
+    if (!file) {
+        Serial.printf("DEBUG: Trying without leading slash: '%s'\n", filename.c_str() + 1);
+        file = SD.open(filename.c_str() + 1, FILE_READ);
     }
     
     if (!file) {
@@ -192,219 +395,271 @@ bool VideoUploader::uploadFileInChunks(String filename) {
         return false;
     }
     
-    filename = normalizedFilename; // Use normalized filename for rest of function
-    
     uploadFileSize = file.size();
+    int64_t uploadStart = Metrics::now();
     Serial.printf("Starting upload: %s (%.2fMB)\n", filename.c_str(), uploadFileSize / (1024.0 * 1024.0));
     
-    // Parse URL to extract host, port, and path
-    String url = uploadURL;
-    String protocol = "http://";
-    String host = "";
-    int port = 80;
-    String path = "/upload";
-    
-    if (url.startsWith("https://")) {
-        protocol = "https://";
-        port = 443;
-        url = url.substring(8); // Remove "https://"
-    } else if (url.startsWith("http://")) {
-        url = url.substring(7); // Remove "http://"
-    }
-    
-    // Extract host and path
-    int slash_pos = url.indexOf('/');
-    if (slash_pos > 0) {
-        host = url.substring(0, slash_pos);
-        path = url.substring(slash_pos);
-    } else {
-        host = url;
-        path = "/upload"; // Default path
-    }
-    
-    // Check for custom port in host
-    int colon_pos = host.indexOf(':');
-    if (colon_pos > 0) {
-        port = host.substring(colon_pos + 1).toInt();
-        host = host.substring(0, colon_pos);
-    }
-    
-    Serial.printf("Connecting to: %s:%d%s\n", host.c_str(), port, path.c_str());
-    
-    // Setup client
-    WiFiClient client;
-    WiFiClientSecure secureClient;
-    WiFiClient* stream;
-    
-    // Connect to server
-    bool connected = false;
-    if (enableHTTPS) {
-        secureClient.setInsecure(); // For testing - use proper certificates in production
-        connected = secureClient.connect(host.c_str(), port);
-        stream = &secureClient;
-    } else {
-        connected = client.connect(host.c_str(), port);
-        stream = &client;
+    if (!endpoint.isValid()) {
+        Serial.printf("ERROR: No usable upload URL (%s)\n", uploadURL.c_str());
+        file.close();
+        return false;
     }
-    
-    if (!connected) {
-        Serial.printf("Connection failed to %s:%d\n", host.c_str(), port);
+    if (!ensureSendBuffers()) {
         file.close();
         return false;
     }
+    if (connections == NULL) {
+        connections = new ConnectionManager(); // Not shared - no manager was set
+    }
     
-    Serial.println("Connected! Sending HTTP request...");
-    
-    // Generate boundary for multipart/form-data
-    String boundary = "----ESP32FormBoundary" + String(random(10000, 99999));
-    
-    // Extract filename without path
-    String filename_only = filename.substring(filename.lastIndexOf('/') + 1);
-    
-    // Build multipart form data
-    String multipart_start = "--" + boundary + "\r\n";
-    multipart_start += "Content-Disposition: form-data; name=\"file\"; filename=\"" + filename_only + "\"\r\n";
-    multipart_start += "Content-Type: application/octet-stream\r\n\r\n";
-    
-    String multipart_end = "\r\n--" + boundary + "--\r\n";
-    
-    // Calculate total content length
-    size_t total_length = multipart_start.length() + uploadFileSize + multipart_end.length();
+    // Name on the server: the file name without the path (previews are renamed after their clip)
+    bool isPreview = ClipPreview::isPreview(filename);
+    String previewName;
+    const char* nameOnly = strrchr(filename.c_str(), '/') + 1;
+    if (isPreview && preview) {
+        previewName = preview->uploadName(filename);
+        nameOnly = previewName.c_str();
+    }
     
-    // Send HTTP headers manually
-    stream->printf("POST %s HTTP/1.1\r\n", path.c_str());
-    stream->printf("Host: %s:%d\r\n", host.c_str(), port);
-    stream->printf("Content-Type: multipart/form-data; boundary=%s\r\n", boundary.c_str());
-    stream->printf("Content-Length: %d\r\n", total_length);
-    if (apiKey.length() > 0) {
-        stream->printf("Authorization: Bearer %s\r\n", apiKey.c_str());
+    // Ask the server how much of this file it already holds
+    long serverOffset = queryServerOffset(nameOnly, uploadFileSize);
+    bool success = false;
+    if (serverOffset < 0) {
+        // Server without resumable support - send the whole file as before
+        success = sendMultipart(file, nameOnly);
+    } else if ((size_t)serverOffset >= uploadFileSize) {
+        Serial.printf("Server already has all of %s\n", nameOnly);
+        success = true;
+    } else {
+        if (serverOffset > 0) {
+            Serial.printf("Resuming %s at %ld of %d bytes\n", nameOnly, serverOffset, uploadFileSize);
+        }
+        success = sendResumable(file, nameOnly, serverOffset);
     }
-    stream->print("Connection: close\r\n");
-    stream->print("\r\n");
     
-    Serial.println("Sending multipart data...");
+    file.close();
     
-    // Send multipart start
-    stream->print(multipart_start);
+    if (success) {
+        metricUploadLatency.recordSince(uploadStart);
+        Serial.printf("Upload successful: %s\n", filename.c_str());
+        
+        if (isPreview) {
+            SD.remove(filename.c_str()); // Rebuilt from the clip if it is ever needed again
+        } else if (deleteAfterUpload) {
+            if (SD.remove(filename.c_str())) {
+                Serial.printf("Deleted uploaded file: %s\n", filename.c_str());
+                if (storageIndex) storageIndex->removeVideoFile(filename);
+                ClipSidecar::remove(filename);
+                ClipPreview::remove(filename);
+            } else {
+                Serial.printf("Failed to delete uploaded file: %s\n", filename.c_str());
+            }
+        }
+    } else {
+        metricUploadFailures.inc();
+        Serial.printf("Upload incomplete: %s (%d of %d bytes on server)\n",
+                      filename.c_str(), uploadProgress, uploadFileSize);
+        if (serverOffset >= 0) {
+            journal.markPartial(filename, uploadProgress);
+        }
+    }
     
-    // Send file content in chunks
-    const size_t bufferSize = 1024;
-    uint8_t buffer[bufferSize];
-    size_t remaining = uploadFileSize;
+    return success;
+}
+
+size_t VideoUploader::sendFileBody(WiFiClient* stream, File& file, size_t offset) {
+    // Send file content block by block while the reader task fetches the next one
+    size_t length = uploadFileSize - offset;
+    size_t remaining = length;
     size_t totalSent = 0;
+    size_t nextProgress = 100 * 1024;
+    unsigned long sendStart = millis();
     
+    file.seek(offset);
+    startReader(file, length);
     while (remaining > 0 && !uploadPaused && stream->connected()) {
-        size_t toRead = min(remaining, bufferSize);
-        size_t bytesRead = file.read(buffer, toRead);
-        
-        if (bytesRead > 0) {
-            size_t written = stream->write(buffer, bytesRead);
-            if (written != bytesRead) {
-                Serial.printf("Write error: expected %d, wrote %d\n", bytesRead, written);
-                break;
-            }
-            remaining -= bytesRead;
-            totalSent += bytesRead;
-            
-            // Progress indicator for large files
-            if (totalSent % (100 * 1024) == 0) { // Every 100KB
-                Serial.printf("Uploaded: %.1f%%\n", (float)totalSent / uploadFileSize * 100);
-            }
-        } else {
+        int idx;
+        if (xQueueReceive(filledBlocks, &idx, pdMS_TO_TICKS(timeoutMs)) != pdTRUE) {
+            Serial.println("Error: timed out waiting for SD read");
+            break;
+        }
+        SendBlock& block = sendBlocks[idx];
+        if (block.len == 0) {
             Serial.println("Error reading file");
             break;
         }
-        yield(); // Allow other tasks to run
-    }
-    
-    // Send multipart end
-    stream->print(multipart_end);
-    stream->clear(); // Ensure all data is sent (updated from deprecated flush())
-    
-    Serial.printf("Upload data sent: %d bytes\n", totalSent + multipart_start.length() + multipart_end.length());
-    
-    // Read response
-    String response = "";
-    unsigned long timeout = millis();
-    bool headersParsed = false;
-    
-    while (stream->connected() && millis() - timeout < timeoutMs) {
-        if (stream->available()) {
-            String line = stream->readStringUntil('\n');
-            line.trim();
-            response += line + "\n";
-            
-            if (!headersParsed) {
-                if (line.length() == 0) { // Empty line indicates end of headers
-                    headersParsed = true;
-                    Serial.println("Headers received, reading body...");
-                }
-            } else {
-                // We're in the body section
-                while (stream->available()) {
-                    response += stream->readString();
-                }
-                break;
+        
+        unsigned long blockStart = millis();
+        size_t written = stream->write(block.data, block.len);
+        if (written != block.len) {
+            Serial.printf("Write error: expected %d, wrote %d\n", block.len, written);
+            break;
+        }
+        remaining -= block.len;
+        totalSent += block.len;
+        uploadProgress = offset + totalSent;
+        xQueueSend(emptyBlocks, &idx, 0); // Hand the block back for the next read
+        
+        // Share the card and the radio with a recording in progress
+        if (recordingRateKBps > 0 && recorder != NULL && recorder->isActive()) {
+            unsigned long minMs = (unsigned long)block.len * 1000 / (recordingRateKBps * 1024);
+            unsigned long spentMs = millis() - blockStart;
+            if (spentMs < minMs) {
+                vTaskDelay(pdMS_TO_TICKS(minMs - spentMs));
+                throttledMs += minMs - spentMs;
             }
         }
-        delay(1);
+        
+        // Progress indicator for large files
+        if (totalSent >= nextProgress) { // Every 100KB
+            Serial.printf("Uploaded: %.1f%%\n", (float)uploadProgress / uploadFileSize * 100);
+            nextProgress += 100 * 1024;
+        }
+    }
+    stopReader();
+    
+    // Achieved throughput for the file body
+    unsigned long sendMs = millis() - sendStart;
+    if (sendMs == 0) sendMs = 1;
+    lastThroughputKBps = (uint32_t)(((uint64_t)totalSent * 1000 / sendMs) / 1024);
+    totalBytesUploaded += totalSent;
+    metricUploadBytes.inc(totalSent);
+    totalUploadMs += sendMs;
+    Serial.printf("Upload throughput: %lu KB/s (%d bytes in %lu ms, %d KB blocks)\n",
+                  (unsigned long)lastThroughputKBps, totalSent, sendMs, sendBlockSize / 1024);
+    return totalSent;
+}
+
+long VideoUploader::queryServerOffset(const char* name, size_t size) {
+    // GET <path>/status - returns the committed byte count, -1 if not supported
+    char query[HttpEndpoint::MAX_PATH + 112];
+    int len = snprintf(query, sizeof(query), "%s/status?filename=%s&size=%lu", endpoint.path, name, (unsigned long)size);
+    if (len < 0 || (size_t)len >= sizeof(query)) {
+        Serial.printf("ERROR: Upload file name too long for a status query: %s\n", name);
+        return -1;
+    }
+    int code = connections->request(endpoint.host, endpoint.port, enableHTTPS, "GET", query, NULL, NULL, 0,
+                                    responseBody, sizeof(responseBody), timeoutMs, authLine);
+    if (code != 200) {
+        Serial.printf("Resume status not available (HTTP %d), using single-shot upload\n", code);
+        return -1;
+    }
+    
+    JsonDocument doc(&jsonAllocator);
+    if (deserializeJson(doc, responseBody) || !doc["offset"].is<long>()) {
+        return -1;
+    }
+    long offset = doc["offset"].as<long>();
+    uploadProgress = (offset > 0) ? offset : 0;
+    return offset;
+}
+
+bool VideoUploader::sendResumable(File& file, const char* name, size_t offset) {
+    // PUT <path>/resume - raw body from offset to end, the server appends as it arrives
+    WiFiClient* stream = connections->acquire(endpoint.host, endpoint.port, enableHTTPS);
+    if (stream == NULL) {
+        return false;
     }
     
-    // Close connection
-    if (enableHTTPS) {
-        secureClient.stop();
-    } else {
-        client.stop();
+    size_t length = uploadFileSize - offset;
+    int headLen = snprintf(requestHead, sizeof(requestHead),
+                           "PUT %s/resume?filename=%s&offset=%u&size=%u HTTP/1.1\r\n"
+                           "Host: %s:%d\r\n"
+                           "Content-Type: application/octet-stream\r\n"
+                           "Content-Length: %u\r\n"
+                           "%s"
+                           "Connection: keep-alive\r\n\r\n",
+                           endpoint.path, name, (unsigned)offset, (unsigned)uploadFileSize,
+                           endpoint.host, endpoint.port, (unsigned)length, authLine);
+    if (!writeRequestHead(stream, headLen)) {
+        connections->release(stream, false);
+        return false;
     }
     
-    // Parse response code
-    int httpResponseCode = 0;
-    if (response.startsWith("HTTP/1.1 ") || response.startsWith("HTTP/1.0 ")) {
-        httpResponseCode = response.substring(9, 12).toInt();
+    size_t sent = sendFileBody(stream, file, offset);
+    if (sent != length) {
+        // Paused or dropped - whatever reached the server stays committed there.
+        // The request is incomplete, so this socket can't carry another one.
+        connections->release(stream, false);
+        return false;
     }
     
-    // Extract and print response body
-    int body_start = response.indexOf("\r\n\r\n");
-    if (body_start < 0) {
-        body_start = response.indexOf("\n\n");
-        if (body_start >= 0) body_start += 2;
-    } else {
-        body_start += 4;
+    bool keepAlive = false;
+    int code = connections->readResponse(stream, responseBody, sizeof(responseBody), timeoutMs, keepAlive);
+    connections->release(stream, keepAlive);
+    if (responseBody[0] != '\0') {
+        Serial.printf("Server response: %s\n", responseBody);
     }
     
-    if (body_start > 0) {
-        String responseBody = response.substring(body_start);
-        responseBody.trim();
-        if (responseBody.length() > 0) {
-            Serial.printf("Server response: %s\n", responseBody.c_str());
+    if (code == 409) {
+        // Offset mismatch, the server tells us where it really is
+        JsonDocument doc(&jsonAllocator);
+        if (!deserializeJson(doc, responseBody) && doc["offset"].is<long>()) {
+            uploadProgress = doc["offset"].as<long>();
         }
+        return false;
+    }
+    return (code == 200 || code == 201);
+}
+
+bool VideoUploader::sendMultipart(File& file, const char* name) {
+    WiFiClient* stream = connections->acquire(endpoint.host, endpoint.port, enableHTTPS);
+    if (stream == NULL) {
+        return false;
     }
     
-    Serial.printf("Full response:\n%s\n", response.c_str());
+    Serial.println("Connected! Sending HTTP request...");
     
-    file.close();
+    MultipartForm form;
+    if (!form.begin(name, random(10000, 99999))) {
+        connections->release(stream, true); // nothing sent yet
+        return false;
+    }
     
-    bool success = (httpResponseCode == 200 || httpResponseCode == 201);
+    // Headers and the multipart start in one write
+    int headLen = snprintf(requestHead, sizeof(requestHead),
+                           "POST %s HTTP/1.1\r\n"
+                           "Host: %s:%d\r\n"
+                           "Content-Type: multipart/form-data; boundary=%s\r\n"
+                           "Content-Length: %u\r\n"
+                           "%s"
+                           "Connection: keep-alive\r\n\r\n"
+                           "%s",
+                           endpoint.path, endpoint.host, endpoint.port, form.getBoundary(),
+                           (unsigned)form.contentLength(uploadFileSize), authLine, (const char*)form.getHead());
+    if (!writeRequestHead(stream, headLen)) {
+        connections->release(stream, false);
+        return false;
+    }
     
-    if (success) {
-        Serial.printf("Upload successful: %s (Response: %d)\n", filename.c_str(), httpResponseCode);
-        
-        if (deleteAfterUpload) {
-            if (SD.remove(filename.c_str())) {
-                Serial.printf("Deleted uploaded file: %s\n", filename.c_str());
-            } else {
-                Serial.printf("Failed to delete uploaded file: %s\n", filename.c_str());
-            }
-        }
-    } else {
-        Serial.printf("Upload failed: %s (Response: %d)\n", filename.c_str(), httpResponseCode);
+    Serial.println("Sending multipart data...");
+    
+    size_t totalSent = sendFileBody(stream, file, 0);
+    if (totalSent != uploadFileSize) {
+        connections->release(stream, false);
+        uploadProgress = 0; // A partial multipart body is discarded by the server
+        return false;
     }
     
-    return success;
+    // Send multipart end
+    stream->write(form.getTail(), form.getTailLength());
+    stream->clear(); // Ensure all data is sent (updated from deprecated flush())
+    
+    Serial.printf("Upload data sent: %u bytes\n", (unsigned)(totalSent + form.getHeadLength() + form.getTailLength()));
+    
+    bool keepAlive = false;
+    int httpResponseCode = connections->readResponse(stream, responseBody, sizeof(responseBody), timeoutMs, keepAlive);
+    connections->release(stream, keepAlive);
+    if (responseBody[0] != '\0') {
+        Serial.printf("Server response: %s\n", responseBody);
+    }
+    Serial.printf("Upload response code: %d\n", httpResponseCode);
+    
+    return (httpResponseCode == 200 || httpResponseCode == 201);
 }
 
 void VideoUploader::processUploadQueue() {
-    if (WiFi.status() != WL_CONNECTED || uploadQueue.empty() || uploadInProgress) {
+    if (WiFi.status() != WL_CONNECTED || uploadInProgress || journal.pendingCount() == 0) {
         return;
     }
     
@@ -419,12 +674,10 @@ void VideoUploader::processUploadQueue() {
         return; // Still paused
     }
     
-    // Throttle upload attempts
+    // Throttle upload attempts - 5 s between files, growing backoff between retries
     unsigned long now = millis();
-    Serial.printf("processUploadQueue() - Time since last attempt: %lu ms (need 5000ms)\n", 
-                  now - lastUploadAttempt);
-    if (now - lastUploadAttempt < 5000) { // Wait 5 seconds between attempts
-        Serial.println("processUploadQueue() - Throttling uploads, too soon");
+    unsigned long waitMs = (uploadRetries > 0) ? 2000UL * uploadRetries : 5000UL;
+    if (now - lastUploadAttempt < waitMs) {
         return;
     }
     
@@ -434,51 +687,92 @@ void VideoUploader::processUploadQueue() {
     isUploading = true;
     lastUploadAttempt = now;
     
-    String filename = uploadQueue[0];
+    // Head of the journal: an interrupted upload, then alerts, motion clips, scheduled clips
+    String filename;
+    size_t resumeOffset = 0;
+    if (!journal.next(filename, resumeOffset)) {
+        uploadInProgress = false;
+        isUploading = false;
+        return;
+    }
+    xSemaphoreTake(queueLock, portMAX_DELAY);
+    if (filename != currentUploadFile) {
+        uploadRetries = 0;
+        if (resumeOffset > 0) {
+            uploadProgress = resumeOffset;
+            Serial.printf("Resuming interrupted upload: %s (%d bytes sent)\n", filename.c_str(), resumeOffset);
+        }
+    }
     currentUploadFile = filename;
-    uploadProgress = 0;
+    xSemaphoreGive(queueLock);
     
-    Serial.printf("Processing upload: %s\n", filename.c_str());
-    
-    bool success = false;
-    int retries = 0;
+    if (ClipPreview::isPreview(filename) && !preparePreview(filename)) {
+        isUploading = false;
+        uploadInProgress = false;
+        return;
+    }
     
-    while (!success && retries < maxRetries && !uploadPaused) {
-        if (retries > 0) {
-            Serial.printf("Retry attempt %d for %s\n", retries, filename.c_str());
-            delay(2000 * retries); // Exponential backoff
-        }
-        
-        success = uploadFileInChunks(filename);
-        
-        if (!success) {
-            retries++;
-            // Check WiFi connection
-            if (WiFi.status() != WL_CONNECTED) {
-                break; // Exit retry loop if WiFi is down
-            }
-        }
+    if (uploadRetries > 0) {
+        Serial.printf("Retry attempt %d for %s\n", uploadRetries, filename.c_str());
+    } else {
+        Serial.printf("Processing upload: %s\n", filename.c_str());
     }
     
-    // Remove from queue regardless of success/failure after max retries
-    uploadQueue.erase(uploadQueue.begin());
+    bool success = uploadFileInChunks(filename);
     
     if (success) {
         Serial.printf("Upload completed successfully: %s\n", filename.c_str());
-    } else {
-        Serial.printf("Upload failed after %d attempts: %s\n", retries, filename.c_str());
+        eraseFromQueue(filename, true);
+        uploadRetries = 0;
+    } else if (uploadPaused) {
+        // Paused for recording - keep the file at the head, it resumes from uploadProgress
+        Serial.printf("Upload paused at %d bytes: %s\n", uploadProgress, filename.c_str());
+    } else if (WiFi.status() != WL_CONNECTED) {
+        // Link down - doesn't count as a failed attempt
+        Serial.println("Upload interrupted, WiFi down");
+    } else if (++uploadRetries >= maxRetries) {
+        // Remove from queue after max retries
+        Serial.printf("Upload failed after %d attempts: %s\n", uploadRetries, filename.c_str());
+        eraseFromQueue(filename, false);
+        uploadRetries = 0;
     }
     
-    currentUploadFile = "";
     isUploading = false;
     uploadInProgress = false;
 }
 
+bool VideoUploader::preparePreview(const String& previewPath) {
+    // Previews are built from the clip just before they are sent
+    if (SD.exists(previewPath.c_str())) {
+        return true;
+    }
+    String clipPath = ClipPreview::clipFor(previewPath);
+    if (preview == NULL || !SD.exists(clipPath.c_str())) {
+        // Clip already gone (evicted, or sent in full first) - nothing to preview
+        eraseFromQueue(previewPath, false);
+        return false;
+    }
+    if (recorderUnderPressure()) {
+        deferredReads++;
+        return false;
+    }
+    if (!preview->build(clipPath, previewPath)) {
+        // The full clip is still queued unless it waits for a request
+        Serial.printf("Preview failed, dropping it: %s\n", previewPath.c_str());
+        eraseFromQueue(previewPath, false);
+        if (fullClipOnRequest) journal.add(clipPath, UPLOAD_PRIORITY_BACKFILL);
+        return false;
+    }
+    return true;
+}
+
 void VideoUploader::printUploadStatus() {
-    if (uploadQueue.empty()) {
+    int pending = journal.pendingCount();
+    if (pending == 0) {
         Serial.println("Upload queue: Empty");
     } else {
-        Serial.printf("Upload queue: %d files pending\n", uploadQueue.size());
+        Serial.printf("Upload queue: %d files pending (%d alert, %d motion)\n", pending,
+                      journal.pendingCount(UPLOAD_PRIORITY_ALERT), journal.pendingCount(UPLOAD_PRIORITY_MOTION));
         if (isUploading) {
             Serial.printf("Currently uploading: %s\n", currentUploadFile.c_str());
             if (uploadPaused) {
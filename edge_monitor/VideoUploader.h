@@ -6,13 +6,26 @@
 #include "WiFiClientSecure.h"
 #include "FS.h"
 #include "SD.h"
+#include <ArduinoJson.h>
 #include <vector>
+#include "CircularBuffer.h"
+#include "UploadJournal.h"
+#include "ClipPreview.h"
+#include "ConnectionManager.h"
+#include "HttpEndpoint.h"
+#include "VideoRecorder.h"
+#include "freertos/semphr.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
 
 class VideoUploader {
 private:
     // Configuration
     String uploadURL;
     String apiKey;
+    HttpEndpoint endpoint;         // uploadURL, parsed once
+    char authLine[160];            // "Authorization: Bearer <apiKey>\r\n" or empty
     long chunkSize;
     long timeoutMs;
     int maxRetries;
@@ -20,7 +33,9 @@ private:
     bool deleteAfterUpload;
     
     // State variables
-    std::vector<String> uploadQueue;
+    UploadJournal journal;         // Pending uploads, persisted on the card
+    ClipPreview* preview;          // Tiered uploads: reduced clip first, NULL = full clips only
+    bool fullClipOnRequest;        // With previews, full clips wait for upload_next
     bool isUploading;
     bool uploadPaused;
     bool uploadInProgress;
@@ -28,9 +43,74 @@ private:
     size_t uploadProgress;
     size_t uploadFileSize;
     unsigned long lastUploadAttempt;
+    int uploadRetries;             // Failed attempts for the file at the head of the queue
+    CircularBuffer* storageIndex;  // Told about deleted uploads, may be NULL
+    ConnectionManager* connections; // Keep-alive connections shared with image streaming
+    
+    // Double-buffered SD reader: PSRAM blocks of chunkSize, one filled while the other is sent
+    struct SendBlock {
+        uint8_t* data;
+        size_t len;
+    };
+    static const int NUM_SEND_BLOCKS = 2;
+    static const int READER_CORE = 0;
+    static const UBaseType_t READER_PRIORITY = 2;
+    static const uint32_t READER_STACK = 3072;
+    SendBlock sendBlocks[NUM_SEND_BLOCKS];
+    size_t sendBlockSize;
+    QueueHandle_t emptyBlocks;
+    QueueHandle_t filledBlocks;
+    TaskHandle_t readerTaskHandle;
+    File* readerFile;
+    volatile size_t readerRemaining;
+    volatile bool readerAbort;
+    volatile bool readerBusy;
+    
+    // Background upload task and governor
+    static const int UPLOAD_CORE = 0;           // Camera capture owns core 1
+    static const UBaseType_t UPLOAD_PRIORITY = 1; // Below the SD writer and the reader
+    static const uint32_t UPLOAD_STACK = 8192;  // Room for a TLS handshake
+    static const uint32_t UPLOAD_POLL_MS = 500;
+    TaskHandle_t uploadTaskHandle;
+    SemaphoreHandle_t queueLock;
+    volatile bool backgroundEnabled;
+    VideoRecorder* recorder;        // Recording pressure source, may be NULL
+    uint32_t recordingRateKBps;     // Send cap while a clip records, 0 = unlimited
+    uint8_t ringHighWaterPercent;   // Defer SD reads above this writer ring fill
+    uint32_t deferredReads;
+    uint32_t throttledMs;
+    
+    // Throughput reporting
+    uint32_t lastThroughputKBps;
+    uint64_t totalBytesUploaded;
+    uint32_t totalUploadMs;
+    
+    // Request formatting - fixed buffers, only the upload task uses them
+    static const size_t RESPONSE_BODY_BYTES = 512;
+    static const size_t REQUEST_HEAD_BYTES = 512;
+    char responseBody[RESPONSE_BODY_BYTES];
+    char requestHead[REQUEST_HEAD_BYTES];
     
     // Internal methods
-    bool uploadFileInChunks(String filename);
+    bool uploadFileInChunks(const String& filename);
+    void buildAuthLine();
+    bool writeRequestHead(WiFiClient* stream, int len);
+    size_t sendFileBody(WiFiClient* stream, File& file, size_t offset);
+    
+    // Resumable upload protocol (<path>/status and <path>/resume on the server)
+    long queryServerOffset(const char* name, size_t size);
+    bool sendResumable(File& file, const char* name, size_t offset);
+    bool sendMultipart(File& file, const char* name);
+
+    bool ensureSendBuffers();
+    void startReader(File& file, size_t length);
+    void stopReader();
+    static void readerTaskEntry(void* param);
+    void readerLoop();
+    static void uploadTaskEntry(void* param);
+    bool recorderUnderPressure() const;
+    bool preparePreview(const String& previewPath);
+    void eraseFromQueue(const String& filename, bool uploaded);
     
 public:
     // Constructor
@@ -39,8 +119,26 @@ public:
                   int maxRetries = 3, bool enableHTTPS = false, 
                   bool deleteAfterUpload = true);
     
-    // Queue management
-    void addToUploadQueue(const String& filename);
+    // Start the background upload task (uploads run concurrently with recording)
+    bool begin();
+    void setBackgroundEnabled(bool enabled) { backgroundEnabled = enabled; }
+    
+    // Recording-aware governor
+    void setRecorder(VideoRecorder* rec) { recorder = rec; }
+    void setRecordingRateKBps(uint32_t kbps) { recordingRateKBps = kbps; }
+    void setRingHighWaterPercent(uint8_t percent) { ringHighWaterPercent = percent; }
+    uint32_t getDeferredReads() const { return deferredReads; }
+    uint32_t getThrottledMs() const { return throttledMs; }
+    
+    // Tiered uploads - set before clips are queued
+    void setClipPreview(ClipPreview* builder, bool fullOnRequest = false) { preview = builder; fullClipOnRequest = fullOnRequest; }
+    ClipPreview* getClipPreview() { return preview; }
+    bool isFullClipOnRequest() const { return fullClipOnRequest; }
+    
+    // Queue management - with previews a clip queues its preview at priority and itself as backfill,
+    // except at alert priority, which always means the full clip
+    void addToUploadQueue(const String& filename, uint8_t priority = UPLOAD_PRIORITY_SCHEDULED);
+    // Load the journal (SD must be mounted); only the first boot without one scans the card
     void populateUploadQueue();
     void clearUploadQueue();
     
@@ -56,20 +154,30 @@ public:
     void printUploadStatus();
     bool getIsUploading() const { return isUploading; }
     bool getUploadPaused() const { return uploadPaused; }
-    int getQueueSize() const { return uploadQueue.size(); }
-    String getCurrentUploadFile() const { return currentUploadFile; }
+    int getQueueSize() { return journal.pendingCount(); }
+    String getCurrentUploadFile();
+    size_t getUploadProgress() const { return uploadProgress; }
+    size_t getUploadFileSize() const { return uploadFileSize; }
+    uint32_t getLastThroughputKBps() const { return lastThroughputKBps; }
+    uint32_t getAverageThroughputKBps() const {
+        return totalUploadMs ? (uint32_t)((totalBytesUploaded * 1000 / totalUploadMs) / 1024) : 0;
+    }
+    uint64_t getTotalBytesUploaded() const { return totalBytesUploaded; }
+    size_t getSendBlockSize() const { return sendBlockSize; }
     
     // Configuration setters
-    void setUploadURL(const String& url) { uploadURL = url; }
-    void setApiKey(const String& key) { apiKey = key; }
+    void setUploadURL(const String& url);
+    void setApiKey(const String& key) { apiKey = key; buildAuthLine(); }
     void setChunkSize(long size) { chunkSize = size; }
     void setTimeoutMs(long timeout) { timeoutMs = timeout; }
     void setMaxRetries(int retries) { maxRetries = retries; }
     void setEnableHTTPS(bool enable) { enableHTTPS = enable; }
     void setDeleteAfterUpload(bool enable) { deleteAfterUpload = enable; }
+    void setStorageIndex(CircularBuffer* index) { storageIndex = index; }
+    void setConnectionManager(ConnectionManager* manager) { connections = manager; }
     
-    // Allow external access to upload queue for storage management
-    std::vector<String>& getUploadQueue() { return uploadQueue; }
+    // Upload queue for storage management and status (locks internally)
+    UploadJournal& getJournal() { return journal; }
 };
 
 #endif // VIDEOUPLOADER_H 
\ No newline at end of file
@@ -27,7 +27,28 @@
 #include "camera_pins.h"
 #include "CircularBuffer.h"
 #include "VideoUploader.h"
+#include "VideoRecorder.h"
+#include "ConnectionManager.h"
+#include "LiveStream.h"
+#include "MotionDetector.h"
+#include "Metrics.h"
+#include "TaskMonitor.h"
+#include "StatusSnapshot.h"
+#include "ClipSidecar.h"
+#include "ClipPool.h"
+#include "ClipPreview.h"
+#include "SnapshotPusher.h"
+#include "SceneChange.h"
+#include "CameraReconfig.h"
+#include "BootSequencer.h"
 #include "Motor.h"
+#include "MotorController.h"
+#include "StatusEvents.h"
+#include "HeapAccounting.h"
+#include "JsonAllocator.h"
+#include "PowerScheduler.h"
+#include "ClipCatchup.h"
+#include "PreviewScaler.h"
 
 const int SD_PIN_CS = 21;
 const int LED_PIN = LED_BUILTIN; // Built-in LED on XIAO ESP32S3
@@ -42,6 +63,8 @@ const char* IP = "10.195.114.153";
 
 const int SERVER_PORT = 8000;
 const int HTTP_PORT = 80;
+const int STREAM_PORT = 81;  // Live MJPEG view, separate httpd so it never blocks the API
+const int CATCHUP_PORT = 82; // /catchup, separate httpd since a transfer can run for minutes
 
 // Web Server Configuration
 String WEB_SERVER_URL = "http://" + String(IP) + ":" + String(SERVER_PORT);
@@ -49,16 +72,99 @@ String WEB_SERVER_URL = "http://" + String(IP) + ":" + String(SERVER_PORT);
 // Upload Configuration (keeping original functionality)
 String UPLOAD_URL = WEB_SERVER_URL + "/upload";
 const char* UPLOAD_API_KEY = "";    
-const long UPLOAD_CHUNK_SIZE = 8192;    
+const long UPLOAD_CHUNK_SIZE = 32 * 1024; // PSRAM send block size (two are allocated)
 const long UPLOAD_TIMEOUT_MS = 60000;   
 const int MAX_UPLOAD_RETRIES = 3;       
 const bool ENABLE_HTTPS = false;        
 const bool DELETE_AFTER_UPLOAD = true;  
+const uint32_t UPLOAD_RATE_WHILE_RECORDING_KBPS = 256; // Background upload cap during a recording (0 = none)
+const uint8_t UPLOAD_RING_HIGH_WATER_PERCENT = 50;     // Defer upload SD reads above this writer ring fill
+
+// Tiered uploads (a reduced preview of each clip goes first, the full clip after all previews)
+const bool PREVIEW_UPLOAD_ENABLED = false;  // opt-in, for constrained uplinks
+const bool PREVIEW_FULL_ON_REQUEST = false; // true = full clips only go up on upload_next
+const int PREVIEW_FRAME_STEP = 5;           // keep every Nth frame
+const int PREVIEW_SCALE = 1;                // 0 = original JPEGs, 1..3 = re-encoded at 1/2..1/8 size
+const uint8_t PREVIEW_QUALITY = 50;         // JPEG quality of re-encoded frames
+const PreviewFormat PREVIEW_FORMAT = PREVIEW_FORMAT_MJPEG; // PREVIEW_FORMAT_H264 needs the esp_h264 component
 
 // Storage Management Configuration
 const long MAX_STORAGE_MB = 24;  
 const long MIN_FREE_SPACE_MB = 1; 
+const long STORAGE_HEADROOM_MB = 4;  // loop() evicts ahead of both limits by this much (about one clip)
 const bool ENABLE_CIRCULAR_BUFFER = true; 
+const int FILES_PAGE_DEFAULT = 50;   // /files entries per page without ?limit=
+const int FILES_PAGE_MAX = 200;      // upper bound for ?limit=
+const size_t CATCHUP_BUFFER_BYTES = 32 * 1024; // /catchup send chunk (PSRAM)
+const int CATCHUP_MAX_CLIPS = 20;              // clips per /catchup range request
+
+// Recording pipeline configuration (PSRAM frame ring between capture and SD writer)
+const size_t FRAME_RING_BYTES = 2 * 1024 * 1024;
+const int FRAME_RING_SLOTS = 48;
+const uint32_t MAX_CLIP_FRAMES = 6000;          // AVI index entries held in PSRAM per clip
+const size_t SD_WRITE_BUFFER_BYTES = 32 * 1024; // PSRAM write coalescing buffer
+const size_t SD_WRITE_ALIGN_BYTES = 4096;       // match the card's FAT cluster size
+
+// Clip file pool (clips are written in place into files pre-allocated while the card is idle)
+const bool CLIP_POOL_ENABLED = false; // opt-in, or at runtime with the clip_pool command
+const size_t CLIP_POOL_FILE_MB = 16;  // about a 30 s HD clip, longer clips grow as usual
+const int CLIP_POOL_FILES = 2;        // ready files kept (count against free space, not MAX_STORAGE_MB)
+const size_t CLIP_POOL_STEP_MB = 2;   // allocated per loop() step while not recording
+
+// Burst capture (frames at the sensor's full rate into a PSRAM arena, written to SD afterwards)
+const bool BURST_ENABLED = false;                 // opt-in, the arena is held in PSRAM from boot
+const size_t BURST_ARENA_BYTES = 3 * 1024 * 1024; // ~6 s of VGA at 25 fps
+const int BURST_MAX_FRAMES = 300;
+const int BURST_DEFAULT_FRAMES = 100;
+const unsigned long BURST_MAX_DURATION_MS = 15000;
+const bool BURST_ON_MOTION = false;               // true = motion starts a burst instead of a paced clip
+volatile int burstRequestFrames = 0;              // set by the burst command, started by loop()
+
+// Live view configuration (frames come from the capture task)
+const size_t LIVE_STREAM_FRAME_BYTES = 256 * 1024;  // larger frames are skipped
+const unsigned long LIVE_STREAM_INTERVAL_MS = 100;  // preview pacing when not recording (~10fps)
+
+// Derived preview for live view, snapshots and /capture (clips keep the full frames)
+const bool PREVIEW_STREAM_ENABLED = true;
+const uint16_t PREVIEW_STREAM_MAX_WIDTH = 320;       // HD frames decode at 1/4 scale
+const uint8_t PREVIEW_STREAM_QUALITY = 50;
+const unsigned long PREVIEW_STREAM_INTERVAL_MS = 200; // at most 5 previews a second
+const size_t PREVIEW_STREAM_FRAME_BYTES = 48 * 1024;  // per preview buffer (PSRAM)
+const unsigned long PREVIEW_MAX_AGE_MS = 1000;        // older previews aren't sent as snapshots
+const unsigned long PREVIEW_WAIT_MS = 1500;           // a /capture or snapshot keeps the scaler warm this long
+const unsigned long CAPTURE_PAUSE_MS = 100;           // /capture?full=1 waits this long for the capture task to park
+
+// Motion trigger configuration (clips start on motion instead of every captureInterval)
+const bool MOTION_TRIGGER_DEFAULT = false;      // until set with recording-config "trigger"
+const int PRE_ROLL_FRAMES = 30;                 // lead-in kept in the frame ring, below FRAME_RING_SLOTS
+const unsigned long MOTION_POST_ROLL_MS = 3000; // clip ends after this long without motion
+const int MOTION_CHECKS_PER_SEC = 5;
+
+// Boot (camera, SD and network stages run as parallel tasks, see setup())
+const unsigned long BOOT_POWER_SETTLE_MS = 500; // before the camera's power peak
+const uint32_t BOOT_CAMERA_STACK = 8192;
+const uint32_t BOOT_STORAGE_STACK = 8192;       // index walk and journal replay
+const uint32_t BOOT_NETWORK_STACK = 6144;
+
+// Task monitor
+const unsigned long TASK_MONITOR_PERIOD_MS = 1000; // per task CPU / stack sample period
+
+// Low-power idle between recording windows (PowerScheduler)
+const bool POWER_SAVE_ENABLED = false;         // opt-in, sensor standby and light sleep between windows
+const unsigned long POWER_MIN_SLEEP_MS = 2000;   // shorter gaps stay awake
+const unsigned long POWER_WAKE_LEAD_MS = 500;    // wake this long before the next capture / snapshot
+const unsigned long POWER_MAX_SLICE_MS = 1000;   // loop() runs at least this often while idle
+const unsigned long POWER_WAKE_HOLD_MS = 10000;  // stay awake after an API request needing the camera
+const float POWER_ACTIVE_MA = 180;               // supply current model for the energy estimate
+const float POWER_LIGHT_SLEEP_MA = 25;
+const float POWER_MODEM_SLEEP_MA = 70;
+const float POWER_SUPPLY_V = 3.7;
+
+// Cached /status body
+const size_t STATUS_SNAPSHOT_BYTES = 16 * 1024;  // pre-sized serialization buffer
+const size_t JSON_RESPONSE_BYTES = 1024;         // control / command / settings replies
+const unsigned long STATUS_REFRESH_MS = 1000;    // rebuild at least this often
+const unsigned long STATUS_EVENTS_HEARTBEAT_MS = 10000;  // /events frame even when nothing changed
 
 // NTP time configuration
 const char* NTP_SERVER = "pool.ntp.org";       
@@ -69,16 +175,47 @@ const int DAYLIGHT_OFFSET_SEC = 0;
 unsigned long imageStreamInterval = 5000; // Stream image every 5 seconds
 unsigned long lastImageStream = 0;
 bool streamingEnabled = true;
+const int SNAPSHOT_SLOTS = 3;                        // queued copies, the oldest is dropped when all are full
+const size_t SNAPSHOT_MAX_BYTES = 256 * 1024;        // per slot (PSRAM)
+const unsigned long SNAPSHOT_TIMEOUT_MS = 10000;
+const bool SNAPSHOT_CHANGE_ONLY = true;              // unchanged scenes send a heartbeat instead of the image
+const unsigned long SNAPSHOT_KEEPALIVE_MS = 60000;   // full image at least this often regardless
+const int SNAPSHOT_CELL_THRESHOLD = 8;               // luma levels a 16x12 grid cell must move
+const int SNAPSHOT_MIN_CHANGED_CELLS = 3;            // cells that must move to count as changed
+unsigned long lastSnapshotSent = 0;
+uint32_t snapshotsUnchanged = 0;
 
 // Class instances
 CircularBuffer* circularBuffer;
 VideoUploader* videoUploader;
+VideoRecorder* videoRecorder;
+ConnectionManager* connectionManager;
+LiveStream* liveStream;
+MotionDetector* motionDetector;
+TaskMonitor* taskMonitor;
+StatusSnapshot* statusSnapshot;
+StatusEvents* statusEvents;
+ClipPool* clipPool;
+ClipPreview* clipPreview;
+SnapshotPusher* snapshotPusher;
+SceneChange* sceneChange;
+CameraReconfig* cameraReconfig;
+BootSequencer* bootSequencer;
+PowerScheduler* powerScheduler;
+ClipCatchup* clipCatchup;
+PreviewScaler* previewScaler;
+int bootCameraPhase = -1;
+int bootStoragePhase = -1;
+int bootNetworkPhase = -1;
 httpd_handle_t camera_httpd = NULL;
+httpd_handle_t catchup_httpd = NULL;
 
 // Motor instance (Single motor on D2=GPIO3, D3=GPIO4)
 Motor motor(3, 4, 10, 100);  // deadZone=10, maxSpeed=100
+MotorController* motorController;
+const int MOTOR_ACCEL_PER_SEC = 400;         // speed units per second, 0 to full in 250 ms
+const unsigned long MOTOR_DEADMAN_MS = 300;  // /motor/ws stops the motor after this long without a command
 
-File videoFile;
 bool camera_sign = false;
 bool sd_sign = false;
 bool wifi_connected = false;
@@ -87,6 +224,7 @@ bool system_paused = false;
 unsigned long lastCaptureTime = 0;
 unsigned long captureDuration = 10000; // 10 seconds
 unsigned long captureInterval = 60000; // 60 seconds
+bool motionTrigger = MOTION_TRIGGER_DEFAULT; // false = record every captureInterval
 int imageCount = 0;
 
 // WiFi status LED variables
@@ -109,7 +247,8 @@ struct CameraSettings {
   int saturation = 0;
 } cameraSettings;
 
-// High resolution support configuration
+// High resolution support configuration (initial camera setup; the recorder's
+// RateController adjusts quality, frame size and pacing at run time)
 const int HIGH_RES_THRESHOLD = FRAMESIZE_SVGA;  // 800x600
 const int VERY_HIGH_RES_THRESHOLD = FRAMESIZE_SXGA; // 1280x1024
 const int HIGH_RES_QUALITY = 25;  // Lower quality for high res (higher number = lower quality)
@@ -117,33 +256,50 @@ const int VERY_HIGH_RES_QUALITY = 35; // Even lower quality for very high res
 const int HIGH_RES_FB_COUNT = 2;  // Use 2 frame buffers for high res
 const int NORMAL_FB_COUNT = 1;    // Normal frame buffer count
 
+// Run-time camera reconfiguration (frame buffers are allocated once for the largest size allowed,
+// so later frame size changes are sensor only - no esp_camera_deinit / re-init)
+const int CAMERA_MAX_FRAMESIZE = FRAMESIZE_UXGA;    // larger sizes are refused
+const int PREVIEW_PROFILE_FRAMESIZE = FRAMESIZE_VGA; // "preview" profile, "recording" is the saved setting
+const int PREVIEW_PROFILE_QUALITY = 12;
+
 // FPS control (milliseconds delay between frames)
 unsigned long frameDelayMs = 0;  // 0 = max FPS, 33 = ~30fps, 66 = ~15fps, 100 = ~10fps
 unsigned long targetFPS = 0;     // 0 = unlimited, set via API
 
-// Error tracking for capture failures
-struct CaptureStats {
-  unsigned long totalCaptures = 0;
-  unsigned long failedCaptures = 0;
-  unsigned long lastFailureTime = 0;
-  int consecutiveFailures = 0;
-  bool degradedMode = false;  // Auto-downgrade resolution on failures
-} captureStats;
-
 // Function prototypes
 void startCameraServer();
+void startCatchupServer();
 void streamImageToServer();
+void submitSnapshot(const uint8_t* jpeg, size_t len, unsigned long now);
+void handleFinishedRecording(const RecordingResult& result);
 void saveSettings();
 void loadSettings();
+void connectToWiFi(bool syncTime = true);
+bool setupTime();
+bool bootCamera();
+bool bootStorage();
+bool bootNetwork();
+bool bootTime();
+bool bootUploads();
+void printSystemStatus();
+bool setCameraFramesize(int framesize, String& error);
 esp_err_t root_handler(httpd_req_t *req);
 esp_err_t status_handler(httpd_req_t *req);
+void build_status(JsonDocument& doc);
+esp_err_t sendJsonResponse(httpd_req_t *req, JsonDocument& doc);
+void debugMemory(const char* caller);
+unsigned long powerIdleMs(bool motionMode);
 esp_err_t control_handler(httpd_req_t *req);
 esp_err_t capture_handler(httpd_req_t *req);
 esp_err_t command_handler(httpd_req_t *req);
 esp_err_t recording_config_handler(httpd_req_t *req);
 esp_err_t apply_settings_handler(httpd_req_t *req);
 esp_err_t files_handler(httpd_req_t *req);
+esp_err_t thumb_handler(httpd_req_t *req);
+esp_err_t catchup_handler(httpd_req_t *req);
 esp_err_t motor_control_handler(httpd_req_t *req);
+esp_err_t metrics_handler(httpd_req_t *req);
+esp_err_t timed_handler(httpd_req_t *req);
 
 // Settings persistence functions
 void saveSettings() {
@@ -160,6 +316,7 @@ void saveSettings() {
   preferences.putULong("streamInt", imageStreamInterval);
   preferences.putULong("targetFPS", targetFPS);
   preferences.putULong("frameDelay", frameDelayMs);
+  preferences.putBool("motionTrig", motionTrigger);
   
   preferences.end();
   Serial.printf("Settings saved: framesize=%d, quality=%d, fps=%lu\n", 
@@ -182,15 +339,32 @@ void loadSettings() {
   imageStreamInterval = preferences.getULong("streamInt", 5000);
   targetFPS = preferences.getULong("targetFPS", 0);
   frameDelayMs = preferences.getULong("frameDelay", 0);
+  motionTrigger = preferences.getBool("motionTrig", MOTION_TRIGGER_DEFAULT);
   
   preferences.end();
+  if (cameraSettings.framesize > CAMERA_MAX_FRAMESIZE) {
+    Serial.printf("WARNING: Saved framesize %d above the maximum, using %d\n",
+                  cameraSettings.framesize, CAMERA_MAX_FRAMESIZE);
+    cameraSettings.framesize = CAMERA_MAX_FRAMESIZE;
+  }
   Serial.printf("Settings loaded: framesize=%d, quality=%d, fps=%lu\n", 
                 cameraSettings.framesize, cameraSettings.quality, targetFPS);
   Serial.println("===================================\n");
 }
 
 // WiFi and upload functions
-void setupTime() {
+// Saved frame size change, applied to the running sensor (buffers stay as allocated)
+bool setCameraFramesize(int framesize, String& error) {
+  if (!cameraReconfig->apply(framesize, -1, error)) {
+    return false;
+  }
+  cameraSettings.framesize = framesize;
+  cameraReconfig->setProfile(CameraReconfig::PROFILE_RECORDING, cameraSettings.framesize, cameraSettings.quality);
+  videoRecorder->setCameraBaseline(cameraSettings.framesize, cameraSettings.quality);
+  return true;
+}
+
+bool setupTime() {
   Serial.println("DEBUG: Setting up time synchronization...");
   configTime(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC, NTP_SERVER);
   
@@ -217,7 +391,9 @@ void setupTime() {
     Serial.println();
     Serial.println("Failed to synchronize time with NTP server!");
     Serial.println("Videos will use fallback numbering system.");
+    return false;
   }
+  return true;
 }
 
 String getTimestampFilename() {
@@ -243,7 +419,7 @@ String getTimestampFilename() {
   return timestampName;
 }
 
-void connectToWiFi() {
+void connectToWiFi(bool syncTime) {
   Serial.println("DEBUG: Connecting to WiFi...");
   WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
   
@@ -260,7 +436,7 @@ void connectToWiFi() {
     Serial.printf("WiFi connected! IP: %s\n", WiFi.localIP().toString().c_str());
     Serial.printf("Signal strength: %d dBm\n", WiFi.RSSI());
     
-    setupTime();
+    if (syncTime) setupTime();
     
     // Setup mDNS for device discovery
     if (MDNS.begin("edge-monitor")) {
@@ -285,6 +461,7 @@ void checkWiFiConnection() {
     if (wifi_connected) {
       Serial.println("DEBUG: WiFi connection lost. Attempting to reconnect...");
       wifi_connected = false;
+      connectionManager->closeIdle(); // Sockets don't survive a reconnect
       
       if (videoUploader->getIsUploading()) {
         videoUploader->pauseUpload();
@@ -360,9 +537,8 @@ void updateWiFiStatusLED() {
 }
 
 bool isRecording() {
-  unsigned long now = millis();
-  bool recording = recording_active && (now - lastCaptureTime) < captureDuration;
-  return recording;
+  // Recording lasts until the writer task has drained the frame ring to SD
+  return videoRecorder != NULL && videoRecorder->isActive();
 }
 
 // HTTP Server Functions
@@ -374,7 +550,7 @@ void startCameraServer() {
   
   httpd_config_t config = HTTPD_DEFAULT_CONFIG();
   config.server_port = HTTP_PORT;
-  config.max_uri_handlers = 10;
+  config.max_uri_handlers = 16;
   config.stack_size = 8192;
   
   // Performance optimizations - run HTTP server on separate core
@@ -385,57 +561,73 @@ void startCameraServer() {
   httpd_uri_t status_uri = {
     .uri       = "/status",
     .method    = HTTP_GET,
-    .handler   = status_handler,
-    .user_ctx  = NULL
+    .handler   = timed_handler,
+    .user_ctx  = (void*)status_handler
   };
   
   httpd_uri_t control_uri = {
     .uri       = "/control",
     .method    = HTTP_POST,
-    .handler   = control_handler,
-    .user_ctx  = NULL
+    .handler   = timed_handler,
+    .user_ctx  = (void*)control_handler
   };
   
   httpd_uri_t capture_uri = {
     .uri       = "/capture",
     .method    = HTTP_GET,
-    .handler   = capture_handler,
-    .user_ctx  = NULL
+    .handler   = timed_handler,
+    .user_ctx  = (void*)capture_handler
   };
   
   httpd_uri_t command_uri = {
     .uri       = "/command",
     .method    = HTTP_POST,
-    .handler   = command_handler,
-    .user_ctx  = NULL
+    .handler   = timed_handler,
+    .user_ctx  = (void*)command_handler
   };
   
   httpd_uri_t recording_config_uri = {
     .uri       = "/recording-config",
     .method    = HTTP_POST,
-    .handler   = recording_config_handler,
-    .user_ctx  = NULL
+    .handler   = timed_handler,
+    .user_ctx  = (void*)recording_config_handler
   };
   
   httpd_uri_t apply_settings_uri = {
     .uri       = "/apply-settings",
     .method    = HTTP_POST,
-    .handler   = apply_settings_handler,
-    .user_ctx  = NULL
+    .handler   = timed_handler,
+    .user_ctx  = (void*)apply_settings_handler
   };
   
   httpd_uri_t files_uri = {
     .uri       = "/files",
     .method    = HTTP_GET,
-    .handler   = files_handler,
-    .user_ctx  = NULL
+    .handler   = timed_handler,
+    .user_ctx  = (void*)files_handler
+  };
+  
+  // Clip thumbnails and stats from the recording's sidecar
+  httpd_uri_t thumb_uri = {
+    .uri       = "/thumb",
+    .method    = HTTP_GET,
+    .handler   = timed_handler,
+    .user_ctx  = (void*)thumb_handler
   };
   
   // Motor control endpoint
   httpd_uri_t motor_uri = {
     .uri       = "/motor",
     .method    = HTTP_POST,
-    .handler   = motor_control_handler,
+    .handler   = timed_handler,
+    .user_ctx  = (void*)motor_control_handler
+  };
+  
+  // Prometheus text for fleet monitoring (not timed itself, a scrape shouldn't skew the API latency)
+  httpd_uri_t metrics_uri = {
+    .uri       = "/metrics",
+    .method    = HTTP_GET,
+    .handler   = metrics_handler,
     .user_ctx  = NULL
   };
   
@@ -443,8 +635,8 @@ void startCameraServer() {
   httpd_uri_t root_uri = {
     .uri       = "/",
     .method    = HTTP_GET,
-    .handler   = root_handler,
-    .user_ctx  = NULL
+    .handler   = timed_handler,
+    .user_ctx  = (void*)root_handler
   };
   
   if (httpd_start(&camera_httpd, &config) == ESP_OK) {
@@ -455,14 +647,96 @@ void startCameraServer() {
     httpd_register_uri_handler(camera_httpd, &recording_config_uri);
     httpd_register_uri_handler(camera_httpd, &apply_settings_uri);
     httpd_register_uri_handler(camera_httpd, &files_uri);
+    httpd_register_uri_handler(camera_httpd, &thumb_uri);
     httpd_register_uri_handler(camera_httpd, &motor_uri);
+    httpd_register_uri_handler(camera_httpd, &metrics_uri);
     httpd_register_uri_handler(camera_httpd, &root_uri);
+    motorController->attach(camera_httpd); // /motor/ws, not timed (long-lived socket)
+    statusEvents->attach(camera_httpd);    // /events, same
     
     Serial.printf("Camera HTTP server started on port %d\n", HTTP_PORT);
     Serial.printf("Device accessible at: http://%s:%d\n", WiFi.localIP().toString().c_str(), HTTP_PORT);
   } else {
     Serial.println("Failed to start camera HTTP server");
   }
+  
+  // Live view runs in its own httpd task so a long-lived stream can't hold up the API
+  liveStream->startServer(STREAM_PORT);
+  startCatchupServer();
+}
+
+// Catch-up transfers get their own httpd task: one can run for minutes, and throttling behind
+// the SD writer must never stall /status, /control or the motor WebSocket on camera_httpd
+void startCatchupServer() {
+  if (catchup_httpd != NULL) {
+    httpd_stop(catchup_httpd);
+    catchup_httpd = NULL;
+  }
+  
+  httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+  config.server_port = CATCHUP_PORT;
+  config.ctrl_port += 2;           // Control server has the default, live stream +1
+  config.max_uri_handlers = 1;
+  config.max_open_sockets = 2;     // One transfer plus a request to refuse with 503
+  config.stack_size = 6144;
+  config.core_id = 0;
+  config.task_priority = 2;        // Below live view, like the background uploads
+  
+  // Recorded frames at SD / network speed for server sync (not timed, a transfer can run for minutes)
+  httpd_uri_t catchup_uri = {
+    .uri       = "/catchup",
+    .method    = HTTP_GET,
+    .handler   = catchup_handler,
+    .user_ctx  = NULL
+  };
+  
+  if (httpd_start(&catchup_httpd, &config) != ESP_OK) {
+    catchup_httpd = NULL;
+    Serial.println("Failed to start catch-up server");
+    return;
+  }
+  httpd_register_uri_handler(catchup_httpd, &catchup_uri);
+  Serial.printf("Catch-up server started on port %d (/catchup)\n", CATCHUP_PORT);
+}
+
+// Runs the real handler (passed in user_ctx) and records how long it took
+esp_err_t timed_handler(httpd_req_t *req) {
+  esp_err_t (*handler)(httpd_req_t*) = (esp_err_t (*)(httpd_req_t*))req->user_ctx;
+  int64_t start = Metrics::now();
+  esp_err_t res = handler(req);
+  // Anything posted may have changed what /status reports
+  if (req->method == HTTP_POST) {
+    statusSnapshot->markDirty();
+  }
+  metricHttpLatency.recordSince(start);
+  metricHttpRequests.inc();
+  return res;
+}
+
+bool metricsChunk(void* ctx, const char* text, size_t len) {
+  return httpd_resp_send_chunk((httpd_req_t*)ctx, text, len) == ESP_OK;
+}
+
+esp_err_t metrics_handler(httpd_req_t *req) {
+  httpd_resp_set_type(req, "text/plain; version=0.0.4");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  
+  // Registered counters and histograms, then gauges for state owned by other modules
+  bool ok = Metrics::writePrometheus(metricsChunk, req);
+  ok = ok && Metrics::writeGauge(metricsChunk, req, "edge_free_heap_bytes", "Free internal heap", ESP.getFreeHeap());
+  ok = ok && Metrics::writeGauge(metricsChunk, req, "edge_free_psram_bytes", "Free PSRAM", ESP.getFreePsram());
+  ok = ok && Metrics::writeGauge(metricsChunk, req, "edge_recording", "1 while a clip is being captured or written", isRecording() ? 1 : 0);
+  ok = ok && Metrics::writeGauge(metricsChunk, req, "edge_ring_frames", "Frames queued for the SD writer", videoRecorder->getQueuedFrames());
+  ok = ok && Metrics::writeGauge(metricsChunk, req, "edge_rate_level", "Rate controller degrade level", videoRecorder->getRateController().getLevel());
+  ok = ok && Metrics::writeGauge(metricsChunk, req, "edge_frame_jitter_avg_seconds", "Average inter-frame jitter of the current / last clip",
+                                 videoRecorder->getFrameTiming().avgJitterUs() / 1e6);
+  ok = ok && Metrics::writeGauge(metricsChunk, req, "edge_upload_queue", "Files waiting for upload", videoUploader->getQueueSize());
+  ok = ok && Metrics::writeGauge(metricsChunk, req, "edge_wifi_rssi_dbm", "WiFi signal strength", wifi_connected ? WiFi.RSSI() : 0);
+  ok = ok && Metrics::writeGauge(metricsChunk, req, "edge_uptime_seconds", "Time since boot", millis() / 1000.0);
+  if (!ok) {
+    return ESP_FAIL; // Client went away mid-scrape
+  }
+  return httpd_resp_send_chunk(req, NULL, 0);
 }
 
 esp_err_t root_handler(httpd_req_t *req) {
@@ -473,6 +747,9 @@ esp_err_t root_handler(httpd_req_t *req) {
                      "<p>Endpoints:</p><ul>"
                      "<li><a href='/status'>/status</a> - Device status (JSON)</li>"
                      "<li><a href='/capture'>/capture</a> - Camera capture</li>"
+                     "<li><a href='/metrics'>/metrics</a> - Prometheus metrics</li>"
+                     "<li>:81/stream - Live MJPEG stream</li>"
+                     "<li>:82/catchup - Recorded frames for server sync</li>"
                      "</ul></body></html>";
   
   httpd_resp_set_type(req, "text/html");
@@ -482,9 +759,31 @@ esp_err_t root_handler(httpd_req_t *req) {
   return ESP_OK;
 }
 
+// camera_httpd runs its handlers one at a time in its own task, so they share one response buffer
+static char jsonResponseBuf[JSON_RESPONSE_BYTES];
+
+esp_err_t sendJsonResponse(httpd_req_t *req, JsonDocument& doc) {
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  if (measureJson(doc) >= sizeof(jsonResponseBuf)) {
+    Serial.println("ERROR: JSON response larger than JSON_RESPONSE_BYTES");
+    return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Response too large");
+  }
+  size_t len = serializeJson(doc, jsonResponseBuf, sizeof(jsonResponseBuf));
+  httpd_resp_set_type(req, "application/json");
+  return httpd_resp_send(req, jsonResponseBuf, len);
+}
+
+// Served from the snapshot loop() keeps current, never blocks on the recorder, SD or sensor
 esp_err_t status_handler(httpd_req_t *req) {
-  JsonDocument doc;
-  
+  return statusSnapshot->send(req);
+}
+
+// Free memory per heap capability and what each subsystem holds, on Serial
+void debugMemory(const char* caller) {
+  HeapAccounting::print(caller);
+}
+
+void build_status(JsonDocument& doc) {
   doc["device_type"] = "edge_monitor";
   doc["wifi_connected"] = wifi_connected;
   doc["is_recording"] = isRecording();
@@ -496,7 +795,128 @@ esp_err_t status_handler(httpd_req_t *req) {
   doc["file_count"] = circularBuffer->countVideoFiles();
   doc["storage_used"] = circularBuffer->getVideoStorageUsed() / (1024 * 1024);
   
+  // Boot phase timings (ms since the parallel boot started; total is 0 while still booting)
+  JsonObject boot = doc["boot"].to<JsonObject>();
+  boot["total_ms"] = bootSequencer->getCompleteMs();
+  JsonArray bootPhases = boot["phases"].to<JsonArray>();
+  for (int i = 0; i < bootSequencer->getPhaseCount(); i++) {
+    const BootSequencer::Phase& phase = bootSequencer->getPhase(i);
+    JsonObject entry = bootPhases.add<JsonObject>();
+    entry["name"] = phase.name;
+    entry["state"] = BootSequencer::stateName(phase.state);
+    entry["start_ms"] = phase.startMs;
+    entry["end_ms"] = phase.endMs;
+  }
+  
+  // Upload throughput
+  JsonObject uploadStats = doc["upload_stats"].to<JsonObject>();
+  uploadStats["block_bytes"] = videoUploader->getSendBlockSize();
+  uploadStats["last_kbps"] = videoUploader->getLastThroughputKBps();
+  uploadStats["avg_kbps"] = videoUploader->getAverageThroughputKBps();
+  uploadStats["bytes_uploaded"] = videoUploader->getTotalBytesUploaded();
+  uploadStats["deferred_reads"] = videoUploader->getDeferredReads();
+  uploadStats["throttled_ms"] = videoUploader->getThrottledMs();
+  UploadJournal& journal = videoUploader->getJournal();
+  const UploadJournal::Stats& journalStats = journal.getStats();
+  uploadStats["queue_size"] = journal.pendingCount();
+  uploadStats["queue_alert"] = journal.pendingCount(UPLOAD_PRIORITY_ALERT);
+  uploadStats["queue_motion"] = journal.pendingCount(UPLOAD_PRIORITY_MOTION);
+  uploadStats["journal_lines"] = journal.getJournalLines();
+  uploadStats["journal_compactions"] = journalStats.compactions;
+  uploadStats["journal_append_failures"] = journalStats.appendFailures;
+  uploadStats["journal_load_ms"] = journalStats.loadMs;
+  uploadStats["queue_backfill"] = journal.pendingCount(UPLOAD_PRIORITY_BACKFILL);
+  ClipPreview* preview = videoUploader->getClipPreview();
+  if (preview) {
+    const ClipPreview::Stats& previewStats = preview->getStats();
+    JsonObject previews = uploadStats["previews"].to<JsonObject>();
+    previews["frame_step"] = preview->getFrameStep();
+    previews["scale"] = preview->getScale();
+    previews["format"] = preview->getFormat() == PREVIEW_FORMAT_H264 ? "h264" : "mjpeg";
+    previews["full_on_request"] = videoUploader->isFullClipOnRequest();
+    previews["built"] = previewStats.built;
+    previews["failures"] = previewStats.failures;
+    previews["last_build_ms"] = previewStats.lastBuildMs;
+    previews["last_frames"] = previewStats.lastFrames;
+    previews["last_bytes"] = previewStats.lastBytes;
+    previews["last_source_bytes"] = previewStats.lastSourceBytes;
+  }
+  
+  // Live view statistics
+  JsonObject streamStats = doc["live_stream"].to<JsonObject>();
+  streamStats["port"] = liveStream->getPort();
+  streamStats["viewer"] = liveStream->hasViewer();
+  streamStats["sessions"] = liveStream->getSessions();
+  streamStats["frames_sent"] = liveStream->getFramesSent();
+  streamStats["oversize_frames"] = liveStream->getOversizeFrames();
+  
+  // Derived preview (live view, snapshots, /capture)
+  const PreviewScaler::Stats& scalerStats = previewScaler->getStats();
+  JsonObject previewStream = doc["preview_stream"].to<JsonObject>();
+  previewStream["enabled"] = previewScaler->isRunning();
+  previewStream["wanted"] = previewScaler->wanted();
+  previewStream["width"] = scalerStats.width;
+  previewStream["height"] = scalerStats.height;
+  previewStream["interval_ms"] = previewScaler->getIntervalMs();
+  previewStream["offered"] = scalerStats.offered;
+  previewStream["busy"] = scalerStats.busy;
+  previewStream["encoded"] = scalerStats.encoded;
+  previewStream["failures"] = scalerStats.failures;
+  previewStream["oversize"] = scalerStats.oversize;
+  previewStream["last_scale_ms"] = scalerStats.lastScaleMs;
+  previewStream["max_scale_ms"] = scalerStats.maxScaleMs;
+  previewStream["last_bytes"] = scalerStats.lastBytes;
+  previewStream["last_source_bytes"] = scalerStats.lastSourceBytes;
+  previewStream["reduction"] = scalerStats.totalBytes > 0 ?
+                               round(10.0 * scalerStats.totalSourceBytes / scalerStats.totalBytes) / 10.0 : 0;
+  
+  // Snapshot push (streamImageToServer)
+  const SnapshotPusher::Stats& snapStats = snapshotPusher->getStats();
+  JsonObject snapshots = doc["snapshots"].to<JsonObject>();
+  snapshots["queued"] = snapshotPusher->getQueued();
+  snapshots["slots"] = snapshotPusher->getSlots();
+  snapshots["submitted"] = snapStats.submitted;
+  snapshots["sent"] = snapStats.sent;
+  snapshots["failed"] = snapStats.failed;
+  snapshots["dropped"] = snapStats.dropped;
+  snapshots["oversize"] = snapStats.oversize;
+  snapshots["heartbeats"] = snapStats.heartbeats;
+  snapshots["unchanged"] = snapshotsUnchanged;
+  snapshots["change_only"] = SNAPSHOT_CHANGE_ONLY;
+  snapshots["changed_cells"] = sceneChange->getChangedCells();
+  snapshots["change_check_us"] = sceneChange->getLastCheckUs();
+  snapshots["last_http_code"] = snapStats.lastHttpCode;
+  snapshots["last_latency_ms"] = snapStats.lastLatencyMs;
+  snapshots["avg_latency_ms"] = snapshotPusher->getAvgLatencyMs();
+  snapshots["max_latency_ms"] = snapStats.maxLatencyMs;
+  
+  // Motor ramp and WebSocket control channel
+  const MotorController::Stats& motorStats = motorController->getStats();
+  JsonObject motorDoc = doc["motor"].to<JsonObject>();
+  motorDoc["target"] = motorController->getTarget();
+  motorDoc["output"] = motorController->getOutput();
+  motorDoc["commands"] = motorStats.commands;
+  motorDoc["ws_commands"] = motorStats.wsCommands;
+  motorDoc["ws_sessions"] = motorStats.wsSessions;
+  motorDoc["bad_frames"] = motorStats.badFrames;
+  motorDoc["deadman_stops"] = motorStats.deadmanStops;
+  motorDoc["last_command_us"] = motorStats.lastCommandUs;
+  
+  // Motion trigger state
+  JsonObject motion = doc["motion"].to<JsonObject>();
+  motion["trigger_mode"] = motionTrigger;
+  motion["armed"] = videoRecorder->isMotionArmed();
+  motion["detected"] = motionDetector->isMotion();
+  motion["night"] = motionDetector->isNight();
+  motion["light_level"] = motionDetector->getLightLevel();
+  motion["changed_pixels"] = motionDetector->getChangedPixels();
+  motion["threshold"] = motionDetector->getMoveThreshold();
+  motion["triggers"] = videoRecorder->getMotionTriggers();
+  motion["check_us"] = motionDetector->getLastCheckUs();
+  motion["parse_failures"] = motionDetector->getParseFailures();
+  
   // Capture statistics
+  CaptureStats& captureStats = videoRecorder->getCaptureStats();
   JsonObject stats = doc["capture_stats"].to<JsonObject>();
   stats["total_captures"] = captureStats.totalCaptures;
   stats["failed_captures"] = captureStats.failedCaptures;
@@ -505,6 +925,211 @@ esp_err_t status_handler(httpd_req_t *req) {
   stats["consecutive_failures"] = captureStats.consecutiveFailures;
   stats["last_failure"] = captureStats.lastFailureTime;
   stats["degraded_mode"] = captureStats.degradedMode;
+  stats["ring_frames"] = videoRecorder->getQueuedFrames();
+  stats["ring_high_water"] = videoRecorder->getRingHighWaterFrames();
+  stats["ring_dropped"] = videoRecorder->getDroppedFrames();
+  stats["burst_active"] = videoRecorder->isBurst();
+  stats["burst_arena_kb"] = videoRecorder->getBurstArenaBytes() / 1024;
+  stats["burst_max_frames"] = videoRecorder->getBurstMaxFrames();
+  
+  // Run-time camera reconfiguration
+  const CameraReconfig::Stats& reconfigStats = cameraReconfig->getStats();
+  JsonObject reconfig = doc["camera_reconfig"].to<JsonObject>();
+  reconfig["max_framesize"] = cameraReconfig->getMaxFramesize();
+  reconfig["profile"] = CameraReconfig::profileName(cameraReconfig->getActiveProfile());
+  reconfig["switches"] = reconfigStats.switches;
+  reconfig["rejected"] = reconfigStats.rejected;
+  reconfig["failures"] = reconfigStats.failures;
+  reconfig["last_switch_ms"] = reconfigStats.lastSwitchMs;
+  reconfig["max_switch_ms"] = reconfigStats.maxSwitchMs;
+  reconfig["stale_frames"] = reconfigStats.lastStaleFrames;
+  
+  // Adaptive quality / rate controller
+  RateController& rate = videoRecorder->getRateController();
+  JsonObject rateStats = doc["rate_control"].to<JsonObject>();
+  rateStats["level"] = rate.getLevel();
+  rateStats["max_level"] = RateController::MAX_LEVEL;
+  rateStats["quality"] = rate.getQuality();
+  rateStats["framesize"] = rate.getFramesize();
+  rateStats["frame_delay_ms"] = rate.getFrameDelayMs();
+  rateStats["measured_fps"] = rate.getMeasuredFps();
+  rateStats["avg_capture_us"] = rate.getAvgCaptureUs();
+  rateStats["avg_write_us"] = rate.getAvgWriteUs();
+  rateStats["adjustments"] = rate.getAdjustments();
+  
+  // Frame spacing of the current / last recording (hardware timer paced)
+  const FrameTimingStats& timing = videoRecorder->getFrameTiming();
+  JsonObject timingStats = doc["frame_timing"].to<JsonObject>();
+  timingStats["nominal_us"] = timing.nominalUs;
+  timingStats["intervals"] = timing.intervals;
+  timingStats["min_interval_us"] = timing.minIntervalUs;
+  timingStats["avg_interval_us"] = timing.avgIntervalUs();
+  timingStats["max_interval_us"] = timing.maxIntervalUs;
+  timingStats["avg_jitter_us"] = timing.avgJitterUs();
+  timingStats["max_jitter_us"] = timing.maxJitterUs;
+  
+  // SD write latency histogram (coalesced block writes)
+  WriteLatencyStats& writeStats = videoRecorder->getWriteStats();
+  JsonObject sdWrites = doc["sd_writes"].to<JsonObject>();
+  sdWrites["buffer_bytes"] = videoRecorder->getWriteBufferBytes();
+  sdWrites["writes"] = writeStats.writes;
+  sdWrites["avg_us"] = writeStats.averageUs();
+  sdWrites["max_us"] = writeStats.maxUs;
+  sdWrites["kb_per_sec"] = writeStats.kbPerSec();
+  JsonArray histogram = sdWrites["histogram"].to<JsonArray>();
+  for (int i = 0; i < WriteLatencyStats::NUM_BUCKETS; i++) {
+    JsonObject bucket = histogram.add<JsonObject>();
+    if (i < WriteLatencyStats::NUM_BUCKETS - 1) {
+      bucket["lt_ms"] = WriteLatencyStats::bucketLimitUs[i] / 1000;
+    } else {
+      bucket["lt_ms"] = nullptr; // open ended
+    }
+    bucket["count"] = writeStats.buckets[i];
+  }
+  
+  // Background eviction - sync_evictions > 0 means recording starts had to wait for deletes
+  const CircularBuffer::Stats& evictStats = circularBuffer->getStats();
+  JsonObject eviction = doc["eviction"].to<JsonObject>();
+  eviction["headroom_mb"] = circularBuffer->getHeadroomMB();
+  eviction["free_mb"] = circularBuffer->getCachedFreeBytes() / (1024 * 1024);
+  eviction["evicted"] = evictStats.evicted;
+  eviction["evicted_mb"] = evictStats.evictedBytes / (1024 * 1024);
+  eviction["sync_evictions"] = evictStats.syncEvictions;
+  eviction["last_evict_ms"] = evictStats.lastEvictMs;
+  eviction["max_evict_ms"] = evictStats.maxEvictMs;
+  eviction["last_check_ms"] = evictStats.lastCheckMs;
+  eviction["max_check_ms"] = evictStats.maxCheckMs;
+  
+  // Pre-allocated clip files, write latency of pooled vs freshly allocated clips
+  const ClipPool::Stats& poolStats = clipPool->getStats();
+  JsonObject pool = doc["clip_pool"].to<JsonObject>();
+  pool["enabled"] = clipPool->isEnabled();
+  pool["file_mb"] = clipPool->getFileBytes() / (1024 * 1024);
+  pool["target_files"] = clipPool->getTargetFiles();
+  pool["ready_files"] = clipPool->getReadyFiles();
+  pool["growing_mb"] = clipPool->getGrowingBytes() / (1024 * 1024);
+  pool["files_prepared"] = poolStats.filesPrepared;
+  pool["last_step_ms"] = poolStats.lastStepMs;
+  pool["max_step_ms"] = poolStats.maxStepMs;
+  pool["pooled_clips"] = poolStats.pooledClips;
+  pool["unpooled_clips"] = poolStats.unpooledClips;
+  pool["overflow_clips"] = poolStats.overflowClips;
+  pool["truncate_failures"] = poolStats.truncateFailures;
+  const WriteLatencyStats* poolWrites[2] = { &poolStats.pooledWrites, &poolStats.unpooledWrites };
+  const char* poolWriteKeys[2] = { "pooled_writes", "unpooled_writes" };
+  for (int i = 0; i < 2; i++) {
+    JsonObject w = pool[poolWriteKeys[i]].to<JsonObject>();
+    w["writes"] = poolWrites[i]->writes;
+    w["avg_us"] = poolWrites[i]->averageUs();
+    w["max_us"] = poolWrites[i]->maxUs;
+    w["kb_per_sec"] = poolWrites[i]->kbPerSec();
+    JsonArray counts = w["histogram"].to<JsonArray>();
+    for (int b = 0; b < WriteLatencyStats::NUM_BUCKETS; b++) {
+      counts.add(poolWrites[i]->buckets[b]);
+    }
+  }
+  
+  // Per task CPU and stack usage (last sample)
+  static TaskSample taskSamples[TaskMonitor::MAX_TASKS];
+  int numTasks = taskMonitor->snapshot(taskSamples, TaskMonitor::MAX_TASKS);
+  JsonObject taskStats = doc["task_stats"].to<JsonObject>();
+  taskStats["sample_ms"] = taskMonitor->getSamplePeriodMs();
+  taskStats["cpu_stats"] = taskMonitor->hasRunTimeStats();
+  JsonArray idle = taskStats["idle_percent"].to<JsonArray>();
+  for (int i = 0; i < portNUM_PROCESSORS; i++) {
+    idle.add(taskMonitor->getIdlePercent(i));
+  }
+  JsonArray tasks = taskStats["tasks"].to<JsonArray>();
+  for (int i = 0; i < numTasks; i++) {
+    JsonObject task = tasks.add<JsonObject>();
+    task["name"] = (const char*)taskSamples[i].name;
+    task["core"] = taskSamples[i].core;
+    task["priority"] = taskSamples[i].priority;
+    task["state"] = String(taskSamples[i].state);
+    task["cpu_percent"] = taskSamples[i].cpuPercent;
+    task["stack_free"] = taskSamples[i].stackFree;
+  }
+  
+  // Snapshot cache effectiveness (as of this build)
+  JsonObject cache = doc["status_cache"].to<JsonObject>();
+  cache["refresh_ms"] = STATUS_REFRESH_MS;
+  cache["builds"] = statusSnapshot->getBuilds();
+  cache["served"] = statusSnapshot->getServed();
+  cache["not_modified"] = statusSnapshot->getNotModified();
+  cache["bytes"] = statusSnapshot->getLength();
+  
+  // Push channel for dashboards (/events)
+  const StatusEvents::Stats& eventStats = statusEvents->getStats();
+  JsonObject events = doc["status_events"].to<JsonObject>();
+  events["clients"] = statusEvents->getClientCount();
+  events["sessions"] = eventStats.sessions;
+  events["rejected"] = eventStats.rejected;
+  events["frames"] = eventStats.frames;
+  events["full_frames"] = eventStats.fullFrames;
+  events["changed_fields"] = eventStats.changedFields;
+  events["send_failures"] = eventStats.sendFailures;
+  
+  // Who holds memory, and how fragmented each heap is (size fb_count and stream buffers from this)
+  JsonObject heap = doc["heap"].to<JsonObject>();
+  JsonObject caps = heap["caps"].to<JsonObject>();
+  for (int i = 0; i < HeapAccounting::NUM_CAPS; i++) {
+    HeapCapInfo info;
+    if (!HeapAccounting::getCapInfo(i, info)) continue;
+    JsonObject cap = caps[info.name].to<JsonObject>();
+    cap["total"] = info.totalBytes;
+    cap["free"] = info.freeBytes;
+    cap["largest_free_block"] = info.largestBlock;
+    cap["min_free"] = info.minFree;
+    cap["fragmentation_pct"] = round(info.fragmentation * 10) / 10.0;
+  }
+  JsonObject tags = heap["tags"].to<JsonObject>();
+  for (HeapTag* tag = HeapAccounting::first(); tag; tag = HeapAccounting::nextTag(tag)) {
+    JsonObject t = tags[tag->getName()].to<JsonObject>();
+    t["internal"] = tag->getInternalBytes();
+    t["psram"] = tag->getPsramBytes();
+    t["peak"] = tag->getPeakBytes();
+    t["allocs"] = tag->getAllocs();
+    t["failures"] = tag->getFailures();
+  }
+  heap["failed_allocs"] = HeapAccounting::getFailedAllocs();
+  heap["last_failed_size"] = HeapAccounting::getLastFailedSize();
+  
+  // Catch-up transfers (/catchup)
+  const ClipCatchup::Stats& catchupStats = clipCatchup->getStats();
+  JsonObject catchup = doc["catchup"].to<JsonObject>();
+  catchup["active"] = clipCatchup->isActive();
+  catchup["sessions"] = catchupStats.sessions;
+  catchup["busy"] = catchupStats.busy;
+  catchup["clips"] = catchupStats.clips;
+  catchup["frames"] = catchupStats.frames;
+  catchup["failures"] = catchupStats.failures;
+  catchup["bytes"] = catchupStats.bytes;
+  catchup["last_session_ms"] = catchupStats.lastSessionMs;
+  catchup["last_kbps"] = catchupStats.lastKBps;
+  catchup["last_realtime_factor"] = round(catchupStats.lastRealtimeFactor * 10) / 10.0;
+  
+  // Idle power state and per-cycle wake latency / energy estimate
+  const PowerScheduler::Stats& powerStats = powerScheduler->getStats();
+  JsonObject power = doc["power"].to<JsonObject>();
+  power["mode"] = PowerScheduler::modeName(powerScheduler->getMode());
+  power["asleep"] = powerScheduler->isAsleep();
+  power["cycles"] = powerStats.cycles;
+  power["early_wakes"] = powerStats.earlyWakes;
+  power["standby_failures"] = powerStats.standbyFailures;
+  power["sleep_ms"] = powerStats.sleepMs;
+  power["awake_ms"] = powerStats.awakeMs;
+  uint64_t powerTotalMs = powerStats.sleepMs + powerStats.awakeMs;
+  power["sleep_pct"] = powerTotalMs > 0 ? round(1000.0 * powerStats.sleepMs / powerTotalMs) / 10.0 : 0;
+  power["last_sleep_ms"] = powerStats.lastSleepMs;
+  power["last_awake_ms"] = powerStats.lastAwakeMs;
+  power["last_camera_resume_ms"] = powerStats.lastCameraResumeMs;
+  power["max_camera_resume_ms"] = powerStats.maxCameraResumeMs;
+  power["last_network_resume_ms"] = powerStats.lastNetworkResumeMs;
+  power["max_network_resume_ms"] = powerStats.maxNetworkResumeMs;
+  power["last_wake_ms"] = powerStats.lastWakeMs;
+  power["max_wake_ms"] = powerStats.maxWakeMs;
+  power["last_cycle_mj"] = round(powerStats.lastCycleMj * 10) / 10.0;
+  power["total_j"] = round(powerStats.totalMj) / 1000.0;
   
   // Current settings
   JsonObject settings = doc["settings"].to<JsonObject>();
@@ -518,6 +1143,7 @@ esp_err_t status_handler(httpd_req_t *req) {
   settings["stream_interval"] = imageStreamInterval / 1000;
   settings["target_fps"] = targetFPS;
   settings["frame_delay_ms"] = frameDelayMs;
+  settings["motion_trigger"] = motionTrigger;
   
   // Resolution info
   sensor_t *s = esp_camera_sensor_get();
@@ -539,19 +1165,11 @@ esp_err_t status_handler(httpd_req_t *req) {
       default: doc["resolution"] = "Unknown"; break;
     }
   }
-  
-  String response;
-  serializeJson(doc, response);
-  
-  httpd_resp_set_type(req, "application/json");
-  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-  httpd_resp_send(req, response.c_str(), response.length());
-  
-  return ESP_OK;
 }
 
 esp_err_t control_handler(httpd_req_t *req) {
   char buf[100];
+  powerScheduler->wake(POWER_WAKE_HOLD_MS); // Sensor registers and reconfiguration need it out of standby
   int ret, remaining = req->content_len;
   
   if (remaining >= sizeof(buf)) {
@@ -568,7 +1186,7 @@ esp_err_t control_handler(httpd_req_t *req) {
   }
   buf[ret] = '\0';
   
-  JsonDocument doc;
+  JsonDocument doc(&jsonAllocator);
   deserializeJson(doc, buf);
   
   String var = doc["var"];
@@ -581,47 +1199,23 @@ esp_err_t control_handler(httpd_req_t *req) {
   sensor_t *s = esp_camera_sensor_get();
   int res = 0;
   
+  String framesizeError;
+  
   if (var == "framesize") {
-    if (s->pixformat == PIXFORMAT_JPEG) {
-      Serial.printf("Changing framesize from %d to %d\n", cameraSettings.framesize, val);
-      
-      // Test if we can get a frame before changing
-      camera_fb_t *test_fb = esp_camera_fb_get();
-      if (test_fb) {
-        Serial.printf("Pre-change test: Successfully captured frame (%d bytes)\n", test_fb->len);
-        esp_camera_fb_return(test_fb);
-      } else {
-        Serial.println("WARNING: Cannot capture frame BEFORE resolution change!");
-      }
-      
-            res = s->set_framesize(s, (framesize_t)val);
-       if (res == 0) {
-          cameraSettings.framesize = val;
-          Serial.println("Framesize change successful");
-          
-          // Test capture after change
-          delay(100);  // Give camera time to adjust
-          test_fb = esp_camera_fb_get();
-          if (test_fb) {
-            Serial.printf("Post-change test: Successfully captured frame at new resolution (%d bytes)\n", test_fb->len);
-            esp_camera_fb_return(test_fb);
-            
-            // Save settings to flash
-            saveSettings();
-          } else {
-            Serial.println("ERROR: Cannot capture frame AFTER resolution change!");
-            Serial.println("This resolution may not work with current buffer configuration!");
-            Serial.println("Consider restarting device to reinitialize camera with new settings.");
-            Serial.println("Settings NOT saved due to test failure.");
-          }
-        } else {
-          Serial.printf("ERROR: Framesize change failed with error: %d\n", res);
-        }
+    // Sensor-only change into the buffers allocated at boot - no camera re-init
+    Serial.printf("Changing framesize from %d to %d\n", cameraSettings.framesize, val);
+    if (setCameraFramesize(val, framesizeError)) {
+      Serial.printf("Framesize change successful (%u ms)\n", (unsigned)cameraReconfig->getStats().lastSwitchMs);
+      saveSettings();
+    } else {
+      res = -1;
+      Serial.printf("ERROR: Framesize change failed: %s\n", framesizeError.c_str());
     }
   } else if (var == "quality") {
     Serial.printf("Changing quality from %d to %d\n", cameraSettings.quality, val);
     res = s->set_quality(s, val);
     cameraSettings.quality = val;
+    cameraReconfig->setProfile(CameraReconfig::PROFILE_RECORDING, cameraSettings.framesize, cameraSettings.quality);
     if (res == 0) {
       Serial.println("Quality change successful");
     } else {
@@ -641,37 +1235,26 @@ esp_err_t control_handler(httpd_req_t *req) {
   Serial.printf("Memory after - Heap: %d, PSRAM: %d\n", ESP.getFreeHeap(), ESP.getFreePsram());
   Serial.println("===========================\n");
   
-  JsonDocument response;
+  JsonDocument response(&jsonAllocator);
   response["success"] = (res == 0);
   
   // Add detailed feedback for framesize changes
   if (var == "framesize") {
     if (res == 0) {
-      // Test if camera can capture at new resolution
-      camera_fb_t *test_fb = esp_camera_fb_get();
-      if (test_fb) {
-        response["message"] = "Framesize updated and tested OK";
-        response["test_passed"] = true;
-        response["frame_size_bytes"] = test_fb->len;
-        esp_camera_fb_return(test_fb);
-      } else {
-        response["message"] = "Framesize changed but capture test FAILED! Device restart recommended.";
-        response["test_passed"] = false;
-        response["warning"] = "Camera may not work at this resolution without restart";
-      }
+      const CameraReconfig::Stats& reconfig = cameraReconfig->getStats();
+      response["message"] = "Framesize updated and tested OK";
+      response["test_passed"] = true;
+      response["frame_size_bytes"] = reconfig.lastFrameBytes;
+      response["switch_ms"] = reconfig.lastSwitchMs;
     } else {
-      response["message"] = "Setting failed";
+      response["message"] = framesizeError;
+      response["test_passed"] = false;
     }
   } else {
     response["message"] = (res == 0) ? "Setting updated" : "Setting failed";
   }
   
-  String responseStr;
-  serializeJson(response, responseStr);
-  
-  httpd_resp_set_type(req, "application/json");
-  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-  httpd_resp_send(req, responseStr.c_str(), responseStr.length());
+  sendJsonResponse(req, response);
   
   return ESP_OK;
 }
@@ -679,6 +1262,33 @@ esp_err_t control_handler(httpd_req_t *req) {
 esp_err_t capture_handler(httpd_req_t *req) {
   camera_fb_t *fb = NULL;
   esp_err_t res = ESP_OK;
+  powerScheduler->wake(POWER_WAKE_HOLD_MS);
+  
+  // The derived preview by default (also while recording), ?full=1 for a full frame
+  char query[32];
+  char param[8];
+  bool full = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+              httpd_query_key_value(query, "full", param, sizeof(param)) == ESP_OK && atoi(param) != 0;
+  if (!full && previewScaler->isRunning()) {
+    // Never wait here (this task also serves /control and /motor/ws): send the newest
+    // preview however old, and demand() keeps the scaler warm for the next request
+    PreviewScaler::Frame frame;
+    previewScaler->demand(PREVIEW_WAIT_MS);
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    if (!previewScaler->acquireLatest(frame, UINT32_MAX)) {
+      httpd_resp_set_status(req, "503 Service Unavailable");
+      httpd_resp_set_hdr(req, "Retry-After", "1");
+      return httpd_resp_sendstr(req, "Preview starting");
+    }
+    char age[12];
+    snprintf(age, sizeof(age), "%lu", (unsigned long)(millis() - frame.timestampMs));
+    httpd_resp_set_type(req, "image/jpeg");
+    httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
+    httpd_resp_set_hdr(req, "X-Preview-Age-Ms", age);
+    res = httpd_resp_send(req, (const char *)frame.buf, frame.len);
+    previewScaler->releaseLatest();
+    return res;
+  }
   
   // Don't capture while recording (camera is busy)
   if (isRecording()) {
@@ -689,10 +1299,18 @@ esp_err_t capture_handler(httpd_req_t *req) {
     return ESP_OK;
   }
   
+  // Park the capture task (motion monitoring, previews) so this frame isn't taken from it
+  if (!videoRecorder->pauseCapture(CAPTURE_PAUSE_MS)) {
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "1");
+    return httpd_resp_sendstr(req, "Camera busy, try again");
+  }
   fb = esp_camera_fb_get();
   if (!fb) {
     // Suppress spam - camera busy
     // Serial.println("Camera capture failed");
+    videoRecorder->resumeCapture();
     httpd_resp_send_500(req);
     return ESP_FAIL;
   }
@@ -703,12 +1321,14 @@ esp_err_t capture_handler(httpd_req_t *req) {
   
   res = httpd_resp_send(req, (const char *)fb->buf, fb->len);
   esp_camera_fb_return(fb);
+  videoRecorder->resumeCapture();
   
   return res;
 }
 
 esp_err_t command_handler(httpd_req_t *req) {
   char buf[100];
+  powerScheduler->wake(POWER_WAKE_HOLD_MS); // Commands can start recordings and bursts
   int ret = httpd_req_recv(req, buf, sizeof(buf));
   if (ret <= 0) {
     httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid request");
@@ -716,7 +1336,7 @@ esp_err_t command_handler(httpd_req_t *req) {
   }
   buf[ret] = '\0';
   
-  JsonDocument doc;
+  JsonDocument doc(&jsonAllocator);
   deserializeJson(doc, buf);
   
   String command = doc["command"];
@@ -730,24 +1350,65 @@ esp_err_t command_handler(httpd_req_t *req) {
     message = "Recording started";
   } else if (command == "stop") {
     recording_active = false;
+    videoRecorder->stopRecording();
     success = true;
     message = "Recording stopped";
+  } else if (command == "clip_pool") {
+    // {"command": "clip_pool", "enabled": false} - compare against freshly allocated clips
+    if (doc["enabled"].is<bool>()) {
+      clipPool->setEnabled(doc["enabled"]);
+    }
+    success = true;
+    message = String("Clip pool ") + (clipPool->isEnabled() ? "enabled" : "disabled");
+  } else if (command == "upload_next") {
+    // {"command": "upload_next", "file": "/video_xxx.avi"} - send this clip before the rest of the queue
+    String file = doc["file"];
+    if (file.length() > 0 && !file.startsWith("/")) file = "/" + file;
+    if (file.length() > 0 && SD.exists(file.c_str())) {
+      videoUploader->addToUploadQueue(file, UPLOAD_PRIORITY_ALERT);
+      success = true;
+      message = "Upload prioritized: " + file;
+    } else {
+      message = "File not found: " + file;
+    }
+  } else if (command == "camera_profile") {
+    // {"command": "camera_profile", "profile": "preview"} - switch without re-initializing the camera
+    String profile = doc["profile"];
+    int id = CameraReconfig::profileFromName(profile);
+    if (id < 0) {
+      message = "Unknown profile: " + profile;
+    } else if (cameraReconfig->applyProfile((CameraReconfig::ProfileId)id, message)) {
+      const CameraReconfig::Profile& p = cameraReconfig->getProfile((CameraReconfig::ProfileId)id);
+      videoRecorder->setCameraBaseline(p.framesize, p.quality);
+      success = true;
+      message = "Camera profile " + profile + " (" + String(cameraReconfig->getStats().lastSwitchMs) + " ms)";
+    }
+  } else if (command == "burst") {
+    // {"command": "burst", "frames": 100} - full sensor rate into PSRAM, written to SD afterwards
+    int frames = doc["frames"].is<int>() ? doc["frames"].as<int>() : BURST_DEFAULT_FRAMES;
+    if (!videoRecorder->hasBurst()) {
+      message = "Burst capture unavailable (set BURST_ENABLED for a burst arena)";
+    } else {
+      burstRequestFrames = constrain(frames, 1, videoRecorder->getBurstMaxFrames());
+      success = true;
+      message = "Burst of " + String(burstRequestFrames) + " frames queued";
+    }
   } else if (command == "pause") {
     system_paused = !system_paused;
     success = true;
     message = system_paused ? "System paused" : "System resumed";
+  } else if (command == "heap_report") {
+    debugMemory("command");
+    success = true;
+    message = "Heap report printed to serial";
   } else if (command == "restart") {
     success = true;
     message = "Restarting system";
     // Send response first, then restart
-    JsonDocument response;
+    JsonDocument response(&jsonAllocator);
     response["success"] = success;
     response["message"] = message;
-    String responseStr;
-    serializeJson(response, responseStr);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-    httpd_resp_send(req, responseStr.c_str(), responseStr.length());
+    sendJsonResponse(req, response);
     
     delay(1000);
     ESP.restart();
@@ -898,8 +1559,9 @@ esp_err_t command_handler(httpd_req_t *req) {
       while (entry) {
         if (!entry.isDirectory()) {
           String fileName = entry.name();
-          // Delete .avi and .jpg files, but keep system files
-          if (fileName.endsWith(".avi") || fileName.endsWith(".jpg") || 
+          // Delete .avi (and their .thm sidecars and .pvw previews) and .jpg files, but keep system files
+          if (fileName.endsWith(".avi") || fileName.endsWith(THUMB_EXT) || fileName.endsWith(PREVIEW_EXT) ||
+              fileName.endsWith(".jpg") || 
               (fileName.startsWith("photo_") && fileName.endsWith(".jpg"))) {
             filesToDelete.push_back("/" + fileName);
           }
@@ -913,6 +1575,7 @@ esp_err_t command_handler(httpd_req_t *req) {
       for (const String& filePath : filesToDelete) {
         Serial.printf("Deleting: %s\n", filePath.c_str());
         if (SD.remove(filePath.c_str())) {
+          circularBuffer->removeVideoFile(filePath);
           deletedCount++;
         } else {
           Serial.printf("Failed to delete: %s\n", filePath.c_str());
@@ -934,16 +1597,11 @@ esp_err_t command_handler(httpd_req_t *req) {
     }
   }
   
-  JsonDocument response;
+  JsonDocument response(&jsonAllocator);
   response["success"] = success;
   response["message"] = message;
   
-  String responseStr;
-  serializeJson(response, responseStr);
-  
-  httpd_resp_set_type(req, "application/json");
-  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-  httpd_resp_send(req, responseStr.c_str(), responseStr.length());
+  sendJsonResponse(req, response);
   
   return ESP_OK;
 }
@@ -957,7 +1615,7 @@ esp_err_t recording_config_handler(httpd_req_t *req) {
   }
   buf[ret] = '\0';
   
-  JsonDocument doc;
+  JsonDocument doc(&jsonAllocator);
   deserializeJson(doc, buf);
   
   String setting = doc["setting"];
@@ -985,14 +1643,21 @@ esp_err_t recording_config_handler(httpd_req_t *req) {
     }
     if (value >= 0 && value <= 60) {
       success = true;
+      videoRecorder->setFrameDelayMs(frameDelayMs);
       Serial.printf("FPS set to %d (frame delay: %lu ms)\n", value, frameDelayMs);
     }
   } else if (setting == "frame_delay") {
     // Direct frame delay control in milliseconds
     frameDelayMs = value;
     targetFPS = (value > 0) ? (1000 / value) : 0;
+    videoRecorder->setFrameDelayMs(frameDelayMs);
     success = true;
     Serial.printf("Frame delay set to %lu ms (approx %lu FPS)\n", frameDelayMs, targetFPS);
+  } else if (setting == "trigger") {
+    // 1 = record on motion with pre-roll, 0 = record every capture interval
+    motionTrigger = (value != 0);
+    success = true;
+    Serial.printf("Recording trigger: %s\n", motionTrigger ? "motion" : "interval");
   }
   
   // Save settings to flash if successful
@@ -1000,16 +1665,11 @@ esp_err_t recording_config_handler(httpd_req_t *req) {
     saveSettings();
   }
   
-  JsonDocument response;
+  JsonDocument response(&jsonAllocator);
   response["success"] = success;
   response["message"] = success ? "Recording setting updated (saved to flash)" : "Invalid setting";
   
-  String responseStr;
-  serializeJson(response, responseStr);
-  
-  httpd_resp_set_type(req, "application/json");
-  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-  httpd_resp_send(req, responseStr.c_str(), responseStr.length());
+  sendJsonResponse(req, response);
   
   return ESP_OK;
 }
@@ -1023,7 +1683,7 @@ esp_err_t apply_settings_handler(httpd_req_t *req) {
   }
   buf[ret] = '\0';
   
-  JsonDocument doc;
+  JsonDocument doc(&jsonAllocator);
   deserializeJson(doc, buf);
   
   sensor_t *s = esp_camera_sensor_get();
@@ -1031,19 +1691,11 @@ esp_err_t apply_settings_handler(httpd_req_t *req) {
   String message = "Settings applied successfully";
   
   // Apply camera settings
-  if (doc["framesize"].is<int>()) {
-    int val = doc["framesize"];
-    if (s->set_framesize(s, (framesize_t)val) == 0) {
-      cameraSettings.framesize = val;
-    } else {
-      success = false;
-    }
-  }
-  
   if (doc["quality"].is<int>()) {
     int val = doc["quality"];
     if (s->set_quality(s, val) == 0) {
       cameraSettings.quality = val;
+      cameraReconfig->setProfile(CameraReconfig::PROFILE_RECORDING, cameraSettings.framesize, cameraSettings.quality);
     } else {
       success = false;
     }
@@ -1076,6 +1728,12 @@ esp_err_t apply_settings_handler(httpd_req_t *req) {
     }
   }
   
+  // Frame size last, the capture task is parked for the switch (no camera re-init)
+  String framesizeError;
+  if (doc["framesize"].is<int>() && !setCameraFramesize(doc["framesize"].as<int>(), framesizeError)) {
+    success = false;
+  }
+  
   // Apply recording settings
   if (doc["capture_interval"].is<int>()) {
     captureInterval = doc["capture_interval"].as<int>() * 1000;
@@ -1107,8 +1765,11 @@ esp_err_t apply_settings_handler(httpd_req_t *req) {
     Serial.printf("Frame delay set to %lu ms (approx %lu FPS)\n", frameDelayMs, targetFPS);
   }
   
+  videoRecorder->setFrameDelayMs(frameDelayMs);
+  
   if (!success) {
     message = "Some settings failed to apply";
+    if (framesizeError.length() > 0) message += ": " + framesizeError;
   } else {
     // Save all settings to flash if successful
     Serial.println("All settings applied successfully - saving to flash");
@@ -1116,53 +1777,322 @@ esp_err_t apply_settings_handler(httpd_req_t *req) {
     message += " (saved to flash)";
   }
   
-  JsonDocument response;
+  JsonDocument response(&jsonAllocator);
   response["success"] = success;
   response["message"] = message;
   
-  String responseStr;
-  serializeJson(response, responseStr);
-  
-  httpd_resp_set_type(req, "application/json");
-  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-  httpd_resp_send(req, responseStr.c_str(), responseStr.length());
+  sendJsonResponse(req, response);
   
   return ESP_OK;
 }
 
+// Batches JSON text into chunked response writes
+struct ChunkWriter {
+  httpd_req_t *req;
+  char buf[1024];
+  size_t len;
+  bool ok;
+};
+
+bool chunkFlush(ChunkWriter& w) {
+  if (w.ok && w.len > 0) {
+    w.ok = httpd_resp_send_chunk(w.req, w.buf, w.len) == ESP_OK;
+  }
+  w.len = 0;
+  return w.ok;
+}
+
+bool chunkPut(ChunkWriter& w, const char* data, size_t n) {
+  if (w.len + n > sizeof(w.buf) && !chunkFlush(w)) {
+    return false;
+  }
+  memcpy(w.buf + w.len, data, n);
+  w.len += n;
+  return w.ok;
+}
+
+bool chunkPrintf(ChunkWriter& w, const char* fmt, ...) {
+  char part[256];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(part, sizeof(part), fmt, args);
+  va_end(args);
+  n = min(n, (int)sizeof(part) - 1);
+  return chunkPut(w, part, n);
+}
+
+// A quoted JSON string, escaped as ArduinoJson would (file names can hold any byte but '/')
+bool chunkJsonString(ChunkWriter& w, const char* str) {
+  chunkPut(w, "\"", 1);
+  for (const char* c = str; *c && w.ok; c++) {
+    char esc[8];
+    switch (*c) {
+      case '"':  chunkPut(w, "\\\"", 2); break;
+      case '\\': chunkPut(w, "\\\\", 2); break;
+      case '\n': chunkPut(w, "\\n", 2); break;
+      case '\r': chunkPut(w, "\\r", 2); break;
+      case '\t': chunkPut(w, "\\t", 2); break;
+      default:
+        if ((uint8_t)*c < 0x20) {
+          snprintf(esc, sizeof(esc), "\\u%04x", (unsigned)(uint8_t)*c);
+          chunkPut(w, esc, 6);
+        } else {
+          chunkPut(w, c, 1);
+        }
+    }
+  }
+  return chunkPut(w, "\"", 1);
+}
+
+// Percent-encoded for a query value; the result is also safe inside a JSON string
+bool chunkUrlEncoded(ChunkWriter& w, const char* str) {
+  for (const char* c = str; *c && w.ok; c++) {
+    if (isalnum((uint8_t)*c) || strchr("-_.~", *c) != NULL) {
+      chunkPut(w, c, 1);
+    } else {
+      char esc[4];
+      snprintf(esc, sizeof(esc), "%%%02X", (unsigned)(uint8_t)*c);
+      chunkPut(w, esc, 3);
+    }
+  }
+  return w.ok;
+}
+
+// In place, for query values (httpd_query_key_value() leaves them encoded)
+void urlDecode(char* str) {
+  char* out = str;
+  for (const char* c = str; *c; c++) {
+    if (*c == '%' && isxdigit((uint8_t)c[1]) && isxdigit((uint8_t)c[2])) {
+      char hex[3] = {c[1], c[2], '\0'};
+      *out++ = (char)strtoul(hex, NULL, 16);
+      c += 2;
+    } else if (*c == '+') {
+      *out++ = ' ';
+    } else {
+      *out++ = *c;
+    }
+  }
+  *out = '\0';
+}
+
+// Newest first, one page per request from the storage index (no SD access):
+//   GET /files?limit=50&cursor=<next_cursor from the previous page, already percent-encoded>
 esp_err_t files_handler(httpd_req_t *req) {
-  JsonDocument doc;
-  JsonArray files = doc["files"].to<JsonArray>();
-  
-  File root = SD.open("/");
-  if (root) {
-    File file = root.openNextFile();
-    int count = 0;
-    while (file && count < 50) {
-      if (!file.isDirectory()) {
-        JsonObject fileObj = files.add<JsonObject>();
-        fileObj["name"] = String(file.name());
-        fileObj["size"] = file.size();
-        fileObj["path"] = "/" + String(file.name());
+  int limit = FILES_PAGE_DEFAULT;
+  VideoFileEntry cursor;
+  bool haveCursor = false;
+  
+  char query[320];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    char param[288];
+    if (httpd_query_key_value(query, "limit", param, sizeof(param)) == ESP_OK) {
+      limit = constrain(atoi(param), 1, FILES_PAGE_MAX);
+    }
+    // Cursor is "<mtime>_<file name>" of the last entry already returned
+    if (httpd_query_key_value(query, "cursor", param, sizeof(param)) == ESP_OK) {
+      urlDecode(param);
+      char* sep = strchr(param, '_');
+      if (sep == NULL || sep == param || sep[1] == '\0') {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid cursor");
+        return ESP_FAIL;
       }
-      file.close();
-      file = root.openNextFile();
-      count++;
+      *sep = '\0';
+      cursor.mtime = (time_t)strtoul(param, NULL, 10);
+      cursor.path = "/" + String(sep + 1);
+      cursor.size = 0;
+      haveCursor = true;
     }
-    root.close();
   }
   
-  doc["upload_queue_size"] = videoUploader->getQueueSize();
-  doc["total_files"] = files.size();
-  
-  String response;
-  serializeJson(doc, response);
+  std::vector<VideoFileEntry> page;
+  bool more = circularBuffer->getVideoFilesPage(haveCursor ? &cursor : NULL, limit, page);
   
   httpd_resp_set_type(req, "application/json");
   httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-  httpd_resp_send(req, response.c_str(), response.length());
   
-  return ESP_OK;
+  ChunkWriter w;
+  w.req = req;
+  w.len = 0;
+  w.ok = true;
+  chunkPrintf(w, "{\"files\":[");
+  for (size_t i = 0; i < page.size() && w.ok; i++) {
+    const VideoFileEntry& entry = page[i];
+    const char* name = entry.path.c_str() + (entry.path.startsWith("/") ? 1 : 0);
+    chunkPrintf(w, "%s{\"name\":", i ? "," : "");
+    chunkJsonString(w, name);
+    chunkPrintf(w, ",\"size\":%u,\"mtime\":%lu,\"path\":", (unsigned)entry.size, (unsigned long)entry.mtime);
+    chunkJsonString(w, entry.path.c_str());
+    chunkPrintf(w, ",\"thumb\":\"/thumb?file=");
+    chunkUrlEncoded(w, name);
+    chunkPrintf(w, "\"}");
+  }
+  chunkPrintf(w, "],\"count\":%u,\"total_files\":%d,\"upload_queue_size\":%d,\"next_cursor\":",
+              (unsigned)page.size(), circularBuffer->countVideoFiles(), videoUploader->getQueueSize());
+  if (more && !page.empty()) {
+    const VideoFileEntry& last = page.back();
+    chunkPrintf(w, "\"%lu_", (unsigned long)last.mtime);
+    chunkUrlEncoded(w, last.path.c_str() + (last.path.startsWith("/") ? 1 : 0));
+    chunkPrintf(w, "\"}");
+  } else {
+    chunkPrintf(w, "null}");
+  }
+  if (!chunkFlush(w)) {
+    return ESP_FAIL;
+  }
+  return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// Thumbnail i (default 0) of a clip as JPEG, or with ?info=1 the sidecar's JSON line
+// (frame count, FPS, motion score, per thumbnail frame number and AVI offset)
+esp_err_t thumb_handler(httpd_req_t *req) {
+  char query[320];
+  char name[288];
+  char param[16];
+  int index = 0;
+  bool info = false;
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+      httpd_query_key_value(query, "file", name, sizeof(name)) == ESP_OK) {
+    urlDecode(name); // /files sends thumb links percent-encoded
+  } else {
+    name[0] = '\0';
+  }
+  if (name[0] == '\0' || strchr(name, '/') != NULL) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing or invalid 'file' parameter");
+    return ESP_FAIL;
+  }
+  if (httpd_query_key_value(query, "i", param, sizeof(param)) == ESP_OK) {
+    index = atoi(param);
+  }
+  if (httpd_query_key_value(query, "info", param, sizeof(param)) == ESP_OK) {
+    info = atoi(param) != 0;
+  }
+  String aviPath = "/" + String(name);
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  
+  if (info) {
+    String json;
+    if (!ClipSidecar::readInfo(aviPath, json)) {
+      httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No sidecar for this clip");
+      return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json.c_str(), json.length());
+  }
+  
+  File file;
+  size_t len = 0;
+  if (!ClipSidecar::openThumb(aviPath, index, file, len)) {
+    if (file) file.close();
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such thumbnail");
+    return ESP_FAIL;
+  }
+  httpd_resp_set_type(req, "image/jpeg");
+  // A finished clip's sidecar never changes
+  httpd_resp_set_hdr(req, "Cache-Control", "max-age=86400");
+  
+  char buf[1024];
+  esp_err_t res = ESP_OK;
+  while (len > 0 && res == ESP_OK) {
+    size_t got = file.read((uint8_t*)buf, min(len, sizeof(buf)));
+    if (got == 0) {
+      res = ESP_FAIL;
+      break;
+    }
+    res = httpd_resp_send_chunk(req, buf, got);
+    len -= got;
+  }
+  file.close();
+  if (res != ESP_OK) {
+    return ESP_FAIL;
+  }
+  return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// Hands a catch-up chunk to the client once the SD writer ring is below the upload high-water mark
+// (runs in catchup_httpd's task, so waiting here only holds up the transfer)
+bool catchupChunk(void* ctx, const uint8_t* data, size_t len) {
+  // Same rule as background uploads: the recorder gets the card first
+  while (videoRecorder->isActive() && videoRecorder->getRingCapacityBytes() > 0 &&
+         videoRecorder->getQueuedBytes() * 100 >= videoRecorder->getRingCapacityBytes() * UPLOAD_RING_HIGH_WATER_PERCENT) {
+    vTaskDelay(pdMS_TO_TICKS(20));
+  }
+  return httpd_resp_send_chunk((httpd_req_t*)ctx, (const char*)data, len) == ESP_OK;
+}
+
+// Recorded frames without real-time pacing, in ClipCatchup's record framing:
+//   ?file=<clip>[&from=<frame>]                        one clip, optionally resuming at a frame
+//   ?since=<unix s>[&until=<unix s>][&limit=<clips>]   every frame in a time range, oldest clip first
+esp_err_t catchup_handler(httpd_req_t *req) {
+  char query[160];
+  char param[96];
+  std::vector<VideoFileEntry> clips;
+  uint32_t firstFrame = 0;
+  int64_t fromMs = 0;
+  int64_t toMs = 0;
+  bool more = false;
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing 'file' or 'since' parameter");
+    return ESP_FAIL;
+  }
+  if (httpd_query_key_value(query, "file", param, sizeof(param)) == ESP_OK) {
+    if (param[0] == '\0' || strchr(param, '/') != NULL) {
+      httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid 'file' parameter");
+      return ESP_FAIL;
+    }
+    VideoFileEntry entry;
+    entry.path = "/" + String(param);
+    File file = SD.open(entry.path.c_str(), FILE_READ);
+    if (!file) {
+      httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No such clip");
+      return ESP_FAIL;
+    }
+    entry.size = file.size();
+    entry.mtime = file.getLastWrite();
+    file.close();
+    clips.push_back(entry);
+    if (httpd_query_key_value(query, "from", param, sizeof(param)) == ESP_OK) {
+      firstFrame = strtoul(param, NULL, 10);
+    }
+  } else if (httpd_query_key_value(query, "since", param, sizeof(param)) == ESP_OK) {
+    time_t since = (time_t)strtoul(param, NULL, 10);
+    time_t until = 0;
+    int limit = CATCHUP_MAX_CLIPS;
+    if (httpd_query_key_value(query, "until", param, sizeof(param)) == ESP_OK) {
+      until = (time_t)strtoul(param, NULL, 10);
+    }
+    if (httpd_query_key_value(query, "limit", param, sizeof(param)) == ESP_OK) {
+      limit = constrain(atoi(param), 1, CATCHUP_MAX_CLIPS);
+    }
+    more = circularBuffer->getVideoFilesInRange(since, until, limit, clips);
+    fromMs = (int64_t)since * 1000;
+    toMs = (int64_t)until * 1000;
+  } else {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing 'file' or 'since' parameter");
+    return ESP_FAIL;
+  }
+  
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  if (!clipCatchup->startSession(catchupChunk, req)) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "5");
+    return httpd_resp_sendstr(req, "Catch-up already running");
+  }
+  powerScheduler->wake(POWER_WAKE_HOLD_MS); // Full speed radio for the transfer
+  httpd_resp_set_type(req, "application/octet-stream");
+  bool ok = true;
+  for (size_t i = 0; i < clips.size() && ok; i++) {
+    ok = clipCatchup->sendClip(clips[i].path, clips[i].mtime, firstFrame, fromMs, toMs);
+  }
+  ok = clipCatchup->finishSession(more) && ok;
+  const ClipCatchup::Stats& catchupStats = clipCatchup->getStats();
+  Serial.printf("Catch-up: %u clips, %u frames in %lu ms (%u KB/s, %.1fx real time)%s\n",
+                (unsigned)clips.size(), (unsigned)clipCatchup->getSessionFrames(),
+                (unsigned long)catchupStats.lastSessionMs, (unsigned)catchupStats.lastKBps,
+                catchupStats.lastRealtimeFactor, ok ? "" : " - client went away");
+  if (!ok) {
+    return ESP_FAIL;
+  }
+  return httpd_resp_send_chunk(req, NULL, 0);
 }
 
 esp_err_t motor_control_handler(httpd_req_t *req) {
@@ -1174,7 +2104,7 @@ esp_err_t motor_control_handler(httpd_req_t *req) {
   }
   buf[ret] = '\0';
   
-  JsonDocument doc;
+  JsonDocument doc(&jsonAllocator);
   deserializeJson(doc, buf);
   
   // Check if speed key exists and is valid
@@ -1188,22 +2118,17 @@ esp_err_t motor_control_handler(httpd_req_t *req) {
   // Clamp speed to -100 to 100 range
   speed = constrain(speed, -100, 100);
   
-  // Apply to motor (dead zone is handled in Motor class)
-  motor.setSpeed(speed);
+  // Ramped in by the motor task (dead zone is handled in Motor class)
+  motorController->command(speed);
   
   Serial.printf("Motor speed set to: %d\n", speed);
   
-  JsonDocument response;
+  JsonDocument response(&jsonAllocator);
   response["success"] = true;
   response["speed"] = speed;
   response["message"] = "Motor speed updated";
   
-  String responseStr;
-  serializeJson(response, responseStr);
-  
-  httpd_resp_set_type(req, "application/json");
-  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-  httpd_resp_send(req, responseStr.c_str(), responseStr.length());
+  sendJsonResponse(req, response);
   
   return ESP_OK;
 }
@@ -1216,58 +2141,141 @@ void streamImageToServer() {
   unsigned long now = millis();
   if (now - lastImageStream < imageStreamInterval) return;
   
-  // Don't stream while recording or uploading (camera/SD card busy)
-  if (isRecording() || videoUploader->getIsUploading()) {
+  // Derived preview: ask for one and send it once it is fresh (a later loop pass), recording or not
+  if (previewScaler->isRunning()) {
+    powerScheduler->wake();
+    previewScaler->demand(PREVIEW_WAIT_MS);
+    PreviewScaler::Frame frame;
+    if (!previewScaler->acquireLatest(frame, PREVIEW_MAX_AGE_MS)) {
+      return;
+    }
+    lastImageStream = now;
+    submitSnapshot(frame.buf, frame.len, now);
+    previewScaler->releaseLatest();
+    return;
+  }
+  lastImageStream = now;
+  
+  // Don't stream while recording (camera busy); background uploads don't touch the camera
+  if (isRecording()) {
     return;
   }
   
+  powerScheduler->wake();
   camera_fb_t *fb = esp_camera_fb_get();
   if (!fb) {
     // Don't spam error messages - camera might be busy
-    lastImageStream = now;
     return;
   }
-  
-  String uploadImageURL = String(WEB_SERVER_URL) + "/api/upload-image";
-  Serial.printf("DEBUG: Streaming image to: %s (size: %d bytes)\n", uploadImageURL.c_str(), fb->len);
-  
-  HTTPClient http;
-  http.setTimeout(10000); // 10 second timeout
-  
-  if (!http.begin(uploadImageURL)) {
-    Serial.printf("ERROR: Failed to begin HTTP connection to %s\n", uploadImageURL.c_str());
-    esp_camera_fb_return(fb);
+  submitSnapshot(fb->buf, fb->len, now);
+  esp_camera_fb_return(fb);
+}
+
+void submitSnapshot(const uint8_t* jpeg, size_t len, unsigned long now) {
+  // Static scene - tell the server its last image is still current instead of sending it again
+  bool keepAliveDue = now - lastSnapshotSent >= SNAPSHOT_KEEPALIVE_MS;
+  if (SNAPSHOT_CHANGE_ONLY && !keepAliveDue && !sceneChange->changed(jpeg, len)) {
+    snapshotsUnchanged++;
+    char beat[128];
+    int beatLen = snprintf(beat, sizeof(beat), "{\"unchanged_since_ms\":%lu,\"changed_cells\":%d,\"unchanged_count\":%lu}",
+                           now - lastSnapshotSent, sceneChange->getChangedCells(), (unsigned long)snapshotsUnchanged);
+    snapshotPusher->submitHeartbeat(beat, beatLen);
     return;
   }
   
-  http.addHeader("Content-Type", "image/jpeg");
-  http.addHeader("Content-Length", String(fb->len));
-  
-  int httpResponseCode = http.POST(fb->buf, fb->len);
-  
-  if (httpResponseCode > 0) {
-    Serial.printf("SUCCESS: Image streamed to server - Response: %d\n", httpResponseCode);
-    if (httpResponseCode == 200) {
-      String response = http.getString();
-      if (response.length() > 0 && response.length() < 200) {
-        Serial.printf("Server response: %s\n", response.c_str());
-      }
-    }
+  // Copied into a snapshot slot, the push task posts it - the caller's buffer is free on return
+  if (SNAPSHOT_CHANGE_ONLY && keepAliveDue) {
+    sceneChange->changed(jpeg, len); // Fresh reference for the frame being sent
+  }
+  if (snapshotPusher->submit(jpeg, len)) {
+    sceneChange->accept();
+    lastSnapshotSent = now;
   } else {
-    Serial.printf("ERROR: Image streaming failed - HTTP error code: %d\n", httpResponseCode);
-    Serial.printf("ERROR: HTTP error: %s\n", http.errorToString(httpResponseCode).c_str());
-    Serial.printf("DEBUG: Server URL: %s\n", WEB_SERVER_URL.c_str());
-    Serial.printf("DEBUG: WiFi connected: %s, RSSI: %d dBm\n", 
-                  wifi_connected ? "YES" : "NO", WiFi.RSSI());
+    Serial.printf("WARNING: Snapshot not queued (%u bytes)\n", (unsigned)len);
+  }
+}
+
+// Post-processing once the writer task has closed a recording
+void handleFinishedRecording(const RecordingResult& result) {
+  const String& filename = result.filename;
+  CaptureStats& captureStats = videoRecorder->getCaptureStats();
+  
+  // Report capture statistics
+  float totalFailRate = (captureStats.totalCaptures > 0) ? 
+                        (captureStats.failedCaptures * 100.0 / captureStats.totalCaptures) : 0;
+  Serial.printf("\n=== CAPTURE STATISTICS ===\n");
+  Serial.printf("This recording: %d successful, %d failed, %lu dropped (ring full)\n", 
+                result.frameCount, result.failedFrames, (unsigned long)result.droppedFrames);
+  Serial.printf("Session total: %lu successful, %lu failed (%.2f%% failure rate)\n",
+                captureStats.totalCaptures - captureStats.failedCaptures,
+                captureStats.failedCaptures, totalFailRate);
+  Serial.println("=========================\n");
+  Serial.printf("DEBUG: Total bytes written to file: %d\n", result.bytesWritten);
+  Serial.printf("Frame jitter: avg %lu us, max %lu us\n",
+                (unsigned long)result.avgJitterUs, (unsigned long)result.maxJitterUs);
+  
+  Serial.printf("*** RECORDING %s *** Frames: %d, Duration: %lu ms, %.1f FPS, File: %s\n", 
+                result.aborted ? "ABORTED" : "COMPLETED",
+                result.frameCount, result.durationMs, result.actualFPS, filename.c_str());
+  
+  // Print updated storage info
+  Serial.println("DEBUG: Checking file on SD card...");
+  
+  uint64_t fileSize = 0;
+  File file = SD.open(filename, FILE_READ);
+  if (file) {
+    fileSize = file.size();
+    time_t fileTime = file.getLastWrite();
+    file.close();
+    circularBuffer->addVideoFile(filename, fileSize, fileTime);
+    Serial.printf("✓ Video saved successfully!\n");
+    Serial.printf("  File: %s\n", filename.c_str());
+    Serial.printf("  Size: %.2f MB (%llu bytes)\n", fileSize / (1024.0 * 1024.0), fileSize);
+    Serial.printf("  Frames: %d\n", result.frameCount);
+    Serial.printf("  Duration: %lu ms\n", result.durationMs);
+  } else {
+    Serial.printf("\n*** CRITICAL ERROR ***\n");
+    Serial.printf("File was written (%d bytes) but cannot be read back!\n", result.bytesWritten);
+    Serial.printf("Filename: %s\n", filename.c_str());
+    Serial.println("This indicates SD card corruption or hardware issue!");
+    Serial.println("Try:");
+    Serial.println("  1. Remove and reinsert SD card");
+    Serial.println("  2. Reformat SD card (FAT32)");
+    Serial.println("  3. Try a different SD card");
+    Serial.println("******************\n");
+    
+    // Try to verify SD card is still accessible
+    uint64_t cardTotal = SD.totalBytes();
+    if (cardTotal == 0) {
+      Serial.println("FATAL: SD card no longer accessible!");
+    }
   }
   
-  http.end();
-  esp_camera_fb_return(fb);
-  lastImageStream = now;
+  // Increment and print video count
+  imageCount++;
+  Serial.printf("=== RECORDING SUMMARY ===\n");
+  Serial.printf("Total videos recorded this session: %d\n", imageCount);
+  Serial.printf("========================\n\n");
+  
+  // Add new video to the upload journal - it is persisted, so also while WiFi is down
+  Serial.printf("DEBUG: Adding to upload queue: %s\n", filename.c_str());
+  videoUploader->addToUploadQueue(String(filename),
+                                  (result.motionTriggered || result.burst) ? UPLOAD_PRIORITY_MOTION
+                                                                           : UPLOAD_PRIORITY_SCHEDULED);
+  Serial.printf("DEBUG: Upload queue size now: %d\n", videoUploader->getQueueSize());
+
+  // Resume uploads now that recording is complete
+  if (videoUploader->getUploadPaused()) {
+    Serial.println("DEBUG: Resuming uploads after recording completion");
+    videoUploader->resumeUpload();
+  }
+
+  Serial.printf("Next video will begin in %d seconds\n", captureInterval/1000);
 }
 
 void setup() {
   Serial.begin(115200);
+  HeapAccounting::begin(); // Count failed allocations from the first one
   
   Serial.println("\n\n=== ENHANCED EDGE MONITOR STARTING ===");
   Serial.printf("Compile Time: %s %s\n", __DATE__, __TIME__);
@@ -1294,174 +2302,103 @@ void setup() {
   // Initialize LED first (minimal power consumption)
   Serial.println("DEBUG: Initializing LED...");
   pinMode(LED_PIN, OUTPUT);
-  
-  // STAGE 1 LED PATTERN: Single long blink (2 seconds ON)
-  digitalWrite(LED_PIN, HIGH);
-  Serial.println("LED STAGE 1: Single long blink - Basic init starting");
-  delay(2000);
   digitalWrite(LED_PIN, LOW);
-  delay(500);
   
   // Initialize motor
   Serial.println("DEBUG: Initializing motor...");
   motor.init();
+  motorController = new MotorController(&motor, MOTOR_ACCEL_PER_SEC, MOTOR_DEADMAN_MS);
+  motorController->begin();
   Serial.println("DEBUG: Motor initialized successfully");
   
   // Initialize basic class instances (no hardware access yet)
   Serial.println("DEBUG: Initializing class instances...");
   circularBuffer = new CircularBuffer(MAX_STORAGE_MB, MIN_FREE_SPACE_MB, ENABLE_CIRCULAR_BUFFER);
+  circularBuffer->setHeadroomMB(STORAGE_HEADROOM_MB);
   videoUploader = new VideoUploader(UPLOAD_URL, UPLOAD_API_KEY, UPLOAD_CHUNK_SIZE, 
                                    UPLOAD_TIMEOUT_MS, MAX_UPLOAD_RETRIES, 
                                    ENABLE_HTTPS, DELETE_AFTER_UPLOAD);
-  Serial.println("DEBUG: Class instances initialized successfully");
-  
-  // STAGE 1 SUCCESS: Two quick blinks
-  Serial.println("LED STAGE 1: Two quick blinks - Basic init SUCCESS");
-  for (int i = 0; i < 2; i++) {
-    digitalWrite(LED_PIN, HIGH);
-    delay(200);
-    digitalWrite(LED_PIN, LOW);
-    delay(200);
+  connectionManager = new ConnectionManager();
+  bootSequencer = new BootSequencer();
+  liveStream = new LiveStream(LIVE_STREAM_FRAME_BYTES, LIVE_STREAM_INTERVAL_MS);
+  previewScaler = new PreviewScaler(PREVIEW_STREAM_MAX_WIDTH, PREVIEW_STREAM_QUALITY, PREVIEW_STREAM_INTERVAL_MS,
+                                    LIVE_STREAM_FRAME_BYTES, PREVIEW_STREAM_FRAME_BYTES);
+  previewScaler->setLiveStream(liveStream);
+  snapshotPusher = new SnapshotPusher(SNAPSHOT_SLOTS, SNAPSHOT_MAX_BYTES, SNAPSHOT_TIMEOUT_MS);
+  sceneChange = new SceneChange(SNAPSHOT_CELL_THRESHOLD, SNAPSHOT_MIN_CHANGED_CELLS);
+  videoRecorder = new VideoRecorder(FRAME_RING_BYTES, FRAME_RING_SLOTS, MAX_CLIP_FRAMES,
+                                    SD_WRITE_BUFFER_BYTES, SD_WRITE_ALIGN_BYTES);
+  motionDetector = new MotionDetector();
+  cameraReconfig = new CameraReconfig(CAMERA_MAX_FRAMESIZE);
+  cameraReconfig->setRecorder(videoRecorder);
+  cameraReconfig->setProfile(CameraReconfig::PROFILE_PREVIEW, PREVIEW_PROFILE_FRAMESIZE, PREVIEW_PROFILE_QUALITY);
+  cameraReconfig->setProfile(CameraReconfig::PROFILE_RECORDING, cameraSettings.framesize, cameraSettings.quality);
+  taskMonitor = new TaskMonitor(TASK_MONITOR_PERIOD_MS);
+  statusSnapshot = new StatusSnapshot(STATUS_SNAPSHOT_BYTES, STATUS_REFRESH_MS);
+  statusEvents = new StatusEvents(STATUS_EVENTS_HEARTBEAT_MS);
+  clipPool = new ClipPool(CLIP_POOL_FILE_MB, CLIP_POOL_FILES, CLIP_POOL_STEP_MB, MIN_FREE_SPACE_MB);
+  clipPool->setEnabled(CLIP_POOL_ENABLED);
+  clipCatchup = new ClipCatchup(CATCHUP_BUFFER_BYTES);
+  if (!clipCatchup->begin()) {
+    Serial.println("WARNING: /catchup unavailable (no memory for its buffer)");
   }
-  
-  // Power stabilization delay with heartbeat pattern
-  Serial.println("DEBUG: Waiting for power stabilization (3 seconds)...");
-  for (int i = 3; i > 0; i--) {
-    Serial.printf("Power stabilization: %d seconds remaining\n", i);
-    // Heartbeat pattern during stabilization
-    digitalWrite(LED_PIN, HIGH);
-    delay(100);
-    digitalWrite(LED_PIN, LOW);
-    delay(100);
-    digitalWrite(LED_PIN, HIGH);
-    delay(100);
-    digitalWrite(LED_PIN, LOW);
-    delay(700); // Rest of the second
+  powerScheduler = new PowerScheduler(POWER_MIN_SLEEP_MS, POWER_MAX_SLICE_MS, PWDN_GPIO_NUM);
+  powerScheduler->setCurrentModel(POWER_ACTIVE_MA, POWER_LIGHT_SLEEP_MA, POWER_MODEM_SLEEP_MA, POWER_SUPPLY_V);
+  if (!statusSnapshot->begin()) {
+    Serial.println("WARNING: /status unavailable (no memory for snapshot buffer)");
   }
-  
-  // === STAGE 2: SD CARD INITIALIZATION ===
-  Serial.println("\nSTAGE 2: SD card initialization...");
-  
-  // STAGE 2 LED PATTERN: Three quick blinks (SD init starting)
-  Serial.println("LED STAGE 2: Three quick blinks - SD init starting");
-  for (int i = 0; i < 3; i++) {
-    digitalWrite(LED_PIN, HIGH);
-    delay(150);
-    digitalWrite(LED_PIN, LOW);
-    delay(150);
+  videoRecorder->setLiveStream(liveStream);
+  videoRecorder->setClipPool(clipPool);
+  videoRecorder->setMotionTrigger(motionDetector, PRE_ROLL_FRAMES, MOTION_POST_ROLL_MS, MOTION_CHECKS_PER_SEC);
+  if (BURST_ENABLED) {
+    videoRecorder->setBurstArena(BURST_ARENA_BYTES, BURST_MAX_FRAMES);
   }
-  delay(500);
-  
-  // Initialize the SD card (moderate power consumption)
-  Serial.println("DEBUG: Initializing SD card...");
-  if (!SD.begin(SD_PIN_CS)) {
-    Serial.println("ERROR: SD card initialization failed!");
-    sd_sign = false;
-    // STAGE 2 FAILURE: Rapid blinking (10 times)
-    Serial.println("LED STAGE 2: Rapid blinking - SD FAILED");
-    for (int i = 0; i < 10; i++) {
-      digitalWrite(LED_PIN, HIGH);
-      delay(100);
-      digitalWrite(LED_PIN, LOW);
-      delay(100);
-    }
-  } else {
-    uint8_t cardType = SD.cardType();
-    if(cardType == CARD_NONE){
-      Serial.println("ERROR: No SD card attached");
-      sd_sign = false;
-      // STAGE 2 FAILURE: Rapid blinking (10 times)
-      Serial.println("LED STAGE 2: Rapid blinking - No SD card");
-      for (int i = 0; i < 10; i++) {
-        digitalWrite(LED_PIN, HIGH);
-        delay(100);
-        digitalWrite(LED_PIN, LOW);
-        delay(100);
-      }
+  videoUploader->setStorageIndex(circularBuffer);
+  videoUploader->setConnectionManager(connectionManager);
+  videoUploader->setRecorder(videoRecorder);
+  videoUploader->setRecordingRateKBps(UPLOAD_RATE_WHILE_RECORDING_KBPS);
+  videoUploader->setRingHighWaterPercent(UPLOAD_RING_HIGH_WATER_PERCENT);
+  if (PREVIEW_UPLOAD_ENABLED) {
+    clipPreview = new ClipPreview(PREVIEW_FRAME_STEP, PREVIEW_SCALE, PREVIEW_QUALITY, PREVIEW_FORMAT);
+    if (clipPreview->begin()) {
+      videoUploader->setClipPreview(clipPreview, PREVIEW_FULL_ON_REQUEST);
     } else {
-      Serial.print("SD Card Type: ");
-      if(cardType == CARD_MMC){
-        Serial.println("MMC");
-      } else if(cardType == CARD_SD){
-        Serial.println("SDSC");
-      } else if(cardType == CARD_SDHC){
-        Serial.println("SDHC");
-      } else {
-        Serial.println("UNKNOWN");
-      }
-      sd_sign = true;
-      Serial.println("DEBUG: SD card initialized successfully");
-      
-      // STAGE 2 SUCCESS: Four quick blinks
-      Serial.println("LED STAGE 2: Four quick blinks - SD SUCCESS");
-      for (int i = 0; i < 4; i++) {
-        digitalWrite(LED_PIN, HIGH);
-        delay(200);
-        digitalWrite(LED_PIN, LOW);
-        delay(200);
-      }
+      Serial.println("WARNING: No memory for clip previews, uploading full clips only");
     }
   }
+  Serial.println("DEBUG: Class instances initialized successfully");
   
-  // Short delay after SD initialization
-  Serial.println("DEBUG: SD initialization complete, brief pause...");
-  delay(500);
-  
-  // === STAGE 3: WIFI INITIALIZATION ===
-  Serial.println("\nSTAGE 3: WiFi initialization...");
-  
-  // STAGE 3 LED PATTERN: Five quick blinks (WiFi init starting)
-  Serial.println("LED STAGE 3: Five quick blinks - WiFi init starting");
-  for (int i = 0; i < 5; i++) {
-    digitalWrite(LED_PIN, HIGH);
-    delay(120);
-    digitalWrite(LED_PIN, LOW);
-    delay(120);
-  }
-  delay(500);
-  
-  // Connect to WiFi (high power consumption during connection)
-  Serial.println("DEBUG: Starting WiFi connection (HIGH POWER STAGE)...");
-  connectToWiFi();
-  
-  // WiFi result LED feedback
-  if (wifi_connected) {
-    // STAGE 3 SUCCESS: Six quick blinks
-    Serial.println("LED STAGE 3: Six quick blinks - WiFi SUCCESS");
-    for (int i = 0; i < 6; i++) {
-      digitalWrite(LED_PIN, HIGH);
-      delay(200);
-      digitalWrite(LED_PIN, LOW);
-      delay(200);
-    }
+  // === STAGE 2: PARALLEL BOOT ===
+  // Camera and recorder come up first, with the SD scan beside them; the network attaches
+  // once the camera's power peak is over and NTP / uploads follow it (see BootSequencer)
+  Serial.println("\nSTAGE 2: Parallel boot (camera, storage, network)...");
+  delay(BOOT_POWER_SETTLE_MS);
+  bootCameraPhase = bootSequencer->addPhase("camera", bootCamera, 0, BOOT_CAMERA_STACK);
+  bootStoragePhase = bootSequencer->addPhase("storage", bootStorage, 0, BOOT_STORAGE_STACK);
+  bootNetworkPhase = bootSequencer->addPhase("network", bootNetwork,
+                                             BootSequencer::bit(bootCameraPhase), BOOT_NETWORK_STACK);
+  bootSequencer->addPhase("time", bootTime, BootSequencer::bit(bootNetworkPhase));
+  bootSequencer->addPhase("uploads", bootUploads,
+                          BootSequencer::bit(bootStoragePhase) | BootSequencer::bit(bootNetworkPhase));
+  bootSequencer->start();
+  
+  // loop() starts as soon as the camera is up, the rest finishes behind it
+  bootSequencer->waitFor(BootSequencer::bit(bootCameraPhase));
+  recording_active = true; // Start recording by default (once the card is mounted)
+  if (motionTrigger) {
+    Serial.println("Video recording will begin on motion");
   } else {
-    // STAGE 3 FAILURE: Very rapid blinking (15 times)
-    Serial.println("LED STAGE 3: Very rapid blinking - WiFi FAILED");
-    for (int i = 0; i < 15; i++) {
-      digitalWrite(LED_PIN, HIGH);
-      delay(80);
-      digitalWrite(LED_PIN, LOW);
-      delay(80);
-    }
+    Serial.printf("Video recording will begin in %d seconds\n", captureInterval/1000);
   }
-  
-  // Short delay after WiFi
-  Serial.println("DEBUG: WiFi initialization complete, brief pause...");
-  delay(1000);
-  
-  // === STAGE 4: CAMERA INITIALIZATION (Highest Power) ===
-  Serial.println("\nSTAGE 4: Camera initialization (final stage)...");
-  
-  // STAGE 4 LED PATTERN: Seven quick blinks (Camera init starting - HIGHEST POWER!)
-  Serial.println("LED STAGE 4: Seven quick blinks - Camera init starting (HIGHEST POWER!)");
-  for (int i = 0; i < 7; i++) {
-    digitalWrite(LED_PIN, HIGH);
-    delay(100);
-    digitalWrite(LED_PIN, LOW);
-    delay(100);
+  if (POWER_SAVE_ENABLED && !powerScheduler->begin(connectionManager, IP, SERVER_PORT, ENABLE_HTTPS)) {
+    Serial.println("WARNING: Power scheduler unavailable, staying at full power");
   }
-  delay(1000); // Longer pause before highest power operation
-  
+  Serial.printf("=== SETUP COMPLETE after %lu ms (camera %s) ===\n\n",
+                millis(), camera_sign ? "OK" : "FAILED");
+}
+
+// Boot phases - each runs in its own task, see setup()
+bool bootCamera() {
   // Initialize the camera with optimized settings (highest power consumption)
   Serial.println("DEBUG: Initializing camera (CRITICAL POWER MOMENT)...");
   size_t psramSize = ESP.getFreePsram();
@@ -1500,7 +2437,6 @@ void setup() {
   // Auto-configure based on PSRAM availability and resolution
   if (hasPSRAM) {
     config.fb_location = CAMERA_FB_IN_PSRAM;
-    config.frame_size = (framesize_t)cameraSettings.framesize;
     
     // Adaptive settings for high resolution - Multi-tier system
     if (cameraSettings.framesize >= FRAMESIZE_UXGA) {
@@ -1560,6 +2496,15 @@ void setup() {
       config.fb_count = NORMAL_FB_COUNT;
       config.jpeg_quality = cameraSettings.quality;
     }
+
+    // Buffers are sized for the largest frame size allowed, so apply_settings and the
+    // preview / recording profiles can switch sizes later without re-initializing the camera
+    config.frame_size = (framesize_t)CAMERA_MAX_FRAMESIZE;
+    if (CAMERA_MAX_FRAMESIZE >= HIGH_RES_THRESHOLD) {
+      config.fb_count = max(config.fb_count, HIGH_RES_FB_COUNT);
+    }
+    Serial.printf("Frame buffers sized for framesize %d (%d buffers), sensor starts at %d\n",
+                  CAMERA_MAX_FRAMESIZE, config.fb_count, cameraSettings.framesize);
   } else {
     Serial.println("No PSRAM - using QQVGA with DRAM");
     config.frame_size = FRAMESIZE_QQVGA;  // 160x120 (small but works)
@@ -1568,16 +2513,19 @@ void setup() {
     config.fb_count = 1;
     cameraSettings.framesize = FRAMESIZE_QQVGA;
     cameraSettings.quality = 20;
+    cameraReconfig->setMaxFramesize(FRAMESIZE_QQVGA);
   }
   
-  config.grab_mode = CAMERA_GRAB_WHEN_EMPTY;
+  // With more than one buffer the driver keeps filling them and hands out the newest,
+  // which is what lets a burst run at the sensor's own rate
+  config.grab_mode = config.fb_count > 1 ? CAMERA_GRAB_LATEST : CAMERA_GRAB_WHEN_EMPTY;
 
-  // Check if we have enough PSRAM for the requested configuration
-  if (hasPSRAM && cameraSettings.framesize >= HIGH_RES_THRESHOLD) {
+  // Check if we have enough PSRAM for the buffers (sized for the maximum frame size)
+  if (hasPSRAM && config.frame_size >= HIGH_RES_THRESHOLD) {
     size_t estimatedFrameSize = 0;
     
     // Enhanced estimation accounting for quality settings
-    switch(cameraSettings.framesize) {
+    switch(config.frame_size) {
       case FRAMESIZE_SVGA: 
         estimatedFrameSize = 80000; 
         break;   // ~80 KB
@@ -1608,7 +2556,7 @@ void setup() {
     }
     
     // Different safety margins for different resolutions
-    float safetyMultiplier = (cameraSettings.framesize >= FRAMESIZE_UXGA) ? 2.5 : 2.0;
+    float safetyMultiplier = (config.frame_size >= FRAMESIZE_UXGA) ? 2.5 : 2.0;
     size_t requiredPSRAM = (size_t)(estimatedFrameSize * config.fb_count * safetyMultiplier);
     
     Serial.printf("Estimated PSRAM required: %d KB (have: %d KB)\n", 
@@ -1623,7 +2571,7 @@ void setup() {
                     requiredPSRAM/1024, psramSize/1024, (requiredPSRAM-psramSize)/1024);
       Serial.println("Consider:");
       Serial.println("  1. Using lower resolution");
-      if (cameraSettings.framesize >= FRAMESIZE_UXGA) {
+      if (config.frame_size >= FRAMESIZE_UXGA) {
         Serial.println("  2. For UXGA: Quality MUST be 35-40");
         Serial.println("  3. For UXGA: FPS should be 5-10 maximum");
         Serial.println("  4. Try SXGA or HD instead");
@@ -1638,6 +2586,9 @@ void setup() {
     }
   }
 
+  // The driver's frame buffers and DMA descriptors are charged to the camera tag
+  uint32_t internalBeforeCamera = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+  uint32_t psramBeforeCamera = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
   esp_err_t err = esp_camera_init(&config);
   if (err != ESP_OK) {
     Serial.printf("\n*** CAMERA INITIALIZATION FAILED ***\n");
@@ -1650,15 +2601,7 @@ void setup() {
     Serial.println("************************************\n");
     
     camera_sign = false;
-    
-    // CAMERA FAILURE LED: Alternating pattern (5 cycles)
-    Serial.println("LED STAGE 4: Alternating pattern - Camera FAILURE");
-    for (int i = 0; i < 5; i++) {
-      digitalWrite(LED_PIN, HIGH);
-      delay(500);
-      digitalWrite(LED_PIN, LOW);
-      delay(500);
-    }
+
   } else {
     Serial.println("✓ Camera initialized successfully!");
     Serial.printf("  Resolution: %dx%d (%s)\n", 
@@ -1668,26 +2611,103 @@ void setup() {
     Serial.printf("  JPEG Quality: %d\n", config.jpeg_quality);
     Serial.printf("  Frame Buffer: %s\n", hasPSRAM ? "PSRAM" : "DRAM");
     camera_sign = true;
+    heapCamera.add((int32_t)(internalBeforeCamera - heap_caps_get_free_size(MALLOC_CAP_INTERNAL)), false);
+    heapCamera.add((int32_t)(psramBeforeCamera - heap_caps_get_free_size(MALLOC_CAP_SPIRAM)), true);
+
+    // Sensor down to the configured size, the buffers stay at the maximum
+    sensor_t *s = esp_camera_sensor_get();
+    if (s && config.frame_size != (framesize_t)cameraSettings.framesize &&
+        s->set_framesize(s, (framesize_t)cameraSettings.framesize) != 0) {
+      Serial.printf("WARNING: Could not set framesize %d, staying at %d\n", cameraSettings.framesize, config.frame_size);
+      cameraSettings.framesize = config.frame_size;
+    }
     
-    // CAMERA SUCCESS: Ten quick blinks
-    Serial.println("LED STAGE 4: Ten quick blinks - Camera SUCCESS");
-    for (int i = 0; i < 10; i++) {
-      digitalWrite(LED_PIN, HIGH);
-      delay(120);
-      digitalWrite(LED_PIN, LOW);
-      delay(120);
+    // Start capture and SD writer tasks (frame ring is allocated after the camera buffers)
+    if (!videoRecorder->begin()) {
+      Serial.println("ERROR: Recording pipeline failed to start!");
+      camera_sign = false;
+    }
+    if (!liveStream->begin()) {
+      Serial.println("WARNING: Live stream unavailable (no PSRAM for frame buffers)");
+    }
+    if (PREVIEW_STREAM_ENABLED && previewScaler->begin()) {
+      videoRecorder->setPreview(previewScaler);
+    } else if (PREVIEW_STREAM_ENABLED) {
+      Serial.println("WARNING: Derived preview unavailable, live view and snapshots send full frames");
+    }
+    if (!snapshotPusher->begin(connectionManager, IP, SERVER_PORT, "/api/upload-image", "/api/upload-image/unchanged")) {
+      Serial.println("WARNING: Snapshot push unavailable (no PSRAM for snapshot slots)");
+    }
+    if (!sceneChange->begin()) {
+      Serial.println("WARNING: Snapshot change check unavailable, every snapshot is sent");
+    }
+    if (!motionDetector->begin()) {
+      Serial.println("WARNING: Motion detector unavailable, recording every capture interval");
+      motionTrigger = false;
+    }
+    if (!taskMonitor->begin()) {
+      Serial.println("WARNING: Task monitor unavailable");
     }
   }
   
   Serial.printf("Post-camera init - Free Heap: %d, Free PSRAM: %d\n", ESP.getFreeHeap(), ESP.getFreePsram());
+  return camera_sign;
+}
+
+bool bootStorage() {
+  // Initialize the SD card (moderate power consumption)
+  Serial.println("DEBUG: Initializing SD card...");
+  if (!SD.begin(SD_PIN_CS)) {
+    Serial.println("ERROR: SD card initialization failed!");
+    sd_sign = false;
+  } else {
+    uint8_t cardType = SD.cardType();
+    if(cardType == CARD_NONE){
+      Serial.println("ERROR: No SD card attached");
+      sd_sign = false;
+    } else {
+      Serial.print("SD Card Type: ");
+      if(cardType == CARD_MMC){
+        Serial.println("MMC");
+      } else if(cardType == CARD_SD){
+        Serial.println("SDSC");
+      } else if(cardType == CARD_SDHC){
+        Serial.println("SDHC");
+      } else {
+        Serial.println("UNKNOWN");
+      }
+      Serial.println("DEBUG: SD card initialized successfully");
+      
+      // One directory walk at boot, afterwards the index is updated incrementally
+      circularBuffer->rebuildIndex();
+      clipPool->begin();
+      // Replays the upload journal, before the first clip is queued
+      videoUploader->populateUploadQueue();
+      // loop() and the recorder only touch the card from here on
+      sd_sign = true;
+    }
+  }
   
-  // === FINAL STAGE: SYSTEM READY ===
-  Serial.println("\nFINAL STAGE: System ready...");
-  
-  // LED off to show normal operation
-  digitalWrite(LED_PIN, LOW);
+  return sd_sign;
+}
 
-  // Print system status
+bool bootNetwork() {
+  // Connect, mDNS and the HTTP server; NTP is its own phase
+  Serial.println("DEBUG: Starting WiFi connection (HIGH POWER STAGE)...");
+  connectToWiFi(false);
+  return wifi_connected;
+}
+
+bool bootTime() {
+  return wifi_connected && setupTime();
+}
+
+bool bootUploads() {
+  // Uploads run in their own task from here on, alongside recording
+  return videoUploader->begin();
+}
+
+void printSystemStatus() {
   Serial.println("\n=== ENHANCED SYSTEM STATUS ===");
   Serial.printf("Camera Status: %s\n", camera_sign ? "OK" : "FAILED");
   Serial.printf("SD Card Status: %s\n", sd_sign ? "OK" : "FAILED");
@@ -1695,60 +2715,16 @@ void setup() {
   Serial.printf("HTTP Server: %s\n", camera_httpd ? "RUNNING" : "FAILED");
   Serial.printf("System Ready: %s\n", (camera_sign && sd_sign && wifi_connected) ? "YES" : "NO");
   Serial.printf("Device IP: %s\n", wifi_connected ? WiFi.localIP().toString().c_str() : "N/A");
-  Serial.printf("Free Heap: %d bytes\n", ESP.getFreeHeap());
-  Serial.printf("Free PSRAM: %d bytes\n", ESP.getFreePsram());
+  Serial.printf("Boot Time: %lu ms\n", bootSequencer->getCompleteMs());
+  for (int i = 0; i < bootSequencer->getPhaseCount(); i++) {
+    const BootSequencer::Phase& phase = bootSequencer->getPhase(i);
+    Serial.printf("  %-8s %-6s %5lu - %5lu ms\n", phase.name, BootSequencer::stateName(phase.state),
+                  phase.startMs, phase.endMs);
+  }
+  debugMemory("boot");
   Serial.println("===============================\n");
-
-  recording_active = true; // Start recording by default
-  Serial.printf("Video recording will begin in %d seconds\n", captureInterval/1000);
-  Serial.println("=== STAGGERED SETUP COMPLETE ===\n");
-  
-  // === FINAL STATUS LED PATTERNS ===
-  if (camera_sign && sd_sign && wifi_connected) {
-    Serial.println("SUCCESS: All systems operational!");
-    // FINAL SUCCESS: Celebration pattern (fast alternating 12 times)
-    Serial.println("LED FINAL: Celebration pattern - ALL SYSTEMS SUCCESS!");
-    for (int i = 0; i < 12; i++) {
-      digitalWrite(LED_PIN, i % 2);
-      delay(100);
-    }
-    // End with LED OFF for normal operation
-    digitalWrite(LED_PIN, LOW);
-  } else {
+  if (!(camera_sign && sd_sign && wifi_connected)) {
     Serial.println("WARNING: Some systems failed to initialize");
-    Serial.printf("Status - Camera: %s, SD: %s, WiFi: %s\n", 
-                  camera_sign ? "OK" : "FAIL", 
-                  sd_sign ? "OK" : "FAIL", 
-                  wifi_connected ? "OK" : "FAIL");
-    
-    // PARTIAL FAILURE: SOS pattern (3 short, 3 long, 3 short)
-    Serial.println("LED FINAL: SOS pattern - PARTIAL SYSTEM FAILURE");
-    // 3 short
-    for (int i = 0; i < 3; i++) {
-      digitalWrite(LED_PIN, HIGH);
-      delay(200);
-      digitalWrite(LED_PIN, LOW);
-      delay(200);
-    }
-    delay(300);
-    // 3 long
-    for (int i = 0; i < 3; i++) {
-      digitalWrite(LED_PIN, HIGH);
-      delay(600);
-      digitalWrite(LED_PIN, LOW);
-      delay(200);
-    }
-    delay(300);
-    // 3 short
-    for (int i = 0; i < 3; i++) {
-      digitalWrite(LED_PIN, HIGH);
-      delay(200);
-      digitalWrite(LED_PIN, LOW);
-      delay(200);
-    }
-    
-    // End with LED OFF
-    digitalWrite(LED_PIN, LOW);
   }
 }
 
@@ -1756,8 +2732,15 @@ void loop() {
   static unsigned long loopCount = 0;
   loopCount++;
   
-  // Check WiFi connection periodically
-  if (millis() - lastWiFiCheck >= STATUS_CHECK_MS) {
+  // System summary once the last boot phase is done
+  static bool bootReported = false;
+  if (!bootReported && bootSequencer->isComplete()) {
+    printSystemStatus();
+    bootReported = true;
+  }
+  
+  // Check WiFi connection periodically (the boot network phase makes the first attempt)
+  if (bootSequencer->isDone(bootNetworkPhase) && millis() - lastWiFiCheck >= STATUS_CHECK_MS) {
     checkWiFiConnection();
     lastWiFiCheck = millis();
   }
@@ -1768,6 +2751,32 @@ void loop() {
   // Stream image to server periodically
   streamImageToServer();
   
+  // Collect recordings finished by the writer task
+  RecordingResult finished;
+  if (videoRecorder->takeFinishedRecording(finished)) {
+    handleFinishedRecording(finished);
+    statusSnapshot->markDirty();
+  }
+  
+  // Top up the clip pool and evict old clips while the card isn't taking a recording
+  if (sd_sign && !isRecording()) {
+    clipPool->maintain();
+    if (circularBuffer->maintain(&videoUploader->getJournal(), videoUploader->getCurrentUploadFile())) {
+      statusSnapshot->markDirty();
+    }
+  }
+  
+  // Rebuild the cached /status body when something changed or it went stale
+  if (statusSnapshot->needsRefresh(millis())) {
+    JsonDocument status(&jsonAllocator);
+    build_status(status);
+    statusSnapshot->publish(status);
+    statusEvents->update(status);
+  }
+  
+  // Background uploads follow the same conditions recording does
+  videoUploader->setBackgroundEnabled(!system_paused && recording_active && sd_sign);
+  
   // Skip recording operations if system is paused
   if (system_paused) {
     delay(100);
@@ -1800,25 +2809,41 @@ void loop() {
     lastDebugPrint = millis();
   }
   
+  // Motion watching runs in the capture task whenever a motion clip could be recorded
+  bool motionMode = motionTrigger && recording_active && camera_sign && sd_sign;
+  videoRecorder->setMotionArmed(motionMode);
+  
   // Recording logic - only if recording is active and system is ready
   if (recording_active && camera_sign && sd_sign) {
     unsigned long now = millis();
     unsigned long timeSinceLastCapture = now - lastCaptureTime;
+    bool triggered = motionMode ? videoRecorder->takeMotionTrigger()
+                                : (timeSinceLastCapture >= captureInterval && !isRecording());
+    // A requested burst goes next, motion bursts only when configured
+    int burstFrames = 0;
+    if (burstRequestFrames > 0 && !isRecording()) {
+      burstFrames = burstRequestFrames;
+      burstRequestFrames = 0;
+      triggered = true;
+    } else if (triggered && motionMode && BURST_ON_MOTION && videoRecorder->hasBurst()) {
+      burstFrames = BURST_DEFAULT_FRAMES;
+    }
 
-    if (timeSinceLastCapture >= captureInterval) {
-      Serial.printf("*** RECORDING TRIGGER *** Now: %lu, LastCapture: %lu, TimeSince: %lu\n",
+    if (triggered) {
+      powerScheduler->wake();
+      Serial.printf("*** RECORDING TRIGGER (%s) *** Now: %lu, LastCapture: %lu, TimeSince: %lu\n",
+                    burstFrames > 0 ? "burst" : motionMode ? "motion" : "interval",
                     now, lastCaptureTime, timeSinceLastCapture);
       
-      // Pause any ongoing upload
-      if (videoUploader->getIsUploading()) {
-        videoUploader->pauseUpload();
-        Serial.println("DEBUG: Pausing upload for recording");
-      }
+      // Uploads keep running - the upload task's governor yields to the recorder
       
-      // Check storage and perform cleanup if necessary
+      // Check storage and perform cleanup if necessary (never evicting the file being uploaded)
       Serial.println("DEBUG: Checking storage space...");
-      if (!circularBuffer->checkAndManageStorage(videoUploader->getUploadQueue())) {
+      bool storageOk = circularBuffer->checkAndManageStorage(&videoUploader->getJournal(),
+                                                             videoUploader->getCurrentUploadFile());
+      if (!storageOk) {
         Serial.println("ERROR: Insufficient storage space available! Skipping recording.");
+        videoRecorder->cancelMotionTrigger();
         lastCaptureTime = now;
         return;
       }
@@ -1827,9 +2852,10 @@ void loop() {
       String filename = getTimestampFilename();
       Serial.printf("DEBUG: Opening file for writing: %s\n", filename.c_str());
       
-      // Get current camera settings before recording
+      // Get current camera settings before recording (not for motion clips - the
+      // armed capture task has been grabbing frames all along and every ms counts)
       sensor_t *s = esp_camera_sensor_get();
-      if (s) {
+      if (s && !motionMode && burstFrames == 0) {
         Serial.printf("\n=== CAMERA STATUS BEFORE RECORDING ===\n");
         Serial.printf("Current framesize: %d\n", s->status.framesize);
         Serial.printf("Current quality: %d\n", s->status.quality);
@@ -1856,175 +2882,54 @@ void loop() {
         Serial.println("=====================================\n");
       }
       
-      videoFile = SD.open(filename, FILE_WRITE);
-      if (!videoFile) {
-        Serial.printf("ERROR: Failed to open video file: %s\n", filename.c_str());
+      // Rate controller steps down from / back up to the configured settings
+      videoRecorder->setCameraBaseline(cameraSettings.framesize, cameraSettings.quality);
+      bool started = burstFrames > 0
+          ? videoRecorder->startBurst(filename, burstFrames, BURST_MAX_DURATION_MS)
+          : videoRecorder->startRecording(filename, captureDuration, frameDelayMs);
+      if (!started) {
+        Serial.printf("ERROR: Failed to start recording: %s\n", filename.c_str());
+        videoRecorder->cancelMotionTrigger();
         return;
       }
-      Serial.printf("*** RECORDING STARTED *** File: %s\n", filename.c_str());
       lastCaptureTime = now;
-      
-      // Start capturing video frames
-      int frame_count = 0;
-      int failed_frames = 0;
-      size_t totalBytesWritten = 0;
-      unsigned long recordingStartTime = millis();
-      unsigned long lastFrameTime = millis();
-      
-      while ((millis() - lastCaptureTime) < captureDuration) {
-        // FPS control: delay between frames if configured
-        if (frameDelayMs > 0) {
-          unsigned long timeSinceLastFrame = millis() - lastFrameTime;
-          if (timeSinceLastFrame < frameDelayMs) {
-            delay(frameDelayMs - timeSinceLastFrame);
-          }
-        }
-        lastFrameTime = millis();
-        
-        camera_fb_t *fb = esp_camera_fb_get();
-        captureStats.totalCaptures++;
-        
-        if (!fb) {
-          // Track capture failure
-          captureStats.failedCaptures++;
-          captureStats.consecutiveFailures++;
-          captureStats.lastFailureTime = millis();
-          failed_frames++;
-          
-          Serial.printf("ERROR: Failed to get framebuffer! (consecutive: %d, total: %lu/%lu)\n", 
-                        captureStats.consecutiveFailures, 
-                        captureStats.failedCaptures, 
-                        captureStats.totalCaptures);
-          Serial.printf("DEBUG: Free Heap: %d, Free PSRAM: %d\n", ESP.getFreeHeap(), ESP.getFreePsram());
-          
-          // If too many consecutive failures, abort recording
-          if (captureStats.consecutiveFailures >= 10) {
-            Serial.println("CRITICAL: Too many consecutive capture failures - aborting recording!");
-            Serial.println("This likely means:");
-            Serial.println("  1. Resolution too high for available memory");
-            Serial.println("  2. PSRAM fragmentation");
-            Serial.println("  3. Insufficient power supply");
-            Serial.println("Consider lowering resolution or JPEG quality.");
-            break;
-          }
-          
-          delay(10);  // Brief delay before retry
-          continue;
-        }
-        
-        // Successful capture - reset consecutive failure counter
-        captureStats.consecutiveFailures = 0;
-        
-        size_t bytesWritten = videoFile.write(fb->buf, fb->len);
-        if (bytesWritten != fb->len) {
-          Serial.printf("ERROR: Write failed! Expected %d bytes, wrote %d bytes\n", fb->len, bytesWritten);
-        }
-        totalBytesWritten += bytesWritten;
-        
-        esp_camera_fb_return(fb);
-        frame_count += 1;
-
-        // Flush to SD card every 10 frames to ensure data is written
-        if (frame_count % 10 == 0) {
-          videoFile.flush();
-          delay(1);  // Yields CPU to other tasks including HTTP server
-        }
-        
-        // Progress indicator every 50 frames with detailed stats
-        if (frame_count % 50 == 0) {
-          float failRate = (failed_frames > 0) ? (failed_frames * 100.0 / (frame_count + failed_frames)) : 0;
-          Serial.printf("Recording progress: %d frames (%d failed, %.1f%% fail rate), %lu ms elapsed, %d bytes written\n", 
-                        frame_count, failed_frames, failRate, millis() - recordingStartTime, totalBytesWritten);
-          Serial.printf("  Memory: Heap=%d, PSRAM=%d\n", ESP.getFreeHeap(), ESP.getFreePsram());
-        }
-      }
-      
-      // Report capture statistics
-      float totalFailRate = (captureStats.totalCaptures > 0) ? 
-                            (captureStats.failedCaptures * 100.0 / captureStats.totalCaptures) : 0;
-      Serial.printf("\n=== CAPTURE STATISTICS ===\n");
-      Serial.printf("This recording: %d successful, %d failed\n", frame_count, failed_frames);
-      Serial.printf("Session total: %lu successful, %lu failed (%.2f%% failure rate)\n",
-                    captureStats.totalCaptures - captureStats.failedCaptures,
-                    captureStats.failedCaptures, totalFailRate);
-      Serial.println("=========================\n");
-      
-      // Flush and close the video file
-      Serial.println("DEBUG: Flushing file buffer...");
-      videoFile.flush();
-      Serial.println("DEBUG: Closing file...");
-      videoFile.close();
-      Serial.printf("DEBUG: Total bytes written to file: %d\n", totalBytesWritten);
-      
-      // Critical: Give filesystem time to update before checking
-      Serial.println("DEBUG: Waiting for filesystem to sync...");
-      delay(500);
-      
-      unsigned long recordingDuration = millis() - recordingStartTime;
-      Serial.printf("*** RECORDING COMPLETED *** Frames: %d, Duration: %lu ms, File: %s\n", 
-                    frame_count, recordingDuration, filename.c_str());
-      
-      // Print updated storage info
-      Serial.println("DEBUG: Checking file on SD card...");
-      
-      uint64_t fileSize = 0;
-      File file = SD.open(filename, FILE_READ);
-      if (file) {
-        fileSize = file.size();
-        file.close();
-        Serial.printf("✓ Video saved successfully!\n");
-        Serial.printf("  File: %s\n", filename.c_str());
-        Serial.printf("  Size: %.2f MB (%llu bytes)\n", fileSize / (1024.0 * 1024.0), fileSize);
-        Serial.printf("  Frames: %d\n", frame_count);
-        Serial.printf("  Duration: %lu ms\n", recordingDuration);
-      } else {
-        Serial.printf("\n*** CRITICAL ERROR ***\n");
-        Serial.printf("File was written (%d bytes) but cannot be read back!\n", totalBytesWritten);
-        Serial.printf("Filename: %s\n", filename.c_str());
-        Serial.println("This indicates SD card corruption or hardware issue!");
-        Serial.println("Try:");
-        Serial.println("  1. Remove and reinsert SD card");
-        Serial.println("  2. Reformat SD card (FAT32)");
-        Serial.println("  3. Try a different SD card");
-        Serial.println("******************\n");
-        
-        // Try to verify SD card is still accessible
-        uint64_t cardTotal = SD.totalBytes();
-        if (cardTotal == 0) {
-          Serial.println("FATAL: SD card no longer accessible!");
-        }
-      }
-      
-      // Increment and print video count
-      imageCount++;
-      Serial.printf("=== RECORDING SUMMARY ===\n");
-      Serial.printf("Total videos recorded this session: %d\n", imageCount);
-      Serial.printf("========================\n\n");
-      
-      // Add new video to upload queue
-      if (wifi_connected) {
-        Serial.printf("DEBUG: Adding to upload queue: %s\n", filename.c_str());
-        videoUploader->addToUploadQueue(String(filename));
-        Serial.printf("DEBUG: Upload queue size now: %d\n", videoUploader->getQueueSize());
-      } else {
-        Serial.println("DEBUG: WiFi not connected, video not added to upload queue");
-      }
-
-      // Resume uploads now that recording is complete
-      if (videoUploader->getUploadPaused()) {
-        Serial.println("DEBUG: Resuming uploads after recording completion");
-        videoUploader->resumeUpload();
-      }
-
-      Serial.printf("Next video will begin in %d seconds\n", captureInterval/1000);
-    }
-    
-    // Process upload queue when not recording and WiFi is connected
-    if (wifi_connected && !isRecording()) {
-      videoUploader->processUploadQueue();
+      statusSnapshot->markDirty();
+      // Capture and SD writes now run in the recorder tasks - loop() keeps serving
+      // WiFi checks, LED updates and the HTTP API until the recording completes
     }
   }
   
+  // Nothing due for a while - idle in the low-power state until just before the next window
+  unsigned long idleMs = powerIdleMs(motionMode);
+  if (idleMs >= powerScheduler->getMinSleepMs() + POWER_WAKE_LEAD_MS && powerScheduler->canSleep()) {
+    powerScheduler->sleep(idleMs - POWER_WAKE_LEAD_MS);
+    return;
+  }
+  powerScheduler->wake();
+  
   // Small delay to prevent excessive CPU usage
   delay(10);   // Reduced from 100ms for better HTTP responsiveness
+}
+
+// ms until loop() next needs the camera or the radio at full power, 0 while anything is in progress
+unsigned long powerIdleMs(bool motionMode) {
+  if (!recording_active || !camera_sign || !sd_sign || isRecording() || motionMode || burstRequestFrames > 0) {
+    return 0;
+  }
+  if (liveStream->hasViewer() || previewScaler->wanted() ||
+      motorController->getTarget() != 0 || motorController->getOutput() != 0) {
+    return 0;
+  }
+  if (videoUploader->getIsUploading() || clipCatchup->isActive() ||
+      (wifi_connected && videoUploader->getQueueSize() > 0)) {
+    return 0;
+  }
+  unsigned long now = millis();
+  unsigned long sinceCapture = now - lastCaptureTime;
+  unsigned long idleMs = sinceCapture >= captureInterval ? 0 : captureInterval - sinceCapture;
+  if (wifi_connected && streamingEnabled) {
+    unsigned long sinceStream = now - lastImageStream;
+    idleMs = min(idleMs, sinceStream >= imageStreamInterval ? 0 : imageStreamInterval - sinceStream);
+  }
+  return idleMs;
 } 
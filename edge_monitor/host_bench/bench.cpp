@@ -0,0 +1,528 @@
+/*
+ * Host benchmark and replay harness for the portable edge_monitor modules
+ *
+ * Replays recorded clips (RIFF AVI or a raw MJPEG stream such as
+ * record_video/recordings/video9.avi) through MotionDetector, writes them
+ * back out through AviWriter + SDWriteBuffer, builds a ClipPreview from
+ * the result, streams it through ClipCatchup, drives CircularBuffer
+ * eviction with UploadJournal, and frames a clip with MultipartForm. Timings go to stdout as one JSON
+ * object, ending with the peak bytes each heap tag reached; module
+ * logging goes to stderr (only with -v).
+ *
+ *   ./edge_bench [-v] [-n passes] [-d sdroot] clip.avi [clip.avi ...]
+ */
+
+#include "Arduino.h"
+#include "SD.h"
+#include "esp_timer.h"
+#include "../MotionDetector.h"
+#include "../AviWriter.h"
+#include "../SDWriteBuffer.h"
+#include "../ClipPreview.h"
+#include "../ClipCatchup.h"
+#include "../CircularBuffer.h"
+#include "../UploadJournal.h"
+#include "../MultipartForm.h"
+#include "../HeapAccounting.h"
+#include <vector>
+#include <string>
+#include <unistd.h>
+
+struct Frame {
+    const uint8_t* data;
+    size_t len;
+};
+
+struct Clip {
+    std::string path;
+    std::vector<uint8_t> bytes;
+    std::vector<Frame> frames;
+    int width = 0;
+    int height = 0;
+};
+
+static int passes = 3;
+static const size_t STORAGE_FILES = 200;
+static const size_t STORAGE_FILE_BYTES = 64 * 1024;
+static const long STORAGE_MAX_MB = 8;
+static const size_t UPLOAD_BLOCK = 32 * 1024; // UPLOAD_CHUNK_SIZE
+
+// ===== JSON output =====
+
+static bool firstField = true;
+
+static void jsonKey(const char* key) {
+    printf("%s\"%s\":", firstField ? "" : ",", key);
+    firstField = false;
+}
+static void jsonOpen(const char* key) {
+    if (key) jsonKey(key); else if (!firstField) printf(",");
+    printf("{");
+    firstField = true;
+}
+static void jsonClose() {
+    printf("}");
+    firstField = false;
+}
+static void jsonOpenArray(const char* key) {
+    jsonKey(key);
+    printf("[");
+    firstField = true;
+}
+static void jsonCloseArray() {
+    printf("]");
+    firstField = false;
+}
+static void jsonNum(const char* key, double v) { jsonKey(key); printf("%.6g", v); }
+static void jsonInt(const char* key, long long v) { jsonKey(key); printf("%lld", v); }
+static void jsonStr(const char* key, const char* v) { jsonKey(key); printf("\"%s\"", v); }
+
+// Latency summary of per-operation samples in microseconds
+static void jsonLatency(const char* key, std::vector<uint32_t> samples) {
+    jsonOpen(key);
+    jsonInt("samples", samples.size());
+    if (!samples.empty()) {
+        std::sort(samples.begin(), samples.end());
+        uint64_t total = 0;
+        for (uint32_t s : samples) total += s;
+        size_t n = samples.size();
+        jsonNum("mean_us", (double)total / n);
+        jsonInt("min_us", samples[0]);
+        jsonInt("p50_us", samples[n / 2]);
+        jsonInt("p95_us", samples[(n * 95) / 100]);
+        jsonInt("p99_us", samples[(n * 99) / 100]);
+        jsonInt("max_us", samples[n - 1]);
+    }
+    jsonClose();
+}
+
+static double mbPerSec(uint64_t bytes, int64_t us) {
+    return us > 0 ? bytes / (1024.0 * 1024.0) / (us / 1e6) : 0;
+}
+
+// ===== Clip loading =====
+
+static size_t jpegEnd(const uint8_t* p, size_t avail) {
+    // Length of the JPEG starting at p: walk marker segments to SOS, then the entropy data to EOI
+    if (avail < 4 || p[0] != 0xFF || p[1] != 0xD8) {
+        return 0;
+    }
+    size_t i = 2;
+    while (i + 4 <= avail) {
+        if (p[i] != 0xFF) {
+            return 0;
+        }
+        uint8_t marker = p[i + 1];
+        size_t segLen = (p[i + 2] << 8) | p[i + 3];
+        i += 2 + segLen;
+        if (marker == 0xDA) {
+            break;
+        }
+    }
+    for (; i + 1 < avail; i++) {
+        if (p[i] == 0xFF && p[i + 1] != 0x00 && (p[i + 1] < 0xD0 || p[i + 1] > 0xD7)) {
+            return p[i + 1] == 0xD9 ? i + 2 : 0;
+        }
+    }
+    return 0;
+}
+
+static bool loadClip(Clip& clip) {
+    FILE* f = fopen(clip.path.c_str(), "rb");
+    if (!f) {
+        fprintf(stderr, "Cannot open %s\n", clip.path.c_str());
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    clip.bytes.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    size_t got = fread(clip.bytes.data(), 1, clip.bytes.size(), f);
+    fclose(f);
+    const uint8_t* d = clip.bytes.data();
+    size_t size = got;
+
+    if (size > 12 && memcmp(d, "RIFF", 4) == 0 && memcmp(d + 8, "AVI ", 4) == 0) {
+        // Frames are the 00dc chunks inside the movi list
+        for (size_t i = 12; i + 8 <= size;) {
+            uint32_t len;
+            memcpy(&len, d + i + 4, 4);
+            if (memcmp(d + i, "LIST", 4) == 0 && i + 12 <= size && memcmp(d + i + 8, "movi", 4) == 0) {
+                size_t end = min(size, i + 8 + (size_t)len);
+                for (size_t j = i + 12; j + 8 <= end;) {
+                    uint32_t chunkLen;
+                    memcpy(&chunkLen, d + j + 4, 4);
+                    if (memcmp(d + j, "00dc", 4) == 0 && chunkLen > 0 && j + 8 + chunkLen <= end) {
+                        clip.frames.push_back({d + j + 8, chunkLen});
+                    }
+                    j += 8 + ((chunkLen + 1) & ~1u);
+                }
+                break;
+            }
+            i += (memcmp(d + i, "RIFF", 4) == 0 || memcmp(d + i, "LIST", 4) == 0) ? 12 : 8 + ((len + 1) & ~1u);
+        }
+    } else {
+        // Raw MJPEG stream, frames back to back
+        for (size_t i = 0; i + 2 < size;) {
+            size_t len = jpegEnd(d + i, size - i);
+            if (len == 0) {
+                i++;
+                continue;
+            }
+            clip.frames.push_back({d + i, len});
+            i += len;
+        }
+    }
+    if (clip.frames.empty()) {
+        fprintf(stderr, "No JPEG frames found in %s\n", clip.path.c_str());
+        return false;
+    }
+    int w = 0, h = 0;
+    static uint8_t thumb[MotionDetector::RESIZE_PIXELS * 4];
+    for (const Frame& fr : clip.frames) {
+        if (MotionDetector::decodeDCLuma(fr.data, fr.len, thumb, sizeof(thumb), &w, &h)) {
+            clip.width = w * 8;
+            clip.height = h * 8;
+            break;
+        }
+    }
+    return true;
+}
+
+// ===== Benchmarks =====
+
+static void benchMotion(const Clip& clip) {
+    jsonOpen("motion");
+    std::vector<uint32_t> dcUs;
+    std::vector<uint32_t> checkUs;
+    static uint8_t thumb[(1600 / 8) * (1200 / 8)];
+    int dcFailures = 0;
+    for (int pass = 0; pass < passes; pass++) {
+        for (const Frame& fr : clip.frames) {
+            int w, h;
+            int64_t t0 = esp_timer_get_time();
+            if (!MotionDetector::decodeDCLuma(fr.data, fr.len, thumb, sizeof(thumb), &w, &h)) {
+                dcFailures++;
+            }
+            dcUs.push_back(esp_timer_get_time() - t0);
+        }
+    }
+    jsonLatency("decode_dc", dcUs);
+    jsonInt("decode_failures", dcFailures);
+
+    // Detection replay: fresh detector per pass so every pass sees the same sequence
+    int motionFrames = 0;
+    uint32_t parseFailures = 0;
+    for (int pass = 0; pass < passes; pass++) {
+        MotionDetector md;
+        md.begin(max(clip.width, 8), max(clip.height, 8));
+        motionFrames = 0;
+        for (const Frame& fr : clip.frames) {
+            int64_t t0 = esp_timer_get_time();
+            bool motion = md.check(fr.data, fr.len);
+            checkUs.push_back(esp_timer_get_time() - t0);
+            if (motion) motionFrames++;
+        }
+        parseFailures = md.getParseFailures();
+    }
+    jsonLatency("check", checkUs);
+    jsonInt("motion_frames", motionFrames);
+    jsonInt("parse_failures", parseFailures);
+    jsonClose();
+}
+
+static bool benchAviWriter(const Clip& clip, const char* outPath) {
+    jsonOpen("avi_writer");
+    AviWriter avi(clip.frames.size() + 1);
+    SDWriteBuffer out(32 * 1024, 4096); // as SD_WRITE_BUFFER_BYTES / SD_WRITE_ALIGN_BYTES
+    if (!avi.begin() || !out.begin()) {
+        jsonStr("error", "allocation failed");
+        jsonClose();
+        return false;
+    }
+    std::vector<uint32_t> frameUs;
+    int64_t totalUs = 0;
+    uint64_t bytes = 0;
+    bool ok = true;
+    for (int pass = 0; pass < passes && ok; pass++) {
+        File file = SD.open(outPath, FILE_WRITE);
+        if (!file) {
+            ok = false;
+            break;
+        }
+        int64_t start = esp_timer_get_time();
+        out.attach(file);
+        ok = avi.openAvi(out);
+        uint32_t ms = 0;
+        for (const Frame& fr : clip.frames) {
+            int64_t t0 = esp_timer_get_time();
+            if (avi.writeFrame(out, fr.data, fr.len, ms) == 0) {
+                ok = false;
+                break;
+            }
+            frameUs.push_back(esp_timer_get_time() - t0);
+            ms += 100;
+        }
+        ok = ok && avi.closeAvi(out, file, 10.0f, clip.width, clip.height);
+        bytes = file.size();
+        file.close();
+        out.detach();
+        totalUs += esp_timer_get_time() - start;
+    }
+    jsonInt("ok", ok);
+    jsonInt("frames", avi.getFrameCount());
+    jsonInt("file_bytes", bytes);
+    jsonNum("mb_per_sec", mbPerSec(bytes * passes, totalUs));
+    jsonLatency("write_frame", frameUs);
+    const WriteLatencyStats& stats = out.getStats();
+    jsonInt("sd_writes", stats.writes);
+    jsonInt("sd_write_max_us", stats.maxUs);
+    jsonClose();
+    return ok;
+}
+
+static void benchPreview(const char* clipPath) {
+    jsonOpen("clip_preview");
+    ClipPreview preview(5, 0); // every 5th frame, JPEGs copied (no codec on the host)
+    if (!preview.begin()) {
+        jsonStr("error", "allocation failed");
+        jsonClose();
+        return;
+    }
+    std::vector<uint32_t> buildUs;
+    bool ok = true;
+    for (int pass = 0; pass < passes; pass++) {
+        int64_t t0 = esp_timer_get_time();
+        ok = preview.build(clipPath, "/bench_replay.pvw") && ok;
+        buildUs.push_back(esp_timer_get_time() - t0);
+    }
+    jsonInt("ok", ok);
+    jsonInt("frames", preview.getStats().lastFrames);
+    jsonInt("bytes", preview.getStats().lastBytes);
+    jsonLatency("build", buildUs);
+    jsonClose();
+    SD.remove("/bench_replay.pvw");
+}
+
+struct CatchupCount {
+    uint64_t bytes;
+    uint32_t chunks;
+    uint32_t checksum;
+};
+
+static bool catchupCount(void* ctx, const uint8_t* data, size_t len) {
+    CatchupCount* count = (CatchupCount*)ctx;
+    count->bytes += len;
+    count->chunks++;
+    count->checksum += data[len - 1];
+    return true;
+}
+
+static void benchCatchup(const char* clipPath) {
+    jsonOpen("catchup");
+    ClipCatchup catchup(UPLOAD_BLOCK);
+    if (!catchup.begin()) {
+        jsonStr("error", "allocation failed");
+        jsonClose();
+        return;
+    }
+    CatchupCount count = {0, 0, 0};
+    std::vector<uint32_t> sessionUs;
+    bool ok = true;
+    for (int pass = 0; pass < passes; pass++) {
+        int64_t t0 = esp_timer_get_time();
+        ok = catchup.startSession(catchupCount, &count) && ok;
+        ok = catchup.sendClip(clipPath, 0) && ok;
+        ok = catchup.finishSession(false) && ok;
+        sessionUs.push_back(esp_timer_get_time() - t0);
+    }
+    const ClipCatchup::Stats& stats = catchup.getStats();
+    jsonInt("ok", ok && stats.failures == 0);
+    jsonInt("frames", catchup.getSessionFrames());
+    jsonInt("bytes", count.bytes / max(passes, 1));
+    jsonLatency("session", sessionUs);
+    jsonNum("realtime_factor", stats.lastRealtimeFactor);
+    jsonInt("checksum", count.checksum);
+    jsonClose();
+}
+
+static void benchMultipart(const char* clipPath) {
+    jsonOpen("multipart");
+    std::vector<uint32_t> frameUs;
+    MultipartForm form;
+    for (int i = 0; i < 1000 * passes; i++) {
+        int64_t t0 = esp_timer_get_time();
+        form.begin("20260101_120000_motion.avi", random(10000, 99999));
+        frameUs.push_back(esp_timer_get_time() - t0);
+    }
+    jsonLatency("frame", frameUs);
+
+    // Whole body as sendFileBody() produces it, into a sink instead of a socket
+    std::vector<uint8_t> block(UPLOAD_BLOCK);
+    uint64_t bytes = 0;
+    uint32_t checksum = 0;
+    int64_t start = esp_timer_get_time();
+    for (int pass = 0; pass < passes; pass++) {
+        File file = SD.open(clipPath, FILE_READ);
+        if (!file) break;
+        size_t remaining = file.size();
+        checksum += form.getHead()[0];
+        bytes += form.getHeadLength();
+        while (remaining > 0) {
+            size_t n = file.read(block.data(), min(remaining, block.size()));
+            if (n == 0) break;
+            checksum += block[n - 1];
+            bytes += n;
+            remaining -= n;
+        }
+        bytes += form.getTailLength();
+        file.close();
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    jsonInt("body_bytes", bytes / max(passes, 1));
+    jsonNum("mb_per_sec", mbPerSec(bytes, elapsed));
+    jsonInt("checksum", checksum); // keeps the reads from being optimised away
+    jsonClose();
+}
+
+static void benchStorage() {
+    jsonOpen("storage");
+    // Synthetic clips, oldest first by name and mtime
+    std::vector<uint8_t> filler(STORAGE_FILE_BYTES, 0x5A);
+    UploadJournal journal("/bench_uploads.jnl", 64);
+    SD.remove("/bench_uploads.jnl");
+    journal.load();
+    std::vector<uint32_t> journalAddUs;
+    for (size_t i = 0; i < STORAGE_FILES; i++) {
+        char path[48];
+        snprintf(path, sizeof(path), "/bench_%05u.avi", (unsigned)i);
+        File f = SD.open(path, FILE_WRITE);
+        f.write(filler.data(), filler.size());
+        f.close();
+        int64_t t0 = esp_timer_get_time();
+        journal.add(path, UPLOAD_PRIORITY_SCHEDULED);
+        journalAddUs.push_back(esp_timer_get_time() - t0);
+    }
+    jsonInt("files", STORAGE_FILES);
+    jsonInt("file_bytes", STORAGE_FILE_BYTES);
+    jsonLatency("journal_add", journalAddUs);
+
+    UploadJournal replay("/bench_uploads.jnl", 64);
+    int64_t t0 = esp_timer_get_time();
+    replay.load();
+    jsonNum("journal_load_us", esp_timer_get_time() - t0);
+    jsonInt("journal_pending", replay.pendingCount());
+
+    CircularBuffer buffer(STORAGE_MAX_MB, 1, true);
+    t0 = esp_timer_get_time();
+    buffer.rebuildIndex();
+    jsonNum("index_rebuild_us", esp_timer_get_time() - t0);
+    jsonInt("indexed", buffer.countVideoFiles());
+
+    std::vector<uint32_t> oldestUs;
+    for (int i = 0; i < 1000; i++) {
+        int64_t s = esp_timer_get_time();
+        String oldest = buffer.getOldestVideoFile();
+        oldestUs.push_back(esp_timer_get_time() - s);
+    }
+    jsonLatency("get_oldest", oldestUs);
+
+    t0 = esp_timer_get_time();
+    bool ok = buffer.checkAndManageStorage(&replay);
+    int64_t evictUs = esp_timer_get_time() - t0;
+    jsonInt("ok", ok);
+    jsonNum("evict_us", evictUs);
+    jsonInt("remaining", buffer.countVideoFiles());
+    jsonInt("journal_after", replay.pendingCount());
+
+    // Recording start once eviction has caught up - cached numbers only
+    std::vector<uint32_t> checkUs;
+    for (int i = 0; i < 1000; i++) {
+        int64_t s = esp_timer_get_time();
+        buffer.checkAndManageStorage(&replay);
+        checkUs.push_back(esp_timer_get_time() - s);
+    }
+    jsonLatency("start_check", checkUs);
+    jsonClose();
+
+    // Leave the bench directory as it was
+    File root = SD.open("/");
+    std::vector<String> leftovers;
+    for (File f = root.openNextFile(); f; f = root.openNextFile()) {
+        String name = f.name();
+        if (name.indexOf("bench_") == 0) leftovers.push_back("/" + name);
+        f.close();
+    }
+    root.close();
+    for (const String& p : leftovers) SD.remove(p.c_str());
+}
+
+// Peak buffer sizes per subsystem over the whole run
+static void reportHeapTags() {
+    jsonOpen("heap_peak_bytes");
+    for (HeapTag* tag = HeapAccounting::first(); tag; tag = HeapAccounting::nextTag(tag)) {
+        if (tag->getAllocs() > 0) jsonInt(tag->getName(), tag->getPeakBytes());
+    }
+    jsonClose();
+}
+
+int main(int argc, char** argv) {
+    const char* sdRoot = "sdcard";
+    bool verbose = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "vn:d:")) != -1) {
+        switch (opt) {
+            case 'v': verbose = true; break;
+            case 'n': passes = max(1, atoi(optarg)); break;
+            case 'd': sdRoot = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-v] [-n passes] [-d sdroot] clip.avi [clip.avi ...]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-v] [-n passes] [-d sdroot] clip.avi [clip.avi ...]\n", argv[0]);
+        return 2;
+    }
+    Serial.quiet = !verbose;
+    SD.setRoot(sdRoot);
+    SD.setCapacity(16ULL * 1024 * 1024);
+    if (!SD.begin()) {
+        fprintf(stderr, "Cannot use %s as the SD card\n", sdRoot);
+        return 1;
+    }
+
+    bool ok = true;
+    jsonOpen(NULL);
+    jsonStr("tool", "edge_bench");
+    jsonInt("passes", passes);
+    jsonOpenArray("clips");
+    for (int i = optind; i < argc; i++) {
+        Clip clip;
+        clip.path = argv[i];
+        if (!loadClip(clip)) {
+            ok = false;
+            continue;
+        }
+        jsonOpen(NULL);
+        jsonStr("path", clip.path.c_str());
+        jsonInt("frames", clip.frames.size());
+        jsonInt("width", clip.width);
+        jsonInt("height", clip.height);
+        benchMotion(clip);
+        if (benchAviWriter(clip, "/bench_replay.avi")) {
+            benchPreview("/bench_replay.avi");
+            benchCatchup("/bench_replay.avi");
+            benchMultipart("/bench_replay.avi");
+        } else {
+            ok = false;
+        }
+        SD.remove("/bench_replay.avi");
+        jsonClose();
+    }
+    jsonCloseArray();
+    benchStorage();
+    reportHeapTags();
+    jsonClose();
+    printf("\n");
+    return ok ? 0 : 1;
+}
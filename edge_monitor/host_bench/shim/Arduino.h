@@ -0,0 +1,150 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Host (Linux) stand-in for the parts of the Arduino-ESP32 core the
+// portable edge_monitor modules use. Behaviour follows the core where the
+// modules depend on it (String, millis/micros, ps_malloc); everything
+// else is left out so a new dependency shows up as a build error.
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdarg.h>
+#include <time.h>
+#include <string>
+#include <algorithm>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+using std::min;
+using std::max;
+
+template <typename T, typename L, typename H>
+inline T constrain(T x, L lo, H hi) { return x < (T)lo ? (T)lo : (x > (T)hi ? (T)hi : x); }
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+inline void yield() {}
+long random(long howbig);
+long random(long howsmall, long howbig);
+
+inline void* ps_malloc(size_t size) { return malloc(size); }
+inline void* ps_calloc(size_t n, size_t size) { return calloc(n, size); }
+inline void* ps_realloc(void* ptr, size_t size) { return realloc(ptr, size); }
+// Host memory counts as PSRAM, so modules take their PSRAM paths
+inline bool psramFound() { return true; }
+
+class EspClass {
+public:
+    uint32_t getFreeHeap() const { return 256 * 1024; }
+    uint32_t getFreePsram() const { return 8 * 1024 * 1024; }
+    uint32_t getPsramSize() const { return 8 * 1024 * 1024; }
+};
+extern EspClass ESP;
+
+class String {
+private:
+    std::string s;
+
+public:
+    String() {}
+    String(const char* c) : s(c ? c : "") {}
+    String(const std::string& str) : s(str) {}
+    String(char c) : s(1, c) {}
+    String(int v) : s(std::to_string(v)) {}
+    String(unsigned int v) : s(std::to_string(v)) {}
+    String(long v) : s(std::to_string(v)) {}
+    String(unsigned long v) : s(std::to_string(v)) {}
+    String(long long v) : s(std::to_string(v)) {}
+    String(unsigned long long v) : s(std::to_string(v)) {}
+
+    const char* c_str() const { return s.c_str(); }
+    unsigned int length() const { return s.length(); }
+    bool reserve(unsigned int size) { s.reserve(size); return true; }
+    char operator[](unsigned int i) const { return i < s.length() ? s[i] : 0; }
+    char charAt(unsigned int i) const { return (*this)[i]; }
+
+    bool startsWith(const String& prefix) const { return s.compare(0, prefix.s.length(), prefix.s) == 0; }
+    bool endsWith(const String& suffix) const {
+        return s.length() >= suffix.s.length() &&
+               s.compare(s.length() - suffix.s.length(), suffix.s.length(), suffix.s) == 0;
+    }
+    int indexOf(char c, unsigned int from = 0) const {
+        size_t pos = s.find(c, from);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+    int indexOf(const String& str, unsigned int from = 0) const {
+        size_t pos = s.find(str.s, from);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+    int lastIndexOf(char c) const {
+        size_t pos = s.rfind(c);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+    String substring(unsigned int from) const { return from >= s.length() ? String() : String(s.substr(from)); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (to > s.length()) to = s.length();
+        return from >= to ? String() : String(s.substr(from, to - from));
+    }
+    void remove(unsigned int index) { if (index < s.length()) s.erase(index); }
+    void remove(unsigned int index, unsigned int count) { if (index < s.length()) s.erase(index, count); }
+    void trim() {
+        size_t start = s.find_first_not_of(" \t\r\n");
+        size_t end = s.find_last_not_of(" \t\r\n");
+        s = start == std::string::npos ? std::string() : s.substr(start, end - start + 1);
+    }
+    long toInt() const { return atol(s.c_str()); }
+
+    String& operator+=(const String& other) { s += other.s; return *this; }
+    String& operator+=(const char* other) { s += other; return *this; }
+    String& operator+=(char c) { s += c; return *this; }
+    friend String operator+(const String& a, const String& b) { return String(a.s + b.s); }
+    friend String operator+(const String& a, const char* b) { return String(a.s + b); }
+    friend String operator+(const char* a, const String& b) { return String(a + b.s); }
+    bool operator==(const String& other) const { return s == other.s; }
+    bool operator==(const char* other) const { return s == other; }
+    bool operator!=(const String& other) const { return s != other.s; }
+    bool operator<(const String& other) const { return s < other.s; }
+    bool equals(const String& other) const { return s == other.s; }
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(const uint8_t* buf, size_t len) = 0;
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t print(const String& str) { return write((const uint8_t*)str.c_str(), str.length()); }
+    size_t print(const char* str) { return write((const uint8_t*)str, strlen(str)); }
+    size_t println(const String& str = String()) { return print(str) + print("\n"); }
+    size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+        char stackBuf[256];
+        va_list args;
+        va_start(args, fmt);
+        int len = vsnprintf(stackBuf, sizeof(stackBuf), fmt, args);
+        va_end(args);
+        if (len < 0) return 0;
+        if ((size_t)len < sizeof(stackBuf)) return write((const uint8_t*)stackBuf, len);
+        char* heapBuf = (char*)malloc(len + 1);
+        va_start(args, fmt);
+        vsnprintf(heapBuf, len + 1, fmt, args);
+        va_end(args);
+        size_t n = write((const uint8_t*)heapBuf, len);
+        free(heapBuf);
+        return n;
+    }
+};
+
+// Module logging goes to stderr so bench output on stdout stays machine-readable
+class HostSerial : public Print {
+public:
+    bool quiet = false;
+    size_t write(const uint8_t* buf, size_t len) override { return quiet ? len : fwrite(buf, 1, len, stderr); }
+};
+extern HostSerial Serial;
+
+#endif // HOST_ARDUINO_H
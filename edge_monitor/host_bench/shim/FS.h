@@ -0,0 +1,75 @@
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+// Host stand-in for the Arduino-ESP32 FS File: a shared handle on a stdio
+// FILE or a directory under the host directory that plays the SD card.
+
+#include "Arduino.h"
+#include <memory>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+struct FileImpl;
+
+class File : public Print {
+private:
+    std::shared_ptr<FileImpl> impl;
+
+public:
+    File() {}
+    explicit File(std::shared_ptr<FileImpl> impl) : impl(impl) {}
+
+    size_t write(const uint8_t* buf, size_t len) override;
+    using Print::write;
+    size_t read(uint8_t* buf, size_t len);
+    int read();
+    size_t readBytes(char* buf, size_t len) { return read((uint8_t*)buf, len); }
+    String readStringUntil(char terminator);
+    int available();
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    void flush();
+    void close();
+    operator bool() const;
+
+    const char* name() const;
+    const char* path() const;
+    bool isDirectory() const;
+    File openNextFile(const char* mode = FILE_READ);
+    time_t getLastWrite();
+};
+
+class FS {
+public:
+    virtual ~FS() {}
+    virtual File open(const char* path, const char* mode = FILE_READ, bool create = false) = 0;
+    File open(const String& path, const char* mode = FILE_READ, bool create = false) {
+        return open(path.c_str(), mode, create);
+    }
+    virtual bool exists(const char* path) = 0;
+    bool exists(const String& path) { return exists(path.c_str()); }
+    virtual bool remove(const char* path) = 0;
+    bool remove(const String& path) { return remove(path.c_str()); }
+    virtual bool rename(const char* from, const char* to) = 0;
+    bool rename(const String& from, const String& to) { return rename(from.c_str(), to.c_str()); }
+    virtual bool mkdir(const char* path) = 0;
+    virtual bool rmdir(const char* path) = 0;
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+
+#endif // HOST_FS_H
@@ -0,0 +1,46 @@
+#ifndef HOST_SD_H
+#define HOST_SD_H
+
+// Host stand-in for the SD library: card paths map onto a host directory
+// (set with setRoot()) and the card capacity is a number, so storage
+// eviction can be driven without a card.
+
+#include "FS.h"
+
+typedef enum { CARD_NONE, CARD_MMC, CARD_SD, CARD_SDHC, CARD_UNKNOWN } sdcard_type_t;
+
+class SDFS : public fs::FS {
+private:
+    std::string root;
+    uint64_t capacity;
+
+public:
+    SDFS() : root("sdcard"), capacity(32ULL * 1024 * 1024 * 1024) {}
+
+    // Host side setup
+    void setRoot(const char* dir) { root = dir; }
+    void setCapacity(uint64_t bytes) { capacity = bytes; }
+    std::string hostPath(const char* path) const;
+
+    bool begin();
+    void end() {}
+    sdcard_type_t cardType() { return CARD_SDHC; }
+    uint64_t cardSize() { return capacity; }
+    uint64_t totalBytes() { return capacity; }
+    uint64_t usedBytes();
+
+    File open(const char* path, const char* mode = FILE_READ, bool create = false) override;
+    using fs::FS::open;
+    bool exists(const char* path) override;
+    using fs::FS::exists;
+    bool remove(const char* path) override;
+    using fs::FS::remove;
+    bool rename(const char* from, const char* to) override;
+    using fs::FS::rename;
+    bool mkdir(const char* path) override;
+    bool rmdir(const char* path) override;
+};
+
+extern SDFS SD;
+
+#endif // HOST_SD_H
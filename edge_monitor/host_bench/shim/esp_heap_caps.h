@@ -0,0 +1,34 @@
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+// Host stand-in for the ESP-IDF capability heap: one malloc heap, which
+// counts as PSRAM like ps_malloc() does in Arduino.h. Allocated sizes are
+// real (malloc_usable_size), so HeapTag accounting can be checked on the host.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <malloc.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+#ifndef ESP_OK
+#define ESP_OK 0
+#endif
+
+typedef void (*esp_alloc_failed_hook_t)(size_t size, uint32_t caps, const char* function_name);
+
+inline void* heap_caps_malloc(size_t size, uint32_t caps) { return malloc(size); }
+inline void* heap_caps_realloc(void* ptr, size_t size, uint32_t caps) { return realloc(ptr, size); }
+inline void heap_caps_free(void* ptr) { free(ptr); }
+inline size_t heap_caps_get_allocated_size(void* ptr) { return malloc_usable_size(ptr); }
+inline size_t heap_caps_get_total_size(uint32_t caps) { return (caps & MALLOC_CAP_SPIRAM) ? 8 * 1024 * 1024 : 0; }
+inline size_t heap_caps_get_free_size(uint32_t caps) { return heap_caps_get_total_size(caps); }
+inline size_t heap_caps_get_largest_free_block(uint32_t caps) { return heap_caps_get_total_size(caps); }
+inline size_t heap_caps_get_minimum_free_size(uint32_t caps) { return heap_caps_get_total_size(caps); }
+inline int heap_caps_register_failed_alloc_callback(esp_alloc_failed_hook_t hook) { return ESP_OK; }
+
+#endif // HOST_ESP_HEAP_CAPS_H
@@ -0,0 +1,7 @@
+#ifndef HOST_ESP_MEMORY_UTILS_H
+#define HOST_ESP_MEMORY_UTILS_H
+
+// Every host allocation is "PSRAM", see esp_heap_caps.h
+inline bool esp_ptr_external_ram(const void* ptr) { return true; }
+
+#endif // HOST_ESP_MEMORY_UTILS_H
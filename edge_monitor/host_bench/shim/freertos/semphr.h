@@ -0,0 +1,25 @@
+#ifndef HOST_SEMPHR_H
+#define HOST_SEMPHR_H
+
+#include "FreeRTOS.h"
+#include <mutex>
+
+// Real mutexes, so the locking cost stays in the timings
+typedef std::recursive_mutex* SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return new std::recursive_mutex(); }
+inline SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { return new std::recursive_mutex(); }
+inline void vSemaphoreDelete(SemaphoreHandle_t sem) { delete sem; }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    if (ticks == 0) {
+        return sem->try_lock() ? pdTRUE : pdFALSE;
+    }
+    sem->lock();
+    return pdTRUE;
+}
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    sem->unlock();
+    return pdTRUE;
+}
+
+#endif // HOST_SEMPHR_H
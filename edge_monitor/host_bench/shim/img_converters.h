@@ -0,0 +1,18 @@
+#ifndef HOST_IMG_CONVERTERS_H
+#define HOST_IMG_CONVERTERS_H
+
+// Host stand-in for esp32-camera's converters. There is no JPEG codec on
+// the host, so decode/encode report failure: ClipPreview only gets as
+// far as its copy path (scale 0), which is what the bench times.
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum { PIXFORMAT_RGB565, PIXFORMAT_YUV422, PIXFORMAT_GRAYSCALE, PIXFORMAT_JPEG, PIXFORMAT_RGB888 } pixformat_t;
+typedef enum { JPG_SCALE_NONE, JPG_SCALE_2X, JPG_SCALE_4X, JPG_SCALE_8X, JPG_SCALE_MAX = JPG_SCALE_8X } jpg_scale_t;
+typedef size_t (*jpg_out_cb)(void* arg, size_t index, const void* data, size_t len);
+
+inline bool jpg2rgb565(const uint8_t*, size_t, uint8_t*, jpg_scale_t) { return false; }
+inline bool fmt2jpg_cb(uint8_t*, size_t, uint16_t, uint16_t, pixformat_t, uint8_t, jpg_out_cb, void*) { return false; }
+
+#endif // HOST_IMG_CONVERTERS_H
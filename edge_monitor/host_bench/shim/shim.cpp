@@ -0,0 +1,218 @@
+#include "Arduino.h"
+#include "FS.h"
+#include "SD.h"
+#include "esp_timer.h"
+#include <chrono>
+#include <thread>
+#include <random>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+EspClass ESP;
+HostSerial Serial;
+SDFS SD;
+
+static const auto startTime = std::chrono::steady_clock::now();
+static std::mt19937 rng(12345); // fixed seed, runs are repeatable
+
+int64_t esp_timer_get_time() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long millis() { return (unsigned long)(esp_timer_get_time() / 1000); }
+unsigned long micros() { return (unsigned long)esp_timer_get_time(); }
+void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+long random(long howbig) {
+    return howbig <= 0 ? 0 : (long)(rng() % howbig);
+}
+
+long random(long howsmall, long howbig) {
+    return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall);
+}
+
+namespace fs {
+
+struct FileImpl {
+    FILE* fp = NULL;
+    DIR* dir = NULL;
+    std::string hostPath;
+    std::string cardPath;
+    std::string baseName;
+
+    ~FileImpl() {
+        if (fp) fclose(fp);
+        if (dir) closedir(dir);
+    }
+};
+
+size_t File::write(const uint8_t* buf, size_t len) {
+    return impl && impl->fp ? fwrite(buf, 1, len, impl->fp) : 0;
+}
+
+size_t File::read(uint8_t* buf, size_t len) {
+    return impl && impl->fp ? fread(buf, 1, len, impl->fp) : 0;
+}
+
+int File::read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+String File::readStringUntil(char terminator) {
+    std::string line;
+    int c;
+    while ((c = read()) >= 0 && c != terminator) {
+        line += (char)c;
+    }
+    return String(line);
+}
+
+int File::available() {
+    return impl && impl->fp ? (int)(size() - position()) : 0;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+    static const int whence[] = {SEEK_SET, SEEK_CUR, SEEK_END};
+    return impl && impl->fp && fseek(impl->fp, (long)pos, whence[mode]) == 0;
+}
+
+size_t File::position() const {
+    return impl && impl->fp ? (size_t)ftell(impl->fp) : 0;
+}
+
+size_t File::size() const {
+    if (!impl || !impl->fp) {
+        return 0;
+    }
+    fflush(impl->fp);
+    struct stat st;
+    return fstat(fileno(impl->fp), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+void File::flush() {
+    if (impl && impl->fp) fflush(impl->fp);
+}
+
+void File::close() {
+    // Other copies of the handle see it closed too, as on the device
+    if (impl) {
+        if (impl->fp) fclose(impl->fp);
+        if (impl->dir) closedir(impl->dir);
+        impl->fp = NULL;
+        impl->dir = NULL;
+    }
+    impl.reset();
+}
+
+File::operator bool() const {
+    return impl && (impl->fp || impl->dir);
+}
+
+const char* File::name() const {
+    return impl ? impl->baseName.c_str() : "";
+}
+
+const char* File::path() const {
+    return impl ? impl->cardPath.c_str() : "";
+}
+
+bool File::isDirectory() const {
+    return impl && impl->dir;
+}
+
+File File::openNextFile(const char* mode) {
+    if (!impl || !impl->dir) {
+        return File();
+    }
+    struct dirent* ent;
+    while ((ent = readdir(impl->dir)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+        std::string child = impl->cardPath;
+        if (child.empty() || child.back() != '/') child += '/';
+        child += ent->d_name;
+        return SD.open(child.c_str(), mode);
+    }
+    return File();
+}
+
+time_t File::getLastWrite() {
+    struct stat st;
+    return impl && stat(impl->hostPath.c_str(), &st) == 0 ? st.st_mtime : 0;
+}
+
+} // namespace fs
+
+std::string SDFS::hostPath(const char* path) const {
+    std::string p = root;
+    if (path[0] != '/') p += '/';
+    p += path;
+    return p;
+}
+
+bool SDFS::begin() {
+    ::mkdir(root.c_str(), 0755);
+    struct stat st;
+    return stat(root.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+uint64_t SDFS::usedBytes() {
+    // Flat walk of the root, the recorder keeps everything there
+    uint64_t used = 0;
+    DIR* dir = opendir(root.c_str());
+    if (dir == NULL) {
+        return 0;
+    }
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        struct stat st;
+        std::string p = root + "/" + ent->d_name;
+        if (stat(p.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            used += st.st_size;
+        }
+    }
+    closedir(dir);
+    return used;
+}
+
+File SDFS::open(const char* path, const char* mode, bool create) {
+    auto impl = std::make_shared<fs::FileImpl>();
+    impl->hostPath = hostPath(path);
+    impl->cardPath = path;
+    const char* slash = strrchr(path, '/');
+    impl->baseName = slash ? slash + 1 : path;
+
+    struct stat st;
+    if (strcmp(mode, FILE_READ) == 0 && stat(impl->hostPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        impl->dir = opendir(impl->hostPath.c_str());
+    } else {
+        // Binary on the host too; "r+" etc. pass straight through as on the device
+        std::string m = std::string(mode) + "b";
+        impl->fp = fopen(impl->hostPath.c_str(), m.c_str());
+    }
+    return (impl->fp || impl->dir) ? File(impl) : File();
+}
+
+bool SDFS::exists(const char* path) {
+    struct stat st;
+    return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool SDFS::remove(const char* path) {
+    return unlink(hostPath(path).c_str()) == 0;
+}
+
+bool SDFS::rename(const char* from, const char* to) {
+    return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool SDFS::mkdir(const char* path) {
+    return ::mkdir(hostPath(path).c_str(), 0755) == 0;
+}
+
+bool SDFS::rmdir(const char* path) {
+    return ::rmdir(hostPath(path).c_str()) == 0;
+}
@@ -0,0 +1,16 @@
+// ClipSidecar.cpp needs ArduinoJson and the JPEG encoder; CircularBuffer
+// only uses these two, which are kept in step with ClipSidecar.cpp.
+
+#include "../ClipSidecar.h"
+
+String ClipSidecar::pathFor(const String& aviPath) {
+    if (aviPath.endsWith(".avi")) {
+        return aviPath.substring(0, aviPath.length() - 4) + THUMB_EXT;
+    }
+    return aviPath + THUMB_EXT;
+}
+
+bool ClipSidecar::remove(const String& aviPath) {
+    String path = pathFor(aviPath);
+    return SD.exists(path.c_str()) && SD.remove(path.c_str());
+}
@@ -13,6 +13,8 @@
 #include "HTTPClient.h"
 #include "WiFiClientSecure.h"
 #include "time.h"
+#include <ArduinoJson.h>
+#include <algorithm>
 
 #define CAMERA_MODEL_XIAO_ESP32S3 // Has PSRAM
 
@@ -25,6 +27,27 @@ const int LED_PIN = LED_BUILTIN; // Built-in LED on XIAO ESP32S3
 const char* WIFI_SSID = "wwddOhYeah!";        
 const char* WIFI_PASSWORD = "wawadudu"; 
 
+// Benchmark mode - runs after the diagnostics, send 'b' on Serial to run it again
+const bool RUN_BENCHMARK = true;
+const char* UPLOAD_URL = "http://10.195.114.153:8000/upload"; // edge_monitor's UPLOAD_URL
+const char* BENCH_SD_FILE = "/bench.bin";
+const char* BENCH_CAPTURE_FILE = "/bench_capture.mjpeg";
+const size_t BENCH_SD_FILE_BYTES = 4 * 1024 * 1024;   // per block size, sequential
+const size_t BENCH_BLOCK_SIZES[] = {512, 4096, 32768};
+const int BENCH_RANDOM_OPS = 256;                      // per block size, random read/write
+const int BENCH_MAX_SAMPLES = 1024;                    // latency samples kept per test
+const framesize_t BENCH_FRAMESIZES[] = {FRAMESIZE_QVGA, FRAMESIZE_VGA, FRAMESIZE_SVGA,
+                                        FRAMESIZE_XGA, FRAMESIZE_SXGA, FRAMESIZE_UXGA}; // largest last
+const int BENCH_QUALITIES[] = {10, 12, 20, 30};
+const int BENCH_FRAMES = 10;                           // timed frames per framesize/quality
+const framesize_t BENCH_SUSTAIN_FRAMESIZE = FRAMESIZE_VGA;
+const int BENCH_SUSTAIN_QUALITY = 12;
+const unsigned long BENCH_SUSTAIN_MS = 10000;          // capture->SD run length
+const size_t BENCH_UPLOAD_BYTES = 512 * 1024;
+const int BENCH_UPLOAD_RUNS = 3;
+
+uint32_t benchSamples[BENCH_MAX_SAMPLES];
+
 void printCameraPins() {
   Serial.println("\n=== CAMERA PIN CONFIGURATION ===");
   Serial.printf("PWDN_GPIO_NUM: %d\n", PWDN_GPIO_NUM);
@@ -47,13 +70,7 @@ void printCameraPins() {
   Serial.println("===============================\n");
 }
 
-void testCameraInitialization() {
-  Serial.println("=== CAMERA DIAGNOSTIC TEST ===");
-  
-  // Print camera configuration
-  printCameraPins();
-  
-  // Test camera initialization with different configurations
+camera_config_t baseCameraConfig() {
   camera_config_t config;
   config.ledc_channel = LEDC_CHANNEL_0;
   config.ledc_timer = LEDC_TIMER_0;
@@ -80,6 +97,17 @@ void testCameraInitialization() {
   config.fb_location = CAMERA_FB_IN_PSRAM;
   config.jpeg_quality = 12;
   config.fb_count = 1;
+  return config;
+}
+
+void testCameraInitialization() {
+  Serial.println("=== CAMERA DIAGNOSTIC TEST ===");
+  
+  // Print camera configuration
+  printCameraPins();
+  
+  // Test camera initialization with different configurations
+  camera_config_t config = baseCameraConfig();
 
   Serial.println("Testing camera initialization...");
   esp_err_t err = esp_camera_init(&config);
@@ -253,6 +281,358 @@ void testSystemInfo() {
   Serial.println("===============================\n");
 }
 
+// ===== BENCHMARK MODE =====
+// Each bench* function fills one section of a single JSON report, so results
+// from different cards, supplies and APs can be diffed or loaded into a sheet.
+
+void addLatencySummary(JsonObject out, uint32_t* samples, int count) {
+  out["samples"] = count;
+  if (count == 0) {
+    return;
+  }
+  std::sort(samples, samples + count);
+  out["min_us"] = samples[0];
+  out["p50_us"] = samples[count / 2];
+  out["p95_us"] = samples[(count * 95) / 100];
+  out["p99_us"] = samples[(count * 99) / 100];
+  out["max_us"] = samples[count - 1];
+}
+
+float kbPerSec(uint64_t bytes, int64_t elapsedUs) {
+  return elapsedUs > 0 ? (bytes * 1000000.0f / 1024.0f) / elapsedUs : 0;
+}
+
+bool benchSDSequential(JsonObject out, uint8_t* buf, size_t block) {
+  int ops = BENCH_SD_FILE_BYTES / block;
+  int stride = (ops + BENCH_MAX_SAMPLES - 1) / BENCH_MAX_SAMPLES; // keep every stride-th latency
+  int n = 0;
+
+  File f = SD.open(BENCH_SD_FILE, FILE_WRITE);
+  if (!f) {
+    out["error"] = "open for write failed";
+    return false;
+  }
+  int64_t start = esp_timer_get_time();
+  for (int i = 0; i < ops; i++) {
+    int64_t t0 = esp_timer_get_time();
+    if (f.write(buf, block) != block) {
+      f.close();
+      out["error"] = "short write";
+      return false;
+    }
+    if (i % stride == 0 && n < BENCH_MAX_SAMPLES) {
+      benchSamples[n++] = esp_timer_get_time() - t0;
+    }
+  }
+  f.close(); // flush counts towards the write time
+  out["write_kbps"] = kbPerSec(BENCH_SD_FILE_BYTES, esp_timer_get_time() - start);
+  addLatencySummary(out["write_latency"].to<JsonObject>(), benchSamples, n);
+
+  n = 0;
+  f = SD.open(BENCH_SD_FILE, FILE_READ);
+  if (!f) {
+    out["error"] = "open for read failed";
+    return false;
+  }
+  start = esp_timer_get_time();
+  for (int i = 0; i < ops; i++) {
+    int64_t t0 = esp_timer_get_time();
+    if (f.read(buf, block) != block) {
+      f.close();
+      out["error"] = "short read";
+      return false;
+    }
+    if (i % stride == 0 && n < BENCH_MAX_SAMPLES) {
+      benchSamples[n++] = esp_timer_get_time() - t0;
+    }
+  }
+  out["read_kbps"] = kbPerSec(BENCH_SD_FILE_BYTES, esp_timer_get_time() - start);
+  f.close();
+  addLatencySummary(out["read_latency"].to<JsonObject>(), benchSamples, n);
+  return true;
+}
+
+void benchSDRandom(JsonObject out, uint8_t* buf, size_t block) {
+  // Runs on the file benchSDSequential left behind, block-aligned offsets
+  uint32_t blocks = BENCH_SD_FILE_BYTES / block;
+  int ops = min(BENCH_RANDOM_OPS, BENCH_MAX_SAMPLES);
+
+  File f = SD.open(BENCH_SD_FILE, "r+");
+  if (!f) {
+    out["error"] = "open for update failed";
+    return;
+  }
+  int64_t start = esp_timer_get_time();
+  for (int i = 0; i < ops; i++) {
+    int64_t t0 = esp_timer_get_time();
+    f.seek((uint64_t)(esp_random() % blocks) * block);
+    f.write(buf, block);
+    f.flush(); // otherwise the writes just land in the FAT cache
+    benchSamples[i] = esp_timer_get_time() - t0;
+  }
+  out["write_kbps"] = kbPerSec((uint64_t)ops * block, esp_timer_get_time() - start);
+  addLatencySummary(out["write_latency"].to<JsonObject>(), benchSamples, ops);
+
+  start = esp_timer_get_time();
+  for (int i = 0; i < ops; i++) {
+    int64_t t0 = esp_timer_get_time();
+    f.seek((uint64_t)(esp_random() % blocks) * block);
+    f.read(buf, block);
+    benchSamples[i] = esp_timer_get_time() - t0;
+  }
+  out["read_kbps"] = kbPerSec((uint64_t)ops * block, esp_timer_get_time() - start);
+  addLatencySummary(out["read_latency"].to<JsonObject>(), benchSamples, ops);
+  f.close();
+}
+
+void benchSD(JsonObject out) {
+  if (SD.cardType() == CARD_NONE) {
+    out["skipped"] = "SD card not available";
+    return;
+  }
+  out["card_mb"] = SD.cardSize() / (1024 * 1024);
+  out["file_bytes"] = BENCH_SD_FILE_BYTES;
+
+  size_t maxBlock = *std::max_element(std::begin(BENCH_BLOCK_SIZES), std::end(BENCH_BLOCK_SIZES));
+  uint8_t* buf = (uint8_t*)malloc(maxBlock); // internal RAM, as the recorder's write buffer would be
+  if (!buf) {
+    out["skipped"] = "no memory for block buffer";
+    return;
+  }
+  for (size_t i = 0; i < maxBlock; i++) {
+    buf[i] = (uint8_t)i;
+  }
+
+  JsonArray results = out["blocks"].to<JsonArray>();
+  for (size_t block : BENCH_BLOCK_SIZES) {
+    Serial.printf("BENCH: SD %u byte blocks...\n", (unsigned)block);
+    JsonObject entry = results.add<JsonObject>();
+    entry["block"] = block;
+    if (benchSDSequential(entry["sequential"].to<JsonObject>(), buf, block)) {
+      benchSDRandom(entry["random"].to<JsonObject>(), buf, block);
+    }
+  }
+  free(buf);
+  SD.remove(BENCH_SD_FILE);
+}
+
+bool initBenchCamera() {
+  // Buffers are sized for the init framesize, so start at the largest one benchmarked
+  esp_camera_deinit();
+  camera_config_t config = baseCameraConfig();
+  config.frame_size = BENCH_FRAMESIZES[sizeof(BENCH_FRAMESIZES) / sizeof(BENCH_FRAMESIZES[0]) - 1];
+  config.fb_count = 2; // continuous capture, as the recorder runs it
+  esp_err_t err = esp_camera_init(&config);
+  if (err != ESP_OK) {
+    Serial.printf("BENCH: camera init for benchmark FAILED: 0x%x\n", err);
+    return false;
+  }
+  return true;
+}
+
+void setBenchProfile(sensor_t* s, framesize_t framesize, int quality) {
+  s->set_framesize(s, framesize);
+  s->set_quality(s, quality);
+  // Frames already in the buffers were taken with the old settings
+  for (int i = 0; i < 2; i++) {
+    camera_fb_t* fb = esp_camera_fb_get();
+    if (fb) esp_camera_fb_return(fb);
+  }
+}
+
+void benchCamera(JsonObject out) {
+  sensor_t* s = esp_camera_sensor_get();
+  if (!s) {
+    out["skipped"] = "camera not available";
+    return;
+  }
+  out["sensor_pid"] = s->id.PID;
+  out["frames_per_test"] = BENCH_FRAMES;
+
+  JsonArray results = out["profiles"].to<JsonArray>();
+  for (framesize_t framesize : BENCH_FRAMESIZES) {
+    for (int quality : BENCH_QUALITIES) {
+      setBenchProfile(s, framesize, quality);
+      JsonObject entry = results.add<JsonObject>();
+      entry["framesize"] = (int)framesize;
+      entry["quality"] = quality;
+
+      int frames = 0;
+      int failures = 0;
+      uint64_t totalBytes = 0;
+      size_t minBytes = SIZE_MAX;
+      size_t maxBytes = 0;
+      int64_t start = esp_timer_get_time();
+      for (int i = 0; i < BENCH_FRAMES; i++) {
+        camera_fb_t* fb = esp_camera_fb_get();
+        if (!fb) {
+          failures++;
+          continue;
+        }
+        entry["width"] = fb->width;
+        entry["height"] = fb->height;
+        totalBytes += fb->len;
+        minBytes = min(minBytes, fb->len);
+        maxBytes = max(maxBytes, fb->len);
+        frames++;
+        esp_camera_fb_return(fb);
+      }
+      int64_t elapsed = esp_timer_get_time() - start;
+      entry["fps"] = elapsed > 0 ? frames * 1000000.0f / elapsed : 0;
+      entry["avg_bytes"] = frames ? (uint32_t)(totalBytes / frames) : 0;
+      entry["min_bytes"] = frames ? minBytes : 0;
+      entry["max_bytes"] = maxBytes;
+      entry["failures"] = failures;
+      Serial.printf("BENCH: framesize %d q%d: %.1f fps\n", framesize, quality, entry["fps"].as<float>());
+    }
+  }
+}
+
+void benchCaptureToSD(JsonObject out) {
+  sensor_t* s = esp_camera_sensor_get();
+  if (!s || SD.cardType() == CARD_NONE) {
+    out["skipped"] = "needs camera and SD card";
+    return;
+  }
+  setBenchProfile(s, BENCH_SUSTAIN_FRAMESIZE, BENCH_SUSTAIN_QUALITY);
+  out["framesize"] = (int)BENCH_SUSTAIN_FRAMESIZE;
+  out["quality"] = BENCH_SUSTAIN_QUALITY;
+  out["duration_ms"] = BENCH_SUSTAIN_MS;
+  Serial.printf("BENCH: capture to SD for %lu ms...\n", BENCH_SUSTAIN_MS);
+
+  File f = SD.open(BENCH_CAPTURE_FILE, FILE_WRITE);
+  if (!f) {
+    out["error"] = "open for write failed";
+    return;
+  }
+  int frames = 0;
+  int failures = 0;
+  int shortWrites = 0;
+  int n = 0;
+  uint64_t bytes = 0;
+  int64_t start = esp_timer_get_time();
+  int64_t end = start + BENCH_SUSTAIN_MS * 1000LL;
+  while (esp_timer_get_time() < end) {
+    camera_fb_t* fb = esp_camera_fb_get();
+    if (!fb) {
+      failures++;
+      continue;
+    }
+    int64_t t0 = esp_timer_get_time();
+    size_t written = f.write(fb->buf, fb->len);
+    if (n < BENCH_MAX_SAMPLES) {
+      benchSamples[n++] = esp_timer_get_time() - t0;
+    }
+    if (written != fb->len) shortWrites++;
+    bytes += written;
+    frames++;
+    esp_camera_fb_return(fb);
+  }
+  f.close();
+  int64_t elapsed = esp_timer_get_time() - start;
+  SD.remove(BENCH_CAPTURE_FILE);
+
+  out["frames"] = frames;
+  out["fps"] = elapsed > 0 ? frames * 1000000.0f / elapsed : 0;
+  out["kbps"] = kbPerSec(bytes, elapsed);
+  out["failed_captures"] = failures;
+  out["short_writes"] = shortWrites;
+  addLatencySummary(out["write_latency"].to<JsonObject>(), benchSamples, n);
+}
+
+void benchUpload(JsonObject out) {
+  if (WiFi.status() != WL_CONNECTED) {
+    out["skipped"] = "WiFi not connected";
+    return;
+  }
+  out["url"] = UPLOAD_URL;
+  out["rssi"] = WiFi.RSSI();
+  out["payload_bytes"] = BENCH_UPLOAD_BYTES;
+
+  // multipart/form-data the way /upload expects it, built once in PSRAM
+  const char* boundary = "----hwtestbench";
+  char head[160];
+  int headLen = snprintf(head, sizeof(head),
+                         "--%s\r\nContent-Disposition: form-data; name=\"file\"; filename=\"hw_test_bench.bin\"\r\n"
+                         "Content-Type: application/octet-stream\r\n\r\n", boundary);
+  char tail[32];
+  int tailLen = snprintf(tail, sizeof(tail), "\r\n--%s--\r\n", boundary);
+  size_t bodyLen = headLen + BENCH_UPLOAD_BYTES + tailLen;
+  uint8_t* body = (uint8_t*)(psramFound() ? ps_malloc(bodyLen) : malloc(bodyLen));
+  if (!body) {
+    out["skipped"] = "no memory for upload body";
+    return;
+  }
+  memcpy(body, head, headLen);
+  for (size_t i = 0; i < BENCH_UPLOAD_BYTES; i++) {
+    body[headLen + i] = (uint8_t)esp_random(); // incompressible
+  }
+  memcpy(body + headLen + BENCH_UPLOAD_BYTES, tail, tailLen);
+
+  char contentType[64];
+  snprintf(contentType, sizeof(contentType), "multipart/form-data; boundary=%s", boundary);
+  bool https = strncmp(UPLOAD_URL, "https", 5) == 0;
+  WiFiClientSecure secureClient;
+  secureClient.setInsecure(); // throughput, not certificate checks
+  float totalKbps = 0;
+  int ok = 0;
+  JsonArray runs = out["runs"].to<JsonArray>();
+  for (int i = 0; i < BENCH_UPLOAD_RUNS; i++) {
+    Serial.printf("BENCH: upload run %d/%d...\n", i + 1, BENCH_UPLOAD_RUNS);
+    HTTPClient http;
+    bool begun = https ? http.begin(secureClient, UPLOAD_URL) : http.begin(UPLOAD_URL);
+    JsonObject run = runs.add<JsonObject>();
+    if (!begun) {
+      run["error"] = "begin failed";
+      continue;
+    }
+    http.addHeader("Content-Type", contentType);
+    http.setTimeout(30000);
+    int64_t start = esp_timer_get_time();
+    int code = http.sendRequest("POST", body, bodyLen);
+    int64_t elapsed = esp_timer_get_time() - start;
+    http.end();
+    run["http_code"] = code;
+    run["ms"] = (uint32_t)(elapsed / 1000);
+    if (code >= 200 && code < 300) {
+      float kbps = kbPerSec(bodyLen, elapsed);
+      run["kbps"] = kbps;
+      totalKbps += kbps;
+      ok++;
+    }
+  }
+  free(body);
+  out["avg_kbps"] = ok ? totalKbps / ok : 0;
+  out["successful_runs"] = ok;
+}
+
+void runBenchmark() {
+  Serial.println("=== BENCHMARK MODE ===");
+  JsonDocument report;
+  report["tool"] = "hw_test";
+  JsonObject system = report["system"].to<JsonObject>();
+  system["chip"] = ESP.getChipModel();
+  system["cpu_mhz"] = ESP.getCpuFreqMHz();
+  system["psram_bytes"] = ESP.getPsramSize();
+  system["sdk"] = ESP.getSdkVersion();
+
+  benchSD(report["sd"].to<JsonObject>());
+  if (esp_camera_sensor_get() && !initBenchCamera()) {
+    report["camera"]["skipped"] = "camera re-init failed";
+  } else {
+    benchCamera(report["camera"].to<JsonObject>());
+  }
+  benchCaptureToSD(report["capture_to_sd"].to<JsonObject>());
+  benchUpload(report["upload"].to<JsonObject>());
+  system["free_heap"] = ESP.getFreeHeap();
+
+  // One line between markers, so it can be cut straight out of a serial log
+  Serial.println("=== BENCHMARK REPORT ===");
+  serializeJson(report, Serial);
+  Serial.println();
+  Serial.println("=== END BENCHMARK REPORT ===");
+}
+
 void setup() {
   Serial.begin(115200);
   while(!Serial);
@@ -281,9 +661,17 @@ void setup() {
   Serial.println("3. Check power supply (5V for camera, 3.3V for SD)");
   Serial.println("4. Try different SD card");
   Serial.println("5. Check for loose connections");
+  
+  if (RUN_BENCHMARK) {
+    runBenchmark();
+  }
 }
 
 void loop() {
+  if (Serial.available() && Serial.read() == 'b') {
+    runBenchmark();
+  }
+  
   // Blink LED to show system is running
   static unsigned long lastBlink = 0;
   if (millis() - lastBlink > 2000) {
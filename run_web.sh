@@ -1 +1 @@
-cd web && uvicorn app.main:app --host 0.0.0.0 --port 8000 --reload
+cd web && uvicorn app.main:app --host 0.0.0.0 --port 8000 --reload --timeout-keep-alive 75
@@ -72,11 +72,19 @@ async def log_requests(request: Request, call_next):
     
     return response
 
+# Resumable video uploads (/upload/status, /upload/resume) share the uploads dir
+from app import upload as resumable_upload
+resumable_upload.UPLOAD_FOLDER = str(BASE_DIR / "uploads")
+app.include_router(resumable_upload.resumable_router)
+
 
 
 # Global variables for device management
 connected_devices: Dict[str, Dict[str, Any]] = {}
 last_device_discovery = 0
+
+# Latest streamed image; "unchanged" heartbeats keep it current without a new upload
+snapshot_state: Dict[str, Any] = {"heartbeats": 0}
 DISCOVERY_INTERVAL = 30  # seconds
 
 # Device configuration storage
@@ -819,6 +827,12 @@ async def upload_image(request: Request):
         
         # Print full file path where image was saved
         full_path = str(file_path.absolute())
+        snapshot_state.update({
+            "last_image": filename,
+            "last_image_time": time.time(),
+            "last_seen_time": time.time(),
+            "unchanged": False,
+        })
         logger.info(f"Received image stream: {filename} ({len(content)} bytes)")
         logger.info(f"Image saved to: {full_path}")
         print(f"✓ Image uploaded and saved to: {full_path}")
@@ -834,6 +848,30 @@ async def upload_image(request: Request):
         logger.error(f"Image upload error: {e}")
         raise HTTPException(status_code=500, detail=str(e))
 
+@app.post("/api/upload-image/unchanged")
+async def upload_image_unchanged(request: Request):
+    """Heartbeat from an edge device whose scene hasn't changed since its last image"""
+    try:
+        info = await request.json()
+    except Exception:
+        info = {}
+    snapshot_state.update({
+        "last_seen_time": time.time(),
+        "unchanged": True,
+        "unchanged_since_ms": info.get("unchanged_since_ms"),
+        "changed_cells": info.get("changed_cells"),
+        "heartbeats": snapshot_state.get("heartbeats", 0) + 1,
+    })
+    return {"success": True, "last_image": snapshot_state.get("last_image")}
+
+@app.get("/api/upload-image/status")
+async def upload_image_status():
+    """Last image received and whether the device reports it as still current"""
+    state = dict(snapshot_state)
+    if state.get("last_seen_time"):
+        state["seconds_since_seen"] = round(time.time() - state["last_seen_time"], 1)
+    return state
+
 # Alternative endpoint for multipart file uploads (for compatibility)
 @app.post("/api/upload-image-file")
 async def upload_image_file(file: UploadFile = File(...)):
@@ -1010,15 +1048,18 @@ async def clear_server_files():
         raise HTTPException(status_code=500, detail=str(e))
 
 @app.get("/api/device/files")
-async def list_device_files():
-    """List files on the connected ESP32 device"""
+async def list_device_files(limit: int = 50, cursor: Optional[str] = None):
+    """List files on the connected ESP32 device, newest first, one page at a time"""
     try:
         device_url = get_primary_device()
         if not device_url:
             raise HTTPException(status_code=503, detail="No edge device connected")
         
-        # Get files from device
-        response = requests.get(f"{device_url}/files", timeout=10)
+        # Get one page of files from device; pass next_cursor back for the following page
+        params = {"limit": limit}
+        if cursor:
+            params["cursor"] = cursor
+        response = requests.get(f"{device_url}/files", params=params, timeout=10)
         response.raise_for_status()
         
         device_data = response.json()
@@ -1027,7 +1068,8 @@ async def list_device_files():
             "device_url": device_url,
             "files": device_data.get("files", []),
             "total_files": device_data.get("total_files", 0),
-            "upload_queue_size": device_data.get("upload_queue_size", 0)
+            "upload_queue_size": device_data.get("upload_queue_size", 0),
+            "next_cursor": device_data.get("next_cursor")
         }
     except Exception as e:
         logger.error(f"Device files error: {e}")
@@ -1,13 +1,23 @@
 import os
+import json
 import shutil
+import asyncio
 import requests
+from contextlib import asynccontextmanager
 from fastapi import APIRouter, File, UploadFile, Request, HTTPException
-from fastapi.responses import HTMLResponse
+from fastapi.responses import HTMLResponse, JSONResponse
+from starlette.concurrency import run_in_threadpool
+from starlette.requests import ClientDisconnect
 
 UPLOAD_FOLDER = "shared/uploads"
 
 router = APIRouter()
 
+# Resumable uploads: partial files live in <UPLOAD_FOLDER>/partial until complete.
+# Mounted by main.py as well, which points UPLOAD_FOLDER at its own uploads dir.
+resumable_router = APIRouter()
+_upload_locks = {}  # filename -> [lock, requests using it], dropped when the last one finishes
+
 @router.get("/", response_class=HTMLResponse)
 async def upload_form():
     return """
@@ -36,3 +46,107 @@ async def upload_file(file: UploadFile = File(...)):
         print("Processor service not reachable.")
 
     return {"message": "Upload successful", "filename": file.filename}
+
+
+def _partial_paths(filename: str):
+    """Paths of the partial data file and its metadata for an upload"""
+    safe_name = os.path.basename(filename)
+    if not safe_name or safe_name in (".", ".."):
+        raise HTTPException(status_code=400, detail="Invalid filename")
+    partial_dir = os.path.join(UPLOAD_FOLDER, "partial")
+    os.makedirs(partial_dir, exist_ok=True)
+    part_path = os.path.join(partial_dir, safe_name + ".part")
+    return safe_name, part_path, part_path + ".json"
+
+
+def _committed_offset(filename: str, size: int) -> int:
+    """Bytes already held for this file, resetting the partial if the size changed"""
+    safe_name, part_path, meta_path = _partial_paths(filename)
+    final_path = os.path.join(UPLOAD_FOLDER, safe_name)
+    if not os.path.exists(part_path) and os.path.exists(final_path) and os.path.getsize(final_path) == size:
+        return size  # Already complete (device rebooted before deleting its copy)
+
+    meta = {}
+    if os.path.exists(meta_path):
+        with open(meta_path) as f:
+            meta = json.load(f)
+    if meta.get("size") != size or not os.path.exists(part_path):
+        # New upload (or a different file under the same name) - start over
+        with open(part_path, "wb"):
+            pass
+        with open(meta_path, "w") as f:
+            json.dump({"size": size}, f)
+        return 0
+    return os.path.getsize(part_path)
+
+
+@asynccontextmanager
+async def _upload_lock(filename: str):
+    """Serialise requests for one upload; the entry only lives while requests hold or wait on it"""
+    name = os.path.basename(filename)
+    entry = _upload_locks.setdefault(name, [asyncio.Lock(), 0])
+    entry[1] += 1
+    try:
+        async with entry[0]:
+            yield
+    finally:
+        entry[1] -= 1
+        if entry[1] == 0:
+            del _upload_locks[name]
+
+
+def _finalize_upload(filename: str) -> str:
+    safe_name, part_path, meta_path = _partial_paths(filename)
+    final_path = os.path.join(UPLOAD_FOLDER, safe_name)
+    os.replace(part_path, final_path)
+    os.remove(meta_path)
+    return final_path
+
+
+@resumable_router.get("/upload/status")
+async def upload_status(filename: str, size: int):
+    """Committed offset for a resumable upload - the device continues from here"""
+    async with _upload_lock(filename):
+        offset = _committed_offset(filename, size)
+    return {"filename": os.path.basename(filename), "offset": offset, "size": size, "complete": offset >= size}
+
+
+@resumable_router.put("/upload/resume")
+async def upload_resume(request: Request, filename: str, offset: int, size: int):
+    """Append a raw byte range to a partial upload; bytes are committed as they arrive"""
+    async with _upload_lock(filename):
+        committed = _committed_offset(filename, size)
+        if offset != committed:
+            return JSONResponse(status_code=409, content={"detail": "Offset mismatch", "offset": committed})
+
+        safe_name, part_path, _ = _partial_paths(filename)
+        received = 0
+        try:
+            with open(part_path, "ab") as buffer:
+                async for chunk in request.stream():
+                    if committed + received + len(chunk) > size:
+                        raise HTTPException(status_code=400, detail="Data beyond declared size")
+                    buffer.write(chunk)
+                    received += len(chunk)
+                buffer.flush()
+                os.fsync(buffer.fileno())
+        except ClientDisconnect:
+            # Keep what arrived, the device asks for the offset and resumes
+            print(f"Upload of {safe_name} interrupted at {committed + received}/{size} bytes")
+            return JSONResponse(status_code=400, content={"detail": "Client disconnected", "offset": committed + received})
+
+        offset = committed + received
+        if offset < size:
+            return {"message": "Partial upload stored", "filename": safe_name, "offset": offset, "size": size}
+
+        final_path = _finalize_upload(filename)
+
+    print(f"✓ Resumable upload complete: {os.path.abspath(final_path)}")
+    try:
+        # Blocking client, kept off the event loop
+        await run_in_threadpool(requests.post, "http://processor:5000/process",
+                                json={"filename": safe_name}, timeout=10)
+    except:
+        print("Processor service not reachable.")
+    return {"message": "Upload successful", "filename": safe_name, "offset": size, "size": size,
+            "file_path": os.path.abspath(final_path)}